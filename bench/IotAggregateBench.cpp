@@ -0,0 +1,78 @@
+#include "bench.h"
+#include "data/aggregate.h"
+#include <vector>
+
+namespace {
+
+// Pre-generated noisy sensor values so the benchmark measures the aggregator
+const std::vector<double>& samples()
+{
+    static const std::vector<double> values = [] {
+        std::vector<double> v(4096);
+        uint32_t state = 12345;
+        for (double& x : v) {
+            state = state * 1664525u + 1013904223u;
+            x = 20.0 + (double)(state >> 8) / (double)(1u << 24) * 10.0;
+        }
+        return v;
+    }();
+    return values;
+}
+
+void count_summary(void* ctx, IO* summary)
+{
+    (void)summary;
+    ++*static_cast<uint64_t*>(ctx);
+}
+
+void record(iot_bench::State& state, enum io_window_type type)
+{
+    struct io_window_config config = {};
+    config.type = type;
+    config.length_ms = 60000;
+    config.step_ms = 10000;
+    uint64_t emitted = 0;
+    IOAggregator* agg = io_aggregator_create(&config, count_summary, &emitted);
+    int metric = io_aggregator_add_metric(agg, "temperature");
+    const std::vector<double>& values = samples();
+
+    // 1 kHz sampling: a window closes every 60000 (tumbling) or 10000 (sliding) samples
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        io_aggregator_record(agg, metric, (int64_t)i, values[i & 4095]);
+    }
+    state.set_counter("windows", (double)emitted);
+    io_aggregator_destroy(agg);
+}
+
+} // namespace
+
+void BM_SketchAdd(iot_bench::State& state)
+{
+    IOSketch sketch;
+    io_sketch_reset(&sketch);
+    const std::vector<double>& values = samples();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        io_sketch_add(&sketch, values[i & 4095]);
+    }
+    iot_bench::do_not_optimize(sketch);
+}
+IOT_BENCHMARK(BM_SketchAdd);
+
+void BM_SketchQuantile(iot_bench::State& state)
+{
+    IOSketch sketch;
+    io_sketch_reset(&sketch);
+    for (double v : samples()) {
+        io_sketch_add(&sketch, v);
+    }
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        iot_bench::do_not_optimize(io_sketch_quantile(&sketch, 0.99));
+    }
+}
+IOT_BENCHMARK(BM_SketchQuantile);
+
+void BM_AggregateTumbling(iot_bench::State& state) { record(state, IO_WINDOW_TUMBLING); }
+IOT_BENCHMARK(BM_AggregateTumbling);
+
+void BM_AggregateSliding(iot_bench::State& state) { record(state, IO_WINDOW_SLIDING); }
+IOT_BENCHMARK(BM_AggregateSliding);
@@ -0,0 +1,100 @@
+#include "bench.h"
+#include "data/serialize.h"
+
+namespace {
+
+const int kSamples = 60; // One minute at 1 Hz
+
+double sample_temperature(int i)
+{
+    return 21.0 + (i / 10) * 0.5 + ((i % 4 == 0) ? 0.25 : 0.0);
+}
+
+IOBatch* make_batch()
+{
+    IOBatch* batch = io_batch_create();
+    int temperature = io_batch_add_series(batch, "temperature", IO_SERIES_DOUBLE);
+    int rssi = io_batch_add_series(batch, "rssi", IO_SERIES_INT64);
+    for (int i = 0; i < kSamples; i++) {
+        int64_t ts = 1700000000000 + i * 1000;
+        io_batch_append_double(batch, temperature, ts, sample_temperature(i));
+        io_batch_append_int(batch, rssi, ts, -67 - (i % 3));
+    }
+    return batch;
+}
+
+void encode(iot_bench::State& state, enum io_batch_format format)
+{
+    IOBatch* batch = make_batch();
+    uint8_t buffer[4096];
+    size_t length = 0;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        io_batch_serialize(batch, format, buffer, sizeof(buffer), &length);
+        iot_bench::do_not_optimize(buffer);
+    }
+    state.set_counter("encoded_bytes", (double)length);
+    state.set_counter("messages", 1);
+    io_batch_destroy(batch);
+}
+
+} // namespace
+
+// Baseline: one JSON object (and one publish) per sample
+void BM_PerSampleJson(iot_bench::State& state)
+{
+    uint8_t buffer[256];
+    size_t total = 0;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        total = 0;
+        for (int s = 0; s < kSamples; s++) {
+            IO* obj = io_create();
+            cJSON_AddNumberToObject(obj->json_obj, "ts", 1700000000000.0 + s * 1000);
+            cJSON_AddNumberToObject(obj->json_obj, "temperature", sample_temperature(s));
+            io_add_int(obj, "rssi", -67 - (s % 3));
+            size_t length = 0;
+            io_serialize(obj, IO_FORMAT_JSON, buffer, sizeof(buffer), &length);
+            iot_bench::do_not_optimize(buffer);
+            total += length;
+            io_destroy(obj);
+        }
+    }
+    state.set_counter("encoded_bytes", (double)total);
+    state.set_counter("messages", kSamples);
+}
+IOT_BENCHMARK(BM_PerSampleJson);
+
+void BM_BatchGorilla(iot_bench::State& state) { encode(state, IO_BATCH_FORMAT_GORILLA); }
+IOT_BENCHMARK(BM_BatchGorilla);
+
+void BM_BatchJson(iot_bench::State& state) { encode(state, IO_BATCH_FORMAT_JSON); }
+IOT_BENCHMARK(BM_BatchJson);
+
+void BM_BatchAppend(iot_bench::State& state)
+{
+    IOBatch* batch = io_batch_create();
+    int temperature = io_batch_add_series(batch, "temperature", IO_SERIES_DOUBLE);
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        if ((i % kSamples) == 0) {
+            io_batch_clear(batch);
+        }
+        io_batch_append_double(batch, temperature, (int64_t)i * 1000, sample_temperature((int)(i % kSamples)));
+    }
+    io_batch_destroy(batch);
+}
+IOT_BENCHMARK(BM_BatchAppend);
+
+void BM_BatchDecodeGorilla(iot_bench::State& state)
+{
+    IOBatch* batch = make_batch();
+    uint8_t buffer[4096];
+    size_t length = 0;
+    io_batch_serialize(batch, IO_BATCH_FORMAT_GORILLA, buffer, sizeof(buffer), &length);
+    io_batch_destroy(batch);
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        IOBatch* decoded = io_batch_deserialize(buffer, length);
+        iot_bench::do_not_optimize(decoded);
+        io_batch_destroy(decoded);
+    }
+    state.set_bytes_processed(length * state.iterations());
+}
+IOT_BENCHMARK(BM_BatchDecodeGorilla);
@@ -0,0 +1,53 @@
+/*
+ * Nanoseconds per call of each clock in interface/clock.h, next to the
+ * raw clock_gettime costs in IotPlatformBench.cpp: the monotonic and wall
+ * clocks, the coarse clock meant for hot-path timeouts, the cycle counter
+ * meant for profiling, and iot_get_time, which adds a division.
+ */
+
+#include "bench.h"
+#include "interface/clock.h"
+
+namespace {
+
+template <uint64_t (*read)(void)>
+void read_clock(iot_bench::State& state)
+{
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        sum += read();
+    }
+    iot_bench::do_not_optimize(sum);
+}
+
+} // namespace
+
+void BM_TimeMonotonicNs(iot_bench::State& state) { read_clock<iot_time_monotonic_ns>(state); }
+IOT_BENCHMARK(BM_TimeMonotonicNs);
+
+void BM_TimeRealtimeNs(iot_bench::State& state) { read_clock<iot_time_realtime_ns>(state); }
+IOT_BENCHMARK(BM_TimeRealtimeNs);
+
+void BM_TimeCoarseNs(iot_bench::State& state)
+{
+    read_clock<iot_time_coarse_ns>(state);
+    state.set_counter("resolution_ns", static_cast<double>(iot_time_coarse_resolution_ns()));
+}
+IOT_BENCHMARK(BM_TimeCoarseNs);
+
+void BM_Cycles(iot_bench::State& state)
+{
+    read_clock<iot_cycles>(state);
+    state.set_counter("cycles_per_ns", static_cast<double>(iot_cycles_per_second()) / 1e9);
+}
+IOT_BENCHMARK(BM_Cycles);
+
+void BM_GetTimeMilliseconds(iot_bench::State& state)
+{
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        sum += iot_get_time(IOT_TIME_MILLISECONDS);
+    }
+    iot_bench::do_not_optimize(sum);
+}
+IOT_BENCHMARK(BM_GetTimeMilliseconds);
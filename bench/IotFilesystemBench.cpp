@@ -0,0 +1,383 @@
+/*
+ * Reading a large file, as when verifying an OTA image: copying chunks out
+ * with iot_fread against reading it in place through iot_fmap. The file
+ * stays in the page cache, so this measures the syscall and copy costs
+ * the mapping avoids, not the disk.
+ *
+ * Appending small records, as the log and telemetry spools do: one
+ * backend write per iot_fwrite against files from iot_fopen_buffered.
+ *
+ * Random 4 KiB reads through iot_aio at several queue depths, on io_uring
+ * and on the thread pool, against blocking iot_fread at depth one.
+ *
+ * Listing a spool directory of 10,000 segments with sizes: iot_readdir,
+ * iot_is_file and iot_stat per entry against bulk iot_dirscan_read, with
+ * and without a glob that selects a tenth of them.
+ */
+
+#include "bench.h"
+#include "interface/filesystem.h"
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const size_t kFileSize = 16 * 1024 * 1024;
+
+// Creates the file on first use and deletes it at exit
+class ImageFile {
+public:
+    ImageFile()
+    {
+        char tmpl[] = "/tmp/iot_fs_bench_XXXXXX";
+        int fd = mkstemp(tmpl);
+        if (fd < 0) {
+            std::abort();
+        }
+        close(fd);
+        path = tmpl;
+
+        std::vector<unsigned char> chunk(1024 * 1024);
+        for (size_t i = 0; i < chunk.size(); i++) {
+            chunk[i] = static_cast<unsigned char>(i * 31);
+        }
+        struct iot_file* file = iot_fopen(path.c_str(), "wb");
+        for (size_t written = 0; file != nullptr && written < kFileSize; written += chunk.size()) {
+            iot_fwrite(chunk.data(), 1, chunk.size(), file);
+        }
+        iot_fclose(file);
+    }
+
+    ~ImageFile() { iot_remove(path.c_str()); }
+
+    std::string path;
+};
+
+const ImageFile& image()
+{
+    static const ImageFile file;
+    return file;
+}
+
+// Stand-in for hashing the image: touches every byte, eight at a time
+uint64_t checksum(const unsigned char* data, size_t size)
+{
+    uint64_t sum = 0;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        sum += word;
+    }
+    for (; i < size; i++) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+// Read the whole file through a chunk-sized buffer
+void read_scan(iot_bench::State& state, size_t chunk_size)
+{
+    std::vector<unsigned char> buffer(chunk_size);
+    struct iot_file* file = iot_fopen(image().path.c_str(), "rb");
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        iot_fseek(file, 0);
+        uint64_t sum = 0;
+        size_t n;
+        while ((n = iot_fread(buffer.data(), 1, buffer.size(), file)) > 0) {
+            sum += checksum(buffer.data(), n);
+        }
+        iot_bench::do_not_optimize(sum);
+    }
+    iot_fclose(file);
+    state.set_bytes_processed(kFileSize * state.iterations());
+}
+
+// Append record_size-byte records, rewinding every kSpoolSize bytes so the file stays small
+void append_records(iot_bench::State& state, struct iot_file* file, size_t record_size)
+{
+    const size_t kSpoolSize = 4 * 1024 * 1024;
+    std::vector<unsigned char> record(record_size, 'r');
+    size_t offset = 0;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        iot_fwrite(record.data(), 1, record.size(), file);
+        offset += record.size();
+        if (offset >= kSpoolSize) {
+            iot_fseek(file, 0);
+            offset = 0;
+        }
+    }
+    iot_fflush(file);
+    state.set_bytes_processed(record_size * state.iterations());
+}
+
+std::string spool_path()
+{
+    return image().path + ".spool";
+}
+
+void write_unbuffered(iot_bench::State& state, size_t record_size)
+{
+    struct iot_file* file = iot_fopen(spool_path().c_str(), "w");
+    append_records(state, file, record_size);
+    iot_fclose(file);
+    iot_remove(spool_path().c_str());
+}
+
+void write_buffered(iot_bench::State& state, size_t record_size)
+{
+    struct iot_file* file = iot_fopen_buffered(spool_path().c_str(), "w", nullptr);
+    append_records(state, file, record_size);
+    iot_fclose(file);
+    iot_remove(spool_path().c_str());
+}
+
+// Keeps depth random block reads in flight until iterations have completed
+struct AioReader {
+    struct iot_aio* aio;
+    struct iot_file* file;
+    std::vector<unsigned char> buffers;
+    std::vector<std::pair<AioReader*, size_t>> slots; // Callback argument per buffer
+    uint64_t issued = 0;
+    uint64_t completed = 0;
+    uint64_t limit;
+    uint64_t rng = 0x9e3779b97f4a7c15ull;
+
+    static const size_t kBlock = 4096;
+
+    void issue(size_t slot)
+    {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        uint64_t offset = (rng % (kFileSize / kBlock)) * kBlock;
+        issued++;
+        iot_aio_read(aio, file, buffers.data() + slot * kBlock, kBlock, offset, on_read, &slots[slot]);
+    }
+
+    static void on_read(void* user_data, int64_t result)
+    {
+        auto* slot = static_cast<std::pair<AioReader*, size_t>*>(user_data);
+        AioReader* reader = slot->first;
+        reader->completed++;
+        iot_bench::do_not_optimize(result);
+        if (reader->issued < reader->limit) {
+            reader->issue(slot->second);
+        }
+    }
+};
+
+void aio_random_read(iot_bench::State& state, enum iot_aio_backend backend, uint32_t depth)
+{
+    struct iot_aio_config config = { depth, depth < 16 ? depth : 16, backend };
+    struct iot_aio* aio = iot_aio_create(&config);
+    if (aio == nullptr) {
+        state.set_counter("unavailable", 1);
+        return;
+    }
+    AioReader reader;
+    reader.aio = aio;
+    reader.file = iot_fopen(image().path.c_str(), "rb");
+    reader.buffers.resize(depth * AioReader::kBlock);
+    reader.limit = state.iterations();
+    for (size_t i = 0; i < depth; i++) {
+        reader.slots.emplace_back(&reader, i);
+    }
+    for (size_t i = 0; i < depth && reader.issued < reader.limit; i++) {
+        reader.issue(i);
+    }
+    while (reader.completed < reader.limit && iot_aio_complete(aio, -1) >= 0) {
+    }
+    iot_aio_destroy(aio);
+    iot_fclose(reader.file);
+    state.set_bytes_processed(AioReader::kBlock * state.iterations());
+}
+
+} // namespace
+
+// Blocking reads of random 4 KiB blocks, the depth-one baseline for the iot_aio benchmarks
+void BM_FsRandomRead4KSync(iot_bench::State& state)
+{
+    std::vector<unsigned char> buffer(4096);
+    struct iot_file* file = iot_fopen(image().path.c_str(), "rb");
+    uint64_t rng = 0x9e3779b97f4a7c15ull;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        iot_fseek(file, static_cast<long>((rng % (kFileSize / buffer.size())) * buffer.size()));
+        iot_bench::do_not_optimize(iot_fread(buffer.data(), 1, buffer.size(), file));
+    }
+    iot_fclose(file);
+    state.set_bytes_processed(buffer.size() * state.iterations());
+}
+IOT_BENCHMARK(BM_FsRandomRead4KSync);
+
+void BM_FsAioUringQd1(iot_bench::State& state) { aio_random_read(state, IOT_AIO_URING, 1); }
+IOT_BENCHMARK(BM_FsAioUringQd1);
+
+void BM_FsAioUringQd8(iot_bench::State& state) { aio_random_read(state, IOT_AIO_URING, 8); }
+IOT_BENCHMARK(BM_FsAioUringQd8);
+
+void BM_FsAioUringQd32(iot_bench::State& state) { aio_random_read(state, IOT_AIO_URING, 32); }
+IOT_BENCHMARK(BM_FsAioUringQd32);
+
+void BM_FsAioThreadsQd1(iot_bench::State& state) { aio_random_read(state, IOT_AIO_THREADS, 1); }
+IOT_BENCHMARK(BM_FsAioThreadsQd1);
+
+void BM_FsAioThreadsQd8(iot_bench::State& state) { aio_random_read(state, IOT_AIO_THREADS, 8); }
+IOT_BENCHMARK(BM_FsAioThreadsQd8);
+
+void BM_FsAioThreadsQd32(iot_bench::State& state) { aio_random_read(state, IOT_AIO_THREADS, 32); }
+IOT_BENCHMARK(BM_FsAioThreadsQd32);
+
+void BM_FsWrite32Unbuffered(iot_bench::State& state) { write_unbuffered(state, 32); }
+IOT_BENCHMARK(BM_FsWrite32Unbuffered);
+
+void BM_FsWrite32Buffered(iot_bench::State& state) { write_buffered(state, 32); }
+IOT_BENCHMARK(BM_FsWrite32Buffered);
+
+void BM_FsWrite256Unbuffered(iot_bench::State& state) { write_unbuffered(state, 256); }
+IOT_BENCHMARK(BM_FsWrite256Unbuffered);
+
+void BM_FsWrite256Buffered(iot_bench::State& state) { write_buffered(state, 256); }
+IOT_BENCHMARK(BM_FsWrite256Buffered);
+
+void BM_FsReadScan4K(iot_bench::State& state) { read_scan(state, 4096); }
+IOT_BENCHMARK(BM_FsReadScan4K);
+
+void BM_FsReadScan64K(iot_bench::State& state) { read_scan(state, 64 * 1024); }
+IOT_BENCHMARK(BM_FsReadScan64K);
+
+// Map, scan and unmap the whole file each iteration, paying the page faults every time
+void BM_FsMapScan(iot_bench::State& state)
+{
+    struct iot_file* file = iot_fopen(image().path.c_str(), "rb");
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        struct iot_fmap* map = iot_fmap(file, 0, 0, IOT_FMAP_SEQUENTIAL);
+        uint64_t sum = checksum(static_cast<const unsigned char*>(iot_fmap_data(map)), iot_fmap_size(map));
+        iot_bench::do_not_optimize(sum);
+        iot_funmap(map);
+    }
+    iot_fclose(file);
+    state.set_bytes_processed(kFileSize * state.iterations());
+}
+IOT_BENCHMARK(BM_FsMapScan);
+
+// Scan a mapping that is kept open, as a long-lived certificate bundle would be
+void BM_FsMapScanResident(iot_bench::State& state)
+{
+    struct iot_file* file = iot_fopen(image().path.c_str(), "rb");
+    struct iot_fmap* map = iot_fmap(file, 0, 0, IOT_FMAP_WILLNEED);
+    iot_fclose(file);
+    const unsigned char* data = static_cast<const unsigned char*>(iot_fmap_data(map));
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        uint64_t sum = checksum(data, iot_fmap_size(map));
+        iot_bench::do_not_optimize(sum);
+    }
+    iot_funmap(map);
+    state.set_bytes_processed(kFileSize * state.iterations());
+}
+IOT_BENCHMARK(BM_FsMapScanResident);
+
+namespace {
+
+const int kSpoolFiles = 10000;
+
+// A directory of small segment files, created at startup and removed at exit
+class SpoolDir {
+public:
+    SpoolDir()
+    {
+        char tmpl[] = "/tmp/iot_fs_bench_spool_XXXXXX";
+        if (mkdtemp(tmpl) == nullptr) {
+            std::abort();
+        }
+        path = tmpl;
+        for (int i = 0; i < kSpoolFiles; i++) {
+            std::string name = path + "/seg-" + std::to_string(i) + (i % 10 == 0 ? ".idx" : ".dat");
+            struct iot_file* file = iot_fopen(name.c_str(), "w");
+            iot_fwrite(name.data(), 1, name.size(), file);
+            iot_fclose(file);
+        }
+    }
+
+    ~SpoolDir() { iot_rmdir_recursive(path.c_str()); }
+
+    std::string path;
+};
+
+// Built before main so the 10,000 creates stay out of the first timed run
+const SpoolDir g_spool;
+
+const SpoolDir& spool()
+{
+    return g_spool;
+}
+
+void dirscan_list(iot_bench::State& state, const char* pattern)
+{
+    const std::string& root = spool().path;
+    std::vector<char> buf(64 * 1024);
+    struct iot_dirscan_options options = { pattern, IOT_DIRSCAN_UNSORTED, 0 };
+    uint64_t entries = 0;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        struct iot_dirscan* scan = iot_dirscan_open(root.c_str(), &options);
+        const struct iot_dirscan_entry* batch;
+        uint64_t total = 0;
+        int n;
+        while ((n = iot_dirscan_read(scan, buf.data(), buf.size(), &batch)) > 0) {
+            for (int j = 0; j < n; j++) {
+                total += batch[j].size;
+            }
+            entries += n;
+        }
+        iot_bench::do_not_optimize(total);
+        iot_dirscan_close(scan);
+    }
+    state.set_counter("entries", static_cast<double>(entries / state.iterations()));
+}
+
+} // namespace
+
+void BM_FsListReaddirStat(iot_bench::State& state)
+{
+    const std::string& root = spool().path;
+    uint64_t entries = 0;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        struct iot_dir* dir = iot_opendir(root.c_str());
+        uint64_t total = 0;
+        struct iot_dirent* entry;
+        while ((entry = iot_readdir(dir)) != nullptr) {
+            if (!iot_is_file(entry)) {
+                continue;
+            }
+            std::string path = root + "/" + iot_dirent_name(entry);
+            struct iot_stat st;
+            if (iot_stat(path.c_str(), &st) == 0) {
+                total += st.st_size;
+            }
+            entries++;
+        }
+        iot_bench::do_not_optimize(total);
+        iot_closedir(dir);
+    }
+    state.set_counter("entries", static_cast<double>(entries / state.iterations()));
+}
+IOT_BENCHMARK(BM_FsListReaddirStat);
+
+void BM_FsListDirscan(iot_bench::State& state)
+{
+    dirscan_list(state, nullptr);
+}
+IOT_BENCHMARK(BM_FsListDirscan);
+
+void BM_FsListDirscanGlob(iot_bench::State& state)
+{
+    dirscan_list(state, "*.idx");
+}
+IOT_BENCHMARK(BM_FsListDirscanGlob);
@@ -0,0 +1,205 @@
+/*
+ * End-to-end benchmark of the HTTP client: GET, POST, PUT and DELETE
+ * through iot_http_* against the local HTTP server, over one kept-alive
+ * connection on an emulated link. Results are printed as one JSON object
+ * on the last line of stdout, or written to the file given with --out.
+ *
+ *   iot_firmware_sdk_http_bench [--requests N] [--size BYTES] [--payload BYTES]
+ *       [--delay-ms MS] [--chunk BYTES] [--rtt-us US] [--jitter-us US]
+ *       [--bandwidth-bps BPS] [--loss-ppm PPM] [--out FILE]
+ */
+
+#include "connectivity/http_client.h"
+#include "http_server.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+const char* const kUrl = "http://localhost:8080";
+const char* const kHost = "localhost";
+const char* const kPort = "8080";
+const size_t kHeaderRoom = 1024; // Response headers share the buffer with the body
+
+struct Options {
+    uint64_t requests = 2000;
+    size_t size = 1024; // Response body
+    size_t payload = 1024; // POST and PUT body
+    uint64_t delay_ms = 0;
+    uint64_t chunk = 0;
+    iot_link_profile link {};
+    const char* out = nullptr;
+};
+
+struct Result {
+    const char* method;
+    bool ok = true;
+    double seconds = 0;
+    std::vector<double> latencies_ms;
+    uint64_t bytes_sent = 0; // Request bytes on the wire
+    uint64_t bytes_received = 0; // Response bytes on the wire
+};
+
+double percentile(std::vector<double> samples, double fraction)
+{
+    if (samples.empty()) {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[std::min(samples.size() - 1, static_cast<size_t>(samples.size() * fraction))];
+}
+
+bool parse_options(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--out" && i + 1 < argc) {
+            options.out = argv[++i];
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        unsigned long long value = std::strtoull(argv[++i], nullptr, 10);
+        if (arg == "--requests") {
+            options.requests = value;
+        } else if (arg == "--size") {
+            options.size = static_cast<size_t>(value);
+        } else if (arg == "--payload") {
+            options.payload = static_cast<size_t>(value);
+        } else if (arg == "--delay-ms") {
+            options.delay_ms = value;
+        } else if (arg == "--chunk") {
+            options.chunk = value;
+        } else if (arg == "--rtt-us") {
+            options.link.rtt_us = static_cast<uint32_t>(value);
+        } else if (arg == "--jitter-us") {
+            options.link.jitter_us = static_cast<uint32_t>(value);
+        } else if (arg == "--bandwidth-bps") {
+            options.link.bandwidth_bps = value;
+        } else if (arg == "--loss-ppm") {
+            options.link.loss_ppm = static_cast<uint32_t>(value);
+        } else {
+            return false;
+        }
+    }
+    return options.requests > 0;
+}
+
+int issue(const std::string& method, const std::string& path, const std::vector<uint8_t>& payload, std::vector<char>& response)
+{
+    if (method == "GET") {
+        return iot_http_get(path.c_str(), response.data(), response.size());
+    }
+    if (method == "POST") {
+        return iot_http_post(path.c_str(), payload.data(), payload.size(), response.data(), response.size());
+    }
+    if (method == "PUT") {
+        return iot_http_put(path.c_str(), payload.data(), payload.size(), response.data(), response.size());
+    }
+    return iot_http_delete(path.c_str(), response.data(), response.size());
+}
+
+Result run(iot_http_server* server, const char* method, const Options& options)
+{
+    Result result;
+    result.method = method;
+    std::string path = "/bench?size=" + std::to_string(options.size) + "&delay_ms=" + std::to_string(options.delay_ms)
+        + "&chunk=" + std::to_string(options.chunk);
+    bool has_payload = std::string(method) == "POST" || std::string(method) == "PUT";
+    std::vector<uint8_t> payload(has_payload ? options.payload : 0, 0x5a);
+    // coreHTTP receives chunk framing into the buffer before it strips it
+    size_t framing = options.chunk != 0 ? (options.size / options.chunk + 1) * 24 : 0;
+    std::vector<char> response(options.size + kHeaderRoom + framing);
+
+    iot_http_server_stats before;
+    iot_http_server_stats after;
+    iot_http_server_get_stats(server, &before);
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; result.ok && i < options.requests; i++) {
+        auto request_start = std::chrono::steady_clock::now();
+        result.ok = issue(method, path, payload, response) == 0;
+        result.latencies_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - request_start).count());
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    iot_http_server_get_stats(server, &after);
+    result.bytes_sent = after.bytes_received - before.bytes_received;
+    result.bytes_received = after.bytes_sent - before.bytes_sent;
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::fprintf(stderr, "usage: %s [--requests N] [--size BYTES] [--payload BYTES] [--delay-ms MS] [--chunk BYTES]\n"
+                             "    [--rtt-us US] [--jitter-us US] [--bandwidth-bps BPS] [--loss-ppm PPM] [--out FILE]\n",
+            argv[0]);
+        return 2;
+    }
+
+    iot_http_server_config config {};
+    config.host = kHost;
+    config.port = kPort;
+    config.link = &options.link;
+    iot_http_server* server = iot_http_server_start(&config);
+    if (server == nullptr) {
+        std::fprintf(stderr, "failed to start the server\n");
+        return 1;
+    }
+    if (iot_http_init() != 0 || iot_http_set_url(kUrl) != 0) {
+        std::fprintf(stderr, "connect failed\n");
+        iot_http_cleanup();
+        iot_http_server_stop(server);
+        return 1;
+    }
+
+    std::vector<Result> results;
+    bool ok = true;
+    for (const char* method : { "GET", "POST", "PUT", "DELETE" }) {
+        results.push_back(run(server, method, options));
+        ok = ok && results.back().ok;
+    }
+    iot_http_cleanup();
+    iot_http_server_stop(server);
+
+    std::string json;
+    char part[512];
+    std::snprintf(part, sizeof(part),
+        "{\"benchmark\":\"http_client\",\"ok\":%s,\"response_bytes\":%zu,\"payload_bytes\":%zu,\"delay_ms\":%llu,\"chunk_bytes\":%llu,"
+        "\"link\":{\"rtt_us\":%u,\"jitter_us\":%u,\"bandwidth_bps\":%llu,\"loss_ppm\":%u},\"methods\":{",
+        ok ? "true" : "false", options.size, options.payload, static_cast<unsigned long long>(options.delay_ms),
+        static_cast<unsigned long long>(options.chunk), options.link.rtt_us, options.link.jitter_us,
+        static_cast<unsigned long long>(options.link.bandwidth_bps), options.link.loss_ppm);
+    json += part;
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        double count = static_cast<double>(r.latencies_ms.size());
+        std::snprintf(part, sizeof(part),
+            "%s\"%s\":{\"ok\":%s,\"requests\":%zu,\"requests_per_sec\":%.1f,"
+            "\"latency_ms\":{\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f},"
+            "\"bytes_per_request\":{\"sent\":%.1f,\"received\":%.1f}}",
+            i > 0 ? "," : "", r.method, r.ok ? "true" : "false", r.latencies_ms.size(), r.seconds > 0 ? count / r.seconds : 0.0,
+            percentile(r.latencies_ms, 0.50), percentile(r.latencies_ms, 0.90), percentile(r.latencies_ms, 0.99),
+            count > 0 ? r.bytes_sent / count : 0.0, count > 0 ? r.bytes_received / count : 0.0);
+        json += part;
+    }
+    json += "}}\n";
+
+    FILE* out = options.out != nullptr ? std::fopen(options.out, "w") : stdout;
+    if (out == nullptr) {
+        std::fprintf(stderr, "cannot write %s\n", options.out);
+        return 1;
+    }
+    std::fputs(json.c_str(), out);
+    if (out != stdout) {
+        std::fclose(out);
+    }
+    return ok ? 0 : 1;
+}
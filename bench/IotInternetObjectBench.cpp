@@ -0,0 +1,115 @@
+#include "bench.h"
+#include "data/internet_object.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+const char* const kTelemetryJson = "{\"device_id\":\"sensor-4f2a9c01\",\"ts\":1700000000123,\"temperature\":23.57,"
+                                   "\"humidity\":41.25,\"pressure\":1013.2,\"battery\":87,\"rssi\":-67,"
+                                   "\"uptime\":864023,\"status\":\"ok\",\"fw\":\"1.4.2\"}";
+
+// Objects are refilled from empty after this many fields, so lookups stay short
+const int kFieldsPerObject = 16;
+
+// Keys "k0".."k15", built once so key formatting is not measured
+struct Keys {
+    Keys()
+    {
+        for (int i = 0; i < kFieldsPerObject; i++) {
+            std::snprintf(names[i], sizeof(names[i]), "k%d", i);
+        }
+    }
+    char names[kFieldsPerObject][8];
+};
+
+const Keys keys;
+
+} // namespace
+
+// io_create and io_destroy of an empty object
+void BM_IoCreateDestroy(iot_bench::State& state)
+{
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        IO* obj = io_create();
+        iot_bench::do_not_optimize(obj);
+        io_destroy(obj);
+    }
+}
+IOT_BENCHMARK(BM_IoCreateDestroy);
+
+// io_add_string, with the object recreated every kFieldsPerObject adds
+void BM_IoAddString(iot_bench::State& state)
+{
+    IO* obj = io_create();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        int field = static_cast<int>(i % kFieldsPerObject);
+        if (field == 0 && i > 0) {
+            io_destroy(obj);
+            obj = io_create();
+        }
+        io_add_string(obj, keys.names[field], "sensor-4f2a9c01");
+    }
+    io_destroy(obj);
+}
+IOT_BENCHMARK(BM_IoAddString);
+
+// io_add_int, with the object recreated every kFieldsPerObject adds
+void BM_IoAddInt(iot_bench::State& state)
+{
+    IO* obj = io_create();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        int field = static_cast<int>(i % kFieldsPerObject);
+        if (field == 0 && i > 0) {
+            io_destroy(obj);
+            obj = io_create();
+        }
+        io_add_int(obj, keys.names[field], static_cast<int>(i));
+    }
+    io_destroy(obj);
+}
+IOT_BENCHMARK(BM_IoAddInt);
+
+// io_get_string and io_get_int on a ten-field telemetry object
+void BM_IoGetFields(iot_bench::State& state)
+{
+    IO* obj = io_from_string(kTelemetryJson);
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        iot_bench::do_not_optimize(io_get_string(obj, "status"));
+        iot_bench::do_not_optimize(io_get_int(obj, "uptime"));
+    }
+    io_destroy(obj);
+}
+IOT_BENCHMARK(BM_IoGetFields);
+
+// io_from_string: parse a telemetry report into a new object
+void BM_IoFromString(iot_bench::State& state)
+{
+    size_t length = std::strlen(kTelemetryJson);
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        IO* obj = io_from_string(kTelemetryJson);
+        iot_bench::do_not_optimize(obj);
+        io_destroy(obj);
+    }
+    state.set_bytes_processed(length * state.iterations());
+}
+IOT_BENCHMARK(BM_IoFromString);
+
+// The whole publish path of a report: build, print, free
+void BM_IoBuildToString(iot_bench::State& state)
+{
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        IO* obj = io_create();
+        io_add_string(obj, "device_id", "sensor-4f2a9c01");
+        io_add_int(obj, "battery", 87);
+        io_add_int(obj, "rssi", -67);
+        io_add_int(obj, "uptime", static_cast<int>(i));
+        io_add_string(obj, "status", "ok");
+        char* json = io_to_string(obj);
+        iot_bench::do_not_optimize(json);
+        free(json);
+        io_destroy(obj);
+    }
+}
+IOT_BENCHMARK(BM_IoBuildToString);
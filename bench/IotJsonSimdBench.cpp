@@ -0,0 +1,150 @@
+#include "bench.h"
+#include "data/internet_object.h"
+#include "data/json_simd.h"
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+// About 4KB of log-line text with no characters that need escaping and
+// no structural characters
+const std::string& plain_text()
+{
+    static const std::string text = [] {
+        std::string s;
+        while (s.size() < 4096) {
+            s += "2024-03-01 12.00.00 gateway-07 INFO mqtt published telemetry for sensor-4f2a9c01 ";
+        }
+        s.resize(4096);
+        return s;
+    }();
+    return text;
+}
+
+// Pretty-printed indentation: long runs of whitespace
+const std::string& whitespace_text()
+{
+    static const std::string text = std::string(4095, ' ') + "x";
+    return text;
+}
+
+// About 4KB of mostly non-ASCII UTF-8
+const std::string& utf8_text()
+{
+    static const std::string text = [] {
+        std::string s;
+        while (s.size() < 4096) {
+            s += "Temp\xC3\xA9rature \xE2\x82\xAC \xF0\x9F\x98\x80 ";
+        }
+        return s;
+    }();
+    return text;
+}
+
+void run_kernel(iot_bench::State& state, io_simd_level level, int kernel)
+{
+    const struct io_json_kernels* k = io_json_kernels_for(level);
+    if (k == nullptr) {
+        state.set_counter("unsupported", 1);
+        return;
+    }
+    const std::string& text = kernel == 1 ? whitespace_text() : kernel == 3 ? utf8_text() : plain_text();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        switch (kernel) {
+        case 0:
+            iot_bench::do_not_optimize(k->find_escape(text.data(), text.size()));
+            break;
+        case 1:
+            iot_bench::do_not_optimize(k->skip_whitespace(text.data(), text.size()));
+            break;
+        case 2:
+            iot_bench::do_not_optimize(k->find_structural(text.data(), text.size()));
+            break;
+        default:
+            iot_bench::do_not_optimize(k->utf8_valid((const uint8_t*)text.data(), text.size()));
+            break;
+        }
+    }
+    state.set_bytes_processed(text.size() * state.iterations());
+}
+
+} // namespace
+
+#define IOT_JSON_KERNEL_BENCH(name, kernel)                                                   \
+    void BM_##name##Scalar(iot_bench::State& state) { run_kernel(state, IO_SIMD_SCALAR, kernel); } \
+    IOT_BENCHMARK(BM_##name##Scalar);                                                           \
+    void BM_##name##Sse2(iot_bench::State& state) { run_kernel(state, IO_SIMD_SSE2, kernel); }     \
+    IOT_BENCHMARK(BM_##name##Sse2);                                                             \
+    void BM_##name##Avx2(iot_bench::State& state) { run_kernel(state, IO_SIMD_AVX2, kernel); }     \
+    IOT_BENCHMARK(BM_##name##Avx2);
+
+IOT_JSON_KERNEL_BENCH(FindEscape, 0)
+IOT_JSON_KERNEL_BENCH(SkipWhitespace, 1)
+IOT_JSON_KERNEL_BENCH(FindStructural, 2)
+IOT_JSON_KERNEL_BENCH(Utf8Valid, 3)
+
+// A string-heavy payload: a batch of log lines
+static IO* make_log_batch()
+{
+    IO* obj = io_create();
+    cJSON* lines = cJSON_AddArrayToObject(obj->json_obj, "lines");
+    for (int i = 0; i < 32; i++) {
+        cJSON_AddItemToArray(lines,
+            cJSON_CreateString("2024-03-01T12:00:00Z gateway-07 WARN \"modbus\": retry 3/5 on /dev/ttyS1"));
+    }
+    return obj;
+}
+
+// Baseline: cJSON's own byte-at-a-time printer
+void BM_CJsonPrintLogBatch(iot_bench::State& state)
+{
+    IO* obj = make_log_batch();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        char* json = cJSON_PrintUnformatted(obj->json_obj);
+        iot_bench::do_not_optimize(json);
+        cJSON_free(json);
+    }
+    io_destroy(obj);
+}
+IOT_BENCHMARK(BM_CJsonPrintLogBatch);
+
+void BM_IoToStringLogBatch(iot_bench::State& state)
+{
+    IO* obj = make_log_batch();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        char* json = io_to_string(obj);
+        iot_bench::do_not_optimize(json);
+        free(json);
+    }
+    io_destroy(obj);
+}
+IOT_BENCHMARK(BM_IoToStringLogBatch);
+
+// Baseline: cJSON's own parser
+void BM_CJsonParseLogBatch(iot_bench::State& state)
+{
+    IO* obj = make_log_batch();
+    char* json = io_to_string(obj);
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        cJSON* parsed = cJSON_Parse(json);
+        iot_bench::do_not_optimize(parsed);
+        cJSON_Delete(parsed);
+    }
+    free(json);
+    io_destroy(obj);
+}
+IOT_BENCHMARK(BM_CJsonParseLogBatch);
+
+void BM_IoFromStringLogBatch(iot_bench::State& state)
+{
+    IO* obj = make_log_batch();
+    char* json = io_to_string(obj);
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        IO* parsed = io_from_string(json);
+        iot_bench::do_not_optimize(parsed);
+        io_destroy(parsed);
+    }
+    free(json);
+    io_destroy(obj);
+}
+IOT_BENCHMARK(BM_IoFromStringLogBatch);
@@ -0,0 +1,160 @@
+#include "bench.h"
+#include "interface/loopback.h"
+#include "interface/transport.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Echo every byte back until the client closes
+void echo(void* ctx)
+{
+    unsigned char buf[4096];
+    for (;;) {
+        int n = iot_transport_recv(ctx, buf, sizeof(buf));
+        if (n == IOT_TRANSPORT_TIMEOUT) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        for (int sent = 0; sent < n;) {
+            int w = iot_transport_send(ctx, buf + sent, static_cast<size_t>(n - sent));
+            if (w <= 0) {
+                return;
+            }
+            sent += w;
+        }
+    }
+}
+
+// Send a request and wait for its echo, reporting latency percentiles
+void request_response(iot_bench::State& state, const iot_link_profile& profile, size_t size)
+{
+    iot_loopback_listener* listener = iot_loopback_listen("echo.bench", "7", &profile);
+    void* client = nullptr;
+    void* server = nullptr;
+    if (listener == nullptr || iot_transport_open(&client, "echo.bench", "7") != 0
+        || iot_loopback_accept(listener, &server, 1000) != 0) {
+        state.set_counter("failed", 1);
+        iot_transport_close(client);
+        iot_loopback_destroy(listener);
+        return;
+    }
+    std::thread peer(echo, server);
+
+    std::vector<unsigned char> request(size, 0x5a);
+    std::vector<unsigned char> reply(size);
+    std::vector<double> latencies;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t sent = 0; sent < size;) {
+            int n = iot_transport_send(client, request.data() + sent, size - sent);
+            if (n <= 0) {
+                break;
+            }
+            sent += static_cast<size_t>(n);
+        }
+        for (size_t got = 0; got < size;) {
+            int n = iot_transport_recv(client, reply.data() + got, size - got);
+            if (n <= 0) {
+                break;
+            }
+            got += static_cast<size_t>(n);
+        }
+        latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    iot_transport_close(client);
+    peer.join();
+    iot_transport_close(server);
+    iot_loopback_destroy(listener);
+
+    std::sort(latencies.begin(), latencies.end());
+    state.set_counter("p50_ms", latencies[latencies.size() / 2]);
+    state.set_counter("p99_ms", latencies[latencies.size() * 99 / 100]);
+    state.set_bytes_processed(state.iterations() * size * 2);
+}
+
+// Stream bytes one way and report goodput
+void stream(iot_bench::State& state, const iot_link_profile& profile, size_t size)
+{
+    iot_loopback_listener* listener = iot_loopback_listen("sink.bench", "9", &profile);
+    void* client = nullptr;
+    void* server = nullptr;
+    if (listener == nullptr || iot_transport_open(&client, "sink.bench", "9") != 0
+        || iot_loopback_accept(listener, &server, 1000) != 0) {
+        state.set_counter("failed", 1);
+        iot_transport_close(client);
+        iot_loopback_destroy(listener);
+        return;
+    }
+    std::thread sink([server] {
+        unsigned char buf[16384];
+        while (iot_transport_recv(server, buf, sizeof(buf)) > 0) {
+        }
+    });
+
+    std::vector<unsigned char> data(size, 0xa5);
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        for (size_t sent = 0; sent < size;) {
+            int n = iot_transport_send(client, data.data() + sent, size - sent);
+            if (n <= 0) {
+                break;
+            }
+            sent += static_cast<size_t>(n);
+        }
+    }
+
+    iot_transport_close(client);
+    sink.join();
+    iot_transport_close(server);
+    iot_loopback_destroy(listener);
+    state.set_bytes_processed(state.iterations() * size);
+}
+
+} // namespace
+
+void BM_LoopbackEchoIdeal(iot_bench::State& state)
+{
+    request_response(state, iot_link_profile {}, 256);
+}
+IOT_BENCHMARK(BM_LoopbackEchoIdeal);
+
+void BM_LoopbackEchoRtt2ms(iot_bench::State& state)
+{
+    iot_link_profile profile {};
+    profile.rtt_us = 2000;
+    profile.jitter_us = 500;
+    request_response(state, profile, 256);
+}
+IOT_BENCHMARK(BM_LoopbackEchoRtt2ms);
+
+void BM_LoopbackEchoLossy(iot_bench::State& state)
+{
+    iot_link_profile profile {};
+    profile.rtt_us = 2000;
+    profile.loss_ppm = 20000; // 2%
+    profile.rto_us = 10000;
+    profile.max_write = 64;
+    profile.max_read = 64;
+    request_response(state, profile, 256);
+}
+IOT_BENCHMARK(BM_LoopbackEchoLossy);
+
+void BM_LoopbackStreamIdeal(iot_bench::State& state)
+{
+    stream(state, iot_link_profile {}, 65536);
+}
+IOT_BENCHMARK(BM_LoopbackStreamIdeal);
+
+void BM_LoopbackStream10Mbit(iot_bench::State& state)
+{
+    iot_link_profile profile {};
+    profile.rtt_us = 5000;
+    profile.bandwidth_bps = 10000000;
+    stream(state, profile, 65536);
+}
+IOT_BENCHMARK(BM_LoopbackStream10Mbit);
@@ -0,0 +1,217 @@
+/*
+ * End-to-end benchmark of the MQTT client: iot_mqtts_connnect, publish and
+ * subscribe against the local broker over TLS, through an emulated link.
+ * Results are printed as one JSON object on the last line of stdout, or
+ * written to the file given with --out.
+ *
+ *   iot_firmware_sdk_mqtt_bench [--messages N] [--round-trips N] [--handshakes N]
+ *       [--payload BYTES] [--qos 0|1] [--rtt-us US] [--jitter-us US]
+ *       [--bandwidth-bps BPS] [--loss-ppm PPM] [--out FILE]
+ */
+
+#include "connectivity/mqtts_client.h"
+#include "mqtt_broker.h"
+#include "test_certs.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+const char* const kHost = "localhost";
+const int kPort = 8883;
+const char* const kTopic = "bench/echo";
+
+std::atomic<uint64_t> received { 0 };
+
+struct Options {
+    uint64_t messages = 10000;
+    uint64_t round_trips = 1000;
+    uint64_t handshakes = 20;
+    size_t payload = 64;
+    uint8_t qos = 0;
+    iot_link_profile link {};
+    const char* out = nullptr;
+};
+
+double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+double percentile(std::vector<double> samples, double fraction)
+{
+    if (samples.empty()) {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[std::min(samples.size() - 1, static_cast<size_t>(samples.size() * fraction))];
+}
+
+bool parse_options(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--out" && i + 1 < argc) {
+            options.out = argv[++i];
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        unsigned long long value = std::strtoull(argv[++i], nullptr, 10);
+        if (arg == "--messages") {
+            options.messages = value;
+        } else if (arg == "--round-trips") {
+            options.round_trips = value;
+        } else if (arg == "--handshakes") {
+            options.handshakes = value;
+        } else if (arg == "--payload") {
+            options.payload = static_cast<size_t>(value);
+        } else if (arg == "--qos") {
+            options.qos = static_cast<uint8_t>(value);
+        } else if (arg == "--rtt-us") {
+            options.link.rtt_us = static_cast<uint32_t>(value);
+        } else if (arg == "--jitter-us") {
+            options.link.jitter_us = static_cast<uint32_t>(value);
+        } else if (arg == "--bandwidth-bps") {
+            options.link.bandwidth_bps = value;
+        } else if (arg == "--loss-ppm") {
+            options.link.loss_ppm = static_cast<uint32_t>(value);
+        } else {
+            return false;
+        }
+    }
+    // Incoming packets must fit the client's network buffer
+    return options.qos <= 1 && options.payload + 64 <= MQTT_BUFFER_SIZE && options.messages > 0 && options.round_trips > 0;
+}
+
+int connect_client()
+{
+    if (iot_mqtts_init() != 0) {
+        return -1;
+    }
+    return iot_mqtts_connnect(kHost, kPort, "bench-client", iot_test_ca_cert, iot_test_client_cert, iot_test_client_key);
+}
+
+// Process incoming packets until the callback has seen target messages
+bool wait_received(uint64_t target)
+{
+    while (received.load() < target) {
+        if (iot_mqtts_loop() != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+extern "C" void iot_mqtts_message_callback(const char* topic, size_t topic_length, const uint8_t* payload, size_t payload_length, void* user_context)
+{
+    received++;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::fprintf(stderr, "usage: %s [--messages N] [--round-trips N] [--handshakes N] [--payload BYTES] [--qos 0|1]\n"
+                             "    [--rtt-us US] [--jitter-us US] [--bandwidth-bps BPS] [--loss-ppm PPM] [--out FILE]\n",
+            argv[0]);
+        return 2;
+    }
+
+    iot_mqtt_broker_config config {};
+    config.host = kHost;
+    std::string port = std::to_string(kPort);
+    config.port = port.c_str();
+    config.link = &options.link;
+    config.tls = true;
+    iot_mqtt_broker* broker = iot_mqtt_broker_start(&config);
+    if (broker == nullptr) {
+        std::fprintf(stderr, "failed to start the broker\n");
+        return 1;
+    }
+    iot_mqtts_set_debug_level(0);
+
+    // TCP and TLS handshakes plus CONNECT/CONNACK
+    std::vector<double> handshakes;
+    for (uint64_t i = 0; i < options.handshakes; i++) {
+        auto start = std::chrono::steady_clock::now();
+        if (connect_client() != 0) {
+            std::fprintf(stderr, "connect failed\n");
+            iot_mqtt_broker_stop(broker);
+            return 1;
+        }
+        handshakes.push_back(elapsed_ms(start));
+        iot_mqtts_disconnect();
+    }
+
+    if (connect_client() != 0 || iot_mqtts_subscribe(kTopic, options.qos) != 0) {
+        std::fprintf(stderr, "connect failed\n");
+        iot_mqtt_broker_stop(broker);
+        return 1;
+    }
+    std::vector<uint8_t> payload(options.payload, 0x5a);
+    bool ok = true;
+
+    // One message at a time: publish, then wait for the broker to route it back
+    std::vector<double> round_trips;
+    for (uint64_t i = 0; ok && i < options.round_trips; i++) {
+        uint64_t target = received.load() + 1;
+        auto start = std::chrono::steady_clock::now();
+        ok = iot_mqtts_publish(kTopic, payload.data(), payload.size(), options.qos) == 0 && wait_received(target);
+        round_trips.push_back(elapsed_ms(start));
+    }
+
+    // Back-to-back publishes, timed until every copy has come back
+    uint64_t target = received.load() + options.messages;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; ok && i < options.messages; i++) {
+        int retries = 0;
+        // QoS 1 publishes wait for a free slot in the client's in-flight table
+        while (ok && iot_mqtts_publish(kTopic, payload.data(), payload.size(), options.qos) != 0) {
+            ok = ++retries < 1000 && iot_mqtts_loop() == 0;
+        }
+    }
+    ok = ok && wait_received(target);
+    double publish_ms = elapsed_ms(start);
+    iot_mqtts_disconnect();
+
+    iot_mqtt_broker_stats stats;
+    iot_mqtt_broker_get_stats(broker, &stats);
+    iot_mqtt_broker_stop(broker);
+
+    char json[1024];
+    std::snprintf(json, sizeof(json),
+        "{\"benchmark\":\"mqtt_client\",\"ok\":%s,\"tls\":true,\"qos\":%u,\"payload_bytes\":%zu,"
+        "\"link\":{\"rtt_us\":%u,\"jitter_us\":%u,\"bandwidth_bps\":%llu,\"loss_ppm\":%u},"
+        "\"handshake_ms\":{\"count\":%zu,\"p50\":%.3f,\"p99\":%.3f},"
+        "\"round_trip_ms\":{\"count\":%zu,\"p50\":%.3f,\"p99\":%.3f},"
+        "\"publish\":{\"messages\":%llu,\"seconds\":%.3f,\"msgs_per_sec\":%.1f},"
+        "\"broker\":{\"connections\":%llu,\"publishes_received\":%llu,\"publishes_delivered\":%llu}}\n",
+        ok ? "true" : "false", options.qos, options.payload,
+        options.link.rtt_us, options.link.jitter_us, static_cast<unsigned long long>(options.link.bandwidth_bps), options.link.loss_ppm,
+        handshakes.size(), percentile(handshakes, 0.50), percentile(handshakes, 0.99),
+        round_trips.size(), percentile(round_trips, 0.50), percentile(round_trips, 0.99),
+        static_cast<unsigned long long>(options.messages), publish_ms / 1000, ok ? options.messages * 1000.0 / publish_ms : 0.0,
+        static_cast<unsigned long long>(stats.connections), static_cast<unsigned long long>(stats.publishes_received),
+        static_cast<unsigned long long>(stats.publishes_delivered));
+
+    FILE* out = options.out != nullptr ? std::fopen(options.out, "w") : stdout;
+    if (out == nullptr) {
+        std::fprintf(stderr, "cannot write %s\n", options.out);
+        return 1;
+    }
+    std::fputs(json, out);
+    if (out != stdout) {
+        std::fclose(out);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+#include "bench.h"
+#include "core_mqtt_serializer.h"
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const char kTopic[] = "devices/sensor-4f2a9c01/telemetry";
+
+MQTTPublishInfo_t make_publish(const std::vector<uint8_t>& payload, MQTTQoS_t qos)
+{
+    MQTTPublishInfo_t publish = {};
+    publish.qos = qos;
+    publish.pTopicName = kTopic;
+    publish.topicNameLength = sizeof(kTopic) - 1;
+    publish.pPayload = payload.data();
+    publish.payloadLength = payload.size();
+    return publish;
+}
+
+// Size and serialize a PUBLISH into a fixed buffer, as the client does per message
+void serialize_publish(iot_bench::State& state, size_t payload_size, MQTTQoS_t qos)
+{
+    std::vector<uint8_t> payload(payload_size, 0x5a);
+    std::vector<uint8_t> buffer(payload_size + 128);
+    MQTTFixedBuffer_t fixed = { buffer.data(), buffer.size() };
+    MQTTPublishInfo_t publish = make_publish(payload, qos);
+    size_t remaining = 0;
+    size_t size = 0;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        MQTT_GetPublishPacketSize(&publish, &remaining, &size);
+        MQTT_SerializePublish(&publish, qos != MQTTQoS0 ? static_cast<uint16_t>(i % 65535 + 1) : 0, remaining, &fixed);
+        iot_bench::do_not_optimize(buffer[0]);
+    }
+    state.set_counter("packet_bytes", static_cast<double>(size));
+    state.set_bytes_processed(size * state.iterations());
+}
+
+} // namespace
+
+void BM_MqttSerializePublish64Qos0(iot_bench::State& state) { serialize_publish(state, 64, MQTTQoS0); }
+IOT_BENCHMARK(BM_MqttSerializePublish64Qos0);
+
+void BM_MqttSerializePublish64Qos1(iot_bench::State& state) { serialize_publish(state, 64, MQTTQoS1); }
+IOT_BENCHMARK(BM_MqttSerializePublish64Qos1);
+
+void BM_MqttSerializePublish1KQos1(iot_bench::State& state) { serialize_publish(state, 1024, MQTTQoS1); }
+IOT_BENCHMARK(BM_MqttSerializePublish1KQos1);
+
+// Parse a received PUBLISH in place, as the client does before the callback
+void BM_MqttDeserializePublish(iot_bench::State& state)
+{
+    std::vector<uint8_t> payload(64, 0x5a);
+    std::vector<uint8_t> buffer(256);
+    MQTTFixedBuffer_t fixed = { buffer.data(), buffer.size() };
+    MQTTPublishInfo_t publish = make_publish(payload, MQTTQoS1);
+    size_t remaining = 0;
+    size_t size = 0;
+    MQTT_GetPublishPacketSize(&publish, &remaining, &size);
+    MQTT_SerializePublish(&publish, 1, remaining, &fixed);
+
+    MQTTPacketInfo_t info = {};
+    info.type = buffer[0];
+    info.headerLength = size - remaining;
+    info.pRemainingData = buffer.data() + info.headerLength;
+    info.remainingLength = remaining;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        MQTTPublishInfo_t parsed = {};
+        uint16_t packet_id = 0;
+        MQTT_DeserializePublish(&info, &packet_id, &parsed);
+        iot_bench::do_not_optimize(parsed.payloadLength);
+    }
+    state.set_bytes_processed(size * state.iterations());
+}
+IOT_BENCHMARK(BM_MqttDeserializePublish);
+
+// Write and parse a PUBACK, the per-message overhead of QoS 1
+void BM_MqttPubackRoundTrip(iot_bench::State& state)
+{
+    uint8_t ack[MQTT_PUBLISH_ACK_PACKET_SIZE];
+    MQTTFixedBuffer_t fixed = { ack, sizeof(ack) };
+    MQTTPacketInfo_t info = {};
+    info.type = MQTT_PACKET_TYPE_PUBACK;
+    info.pRemainingData = ack + 2;
+    info.remainingLength = 2;
+    info.headerLength = 2;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        uint16_t packet_id = 0;
+        bool session_present = false;
+        MQTT_SerializeAck(&fixed, MQTT_PACKET_TYPE_PUBACK, static_cast<uint16_t>(i % 65535 + 1));
+        MQTT_DeserializeAck(&info, &packet_id, &session_present);
+        iot_bench::do_not_optimize(packet_id);
+    }
+}
+IOT_BENCHMARK(BM_MqttPubackRoundTrip);
+
+void BM_MqttSerializeConnect(iot_bench::State& state)
+{
+    const char client_id[] = "sensor-4f2a9c01";
+    uint8_t buffer[128];
+    MQTTFixedBuffer_t fixed = { buffer, sizeof(buffer) };
+    MQTTConnectInfo_t connect = {};
+    connect.cleanSession = true;
+    connect.keepAliveIntervalSec = 60;
+    connect.pClientIdentifier = client_id;
+    connect.clientIdentifierLength = sizeof(client_id) - 1;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        size_t remaining = 0;
+        size_t size = 0;
+        MQTT_GetConnectPacketSize(&connect, nullptr, &remaining, &size);
+        MQTT_SerializeConnect(&connect, nullptr, remaining, &fixed);
+        iot_bench::do_not_optimize(buffer[0]);
+    }
+}
+IOT_BENCHMARK(BM_MqttSerializeConnect);
+
+void BM_MqttSerializeSubscribe(iot_bench::State& state)
+{
+    const char* const filters[] = { "devices/+/config", "devices/sensor-4f2a9c01/cmd/#", "broadcast/ota" };
+    MQTTSubscribeInfo_t subscriptions[3] = {};
+    for (size_t i = 0; i < 3; i++) {
+        subscriptions[i].qos = MQTTQoS1;
+        subscriptions[i].pTopicFilter = filters[i];
+        subscriptions[i].topicFilterLength = static_cast<uint16_t>(std::strlen(filters[i]));
+    }
+    uint8_t buffer[256];
+    MQTTFixedBuffer_t fixed = { buffer, sizeof(buffer) };
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        size_t remaining = 0;
+        size_t size = 0;
+        MQTT_GetSubscribePacketSize(subscriptions, 3, &remaining, &size);
+        MQTT_SerializeSubscribe(subscriptions, 3, static_cast<uint16_t>(i % 65535 + 1), remaining, &fixed);
+        iot_bench::do_not_optimize(buffer[0]);
+    }
+}
+IOT_BENCHMARK(BM_MqttSerializeSubscribe);
@@ -0,0 +1,291 @@
+/*
+ * Thread events from interface/os.h: round trips between two threads
+ * bouncing an event through their mailboxes or a bit through their flags,
+ * against the same ping-pong on a pthread mutex and condition variable
+ * pair, plus posting to and draining the calling thread's own mailbox,
+ * which is the cost when the receiver is already awake. On one CPU every
+ * round trip is two context switches; on several the waits mostly end in
+ * the futex before the thread sleeps.
+ *
+ * The lock benchmarks mirror the pthread ones in IotPlatformBench.cpp for
+ * the mutex, and set the reader-writer lock and condition variable against
+ * pthreads here: a read-mostly table where one access in sixteen writes,
+ * and the condition ping-pong above. With more threads than CPUs,
+ * contention shows mostly as the cost of sleeping and waking.
+ */
+
+#include "bench.h"
+#include "interface/os.h"
+#include <atomic>
+#include <pthread.h>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct PingPong {
+    uint64_t rounds;
+    std::atomic<struct iot_thread*> peer { nullptr };
+    bool use_flags;
+};
+
+// Sends first when serving is true, otherwise answers
+template <bool serving>
+void bounce(void* arg)
+{
+    PingPong* game = static_cast<PingPong*>(arg);
+    struct iot_thread* peer;
+    while ((peer = game->peer.load()) == nullptr) {
+    }
+    uint32_t event;
+    for (uint64_t i = 0; i < game->rounds; i++) {
+        if (serving) {
+            game->use_flags ? iot_thread_set_flags(peer, 0x1) : iot_thread_post(peer, static_cast<uint32_t>(i));
+        }
+        if (game->use_flags) {
+            iot_thread_wait_flags(0x1, 0, nullptr, IOT_WAIT_FOREVER);
+        } else {
+            iot_thread_wait_event(&event, IOT_WAIT_FOREVER);
+        }
+        if (!serving) {
+            game->use_flags ? iot_thread_set_flags(peer, 0x1) : iot_thread_post(peer, event);
+        }
+    }
+}
+
+void ping_pong(iot_bench::State& state, bool use_flags)
+{
+    PingPong serve_side;
+    PingPong answer_side;
+    serve_side.rounds = answer_side.rounds = state.iterations();
+    serve_side.use_flags = answer_side.use_flags = use_flags;
+    struct iot_thread* answerer = iot_thread_create("pong", bounce<false>, &answer_side, 0, 0, 4);
+    struct iot_thread* server = iot_thread_create("ping", bounce<true>, &serve_side, 0, 0, 4);
+    answer_side.peer.store(server);
+    serve_side.peer.store(answerer);
+    iot_thread_join(server, nullptr);
+    iot_thread_join(answerer, nullptr);
+}
+
+struct CondPingPong {
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+    uint64_t turn = 0;
+    uint64_t rounds = 0;
+};
+
+// Each side waits for its parity of turn, then hands the turn over
+void cond_side(CondPingPong* game, uint64_t parity)
+{
+    for (uint64_t i = 0; i < game->rounds; i++) {
+        pthread_mutex_lock(&game->mutex);
+        while ((game->turn & 1) != parity) {
+            pthread_cond_wait(&game->cond, &game->mutex);
+        }
+        game->turn++;
+        pthread_cond_signal(&game->cond);
+        pthread_mutex_unlock(&game->mutex);
+    }
+}
+
+struct SelfPost {
+    uint64_t rounds;
+    uint32_t batch;
+};
+
+void post_to_self(void* arg)
+{
+    SelfPost* job = static_cast<SelfPost*>(arg);
+    struct iot_thread* self = iot_thread_self();
+    uint32_t event = 0;
+    for (uint64_t i = 0; i < job->rounds; i += job->batch) {
+        for (uint32_t j = 0; j < job->batch; j++) {
+            iot_thread_post(self, j);
+        }
+        for (uint32_t j = 0; j < job->batch; j++) {
+            iot_thread_wait_event(&event, 0);
+        }
+    }
+    iot_bench::do_not_optimize(event);
+}
+
+// Lock and unlock one mutex from threads threads, iterations times in total,
+// as BM_MutexContended* in IotPlatformBench.cpp does with a pthread mutex
+void contend(iot_bench::State& state, int threads)
+{
+    struct iot_mutex* mutex = iot_mutex_init();
+    uint64_t counter = 0;
+    std::atomic<int> ready { 0 };
+    std::vector<std::thread> workers;
+    uint64_t per_thread = state.iterations() / threads + 1;
+
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&] {
+            ready++;
+            while (ready.load() < threads) {
+            }
+            for (uint64_t i = 0; i < per_thread; i++) {
+                iot_mutex_lock(mutex);
+                counter++;
+                iot_mutex_unlock(mutex);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    iot_bench::do_not_optimize(counter);
+    iot_mutex_destroy(mutex);
+}
+
+struct OsRwlock {
+    struct iot_rwlock* rwlock = iot_rwlock_init();
+    ~OsRwlock() { iot_rwlock_destroy(rwlock); }
+    void read_lock() { iot_rwlock_read_lock(rwlock); }
+    void read_unlock() { iot_rwlock_read_unlock(rwlock); }
+    void write_lock() { iot_rwlock_write_lock(rwlock); }
+    void write_unlock() { iot_rwlock_write_unlock(rwlock); }
+};
+
+struct PthreadRwlock {
+    pthread_rwlock_t rwlock = PTHREAD_RWLOCK_INITIALIZER;
+    ~PthreadRwlock() { pthread_rwlock_destroy(&rwlock); }
+    void read_lock() { pthread_rwlock_rdlock(&rwlock); }
+    void read_unlock() { pthread_rwlock_unlock(&rwlock); }
+    void write_lock() { pthread_rwlock_wrlock(&rwlock); }
+    void write_unlock() { pthread_rwlock_unlock(&rwlock); }
+};
+
+// threads look up a small table, updating an entry on every sixteenth access
+template <typename Rwlock>
+void read_mostly(iot_bench::State& state, int threads)
+{
+    Rwlock lock;
+    uint64_t table[64] = {};
+    std::atomic<int> ready { 0 };
+    std::vector<std::thread> workers;
+    uint64_t per_thread = state.iterations() / threads + 1;
+
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            ready++;
+            while (ready.load() < threads) {
+            }
+            uint64_t sum = 0;
+            for (uint64_t i = 0; i < per_thread; i++) {
+                size_t slot = (i * 7 + static_cast<uint64_t>(t)) & 63;
+                if ((i & 15) == 0) {
+                    lock.write_lock();
+                    table[slot]++;
+                    lock.write_unlock();
+                } else {
+                    lock.read_lock();
+                    sum += table[slot];
+                    lock.read_unlock();
+                }
+            }
+            iot_bench::do_not_optimize(sum);
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+struct OsCondPingPong {
+    struct iot_mutex* mutex = iot_mutex_init();
+    struct iot_cond* cond = iot_cond_init();
+    uint64_t turn = 0;
+    uint64_t rounds = 0;
+};
+
+void os_cond_side(OsCondPingPong* game, uint64_t parity)
+{
+    for (uint64_t i = 0; i < game->rounds; i++) {
+        iot_mutex_lock(game->mutex);
+        while ((game->turn & 1) != parity) {
+            iot_cond_wait(game->cond, game->mutex, IOT_WAIT_FOREVER);
+        }
+        game->turn++;
+        iot_cond_signal(game->cond);
+        iot_mutex_unlock(game->mutex);
+    }
+}
+
+} // namespace
+
+void BM_OsEventPingPong(iot_bench::State& state)
+{
+    ping_pong(state, false);
+}
+IOT_BENCHMARK(BM_OsEventPingPong);
+
+void BM_OsFlagsPingPong(iot_bench::State& state)
+{
+    ping_pong(state, true);
+}
+IOT_BENCHMARK(BM_OsFlagsPingPong);
+
+void BM_PthreadCondPingPong(iot_bench::State& state)
+{
+    CondPingPong game;
+    game.rounds = state.iterations();
+    pthread_t other;
+    pthread_create(
+        &other, nullptr, [](void* arg) -> void* {
+            cond_side(static_cast<CondPingPong*>(arg), 1);
+            return nullptr;
+        },
+        &game);
+    cond_side(&game, 0);
+    pthread_join(other, nullptr);
+    pthread_cond_destroy(&game.cond);
+    pthread_mutex_destroy(&game.mutex);
+}
+IOT_BENCHMARK(BM_PthreadCondPingPong);
+
+// Post and receive in batches of 32 on one thread: no sleeping, no contention
+void BM_OsEventPostReceive(iot_bench::State& state)
+{
+    SelfPost job = { state.iterations(), 32 };
+    struct iot_thread* thread = iot_thread_create("self_post", post_to_self, &job, 0, 0, 32);
+    iot_thread_join(thread, nullptr);
+}
+IOT_BENCHMARK(BM_OsEventPostReceive);
+
+void BM_OsCondPingPong(iot_bench::State& state)
+{
+    OsCondPingPong game;
+    game.rounds = state.iterations();
+    std::thread other(os_cond_side, &game, 1);
+    os_cond_side(&game, 0);
+    other.join();
+    iot_cond_destroy(game.cond);
+    iot_mutex_destroy(game.mutex);
+}
+IOT_BENCHMARK(BM_OsCondPingPong);
+
+// Compare with BM_MutexLockUnlock only after some thread has been started:
+// glibc skips the atomic instructions while the process is single-threaded
+void BM_OsMutexLockUnlock(iot_bench::State& state)
+{
+    struct iot_mutex* mutex = iot_mutex_init();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        iot_mutex_lock(mutex);
+        iot_mutex_unlock(mutex);
+    }
+    iot_mutex_destroy(mutex);
+}
+IOT_BENCHMARK(BM_OsMutexLockUnlock);
+
+void BM_OsMutexContended2Threads(iot_bench::State& state) { contend(state, 2); }
+IOT_BENCHMARK(BM_OsMutexContended2Threads);
+
+void BM_OsMutexContended4Threads(iot_bench::State& state) { contend(state, 4); }
+IOT_BENCHMARK(BM_OsMutexContended4Threads);
+
+void BM_OsRwlockReadMostly4Threads(iot_bench::State& state) { read_mostly<OsRwlock>(state, 4); }
+IOT_BENCHMARK(BM_OsRwlockReadMostly4Threads);
+
+void BM_PthreadRwlockReadMostly4Threads(iot_bench::State& state) { read_mostly<PthreadRwlock>(state, 4); }
+IOT_BENCHMARK(BM_PthreadRwlockReadMostly4Threads);
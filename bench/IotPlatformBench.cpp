@@ -0,0 +1,93 @@
+/*
+ * Costs of the POSIX primitives behind interface/clock.h and the mutex in
+ * interface/os.h: clock reads and pthread mutex operations. They bound
+ * what the platform port can achieve and are the baseline to compare it
+ * against.
+ */
+
+#include "bench.h"
+#include <atomic>
+#include <pthread.h>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+namespace {
+
+void read_clock(iot_bench::State& state, clockid_t clock)
+{
+    struct timespec ts;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        clock_gettime(clock, &ts);
+        iot_bench::do_not_optimize(ts);
+    }
+}
+
+// Lock and unlock one mutex from threads threads, iterations times in total
+void contend(iot_bench::State& state, int threads)
+{
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    uint64_t counter = 0;
+    std::atomic<int> ready { 0 };
+    std::vector<std::thread> workers;
+    uint64_t per_thread = state.iterations() / threads + 1;
+
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&] {
+            ready++;
+            while (ready.load() < threads) {
+            }
+            for (uint64_t i = 0; i < per_thread; i++) {
+                pthread_mutex_lock(&mutex);
+                counter++;
+                pthread_mutex_unlock(&mutex);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    iot_bench::do_not_optimize(counter);
+    pthread_mutex_destroy(&mutex);
+}
+
+} // namespace
+
+void BM_ClockMonotonic(iot_bench::State& state) { read_clock(state, CLOCK_MONOTONIC); }
+IOT_BENCHMARK(BM_ClockMonotonic);
+
+void BM_ClockRealtime(iot_bench::State& state) { read_clock(state, CLOCK_REALTIME); }
+IOT_BENCHMARK(BM_ClockRealtime);
+
+#ifdef CLOCK_MONOTONIC_COARSE
+void BM_ClockMonotonicCoarse(iot_bench::State& state) { read_clock(state, CLOCK_MONOTONIC_COARSE); }
+IOT_BENCHMARK(BM_ClockMonotonicCoarse);
+#endif
+
+void BM_MutexLockUnlock(iot_bench::State& state)
+{
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        pthread_mutex_lock(&mutex);
+        pthread_mutex_unlock(&mutex);
+    }
+    pthread_mutex_destroy(&mutex);
+}
+IOT_BENCHMARK(BM_MutexLockUnlock);
+
+void BM_MutexCreateDestroy(iot_bench::State& state)
+{
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        pthread_mutex_t mutex;
+        pthread_mutex_init(&mutex, nullptr);
+        iot_bench::do_not_optimize(mutex);
+        pthread_mutex_destroy(&mutex);
+    }
+}
+IOT_BENCHMARK(BM_MutexCreateDestroy);
+
+void BM_MutexContended2Threads(iot_bench::State& state) { contend(state, 2); }
+IOT_BENCHMARK(BM_MutexContended2Threads);
+
+void BM_MutexContended4Threads(iot_bench::State& state) { contend(state, 4); }
+IOT_BENCHMARK(BM_MutexContended4Threads);
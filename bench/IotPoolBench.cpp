@@ -0,0 +1,131 @@
+/*
+ * Fixed-block pools from system/pool.h against the C library's malloc:
+ * one 64-byte block allocated and freed, as for an IO handle; batches of
+ * 256 blocks of 16 bytes to 2 KB freed in shuffled order, as request
+ * buffers and header copies come and go; and the same batches on four
+ * threads at once, where malloc's arenas and the pool's shared lists are
+ * contended. Iterations are blocks, allocated and freed.
+ */
+
+#include "bench.h"
+#include "system/pool.h"
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const size_t kBatch = 256;
+const int kThreads = 4;
+
+struct Pool {
+    static void* alloc(size_t size) { return iot_pool_alloc(size); }
+    static void release(void* ptr) { iot_pool_free(ptr); }
+};
+
+struct Malloc {
+    static void* alloc(size_t size) { return std::malloc(size); }
+    static void release(void* ptr) { std::free(ptr); }
+};
+
+// Sizes and a free order drawn once, so drawing them is not measured
+struct Pattern {
+    Pattern()
+        : sizes(kBatch)
+        , order(kBatch)
+    {
+        uint64_t seed = 1;
+        for (size_t i = 0; i < kBatch; i++) {
+            seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+            sizes[i] = 16 + static_cast<size_t>(seed >> 33) % (IOT_POOL_MAX_BLOCK - 15);
+            order[i] = i;
+        }
+        for (size_t i = kBatch - 1; i > 0; i--) {
+            seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+            std::swap(order[i], order[static_cast<size_t>(seed >> 33) % (i + 1)]);
+        }
+    }
+
+    std::vector<size_t> sizes;
+    std::vector<size_t> order;
+};
+
+const Pattern& pattern()
+{
+    static const Pattern shared;
+    return shared;
+}
+
+template <typename Allocator>
+uint64_t run_batches(uint64_t blocks)
+{
+    const Pattern& p = pattern();
+    std::vector<void*> live(kBatch);
+    uint64_t bytes = 0;
+    for (uint64_t done = 0; done < blocks; done += kBatch) {
+        for (size_t i = 0; i < kBatch; i++) {
+            live[i] = Allocator::alloc(p.sizes[i]);
+            static_cast<char*>(live[i])[0] = 1;
+            bytes += p.sizes[i];
+        }
+        for (size_t i : p.order) {
+            Allocator::release(live[i]);
+        }
+    }
+    return bytes;
+}
+
+template <typename Allocator>
+void alloc_free_64(iot_bench::State& state)
+{
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        void* ptr = Allocator::alloc(64);
+        iot_bench::do_not_optimize(ptr);
+        Allocator::release(ptr);
+    }
+}
+
+template <typename Allocator>
+void mixed_batches(iot_bench::State& state)
+{
+    state.set_bytes_processed(run_batches<Allocator>(state.iterations()));
+}
+
+template <typename Allocator>
+void mixed_batches_threads(iot_bench::State& state)
+{
+    std::vector<std::thread> threads;
+    std::vector<uint64_t> bytes(kThreads);
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&state, &bytes, t] {
+            bytes[t] = run_batches<Allocator>(state.iterations() / kThreads);
+            iot_pool_thread_flush();
+        });
+    }
+    uint64_t total = 0;
+    for (int t = 0; t < kThreads; t++) {
+        threads[t].join();
+        total += bytes[t];
+    }
+    state.set_bytes_processed(total);
+}
+
+} // namespace
+
+void BM_PoolAllocFree64(iot_bench::State& state) { alloc_free_64<Pool>(state); }
+IOT_BENCHMARK(BM_PoolAllocFree64);
+
+void BM_MallocAllocFree64(iot_bench::State& state) { alloc_free_64<Malloc>(state); }
+IOT_BENCHMARK(BM_MallocAllocFree64);
+
+void BM_PoolMixedBatch(iot_bench::State& state) { mixed_batches<Pool>(state); }
+IOT_BENCHMARK(BM_PoolMixedBatch);
+
+void BM_MallocMixedBatch(iot_bench::State& state) { mixed_batches<Malloc>(state); }
+IOT_BENCHMARK(BM_MallocMixedBatch);
+
+void BM_PoolMixedBatch4Threads(iot_bench::State& state) { mixed_batches_threads<Pool>(state); }
+IOT_BENCHMARK(BM_PoolMixedBatch4Threads);
+
+void BM_MallocMixedBatch4Threads(iot_bench::State& state) { mixed_batches_threads<Malloc>(state); }
+IOT_BENCHMARK(BM_MallocMixedBatch4Threads);
@@ -0,0 +1,138 @@
+#include "bench.h"
+#include "data/schema.h"
+#include <cstring>
+
+namespace {
+
+#define BENCH_TELEMETRY_FIELDS(X) \
+    X(STRING, device_id, 24)      \
+    X(INT64, ts, 0)               \
+    X(DOUBLE, temperature, 0)     \
+    X(DOUBLE, humidity, 0)        \
+    X(DOUBLE, pressure, 0)        \
+    X(INT32, battery, 0)          \
+    X(INT32, rssi, 0)             \
+    X(UINT32, uptime, 0)          \
+    X(STRING, status, 8)          \
+    X(STRING, fw, 8)
+
+IO_SCHEMA_DECLARE(bench_telemetry, BENCH_TELEMETRY_FIELDS)
+IO_SCHEMA_DEFINE(bench_telemetry, BENCH_TELEMETRY_FIELDS)
+
+bench_telemetry make_message()
+{
+    bench_telemetry msg = {};
+    std::strcpy(msg.device_id, "sensor-4f2a9c01");
+    msg.ts = 1700000000123;
+    msg.temperature = 23.57;
+    msg.humidity = 41.25;
+    msg.pressure = 1013.2;
+    msg.battery = 87;
+    msg.rssi = -67;
+    msg.uptime = 864023;
+    std::strcpy(msg.status, "ok");
+    std::strcpy(msg.fw, "1.4.2");
+    return msg;
+}
+
+// The IO path: one allocation per field, cJSON print, then free everything
+void BM_IoBuildAndPrint(iot_bench::State& state)
+{
+    bench_telemetry msg = make_message();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        IO* obj = io_create();
+        io_add_string(obj, "device_id", msg.device_id);
+        cJSON_AddNumberToObject(obj->json_obj, "ts", (double)msg.ts);
+        cJSON_AddNumberToObject(obj->json_obj, "temperature", msg.temperature);
+        cJSON_AddNumberToObject(obj->json_obj, "humidity", msg.humidity);
+        cJSON_AddNumberToObject(obj->json_obj, "pressure", msg.pressure);
+        io_add_int(obj, "battery", msg.battery);
+        io_add_int(obj, "rssi", msg.rssi);
+        io_add_int(obj, "uptime", (int)msg.uptime);
+        io_add_string(obj, "status", msg.status);
+        io_add_string(obj, "fw", msg.fw);
+        char* json = cJSON_PrintUnformatted(obj->json_obj);
+        iot_bench::do_not_optimize(json);
+        cJSON_free(json);
+        io_destroy(obj);
+    }
+}
+IOT_BENCHMARK(BM_IoBuildAndPrint);
+
+void BM_SchemaEncodeJson(iot_bench::State& state)
+{
+    bench_telemetry msg = make_message();
+    uint8_t buffer[256];
+    size_t length = 0;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        bench_telemetry_encode(&msg, IO_FORMAT_JSON, buffer, sizeof(buffer), &length);
+        iot_bench::do_not_optimize(buffer);
+    }
+    state.set_counter("encoded_bytes", (double)length);
+}
+IOT_BENCHMARK(BM_SchemaEncodeJson);
+
+void BM_SchemaEncodeMsgpack(iot_bench::State& state)
+{
+    bench_telemetry msg = make_message();
+    uint8_t buffer[256];
+    size_t length = 0;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        bench_telemetry_encode(&msg, IO_FORMAT_MSGPACK, buffer, sizeof(buffer), &length);
+        iot_bench::do_not_optimize(buffer);
+    }
+    state.set_counter("encoded_bytes", (double)length);
+}
+IOT_BENCHMARK(BM_SchemaEncodeMsgpack);
+
+// The IO path for the receiving side: parse, then look every field up
+void BM_IoParseAndRead(iot_bench::State& state)
+{
+    bench_telemetry msg = make_message();
+    uint8_t buffer[256];
+    size_t length = 0;
+    bench_telemetry_encode(&msg, IO_FORMAT_JSON, buffer, sizeof(buffer) - 1, &length);
+    buffer[length] = '\0';
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        IO* obj = io_from_string((const char*)buffer);
+        bench_telemetry out = {};
+        std::strncpy(out.device_id, io_get_string(obj, "device_id"), sizeof(out.device_id) - 1);
+        out.battery = io_get_int(obj, "battery");
+        out.rssi = io_get_int(obj, "rssi");
+        out.uptime = (uint32_t)io_get_int(obj, "uptime");
+        out.temperature = cJSON_GetObjectItemCaseSensitive(obj->json_obj, "temperature")->valuedouble;
+        iot_bench::do_not_optimize(out);
+        io_destroy(obj);
+    }
+}
+IOT_BENCHMARK(BM_IoParseAndRead);
+
+void BM_SchemaDecodeJson(iot_bench::State& state)
+{
+    bench_telemetry msg = make_message();
+    uint8_t buffer[256];
+    size_t length = 0;
+    bench_telemetry_encode(&msg, IO_FORMAT_JSON, buffer, sizeof(buffer), &length);
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        bench_telemetry out;
+        bench_telemetry_decode(&out, IO_FORMAT_JSON, buffer, length);
+        iot_bench::do_not_optimize(out);
+    }
+}
+IOT_BENCHMARK(BM_SchemaDecodeJson);
+
+void BM_SchemaDecodeMsgpack(iot_bench::State& state)
+{
+    bench_telemetry msg = make_message();
+    uint8_t buffer[256];
+    size_t length = 0;
+    bench_telemetry_encode(&msg, IO_FORMAT_MSGPACK, buffer, sizeof(buffer), &length);
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        bench_telemetry out;
+        bench_telemetry_decode(&out, IO_FORMAT_MSGPACK, buffer, length);
+        iot_bench::do_not_optimize(out);
+    }
+}
+IOT_BENCHMARK(BM_SchemaDecodeMsgpack);
+
+} // namespace
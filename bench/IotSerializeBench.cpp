@@ -0,0 +1,83 @@
+#include "bench.h"
+#include "data/serialize.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// A typical periodic telemetry report from an environmental sensor
+IO* make_telemetry()
+{
+    IO* obj = io_create();
+    io_add_string(obj, "device_id", "sensor-4f2a9c01");
+    cJSON_AddNumberToObject(obj->json_obj, "ts", 1700000000123.0);
+    cJSON_AddNumberToObject(obj->json_obj, "temperature", 23.57);
+    cJSON_AddNumberToObject(obj->json_obj, "humidity", 41.25);
+    cJSON_AddNumberToObject(obj->json_obj, "pressure", 1013.2);
+    io_add_int(obj, "battery", 87);
+    io_add_int(obj, "rssi", -67);
+    io_add_int(obj, "uptime", 864023);
+    io_add_string(obj, "status", "ok");
+    io_add_string(obj, "fw", "1.4.2");
+    return obj;
+}
+
+void encode(iot_bench::State& state, enum io_format format)
+{
+    IO* obj = make_telemetry();
+    uint8_t buffer[512];
+    size_t length = 0;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        io_serialize(obj, format, buffer, sizeof(buffer), &length);
+        iot_bench::do_not_optimize(buffer);
+    }
+    state.set_counter("encoded_bytes", (double)length);
+    state.set_bytes_processed(length * state.iterations());
+    io_destroy(obj);
+}
+
+void decode(iot_bench::State& state, enum io_format format)
+{
+    IO* obj = make_telemetry();
+    uint8_t buffer[512];
+    size_t length = 0;
+    io_serialize(obj, format, buffer, sizeof(buffer), &length);
+    io_destroy(obj);
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        IO* decoded = io_deserialize(buffer, length, format);
+        iot_bench::do_not_optimize(decoded);
+        io_destroy(decoded);
+    }
+    state.set_counter("encoded_bytes", (double)length);
+    state.set_bytes_processed(length * state.iterations());
+}
+
+// io_to_string: compact JSON into a freshly allocated string
+void BM_IoToString(iot_bench::State& state)
+{
+    IO* obj = make_telemetry();
+    size_t length = 0;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        char* json = io_to_string(obj);
+        iot_bench::do_not_optimize(json);
+        length = std::strlen(json);
+        free(json);
+    }
+    state.set_counter("encoded_bytes", (double)length);
+    io_destroy(obj);
+}
+IOT_BENCHMARK(BM_IoToString);
+
+void BM_SerializeJson(iot_bench::State& state) { encode(state, IO_FORMAT_JSON); }
+IOT_BENCHMARK(BM_SerializeJson);
+
+void BM_SerializeMsgpack(iot_bench::State& state) { encode(state, IO_FORMAT_MSGPACK); }
+IOT_BENCHMARK(BM_SerializeMsgpack);
+
+void BM_DeserializeJson(iot_bench::State& state) { decode(state, IO_FORMAT_JSON); }
+IOT_BENCHMARK(BM_DeserializeJson);
+
+void BM_DeserializeMsgpack(iot_bench::State& state) { decode(state, IO_FORMAT_MSGPACK); }
+IOT_BENCHMARK(BM_DeserializeMsgpack);
+
+} // namespace
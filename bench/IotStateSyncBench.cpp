@@ -0,0 +1,84 @@
+#include "bench.h"
+#include "data/serialize.h"
+#include "data/state_sync.h"
+#include <string>
+
+namespace {
+
+const int kFields = 80;
+
+// Count the encoded bytes of every published message
+int count_bytes(void* ctx, IO* message, bool full)
+{
+    (void)full;
+    uint8_t buffer[4096];
+    size_t length = 0;
+    if (io_serialize(message, IO_FORMAT_JSON, buffer, sizeof(buffer), &length) != 0) {
+        return -1;
+    }
+    *static_cast<size_t*>(ctx) += length;
+    return 0;
+}
+
+IO* make_state()
+{
+    IO* state = io_create();
+    for (int i = 0; i < kFields; i++) {
+        cJSON_AddNumberToObject(state->json_obj, ("field_" + std::to_string(i)).c_str(), 1000 + i);
+    }
+    return state;
+}
+
+// Report a state where 'changed' fields move between reports, acking each one
+void report(iot_bench::State& state, int changed, bool always_full)
+{
+    IO* device = make_state();
+    size_t bytes = 0;
+    IOStateSync* sync = io_state_sync_create(0, count_bytes, &bytes);
+    io_state_sync_report(sync, device);
+    io_state_sync_ack(sync);
+    bytes = 0;
+
+    cJSON* item = device->json_obj->child;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        for (int c = 0; c < changed; c++) {
+            item = item->next != NULL ? item->next : device->json_obj->child;
+            cJSON_SetNumberValue(item, (double)i);
+        }
+        if (always_full) {
+            io_state_sync_request_full(sync);
+        }
+        io_state_sync_report(sync, device);
+        io_state_sync_ack(sync);
+    }
+    state.set_counter("bytes_per_report", (double)bytes / (double)state.iterations());
+    io_state_sync_destroy(sync);
+    io_destroy(device);
+}
+
+} // namespace
+
+// Baseline: every report is a full snapshot
+void BM_StateReportFull(iot_bench::State& state)
+{
+    report(state, 1, true);
+}
+IOT_BENCHMARK(BM_StateReportFull);
+
+void BM_StateReportPatch1of80(iot_bench::State& state)
+{
+    report(state, 1, false);
+}
+IOT_BENCHMARK(BM_StateReportPatch1of80);
+
+void BM_StateReportPatch8of80(iot_bench::State& state)
+{
+    report(state, 8, false);
+}
+IOT_BENCHMARK(BM_StateReportPatch8of80);
+
+void BM_StateReportPatch40of80(iot_bench::State& state)
+{
+    report(state, 40, false);
+}
+IOT_BENCHMARK(BM_StateReportPatch40of80);
@@ -0,0 +1,130 @@
+/*
+ * Wake-up jitter of a periodic thread, as for a sensor acquisition loop
+ * sampling every 200 us while compression work keeps every CPU busy
+ * sweeping a buffer larger than the caches. Each iteration is one period:
+ * the thread sleeps to an absolute deadline and records how late it woke.
+ *
+ * Unpinned, the kernel places both the periodic thread and the load.
+ * Pinned, the periodic thread has the last CPU and the load the others,
+ * so its cache stays warm and nothing queues ahead of it; on one CPU the
+ * two share it. The real-time variant adds SCHED_FIFO, which preempts the
+ * load on wake-up; where that is not permitted it runs time-shared and
+ * reports fifo 0. Lateness is reported in microseconds.
+ */
+
+#include "bench.h"
+#include "interface/clock.h"
+#include "interface/os.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <ctime>
+#include <vector>
+
+namespace {
+
+const long kPeriodNs = 200000;
+const size_t kLoadBytes = 8 * 1024 * 1024;
+
+struct Load {
+    std::atomic<bool> stop { false };
+    std::vector<unsigned char> buffer = std::vector<unsigned char>(kLoadBytes);
+};
+
+// Dirties a cache line at a time until stopped
+void sweep(void* arg)
+{
+    Load* load = static_cast<Load*>(arg);
+    while (!load->stop.load(std::memory_order_relaxed)) {
+        for (size_t i = 0; i < load->buffer.size(); i += 64) {
+            load->buffer[i]++;
+        }
+    }
+}
+
+struct Periodic {
+    uint64_t periods;
+    std::vector<uint64_t> lateness_ns;
+};
+
+void run_periodic(void* arg)
+{
+    Periodic* periodic = static_cast<Periodic*>(arg);
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    for (uint64_t i = 0; i < periodic->periods; i++) {
+        deadline.tv_nsec += kPeriodNs;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_nsec -= 1000000000L;
+            deadline.tv_sec++;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {
+        }
+        uint64_t due = static_cast<uint64_t>(deadline.tv_sec) * 1000000000ull + static_cast<uint64_t>(deadline.tv_nsec);
+        uint64_t now = iot_time_monotonic_ns();
+        periodic->lateness_ns.push_back(now > due ? now - due : 0);
+    }
+}
+
+void jitter(iot_bench::State& state, bool pinned, enum iot_thread_sched sched)
+{
+    int cpus = std::min(iot_cpu_count(), 64);
+    uint64_t last_cpu = uint64_t { 1 } << (cpus - 1);
+    uint64_t others = cpus > 1 ? last_cpu - 1 : last_cpu;
+
+    Load load;
+    std::vector<struct iot_thread*> loaders;
+    struct iot_thread_attr attr;
+    for (int i = 0; i < cpus; i++) {
+        iot_thread_attr_init(&attr);
+        attr.name = "jitter_load";
+        attr.cpu_mask = pinned ? others : 0;
+        loaders.push_back(iot_thread_create_ex(sweep, &load, &attr));
+    }
+
+    Periodic periodic;
+    periodic.periods = state.iterations();
+    periodic.lateness_ns.reserve(state.iterations());
+    iot_thread_attr_init(&attr);
+    attr.name = "jitter_periodic";
+    attr.cpu_mask = pinned ? last_cpu : 0;
+    attr.sched = sched;
+    attr.priority = 50;
+    struct iot_thread* thread = iot_thread_create_ex(run_periodic, &periodic, &attr);
+    bool realtime = thread != nullptr && sched != IOT_THREAD_SCHED_DEFAULT;
+    if (thread == nullptr) {
+        attr.sched = IOT_THREAD_SCHED_DEFAULT;
+        thread = iot_thread_create_ex(run_periodic, &periodic, &attr);
+    }
+    iot_thread_join(thread, nullptr);
+
+    load.stop.store(true);
+    for (struct iot_thread* loader : loaders) {
+        iot_thread_join(loader, nullptr);
+    }
+
+    std::vector<uint64_t>& lateness = periodic.lateness_ns;
+    std::sort(lateness.begin(), lateness.end());
+    uint64_t total = 0;
+    for (uint64_t value : lateness) {
+        total += value;
+    }
+    double count = static_cast<double>(lateness.size());
+    state.set_counter("mean_us", static_cast<double>(total) / count / 1000.0);
+    state.set_counter("p99_us", static_cast<double>(lateness[lateness.size() * 99 / 100]) / 1000.0);
+    state.set_counter("max_us", static_cast<double>(lateness.back()) / 1000.0);
+    if (sched != IOT_THREAD_SCHED_DEFAULT) {
+        state.set_counter("fifo", realtime ? 1.0 : 0.0);
+    }
+}
+
+} // namespace
+
+void BM_ThreadJitterUnpinned(iot_bench::State& state) { jitter(state, false, IOT_THREAD_SCHED_DEFAULT); }
+IOT_BENCHMARK(BM_ThreadJitterUnpinned);
+
+void BM_ThreadJitterPinned(iot_bench::State& state) { jitter(state, true, IOT_THREAD_SCHED_DEFAULT); }
+IOT_BENCHMARK(BM_ThreadJitterPinned);
+
+void BM_ThreadJitterPinnedFifo(iot_bench::State& state) { jitter(state, true, IOT_THREAD_SCHED_FIFO); }
+IOT_BENCHMARK(BM_ThreadJitterPinnedFifo);
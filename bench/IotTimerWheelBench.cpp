@@ -0,0 +1,135 @@
+/*
+ * Timer wheel with 100k timers pending, as on a gateway holding a
+ * keep-alive per connection and retries per message: restarting a
+ * keep-alive on traffic, starting and cancelling a retry around an
+ * acknowledged publish, and advancing by one 1 ms tick while 100k periodic
+ * timers with a 1 s period fire about 100 per tick. The last is set
+ * against the scan of a deadline array that modules polling on their own
+ * do today, which touches every timer on every tick.
+ */
+
+#include "bench.h"
+#include "system/timer_wheel.h"
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+const size_t kTimers = 100000;
+const uint64_t kStart = 1700000000000ull;
+
+void count_fire(struct iot_timer* timer, void* arg)
+{
+    (void)timer;
+    (*static_cast<uint64_t*>(arg))++;
+}
+
+// A wheel with kTimers timers pending, spread over delays from min_ms on
+struct LoadedWheel {
+    LoadedWheel(uint64_t min_ms, uint32_t spread_ms, uint32_t period_ms)
+        : timers(kTimers)
+    {
+        wheel = iot_timer_wheel_create(1, kStart);
+        for (size_t i = 0; i < kTimers; i++) {
+            iot_timer_init(&timers[i], count_fire, &fired);
+            iot_timer_start(wheel, &timers[i], min_ms + next() % spread_ms, period_ms);
+        }
+    }
+
+    ~LoadedWheel() { iot_timer_wheel_destroy(wheel); }
+
+    // A cheap LCG, so picking timers costs little next to the operation measured
+    uint32_t next()
+    {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        return static_cast<uint32_t>(seed >> 33);
+    }
+
+    struct iot_timer_wheel* wheel;
+    std::vector<struct iot_timer> timers;
+    uint64_t fired = 0;
+    uint64_t seed = 1;
+};
+
+} // namespace
+
+// Traffic on a connection pushes its keep-alive back to 30-90 s
+void BM_TimerWheelRestart100k(iot_bench::State& state)
+{
+    LoadedWheel loaded(30000, 60000, 0);
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        struct iot_timer* timer = &loaded.timers[loaded.next() % kTimers];
+        iot_timer_start(loaded.wheel, timer, 30000 + loaded.next() % 60000, 0);
+    }
+    state.set_counter("pending", static_cast<double>(iot_timer_wheel_pending(loaded.wheel)));
+}
+IOT_BENCHMARK(BM_TimerWheelRestart100k);
+
+// A publish arms a retry and its acknowledgement cancels it
+void BM_TimerWheelStartCancel100k(iot_bench::State& state)
+{
+    LoadedWheel loaded(30000, 60000, 0);
+    uint64_t retries = 0;
+    struct iot_timer retry;
+    iot_timer_init(&retry, count_fire, &retries);
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        iot_timer_start(loaded.wheel, &retry, 500 + (i & 1023), 0);
+        iot_timer_cancel(loaded.wheel, &retry);
+    }
+    iot_bench::do_not_optimize(retries);
+}
+IOT_BENCHMARK(BM_TimerWheelStartCancel100k);
+
+// One 1 ms tick of 100k periodic timers; about 100 fire each tick
+void BM_TimerWheelTick100k(iot_bench::State& state)
+{
+    LoadedWheel loaded(1, 1000, 1000);
+    uint64_t now = kStart;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        iot_timer_wheel_advance(loaded.wheel, ++now);
+    }
+    state.set_counter("fired_per_tick", static_cast<double>(loaded.fired) / static_cast<double>(state.iterations()));
+}
+IOT_BENCHMARK(BM_TimerWheelTick100k);
+
+// The same load kept as an array of deadlines and scanned on every tick
+void BM_DeadlineScanTick100k(iot_bench::State& state)
+{
+    std::vector<uint64_t> deadlines(kTimers);
+    uint64_t seed = 1;
+    for (auto& deadline : deadlines) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        deadline = kStart + 1 + (seed >> 33) % 1000;
+    }
+    uint64_t fired = 0;
+    uint64_t now = kStart;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        now++;
+        for (auto& deadline : deadlines) {
+            if (deadline <= now) {
+                deadline += 1000;
+                fired++;
+            }
+        }
+    }
+    state.set_counter("fired_per_tick", static_cast<double>(fired) / static_cast<double>(state.iterations()));
+}
+IOT_BENCHMARK(BM_DeadlineScanTick100k);
+
+// An event loop that slept through 10 idle minutes catches up in one advance
+void BM_TimerWheelIdleCatchUp(iot_bench::State& state)
+{
+    struct iot_timer_wheel* wheel = iot_timer_wheel_create(1, kStart);
+    uint64_t fired = 0;
+    struct iot_timer timer;
+    iot_timer_init(&timer, count_fire, &fired);
+    uint64_t now = kStart;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        iot_timer_start(wheel, &timer, 600000, 0);
+        now += 600000;
+        iot_timer_wheel_advance(wheel, now);
+    }
+    iot_timer_wheel_destroy(wheel);
+    iot_bench::do_not_optimize(fired);
+}
+IOT_BENCHMARK(BM_TimerWheelIdleCatchUp);
@@ -0,0 +1,282 @@
+#include "bench.h"
+#include "interface/transport.h"
+#include <algorithm>
+#include <atomic>
+#include <arpa/inet.h>
+#include <chrono>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string>
+#include <cstring>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Listen on the loopback address of a family at the given port (0: any)
+int listen_loopback(int family, int port, int backlog)
+{
+    int fd = socket(family, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_storage addr {};
+    socklen_t length;
+    if (family == AF_INET6) {
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on));
+        auto* a6 = reinterpret_cast<sockaddr_in6*>(&addr);
+        a6->sin6_family = AF_INET6;
+        a6->sin6_addr = in6addr_loopback;
+        a6->sin6_port = htons(static_cast<uint16_t>(port));
+        length = sizeof(sockaddr_in6);
+    } else {
+        auto* a4 = reinterpret_cast<sockaddr_in*>(&addr);
+        a4->sin_family = AF_INET;
+        a4->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        a4->sin_port = htons(static_cast<uint16_t>(port));
+        length = sizeof(sockaddr_in);
+    }
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&addr), length) != 0 || listen(fd, backlog) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+int local_port(int fd)
+{
+    sockaddr_storage addr {};
+    socklen_t length = sizeof(addr);
+    getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &length);
+    return ntohs(addr.ss_family == AF_INET6 ? reinterpret_cast<sockaddr_in6*>(&addr)->sin6_port
+                                            : reinterpret_cast<sockaddr_in*>(&addr)->sin_port);
+}
+
+// Local listeners on ::1 and 127.0.0.1 sharing one port; a dead IPv6
+// listener has its accept queue filled so new SYNs are silently dropped
+struct DualStack {
+    int v6 = -1;
+    int v4 = -1;
+    int port = 0;
+    std::vector<int> fillers;
+
+    explicit DualStack(bool ipv6_alive)
+    {
+        for (int attempt = 0; attempt < 20 && v4 < 0; attempt++) {
+            v6 = listen_loopback(AF_INET6, 0, ipv6_alive ? 64 : 0);
+            if (v6 < 0) {
+                return;
+            }
+            port = local_port(v6);
+            v4 = listen_loopback(AF_INET, port, 64);
+            if (v4 < 0) {
+                close(v6);
+                v6 = -1;
+            }
+        }
+        if (!ipv6_alive && v6 >= 0) {
+            sockaddr_storage addr {};
+            socklen_t length = sizeof(addr);
+            getsockname(v6, reinterpret_cast<sockaddr*>(&addr), &length);
+            for (int i = 0; i < 4; i++) {
+                int c = socket(AF_INET6, SOCK_STREAM, 0);
+                fcntl(c, F_SETFL, O_NONBLOCK);
+                connect(c, reinterpret_cast<sockaddr*>(&addr), length);
+                fillers.push_back(c);
+            }
+            usleep(20000);
+        }
+        iot_transport_add_host("dual.bench", "::1 127.0.0.1");
+    }
+
+    ~DualStack()
+    {
+        for (int fd : fillers) {
+            close(fd);
+        }
+        if (v6 >= 0) {
+            close(v6);
+        }
+        if (v4 >= 0) {
+            close(v4);
+        }
+        iot_transport_add_host("dual.bench", nullptr);
+    }
+};
+
+// Connect repeatedly and report latency percentiles
+void connect_loop(iot_bench::State& state, const char* host, int port, int accept_v6, int accept_v4,
+    const iot_transport_config& config)
+{
+    std::string port_string = std::to_string(port);
+    std::vector<double> latencies;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        void* ctx = nullptr;
+        auto start = std::chrono::steady_clock::now();
+        int ret = iot_transport_open_with(&ctx, host, port_string.c_str(), &config);
+        latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        if (ret != 0) {
+            state.set_counter("failed", 1);
+            return;
+        }
+        // Drain whichever listener took the connection
+        pollfd fds[2] = { { accept_v6, POLLIN, 0 }, { accept_v4, POLLIN, 0 } };
+        if (poll(fds, 2, 1000) > 0) {
+            for (const pollfd& p : fds) {
+                if (p.fd >= 0 && (p.revents & POLLIN)) {
+                    close(accept(p.fd, nullptr, nullptr));
+                }
+            }
+        }
+        iot_transport_close(ctx);
+    }
+    state.set_counter("first_ms", latencies[0]);
+    std::sort(latencies.begin(), latencies.end());
+    state.set_counter("p50_ms", latencies[latencies.size() / 2]);
+    state.set_counter("p99_ms", latencies[latencies.size() * 99 / 100]);
+}
+
+iot_transport_config default_config()
+{
+    iot_transport_config config;
+    iot_transport_config_default(&config);
+    return config;
+}
+
+} // namespace
+
+void BM_ConnectIPv4Loopback(iot_bench::State& state)
+{
+    int fd = listen_loopback(AF_INET, 0, 64);
+    connect_loop(state, "127.0.0.1", local_port(fd), -1, fd, default_config());
+    close(fd);
+}
+IOT_BENCHMARK(BM_ConnectIPv4Loopback);
+
+void BM_ConnectDualStackHealthy(iot_bench::State& state)
+{
+    DualStack listeners(true);
+    connect_loop(state, "dual.bench", listeners.port, listeners.v6, listeners.v4, default_config());
+}
+IOT_BENCHMARK(BM_ConnectDualStackHealthy);
+
+// IPv6 is dead: Happy Eyeballs falls back after one attempt delay (250 ms),
+// then later connects start with IPv4
+void BM_ConnectDualStackDeadIPv6(iot_bench::State& state)
+{
+    DualStack listeners(false);
+    connect_loop(state, "dual.bench", listeners.port, -1, listeners.v4, default_config());
+}
+IOT_BENCHMARK(BM_ConnectDualStackDeadIPv6);
+
+// Baseline: a 1 s per-address timeout before moving on to the next address
+void BM_ConnectDualStackDeadIPv6Sequential(iot_bench::State& state)
+{
+    DualStack listeners(false);
+    iot_transport_config config = default_config();
+    config.attempt_delay_ms = 1000;
+    connect_loop(state, "dual.bench", listeners.port, -1, listeners.v4, config);
+}
+IOT_BENCHMARK(BM_ConnectDualStackDeadIPv6Sequential);
+
+namespace {
+
+// A transport connected to a local listener whose peer discards everything
+struct SinkConnection {
+    int listener = -1;
+    int peer = -1;
+    void* ctx = nullptr;
+    std::thread reader;
+
+    explicit SinkConnection(size_t zerocopy_threshold)
+    {
+        listener = listen_loopback(AF_INET, 0, 4);
+        iot_transport_config config;
+        iot_transport_config_default(&config);
+        config.zerocopy_threshold = zerocopy_threshold;
+        iot_transport_open_with(&ctx, "127.0.0.1", std::to_string(local_port(listener)).c_str(), &config);
+        peer = accept(listener, nullptr, nullptr);
+        reader = std::thread([fd = peer] {
+            static char buffer[1 << 16];
+            while (recv(fd, buffer, sizeof(buffer), 0) > 0) {
+            }
+        });
+    }
+
+    ~SinkConnection()
+    {
+        iot_transport_close(ctx);
+        reader.join();
+        close(peer);
+        close(listener);
+    }
+};
+
+const unsigned char kHeader[] = { 0x32, 0xFF, 0xFF, 0x03, 0x00, 0x0A, 't', 'e', 'l', 'e', 'm', 'e', 't', 'r', 'y' };
+
+// Send a protocol header and a payload the way each strategy would
+void send_message(iot_bench::State& state, size_t payload_size, int strategy, size_t zerocopy_threshold)
+{
+    SinkConnection connection(zerocopy_threshold);
+    std::vector<unsigned char> payload(payload_size, 'x');
+    std::vector<unsigned char> joined(sizeof(kHeader) + payload_size);
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        if (strategy == 0) {
+            // Copy header and payload into one buffer, one send
+            std::memcpy(joined.data(), kHeader, sizeof(kHeader));
+            std::memcpy(joined.data() + sizeof(kHeader), payload.data(), payload_size);
+            iot_transport_send(connection.ctx, joined.data(), joined.size());
+        } else if (strategy == 1) {
+            // No copy, two sends
+            iot_transport_send(connection.ctx, kHeader, sizeof(kHeader));
+            iot_transport_send(connection.ctx, payload.data(), payload_size);
+        } else {
+            iot_transport_iovec iov[2] = { { kHeader, sizeof(kHeader) }, { payload.data(), payload_size } };
+            iot_transport_sendv(connection.ctx, iov, 2);
+        }
+    }
+    state.set_bytes_processed((sizeof(kHeader) + payload_size) * state.iterations());
+}
+
+} // namespace
+
+void BM_SendJoined256(iot_bench::State& state)
+{
+    send_message(state, 256, 0, 0);
+}
+IOT_BENCHMARK(BM_SendJoined256);
+
+void BM_SendTwoCalls256(iot_bench::State& state)
+{
+    send_message(state, 256, 1, 0);
+}
+IOT_BENCHMARK(BM_SendTwoCalls256);
+
+void BM_SendVectored256(iot_bench::State& state)
+{
+    send_message(state, 256, 2, 0);
+}
+IOT_BENCHMARK(BM_SendVectored256);
+
+void BM_SendJoined64K(iot_bench::State& state)
+{
+    send_message(state, 65536, 0, 0);
+}
+IOT_BENCHMARK(BM_SendJoined64K);
+
+void BM_SendVectored64K(iot_bench::State& state)
+{
+    send_message(state, 65536, 2, 0);
+}
+IOT_BENCHMARK(BM_SendVectored64K);
+
+// Loopback always copies, so this shows the cost of the completion round trip
+void BM_SendVectoredZeroCopy64K(iot_bench::State& state)
+{
+    send_message(state, 65536, 2, 16384);
+}
+IOT_BENCHMARK(BM_SendVectoredZeroCopy64K);
@@ -0,0 +1,139 @@
+/*
+ * Work queue scaling from one worker up to one per CPU: a parallel for over
+ * a 1M-element array with a few hundred nanoseconds of work per 64
+ * elements, recursive Fibonacci with a task group per call (the cost of
+ * spawning and joining tiny tasks), and single tasks submitted from outside
+ * the queue. Worker counts above the number of CPUs only add contention, so
+ * compare against the machine's core count before reading the curve.
+ */
+
+#include "bench.h"
+#include "interface/os.h"
+#include <atomic>
+#include <cmath>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+const size_t kElements = 1 << 20;
+
+// One work queue per worker count, kept across runs so thread start-up is not measured
+struct iot_workqueue* queue(uint32_t workers)
+{
+    static struct iot_workqueue* queues[65];
+    if (queues[workers] == nullptr) {
+        queues[workers] = iot_workqueue_create("bench_wq", workers, 0);
+    }
+    return queues[workers];
+}
+
+std::vector<float>& samples()
+{
+    static std::vector<float> data(kElements, 1.5f);
+    return data;
+}
+
+void scale_range(void* arg, size_t begin, size_t end)
+{
+    float* data = static_cast<float*>(arg);
+    for (size_t i = begin; i < end; i++) {
+        data[i] = std::sqrt(data[i] * 1.0001f + 0.5f);
+    }
+}
+
+void parallel_for(iot_bench::State& state, uint32_t workers)
+{
+    struct iot_workqueue* wq = queue(workers);
+    std::vector<float>& data = samples();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        iot_workqueue_parallel_for(wq, 0, data.size(), 4096, scale_range, data.data());
+    }
+    iot_bench::do_not_optimize(data[kElements / 2]);
+    state.set_bytes_processed(state.iterations() * kElements * sizeof(float));
+    state.set_counter("workers", workers);
+}
+
+struct Fib {
+    struct iot_workqueue* wq;
+    int n;
+    long result;
+};
+
+void fib_task(void* arg)
+{
+    Fib* fib = static_cast<Fib*>(arg);
+    if (fib->n < 2) {
+        fib->result = fib->n;
+        return;
+    }
+    Fib left = { fib->wq, fib->n - 1, 0 };
+    Fib right = { fib->wq, fib->n - 2, 0 };
+    struct iot_task_group* group = iot_task_group_create(fib->wq);
+    iot_task_group_run(group, fib_task, &left);
+    fib_task(&right);
+    iot_task_group_destroy(group);
+    fib->result = left.result + right.result;
+}
+
+// fib(20) spawns 10,945 tasks
+void fibonacci(iot_bench::State& state, uint32_t workers)
+{
+    struct iot_workqueue* wq = queue(workers);
+    long result = 0;
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        Fib fib = { wq, 20, 0 };
+        fib_task(&fib);
+        result = fib.result;
+    }
+    iot_bench::do_not_optimize(result);
+    state.set_counter("tasks_per_op", 10945);
+    state.set_counter("workers", workers);
+}
+
+void tick(void* arg)
+{
+    static_cast<std::atomic<uint64_t>*>(arg)->fetch_add(1, std::memory_order_relaxed);
+}
+
+// Empty tasks submitted from this thread, joined in batches of 256
+void submit(iot_bench::State& state, uint32_t workers)
+{
+    struct iot_workqueue* wq = queue(workers);
+    std::atomic<uint64_t> count { 0 };
+    struct iot_task_group* group = iot_task_group_create(wq);
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        iot_task_group_run(group, tick, &count);
+        if ((i & 255) == 255) {
+            iot_task_group_wait(group);
+        }
+    }
+    iot_task_group_destroy(group);
+    iot_bench::do_not_optimize(count.load());
+    state.set_counter("workers", workers);
+}
+
+// One worker per online CPU, capped at the largest queue kept
+uint32_t all_cpus()
+{
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    return online < 1 ? 1 : online > 64 ? 64 : static_cast<uint32_t>(online);
+}
+
+} // namespace
+
+#define WORKQUEUE_SCALING(name, body)                                            \
+    void BM_Workqueue##name##1Worker(iot_bench::State& state) { body(state, 1); } \
+    IOT_BENCHMARK(BM_Workqueue##name##1Worker);                                   \
+    void BM_Workqueue##name##2Workers(iot_bench::State& state) { body(state, 2); } \
+    IOT_BENCHMARK(BM_Workqueue##name##2Workers);                                  \
+    void BM_Workqueue##name##4Workers(iot_bench::State& state) { body(state, 4); } \
+    IOT_BENCHMARK(BM_Workqueue##name##4Workers);                                  \
+    void BM_Workqueue##name##8Workers(iot_bench::State& state) { body(state, 8); } \
+    IOT_BENCHMARK(BM_Workqueue##name##8Workers);                                  \
+    void BM_Workqueue##name##AllCpus(iot_bench::State& state) { body(state, all_cpus()); } \
+    IOT_BENCHMARK(BM_Workqueue##name##AllCpus)
+
+WORKQUEUE_SCALING(ParallelFor, parallel_for);
+WORKQUEUE_SCALING(Fib20, fibonacci);
+WORKQUEUE_SCALING(Submit, submit);
@@ -0,0 +1,53 @@
+#ifndef IOT_BENCH_H
+#define IOT_BENCH_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace iot_bench {
+
+// Per-run state handed to every benchmark function
+class State {
+public:
+    explicit State(uint64_t iterations)
+        : iterations_(iterations)
+    {
+    }
+
+    // Number of times the benchmark body must run
+    uint64_t iterations() const { return iterations_; }
+
+    // Attach a named result (reported as-is, not divided by iterations)
+    void set_counter(const std::string& name, double value) { counters_[name] = value; }
+
+    // Total bytes handled over all iterations, reported as MB/s
+    void set_bytes_processed(uint64_t bytes) { bytes_processed_ = bytes; }
+
+    const std::map<std::string, double>& counters() const { return counters_; }
+    uint64_t bytes_processed() const { return bytes_processed_; }
+
+private:
+    uint64_t iterations_;
+    uint64_t bytes_processed_ = 0;
+    std::map<std::string, double> counters_;
+};
+
+using BenchmarkFunc = void (*)(State& state);
+
+// Add a benchmark to the global registry; used through IOT_BENCHMARK
+int register_benchmark(const char* name, BenchmarkFunc func);
+
+// Keep the compiler from discarding a computed value
+template <class T>
+inline void do_not_optimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+} // namespace iot_bench
+
+#define IOT_BENCHMARK(func) \
+    static const int func##_registered = ::iot_bench::register_benchmark(#func, func)
+
+#endif // IOT_BENCH_H
@@ -0,0 +1,307 @@
+#include "bench.h"
+#include "cJSON.h"
+#include "data/internet_object.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace iot_bench {
+
+namespace {
+
+    struct Benchmark {
+        const char* name;
+        BenchmarkFunc func;
+    };
+
+    std::vector<Benchmark>& registry()
+    {
+        static std::vector<Benchmark> benchmarks;
+        return benchmarks;
+    }
+
+    // Retired user-space instructions of the calling thread, when the kernel allows it
+    class InstructionCounter {
+    public:
+        InstructionCounter()
+        {
+#ifdef __linux__
+            perf_event_attr attr = {};
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd_ = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+        }
+
+        ~InstructionCounter()
+        {
+#ifdef __linux__
+            if (fd_ >= 0) {
+                close(fd_);
+            }
+#endif
+        }
+
+        bool available() const { return fd_ >= 0; }
+
+        void start()
+        {
+#ifdef __linux__
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+        }
+
+        uint64_t stop()
+        {
+            uint64_t count = 0;
+#ifdef __linux__
+            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd_, &count, sizeof(count)) != (ssize_t)sizeof(count)) {
+                count = 0;
+            }
+#endif
+            return count;
+        }
+
+    private:
+        int fd_ = -1;
+    };
+
+    // Run a benchmark once with a fixed iteration count, returning elapsed nanoseconds
+    double run_once(const Benchmark& bench, State& state, InstructionCounter& instructions, uint64_t* instruction_count)
+    {
+        if (instructions.available()) {
+            instructions.start();
+        }
+        auto start = std::chrono::steady_clock::now();
+        bench.func(state);
+        auto end = std::chrono::steady_clock::now();
+        if (instructions.available()) {
+            *instruction_count = instructions.stop();
+        }
+        return std::chrono::duration<double, std::nano>(end - start).count();
+    }
+
+    // One line of the report
+    struct Result {
+        std::string name;
+        uint64_t iterations;
+        double ns_per_op;
+        double instructions_per_op; // 0 when not counted
+        double mb_per_s; // 0 when the benchmark reports no bytes
+        std::map<std::string, double> counters;
+    };
+
+    // Write results as {"benchmarks": [...]}, the format --baseline reads back
+    bool write_json(const char* path, const std::vector<Result>& results)
+    {
+        cJSON* root = cJSON_CreateObject();
+        cJSON* list = cJSON_AddArrayToObject(root, "benchmarks");
+        for (const auto& result : results) {
+            cJSON* entry = cJSON_CreateObject();
+            cJSON_AddStringToObject(entry, "name", result.name.c_str());
+            cJSON_AddNumberToObject(entry, "iterations", (double)result.iterations);
+            cJSON_AddNumberToObject(entry, "ns_per_op", result.ns_per_op);
+            if (result.instructions_per_op > 0) {
+                cJSON_AddNumberToObject(entry, "instructions_per_op", result.instructions_per_op);
+            }
+            if (result.mb_per_s > 0) {
+                cJSON_AddNumberToObject(entry, "mb_per_s", result.mb_per_s);
+            }
+            cJSON* counters = cJSON_AddObjectToObject(entry, "counters");
+            for (const auto& counter : result.counters) {
+                cJSON_AddNumberToObject(counters, counter.first.c_str(), counter.second);
+            }
+            cJSON_AddItemToArray(list, entry);
+        }
+        char* text = cJSON_Print(root);
+        cJSON_Delete(root);
+        FILE* out = text != nullptr ? std::fopen(path, "w") : nullptr;
+        bool ok = out != nullptr && std::fputs(text, out) >= 0 && std::fputc('\n', out) != EOF;
+        if (out != nullptr) {
+            ok = std::fclose(out) == 0 && ok;
+        }
+        cJSON_free(text);
+        return ok;
+    }
+
+    // Read ns_per_op by benchmark name from a file written by write_json
+    bool read_baseline(const char* path, std::map<std::string, double>& ns_per_op)
+    {
+        FILE* in = std::fopen(path, "r");
+        if (in == nullptr) {
+            return false;
+        }
+        std::string text;
+        char buf[4096];
+        size_t n;
+        while ((n = std::fread(buf, 1, sizeof(buf), in)) > 0) {
+            text.append(buf, n);
+        }
+        std::fclose(in);
+
+        cJSON* root = cJSON_Parse(text.c_str());
+        cJSON* list = cJSON_GetObjectItemCaseSensitive(root, "benchmarks");
+        bool ok = cJSON_IsArray(list);
+        cJSON* entry;
+        cJSON_ArrayForEach(entry, list)
+        {
+            cJSON* name = cJSON_GetObjectItemCaseSensitive(entry, "name");
+            cJSON* ns = cJSON_GetObjectItemCaseSensitive(entry, "ns_per_op");
+            if (cJSON_IsString(name) && cJSON_IsNumber(ns)) {
+                ns_per_op[name->valuestring] = ns->valuedouble;
+            }
+        }
+        cJSON_Delete(root);
+        return ok;
+    }
+
+    // Print each result against the baseline; return how many got slower than threshold_pct allows
+    int compare(const std::vector<Result>& results, const std::map<std::string, double>& baseline, double threshold_pct)
+    {
+        int regressions = 0;
+
+        std::printf("\n%-44s %14s %14s %9s\n", "benchmark", "baseline ns/op", "ns/op", "change");
+        for (const auto& result : results) {
+            auto it = baseline.find(result.name);
+            if (it == baseline.end() || it->second <= 0) {
+                std::printf("%-44s %14s %14.2f %9s\n", result.name.c_str(), "-", result.ns_per_op, "new");
+                continue;
+            }
+            double change = (result.ns_per_op / it->second - 1) * 100;
+            bool regressed = change > threshold_pct;
+            regressions += regressed ? 1 : 0;
+            std::printf("%-44s %14.2f %14.2f %+8.1f%%%s\n", result.name.c_str(), it->second, result.ns_per_op, change,
+                regressed ? "  REGRESSION" : (change < -threshold_pct ? "  improved" : ""));
+        }
+        std::printf("%d regression%s beyond %.1f%%\n", regressions, regressions == 1 ? "" : "s", threshold_pct);
+        return regressions;
+    }
+
+} // namespace
+
+int register_benchmark(const char* name, BenchmarkFunc func)
+{
+    registry().push_back({ name, func });
+    return 0;
+}
+
+} // namespace iot_bench
+
+/*
+ * --json FILE writes the results as JSON. --baseline FILE compares them
+ * with an earlier --json file and exits with 1 if any benchmark is more
+ * than --threshold percent (default 10) slower than in the baseline.
+ * --repetitions N reports the fastest of N runs, which steadies the
+ * comparison on a noisy machine.
+ */
+int main(int argc, char** argv)
+{
+    io_init(); // As on a device, before any IO exists
+    const char* filter = nullptr;
+    const char* json_path = nullptr;
+    const char* baseline_path = nullptr;
+    double min_time_ns = 200e6;
+    double threshold_pct = 10;
+    int repetitions = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--min-time-ms") == 0 && i + 1 < argc) {
+            min_time_ns = std::atof(argv[++i]) * 1e6;
+        } else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold_pct = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) {
+            repetitions = std::atoi(argv[++i]);
+        } else {
+            std::fprintf(stderr, "usage: %s [--filter substring] [--min-time-ms ms] [--json file]\n"
+                                 "    [--repetitions n] [--baseline file] [--threshold percent]\n",
+                argv[0]);
+            return 1;
+        }
+    }
+
+    // Fail before spending time on the run
+    std::map<std::string, double> baseline;
+    if (baseline_path != nullptr && !iot_bench::read_baseline(baseline_path, baseline)) {
+        std::fprintf(stderr, "cannot read baseline %s\n", baseline_path);
+        return 1;
+    }
+
+    iot_bench::InstructionCounter instructions;
+    std::vector<iot_bench::Result> results;
+
+    std::printf("%-44s %12s %14s  %s\n", "benchmark", "iterations", "ns/op", "counters");
+    for (const auto& bench : iot_bench::registry()) {
+        if (filter != nullptr && std::strstr(bench.name, filter) == nullptr) {
+            continue;
+        }
+
+        // Grow the iteration count until a run lasts at least min_time_ns
+        uint64_t iterations = 1;
+        double elapsed_ns = 0;
+        for (;;) {
+            iot_bench::State state(iterations);
+            uint64_t instruction_count = 0;
+            elapsed_ns = iot_bench::run_once(bench, state, instructions, &instruction_count);
+            if (elapsed_ns >= min_time_ns || iterations >= (1ULL << 40)) {
+                for (int r = 1; r < repetitions; r++) {
+                    iot_bench::State again(iterations);
+                    uint64_t again_count = 0;
+                    double again_ns = iot_bench::run_once(bench, again, instructions, &again_count);
+                    if (again_ns < elapsed_ns) {
+                        elapsed_ns = again_ns;
+                        instruction_count = again_count;
+                        state = again;
+                    }
+                }
+                iot_bench::Result result = { bench.name, iterations, elapsed_ns / iterations,
+                    (double)instruction_count / iterations, state.bytes_processed() * 1e3 / elapsed_ns, state.counters() };
+                std::printf("%-44s %12llu %14.2f ", bench.name, (unsigned long long)iterations, result.ns_per_op);
+                if (result.instructions_per_op > 0) {
+                    std::printf(" instructions/op=%.0f", result.instructions_per_op);
+                }
+                if (result.mb_per_s > 0) {
+                    std::printf(" MB/s=%.1f", result.mb_per_s);
+                }
+                for (const auto& counter : result.counters) {
+                    std::printf(" %s=%g", counter.first.c_str(), counter.second);
+                }
+                std::printf("\n");
+                results.push_back(result);
+                break;
+            }
+            double scale = elapsed_ns > 0 ? min_time_ns * 1.2 / elapsed_ns : 10.0;
+            scale = scale < 2.0 ? 2.0 : (scale > 100.0 ? 100.0 : scale);
+            iterations = (uint64_t)(iterations * scale);
+        }
+    }
+
+    if (json_path != nullptr && !iot_bench::write_json(json_path, results)) {
+        std::fprintf(stderr, "cannot write %s\n", json_path);
+        return 1;
+    }
+    if (baseline_path != nullptr && iot_bench::compare(results, baseline, threshold_pct) > 0) {
+        return 1;
+    }
+    return 0;
+}
@@ -4,6 +4,10 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /**
  * @brief Initialize the HTTP client
  *
@@ -79,4 +83,8 @@ int iot_http_set_headers(const char* headers[], size_t header_count);
  */
 int iot_http_cleanup(void);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -2,6 +2,8 @@
 #define IOT_MQTT_CLIENT_H
 
 #include "core_mqtt.h"
+#include "data/serialize.h"
+#include "data/state_sync.h"
 #include "mbedtls/ctr_drbg.h"
 #include "mbedtls/debug.h"
 #include "mbedtls/entropy.h"
@@ -9,6 +11,11 @@
 #include "mbedtls/net_sockets.h"
 #include "mbedtls/pk.h"
 #include "mbedtls/ssl.h"
+#include "storage/ring_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 #define MQTT_BUFFER_SIZE 1024
 
@@ -24,6 +31,7 @@ typedef struct {
     mbedtls_ctr_drbg_context ctr_drbg;
     uint8_t network_buffer[MQTT_BUFFER_SIZE];
     uint8_t fixed_buffer[MQTT_BUFFER_SIZE];
+    uint8_t payload_buffer[MQTT_BUFFER_SIZE];
     void* transport_ctx;
 } MQTTClientContext;
 
@@ -41,6 +49,13 @@ __attribute__((weak)) void iot_mqtts_message_callback(
  */
 int iot_mqtts_init(void);
 
+/**
+ * @brief Set the mbedtls debug level used by later connections
+ *
+ * @param level 0 (off) to 4 (verbose); defaults to 4
+ */
+void iot_mqtts_set_debug_level(int level);
+
 /**
  * @brief Connect to the MQTT broker
  *
@@ -72,6 +87,73 @@ int iot_mqtts_disconnect(void);
  */
 int iot_mqtts_publish(const char* topic, const uint8_t* payload, size_t payload_length, uint8_t qos);
 
+/**
+ * @brief Encode an IO in the given wire format and publish it
+ *
+ * The payload is encoded into a buffer owned by the client, so no heap
+ * allocation is made on this path.
+ *
+ * @param topic The topic to publish to
+ * @param obj The IO to encode as the payload
+ * @param format Wire format of the payload (JSON or MessagePack)
+ * @param qos Quality of Service level (0, 1, or 2)
+ * @return int 0 on success, negative value on error
+ */
+int iot_mqtts_publish_io(const char* topic, IO* obj, enum io_format format, uint8_t qos);
+
+/**
+ * @brief Publish a time-series batch, encoded into the client's payload buffer
+ *
+ * @param topic The topic to publish to
+ * @param batch The samples to send as one message
+ * @param format Wire format of the payload (Gorilla binary or JSON)
+ * @param qos Quality of Service level (0, 1, or 2)
+ * @return int 0 on success, negative value on error
+ */
+int iot_mqtts_publish_batch(const char* topic, const IOBatch* batch, enum io_batch_format format, uint8_t qos);
+
+/**
+ * @brief Publish up to max_records unread records of a ring log, one message each
+ *
+ * At QoS 0 a record is committed in the log as soon as it is sent. At
+ * QoS 1 and 2 it is committed only once the broker acknowledges it, when
+ * iot_mqtts_loop handles the PUBACK or PUBCOMP. Up to 16 records wait for
+ * acknowledgement at a time, and later calls send the records after them.
+ * Records still unacknowledged when the connection drops are sent again
+ * after the next iot_mqtts_connnect, and so are all uncommitted records
+ * after a restart. Only one log may have records awaiting acknowledgement
+ * at a time. A failed publish ends the batch; that record and the ones
+ * after it are sent by the next call.
+ *
+ * @param topic The topic to publish to
+ * @param log Log holding encoded payloads, as appended by the application
+ * @param max_records Largest number of messages to send
+ * @param qos Quality of Service level (0, 1, or 2)
+ * @return int Records sent, or negative value on error
+ */
+int iot_mqtts_publish_ring_log(const char* topic, struct iot_ring_log* log, size_t max_records, uint8_t qos);
+
+// Topics and encoding used by iot_mqtts_publish_state
+struct iot_mqtts_state_topics {
+    const char* full_topic; // Full snapshots, which replace the stored state
+    const char* patch_topic; // JSON merge patches against the stored state
+    enum io_format format;
+    uint8_t qos;
+};
+
+/**
+ * @brief Publish callback for io_state_sync_create
+ *
+ * Pass a struct iot_mqtts_state_topics as the context. Full snapshots and
+ * patches go to their own topics so subscribers know how to apply them.
+ *
+ * @param ctx The struct iot_mqtts_state_topics to publish with
+ * @param message The snapshot or patch to send
+ * @param full Whether message is a full snapshot
+ * @return int 0 on success, negative value on error
+ */
+int iot_mqtts_publish_state(void* ctx, IO* message, bool full);
+
 /**
  * @brief Subscribe to an MQTT topic
  *
@@ -112,4 +194,8 @@ int iot_mqtts_set_client_key(const char* key_pem);
  */
 int iot_mqtts_loop(void);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* IOT_MQTT_CLIENT_H */
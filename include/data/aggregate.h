@@ -0,0 +1,108 @@
+#ifndef IOT_DATA_AGGREGATE_H
+#define IOT_DATA_AGGREGATE_H
+
+#include "data/internet_object.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Quantile sketch: a log-linear histogram keyed on the top bits of the
+ * IEEE-754 representation (exponent plus IO_SKETCH_SUBBUCKET_BITS of
+ * mantissa), so inserting is a shift and an increment. Estimates are within
+ * 1/2^(IO_SKETCH_SUBBUCKET_BITS + 1) relative error while the magnitudes of
+ * one sign span at most IO_SKETCH_BINS buckets (8 octaves); beyond that the
+ * smallest magnitudes are merged into the lowest bucket. Sketches are
+ * mergeable, which is what sliding windows are built on.
+ */
+#define IO_SKETCH_BINS 256
+#define IO_SKETCH_SUBBUCKET_BITS 5
+
+// Buckets for the magnitudes of one sign
+typedef struct {
+    int32_t offset; // Key of bins[0]
+    uint32_t bins[IO_SKETCH_BINS];
+    uint64_t count;
+} IOSketchStore;
+
+typedef struct {
+    IOSketchStore positive;
+    IOSketchStore negative;
+    uint64_t zero_count;
+} IOSketch;
+
+// Empty the sketch
+void io_sketch_reset(IOSketch* sketch);
+
+// Add a finite value to the sketch
+void io_sketch_add(IOSketch* sketch, double value);
+
+// Add every value counted in src to dst
+void io_sketch_merge(IOSketch* dst, const IOSketch* src);
+
+// Estimate the q-quantile (0 <= q <= 1), or 0 if the sketch is empty
+double io_sketch_quantile(const IOSketch* sketch, double q);
+
+// Get the number of values in the sketch
+uint64_t io_sketch_count(const IOSketch* sketch);
+
+// Maximum series name length and number of reported quantiles
+#define IO_AGGREGATE_NAME_SIZE 32
+#define IO_AGGREGATE_MAX_QUANTILES 8
+
+// Maximum number of steps in a sliding window
+#define IO_AGGREGATE_MAX_PANES 60
+
+// How samples are grouped into windows
+enum io_window_type {
+    IO_WINDOW_TUMBLING, // Back-to-back windows of length_ms
+    IO_WINDOW_SLIDING // Windows of length_ms emitted every step_ms
+};
+
+struct io_window_config {
+    enum io_window_type type;
+    int64_t length_ms;
+    int64_t step_ms; // Sliding only; must divide length_ms
+    size_t quantile_count; // 0 reports p50, p90 and p99
+    double quantiles[IO_AGGREGATE_MAX_QUANTILES];
+};
+
+/*
+ * Called once per metric for every closed window that saw samples, with an
+ * IO such as
+ *
+ *   {"metric":"temperature","start":1700000000000,"end":1700000060000,
+ *    "count":60,"min":21.5,"max":23.0,"mean":22.1,"p50":22.0,...}
+ *
+ * The IO is destroyed when the callback returns.
+ */
+typedef void (*io_summary_func_t)(void* ctx, IO* summary);
+
+typedef struct IOAggregator IOAggregator;
+
+// Create an aggregator; windows are aligned to multiples of the step since the epoch
+IOAggregator* io_aggregator_create(const struct io_window_config* config, io_summary_func_t on_summary, void* ctx);
+
+// Destroy the aggregator without emitting open windows
+void io_aggregator_destroy(IOAggregator* agg);
+
+// Add a metric and return its index, or -1 on error
+int io_aggregator_add_metric(IOAggregator* agg, const char* name);
+
+// Record a sample. Returns -1 for invalid input or samples older than the
+// oldest open window; closes (and emits) windows the timestamp has passed.
+int io_aggregator_record(IOAggregator* agg, int metric, int64_t timestamp_ms, double value);
+
+// Close and emit every window that ended at or before now_ms.
+// Pass INT64_MAX to close all open windows; a metric whose windows are all
+// closed takes new samples again, from after its last emitted window.
+int io_aggregator_flush(IOAggregator* agg, int64_t now_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOT_DATA_AGGREGATE_H
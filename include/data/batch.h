@@ -0,0 +1,68 @@
+#ifndef IOT_DATA_BATCH_H
+#define IOT_DATA_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Maximum series name length, including the NUL terminator
+#define IO_SERIES_NAME_SIZE 32
+
+// Value types a batch series can hold
+enum io_series_type {
+    IO_SERIES_INT64,
+    IO_SERIES_DOUBLE
+};
+
+// One named column of (timestamp, value) samples
+typedef struct {
+    char name[IO_SERIES_NAME_SIZE];
+    enum io_series_type type;
+    size_t count;
+    size_t capacity;
+    int64_t* timestamps;
+    union {
+        int64_t* ints;
+        double* doubles;
+    } values;
+} IOSeries;
+
+// A batch of time series, encoded as one message (see io_batch_serialize)
+typedef struct {
+    IOSeries* series;
+    size_t series_count;
+    size_t series_capacity;
+} IOBatch;
+
+// Create an empty batch
+IOBatch* io_batch_create(void);
+
+// Destroy the batch, freeing all series
+void io_batch_destroy(IOBatch* batch);
+
+// Add a series and return its index, or -1 on error (duplicate or too-long name)
+int io_batch_add_series(IOBatch* batch, const char* name, enum io_series_type type);
+
+// Get the index of a series by name, or -1 if not found
+int io_batch_find_series(const IOBatch* batch, const char* name);
+
+// Append a sample to an integer series
+int io_batch_append_int(IOBatch* batch, int series, int64_t timestamp, int64_t value);
+
+// Append a sample to a double series
+int io_batch_append_double(IOBatch* batch, int series, int64_t timestamp, double value);
+
+// Get the total number of samples over all series
+size_t io_batch_sample_count(const IOBatch* batch);
+
+// Drop all samples but keep the series and their storage for the next batch
+void io_batch_clear(IOBatch* batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOT_DATA_BATCH_H
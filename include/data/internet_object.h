@@ -14,6 +14,11 @@ typedef struct {
 
 // Function declarations
 
+// Allocate the cJSON nodes and strings of every IO from system/pool.h
+// instead of malloc. Call once at startup, before any IO or cJSON item
+// exists: an item made before would later be freed into the pool.
+void io_init(void);
+
 // Create a new IO and initialize an empty JSON object
 IO* io_create(void);
 
@@ -32,7 +37,7 @@ char* io_get_string(IO* obj, const char* key);
 // Get an integer value from the IO by key
 int io_get_int(IO* obj, const char* key);
 
-// Convert the IO to a JSON string (for serialization)
+// Convert the IO to a compact JSON string (for serialization)
 char* io_to_string(IO* obj);
 
 // Parse a JSON string into an IO (for deserialization)
@@ -0,0 +1,172 @@
+#ifndef IOT_DATA_SCHEMA_H
+#define IOT_DATA_SCHEMA_H
+
+#include "data/serialize.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Fixed-schema messages that bypass the IO object entirely.
+ *
+ * A schema is an X-macro listing each field as X(KIND, name, size), where
+ * KIND is one of INT32, INT64, UINT32, DOUBLE, BOOL or STRING and size is
+ * the char array length for STRING fields (ignored for the others):
+ *
+ *     #define TELEMETRY_FIELDS(X)      \
+ *         X(STRING, device_id, 24)     \
+ *         X(INT64, ts, 0)              \
+ *         X(DOUBLE, temperature, 0)
+ *
+ *     IO_SCHEMA_DECLARE(telemetry, TELEMETRY_FIELDS)   // in a header
+ *     IO_SCHEMA_DEFINE(telemetry, TELEMETRY_FIELDS)    // in one source file
+ *
+ * This declares struct telemetry together with
+ *
+ *     int telemetry_encode(const struct telemetry* msg, enum io_format format,
+ *         uint8_t* buffer, size_t buffer_length, size_t* out_length);
+ *     int telemetry_decode(struct telemetry* msg, enum io_format format,
+ *         const uint8_t* data, size_t length);
+ *
+ * Encoders write straight from the struct into the buffer, with every key
+ * (including its quotes and separator) emitted as a compile-time literal.
+ * They follow io_serialize: on a short buffer -1 is returned and
+ * *out_length holds the required size. Decoders zero the struct, then fill
+ * known fields in place; unknown keys are skipped and missing ones stay zero.
+ */
+
+// Field kinds understood by the schema runtime
+enum io_schema_kind {
+    IO_SCHEMA_KIND_INT32,
+    IO_SCHEMA_KIND_INT64,
+    IO_SCHEMA_KIND_UINT32,
+    IO_SCHEMA_KIND_DOUBLE,
+    IO_SCHEMA_KIND_BOOL,
+    IO_SCHEMA_KIND_STRING
+};
+
+// Field descriptor generated for each schema entry (used by the decoders)
+struct io_schema_field {
+    const char* name;
+    size_t name_length;
+    enum io_schema_kind kind;
+    size_t offset;
+    size_t size;
+};
+
+// Output cursor used by the generated encoders
+struct io_schema_writer {
+    uint8_t* pos;
+    uint8_t* end;
+    size_t overflow;
+};
+
+// Runtime helpers called by the generated code
+void io_schema_put(struct io_schema_writer* w, const void* data, size_t length);
+void io_schema_json_int64(struct io_schema_writer* w, int64_t value);
+void io_schema_json_double(struct io_schema_writer* w, double value);
+void io_schema_json_bool(struct io_schema_writer* w, bool value);
+void io_schema_json_string(struct io_schema_writer* w, const char* value, size_t size);
+void io_schema_json_end(struct io_schema_writer* w, uint8_t* start);
+void io_schema_msgpack_map(struct io_schema_writer* w, size_t count);
+void io_schema_msgpack_key(struct io_schema_writer* w, const char* key, size_t key_length);
+void io_schema_msgpack_int64(struct io_schema_writer* w, int64_t value);
+void io_schema_msgpack_double(struct io_schema_writer* w, double value);
+void io_schema_msgpack_bool(struct io_schema_writer* w, bool value);
+void io_schema_msgpack_string(struct io_schema_writer* w, const char* value, size_t size);
+int io_schema_decode(const struct io_schema_field* fields, size_t field_count, void* msg,
+    enum io_format format, const uint8_t* data, size_t length);
+
+#ifdef __cplusplus
+#define IO_SCHEMA_STATIC_ASSERT(cond, msg) static_assert(cond, msg)
+#else
+#define IO_SCHEMA_STATIC_ASSERT(cond, msg) _Static_assert(cond, msg)
+#endif
+
+// Struct members per kind
+#define IO_SCHEMA_MEMBER_INT32(name, size) int32_t name;
+#define IO_SCHEMA_MEMBER_INT64(name, size) int64_t name;
+#define IO_SCHEMA_MEMBER_UINT32(name, size) uint32_t name;
+#define IO_SCHEMA_MEMBER_DOUBLE(name, size) double name;
+#define IO_SCHEMA_MEMBER_BOOL(name, size) bool name;
+#define IO_SCHEMA_MEMBER_STRING(name, size) char name[size];
+#define IO_SCHEMA_MEMBER(kind, name, size) IO_SCHEMA_MEMBER_##kind(name, size)
+
+// Value writers per kind
+#define IO_SCHEMA_JSON_INT32(w, value, size) io_schema_json_int64(w, value)
+#define IO_SCHEMA_JSON_INT64(w, value, size) io_schema_json_int64(w, value)
+#define IO_SCHEMA_JSON_UINT32(w, value, size) io_schema_json_int64(w, value)
+#define IO_SCHEMA_JSON_DOUBLE(w, value, size) io_schema_json_double(w, value)
+#define IO_SCHEMA_JSON_BOOL(w, value, size) io_schema_json_bool(w, value)
+#define IO_SCHEMA_JSON_STRING(w, value, size) io_schema_json_string(w, value, size)
+#define IO_SCHEMA_MSGPACK_INT32(w, value, size) io_schema_msgpack_int64(w, value)
+#define IO_SCHEMA_MSGPACK_INT64(w, value, size) io_schema_msgpack_int64(w, value)
+#define IO_SCHEMA_MSGPACK_UINT32(w, value, size) io_schema_msgpack_int64(w, value)
+#define IO_SCHEMA_MSGPACK_DOUBLE(w, value, size) io_schema_msgpack_double(w, value)
+#define IO_SCHEMA_MSGPACK_BOOL(w, value, size) io_schema_msgpack_bool(w, value)
+#define IO_SCHEMA_MSGPACK_STRING(w, value, size) io_schema_msgpack_string(w, value, size)
+
+// Per-field expansions used by IO_SCHEMA_DEFINE
+#define IO_SCHEMA_JSON_KEY(name) ",\"" #name "\":"
+#define IO_SCHEMA_ENCODE_JSON(kind, name, size)                                        \
+    io_schema_put(&w, IO_SCHEMA_JSON_KEY(name), sizeof(IO_SCHEMA_JSON_KEY(name)) - 1); \
+    IO_SCHEMA_JSON_##kind(&w, msg->name, size);
+#define IO_SCHEMA_ENCODE_MSGPACK(kind, name, size)                             \
+    IO_SCHEMA_STATIC_ASSERT(sizeof(#name) <= 32, "schema key too long: " #name); \
+    io_schema_msgpack_key(&w, #name, sizeof(#name) - 1);                       \
+    IO_SCHEMA_MSGPACK_##kind(&w, msg->name, size);
+#define IO_SCHEMA_COUNT(kind, name, size) +1
+#define IO_SCHEMA_DESCRIBE(kind, name, size) \
+    { #name, sizeof(#name) - 1, IO_SCHEMA_KIND_##kind, offsetof(io_schema_self_t, name), sizeof(((io_schema_self_t*)0)->name) },
+
+// Declare the message struct and its codec functions
+#define IO_SCHEMA_DECLARE(type, FIELDS)                                                        \
+    struct type {                                                                             \
+        FIELDS(IO_SCHEMA_MEMBER)                                                               \
+    };                                                                                         \
+    int type##_encode(const struct type* msg, enum io_format format, uint8_t* buffer,          \
+        size_t buffer_length, size_t* out_length);                                             \
+    int type##_decode(struct type* msg, enum io_format format, const uint8_t* data, size_t length);
+
+// Define the codec functions declared by IO_SCHEMA_DECLARE
+#define IO_SCHEMA_DEFINE(type, FIELDS)                                                                \
+    int type##_encode(const struct type* msg, enum io_format format, uint8_t* buffer,                 \
+        size_t buffer_length, size_t* out_length)                                                      \
+    {                                                                                                 \
+        if (msg == NULL || buffer == NULL || out_length == NULL) {                                    \
+            return -1;                                                                                \
+        }                                                                                             \
+        struct io_schema_writer w = { buffer, buffer + buffer_length, 0 };                            \
+        if (format == IO_FORMAT_JSON) {                                                               \
+            FIELDS(IO_SCHEMA_ENCODE_JSON)                                                             \
+            io_schema_json_end(&w, buffer);                                                           \
+        } else if (format == IO_FORMAT_MSGPACK) {                                                     \
+            io_schema_msgpack_map(&w, 0 FIELDS(IO_SCHEMA_COUNT));                                     \
+            FIELDS(IO_SCHEMA_ENCODE_MSGPACK)                                                          \
+        } else {                                                                                      \
+            return -1;                                                                                \
+        }                                                                                             \
+        *out_length = (size_t)(w.pos - buffer) + w.overflow;                                          \
+        return w.overflow == 0 ? 0 : -1;                                                              \
+    }                                                                                                 \
+    int type##_decode(struct type* msg, enum io_format format, const uint8_t* data, size_t length)   \
+    {                                                                                                 \
+        typedef struct type io_schema_self_t;                                                         \
+        if (msg == NULL) {                                                                            \
+            return -1;                                                                                \
+        }                                                                                             \
+        memset(msg, 0, sizeof(*msg));                                                                 \
+        static const struct io_schema_field fields[] = { FIELDS(IO_SCHEMA_DESCRIBE) };               \
+        return io_schema_decode(fields, sizeof(fields) / sizeof(fields[0]), msg, format, data, length); \
+    }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOT_DATA_SCHEMA_H
@@ -0,0 +1,63 @@
+#ifndef IOT_DATA_SERIALIZE_H
+#define IOT_DATA_SERIALIZE_H
+
+#include "data/batch.h"
+#include "data/internet_object.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Wire formats an IO can be encoded to
+enum io_format {
+    IO_FORMAT_JSON, // Compact JSON text (not NUL-terminated)
+    IO_FORMAT_MSGPACK // MessagePack binary
+};
+
+// Maximum nesting depth accepted by the encoders and decoders
+#define IO_MAX_DEPTH 32
+
+// Output sink used by the streaming encoder; return 0 to continue, negative to abort
+typedef int (*io_write_func_t)(void* ctx, const uint8_t* data, size_t length);
+
+// Encode an IO into a caller-provided buffer without allocating.
+// On success *out_length is the number of bytes written. If the buffer is
+// too small, -1 is returned and *out_length is the size that was required.
+int io_serialize(IO* obj, enum io_format format, uint8_t* buffer, size_t buffer_length, size_t* out_length);
+
+// Encode an IO through a write callback, staging output in a small stack buffer
+int io_serialize_stream(IO* obj, enum io_format format, io_write_func_t write, void* ctx);
+
+// Get the number of bytes io_serialize would produce, 0 on error
+size_t io_serialized_size(IO* obj, enum io_format format);
+
+// Decode a buffer in the given format into a new IO (free with io_destroy)
+IO* io_deserialize(const uint8_t* data, size_t length, enum io_format format);
+
+// Wire formats a time-series batch can be encoded to
+enum io_batch_format {
+    IO_BATCH_FORMAT_GORILLA, // Delta-of-delta timestamps, XOR doubles (compact binary)
+    IO_BATCH_FORMAT_JSON // {"name":{"t0":first,"dt":[deltas],"v":[values]},...}
+};
+
+// Version byte that starts IO_BATCH_FORMAT_GORILLA output
+#define IO_BATCH_VERSION 1
+
+// Encode a batch into a caller-provided buffer, with the same buffer
+// contract as io_serialize
+int io_batch_serialize(const IOBatch* batch, enum io_batch_format format, uint8_t* buffer,
+    size_t buffer_length, size_t* out_length);
+
+// Get the number of bytes io_batch_serialize would produce, 0 on error
+size_t io_batch_serialized_size(const IOBatch* batch, enum io_batch_format format);
+
+// Decode a batch encoded with IO_BATCH_FORMAT_GORILLA (free with io_batch_destroy)
+IOBatch* io_batch_deserialize(const uint8_t* data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOT_DATA_SERIALIZE_H
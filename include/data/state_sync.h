@@ -0,0 +1,59 @@
+#ifndef IOT_DATA_STATE_SYNC_H
+#define IOT_DATA_STATE_SYNC_H
+
+#include "data/internet_object.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Build the JSON merge patch (RFC 7386) that turns 'from' into 'to'; both
+// must be objects. Returns a new IO (free with io_destroy), or NULL on error
+// or when 'to' needs a null member written (a null in a patch means delete).
+IO* io_merge_patch_create(const IO* from, const IO* to);
+
+// Apply a JSON merge patch to target in place
+int io_merge_patch_apply(IO* target, const IO* patch);
+
+/*
+ * Delta state reporting. Each report is published either as a full
+ * snapshot, which replaces the receiver's state, or as a merge patch
+ * against the last acknowledged snapshot. Patches also restate every field
+ * touched by reports that are not acknowledged yet, so applying the latest
+ * patch yields the reported state whichever earlier patches the receiver
+ * saw. A full snapshot is sent first, every full_interval patches (0 for
+ * never), on request, and whenever a patch would have to delete or replace
+ * an object or write a null member, which merge patches cannot express.
+ * Until a full snapshot is acknowledged, reports stay full.
+ *
+ * Call io_state_sync_ack when the most recent report is confirmed, e.g. on
+ * its PUBACK. With QoS 0, call it right after each successful report.
+ */
+
+// Publish one report; return 0 on success. The message is destroyed afterwards.
+typedef int (*io_state_publish_func_t)(void* ctx, IO* message, bool full);
+
+typedef struct IOStateSync IOStateSync;
+
+// Create a state reporter
+IOStateSync* io_state_sync_create(uint32_t full_interval, io_state_publish_func_t publish, void* ctx);
+
+// Destroy the reporter and its snapshots
+void io_state_sync_destroy(IOStateSync* sync);
+
+// Publish what changed in state; nothing is published if nothing changed
+int io_state_sync_report(IOStateSync* sync, const IO* state);
+
+// Mark the most recent report as received
+void io_state_sync_ack(IOStateSync* sync);
+
+// Make the next report a full snapshot
+void io_state_sync_request_full(IOStateSync* sync);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOT_DATA_STATE_SYNC_H
@@ -19,11 +19,82 @@ enum iot_time_unit {
 /**
  * @brief Get current time in specified units
  *
+ * Microseconds and milliseconds come from the monotonic clock, seconds
+ * from the wall clock.
+ *
  * @param unit Time unit to return
  * @return uint64_t Current time in requested units
  */
 uint64_t iot_get_time(enum iot_time_unit unit);
 
+/*
+ * Clocks in nanoseconds. The monotonic clock never goes back and counts
+ * from an arbitrary point; use it for timeouts and intervals. The wall
+ * clock counts from the Unix epoch and jumps when the system time is set;
+ * use it for timestamps that leave the device.
+ *
+ * The coarse clock is the monotonic clock as of the last scheduler tick:
+ * a few nanoseconds to read and never ahead of iot_time_monotonic_ns, but
+ * behind it by up to its resolution. It suits hot-path timeouts measured
+ * in milliseconds. The cycle counter is the CPU's timestamp counter where
+ * there is one, cheapest of all and for profiling only; it is converted
+ * with a frequency calibrated against the monotonic clock on first use.
+ */
+
+/**
+ * @brief Read the monotonic clock
+ *
+ * @return uint64_t Nanoseconds since an arbitrary point
+ */
+uint64_t iot_time_monotonic_ns(void);
+
+/**
+ * @brief Read the wall clock
+ *
+ * @return uint64_t Nanoseconds since the Unix epoch
+ */
+uint64_t iot_time_realtime_ns(void);
+
+/**
+ * @brief Read the monotonic clock as of the last scheduler tick
+ *
+ * @return uint64_t Nanoseconds on the timeline of iot_time_monotonic_ns
+ */
+uint64_t iot_time_coarse_ns(void);
+
+/**
+ * @brief How far iot_time_coarse_ns may lag the monotonic clock
+ *
+ * @return uint64_t Resolution in nanoseconds
+ */
+uint64_t iot_time_coarse_resolution_ns(void);
+
+/**
+ * @brief Read the cycle counter
+ *
+ * Not ordered with the surrounding instructions and, on some systems, not
+ * synchronised between CPUs, so only differences taken on one thread are
+ * meaningful.
+ *
+ * @return uint64_t Cycles since an arbitrary point
+ */
+uint64_t iot_cycles(void);
+
+/**
+ * @brief Cycle counter frequency, calibrated on the first call
+ *
+ * @return uint64_t Cycles per second
+ */
+uint64_t iot_cycles_per_second(void);
+
+/**
+ * @brief Convert a cycle count to nanoseconds
+ *
+ * @param cycles Difference of two iot_cycles readings
+ * @return uint64_t Nanoseconds
+ */
+uint64_t iot_cycles_to_ns(uint64_t cycles);
+
 #ifdef __cplusplus
 }
 #endif
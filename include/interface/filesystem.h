@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -19,23 +20,324 @@ int iot_fseek(struct iot_file* file, long offset);
 int iot_fclose(struct iot_file* file);
 int iot_ftruncate(struct iot_file* file, size_t size);
 
+#define IOT_FBUFFER_DEFAULT_SIZE (64 * 1024)
+#define IOT_FBUFFER_DEFAULT_INTERVAL_MS 1000
+
+// Write-behind settings of a file opened with iot_fopen_buffered
+struct iot_fbuffer_config {
+    size_t buffer_size; /**< Bytes combined before a write reaches the backend (0: IOT_FBUFFER_DEFAULT_SIZE) */
+    uint32_t flush_interval_ms; /**< Longest time written bytes stay buffered (0: IOT_FBUFFER_DEFAULT_INTERVAL_MS) */
+};
+
+/**
+ * @brief Open a file whose writes are combined in memory
+ *
+ * Small iot_fwrite calls are copied into a per-file buffer and reach the
+ * backend in one write when the buffer fills, on iot_fflush, iot_fsync,
+ * iot_fclose, or any read, seek or truncate of the file. A background
+ * thread writes out buffers older than flush_interval_ms, and writers
+ * flush their own buffer when the bytes buffered across all files reach
+ * a platform limit, so both the data at risk and the memory held stay
+ * bounded. Writes at least as large as the buffer bypass it.
+ *
+ * @param path File path
+ * @param mode fopen-style mode
+ * @param config Buffer settings, NULL for the defaults
+ * @return struct iot_file* File handle, NULL on error
+ */
+struct iot_file* iot_fopen_buffered(const char* path, const char* mode, const struct iot_fbuffer_config* config);
+
+/**
+ * @brief Hand buffered writes to the backend
+ *
+ * @param file Open file; a no-op for unbuffered files
+ * @return int 0 on success, negative value if this or an earlier background flush failed
+ */
+int iot_fflush(struct iot_file* file);
+
+/**
+ * @brief Flush buffered writes and wait until the file is on stable storage
+ *
+ * @param file Open file
+ * @return int 0 on success, negative value on error
+ */
+int iot_fsync(struct iot_file* file);
+
+#define IOT_AIO_DEFAULT_DEPTH 64
+#define IOT_AIO_DEFAULT_THREADS 4
+
+// Implementation behind an iot_aio queue
+enum iot_aio_backend {
+    IOT_AIO_AUTO, // io_uring where the kernel allows it, otherwise threads
+    IOT_AIO_URING, // Linux io_uring; iot_aio_create fails if it is unavailable
+    IOT_AIO_THREADS // Blocking calls on a pool of worker threads
+};
+
+// Settings of an asynchronous I/O queue
+struct iot_aio_config {
+    uint32_t queue_depth; /**< Requests in flight at once (0: IOT_AIO_DEFAULT_DEPTH) */
+    uint32_t threads; /**< Worker threads of the thread backend (0: IOT_AIO_DEFAULT_THREADS) */
+    enum iot_aio_backend backend;
+};
+
+/**
+ * @brief Completion callback of an asynchronous request
+ *
+ * @param user_data Pointer passed with the request
+ * @param result Bytes transferred (0 for fsync), or the negated errno on error
+ */
+typedef void (*iot_aio_callback)(void* user_data, int64_t result);
+
+/*
+ * Asynchronous file I/O. Requests are queued by iot_aio_read/write/fsync,
+ * handed to the backend by iot_aio_submit, and their callbacks run inside
+ * iot_aio_complete on the calling thread, never concurrently. An event
+ * loop polls iot_aio_fd for readability next to its sockets and calls
+ * iot_aio_complete(aio, 0) when it fires. A queue is used from one thread.
+ * Reads and writes are positional and leave the file offset alone; the
+ * buffers must stay valid until the callback has run.
+ */
+struct iot_aio;
+
+/**
+ * @brief Create an asynchronous I/O queue
+ *
+ * @param config Settings, NULL for the defaults
+ * @return struct iot_aio* Queue, NULL on error
+ */
+struct iot_aio* iot_aio_create(const struct iot_aio_config* config);
+
+/**
+ * @brief Wait for submitted requests and free the queue; no more callbacks are run
+ *
+ * @param aio Queue
+ */
+void iot_aio_destroy(struct iot_aio* aio);
+
+/**
+ * @brief Backend in use, IOT_AIO_URING or IOT_AIO_THREADS
+ *
+ * @param aio Queue
+ * @return enum iot_aio_backend Backend
+ */
+enum iot_aio_backend iot_aio_get_backend(const struct iot_aio* aio);
+
+/**
+ * @brief Queue a read of len bytes at offset
+ *
+ * Buffered files are flushed first, so the read sees earlier writes.
+ *
+ * @return int 0 on success, negative value if the queue is full or on error
+ */
+int iot_aio_read(struct iot_aio* aio, struct iot_file* file, void* buf, size_t len, uint64_t offset,
+    iot_aio_callback callback, void* user_data);
+
+/**
+ * @brief Queue a write of len bytes at offset
+ *
+ * @return int 0 on success, negative value if the queue is full or on error
+ */
+int iot_aio_write(struct iot_aio* aio, struct iot_file* file, const void* buf, size_t len, uint64_t offset,
+    iot_aio_callback callback, void* user_data);
+
+/**
+ * @brief Queue an fsync of the file; it is not ordered after other requests still in flight
+ *
+ * @return int 0 on success, negative value if the queue is full or on error
+ */
+int iot_aio_fsync(struct iot_aio* aio, struct iot_file* file, iot_aio_callback callback, void* user_data);
+
+/**
+ * @brief Hand queued requests to the backend
+ *
+ * @param aio Queue
+ * @return int Number of requests submitted, negative value on error
+ */
+int iot_aio_submit(struct iot_aio* aio);
+
+/**
+ * @brief Submit queued requests and run the callbacks of finished ones
+ *
+ * @param aio Queue
+ * @param timeout_ms How long to wait if none has finished: 0 not at all, -1 without limit
+ * @return int Number of callbacks run, negative value on error
+ */
+int iot_aio_complete(struct iot_aio* aio, int timeout_ms);
+
+/**
+ * @brief Descriptor that polls readable when requests may have finished
+ *
+ * @param aio Queue
+ * @return int File descriptor owned by the queue
+ */
+int iot_aio_fd(const struct iot_aio* aio);
+
+/**
+ * @brief Requests queued or in flight whose callbacks have not run yet
+ *
+ * @param aio Queue
+ * @return uint32_t Count
+ */
+uint32_t iot_aio_pending(const struct iot_aio* aio);
+
+// Expected access pattern of a mapping, passed on to the kernel's readahead
+enum iot_fmap_advice {
+    IOT_FMAP_NORMAL, // No particular pattern
+    IOT_FMAP_SEQUENTIAL, // Read once from start to end; read ahead aggressively
+    IOT_FMAP_RANDOM, // Scattered reads; do not read ahead
+    IOT_FMAP_WILLNEED // Start reading the whole range in now
+};
+
+// Opaque read-only view of part of a file
+struct iot_fmap;
+
+/**
+ * @brief Map part of a file into memory, read-only
+ *
+ * The bytes are read straight from the page cache, without a copy into a
+ * caller buffer. The mapping stays valid after the file is closed. If the
+ * file shrinks, touching mapped pages past its new end is fatal.
+ *
+ * @param file Open file
+ * @param offset First byte to map; need not be page aligned
+ * @param length Bytes to map, 0 for everything from offset to the end of the file
+ * @param advice Expected access pattern
+ * @return struct iot_fmap* Mapping, NULL on error or if the range is past the end of the file
+ */
+struct iot_fmap* iot_fmap(struct iot_file* file, size_t offset, size_t length, enum iot_fmap_advice advice);
+
+/**
+ * @brief First mapped byte, the one at the offset passed to iot_fmap
+ *
+ * @param map Mapping
+ * @return const void* Mapped bytes
+ */
+const void* iot_fmap_data(const struct iot_fmap* map);
+
+/**
+ * @brief Number of mapped bytes
+ *
+ * @param map Mapping
+ * @return size_t Length, 0 for an empty file
+ */
+size_t iot_fmap_size(const struct iot_fmap* map);
+
+/**
+ * @brief Change the access pattern hint of a mapped range
+ *
+ * @param map Mapping
+ * @param offset Start of the range, relative to iot_fmap_data
+ * @param length Length of the range
+ * @param advice Expected access pattern
+ * @return int 0 on success, negative value on error
+ */
+int iot_fmap_advise(struct iot_fmap* map, size_t offset, size_t length, enum iot_fmap_advice advice);
+
+/**
+ * @brief Unmap and free a mapping
+ *
+ * @param map Mapping from iot_fmap
+ * @return int 0 on success, negative value on error
+ */
+int iot_funmap(struct iot_fmap* map);
+
 // Directory operations
 int iot_mkdir(const char* path);
 int iot_remove(const char* path);
 int iot_mkdirp(const char* path);
 int iot_rmdir_recursive(const char* path);
+int iot_rename(const char* from, const char* to); // Atomically replaces to if it exists
 
 struct iot_dir;
 struct iot_dirent;
 
 struct iot_dir* iot_opendir(const char* path);
-struct iot_dirent* iot_readdir(struct iot_dir* dir);
+struct iot_dirent* iot_readdir(struct iot_dir* dir); // Skips "." and ".."; valid until the next call
 int iot_closedir(struct iot_dir* dir);
 
 // Dirent operations
 const char* iot_dirent_name(const struct iot_dirent* entry);
 bool iot_is_file(const struct iot_dirent* entry);
 
+/*
+ * Bulk directory scans. iot_dirscan_read fills a caller buffer with as
+ * many entries as fit, each with its type, size and modification time, so
+ * listing a directory of spool segments takes a few large directory reads
+ * and at most one stat per entry, instead of a readdir, a path rebuild and
+ * a stat for every file. Entries whose names do not match the pattern are
+ * dropped before they are stat'ed.
+ */
+
+// Smallest buffer iot_dirscan_read accepts; enough for any entry whose path is under 4 KiB
+#define IOT_DIRSCAN_MIN_BUFFER (4096 + 64)
+
+// Scan flags
+#define IOT_DIRSCAN_RECURSIVE 0x1 // Descend into subdirectories, never through symlinks
+#define IOT_DIRSCAN_DIRS_LAST 0x2 // Report a directory after its contents instead of before
+#define IOT_DIRSCAN_NO_STAT 0x4 // Leave size and mtime at 0; saves the stat where the type is known
+
+enum iot_dirscan_type {
+    IOT_DIRSCAN_FILE,
+    IOT_DIRSCAN_DIR,
+    IOT_DIRSCAN_SYMLINK,
+    IOT_DIRSCAN_OTHER
+};
+
+enum iot_dirscan_sort {
+    IOT_DIRSCAN_UNSORTED, // Directory order, streamed as it is read
+    IOT_DIRSCAN_BY_NAME, // Byte order of the relative paths
+    IOT_DIRSCAN_BY_MTIME, // Oldest first, ties by name
+    IOT_DIRSCAN_BY_SIZE // Smallest first, ties by name
+};
+
+struct iot_dirscan_options {
+    const char* pattern; /**< Glob matched against entry names (not paths), NULL for every entry */
+    enum iot_dirscan_sort sort; /**< Sorting reads the whole tree before the first entry is returned */
+    uint32_t flags; /**< IOT_DIRSCAN_* flags */
+};
+
+struct iot_dirscan_entry {
+    const char* name; /**< Path relative to the scanned directory; stored in the read buffer */
+    uint64_t size;
+    int64_t mtime_ms; /**< Modification time in milliseconds since the Unix epoch */
+    enum iot_dirscan_type type;
+};
+
+struct iot_dirscan;
+
+/**
+ * @brief Start scanning a directory
+ *
+ * "." and ".." are never reported.
+ *
+ * @param path Directory
+ * @param options Pattern, sorting and flags; NULL for all entries, unsorted
+ * @return struct iot_dirscan* Scan, NULL on error
+ */
+struct iot_dirscan* iot_dirscan_open(const char* path, const struct iot_dirscan_options* options);
+
+/**
+ * @brief Read the next entries into buf
+ *
+ * The entries are an array at the start of buf (aligned as needed); their
+ * names are packed at the end. Both stay valid until buf is reused.
+ *
+ * @param scan Scan
+ * @param buf Buffer of at least IOT_DIRSCAN_MIN_BUFFER bytes
+ * @param size Size of buf
+ * @param entries Set to the first entry
+ * @return int Number of entries, 0 once the scan is complete, negative value on error
+ */
+int iot_dirscan_read(struct iot_dirscan* scan, void* buf, size_t size, const struct iot_dirscan_entry** entries);
+
+/**
+ * @brief End a scan
+ *
+ * @param scan Scan
+ * @return int 0 on success, negative value on error
+ */
+int iot_dirscan_close(struct iot_dirscan* scan);
+
 // File information
 struct iot_stat {
     size_t st_size;
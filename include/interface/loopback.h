@@ -0,0 +1,89 @@
+#ifndef IOT_LOOPBACK_H
+#define IOT_LOOPBACK_H
+
+#include "interface/transport.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Characteristics of an emulated link, applied to each direction
+ *
+ * A zeroed profile is an ideal link. Data is never dropped: like TCP, a
+ * lost segment arrives one retransmit timeout late and holds back the
+ * segments behind it. Every random draw comes from seed, so a run with
+ * the same calls in the same order behaves the same way.
+ */
+struct iot_link_profile {
+    uint32_t rtt_us; /**< Round-trip time; each direction adds half, and connecting takes one */
+    uint32_t jitter_us; /**< Extra one-way delay per segment, uniform in [0, jitter_us] */
+    uint64_t bandwidth_bps; /**< Bits per second per direction (0: unlimited) */
+    uint32_t loss_ppm; /**< Segments lost per million */
+    uint32_t rto_us; /**< Retransmit timeout of a lost segment (0: 200 ms or two RTTs, whichever is larger) */
+    uint32_t mss; /**< Segment size in bytes (0: 1460) */
+    uint32_t max_write; /**< A send accepts a random 1..max_write bytes at most (0: no limit) */
+    uint32_t max_read; /**< A recv returns a random 1..max_read bytes at most (0: no limit) */
+    size_t window; /**< Unread bytes per direction before send blocks (0: 256 KiB) */
+    uint64_t seed; /**< Seed of the random draws */
+};
+
+// Opaque listener type
+struct iot_loopback_listener;
+
+/**
+ * @brief Serve host:port in memory through an emulated link
+ *
+ * While the listener exists, iot_transport_open to host and port connects
+ * to it without touching the network. The connection is used with the
+ * usual iot_transport_send/sendv/recv/close calls on both sides.
+ *
+ * @param host Host name clients connect to
+ * @param port Port clients connect to
+ * @param profile Link applied to every connection, or NULL for an ideal link
+ * @return struct iot_loopback_listener* Listener on success, NULL on failure
+ */
+struct iot_loopback_listener* iot_loopback_listen(const char* host, const char* port, const struct iot_link_profile* profile);
+
+/**
+ * @brief Wait for a client connection
+ *
+ * @param listener Listener handle
+ * @param ctx Set to the server end of the connection
+ * @param timeout_ms How long to wait (0: forever)
+ * @return int 0 on success, IOT_TRANSPORT_TIMEOUT if no client came,
+ *         other negative values on error
+ */
+int iot_loopback_accept(struct iot_loopback_listener* listener, void** ctx, uint32_t timeout_ms);
+
+/**
+ * @brief Wait for a client connection and apply socket options to the server end
+ *
+ * Only the send and receive timeouts of config apply to loopback connections.
+ *
+ * @param listener Listener handle
+ * @param ctx Set to the server end of the connection
+ * @param timeout_ms How long to wait (0: forever)
+ * @param config Options for the server end, or NULL for the defaults
+ * @return int 0 on success, IOT_TRANSPORT_TIMEOUT if no client came,
+ *         other negative values on error
+ */
+int iot_loopback_accept_with(struct iot_loopback_listener* listener, void** ctx, uint32_t timeout_ms, const struct iot_transport_config* config);
+
+/**
+ * @brief Stop serving and free the listener
+ *
+ * Connections not accepted yet are closed; accepted ones stay open. No
+ * thread may be waiting in iot_loopback_accept on it.
+ *
+ * @param listener Listener handle
+ */
+void iot_loopback_destroy(struct iot_loopback_listener* listener);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOT_LOOPBACK_H
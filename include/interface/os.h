@@ -1,6 +1,7 @@
 #ifndef IOT_OS_H
 #define IOT_OS_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -11,6 +12,16 @@ extern "C" {
 struct iot_thread;
 typedef struct iot_thread iot_thread;
 
+// Timeout value that waits until the event arrives
+#define IOT_WAIT_FOREVER UINT32_MAX
+
+// Returned by waits when the timeout expires first
+#define IOT_THREAD_TIMEOUT (-2)
+
+// Options for iot_thread_wait_flags
+#define IOT_FLAGS_WAIT_ALL 0x1u // Wait for every bit of the mask instead of any
+#define IOT_FLAGS_NO_CLEAR 0x2u // Leave the matched bits set
+
 // Thread function type
 typedef void (*iot_thread_func_t)(void* arg);
 
@@ -20,9 +31,10 @@ typedef void (*iot_thread_func_t)(void* arg);
  * @param name Name of the thread
  * @param func Thread function to execute
  * @param arg Argument passed to thread function
- * @param priority Thread priority
+ * @param priority Thread priority; only real-time threads use it
  * @param stack_size Stack size in bytes
- * @param event_count Maximum number of events thread can handle
+ * @param event_count Maximum number of events thread can handle; its mailbox holds at
+ *                    least this many (rounded up to a power of two), 0 for none
  * @return struct iot_thread* Thread handle on success, NULL on failure
  */
 struct iot_thread* iot_thread_create(const char* name, iot_thread_func_t func, void* arg,
@@ -86,6 +98,169 @@ void iot_thread_delay(uint32_t milliseconds);
  */
 int iot_thread_join(struct iot_thread* thread, void** retval);
 
+/*
+ * Thread placement: iot_thread_create_ex takes the attributes that decide
+ * where and how a thread runs. A CPU mask keeps a latency-sensitive thread
+ * on cores of its own and its data in their caches; the real-time classes
+ * run a thread ahead of every time-shared one, which usually needs
+ * CAP_SYS_NICE or an RLIMIT_RTPRIO allowance; a caller-provided stack can
+ * be placed in locked or node-local memory. CPUs are numbered as the
+ * system numbers them, 0 to 63 in a mask.
+ */
+
+// Scheduling classes
+enum iot_thread_sched {
+    IOT_THREAD_SCHED_DEFAULT, /**< Time-shared */
+    IOT_THREAD_SCHED_FIFO, /**< Real-time, runs until it blocks or a higher priority is ready */
+    IOT_THREAD_SCHED_RR /**< Real-time, round-robin among threads of equal priority */
+};
+
+// Thread attributes; start from iot_thread_attr_init
+struct iot_thread_attr {
+    const char* name; /**< Thread name, truncated to what the system keeps; NULL for none */
+    uint32_t priority; /**< For the real-time classes, levels above the lowest, capped at the highest */
+    enum iot_thread_sched sched; /**< Scheduling class */
+    uint64_t cpu_mask; /**< CPUs the thread may run on, bit n for CPU n; 0 for any */
+    void* stack; /**< Memory for the stack, stack_size bytes; NULL to allocate it */
+    uint32_t stack_size; /**< Stack size in bytes; 0 for the default, required with stack */
+    uint32_t event_count; /**< Mailbox size as for iot_thread_create, 0 for none */
+};
+
+// Where a CPU sits in the machine
+struct iot_cpu_info {
+    uint32_t cpu; /**< CPU number, as used in masks */
+    uint32_t core; /**< Physical core; hyperthreads of one core share it */
+    uint32_t package; /**< Socket */
+    uint32_t node; /**< NUMA node */
+};
+
+/**
+ * @brief Set attributes to their defaults: time-shared, any CPU, default stack, no events
+ *
+ * @param attr Attributes
+ */
+void iot_thread_attr_init(struct iot_thread_attr* attr);
+
+/**
+ * @brief Create a new thread with the given attributes
+ *
+ * @param func Thread function to execute
+ * @param arg Argument passed to thread function
+ * @param attr Attributes, NULL for the defaults
+ * @return struct iot_thread* Thread handle on success, NULL on failure, including
+ *         when the real-time class or CPU mask is not permitted
+ */
+struct iot_thread* iot_thread_create_ex(iot_thread_func_t func, void* arg, const struct iot_thread_attr* attr);
+
+/**
+ * @brief Restrict a thread to a set of CPUs
+ *
+ * @param thread Thread handle, NULL for the calling thread
+ * @param cpu_mask CPUs the thread may run on, bit n for CPU n; 0 for any
+ * @return int 0 on success, negative value on error or if no CPU in the mask is usable
+ */
+int iot_thread_set_affinity(struct iot_thread* thread, uint64_t cpu_mask);
+
+/**
+ * @brief Get the CPUs a thread may run on
+ *
+ * @param thread Thread handle, NULL for the calling thread
+ * @param cpu_mask Pointer to store the mask; CPUs above 63 are left out
+ * @return int 0 on success, negative value on error
+ */
+int iot_thread_get_affinity(struct iot_thread* thread, uint64_t* cpu_mask);
+
+/**
+ * @brief Count the CPUs that are online
+ *
+ * @return int Number of CPUs, at least 1
+ */
+int iot_cpu_count(void);
+
+/**
+ * @brief Get the CPU the calling thread is running on
+ *
+ * @return int CPU number, negative value if the system does not say
+ */
+int iot_cpu_current(void);
+
+/**
+ * @brief Describe the online CPUs
+ *
+ * @param cpus Array to fill, in CPU order
+ * @param max_cpus Length of cpus
+ * @return int Number of online CPUs, which may exceed max_cpus; negative value on error
+ */
+int iot_cpu_topology(struct iot_cpu_info* cpus, size_t max_cpus);
+
+/*
+ * Thread events: every thread from iot_thread_create has a mailbox of
+ * event_count 32-bit events and a 32-bit flags word. Any thread, or a
+ * signal handler, may post or set flags without taking a lock; only the
+ * thread itself waits on them. Events queue in order and each is received
+ * once; flags merge, so setting a bit twice before the wait is one wake-up.
+ */
+
+/**
+ * @brief Get the calling thread's handle
+ *
+ * @return struct iot_thread* Handle, NULL if the thread was not created by iot_thread_create
+ */
+struct iot_thread* iot_thread_self(void);
+
+/**
+ * @brief Post an event to a thread's mailbox
+ *
+ * Lock-free and async-signal-safe; wakes the thread if it is waiting.
+ *
+ * @param thread Thread handle
+ * @param event Event value
+ * @return int 0 on success, negative value if the mailbox is full or the thread has none
+ */
+int iot_thread_post(struct iot_thread* thread, uint32_t event);
+
+/**
+ * @brief Receive the next event posted to the calling thread
+ *
+ * @param event Pointer to store the event
+ * @param timeout_ms Longest time to wait; 0 polls, IOT_WAIT_FOREVER waits indefinitely
+ * @return int 0 on success, IOT_THREAD_TIMEOUT if none arrived in time, other negative value on error
+ */
+int iot_thread_wait_event(uint32_t* event, uint32_t timeout_ms);
+
+/**
+ * @brief Set bits in a thread's flags
+ *
+ * Lock-free and async-signal-safe; wakes the thread if it is waiting.
+ *
+ * @param thread Thread handle
+ * @param flags Bits to set
+ * @return int 0 on success, negative value on error
+ */
+int iot_thread_set_flags(struct iot_thread* thread, uint32_t flags);
+
+/**
+ * @brief Wait for bits in the calling thread's flags
+ *
+ * The matched bits are cleared unless IOT_FLAGS_NO_CLEAR is given.
+ *
+ * @param mask Bits to wait for
+ * @param options IOT_FLAGS_WAIT_ALL and IOT_FLAGS_NO_CLEAR, or 0 to wait for any bit and clear it
+ * @param flags Pointer to store the flags as they were when the wait was satisfied; may be NULL
+ * @param timeout_ms Longest time to wait; 0 polls, IOT_WAIT_FOREVER waits indefinitely
+ * @return int 0 on success, IOT_THREAD_TIMEOUT if the bits were not set in time, other negative value on error
+ */
+int iot_thread_wait_flags(uint32_t mask, uint32_t options, uint32_t* flags, uint32_t timeout_ms);
+
+/*
+ * Synchronisation: a non-recursive mutex, a writer-preferring
+ * reader-writer lock, a condition variable and a counting semaphore. Lock
+ * operations spin briefly while the holder is likely running on another
+ * CPU and then sleep in the kernel, so short critical sections rarely
+ * leave user space. Condition waits may wake spuriously; re-check the
+ * predicate as with pthreads.
+ */
+
 // Opaque mutex type
 struct iot_mutex;
 
@@ -104,6 +279,14 @@ struct iot_mutex* iot_mutex_init(void);
  */
 int iot_mutex_lock(struct iot_mutex* mutex);
 
+/**
+ * @brief Lock mutex if it is free
+ *
+ * @param mutex Mutex handle
+ * @return int 0 if locked, negative value if it is held or on error
+ */
+int iot_mutex_trylock(struct iot_mutex* mutex);
+
 /**
  * @brief Unlock mutex
  *
@@ -119,6 +302,252 @@ int iot_mutex_unlock(struct iot_mutex* mutex);
  */
 void iot_mutex_destroy(struct iot_mutex* mutex);
 
+// Opaque reader-writer lock type
+struct iot_rwlock;
+
+/**
+ * @brief Initialize reader-writer lock
+ *
+ * @return struct iot_rwlock* Lock handle on success, NULL on failure
+ */
+struct iot_rwlock* iot_rwlock_init(void);
+
+/**
+ * @brief Take the lock shared, alongside other readers
+ *
+ * Waits while a writer holds the lock or is waiting for it, so a stream of
+ * readers cannot starve writers. For the same reason a thread must not
+ * take a second read hold while it already has one.
+ *
+ * @param rwlock Lock handle
+ * @return int 0 on success, negative value on error
+ */
+int iot_rwlock_read_lock(struct iot_rwlock* rwlock);
+
+/**
+ * @brief Release a shared hold
+ *
+ * @param rwlock Lock handle
+ * @return int 0 on success, negative value on error
+ */
+int iot_rwlock_read_unlock(struct iot_rwlock* rwlock);
+
+/**
+ * @brief Take the lock exclusively
+ *
+ * @param rwlock Lock handle
+ * @return int 0 on success, negative value on error
+ */
+int iot_rwlock_write_lock(struct iot_rwlock* rwlock);
+
+/**
+ * @brief Release an exclusive hold
+ *
+ * @param rwlock Lock handle
+ * @return int 0 on success, negative value on error
+ */
+int iot_rwlock_write_unlock(struct iot_rwlock* rwlock);
+
+/**
+ * @brief Destroy reader-writer lock
+ *
+ * @param rwlock Lock handle
+ */
+void iot_rwlock_destroy(struct iot_rwlock* rwlock);
+
+// Opaque condition variable type
+struct iot_cond;
+
+/**
+ * @brief Initialize condition variable
+ *
+ * @return struct iot_cond* Condition variable handle on success, NULL on failure
+ */
+struct iot_cond* iot_cond_init(void);
+
+/**
+ * @brief Unlock mutex, wait for a signal and lock mutex again
+ *
+ * @param cond Condition variable handle
+ * @param mutex Mutex handle, locked by the caller
+ * @param timeout_ms Longest time to wait; IOT_WAIT_FOREVER waits indefinitely
+ * @return int 0 when woken, IOT_THREAD_TIMEOUT on timeout, other negative value on error;
+ *             the mutex is locked again in every case but the error
+ */
+int iot_cond_wait(struct iot_cond* cond, struct iot_mutex* mutex, uint32_t timeout_ms);
+
+/**
+ * @brief Wake one waiting thread
+ *
+ * @param cond Condition variable handle
+ * @return int 0 on success, negative value on error
+ */
+int iot_cond_signal(struct iot_cond* cond);
+
+/**
+ * @brief Wake every waiting thread
+ *
+ * @param cond Condition variable handle
+ * @return int 0 on success, negative value on error
+ */
+int iot_cond_broadcast(struct iot_cond* cond);
+
+/**
+ * @brief Destroy condition variable
+ *
+ * @param cond Condition variable handle
+ */
+void iot_cond_destroy(struct iot_cond* cond);
+
+// Opaque semaphore type
+struct iot_sem;
+
+/**
+ * @brief Initialize counting semaphore
+ *
+ * @param initial Starting count
+ * @return struct iot_sem* Semaphore handle on success, NULL on failure
+ */
+struct iot_sem* iot_sem_init(uint32_t initial);
+
+/**
+ * @brief Take one count, waiting for it if the semaphore is at zero
+ *
+ * @param sem Semaphore handle
+ * @param timeout_ms Longest time to wait; 0 polls, IOT_WAIT_FOREVER waits indefinitely
+ * @return int 0 on success, IOT_THREAD_TIMEOUT on timeout, other negative value on error
+ */
+int iot_sem_wait(struct iot_sem* sem, uint32_t timeout_ms);
+
+/**
+ * @brief Give one count back, waking a waiter if there is one
+ *
+ * @param sem Semaphore handle
+ * @return int 0 on success, negative value on error or overflow
+ */
+int iot_sem_post(struct iot_sem* sem);
+
+/**
+ * @brief Destroy semaphore
+ *
+ * @param sem Semaphore handle
+ */
+void iot_sem_destroy(struct iot_sem* sem);
+
+/*
+ * Work queue: a fixed set of worker threads sharing short tasks. Each
+ * worker keeps its own deque of tasks; it pushes and pops at one end and
+ * idle workers steal from the other, so load balances without a shared
+ * queue. Tasks submitted from other threads go through a shared injection
+ * queue. Tasks must not block on I/O for long; that holds up every task
+ * queued behind them on the same worker.
+ */
+
+// Opaque work queue and task group types
+struct iot_workqueue;
+struct iot_task_group;
+
+// Task function type
+typedef void (*iot_task_func_t)(void* arg);
+
+// Body of a parallel for: handles indices [begin, end)
+typedef void (*iot_range_func_t)(void* arg, size_t begin, size_t end);
+
+/**
+ * @brief Create a work queue and start its workers
+ *
+ * @param name Name of the worker threads
+ * @param workers Number of worker threads; 0 for one per online CPU
+ * @param stack_size Stack size of each worker in bytes; 0 for the default
+ * @return struct iot_workqueue* Work queue handle on success, NULL on failure
+ */
+struct iot_workqueue* iot_workqueue_create(const char* name, uint32_t workers, uint32_t stack_size);
+
+/**
+ * @brief Run every queued task, stop the workers and free the work queue
+ *
+ * Must not be called from one of its own tasks.
+ *
+ * @param wq Work queue handle
+ * @return int 0 on success, negative value on error
+ */
+int iot_workqueue_destroy(struct iot_workqueue* wq);
+
+/**
+ * @brief Get the number of worker threads
+ *
+ * @param wq Work queue handle
+ * @return uint32_t Number of workers, 0 if wq is NULL
+ */
+uint32_t iot_workqueue_workers(const struct iot_workqueue* wq);
+
+/**
+ * @brief Queue a task that nothing waits for
+ *
+ * From one of the queue's own tasks the task goes on that worker's deque,
+ * otherwise on the injection queue.
+ *
+ * @param wq Work queue handle
+ * @param func Task function
+ * @param arg Argument passed to func
+ * @return int 0 on success, negative value on error
+ */
+int iot_workqueue_submit(struct iot_workqueue* wq, iot_task_func_t func, void* arg);
+
+/**
+ * @brief Run func over [begin, end) in parallel and wait for it
+ *
+ * The range is split in halves until pieces are at most grain indices;
+ * idle workers steal the larger halves. The calling thread takes part.
+ *
+ * @param wq Work queue handle
+ * @param begin First index
+ * @param end One past the last index
+ * @param grain Largest piece handed to func; 0 picks one from the range and worker count
+ * @param func Range function
+ * @param arg Argument passed to func
+ * @return int 0 on success, negative value on error
+ */
+int iot_workqueue_parallel_for(struct iot_workqueue* wq, size_t begin, size_t end, size_t grain,
+    iot_range_func_t func, void* arg);
+
+/**
+ * @brief Create a task group to run tasks on a work queue and wait for them
+ *
+ * @param wq Work queue handle
+ * @return struct iot_task_group* Task group handle on success, NULL on failure
+ */
+struct iot_task_group* iot_task_group_create(struct iot_workqueue* wq);
+
+/**
+ * @brief Queue a task in a group
+ *
+ * Tasks may add further tasks to their own group.
+ *
+ * @param group Task group handle
+ * @param func Task function
+ * @param arg Argument passed to func
+ * @return int 0 on success, negative value on error
+ */
+int iot_task_group_run(struct iot_task_group* group, iot_task_func_t func, void* arg);
+
+/**
+ * @brief Wait for every task in the group, running queued tasks meanwhile
+ *
+ * Safe to call from a task of the same work queue.
+ *
+ * @param group Task group handle
+ * @return int 0 on success, negative value on error
+ */
+int iot_task_group_wait(struct iot_task_group* group);
+
+/**
+ * @brief Wait for the group and free it
+ *
+ * @param group Task group handle
+ */
+void iot_task_group_destroy(struct iot_task_group* group);
+
 #ifdef __cplusplus
 }
 #endif
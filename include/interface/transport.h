@@ -1,12 +1,53 @@
 #ifndef IOT_TRANSPORT_H
 #define IOT_TRANSPORT_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Returned by open, send and recv when a timeout expires
+#define IOT_TRANSPORT_TIMEOUT (-2)
+
+/**
+ * @brief Connection and socket options
+ *
+ * Timeouts of 0 wait forever, buffer sizes of 0 keep the system default.
+ */
+struct iot_transport_config {
+    uint32_t connect_timeout_ms; /**< Whole connect, across every address */
+    uint32_t attempt_delay_ms; /**< Head start of each address before the next one is tried */
+    uint32_t send_timeout_ms; /**< Per send call */
+    uint32_t recv_timeout_ms; /**< Per recv call */
+    bool tcp_nodelay; /**< Disable Nagle's algorithm */
+    bool keepalive; /**< Enable TCP keepalive probes */
+    uint32_t keepalive_idle_s; /**< Idle time before the first probe */
+    uint32_t keepalive_interval_s; /**< Time between probes */
+    uint32_t keepalive_count; /**< Unanswered probes before the connection drops */
+    int send_buffer_size; /**< SO_SNDBUF in bytes */
+    int recv_buffer_size; /**< SO_RCVBUF in bytes */
+    uint32_t dns_cache_ttl_ms; /**< How long resolved addresses are reused (0 disables the cache) */
+    size_t zerocopy_threshold; /**< Sends of at least this many bytes use MSG_ZEROCOPY where supported (0 disables) */
+};
+
+/**
+ * @brief One buffer of a vectored send
+ */
+struct iot_transport_iovec {
+    const void* base; /**< Start of the buffer */
+    size_t length; /**< Bytes to send from it */
+};
+
+/**
+ * @brief Fill a config with the defaults used by iot_transport_open
+ *
+ * @param config Config to fill
+ */
+void iot_transport_config_default(struct iot_transport_config* config);
+
 /**
  * @brief Open a connection to a remote host
  *
@@ -17,6 +58,37 @@ extern "C" {
  */
 int iot_transport_open(void** ctx, const char* host, const char* port);
 
+/**
+ * @brief Open a connection with explicit options
+ *
+ * Every address of the host is tried, alternating between IPv6 and IPv4
+ * (Happy Eyeballs): each attempt gets attempt_delay_ms before the next one
+ * starts in parallel, and the first to connect wins. The winning family is
+ * remembered for the host and tried first next time.
+ *
+ * @param ctx Pointer to a void pointer that will be set to the context
+ * @param host Hostname or IP address of the remote host
+ * @param port Port number as a string
+ * @param config Options, or NULL for the defaults
+ * @return int 0 on success, IOT_TRANSPORT_TIMEOUT if the connect timed out,
+ *         other negative values on error
+ */
+int iot_transport_open_with(void** ctx, const char* host, const char* port, const struct iot_transport_config* config);
+
+/**
+ * @brief Pin a host name to fixed addresses, bypassing DNS
+ *
+ * @param host Host name to pin
+ * @param addresses Space-separated numeric IPv4/IPv6 addresses, or NULL to remove the pin
+ * @return int 0 on success, negative value on error
+ */
+int iot_transport_add_host(const char* host, const char* addresses);
+
+/**
+ * @brief Drop every cached DNS result (pinned hosts are kept)
+ */
+void iot_transport_flush_dns(void);
+
 /**
  * @brief Close the connection and free resources
  *
@@ -30,17 +102,34 @@ void iot_transport_close(void* ctx);
  * @param ctx Context pointer (typically contains socket information)
  * @param buf Buffer containing data to send
  * @param len Length of data to send
- * @return int Number of bytes sent, or error code
+ * @return int Number of bytes sent, or error code (IOT_TRANSPORT_TIMEOUT if
+ *         nothing could be sent in time)
  */
 int iot_transport_send(void* ctx, const unsigned char* buf, size_t len);
 
+/**
+ * @brief Send several buffers in one write, without joining them first
+ *
+ * Sends at or above the configured zerocopy_threshold let the kernel read
+ * the buffers in place, and wait until it has released them before
+ * returning, so they may be reused as soon as the call returns.
+ *
+ * @param ctx Context pointer (typically contains socket information)
+ * @param iov Buffers to send, in order
+ * @param count Number of buffers
+ * @return int Number of bytes sent, or error code (IOT_TRANSPORT_TIMEOUT if
+ *         nothing could be sent in time)
+ */
+int iot_transport_sendv(void* ctx, const struct iot_transport_iovec* iov, size_t count);
+
 /**
  * @brief Receive data over SSL connection
  *
  * @param ctx Context pointer (typically contains socket information)
  * @param buf Buffer to store received data
  * @param len Maximum length of data to receive
- * @return int Number of bytes received, or error code
+ * @return int Number of bytes received, 0 if the peer closed the connection,
+ *         or error code (IOT_TRANSPORT_TIMEOUT if nothing arrived in time)
  */
 int iot_transport_recv(void* ctx, unsigned char* buf, size_t len);
 
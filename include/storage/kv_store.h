@@ -0,0 +1,168 @@
+#ifndef IOT_STORAGE_KV_STORE_H
+#define IOT_STORAGE_KV_STORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returned by iot_kv_get and iot_kv_delete for a key that is not stored
+#define IOT_KV_NOT_FOUND (-2)
+
+// Longest key, in bytes
+#define IOT_KV_MAX_KEY 1024
+
+/*
+ * Key-value store in a single append-only log file. Every write appends
+ * one CRC-checked record; an in-memory hash table maps each key to the
+ * offset of its latest value, so gets are one seek and read. Opening the
+ * store replays the log to rebuild the table and cuts off a torn or
+ * corrupt tail left by a crash. A batch is one record, so it is either
+ * replayed whole or not at all.
+ *
+ * Overwritten and deleted values stay in the log until compaction, which
+ * copies the live values to a new file and renames it over the log. It
+ * runs on a background thread once the dead share of the log passes
+ * compact_percent; writers and readers are only held up while the records
+ * appended during the copy are moved over. A store is safe to use from
+ * several threads.
+ */
+struct iot_kv;
+
+// Store settings
+struct iot_kv_config {
+    bool sync_writes; /**< fsync after every write; otherwise a crash may lose the latest writes, but never earlier ones */
+    uint32_t compact_percent; /**< Compact once this share of the log is dead (0: 50) */
+    size_t compact_min_bytes; /**< Never compact a log smaller than this (0: 64 KiB) */
+};
+
+// Store counters
+struct iot_kv_stats {
+    size_t keys;
+    uint64_t log_bytes; /**< Current size of the log file */
+    uint64_t live_bytes; /**< Bytes the live values would take after compaction */
+    uint64_t recovered_bytes; /**< Log bytes replayed when the store was opened */
+    uint64_t discarded_bytes; /**< Torn or corrupt tail cut off when the store was opened */
+    uint32_t compactions;
+};
+
+/**
+ * @brief Open a store, creating its log if needed
+ *
+ * @param path Log file; compaction also uses path with ".compact" appended
+ * @param config Settings, NULL for the defaults
+ * @return struct iot_kv* Store, NULL on error or if path is not a store log
+ */
+struct iot_kv* iot_kv_open(const char* path, const struct iot_kv_config* config);
+
+/**
+ * @brief Wait for a running compaction, flush and close the store
+ *
+ * @param kv Store
+ * @return int 0 on success, negative value on error
+ */
+int iot_kv_close(struct iot_kv* kv);
+
+/**
+ * @brief Store a value under key, replacing any previous one
+ *
+ * @param kv Store
+ * @param key NUL-terminated key of at most IOT_KV_MAX_KEY bytes
+ * @param value Value bytes
+ * @param length Value length
+ * @return int 0 on success, negative value on error
+ */
+int iot_kv_put(struct iot_kv* kv, const char* key, const void* value, size_t length);
+
+/**
+ * @brief Read the value of key
+ *
+ * @param kv Store
+ * @param key Key
+ * @param buf Receives the first size bytes of the value
+ * @param size Size of buf
+ * @param length Set to the full value length, which may exceed size
+ * @return int 0 on success, IOT_KV_NOT_FOUND, or another negative value on error
+ */
+int iot_kv_get(struct iot_kv* kv, const char* key, void* buf, size_t size, size_t* length);
+
+/**
+ * @brief Remove key
+ *
+ * @param kv Store
+ * @param key Key
+ * @return int 0 on success, IOT_KV_NOT_FOUND, or another negative value on error
+ */
+int iot_kv_delete(struct iot_kv* kv, const char* key);
+
+/**
+ * @brief Compact the log now, waiting until it is done
+ *
+ * @param kv Store
+ * @return int 0 on success, negative value on error
+ */
+int iot_kv_compact(struct iot_kv* kv);
+
+/**
+ * @brief Read the store counters
+ *
+ * @param kv Store
+ * @param stats Filled in
+ */
+void iot_kv_get_stats(struct iot_kv* kv, struct iot_kv_stats* stats);
+
+// Puts and deletes applied together by iot_kv_write
+struct iot_kv_batch;
+
+/**
+ * @brief Create an empty batch
+ *
+ * @return struct iot_kv_batch* Batch, NULL on error
+ */
+struct iot_kv_batch* iot_kv_batch_create(void);
+
+/**
+ * @brief Add a put to the batch; the value is copied
+ *
+ * @return int 0 on success, negative value on error
+ */
+int iot_kv_batch_put(struct iot_kv_batch* batch, const char* key, const void* value, size_t length);
+
+/**
+ * @brief Add a delete to the batch; deleting a missing key is not an error
+ *
+ * @return int 0 on success, negative value on error
+ */
+int iot_kv_batch_delete(struct iot_kv_batch* batch, const char* key);
+
+/**
+ * @brief Empty the batch for reuse
+ *
+ * @param batch Batch
+ */
+void iot_kv_batch_clear(struct iot_kv_batch* batch);
+
+/**
+ * @brief Free a batch
+ *
+ * @param batch Batch
+ */
+void iot_kv_batch_destroy(struct iot_kv_batch* batch);
+
+/**
+ * @brief Apply every operation of the batch, in order, as one record
+ *
+ * @param kv Store
+ * @param batch Batch; left unchanged
+ * @return int 0 on success, negative value on error (nothing is applied)
+ */
+int iot_kv_write(struct iot_kv* kv, const struct iot_kv_batch* batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOT_STORAGE_KV_STORE_H
@@ -0,0 +1,156 @@
+#ifndef IOT_STORAGE_RING_LOG_H
+#define IOT_STORAGE_RING_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returned by iot_ring_log_read when the cursor has caught up with the writer
+#define IOT_RING_LOG_END (-2)
+
+// Returned by iot_ring_log_read when buf is too small for the next record
+#define IOT_RING_LOG_TOO_SMALL (-3)
+
+/*
+ * Bounded record log in a preallocated file, for buffering telemetry while
+ * the uplink is down. Records are appended in place after the previous
+ * one and wrap to the start of the file; once it is full, each append
+ * overwrites the oldest records, so the file never grows.
+ *
+ * Every record carries a sequence number and a CRC. The file header holds
+ * a checkpoint of the write and read positions, written every
+ * checkpoint_interval appends and whenever the reader commits, so opening
+ * the log after a power loss only scans the records appended since the
+ * last checkpoint and stops at the first torn one.
+ *
+ * One reader consumes the records in order through a cursor. Committing
+ * the cursor marks the records before it as sent, so they are not
+ * delivered again after a restart; records overwritten before they were
+ * read are counted as lost. A log is safe to use from several threads.
+ */
+struct iot_ring_log;
+
+// Log settings
+struct iot_ring_log_config {
+    uint32_t capacity; /**< Record space of a new file in bytes (0: 64 KiB); an existing file keeps its own */
+    uint32_t checkpoint_interval; /**< Appends between checkpoints, bounding the recovery scan (0: 64) */
+    bool sync_writes; /**< fsync after every append and checkpoint */
+};
+
+// Log counters
+struct iot_ring_log_stats {
+    uint32_t capacity; /**< Record space in bytes */
+    uint32_t used_bytes; /**< Record space holding stored records */
+    uint64_t records; /**< Stored records, read or not */
+    uint64_t unread; /**< Records after the committed read position */
+    uint64_t next_seq; /**< Sequence number of the next append */
+    uint64_t lost; /**< Records overwritten before they were read */
+    uint64_t recovered; /**< Records found past the checkpoint when the log was opened */
+};
+
+// Position of a reader; records are read in sequence order
+struct iot_ring_log_cursor {
+    uint64_t seq; /**< Sequence number of the next record to read */
+    uint32_t offset; /**< Where that record is stored */
+};
+
+/**
+ * @brief Open a ring log, creating and preallocating its file if needed
+ *
+ * @param path Log file
+ * @param config Settings, NULL for the defaults
+ * @return struct iot_ring_log* Log, NULL on error or if path is not a ring log
+ */
+struct iot_ring_log* iot_ring_log_open(const char* path, const struct iot_ring_log_config* config);
+
+/**
+ * @brief Write a checkpoint and close the log
+ *
+ * @param log Log
+ * @return int 0 on success, negative value on error
+ */
+int iot_ring_log_close(struct iot_ring_log* log);
+
+/**
+ * @brief Append a record, overwriting the oldest records if the log is full
+ *
+ * @param log Log
+ * @param data Record bytes
+ * @param length Record length; at most the capacity less 16 bytes of header
+ * @return int 0 on success, negative value on error
+ */
+int iot_ring_log_append(struct iot_ring_log* log, const void* data, size_t length);
+
+/**
+ * @brief Position a cursor at the first record not yet committed
+ *
+ * @param log Log
+ * @param cursor Set to the committed read position
+ */
+void iot_ring_log_cursor_init(struct iot_ring_log* log, struct iot_ring_log_cursor* cursor);
+
+/**
+ * @brief Read the record at the cursor and advance it
+ *
+ * A cursor whose record has been overwritten skips ahead to the oldest
+ * stored record.
+ *
+ * @param log Log
+ * @param cursor Cursor
+ * @param buf Receives the record
+ * @param size Size of buf
+ * @param length Set to the record length, also when buf is too small
+ * @return int 0 on success, IOT_RING_LOG_END, IOT_RING_LOG_TOO_SMALL (the
+ *         cursor is not advanced), or another negative value on error
+ */
+int iot_ring_log_read(struct iot_ring_log* log, struct iot_ring_log_cursor* cursor, void* buf, size_t size, size_t* length);
+
+/**
+ * @brief Mark every record before the cursor as read and write a checkpoint
+ *
+ * @param log Log
+ * @param cursor Cursor
+ * @return int 0 on success, negative value on error
+ */
+int iot_ring_log_commit(struct iot_ring_log* log, const struct iot_ring_log_cursor* cursor);
+
+/**
+ * @brief Receives records from iot_ring_log_drain
+ *
+ * @return int 0 if the record was delivered, negative value to stop
+ */
+typedef int (*iot_ring_log_sink)(void* ctx, const uint8_t* record, size_t length);
+
+/**
+ * @brief Pass up to max_records unread records to sink, then commit them
+ *
+ * The records are read one at a time and the sink is called without the
+ * log locked, so appends carry on while it sends. Records delivered before
+ * a failure are committed; the one the sink refused is offered again on
+ * the next drain.
+ *
+ * @param log Log
+ * @param max_records Largest batch
+ * @param sink Called once per record, in order
+ * @param ctx Passed to sink
+ * @return int Records delivered, or negative value if reading or the sink failed
+ */
+int iot_ring_log_drain(struct iot_ring_log* log, size_t max_records, iot_ring_log_sink sink, void* ctx);
+
+/**
+ * @brief Read the log counters
+ *
+ * @param log Log
+ * @param stats Filled in
+ */
+void iot_ring_log_get_stats(struct iot_ring_log* log, struct iot_ring_log_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOT_STORAGE_RING_LOG_H
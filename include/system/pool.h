@@ -0,0 +1,76 @@
+#ifndef IOT_SYSTEM_POOL_H
+#define IOT_SYSTEM_POOL_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Largest request served from a pool; larger ones go to malloc
+#define IOT_POOL_MAX_BLOCK 2048
+
+/*
+ * Fixed-block pools for the short-lived allocations of the data and
+ * connectivity paths. Requests up to IOT_POOL_MAX_BLOCK bytes are rounded
+ * up to one of 14 size classes, 16 bytes to 2 KB, and each class hands out
+ * blocks of exactly its size carved from 16 KB chunks. A freed block only
+ * ever serves its own class again, so a device that allocates the same mix
+ * of sizes for weeks holds the same memory, bounded by the peak number of
+ * blocks live at once, instead of an ever more fragmented heap. Chunks are
+ * never returned to the system.
+ *
+ * Allocation and release are O(1) and, most of the time, touch only a
+ * cache of blocks per class kept by the calling thread; the shared lists
+ * are locked only to move half a cache at a time. Blocks may be freed by
+ * any thread, and every thread hands its cache back when it exits.
+ */
+
+// Occupancy of the pools, for leak and soak tests
+struct iot_pool_stats {
+    size_t reserved_bytes; /**< Held in chunks, over all classes */
+    size_t total_blocks; /**< Carved from the chunks */
+    size_t free_blocks; /**< In the shared lists, not counting thread caches */
+    size_t large_in_use; /**< Live allocations above IOT_POOL_MAX_BLOCK */
+};
+
+/**
+ * @brief Allocate memory, aligned as for malloc
+ *
+ * @param size Size in bytes
+ * @return void* Memory to release with iot_pool_free, NULL on failure
+ */
+void* iot_pool_alloc(size_t size);
+
+/**
+ * @brief Copy a string into memory from iot_pool_alloc
+ *
+ * @param str String to copy
+ * @return char* Copy to release with iot_pool_free, NULL on failure or if str is NULL
+ */
+char* iot_pool_strdup(const char* str);
+
+/**
+ * @brief Release memory from iot_pool_alloc or iot_pool_strdup
+ *
+ * @param ptr Memory to release, NULL for none
+ */
+void iot_pool_free(void* ptr);
+
+/**
+ * @brief Return the calling thread's cached blocks to the shared lists
+ */
+void iot_pool_thread_flush(void);
+
+/**
+ * @brief Report the occupancy of the pools
+ *
+ * @param stats Filled with the current figures
+ */
+void iot_pool_get_stats(struct iot_pool_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOT_SYSTEM_POOL_H
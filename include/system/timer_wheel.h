@@ -0,0 +1,158 @@
+#ifndef IOT_SYSTEM_TIMER_WHEEL_H
+#define IOT_SYSTEM_TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returned by iot_timer_wheel_next_expiry when no timer is pending
+#define IOT_TIMER_WHEEL_IDLE UINT64_MAX
+
+/*
+ * Hierarchical timing wheel for keep-alives, retries, backoffs and other
+ * scheduled work. Six levels of 64 slots each cover 64 times the span of
+ * the level below, so a timer is filed in O(1) by how far away it is and
+ * moves down a level as its expiry approaches. Starting and cancelling a
+ * timer are O(1) whatever the number pending, and advancing the wheel
+ * costs time only for the timers that fire or move, not for the others.
+ *
+ * Times are milliseconds on the clock of iot_get_time(IOT_TIME_MILLISECONDS),
+ * supplied by the caller, and timers fire on the first advance at or past
+ * their expiry rounded up to the tick. A wheel is driven by one thread, the
+ * event loop that owns it: call iot_timer_wheel_advance when woken, and
+ * sleep for iot_timer_wheel_timeout in between rather than on a fixed
+ * tick. A wheel is not safe to use from several threads; callbacks run on
+ * the advancing thread and may start or cancel any timer.
+ */
+struct iot_timer_wheel;
+struct iot_timer;
+
+/**
+ * @brief Called when a timer fires
+ *
+ * @param timer The timer; it is no longer pending unless it is periodic
+ * @param arg Argument given to iot_timer_init
+ */
+typedef void (*iot_timer_func_t)(struct iot_timer* timer, void* arg);
+
+// A timer, owned by the caller and usually embedded in the object it serves.
+// The fields are managed by the wheel; set them up with iot_timer_init
+struct iot_timer {
+    struct iot_timer* next;
+    struct iot_timer** pprev; /**< NULL while not pending */
+    uint64_t expires; /**< Expiry in ticks */
+    uint32_t period; /**< Period in ticks, 0 for a one-shot timer */
+    uint16_t slot;
+    iot_timer_func_t func;
+    void* arg;
+};
+
+/**
+ * @brief Create a timer wheel
+ *
+ * @param tick_ms Resolution in milliseconds (0: 1 ms); expiries are rounded up to it
+ * @param now_ms Current time
+ * @return struct iot_timer_wheel* Wheel, NULL on error
+ */
+struct iot_timer_wheel* iot_timer_wheel_create(uint32_t tick_ms, uint64_t now_ms);
+
+/**
+ * @brief Destroy a timer wheel; its pending timers are stopped without firing
+ *
+ * @param wheel Wheel
+ */
+void iot_timer_wheel_destroy(struct iot_timer_wheel* wheel);
+
+/**
+ * @brief Set up a timer, which starts out stopped
+ *
+ * @param timer Timer
+ * @param func Called when the timer fires
+ * @param arg Passed to func
+ */
+void iot_timer_init(struct iot_timer* timer, iot_timer_func_t func, void* arg);
+
+/**
+ * @brief Start a timer, restarting it if it is pending
+ *
+ * A periodic timer is started again each time it fires, a period after its
+ * previous expiry, so it does not drift with late advances.
+ *
+ * @param wheel Wheel
+ * @param timer Timer
+ * @param delay_ms Time from the wheel's last advance to the first expiry
+ * @param period_ms Time between later expiries, 0 to fire once
+ * @return int 0 on success, negative value on error
+ */
+int iot_timer_start(struct iot_timer_wheel* wheel, struct iot_timer* timer, uint64_t delay_ms, uint32_t period_ms);
+
+/**
+ * @brief Stop a timer
+ *
+ * @param wheel Wheel
+ * @param timer Timer
+ * @return int 1 if the timer was pending, 0 if not, negative value on error
+ */
+int iot_timer_cancel(struct iot_timer_wheel* wheel, struct iot_timer* timer);
+
+/**
+ * @brief Tell whether a timer is waiting to fire
+ *
+ * @param timer Timer
+ * @return bool true if started and not yet fired or cancelled
+ */
+bool iot_timer_pending(const struct iot_timer* timer);
+
+/**
+ * @brief Move the wheel to now_ms, firing every timer that has expired
+ *
+ * Stretches without timers are skipped whole, so a loop that slept for a
+ * long time catches up in a handful of steps.
+ *
+ * @param wheel Wheel
+ * @param now_ms Current time; times earlier than the last advance are ignored
+ * @return int Number of timers fired, negative value on error
+ */
+int iot_timer_wheel_advance(struct iot_timer_wheel* wheel, uint64_t now_ms);
+
+/**
+ * @brief Time at which the wheel next needs advancing
+ *
+ * The first expiry when it is near. When the nearest timer is further out,
+ * the earlier time at which it moves down a level; advancing then fires
+ * nothing and the next call reports a closer time.
+ *
+ * @param wheel Wheel
+ * @return uint64_t Time in milliseconds, IOT_TIMER_WHEEL_IDLE if no timer is pending
+ */
+uint64_t iot_timer_wheel_next_expiry(const struct iot_timer_wheel* wheel);
+
+/**
+ * @brief How long the owning thread may sleep before advancing the wheel
+ *
+ * For timeouts such as those of iot_thread_wait_event and poll.
+ *
+ * @param wheel Wheel
+ * @param now_ms Current time
+ * @return uint32_t Milliseconds until iot_timer_wheel_next_expiry, 0 if
+ *         that has passed, UINT32_MAX (IOT_WAIT_FOREVER) if no timer is pending
+ */
+uint32_t iot_timer_wheel_timeout(const struct iot_timer_wheel* wheel, uint64_t now_ms);
+
+/**
+ * @brief Count the pending timers
+ *
+ * @param wheel Wheel
+ * @return size_t Timers started and not yet fired or cancelled
+ */
+size_t iot_timer_wheel_pending(const struct iot_timer_wheel* wheel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOT_SYSTEM_TIMER_WHEEL_H
@@ -0,0 +1,150 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include "interface/clock.h"
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#if defined(CLOCK_MONOTONIC_COARSE)
+#define COARSE_CLOCK CLOCK_MONOTONIC_COARSE
+#elif defined(CLOCK_MONOTONIC_FAST)
+#define COARSE_CLOCK CLOCK_MONOTONIC_FAST
+#else
+#define COARSE_CLOCK CLOCK_MONOTONIC
+#endif
+
+/*
+ * clock_gettime is answered from the vDSO on Linux without entering the
+ * kernel: the fine clocks read the timestamp counter and scale it, the
+ * coarse one only copies the time the kernel stored at its last tick.
+ *
+ * The x86 timestamp counter runs at a fixed rate on current CPUs but its
+ * frequency is not exposed to user space, so it is measured: the counter
+ * is read between two monotonic clock reads, keeping the tightest of a few
+ * tries, before and after a 10 ms sleep. The arm64 virtual counter states
+ * its frequency. Elsewhere the cycle counter is the monotonic clock.
+ */
+
+#define NS_PER_SEC 1000000000ull
+#define CALIBRATION_NS 10000000L
+#define CALIBRATION_TRIES 5
+
+static pthread_once_t calibrate_once = PTHREAD_ONCE_INIT;
+static uint64_t cycles_per_second;
+
+static uint64_t read_clock(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t iot_get_time(enum iot_time_unit unit)
+{
+    switch (unit) {
+    case IOT_TIME_MICROSECONDS:
+        return read_clock(CLOCK_MONOTONIC) / 1000u;
+    case IOT_TIME_MILLISECONDS:
+        return read_clock(CLOCK_MONOTONIC) / 1000000u;
+    case IOT_TIME_SECONDS:
+        return read_clock(CLOCK_REALTIME) / NS_PER_SEC;
+    }
+    return 0;
+}
+
+uint64_t iot_time_monotonic_ns(void)
+{
+    return read_clock(CLOCK_MONOTONIC);
+}
+
+uint64_t iot_time_realtime_ns(void)
+{
+    return read_clock(CLOCK_REALTIME);
+}
+
+uint64_t iot_time_coarse_ns(void)
+{
+    return read_clock(COARSE_CLOCK);
+}
+
+uint64_t iot_time_coarse_resolution_ns(void)
+{
+    struct timespec ts;
+    if (clock_getres(COARSE_CLOCK, &ts) != 0) {
+        return 0;
+    }
+    return (uint64_t)ts.tv_sec * NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t iot_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    uint64_t cycles;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(cycles));
+    return cycles;
+#else
+    return read_clock(CLOCK_MONOTONIC);
+#endif
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// A cycle count and the monotonic time it was read at, to within the tightest bracket
+static void sample(uint64_t* ns, uint64_t* cycles)
+{
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < CALIBRATION_TRIES; i++) {
+        uint64_t before = read_clock(CLOCK_MONOTONIC);
+        uint64_t count = iot_cycles();
+        uint64_t after = read_clock(CLOCK_MONOTONIC);
+        if (after - before < best) {
+            best = after - before;
+            *ns = before + (after - before) / 2;
+            *cycles = count;
+        }
+    }
+}
+#endif
+
+static void calibrate(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t start_ns = 0;
+    uint64_t start_cycles = 0;
+    uint64_t end_ns = 0;
+    uint64_t end_cycles = 0;
+    sample(&start_ns, &start_cycles);
+    struct timespec pause = { 0, CALIBRATION_NS };
+    while (nanosleep(&pause, &pause) != 0 && errno == EINTR) {
+    }
+    sample(&end_ns, &end_cycles);
+    uint64_t elapsed = end_ns - start_ns;
+    uint64_t counted = end_cycles - start_cycles;
+    // In two parts, in case the sleep overran by seconds
+    cycles_per_second = elapsed != 0 ? counted / elapsed * NS_PER_SEC + counted % elapsed * NS_PER_SEC / elapsed : 0;
+#elif defined(__aarch64__)
+    uint64_t frequency;
+    __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(frequency));
+    cycles_per_second = frequency;
+#else
+    cycles_per_second = NS_PER_SEC;
+#endif
+    if (cycles_per_second == 0) {
+        cycles_per_second = NS_PER_SEC;
+    }
+}
+
+uint64_t iot_cycles_per_second(void)
+{
+    pthread_once(&calibrate_once, calibrate);
+    return cycles_per_second;
+}
+
+uint64_t iot_cycles_to_ns(uint64_t cycles)
+{
+    uint64_t frequency = iot_cycles_per_second();
+    // In two parts, so long intervals do not overflow
+    return cycles / frequency * NS_PER_SEC + cycles % frequency * NS_PER_SEC / frequency;
+}
@@ -0,0 +1,677 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE // d_type and DT_* in dirent.h
+
+#include "filesystem_internal.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+// Bytes buffered across all files before a writer must flush its own buffer
+#ifndef IOT_FBUFFER_MAX_DIRTY
+#define IOT_FBUFFER_MAX_DIRTY (1024 * 1024)
+#endif
+
+struct iot_dirent {
+    char name[NAME_MAX + 1];
+    bool is_file;
+};
+
+struct iot_dir {
+    DIR* dir;
+    struct iot_dirent entry;
+};
+
+struct iot_fmap {
+    void* base; // Page-aligned start of the mapping, NULL when empty
+    size_t mapped; // Length of the mapping from base
+    const unsigned char* data; // Byte at the requested offset
+    size_t size;
+};
+
+/*
+ * Buffered files are on one list, walked by a single flusher thread. The
+ * thread wakes every half of the shortest flush interval on the list and
+ * writes out each buffer that has been dirty for half its interval or
+ * more, so no byte stays buffered longer than its interval. It starts with
+ * the first buffered file and stops when the last one is closed. Lock
+ * order is registry_lock, then a file's lock; writers never take
+ * registry_lock. The flusher writes a buffer out holding only that file's
+ * lock, so opening and closing files never waits on the disk; the file is
+ * marked as flushing meanwhile, and closing it waits for the mark to clear.
+ */
+struct flusher {
+    pthread_t thread;
+    bool stop;
+};
+
+static pthread_once_t registry_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t registry_changed;
+static struct iot_file* registry;
+static struct flusher* flusher;
+static atomic_size_t dirty_bytes;
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+// Write all of buf, retrying short writes; returns the bytes written
+static size_t write_all(int fd, const unsigned char* buf, size_t len)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t n = write(fd, buf + done, len - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        done += (size_t)n;
+    }
+    return done;
+}
+
+// Hand the buffer to the backend; the caller holds file->lock
+static int flush_locked(struct iot_file* file)
+{
+    if (file->used == 0) {
+        return 0;
+    }
+    size_t written = write_all(file->fd, file->buffer, file->used);
+    atomic_fetch_sub_explicit(&dirty_bytes, file->used, memory_order_relaxed);
+    int ret = written == file->used ? 0 : -1;
+    file->used = 0;
+    return ret;
+}
+
+// Flush before an operation that must see the written bytes, and lock the file for it
+static int begin_op(struct iot_file* file)
+{
+    if (file->buffer == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&file->lock);
+    return flush_locked(file);
+}
+
+static void end_op(struct iot_file* file)
+{
+    if (file->buffer != NULL) {
+        pthread_mutex_unlock(&file->lock);
+    }
+}
+
+static void registry_init(void)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&registry_changed, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void* flusher_main(void* arg)
+{
+    struct flusher* self = (struct flusher*)arg;
+
+    pthread_mutex_lock(&registry_lock);
+    while (!self->stop) {
+        uint64_t now = now_ms();
+        uint32_t tick = UINT32_MAX;
+        struct iot_file* due = NULL;
+        for (struct iot_file* file = registry; file != NULL; file = file->next) {
+            uint32_t half = file->interval_ms > 1 ? file->interval_ms / 2 : 1;
+            if (half < tick) {
+                tick = half;
+            }
+            if (due == NULL) {
+                pthread_mutex_lock(&file->lock);
+                if (file->used > 0 && now >= file->dirty_since_ms + half) {
+                    due = file;
+                }
+                pthread_mutex_unlock(&file->lock);
+            }
+        }
+        if (due != NULL) {
+            // Write it out unlisted, then look again from the start
+            due->flushing = true;
+            pthread_mutex_unlock(&registry_lock);
+            pthread_mutex_lock(&due->lock);
+            if (flush_locked(due) != 0) {
+                due->failed = true;
+            }
+            pthread_mutex_unlock(&due->lock);
+            pthread_mutex_lock(&registry_lock);
+            due->flushing = false;
+            pthread_cond_broadcast(&registry_changed);
+            continue;
+        }
+        if (tick == UINT32_MAX) {
+            pthread_cond_wait(&registry_changed, &registry_lock);
+            continue;
+        }
+        uint64_t deadline = now + tick;
+        struct timespec ts = { (time_t)(deadline / 1000u), (long)(deadline % 1000u) * 1000000L };
+        pthread_cond_timedwait(&registry_changed, &registry_lock, &ts);
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return NULL;
+}
+
+static int registry_add(struct iot_file* file)
+{
+    pthread_once(&registry_once, registry_init);
+    pthread_mutex_lock(&registry_lock);
+    if (flusher == NULL) {
+        struct flusher* started = (struct flusher*)calloc(1, sizeof(struct flusher));
+        if (started == NULL || pthread_create(&started->thread, NULL, flusher_main, started) != 0) {
+            pthread_mutex_unlock(&registry_lock);
+            free(started);
+            return -1;
+        }
+        flusher = started;
+    }
+    file->next = registry;
+    registry = file;
+    pthread_cond_broadcast(&registry_changed); // The new file may shorten the tick
+    pthread_mutex_unlock(&registry_lock);
+    return 0;
+}
+
+static void registry_remove(struct iot_file* file)
+{
+    struct flusher* stopped = NULL;
+
+    pthread_mutex_lock(&registry_lock);
+    for (struct iot_file** link = &registry; *link != NULL; link = &(*link)->next) {
+        if (*link == file) {
+            *link = file->next;
+            break;
+        }
+    }
+    while (file->flushing) {
+        pthread_cond_wait(&registry_changed, &registry_lock);
+    }
+    if (registry == NULL && flusher != NULL) {
+        stopped = flusher;
+        stopped->stop = true;
+        flusher = NULL;
+        pthread_cond_broadcast(&registry_changed);
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    if (stopped != NULL) {
+        pthread_join(stopped->thread, NULL);
+        free(stopped);
+    }
+}
+
+// Translate an fopen mode string into open flags; -1 if it is not one
+static int open_flags(const char* mode)
+{
+    int flags;
+
+    switch (mode[0]) {
+    case 'r':
+        flags = O_RDONLY;
+        break;
+    case 'w':
+        flags = O_WRONLY | O_CREAT | O_TRUNC;
+        break;
+    case 'a':
+        flags = O_WRONLY | O_CREAT | O_APPEND;
+        break;
+    default:
+        return -1;
+    }
+    for (const char* m = mode + 1; *m != '\0'; m++) {
+        if (*m == '+') {
+            flags = (flags & ~O_WRONLY) | O_RDWR;
+        } else if (*m == 'x' && mode[0] == 'w') {
+            flags |= O_EXCL;
+        } else if (*m != 'b' && *m != 'e') {
+            return -1;
+        }
+    }
+    return flags | O_CLOEXEC;
+}
+
+struct iot_file* iot_fopen(const char* path, const char* mode)
+{
+    if (path == NULL || mode == NULL) {
+        return NULL;
+    }
+    int flags = open_flags(mode);
+    if (flags < 0) {
+        return NULL;
+    }
+
+    struct iot_file* file = (struct iot_file*)calloc(1, sizeof(struct iot_file));
+    if (file == NULL) {
+        return NULL;
+    }
+    do {
+        file->fd = open(path, flags, 0644);
+    } while (file->fd < 0 && errno == EINTR);
+    if (file->fd < 0) {
+        free(file);
+        return NULL;
+    }
+    return file;
+}
+
+struct iot_file* iot_fopen_buffered(const char* path, const char* mode, const struct iot_fbuffer_config* config)
+{
+    struct iot_file* file = iot_fopen(path, mode);
+    if (file == NULL) {
+        return NULL;
+    }
+    file->capacity = config != NULL && config->buffer_size != 0 ? config->buffer_size : IOT_FBUFFER_DEFAULT_SIZE;
+    file->interval_ms = config != NULL && config->flush_interval_ms != 0 ? config->flush_interval_ms : IOT_FBUFFER_DEFAULT_INTERVAL_MS;
+    file->buffer = (unsigned char*)malloc(file->capacity);
+    if (file->buffer == NULL || pthread_mutex_init(&file->lock, NULL) != 0) {
+        free(file->buffer);
+        file->buffer = NULL;
+        iot_fclose(file);
+        return NULL;
+    }
+    if (registry_add(file) != 0) {
+        pthread_mutex_destroy(&file->lock);
+        free(file->buffer);
+        file->buffer = NULL;
+        iot_fclose(file);
+        return NULL;
+    }
+    return file;
+}
+
+size_t iot_fwrite(const void* ptr, size_t size, size_t count, struct iot_file* file)
+{
+    if (file == NULL || ptr == NULL || size == 0 || count > SIZE_MAX / size) {
+        return 0;
+    }
+    const unsigned char* p = (const unsigned char*)ptr;
+    size_t total = size * count;
+    if (file->buffer == NULL) {
+        return write_all(file->fd, p, total) / size;
+    }
+
+    size_t done = 0;
+    pthread_mutex_lock(&file->lock);
+    bool over_limit = atomic_load_explicit(&dirty_bytes, memory_order_relaxed) + total > IOT_FBUFFER_MAX_DIRTY;
+    if ((file->used + total > file->capacity || over_limit) && flush_locked(file) != 0) {
+        pthread_mutex_unlock(&file->lock);
+        return 0;
+    }
+    if (total >= file->capacity) {
+        done = write_all(file->fd, p, total);
+    } else {
+        if (file->used == 0) {
+            file->dirty_since_ms = now_ms();
+        }
+        memcpy(file->buffer + file->used, p, total);
+        file->used += total;
+        atomic_fetch_add_explicit(&dirty_bytes, total, memory_order_relaxed);
+        done = total;
+    }
+    pthread_mutex_unlock(&file->lock);
+    return done / size;
+}
+
+size_t iot_fread(void* ptr, size_t size, size_t count, struct iot_file* file)
+{
+    if (file == NULL || ptr == NULL || size == 0 || count > SIZE_MAX / size) {
+        return 0;
+    }
+    unsigned char* p = (unsigned char*)ptr;
+    size_t total = size * count;
+    size_t done = 0;
+
+    if (begin_op(file) != 0) {
+        end_op(file);
+        return 0;
+    }
+    while (done < total) {
+        ssize_t n = read(file->fd, p + done, total - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break; // End of file or error
+        }
+        done += (size_t)n;
+    }
+    end_op(file);
+    return done / size;
+}
+
+int iot_fseek(struct iot_file* file, long offset)
+{
+    if (file == NULL || offset < 0) {
+        return -1;
+    }
+    int ret = begin_op(file);
+    if (ret == 0 && lseek(file->fd, (off_t)offset, SEEK_SET) < 0) {
+        ret = -1;
+    }
+    end_op(file);
+    return ret;
+}
+
+int iot_fclose(struct iot_file* file)
+{
+    if (file == NULL) {
+        return -1;
+    }
+    int ret = 0;
+    if (file->buffer != NULL) {
+        registry_remove(file);
+        ret = iot_fflush(file);
+        pthread_mutex_destroy(&file->lock);
+        free(file->buffer);
+    }
+    if (close(file->fd) != 0 && errno != EINTR) { // The descriptor is gone either way
+        ret = -1;
+    }
+    free(file);
+    return ret;
+}
+
+int iot_fflush(struct iot_file* file)
+{
+    if (file == NULL) {
+        return -1;
+    }
+    if (file->buffer == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&file->lock);
+    int ret = flush_locked(file);
+    if (file->failed) {
+        file->failed = false;
+        ret = -1;
+    }
+    pthread_mutex_unlock(&file->lock);
+    return ret;
+}
+
+int iot_fsync(struct iot_file* file)
+{
+    if (file == NULL) {
+        return -1;
+    }
+    int ret = iot_fflush(file);
+    if (fsync(file->fd) != 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+int iot_ftruncate(struct iot_file* file, size_t size)
+{
+    if (file == NULL || size > (size_t)INTPTR_MAX) {
+        return -1;
+    }
+    int ret = begin_op(file);
+    if (ret == 0) {
+        do {
+            ret = ftruncate(file->fd, (off_t)size);
+        } while (ret < 0 && errno == EINTR);
+    }
+    end_op(file);
+    return ret == 0 ? 0 : -1;
+}
+
+static int advise(void* addr, size_t length, enum iot_fmap_advice advice)
+{
+    int posix_advice;
+
+    switch (advice) {
+    case IOT_FMAP_SEQUENTIAL:
+        posix_advice = POSIX_MADV_SEQUENTIAL;
+        break;
+    case IOT_FMAP_RANDOM:
+        posix_advice = POSIX_MADV_RANDOM;
+        break;
+    case IOT_FMAP_WILLNEED:
+        posix_advice = POSIX_MADV_WILLNEED;
+        break;
+    default:
+        posix_advice = POSIX_MADV_NORMAL;
+        break;
+    }
+    return posix_madvise(addr, length, posix_advice) == 0 ? 0 : -1;
+}
+
+struct iot_fmap* iot_fmap(struct iot_file* file, size_t offset, size_t length, enum iot_fmap_advice advice)
+{
+    static const unsigned char empty[1] = { 0 };
+    struct stat st;
+
+    if (file == NULL || iot_fflush(file) != 0 || fstat(file->fd, &st) != 0) {
+        return NULL;
+    }
+    size_t file_size = (size_t)st.st_size;
+    if (offset > file_size || length > file_size - offset) {
+        return NULL; // Pages past the end of the file cannot be touched
+    }
+    if (length == 0) {
+        length = file_size - offset;
+    }
+
+    struct iot_fmap* map = (struct iot_fmap*)calloc(1, sizeof(struct iot_fmap));
+    if (map == NULL) {
+        return NULL;
+    }
+    map->size = length;
+    if (length == 0) {
+        map->data = empty;
+        return map;
+    }
+
+    // mmap offsets must be page aligned; map from the page holding offset
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t aligned = offset - offset % page;
+    map->mapped = length + (offset - aligned);
+    map->base = mmap(NULL, map->mapped, PROT_READ, MAP_SHARED, file->fd, (off_t)aligned);
+    if (map->base == MAP_FAILED) {
+        free(map);
+        return NULL;
+    }
+    map->data = (const unsigned char*)map->base + (offset - aligned);
+    if (advice != IOT_FMAP_NORMAL) {
+        advise(map->base, map->mapped, advice); // Only a hint
+    }
+    return map;
+}
+
+const void* iot_fmap_data(const struct iot_fmap* map)
+{
+    return map != NULL ? map->data : NULL;
+}
+
+size_t iot_fmap_size(const struct iot_fmap* map)
+{
+    return map != NULL ? map->size : 0;
+}
+
+int iot_fmap_advise(struct iot_fmap* map, size_t offset, size_t length, enum iot_fmap_advice advice)
+{
+    if (map == NULL || offset > map->size || length > map->size - offset) {
+        return -1;
+    }
+    if (length == 0) {
+        return 0;
+    }
+    size_t start = (size_t)(map->data - (const unsigned char*)map->base) + offset;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t aligned = start - start % page;
+    return advise((unsigned char*)map->base + aligned, length + (start - aligned), advice);
+}
+
+int iot_funmap(struct iot_fmap* map)
+{
+    if (map == NULL) {
+        return -1;
+    }
+    int ret = map->base != NULL ? munmap(map->base, map->mapped) : 0;
+    free(map);
+    return ret == 0 ? 0 : -1;
+}
+
+int iot_mkdir(const char* path)
+{
+    if (path == NULL) {
+        return -1;
+    }
+    return mkdir(path, 0755) == 0 ? 0 : -1;
+}
+
+int iot_remove(const char* path)
+{
+    if (path == NULL) {
+        return -1;
+    }
+    return remove(path) == 0 ? 0 : -1;
+}
+
+int iot_rename(const char* from, const char* to)
+{
+    if (from == NULL || to == NULL) {
+        return -1;
+    }
+    return rename(from, to) == 0 ? 0 : -1;
+}
+
+int iot_mkdirp(const char* path)
+{
+    if (path == NULL || path[0] == '\0') {
+        return -1;
+    }
+    size_t length = strlen(path);
+    char* copy = (char*)malloc(length + 1);
+    if (copy == NULL) {
+        return -1;
+    }
+    memcpy(copy, path, length + 1);
+
+    int ret = 0;
+    for (char* p = copy + 1; ret == 0; p++) {
+        if (*p != '/' && *p != '\0') {
+            continue;
+        }
+        char saved = *p;
+        *p = '\0';
+        if (mkdir(copy, 0755) != 0) {
+            struct stat st;
+            if (errno != EEXIST || stat(copy, &st) != 0 || !S_ISDIR(st.st_mode)) {
+                ret = -1;
+            }
+        }
+        *p = saved;
+        if (saved == '\0') {
+            break;
+        }
+    }
+    free(copy);
+    return ret;
+}
+
+struct iot_dir* iot_opendir(const char* path)
+{
+    if (path == NULL) {
+        return NULL;
+    }
+    struct iot_dir* dir = (struct iot_dir*)malloc(sizeof(struct iot_dir));
+    if (dir == NULL) {
+        return NULL;
+    }
+    dir->dir = opendir(path);
+    if (dir->dir == NULL) {
+        free(dir);
+        return NULL;
+    }
+    return dir;
+}
+
+struct iot_dirent* iot_readdir(struct iot_dir* dir)
+{
+    if (dir == NULL) {
+        return NULL;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir->dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        size_t length = strlen(entry->d_name);
+        if (length >= sizeof(dir->entry.name)) {
+            continue;
+        }
+        memcpy(dir->entry.name, entry->d_name, length + 1);
+
+        // Only some file systems report the type; ask for the rest
+#ifdef DT_UNKNOWN
+        if (entry->d_type != DT_UNKNOWN) {
+            dir->entry.is_file = entry->d_type == DT_REG;
+            return &dir->entry;
+        }
+#endif
+        struct stat st;
+        dir->entry.is_file = fstatat(dirfd(dir->dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISREG(st.st_mode);
+        return &dir->entry;
+    }
+    return NULL;
+}
+
+int iot_closedir(struct iot_dir* dir)
+{
+    if (dir == NULL) {
+        return -1;
+    }
+    int ret = closedir(dir->dir);
+    free(dir);
+    return ret == 0 ? 0 : -1;
+}
+
+const char* iot_dirent_name(const struct iot_dirent* entry)
+{
+    return entry != NULL ? entry->name : NULL;
+}
+
+bool iot_is_file(const struct iot_dirent* entry)
+{
+    return entry != NULL && entry->is_file;
+}
+
+int iot_stat(const char* path, struct iot_stat* st)
+{
+    struct stat s;
+
+    if (path == NULL || st == NULL || stat(path, &s) != 0) {
+        return -1;
+    }
+    st->st_size = (size_t)s.st_size;
+    return 0;
+}
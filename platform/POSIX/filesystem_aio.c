@@ -0,0 +1,637 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include "filesystem_internal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+#define AIO_HAVE_URING 1
+#endif
+#endif
+
+/*
+ * Every request lives in one of depth preallocated slots; its index is the
+ * io_uring user_data. A slot moves from the free list to the queued list
+ * (iot_aio_read and friends), to the backend (iot_aio_submit), and back to
+ * the free list just before its callback runs, so the callback can queue
+ * the next request into it. Completion is signalled on an eventfd, written
+ * by the kernel for io_uring and by the workers for the thread backend; a
+ * pipe stands in where there is no eventfd.
+ */
+
+enum aio_op {
+    AIO_READ,
+    AIO_WRITE,
+    AIO_FSYNC
+};
+
+struct aio_request {
+    enum aio_op op;
+    int fd;
+    struct iovec iov;
+    uint64_t offset;
+    iot_aio_callback callback;
+    void* user_data;
+    int64_t result;
+    struct aio_request* next;
+};
+
+#ifdef AIO_HAVE_URING
+struct aio_uring {
+    int fd;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+};
+#endif
+
+struct iot_aio {
+    enum iot_aio_backend backend;
+    uint32_t depth;
+    struct aio_request* requests;
+    struct aio_request* free_list;
+    struct aio_request* queued_head; // Not yet submitted, oldest first
+    struct aio_request* queued_tail;
+    uint32_t queued;
+    uint32_t pending; // Queued or submitted, callback not yet run
+    int notify_read; // Same descriptor as notify_write for an eventfd
+    int notify_write;
+
+#ifdef AIO_HAVE_URING
+    struct aio_uring ring;
+#endif
+
+    // Thread backend
+    pthread_t* workers;
+    uint32_t worker_count;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    struct aio_request* work_head;
+    struct aio_request* work_tail;
+    struct aio_request* done; // Finished, in no particular order
+    bool stop;
+};
+
+static int notify_open(struct iot_aio* aio)
+{
+#if defined(__linux__)
+    aio->notify_read = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    aio->notify_write = aio->notify_read;
+    return aio->notify_read >= 0 ? 0 : -1;
+#else
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    aio->notify_read = fds[0];
+    aio->notify_write = fds[1];
+    return 0;
+#endif
+}
+
+static void notify_close(struct iot_aio* aio)
+{
+    if (aio->notify_write != aio->notify_read) {
+        close(aio->notify_write);
+    }
+    close(aio->notify_read);
+}
+
+static void notify_signal(struct iot_aio* aio)
+{
+#if defined(__linux__)
+    uint64_t one = 1;
+    ssize_t n = write(aio->notify_write, &one, sizeof(one));
+#else
+    char one = 1;
+    ssize_t n = write(aio->notify_write, &one, sizeof(one)); // A full pipe is already signalled
+#endif
+    (void)n;
+}
+
+// Reset the descriptor before looking for completions, so none is missed
+static void notify_drain(struct iot_aio* aio)
+{
+    unsigned char buf[64];
+    while (read(aio->notify_read, buf, sizeof(buf)) > 0) {
+    }
+}
+
+static int64_t run_request(const struct aio_request* req)
+{
+    ssize_t n;
+    do {
+        switch (req->op) {
+        case AIO_READ:
+            n = pread(req->fd, req->iov.iov_base, req->iov.iov_len, (off_t)req->offset);
+            break;
+        case AIO_WRITE:
+            n = pwrite(req->fd, req->iov.iov_base, req->iov.iov_len, (off_t)req->offset);
+            break;
+        default:
+            n = fsync(req->fd);
+            break;
+        }
+    } while (n < 0 && errno == EINTR);
+    return n < 0 ? -(int64_t)errno : (int64_t)n;
+}
+
+// Return a finished slot to the free list and run its callback
+static void finish(struct iot_aio* aio, struct aio_request* req, int64_t result)
+{
+    iot_aio_callback callback = req->callback;
+    void* user_data = req->user_data;
+
+    req->next = aio->free_list;
+    aio->free_list = req;
+    aio->pending--;
+    if (callback != NULL) {
+        callback(user_data, result);
+    }
+}
+
+// Thread backend
+
+static void* worker_main(void* arg)
+{
+    struct iot_aio* aio = (struct iot_aio*)arg;
+
+    pthread_mutex_lock(&aio->lock);
+    for (;;) {
+        while (aio->work_head == NULL && !aio->stop) {
+            pthread_cond_wait(&aio->work_ready, &aio->lock);
+        }
+        struct aio_request* req = aio->work_head;
+        if (req == NULL) {
+            break; // Stopping, and the work list is drained
+        }
+        aio->work_head = req->next;
+        if (aio->work_head == NULL) {
+            aio->work_tail = NULL;
+        }
+        pthread_mutex_unlock(&aio->lock);
+
+        req->result = run_request(req);
+
+        pthread_mutex_lock(&aio->lock);
+        req->next = aio->done;
+        aio->done = req;
+        notify_signal(aio);
+    }
+    pthread_mutex_unlock(&aio->lock);
+    return NULL;
+}
+
+static int threads_start(struct iot_aio* aio, uint32_t count)
+{
+    if (pthread_mutex_init(&aio->lock, NULL) != 0) {
+        return -1;
+    }
+    if (pthread_cond_init(&aio->work_ready, NULL) != 0) {
+        pthread_mutex_destroy(&aio->lock);
+        return -1;
+    }
+    aio->workers = (pthread_t*)calloc(count, sizeof(pthread_t));
+    if (aio->workers == NULL) {
+        pthread_cond_destroy(&aio->work_ready);
+        pthread_mutex_destroy(&aio->lock);
+        return -1;
+    }
+    for (aio->worker_count = 0; aio->worker_count < count; aio->worker_count++) {
+        if (pthread_create(&aio->workers[aio->worker_count], NULL, worker_main, aio) != 0) {
+            break;
+        }
+    }
+    if (aio->worker_count == 0) {
+        free(aio->workers);
+        pthread_cond_destroy(&aio->work_ready);
+        pthread_mutex_destroy(&aio->lock);
+        return -1;
+    }
+    return 0;
+}
+
+static void threads_stop(struct iot_aio* aio)
+{
+    pthread_mutex_lock(&aio->lock);
+    aio->stop = true;
+    pthread_cond_broadcast(&aio->work_ready);
+    pthread_mutex_unlock(&aio->lock);
+    for (uint32_t i = 0; i < aio->worker_count; i++) {
+        pthread_join(aio->workers[i], NULL);
+    }
+    free(aio->workers);
+    pthread_cond_destroy(&aio->work_ready);
+    pthread_mutex_destroy(&aio->lock);
+}
+
+static int threads_submit(struct iot_aio* aio)
+{
+    pthread_mutex_lock(&aio->lock);
+    if (aio->work_tail != NULL) {
+        aio->work_tail->next = aio->queued_head;
+    } else {
+        aio->work_head = aio->queued_head;
+    }
+    aio->work_tail = aio->queued_tail;
+    pthread_cond_broadcast(&aio->work_ready);
+    pthread_mutex_unlock(&aio->lock);
+    return (int)aio->queued;
+}
+
+static int threads_reap(struct iot_aio* aio)
+{
+    pthread_mutex_lock(&aio->lock);
+    struct aio_request* done = aio->done;
+    aio->done = NULL;
+    pthread_mutex_unlock(&aio->lock);
+
+    int count = 0;
+    while (done != NULL) {
+        struct aio_request* next = done->next;
+        finish(aio, done, done->result);
+        done = next;
+        count++;
+    }
+    return count;
+}
+
+// io_uring backend, on the raw system calls
+
+#ifdef AIO_HAVE_URING
+static int uring_setup(unsigned entries, struct io_uring_params* params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int fd, unsigned opcode, const void* arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void uring_close(struct aio_uring* ring)
+{
+    if (ring->sqes != NULL) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring != NULL) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    close(ring->fd);
+}
+
+static int uring_open(struct iot_aio* aio)
+{
+    struct aio_uring* ring = &aio->ring;
+    struct io_uring_params params;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    ring->fd = uring_setup(aio->depth, &params);
+    if (ring->fd < 0) {
+        return -1; // ENOSYS on old kernels, EPERM where it is disabled
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = NULL;
+        uring_close(ring);
+        return -1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            ring->cq_ring = NULL;
+            uring_close(ring);
+            return -1;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        uring_close(ring);
+        return -1;
+    }
+
+    unsigned char* sq = (unsigned char*)ring->sq_ring;
+    unsigned char* cq = (unsigned char*)ring->cq_ring;
+    ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    // The kernel bumps the eventfd for every completion it posts
+    if (uring_register(ring->fd, IORING_REGISTER_EVENTFD, &aio->notify_write, 1) != 0) {
+        uring_close(ring);
+        return -1;
+    }
+    return 0;
+}
+
+static int uring_submit(struct iot_aio* aio)
+{
+    struct aio_uring* ring = &aio->ring;
+    unsigned tail = *ring->sq_tail;
+    unsigned mask = *ring->sq_mask;
+
+    // At most depth requests are pending, so the ring always has room
+    for (struct aio_request* req = aio->queued_head; req != NULL; req = req->next) {
+        unsigned index = tail & mask;
+        struct io_uring_sqe* sqe = &ring->sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->fd = req->fd;
+        sqe->user_data = (uint64_t)(req - aio->requests);
+        switch (req->op) {
+        case AIO_READ:
+            sqe->opcode = IORING_OP_READV;
+            break;
+        case AIO_WRITE:
+            sqe->opcode = IORING_OP_WRITEV;
+            break;
+        default:
+            sqe->opcode = IORING_OP_FSYNC;
+            break;
+        }
+        if (req->op != AIO_FSYNC) {
+            sqe->addr = (uint64_t)(uintptr_t)&req->iov;
+            sqe->len = 1;
+            sqe->off = req->offset;
+        }
+        ring->sq_array[index] = index;
+        tail++;
+    }
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+    // Entries the kernel has not consumed yet, including any left by an earlier failed enter
+    unsigned to_submit = tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    int ret;
+    do {
+        ret = uring_enter(ring->fd, to_submit, 0, 0);
+    } while (ret < 0 && errno == EINTR);
+    return ret < 0 && errno != EAGAIN && errno != EBUSY ? -1 : (int)aio->queued;
+}
+
+static int uring_reap(struct iot_aio* aio, bool run_callbacks)
+{
+    struct aio_uring* ring = &aio->ring;
+    unsigned head = *ring->cq_head;
+    int count = 0;
+
+    for (;;) {
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            break;
+        }
+        struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+        struct aio_request* req = &aio->requests[cqe->user_data];
+        int64_t result = cqe->res;
+        __atomic_store_n(ring->cq_head, ++head, __ATOMIC_RELEASE);
+        if (!run_callbacks) {
+            req->callback = NULL;
+        }
+        finish(aio, req, result);
+        count++;
+    }
+    return count;
+}
+#endif
+
+static int reap(struct iot_aio* aio)
+{
+    notify_drain(aio);
+#ifdef AIO_HAVE_URING
+    if (aio->backend == IOT_AIO_URING) {
+        return uring_reap(aio, true);
+    }
+#endif
+    return threads_reap(aio);
+}
+
+struct iot_aio* iot_aio_create(const struct iot_aio_config* config)
+{
+    enum iot_aio_backend backend = config != NULL ? config->backend : IOT_AIO_AUTO;
+    uint32_t depth = config != NULL && config->queue_depth != 0 ? config->queue_depth : IOT_AIO_DEFAULT_DEPTH;
+    uint32_t threads = config != NULL && config->threads != 0 ? config->threads : IOT_AIO_DEFAULT_THREADS;
+
+#ifndef AIO_HAVE_URING
+    if (backend == IOT_AIO_URING) {
+        return NULL;
+    }
+#endif
+    struct iot_aio* aio = (struct iot_aio*)calloc(1, sizeof(struct iot_aio));
+    if (aio == NULL) {
+        return NULL;
+    }
+    aio->depth = depth;
+    aio->requests = (struct aio_request*)calloc(depth, sizeof(struct aio_request));
+    if (aio->requests == NULL || notify_open(aio) != 0) {
+        free(aio->requests);
+        free(aio);
+        return NULL;
+    }
+    for (uint32_t i = depth; i > 0; i--) {
+        aio->requests[i - 1].next = aio->free_list;
+        aio->free_list = &aio->requests[i - 1];
+    }
+
+#ifdef AIO_HAVE_URING
+    if (backend != IOT_AIO_THREADS && uring_open(aio) == 0) {
+        aio->backend = IOT_AIO_URING;
+        return aio;
+    }
+    if (backend == IOT_AIO_URING) {
+        notify_close(aio);
+        free(aio->requests);
+        free(aio);
+        return NULL;
+    }
+#endif
+    if (threads_start(aio, threads) != 0) {
+        notify_close(aio);
+        free(aio->requests);
+        free(aio);
+        return NULL;
+    }
+    aio->backend = IOT_AIO_THREADS;
+    return aio;
+}
+
+void iot_aio_destroy(struct iot_aio* aio)
+{
+    if (aio == NULL) {
+        return;
+    }
+#ifdef AIO_HAVE_URING
+    if (aio->backend == IOT_AIO_URING) {
+        // The kernel may still write into caller buffers until each submitted request completes
+        while (aio->pending > aio->queued) {
+            if (uring_enter(aio->ring.fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+                break;
+            }
+            uring_reap(aio, false);
+        }
+        uring_close(&aio->ring);
+    }
+#endif
+    if (aio->backend == IOT_AIO_THREADS) {
+        threads_stop(aio); // Workers drain the submitted requests before they exit
+    }
+    notify_close(aio);
+    free(aio->requests);
+    free(aio);
+}
+
+enum iot_aio_backend iot_aio_get_backend(const struct iot_aio* aio)
+{
+    return aio != NULL ? aio->backend : IOT_AIO_AUTO;
+}
+
+static int enqueue(struct iot_aio* aio, enum aio_op op, struct iot_file* file, void* buf, size_t len, uint64_t offset,
+    iot_aio_callback callback, void* user_data)
+{
+    if (aio == NULL || file == NULL || (op != AIO_FSYNC && buf == NULL) || aio->free_list == NULL) {
+        return -1;
+    }
+    // Keep the request ordered after writes still sitting in a write-behind buffer
+    if (file->buffer != NULL && iot_fflush(file) != 0) {
+        return -1;
+    }
+
+    struct aio_request* req = aio->free_list;
+    aio->free_list = req->next;
+    req->op = op;
+    req->fd = file->fd;
+    req->iov.iov_base = buf;
+    req->iov.iov_len = len;
+    req->offset = offset;
+    req->callback = callback;
+    req->user_data = user_data;
+    req->result = 0;
+    req->next = NULL;
+    if (aio->queued_tail != NULL) {
+        aio->queued_tail->next = req;
+    } else {
+        aio->queued_head = req;
+    }
+    aio->queued_tail = req;
+    aio->queued++;
+    aio->pending++;
+    return 0;
+}
+
+int iot_aio_read(struct iot_aio* aio, struct iot_file* file, void* buf, size_t len, uint64_t offset,
+    iot_aio_callback callback, void* user_data)
+{
+    return enqueue(aio, AIO_READ, file, buf, len, offset, callback, user_data);
+}
+
+int iot_aio_write(struct iot_aio* aio, struct iot_file* file, const void* buf, size_t len, uint64_t offset,
+    iot_aio_callback callback, void* user_data)
+{
+    return enqueue(aio, AIO_WRITE, file, (void*)(uintptr_t)buf, len, offset, callback, user_data);
+}
+
+int iot_aio_fsync(struct iot_aio* aio, struct iot_file* file, iot_aio_callback callback, void* user_data)
+{
+    return enqueue(aio, AIO_FSYNC, file, NULL, 0, 0, callback, user_data);
+}
+
+int iot_aio_submit(struct iot_aio* aio)
+{
+    if (aio == NULL) {
+        return -1;
+    }
+    if (aio->queued == 0) {
+        return 0;
+    }
+    int ret;
+#ifdef AIO_HAVE_URING
+    if (aio->backend == IOT_AIO_URING) {
+        ret = uring_submit(aio);
+    } else
+#endif
+    {
+        ret = threads_submit(aio);
+    }
+    // io_uring keeps entries it could not take yet in the ring, so the queue is empty either way
+    aio->queued_head = NULL;
+    aio->queued_tail = NULL;
+    aio->queued = 0;
+    return ret;
+}
+
+int iot_aio_complete(struct iot_aio* aio, int timeout_ms)
+{
+    if (aio == NULL || iot_aio_submit(aio) < 0) {
+        return -1;
+    }
+    int count = reap(aio);
+    if (count == 0 && timeout_ms != 0 && aio->pending > 0) {
+        struct pollfd pfd = { aio->notify_read, POLLIN, 0 };
+        if (poll(&pfd, 1, timeout_ms) < 0 && errno != EINTR) {
+            return -1;
+        }
+        count = reap(aio);
+    }
+    return count;
+}
+
+int iot_aio_fd(const struct iot_aio* aio)
+{
+    return aio != NULL ? aio->notify_read : -1;
+}
+
+uint32_t iot_aio_pending(const struct iot_aio* aio)
+{
+    return aio != NULL ? aio->pending : 0;
+}
@@ -0,0 +1,24 @@
+#ifndef IOT_POSIX_FILESYSTEM_INTERNAL_H
+#define IOT_POSIX_FILESYSTEM_INTERNAL_H
+
+#include "interface/filesystem.h"
+#include <pthread.h>
+#include <stdint.h>
+
+// File handle handed out by iot_fopen and iot_fopen_buffered
+struct iot_file {
+    int fd;
+
+    // Write-behind state, used only when buffer is not NULL
+    pthread_mutex_t lock; // Guards the buffer against the flusher thread
+    unsigned char* buffer;
+    size_t capacity;
+    size_t used;
+    uint64_t dirty_since_ms; // When the oldest buffered byte was written
+    uint32_t interval_ms;
+    bool failed; // A background flush lost data; reported by the next iot_fflush
+    struct iot_file* next; // In the flusher's list
+    bool flushing; // Being written out by the flusher; guarded by registry_lock
+};
+
+#endif // IOT_POSIX_FILESYSTEM_INTERNAL_H
@@ -0,0 +1,504 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include "interface/filesystem.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#if defined(SYS_getdents64)
+#define SCAN_HAVE_GETDENTS64 1
+#endif
+#endif
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+/*
+ * A scan walks a stack of open directories, one frame per level. Entries
+ * are read straight from the kernel with getdents64 where it exists, into
+ * a per-frame buffer; elsewhere through readdir. Names are matched against
+ * the pattern before anything else, and fstatat is only called for
+ * entries that are reported (unless IOT_DIRSCAN_NO_STAT) or whose type the
+ * directory did not give. Children are opened with openat relative to the
+ * parent, so no path is resolved more than once.
+ */
+
+#define SCAN_BUFFER_SIZE (32 * 1024)
+#define SCAN_PATH_MAX 4096
+
+// Type of a directory entry before it is known
+#define SCAN_TYPE_UNKNOWN (-1)
+
+struct scan_frame {
+    int fd;
+    size_t path_length; // Of the directory's path in the scan path, with its trailing '/'; 0 for the root
+#ifdef SCAN_HAVE_GETDENTS64
+    unsigned char* buf;
+    size_t pos;
+    size_t end;
+#else
+    DIR* dir;
+#endif
+    // The directory's own entry, reported after its contents with IOT_DIRSCAN_DIRS_LAST
+    struct iot_dirscan_entry self;
+    bool self_matches;
+};
+
+// An entry produced by the walk; name and base point into the scan path
+struct scan_item {
+    struct iot_dirscan_entry entry;
+    int parent_fd; // Directory holding the entry
+    const char* base; // Name within parent_fd
+};
+
+struct iot_dirscan {
+    char* pattern;
+    enum iot_dirscan_sort sort;
+    uint32_t flags;
+    struct scan_frame* frames;
+    size_t depth;
+    size_t frames_capacity;
+    char path[SCAN_PATH_MAX];
+
+    struct scan_item pending; // Produced but not yet handed out
+    bool has_pending;
+
+    // Sorted scans: every entry, read on the first call
+    struct iot_dirscan_entry* sorted;
+    size_t sorted_count;
+    size_t sorted_next;
+    bool collected;
+};
+
+static void frame_close(struct scan_frame* frame)
+{
+#ifdef SCAN_HAVE_GETDENTS64
+    free(frame->buf);
+    close(frame->fd);
+#else
+    closedir(frame->dir);
+#endif
+}
+
+// Push a frame for the directory open at fd, which it takes over
+static int push_frame(struct iot_dirscan* scan, int fd, size_t path_length)
+{
+    if (scan->depth == scan->frames_capacity) {
+        size_t capacity = scan->frames_capacity == 0 ? 8 : scan->frames_capacity * 2;
+        struct scan_frame* frames = (struct scan_frame*)realloc(scan->frames, capacity * sizeof(struct scan_frame));
+        if (frames == NULL) {
+            close(fd);
+            return -1;
+        }
+        scan->frames = frames;
+        scan->frames_capacity = capacity;
+    }
+    struct scan_frame* frame = &scan->frames[scan->depth];
+    memset(frame, 0, sizeof(*frame));
+    frame->fd = fd;
+    frame->path_length = path_length;
+#ifdef SCAN_HAVE_GETDENTS64
+    frame->buf = (unsigned char*)malloc(SCAN_BUFFER_SIZE);
+    if (frame->buf == NULL) {
+        close(fd);
+        return -1;
+    }
+#else
+    frame->dir = fdopendir(fd);
+    if (frame->dir == NULL) {
+        close(fd);
+        return -1;
+    }
+#endif
+    scan->depth++;
+    return 0;
+}
+
+// Next raw entry of a frame: 1 with name and type set, 0 at the end, -1 on error
+static int frame_next(struct scan_frame* frame, const char** name, int* type)
+{
+#ifdef SCAN_HAVE_GETDENTS64
+    // struct linux_dirent64: u64 d_ino, s64 d_off, u16 d_reclen, u8 d_type, char d_name[]
+    if (frame->pos >= frame->end) {
+        long n = syscall(SYS_getdents64, frame->fd, frame->buf, SCAN_BUFFER_SIZE);
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            return 0;
+        }
+        frame->pos = 0;
+        frame->end = (size_t)n;
+    }
+    const unsigned char* record = frame->buf + frame->pos;
+    unsigned short reclen;
+    memcpy(&reclen, record + 16, sizeof(reclen));
+    frame->pos += reclen;
+    *name = (const char*)record + 19;
+    switch (record[18]) {
+    case DT_REG:
+        *type = IOT_DIRSCAN_FILE;
+        break;
+    case DT_DIR:
+        *type = IOT_DIRSCAN_DIR;
+        break;
+    case DT_LNK:
+        *type = IOT_DIRSCAN_SYMLINK;
+        break;
+    case DT_UNKNOWN:
+        *type = SCAN_TYPE_UNKNOWN;
+        break;
+    default:
+        *type = IOT_DIRSCAN_OTHER;
+        break;
+    }
+    return 1;
+#else
+    errno = 0;
+    struct dirent* entry = readdir(frame->dir);
+    if (entry == NULL) {
+        return errno == 0 ? 0 : -1;
+    }
+    *name = entry->d_name;
+    *type = SCAN_TYPE_UNKNOWN;
+    return 1;
+#endif
+}
+
+static enum iot_dirscan_type type_of(mode_t mode)
+{
+    if (S_ISREG(mode)) {
+        return IOT_DIRSCAN_FILE;
+    }
+    if (S_ISDIR(mode)) {
+        return IOT_DIRSCAN_DIR;
+    }
+    if (S_ISLNK(mode)) {
+        return IOT_DIRSCAN_SYMLINK;
+    }
+    return IOT_DIRSCAN_OTHER;
+}
+
+static void fill_stat(struct iot_dirscan_entry* entry, const struct stat* st)
+{
+    entry->type = type_of(st->st_mode);
+    entry->size = (uint64_t)st->st_size;
+    entry->mtime_ms = (int64_t)st->st_mtim.tv_sec * 1000 + st->st_mtim.tv_nsec / 1000000;
+}
+
+// Produce the next entry: 1 with item set, 0 when the walk is done, -1 on error
+static int walk_next(struct iot_dirscan* scan, struct scan_item* item)
+{
+    while (scan->depth > 0) {
+        struct scan_frame* frame = &scan->frames[scan->depth - 1];
+        const char* name;
+        int type;
+        int ret = frame_next(frame, &name, &type);
+        if (ret < 0) {
+            return -1;
+        }
+        if (ret == 0) {
+            struct scan_frame done = *frame;
+            frame_close(frame);
+            scan->depth--;
+            if (scan->depth > 0 && (scan->flags & IOT_DIRSCAN_DIRS_LAST) && done.self_matches) {
+                scan->path[done.path_length - 1] = '\0';
+                const char* slash = strrchr(scan->path, '/');
+                item->entry = done.self;
+                item->entry.name = scan->path;
+                item->parent_fd = scan->frames[scan->depth - 1].fd;
+                item->base = slash != NULL ? slash + 1 : scan->path;
+                return 1;
+            }
+            continue;
+        }
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+
+        bool matches = scan->pattern == NULL || fnmatch(scan->pattern, name, 0) == 0;
+        bool recursive = (scan->flags & IOT_DIRSCAN_RECURSIVE) != 0;
+        if (!matches && !(recursive && (type == IOT_DIRSCAN_DIR || type == SCAN_TYPE_UNKNOWN))) {
+            continue;
+        }
+        struct iot_dirscan_entry entry = { NULL, 0, 0, IOT_DIRSCAN_OTHER };
+        if (type == SCAN_TYPE_UNKNOWN || (matches && !(scan->flags & IOT_DIRSCAN_NO_STAT))) {
+            struct stat st;
+            if (fstatat(frame->fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                if (errno == ENOENT) {
+                    continue; // Removed since the directory was read
+                }
+                return -1;
+            }
+            fill_stat(&entry, &st);
+            if (scan->flags & IOT_DIRSCAN_NO_STAT) {
+                entry.size = 0;
+                entry.mtime_ms = 0;
+            }
+        } else {
+            entry.type = (enum iot_dirscan_type)type;
+        }
+        if (!matches && !(recursive && entry.type == IOT_DIRSCAN_DIR)) {
+            continue;
+        }
+
+        size_t name_length = strlen(name);
+        if (frame->path_length + name_length + 2 > sizeof(scan->path)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        if (frame->path_length > 0) {
+            scan->path[frame->path_length - 1] = '/';
+        }
+        memcpy(scan->path + frame->path_length, name, name_length + 1);
+        entry.name = scan->path;
+        item->entry = entry;
+        item->parent_fd = frame->fd;
+        item->base = scan->path + frame->path_length;
+
+        if (recursive && entry.type == IOT_DIRSCAN_DIR) {
+            int fd = openat(frame->fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (fd < 0) {
+                return -1;
+            }
+            size_t path_length = frame->path_length + name_length + 1;
+            if (push_frame(scan, fd, path_length) != 0) {
+                return -1;
+            }
+            struct scan_frame* child = &scan->frames[scan->depth - 1];
+            child->self = entry;
+            child->self_matches = matches;
+            // The pushed frame may have moved the stack
+            item->parent_fd = scan->frames[scan->depth - 2].fd;
+            if (scan->flags & IOT_DIRSCAN_DIRS_LAST) {
+                continue;
+            }
+        }
+        if (matches) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int compare_entries(const void* a, const void* b, enum iot_dirscan_sort sort)
+{
+    const struct iot_dirscan_entry* x = (const struct iot_dirscan_entry*)a;
+    const struct iot_dirscan_entry* y = (const struct iot_dirscan_entry*)b;
+    if (sort == IOT_DIRSCAN_BY_MTIME && x->mtime_ms != y->mtime_ms) {
+        return x->mtime_ms < y->mtime_ms ? -1 : 1;
+    }
+    if (sort == IOT_DIRSCAN_BY_SIZE && x->size != y->size) {
+        return x->size < y->size ? -1 : 1;
+    }
+    return strcmp(x->name, y->name);
+}
+
+static int compare_by_name(const void* a, const void* b)
+{
+    return compare_entries(a, b, IOT_DIRSCAN_BY_NAME);
+}
+
+static int compare_by_mtime(const void* a, const void* b)
+{
+    return compare_entries(a, b, IOT_DIRSCAN_BY_MTIME);
+}
+
+static int compare_by_size(const void* a, const void* b)
+{
+    return compare_entries(a, b, IOT_DIRSCAN_BY_SIZE);
+}
+
+// Read every entry of a sorted scan and sort them
+static int collect(struct iot_dirscan* scan)
+{
+    size_t capacity = 0;
+    struct scan_item item;
+    int ret;
+    while ((ret = walk_next(scan, &item)) == 1) {
+        if (scan->sorted_count == capacity) {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            struct iot_dirscan_entry* sorted = (struct iot_dirscan_entry*)realloc(scan->sorted, capacity * sizeof(struct iot_dirscan_entry));
+            if (sorted == NULL) {
+                return -1;
+            }
+            scan->sorted = sorted;
+        }
+        char* name = strdup(item.entry.name);
+        if (name == NULL) {
+            return -1;
+        }
+        scan->sorted[scan->sorted_count] = item.entry;
+        scan->sorted[scan->sorted_count++].name = name;
+    }
+    if (ret < 0) {
+        return -1;
+    }
+    int (*compare)(const void*, const void*) = compare_by_name;
+    if (scan->sort == IOT_DIRSCAN_BY_MTIME) {
+        compare = compare_by_mtime;
+    } else if (scan->sort == IOT_DIRSCAN_BY_SIZE) {
+        compare = compare_by_size;
+    }
+    if (scan->sorted_count > 1) {
+        qsort(scan->sorted, scan->sorted_count, sizeof(struct iot_dirscan_entry), compare);
+    }
+    scan->collected = true;
+    return 0;
+}
+
+static struct iot_dirscan* scan_open(const char* path, const struct iot_dirscan_options* options)
+{
+    if (path == NULL) {
+        return NULL;
+    }
+    struct iot_dirscan* scan = (struct iot_dirscan*)calloc(1, sizeof(struct iot_dirscan));
+    if (scan == NULL) {
+        return NULL;
+    }
+    if (options != NULL) {
+        scan->sort = options->sort;
+        scan->flags = options->flags;
+        if (options->pattern != NULL && (scan->pattern = strdup(options->pattern)) == NULL) {
+            iot_dirscan_close(scan);
+            return NULL;
+        }
+    }
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 || push_frame(scan, fd, 0) != 0) {
+        iot_dirscan_close(scan);
+        return NULL;
+    }
+    return scan;
+}
+
+struct iot_dirscan* iot_dirscan_open(const char* path, const struct iot_dirscan_options* options)
+{
+    return scan_open(path, options);
+}
+
+int iot_dirscan_read(struct iot_dirscan* scan, void* buf, size_t size, const struct iot_dirscan_entry** entries)
+{
+    if (scan == NULL || buf == NULL || entries == NULL || size < IOT_DIRSCAN_MIN_BUFFER) {
+        return -1;
+    }
+    if (scan->sort != IOT_DIRSCAN_UNSORTED && !scan->collected && collect(scan) != 0) {
+        return -1;
+    }
+
+    // Entries grow up from the aligned start, names down from the end
+    uintptr_t start = ((uintptr_t)buf + alignof(struct iot_dirscan_entry) - 1) & ~(uintptr_t)(alignof(struct iot_dirscan_entry) - 1);
+    struct iot_dirscan_entry* out = (struct iot_dirscan_entry*)start;
+    char* names = (char*)buf + size;
+    *entries = out;
+    int count = 0;
+    for (;;) {
+        const struct iot_dirscan_entry* entry;
+        if (scan->sort != IOT_DIRSCAN_UNSORTED) {
+            if (scan->sorted_next == scan->sorted_count) {
+                break;
+            }
+            entry = &scan->sorted[scan->sorted_next];
+        } else {
+            if (!scan->has_pending) {
+                int ret = walk_next(scan, &scan->pending);
+                if (ret < 0) {
+                    return count > 0 ? count : -1;
+                }
+                if (ret == 0) {
+                    break;
+                }
+                scan->has_pending = true;
+            }
+            entry = &scan->pending.entry;
+        }
+
+        size_t name_size = strlen(entry->name) + 1;
+        if ((uintptr_t)(out + count + 1) + name_size > (uintptr_t)names) {
+            if (count == 0) {
+                return -1;
+            }
+            break;
+        }
+        names -= name_size;
+        memcpy(names, entry->name, name_size);
+        out[count] = *entry;
+        out[count].name = names;
+        count++;
+        if (scan->sort != IOT_DIRSCAN_UNSORTED) {
+            scan->sorted_next++;
+        } else {
+            scan->has_pending = false;
+        }
+    }
+    return count;
+}
+
+int iot_dirscan_close(struct iot_dirscan* scan)
+{
+    if (scan == NULL) {
+        return -1;
+    }
+    while (scan->depth > 0) {
+        frame_close(&scan->frames[--scan->depth]);
+    }
+    for (size_t i = 0; i < scan->sorted_count; i++) {
+        free((char*)scan->sorted[i].name);
+    }
+    free(scan->sorted);
+    free(scan->frames);
+    free(scan->pattern);
+    free(scan);
+    return 0;
+}
+
+// Removes the tree with the same walk, contents before their directory.
+// Types come from the directory where the file system reports them, so
+// most entries cost one unlinkat and nothing else. Symlinks are removed,
+// never followed.
+int iot_rmdir_recursive(const char* path)
+{
+    if (path == NULL) {
+        return -1;
+    }
+    struct stat st;
+    if (lstat(path, &st) != 0) {
+        return -1;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        return unlink(path) == 0 ? 0 : -1;
+    }
+
+    struct iot_dirscan_options options = { NULL, IOT_DIRSCAN_UNSORTED, IOT_DIRSCAN_RECURSIVE | IOT_DIRSCAN_DIRS_LAST | IOT_DIRSCAN_NO_STAT };
+    struct iot_dirscan* scan = scan_open(path, &options);
+    if (scan == NULL) {
+        return -1;
+    }
+    int ret = 0;
+    struct scan_item item;
+    int step;
+    while ((step = walk_next(scan, &item)) == 1) {
+        if (unlinkat(item.parent_fd, item.base, item.entry.type == IOT_DIRSCAN_DIR ? AT_REMOVEDIR : 0) != 0) {
+            ret = -1;
+        }
+    }
+    if (step < 0) {
+        ret = -1;
+    }
+    iot_dirscan_close(scan);
+    if (ret == 0 && rmdir(path) != 0) {
+        ret = -1;
+    }
+    return ret;
+}
@@ -0,0 +1,518 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include "interface/loopback.h"
+#include "transport_internal.h"
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LOOPBACK_HOST_SIZE 256
+#define LOOPBACK_PORT_SIZE 32
+#define LOOPBACK_BACKLOG 16
+#define LOOPBACK_DEFAULT_MSS 1460
+#define LOOPBACK_DEFAULT_WINDOW (256 * 1024)
+#define LOOPBACK_MIN_RTO_US 200000
+
+/*
+ * Each connection has two pipes, one per direction. A send cuts its bytes
+ * into segments and stamps each with the time it arrives at the other end:
+ * the link serializes segments at the configured bandwidth, the segment
+ * then spends half an RTT plus jitter in flight, and a lost segment waits
+ * one retransmit timeout more. Arrival times never decrease, so a late
+ * segment holds back the ones behind it, as in TCP. recv only returns
+ * segments whose arrival time has passed.
+ */
+
+// A segment in flight, or arrived and partly read
+struct loopback_segment {
+    struct loopback_segment* next;
+    uint64_t arrival_us;
+    size_t length;
+    size_t offset; // Bytes already read
+    unsigned char data[];
+};
+
+// One direction of a connection
+struct loopback_pipe {
+    struct loopback_segment* head;
+    struct loopback_segment* tail;
+    size_t unread; // Bytes queued and not read yet
+    uint64_t link_free_us; // When the link has serialized everything sent so far
+    uint64_t last_arrival_us;
+    uint64_t send_rng; // Draws of the writer: write size, jitter, loss
+    uint64_t recv_rng; // Draws of the reader: read size
+    bool writer_closed;
+    bool reader_closed;
+};
+
+struct loopback_conn {
+    pthread_mutex_t lock;
+    pthread_cond_t changed; // Data queued or read, or an end closed
+    struct iot_link_profile profile;
+    struct loopback_pipe pipes[2]; // [0]: client to server, [1]: server to client
+    int ends; // Ends not closed yet
+};
+
+struct loopback_end {
+    struct loopback_conn* conn;
+    int side; // Sends on pipes[side] and receives on pipes[1 - side]
+    uint32_t send_timeout_ms;
+    uint32_t recv_timeout_ms;
+};
+
+struct iot_loopback_listener {
+    struct iot_loopback_listener* next;
+    char host[LOOPBACK_HOST_SIZE];
+    char port[LOOPBACK_PORT_SIZE];
+    struct iot_link_profile profile;
+    uint64_t connections; // Connections made, to vary the seed of each
+    pthread_mutex_t lock;
+    pthread_cond_t arrived;
+    struct loopback_end* pending[LOOPBACK_BACKLOG];
+    int pending_count;
+};
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct iot_loopback_listener* registry;
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static void sleep_us(uint64_t us)
+{
+    struct timespec ts = { (time_t)(us / 1000000u), (long)(us % 1000000u) * 1000 };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+static int cond_init(pthread_cond_t* cond)
+{
+    pthread_condattr_t attr;
+    if (pthread_condattr_init(&attr) != 0) {
+        return -1;
+    }
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    int ret = pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+    return ret == 0 ? 0 : -1;
+}
+
+// Wait on cond until signalled or until deadline_us (UINT64_MAX: no deadline)
+static void cond_wait_until(pthread_cond_t* cond, pthread_mutex_t* lock, uint64_t deadline_us)
+{
+    if (deadline_us == UINT64_MAX) {
+        pthread_cond_wait(cond, lock);
+        return;
+    }
+    struct timespec ts = { (time_t)(deadline_us / 1000000u), (long)(deadline_us % 1000000u) * 1000 };
+    pthread_cond_timedwait(cond, lock, &ts);
+}
+
+static uint64_t deadline_after(uint32_t timeout_ms)
+{
+    return timeout_ms != 0 ? now_us() + (uint64_t)timeout_ms * 1000u : UINT64_MAX;
+}
+
+// xorshift64*, never seeded with zero
+static uint64_t next_random(uint64_t* state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static uint64_t seed_state(uint64_t seed)
+{
+    uint64_t state = seed ^ 0x9E3779B97F4A7C15ULL;
+    return state != 0 ? state : 1;
+}
+
+// Cap len at a random size in [1, max], or leave it when max is 0
+static size_t random_limit(uint64_t* state, uint32_t max, size_t len)
+{
+    if (max == 0 || len == 0) {
+        return len;
+    }
+    size_t limit = 1 + (size_t)(next_random(state) % max);
+    return limit < len ? limit : len;
+}
+
+static struct iot_loopback_listener* find_listener(const char* host, const char* port)
+{
+    for (struct iot_loopback_listener* l = registry; l != NULL; l = l->next) {
+        if (strcmp(l->host, host) == 0 && strcmp(l->port, port) == 0) {
+            return l;
+        }
+    }
+    return NULL;
+}
+
+static struct loopback_end* end_create(struct loopback_conn* conn, int side, const struct iot_transport_config* config)
+{
+    struct loopback_end* end = (struct loopback_end*)malloc(sizeof(struct loopback_end));
+    if (end != NULL) {
+        end->conn = conn;
+        end->side = side;
+        end->send_timeout_ms = config->send_timeout_ms;
+        end->recv_timeout_ms = config->recv_timeout_ms;
+    }
+    return end;
+}
+
+static struct loopback_conn* conn_create(const struct iot_link_profile* profile, uint64_t connection)
+{
+    struct loopback_conn* conn = (struct loopback_conn*)calloc(1, sizeof(struct loopback_conn));
+    if (conn == NULL) {
+        return NULL;
+    }
+    if (pthread_mutex_init(&conn->lock, NULL) != 0) {
+        free(conn);
+        return NULL;
+    }
+    if (cond_init(&conn->changed) != 0) {
+        pthread_mutex_destroy(&conn->lock);
+        free(conn);
+        return NULL;
+    }
+    conn->profile = *profile;
+    if (conn->profile.mss == 0) {
+        conn->profile.mss = LOOPBACK_DEFAULT_MSS;
+    }
+    if (conn->profile.window == 0) {
+        conn->profile.window = LOOPBACK_DEFAULT_WINDOW;
+    }
+    if (conn->profile.rto_us == 0) {
+        uint64_t rto = 2 * (uint64_t)conn->profile.rtt_us;
+        conn->profile.rto_us = rto > LOOPBACK_MIN_RTO_US ? (uint32_t)(rto > UINT32_MAX ? UINT32_MAX : rto) : LOOPBACK_MIN_RTO_US;
+    }
+    for (int i = 0; i < 2; i++) {
+        uint64_t seed = profile->seed + connection * 4 + (uint64_t)i * 2;
+        conn->pipes[i].send_rng = seed_state(seed);
+        conn->pipes[i].recv_rng = seed_state(seed + 1);
+    }
+    conn->ends = 2;
+    return conn;
+}
+
+static void conn_destroy(struct loopback_conn* conn)
+{
+    for (int i = 0; i < 2; i++) {
+        struct loopback_segment* seg = conn->pipes[i].head;
+        while (seg != NULL) {
+            struct loopback_segment* next = seg->next;
+            free(seg);
+            seg = next;
+        }
+    }
+    pthread_cond_destroy(&conn->changed);
+    pthread_mutex_destroy(&conn->lock);
+    free(conn);
+}
+
+int loopback_connect(const char* host, const char* port, const struct iot_transport_config* config, struct loopback_end** end)
+{
+    *end = NULL;
+    pthread_mutex_lock(&registry_lock);
+    struct iot_loopback_listener* listener = find_listener(host, port);
+    if (listener == NULL) {
+        pthread_mutex_unlock(&registry_lock);
+        return 0;
+    }
+
+    pthread_mutex_lock(&listener->lock);
+    struct iot_transport_config server_config;
+    iot_transport_config_default(&server_config);
+    struct loopback_conn* conn = listener->pending_count < LOOPBACK_BACKLOG ? conn_create(&listener->profile, listener->connections) : NULL;
+    struct loopback_end* client = conn != NULL ? end_create(conn, 0, config) : NULL;
+    struct loopback_end* server = client != NULL ? end_create(conn, 1, &server_config) : NULL;
+    uint32_t rtt_us = listener->profile.rtt_us;
+    if (server != NULL) {
+        listener->connections++;
+        listener->pending[listener->pending_count++] = server;
+        pthread_cond_signal(&listener->arrived);
+    }
+    pthread_mutex_unlock(&listener->lock);
+    pthread_mutex_unlock(&registry_lock);
+
+    if (server == NULL) {
+        free(client);
+        if (conn != NULL) {
+            conn_destroy(conn);
+        }
+        return -1; // Backlog full or out of memory: refused
+    }
+
+    sleep_us(rtt_us); // SYN and SYN-ACK
+    *end = client;
+    return 1;
+}
+
+int loopback_sendv(struct loopback_end* end, const struct iot_transport_iovec* iov, size_t count, size_t total)
+{
+    struct loopback_conn* conn = end->conn;
+    const struct iot_link_profile* profile = &conn->profile;
+    struct loopback_pipe* pipe = &conn->pipes[end->side];
+    uint64_t deadline = deadline_after(end->send_timeout_ms);
+
+    if (total == 0) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&conn->lock);
+    size_t limit = random_limit(&pipe->send_rng, profile->max_write, total);
+    while (pipe->unread >= profile->window && !pipe->reader_closed) {
+        if (now_us() >= deadline) {
+            pthread_mutex_unlock(&conn->lock);
+            return IOT_TRANSPORT_TIMEOUT;
+        }
+        cond_wait_until(&conn->changed, &conn->lock, deadline);
+    }
+    if (pipe->reader_closed) {
+        pthread_mutex_unlock(&conn->lock);
+        return -1; // Peer closed: the write would be reset
+    }
+
+    size_t room = profile->window - pipe->unread;
+    size_t amount = limit < room ? limit : room;
+    size_t index = 0;
+    size_t offset = 0; // Bytes of iov[index] already taken
+    size_t queued = 0;
+    while (queued < amount) {
+        size_t length = amount - queued < profile->mss ? amount - queued : profile->mss;
+        struct loopback_segment* seg = (struct loopback_segment*)malloc(sizeof(struct loopback_segment) + length);
+        if (seg == NULL) {
+            break;
+        }
+        for (size_t copied = 0; copied < length;) {
+            size_t chunk = iov[index].length - offset;
+            if (chunk > length - copied) {
+                chunk = length - copied;
+            }
+            memcpy(seg->data + copied, (const unsigned char*)iov[index].base + offset, chunk);
+            copied += chunk;
+            offset += chunk;
+            if (offset == iov[index].length) {
+                index++;
+                offset = 0;
+            }
+        }
+
+        uint64_t now = now_us();
+        uint64_t start = pipe->link_free_us > now ? pipe->link_free_us : now;
+        uint64_t serialize = profile->bandwidth_bps != 0 ? (uint64_t)length * 8u * 1000000u / profile->bandwidth_bps : 0;
+        pipe->link_free_us = start + serialize;
+        uint64_t arrival = pipe->link_free_us + profile->rtt_us / 2;
+        if (profile->jitter_us != 0) {
+            arrival += next_random(&pipe->send_rng) % ((uint64_t)profile->jitter_us + 1);
+        }
+        if (profile->loss_ppm != 0 && next_random(&pipe->send_rng) % 1000000u < profile->loss_ppm) {
+            arrival += profile->rto_us;
+        }
+        if (arrival < pipe->last_arrival_us) {
+            arrival = pipe->last_arrival_us; // In-order delivery
+        }
+        pipe->last_arrival_us = arrival;
+
+        seg->next = NULL;
+        seg->arrival_us = arrival;
+        seg->length = length;
+        seg->offset = 0;
+        if (pipe->tail != NULL) {
+            pipe->tail->next = seg;
+        } else {
+            pipe->head = seg;
+        }
+        pipe->tail = seg;
+        pipe->unread += length;
+        queued += length;
+    }
+    pthread_cond_broadcast(&conn->changed);
+    pthread_mutex_unlock(&conn->lock);
+    return queued > 0 ? (int)queued : -1;
+}
+
+int loopback_recv(struct loopback_end* end, unsigned char* buf, size_t len)
+{
+    struct loopback_conn* conn = end->conn;
+    struct loopback_pipe* pipe = &conn->pipes[1 - end->side];
+    uint64_t deadline = deadline_after(end->recv_timeout_ms);
+
+    if (len == 0) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&conn->lock);
+    uint64_t now = now_us();
+    while (pipe->head == NULL || pipe->head->arrival_us > now) {
+        if (pipe->head == NULL && pipe->writer_closed) {
+            pthread_mutex_unlock(&conn->lock);
+            return 0; // Orderly shutdown by the peer
+        }
+        if (now >= deadline) {
+            pthread_mutex_unlock(&conn->lock);
+            return IOT_TRANSPORT_TIMEOUT;
+        }
+        uint64_t wake = pipe->head != NULL && pipe->head->arrival_us < deadline ? pipe->head->arrival_us : deadline;
+        cond_wait_until(&conn->changed, &conn->lock, wake);
+        now = now_us();
+    }
+
+    size_t limit = random_limit(&pipe->recv_rng, conn->profile.max_read, len);
+    size_t copied = 0;
+    while (copied < limit && pipe->head != NULL && pipe->head->arrival_us <= now) {
+        struct loopback_segment* seg = pipe->head;
+        size_t chunk = seg->length - seg->offset;
+        if (chunk > limit - copied) {
+            chunk = limit - copied;
+        }
+        memcpy(buf + copied, seg->data + seg->offset, chunk);
+        copied += chunk;
+        seg->offset += chunk;
+        if (seg->offset == seg->length) {
+            pipe->head = seg->next;
+            if (pipe->head == NULL) {
+                pipe->tail = NULL;
+            }
+            free(seg);
+        }
+    }
+    pipe->unread -= copied;
+    pthread_cond_broadcast(&conn->changed);
+    pthread_mutex_unlock(&conn->lock);
+    return (int)copied;
+}
+
+void loopback_close(struct loopback_end* end)
+{
+    struct loopback_conn* conn = end->conn;
+
+    pthread_mutex_lock(&conn->lock);
+    conn->pipes[end->side].writer_closed = true;
+    conn->pipes[1 - end->side].reader_closed = true;
+    bool last = --conn->ends == 0;
+    pthread_cond_broadcast(&conn->changed);
+    pthread_mutex_unlock(&conn->lock);
+
+    if (last) {
+        conn_destroy(conn);
+    }
+    free(end);
+}
+
+struct iot_loopback_listener* iot_loopback_listen(const char* host, const char* port, const struct iot_link_profile* profile)
+{
+    if (host == NULL || port == NULL || strlen(host) >= LOOPBACK_HOST_SIZE || strlen(port) >= LOOPBACK_PORT_SIZE) {
+        return NULL;
+    }
+
+    struct iot_loopback_listener* listener = (struct iot_loopback_listener*)calloc(1, sizeof(struct iot_loopback_listener));
+    if (listener == NULL) {
+        return NULL;
+    }
+    if (pthread_mutex_init(&listener->lock, NULL) != 0) {
+        free(listener);
+        return NULL;
+    }
+    if (cond_init(&listener->arrived) != 0) {
+        pthread_mutex_destroy(&listener->lock);
+        free(listener);
+        return NULL;
+    }
+    strcpy(listener->host, host);
+    strcpy(listener->port, port);
+    if (profile != NULL) {
+        listener->profile = *profile;
+    }
+
+    pthread_mutex_lock(&registry_lock);
+    if (find_listener(host, port) != NULL) {
+        pthread_mutex_unlock(&registry_lock);
+        pthread_cond_destroy(&listener->arrived);
+        pthread_mutex_destroy(&listener->lock);
+        free(listener);
+        return NULL; // Address in use
+    }
+    listener->next = registry;
+    registry = listener;
+    pthread_mutex_unlock(&registry_lock);
+    return listener;
+}
+
+int iot_loopback_accept(struct iot_loopback_listener* listener, void** ctx, uint32_t timeout_ms)
+{
+    return iot_loopback_accept_with(listener, ctx, timeout_ms, NULL);
+}
+
+int iot_loopback_accept_with(struct iot_loopback_listener* listener, void** ctx, uint32_t timeout_ms, const struct iot_transport_config* config)
+{
+    if (listener == NULL || ctx == NULL) {
+        return -1;
+    }
+    *ctx = NULL;
+
+    struct iot_transport_socket* sock = (struct iot_transport_socket*)calloc(1, sizeof(struct iot_transport_socket));
+    if (sock == NULL) {
+        return -1;
+    }
+
+    uint64_t deadline = deadline_after(timeout_ms);
+    pthread_mutex_lock(&listener->lock);
+    while (listener->pending_count == 0) {
+        if (now_us() >= deadline) {
+            pthread_mutex_unlock(&listener->lock);
+            free(sock);
+            return IOT_TRANSPORT_TIMEOUT;
+        }
+        cond_wait_until(&listener->arrived, &listener->lock, deadline);
+    }
+    struct loopback_end* end = listener->pending[0];
+    listener->pending_count--;
+    memmove(listener->pending, listener->pending + 1, (size_t)listener->pending_count * sizeof(listener->pending[0]));
+    pthread_mutex_unlock(&listener->lock);
+
+    // The client only touches its own end, so the timeouts can change unlocked
+    if (config != NULL) {
+        end->send_timeout_ms = config->send_timeout_ms;
+        end->recv_timeout_ms = config->recv_timeout_ms;
+    }
+    sock->fd = -1;
+    sock->loopback = end;
+    *ctx = sock;
+    return 0;
+}
+
+void iot_loopback_destroy(struct iot_loopback_listener* listener)
+{
+    if (listener == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&registry_lock);
+    for (struct iot_loopback_listener** link = &registry; *link != NULL; link = &(*link)->next) {
+        if (*link == listener) {
+            *link = listener->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    // No connect can reach the listener any more
+    for (int i = 0; i < listener->pending_count; i++) {
+        loopback_close(listener->pending[i]);
+    }
+    pthread_cond_destroy(&listener->arrived);
+    pthread_mutex_destroy(&listener->lock);
+    free(listener);
+}
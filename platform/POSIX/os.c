@@ -0,0 +1,328 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "os_internal.h"
+#include "system/pool.h"
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * POSIX has no way to suspend another thread, so iot_thread_suspend sends
+ * it a signal whose handler parks in sigsuspend until iot_thread_resume
+ * clears the flag and sends the signal again. The suspender waits for the
+ * handler to acknowledge, so the thread is stopped when suspend returns.
+ * Only threads from iot_thread_create can be suspended.
+ */
+#ifdef SIGRTMIN
+#define SUSPEND_SIGNAL (SIGRTMIN + 4)
+#else
+#define SUSPEND_SIGNAL SIGUSR2
+#endif
+
+_Thread_local struct iot_thread* iot_current_thread;
+static pthread_once_t suspend_once = PTHREAD_ONCE_INIT;
+static int suspend_installed;
+
+static void flush_pool(void* arg)
+{
+    (void)arg;
+    iot_pool_thread_flush();
+}
+
+static void* thread_main(void* arg)
+{
+    struct iot_thread* thread = (struct iot_thread*)arg;
+    iot_current_thread = thread;
+    if (thread->name[0] != '\0') {
+        os_thread_set_name(thread->name);
+    }
+    // Hands the pool cache back also when the thread is cancelled or deletes itself
+    pthread_cleanup_push(flush_pool, NULL);
+    thread->func(thread->arg);
+    pthread_cleanup_pop(1);
+    return NULL;
+}
+
+static void free_thread(struct iot_thread* thread)
+{
+    os_events_destroy(thread);
+    pthread_mutex_destroy(&thread->suspend_lock);
+    sem_destroy(&thread->ack);
+    free(thread);
+}
+
+// The real-time level priority steps above the lowest, capped at the highest
+static int realtime_priority(int policy, uint32_t priority)
+{
+    int low = sched_get_priority_min(policy);
+    int high = sched_get_priority_max(policy);
+    return priority > (uint32_t)(high - low) ? high : low + (int)priority;
+}
+
+// Maps priority onto the thread's real-time range; time-shared threads keep the value only
+static int apply_priority(pthread_t handle, uint32_t priority)
+{
+    int policy;
+    struct sched_param param;
+    if (pthread_getschedparam(handle, &policy, &param) != 0) {
+        return -1;
+    }
+    if (policy != SCHED_FIFO && policy != SCHED_RR) {
+        return 0;
+    }
+    return pthread_setschedprio(handle, realtime_priority(policy, priority)) == 0 ? 0 : -1;
+}
+
+static void suspend_handler(int sig)
+{
+    struct iot_thread* self = iot_current_thread;
+    // A resume, or a suspend already cancelled by one
+    if (self == NULL || !atomic_load(&self->suspended)) {
+        return;
+    }
+    int saved_errno = errno;
+    sigset_t wait_mask;
+    sigfillset(&wait_mask);
+    sigdelset(&wait_mask, sig);
+    if (atomic_exchange(&self->ack_wanted, 0)) {
+        sem_post(&self->ack);
+    }
+    while (atomic_load(&self->suspended)) {
+        sigsuspend(&wait_mask);
+    }
+    errno = saved_errno;
+}
+
+static void install_suspend_handler(void)
+{
+    struct sigaction action;
+    action.sa_handler = suspend_handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    suspend_installed = sigaction(SUSPEND_SIGNAL, &action, NULL) == 0;
+}
+
+void iot_thread_attr_init(struct iot_thread_attr* attr)
+{
+    memset(attr, 0, sizeof(*attr));
+    attr->sched = IOT_THREAD_SCHED_DEFAULT;
+}
+
+// Applies the scheduling, stack and CPU attributes to the pthread attributes
+static int set_attributes(pthread_attr_t* pattr, const struct iot_thread_attr* attr)
+{
+    if (attr->sched != IOT_THREAD_SCHED_DEFAULT) {
+        int policy = attr->sched == IOT_THREAD_SCHED_FIFO ? SCHED_FIFO : SCHED_RR;
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = realtime_priority(policy, attr->priority);
+        if (pthread_attr_setinheritsched(pattr, PTHREAD_EXPLICIT_SCHED) != 0
+            || pthread_attr_setschedpolicy(pattr, policy) != 0
+            || pthread_attr_setschedparam(pattr, &param) != 0) {
+            return -1;
+        }
+    }
+    if (attr->stack != NULL) {
+        if (attr->stack_size < PTHREAD_STACK_MIN || pthread_attr_setstack(pattr, attr->stack, attr->stack_size) != 0) {
+            return -1;
+        }
+    } else if (attr->stack_size != 0) {
+        // Smaller requests are raised to the minimum
+        size_t size = attr->stack_size < PTHREAD_STACK_MIN ? PTHREAD_STACK_MIN : attr->stack_size;
+        pthread_attr_setstacksize(pattr, size);
+    }
+    if (attr->cpu_mask != 0 && os_attr_set_affinity(pattr, attr->cpu_mask) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+struct iot_thread* iot_thread_create_ex(iot_thread_func_t func, void* arg, const struct iot_thread_attr* attr)
+{
+    struct iot_thread_attr defaults;
+    if (attr == NULL) {
+        iot_thread_attr_init(&defaults);
+        attr = &defaults;
+    }
+    if (func == NULL || (unsigned)attr->sched > IOT_THREAD_SCHED_RR) {
+        return NULL;
+    }
+    // Aligned so the mailbox tail and the sleep word get cache lines of their own
+    size_t handle_size = (sizeof(struct iot_thread) + 63) / 64 * 64;
+    struct iot_thread* thread = (struct iot_thread*)aligned_alloc(64, handle_size);
+    if (thread == NULL) {
+        return NULL;
+    }
+    memset(thread, 0, handle_size);
+    thread->func = func;
+    thread->arg = arg;
+    thread->priority = attr->priority;
+    if (attr->name != NULL) {
+        // The kernel keeps 15 characters
+        strncpy(thread->name, attr->name, sizeof(thread->name) - 1);
+    }
+    if (pthread_mutex_init(&thread->suspend_lock, NULL) != 0) {
+        free(thread);
+        return NULL;
+    }
+    if (sem_init(&thread->ack, 0, 0) != 0) {
+        pthread_mutex_destroy(&thread->suspend_lock);
+        free(thread);
+        return NULL;
+    }
+    if (os_events_init(thread, attr->event_count) != 0) {
+        pthread_mutex_destroy(&thread->suspend_lock);
+        sem_destroy(&thread->ack);
+        free(thread);
+        return NULL;
+    }
+
+    pthread_attr_t pattr;
+    if (pthread_attr_init(&pattr) != 0) {
+        free_thread(thread);
+        return NULL;
+    }
+    int ret = set_attributes(&pattr, attr);
+    if (ret == 0) {
+        ret = pthread_create(&thread->thread, &pattr, thread_main, thread);
+    }
+    pthread_attr_destroy(&pattr);
+    if (ret != 0) {
+        free_thread(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+struct iot_thread* iot_thread_create(const char* name, iot_thread_func_t func, void* arg,
+    uint32_t priority, uint32_t stack_size, uint32_t event_count)
+{
+    struct iot_thread_attr attr;
+    iot_thread_attr_init(&attr);
+    attr.name = name;
+    attr.priority = priority;
+    attr.stack_size = stack_size;
+    attr.event_count = event_count;
+    return iot_thread_create_ex(func, arg, &attr);
+}
+
+// Cancels the thread at its next cancellation point and frees the handle
+int iot_thread_delete(struct iot_thread* thread)
+{
+    if (thread == NULL) {
+        return -1;
+    }
+    if (pthread_equal(thread->thread, pthread_self())) {
+        pthread_detach(thread->thread);
+        free_thread(thread);
+        iot_current_thread = NULL;
+        iot_pool_thread_flush();
+        pthread_exit(NULL);
+    }
+    // A parked thread blocks cancellation, so let it run to the cancellation point
+    iot_thread_resume(thread);
+    int ret = pthread_cancel(thread->thread);
+    if (ret != 0 && ret != ESRCH) {
+        return -1;
+    }
+    // Event waits sleep outside any cancellation point until woken
+    os_events_wake(thread);
+    pthread_join(thread->thread, NULL);
+    free_thread(thread);
+    return 0;
+}
+
+int iot_thread_set_priority(struct iot_thread* thread, uint32_t priority)
+{
+    if (thread == NULL) {
+        return -1;
+    }
+    if (apply_priority(thread->thread, priority) != 0) {
+        return -1;
+    }
+    thread->priority = priority;
+    return 0;
+}
+
+int iot_thread_get_priority(struct iot_thread* thread, uint32_t* priority)
+{
+    if (thread == NULL || priority == NULL) {
+        return -1;
+    }
+    *priority = thread->priority;
+    return 0;
+}
+
+int iot_thread_suspend(struct iot_thread* thread)
+{
+    if (thread == NULL) {
+        return -1;
+    }
+    pthread_once(&suspend_once, install_suspend_handler);
+    if (!suspend_installed) {
+        return -1;
+    }
+    if (pthread_equal(thread->thread, pthread_self())) {
+        // The handler runs before pthread_kill returns and parks until resumed
+        pthread_mutex_lock(&thread->suspend_lock);
+        atomic_store(&thread->suspended, 1);
+        pthread_mutex_unlock(&thread->suspend_lock);
+        return pthread_kill(thread->thread, SUSPEND_SIGNAL) == 0 ? 0 : -1;
+    }
+
+    pthread_mutex_lock(&thread->suspend_lock);
+    int ret = 0;
+    if (!atomic_load(&thread->suspended)) {
+        atomic_store(&thread->suspended, 1);
+        atomic_store(&thread->ack_wanted, 1);
+        if (pthread_kill(thread->thread, SUSPEND_SIGNAL) == 0) {
+            while (sem_wait(&thread->ack) != 0 && errno == EINTR) {
+            }
+        } else {
+            atomic_store(&thread->suspended, 0);
+            atomic_store(&thread->ack_wanted, 0);
+            ret = -1;
+        }
+    }
+    pthread_mutex_unlock(&thread->suspend_lock);
+    return ret;
+}
+
+int iot_thread_resume(struct iot_thread* thread)
+{
+    if (thread == NULL) {
+        return -1;
+    }
+    pthread_mutex_lock(&thread->suspend_lock);
+    int ret = 0;
+    if (atomic_exchange(&thread->suspended, 0)) {
+        ret = pthread_kill(thread->thread, SUSPEND_SIGNAL) == 0 ? 0 : -1;
+    }
+    pthread_mutex_unlock(&thread->suspend_lock);
+    return ret;
+}
+
+void iot_thread_delay(uint32_t milliseconds)
+{
+    struct timespec ts = { (time_t)(milliseconds / 1000u), (long)(milliseconds % 1000u) * 1000000L };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+// Waits for the thread to return and frees the handle; retval is set to NULL
+int iot_thread_join(struct iot_thread* thread, void** retval)
+{
+    if (thread == NULL) {
+        return -1;
+    }
+    int ret = pthread_join(thread->thread, NULL);
+    free_thread(thread);
+    if (retval != NULL) {
+        *retval = NULL;
+    }
+    return ret == 0 ? 0 : -1;
+}
@@ -0,0 +1,243 @@
+#define _GNU_SOURCE
+
+#include "os_internal.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+/*
+ * Affinity goes through the GNU pthread extensions, and the topology is
+ * read from sysfs: the online list in /sys/devices/system/cpu/online, and
+ * for each CPU its topology/core_id and topology/physical_package_id
+ * files and the nodeN link naming its NUMA node. Where any of that is
+ * missing, every CPU is taken as a core of its own in package and node 0.
+ * Other systems report the CPU count only and accept just the empty mask.
+ */
+
+#define MASK_BITS 64
+#define SYSFS_CPU "/sys/devices/system/cpu"
+
+int iot_cpu_count(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 1 ? (int)count : 1;
+}
+
+#if defined(__linux__)
+
+static void mask_to_set(uint64_t cpu_mask, cpu_set_t* set)
+{
+    CPU_ZERO(set);
+    for (int cpu = 0; cpu < MASK_BITS; cpu++) {
+        if (cpu_mask & ((uint64_t)1 << cpu)) {
+            CPU_SET(cpu, set);
+        }
+    }
+}
+
+int os_attr_set_affinity(pthread_attr_t* pattr, uint64_t cpu_mask)
+{
+    cpu_set_t set;
+    mask_to_set(cpu_mask, &set);
+    return pthread_attr_setaffinity_np(pattr, sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+void os_thread_set_name(const char* name)
+{
+    pthread_setname_np(pthread_self(), name);
+}
+
+int iot_thread_set_affinity(struct iot_thread* thread, uint64_t cpu_mask)
+{
+    cpu_set_t set;
+    if (cpu_mask == 0) {
+        // Any CPU, including those beyond the reach of a mask
+        CPU_ZERO(&set);
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, &set);
+        }
+    } else {
+        mask_to_set(cpu_mask, &set);
+    }
+    pthread_t handle = thread != NULL ? thread->thread : pthread_self();
+    return pthread_setaffinity_np(handle, sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+int iot_thread_get_affinity(struct iot_thread* thread, uint64_t* cpu_mask)
+{
+    if (cpu_mask == NULL) {
+        return -1;
+    }
+    cpu_set_t set;
+    pthread_t handle = thread != NULL ? thread->thread : pthread_self();
+    if (pthread_getaffinity_np(handle, sizeof(set), &set) != 0) {
+        return -1;
+    }
+    *cpu_mask = 0;
+    for (int cpu = 0; cpu < MASK_BITS; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            *cpu_mask |= (uint64_t)1 << cpu;
+        }
+    }
+    return 0;
+}
+
+int iot_cpu_current(void)
+{
+    return sched_getcpu();
+}
+
+// Reads a sysfs file holding one number
+static int read_number(const char* path, uint32_t* value)
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    unsigned long number;
+    int ret = fscanf(file, "%lu", &number) == 1 ? 0 : -1;
+    fclose(file);
+    if (ret == 0) {
+        *value = (uint32_t)number;
+    }
+    return ret;
+}
+
+static uint32_t cpu_node(uint32_t cpu)
+{
+    char path[64];
+    snprintf(path, sizeof(path), SYSFS_CPU "/cpu%u", cpu);
+    DIR* dir = opendir(path);
+    if (dir == NULL) {
+        return 0;
+    }
+    uint32_t node = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        char* end;
+        if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] != '\0') {
+            unsigned long number = strtoul(entry->d_name + 4, &end, 10);
+            if (*end == '\0') {
+                node = (uint32_t)number;
+                break;
+            }
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+static void describe(uint32_t cpu, struct iot_cpu_info* info)
+{
+    char path[96];
+    info->cpu = cpu;
+    snprintf(path, sizeof(path), SYSFS_CPU "/cpu%u/topology/core_id", cpu);
+    if (read_number(path, &info->core) != 0) {
+        info->core = cpu;
+    }
+    snprintf(path, sizeof(path), SYSFS_CPU "/cpu%u/topology/physical_package_id", cpu);
+    if (read_number(path, &info->package) != 0) {
+        info->package = 0;
+    }
+    info->node = cpu_node(cpu);
+}
+
+int iot_cpu_topology(struct iot_cpu_info* cpus, size_t max_cpus)
+{
+    if (cpus == NULL && max_cpus != 0) {
+        return -1;
+    }
+    // A list of ranges such as "0-3,8-11"
+    char online[256];
+    FILE* file = fopen(SYSFS_CPU "/online", "r");
+    if (file == NULL || fgets(online, sizeof(online), file) == NULL) {
+        if (file != NULL) {
+            fclose(file);
+        }
+        snprintf(online, sizeof(online), "0-%d", iot_cpu_count() - 1);
+    } else {
+        fclose(file);
+    }
+    int count = 0;
+    char* cursor = online;
+    while (*cursor >= '0' && *cursor <= '9') {
+        unsigned long first = strtoul(cursor, &cursor, 10);
+        unsigned long last = first;
+        if (*cursor == '-') {
+            last = strtoul(cursor + 1, &cursor, 10);
+        }
+        for (unsigned long cpu = first; cpu <= last; cpu++) {
+            if ((size_t)count < max_cpus) {
+                describe((uint32_t)cpu, &cpus[count]);
+            }
+            count++;
+        }
+        if (*cursor == ',') {
+            cursor++;
+        }
+    }
+    return count;
+}
+
+#else
+
+int os_attr_set_affinity(pthread_attr_t* pattr, uint64_t cpu_mask)
+{
+    (void)pattr;
+    (void)cpu_mask;
+    return -1;
+}
+
+void os_thread_set_name(const char* name)
+{
+#if defined(__APPLE__)
+    pthread_setname_np(name);
+#else
+    (void)name;
+#endif
+}
+
+int iot_thread_set_affinity(struct iot_thread* thread, uint64_t cpu_mask)
+{
+    (void)thread;
+    return cpu_mask == 0 ? 0 : -1;
+}
+
+int iot_thread_get_affinity(struct iot_thread* thread, uint64_t* cpu_mask)
+{
+    (void)thread;
+    if (cpu_mask == NULL) {
+        return -1;
+    }
+    int count = iot_cpu_count();
+    *cpu_mask = count >= MASK_BITS ? UINT64_MAX : ((uint64_t)1 << count) - 1;
+    return 0;
+}
+
+int iot_cpu_current(void)
+{
+    return -1;
+}
+
+int iot_cpu_topology(struct iot_cpu_info* cpus, size_t max_cpus)
+{
+    if (cpus == NULL && max_cpus != 0) {
+        return -1;
+    }
+    int count = iot_cpu_count();
+    for (int cpu = 0; cpu < count && (size_t)cpu < max_cpus; cpu++) {
+        cpus[cpu].cpu = (uint32_t)cpu;
+        cpus[cpu].core = (uint32_t)cpu;
+        cpus[cpu].package = 0;
+        cpus[cpu].node = 0;
+    }
+    return count;
+}
+
+#endif
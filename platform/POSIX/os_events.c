@@ -0,0 +1,262 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include "os_internal.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * The mailbox is Vyukov's bounded MPMC ring with a single reader. Each
+ * cell's sequence says whether it is free for the poster of lap n or holds
+ * that lap's event, so posters claim a cell with one CAS on tail and never
+ * wait on each other, and the reader needs no atomic read-modify-write.
+ *
+ * A waiting thread that finds nothing sets sleeping, looks once more and
+ * sleeps on the word: a futex on Linux, a semaphore elsewhere. Posters
+ * publish, fence, and only if sleeping is set swap it to 0 and wake the
+ * thread, so an idle thread costs nothing and a busy one is never
+ * signalled. Both steps are async-signal-safe.
+ */
+
+int os_events_init(struct iot_thread* thread, uint32_t event_count)
+{
+    atomic_init(&thread->tail, 0);
+    thread->head = 0;
+    atomic_init(&thread->flags, 0);
+    atomic_init(&thread->sleeping, 0);
+    thread->cells = NULL;
+    thread->mask = 0;
+#if !defined(__linux__)
+    if (sem_init(&thread->wake, 0, 0) != 0) {
+        return -1;
+    }
+#endif
+    if (event_count == 0) {
+        return 0;
+    }
+    size_t capacity = 1;
+    while (capacity < event_count) {
+        capacity <<= 1;
+    }
+    thread->cells = (struct event_cell*)malloc(capacity * sizeof(struct event_cell));
+    if (thread->cells == NULL) {
+#if !defined(__linux__)
+        sem_destroy(&thread->wake);
+#endif
+        return -1;
+    }
+    for (size_t i = 0; i < capacity; i++) {
+        atomic_init(&thread->cells[i].sequence, i);
+        thread->cells[i].event = 0;
+    }
+    thread->mask = capacity - 1;
+    return 0;
+}
+
+void os_events_destroy(struct iot_thread* thread)
+{
+    free(thread->cells);
+    thread->cells = NULL;
+#if !defined(__linux__)
+    sem_destroy(&thread->wake);
+#endif
+}
+
+void os_events_wake(struct iot_thread* thread)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&thread->sleeping, memory_order_relaxed) == 0) {
+        return;
+    }
+    if (atomic_exchange_explicit(&thread->sleeping, 0, memory_order_acq_rel) == 0) {
+        return;
+    }
+#if defined(__linux__)
+    os_futex_wake(&thread->sleeping, 1);
+#else
+    sem_post(&thread->wake);
+#endif
+}
+
+// Sleeps while sleeping stays 1; returns true once the deadline has passed
+static bool sleep_until(struct iot_thread* self, const struct timespec* deadline)
+{
+#if defined(__linux__)
+    // The deadline is absolute, so wake-ups need no recomputing
+    return os_futex_wait(&self->sleeping, 1, deadline) != 0;
+#else
+    int ret = deadline != NULL ? sem_timedwait(&self->wake, deadline) : sem_wait(&self->wake);
+    if (ret == 0) {
+        // Consumed the poster's wake-up, so settle must not wait for another
+        atomic_store(&self->sleeping, 2);
+        return false;
+    }
+    return errno == ETIMEDOUT;
+#endif
+}
+
+// Leaves the sleeping state; elsewhere than Linux, takes the wake-up a poster committed to
+static void settle(struct iot_thread* self)
+{
+    unsigned previous = atomic_exchange(&self->sleeping, 0);
+#if defined(__linux__)
+    (void)previous;
+#else
+    if (previous == 0) {
+        while (sem_wait(&self->wake) != 0 && errno == EINTR) {
+        }
+    }
+#endif
+}
+
+typedef bool (*attempt_func)(struct iot_thread* self, void* ctx);
+
+static int wait_for(struct iot_thread* self, attempt_func attempt, void* ctx, uint32_t timeout_ms)
+{
+    if (attempt(self, ctx)) {
+        return 0;
+    }
+    if (timeout_ms == 0) {
+        return IOT_THREAD_TIMEOUT;
+    }
+    struct timespec deadline;
+    const struct timespec* until = NULL;
+    if (timeout_ms != IOT_WAIT_FOREVER) {
+#if defined(__linux__)
+        os_deadline(timeout_ms, &deadline);
+#else
+        // sem_timedwait takes CLOCK_REALTIME
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += (time_t)(timeout_ms / 1000u);
+        deadline.tv_nsec += (long)(timeout_ms % 1000u) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+#endif
+        until = &deadline;
+    }
+
+    for (;;) {
+        atomic_store(&self->sleeping, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        // iot_thread_delete wakes the thread after cancelling it; waits are cancellation points
+        pthread_testcancel();
+        if (attempt(self, ctx)) {
+            settle(self);
+            return 0;
+        }
+        bool expired = sleep_until(self, until);
+        settle(self);
+        pthread_testcancel();
+        if (attempt(self, ctx)) {
+            return 0;
+        }
+        if (expired) {
+            return IOT_THREAD_TIMEOUT;
+        }
+    }
+}
+
+struct iot_thread* iot_thread_self(void)
+{
+    return iot_current_thread;
+}
+
+int iot_thread_post(struct iot_thread* thread, uint32_t event)
+{
+    if (thread == NULL || thread->cells == NULL) {
+        return -1;
+    }
+    size_t pos = atomic_load_explicit(&thread->tail, memory_order_relaxed);
+    for (;;) {
+        struct event_cell* cell = &thread->cells[pos & thread->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t lap = (intptr_t)sequence - (intptr_t)pos;
+        if (lap == 0) {
+            if (atomic_compare_exchange_weak_explicit(&thread->tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                cell->event = event;
+                atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+                break;
+            }
+        } else if (lap < 0) {
+            // The reader has not freed this cell from the previous lap
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&thread->tail, memory_order_relaxed);
+        }
+    }
+    os_events_wake(thread);
+    return 0;
+}
+
+static bool take_event(struct iot_thread* self, void* ctx)
+{
+    struct event_cell* cell = &self->cells[self->head & self->mask];
+    if (atomic_load_explicit(&cell->sequence, memory_order_acquire) != self->head + 1) {
+        return false;
+    }
+    *(uint32_t*)ctx = cell->event;
+    atomic_store_explicit(&cell->sequence, self->head + self->mask + 1, memory_order_release);
+    self->head++;
+    return true;
+}
+
+int iot_thread_wait_event(uint32_t* event, uint32_t timeout_ms)
+{
+    struct iot_thread* self = iot_current_thread;
+    if (self == NULL || self->cells == NULL || event == NULL) {
+        return -1;
+    }
+    return wait_for(self, take_event, event, timeout_ms);
+}
+
+int iot_thread_set_flags(struct iot_thread* thread, uint32_t flags)
+{
+    if (thread == NULL) {
+        return -1;
+    }
+    atomic_fetch_or_explicit(&thread->flags, flags, memory_order_release);
+    os_events_wake(thread);
+    return 0;
+}
+
+struct flags_wait {
+    uint32_t mask;
+    uint32_t options;
+    uint32_t seen;
+};
+
+static bool take_flags(struct iot_thread* self, void* ctx)
+{
+    struct flags_wait* wait = (struct flags_wait*)ctx;
+    unsigned current = atomic_load_explicit(&self->flags, memory_order_acquire);
+    for (;;) {
+        bool ready = (wait->options & IOT_FLAGS_WAIT_ALL) ? (current & wait->mask) == wait->mask : (current & wait->mask) != 0;
+        if (!ready) {
+            return false;
+        }
+        if ((wait->options & IOT_FLAGS_NO_CLEAR)
+            || atomic_compare_exchange_weak_explicit(&self->flags, &current, current & ~wait->mask, memory_order_acquire, memory_order_acquire)) {
+            break;
+        }
+    }
+    wait->seen = current;
+    return true;
+}
+
+int iot_thread_wait_flags(uint32_t mask, uint32_t options, uint32_t* flags, uint32_t timeout_ms)
+{
+    struct iot_thread* self = iot_current_thread;
+    if (self == NULL || mask == 0) {
+        return -1;
+    }
+    struct flags_wait wait = { mask, options, 0 };
+    int ret = wait_for(self, take_flags, &wait, timeout_ms);
+    if (ret == 0 && flags != NULL) {
+        *flags = wait.seen;
+    }
+    return ret;
+}
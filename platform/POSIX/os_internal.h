@@ -0,0 +1,83 @@
+#ifndef IOT_POSIX_OS_INTERNAL_H
+#define IOT_POSIX_OS_INTERNAL_H
+
+#include "interface/os.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// One slot of a thread's event mailbox
+struct event_cell {
+    atomic_size_t sequence; // Which lap of the ring the slot is ready for
+    uint32_t event;
+};
+
+// Thread handle handed out by iot_thread_create
+struct iot_thread {
+    pthread_t thread;
+    iot_thread_func_t func;
+    void* arg;
+    uint32_t priority;
+    // Taken by the thread itself on start, so it is in place before func runs
+    char name[16];
+    // Serialises suspend and resume; ack is posted by the parked handler
+    pthread_mutex_t suspend_lock;
+    atomic_int suspended;
+    atomic_int ack_wanted;
+    sem_t ack;
+
+    // Event mailbox: any thread posts at tail, only this thread reads at head
+    struct event_cell* cells; // NULL when created with no events
+    size_t mask;
+    _Alignas(64) atomic_size_t tail;
+    size_t head;
+    atomic_uint flags;
+    // 1 while the thread sleeps in an event wait; the futex word on Linux
+    _Alignas(64) atomic_uint sleeping;
+#if !defined(__linux__)
+    sem_t wake;
+#endif
+};
+
+// Tells the CPU the caller is spinning, freeing pipeline resources for the other hyperthread
+static inline void os_cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// The calling thread's handle, NULL outside threads from iot_thread_create
+extern _Thread_local struct iot_thread* iot_current_thread;
+
+// Set up and tear down the mailbox and flags of a new thread
+int os_events_init(struct iot_thread* thread, uint32_t event_count);
+void os_events_destroy(struct iot_thread* thread);
+
+// Wakes the thread if it sleeps in an event wait; async-signal-safe
+void os_events_wake(struct iot_thread* thread);
+
+// Restricts threads created with pattr to the CPUs in cpu_mask
+int os_attr_set_affinity(pthread_attr_t* pattr, uint64_t cpu_mask);
+
+// Names the calling thread where the system supports it
+void os_thread_set_name(const char* name);
+
+// Sleeps while *word is expected, until woken or past deadline (absolute
+// CLOCK_MONOTONIC, NULL for none); returns -1 with errno ETIMEDOUT on
+// timeout and 0 otherwise, including spurious wake-ups. A futex on Linux,
+// hashed condition variables elsewhere.
+int os_futex_wait(atomic_uint* word, unsigned expected, const struct timespec* deadline);
+
+// Wakes up to count threads sleeping on word
+void os_futex_wake(atomic_uint* word, int count);
+
+// The CLOCK_MONOTONIC time timeout_ms from now
+void os_deadline(uint32_t timeout_ms, struct timespec* deadline);
+
+#endif // IOT_POSIX_OS_INTERNAL_H
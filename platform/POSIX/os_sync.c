@@ -0,0 +1,494 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include "os_internal.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+/*
+ * Every primitive here is one or two 32-bit words changed with atomics on
+ * the uncontended path; only a thread that has to sleep enters the kernel,
+ * and a releaser makes the wake-up syscall only when it knows of sleepers.
+ *
+ * The mutex word is 0 when free, 1 when held and 2 when held with possible
+ * sleepers (Drepper, "Futexes Are Tricky", mutex 2). Before sleeping, lock
+ * spins for up to twice the rounds it has recently taken to get the
+ * mutex, plus a margin, up to SPIN_MAX; the estimate is a running average,
+ * so mutexes held across long operations stop spinning. This is the
+ * heuristic of glibc's adaptive mutex. Nothing spins on a single CPU,
+ * where the holder cannot run meanwhile.
+ */
+
+#define SPIN_MAX 100
+#define RWLOCK_SPINS 50
+#define RWLOCK_WRITER 0x80000000u
+
+struct iot_mutex {
+    atomic_uint state;
+    atomic_int spins; // Running average of rounds spun before acquiring
+};
+
+// Reader count, or RWLOCK_WRITER while held exclusively. Readers also wait
+// while writers_waiting is non-zero, so writers are not starved
+struct iot_rwlock {
+    atomic_uint state;
+    atomic_uint writers_waiting;
+    atomic_uint readers_waiting;
+    atomic_uint read_wake; // Futex words, bumped to wake their sleepers
+    atomic_uint write_wake;
+};
+
+struct iot_cond {
+    atomic_uint sequence; // Bumped by every signal; waiters sleep on it
+    atomic_uint waiters;
+};
+
+struct iot_sem {
+    atomic_uint count; // Waiters sleep on it while it is zero
+    atomic_uint waiters;
+};
+
+#if defined(__linux__)
+
+int os_futex_wait(atomic_uint* word, unsigned expected, const struct timespec* deadline)
+{
+    // The bitset form takes an absolute CLOCK_MONOTONIC deadline
+    long ret = syscall(SYS_futex, word, FUTEX_WAIT_BITSET_PRIVATE, expected, deadline, NULL, FUTEX_BITSET_MATCH_ANY);
+    return ret != 0 && errno == ETIMEDOUT ? -1 : 0;
+}
+
+void os_futex_wake(atomic_uint* word, int count)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+#else
+
+// Without futexes, sleepers wait on a condition variable picked by address.
+// Wakers change the word before taking the bucket lock and waiters check
+// it under that lock, so no wake-up is lost; unrelated words sharing a
+// bucket only cause spurious wake-ups.
+#define PARK_BUCKETS 64
+
+struct park_bucket {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+static struct park_bucket park_buckets[PARK_BUCKETS];
+static pthread_once_t park_once = PTHREAD_ONCE_INIT;
+
+static void park_init(void)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    for (int i = 0; i < PARK_BUCKETS; i++) {
+        pthread_mutex_init(&park_buckets[i].lock, NULL);
+        pthread_cond_init(&park_buckets[i].cond, &attr);
+    }
+    pthread_condattr_destroy(&attr);
+}
+
+static struct park_bucket* park_bucket_of(const atomic_uint* word)
+{
+    uintptr_t hash = ((uintptr_t)word >> 2) * (uintptr_t)0x9e3779b97f4a7c15ull;
+    return &park_buckets[(hash >> 16) % PARK_BUCKETS];
+}
+
+int os_futex_wait(atomic_uint* word, unsigned expected, const struct timespec* deadline)
+{
+    pthread_once(&park_once, park_init);
+    struct park_bucket* bucket = park_bucket_of(word);
+    int ret = 0;
+    pthread_mutex_lock(&bucket->lock);
+    if (atomic_load(word) == expected) {
+        ret = deadline != NULL ? pthread_cond_timedwait(&bucket->cond, &bucket->lock, deadline)
+                               : pthread_cond_wait(&bucket->cond, &bucket->lock);
+    }
+    pthread_mutex_unlock(&bucket->lock);
+    if (ret == ETIMEDOUT) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    return 0;
+}
+
+void os_futex_wake(atomic_uint* word, int count)
+{
+    pthread_once(&park_once, park_init);
+    struct park_bucket* bucket = park_bucket_of(word);
+    pthread_mutex_lock(&bucket->lock);
+    pthread_cond_broadcast(&bucket->cond);
+    pthread_mutex_unlock(&bucket->lock);
+    (void)count;
+}
+
+#endif
+
+void os_deadline(uint32_t timeout_ms, struct timespec* deadline)
+{
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += (time_t)(timeout_ms / 1000u);
+    deadline->tv_nsec += (long)(timeout_ms % 1000u) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+static bool spinning_pays(void)
+{
+    static atomic_int cpus;
+    int count = atomic_load_explicit(&cpus, memory_order_relaxed);
+    if (count == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        count = online > 1 ? (int)online : 1;
+        atomic_store_explicit(&cpus, count, memory_order_relaxed);
+    }
+    return count > 1;
+}
+
+struct iot_mutex* iot_mutex_init(void)
+{
+    struct iot_mutex* mutex = (struct iot_mutex*)malloc(sizeof(struct iot_mutex));
+    if (mutex == NULL) {
+        return NULL;
+    }
+    atomic_init(&mutex->state, 0);
+    atomic_init(&mutex->spins, 0);
+    return mutex;
+}
+
+// Takes the mutex as contended; used after sleeping, when others may be asleep too
+static void mutex_lock_contended(struct iot_mutex* mutex)
+{
+    while (atomic_exchange_explicit(&mutex->state, 2, memory_order_acquire) != 0) {
+        os_futex_wait(&mutex->state, 2, NULL);
+    }
+}
+
+int iot_mutex_lock(struct iot_mutex* mutex)
+{
+    if (mutex == NULL) {
+        return -1;
+    }
+    unsigned expected = 0;
+    if (atomic_compare_exchange_strong_explicit(&mutex->state, &expected, 1, memory_order_acquire, memory_order_relaxed)) {
+        return 0;
+    }
+    if (spinning_pays()) {
+        int average = atomic_load_explicit(&mutex->spins, memory_order_relaxed);
+        int limit = average * 2 + 10 < SPIN_MAX ? average * 2 + 10 : SPIN_MAX;
+        int round = 1;
+        for (; round <= limit; round++) {
+            os_cpu_relax();
+            expected = 0;
+            if (atomic_load_explicit(&mutex->state, memory_order_relaxed) == 0
+                && atomic_compare_exchange_weak_explicit(&mutex->state, &expected, 1, memory_order_acquire, memory_order_relaxed)) {
+                break;
+            }
+        }
+        atomic_store_explicit(&mutex->spins, average + ((round > limit ? limit : round) - average) / 8, memory_order_relaxed);
+        if (round <= limit) {
+            return 0;
+        }
+    }
+    mutex_lock_contended(mutex);
+    return 0;
+}
+
+int iot_mutex_trylock(struct iot_mutex* mutex)
+{
+    if (mutex == NULL) {
+        return -1;
+    }
+    unsigned expected = 0;
+    return atomic_compare_exchange_strong_explicit(&mutex->state, &expected, 1, memory_order_acquire, memory_order_relaxed) ? 0 : -1;
+}
+
+int iot_mutex_unlock(struct iot_mutex* mutex)
+{
+    if (mutex == NULL) {
+        return -1;
+    }
+    if (atomic_exchange_explicit(&mutex->state, 0, memory_order_release) == 2) {
+        os_futex_wake(&mutex->state, 1);
+    }
+    return 0;
+}
+
+void iot_mutex_destroy(struct iot_mutex* mutex)
+{
+    free(mutex);
+}
+
+struct iot_rwlock* iot_rwlock_init(void)
+{
+    struct iot_rwlock* rwlock = (struct iot_rwlock*)malloc(sizeof(struct iot_rwlock));
+    if (rwlock == NULL) {
+        return NULL;
+    }
+    atomic_init(&rwlock->state, 0);
+    atomic_init(&rwlock->writers_waiting, 0);
+    atomic_init(&rwlock->readers_waiting, 0);
+    atomic_init(&rwlock->read_wake, 0);
+    atomic_init(&rwlock->write_wake, 0);
+    return rwlock;
+}
+
+static bool try_read_lock(struct iot_rwlock* rwlock)
+{
+    unsigned state = atomic_load(&rwlock->state);
+    while (!(state & RWLOCK_WRITER) && atomic_load(&rwlock->writers_waiting) == 0) {
+        if (atomic_compare_exchange_weak(&rwlock->state, &state, state + 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool try_write_lock(struct iot_rwlock* rwlock)
+{
+    unsigned expected = 0;
+    return atomic_compare_exchange_strong(&rwlock->state, &expected, RWLOCK_WRITER);
+}
+
+// Retries try for a few rounds when another CPU may release the lock meanwhile
+static bool spin_for(struct iot_rwlock* rwlock, bool (*try)(struct iot_rwlock*))
+{
+    if (try(rwlock)) {
+        return true;
+    }
+    if (!spinning_pays()) {
+        return false;
+    }
+    for (int round = 0; round < RWLOCK_SPINS; round++) {
+        os_cpu_relax();
+        if (try(rwlock)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int iot_rwlock_read_lock(struct iot_rwlock* rwlock)
+{
+    if (rwlock == NULL) {
+        return -1;
+    }
+    if (spin_for(rwlock, try_read_lock)) {
+        return 0;
+    }
+    atomic_fetch_add(&rwlock->readers_waiting, 1);
+    for (;;) {
+        unsigned wake = atomic_load(&rwlock->read_wake);
+        if (try_read_lock(rwlock)) {
+            break;
+        }
+        os_futex_wait(&rwlock->read_wake, wake, NULL);
+    }
+    atomic_fetch_sub(&rwlock->readers_waiting, 1);
+    return 0;
+}
+
+int iot_rwlock_read_unlock(struct iot_rwlock* rwlock)
+{
+    if (rwlock == NULL) {
+        return -1;
+    }
+    // The last reader out hands over to a waiting writer
+    if (atomic_fetch_sub(&rwlock->state, 1) == 1 && atomic_load(&rwlock->writers_waiting) != 0) {
+        atomic_fetch_add(&rwlock->write_wake, 1);
+        os_futex_wake(&rwlock->write_wake, 1);
+    }
+    return 0;
+}
+
+int iot_rwlock_write_lock(struct iot_rwlock* rwlock)
+{
+    if (rwlock == NULL) {
+        return -1;
+    }
+    if (spin_for(rwlock, try_write_lock)) {
+        return 0;
+    }
+    atomic_fetch_add(&rwlock->writers_waiting, 1);
+    for (;;) {
+        unsigned wake = atomic_load(&rwlock->write_wake);
+        if (try_write_lock(rwlock)) {
+            break;
+        }
+        os_futex_wait(&rwlock->write_wake, wake, NULL);
+    }
+    atomic_fetch_sub(&rwlock->writers_waiting, 1);
+    return 0;
+}
+
+int iot_rwlock_write_unlock(struct iot_rwlock* rwlock)
+{
+    if (rwlock == NULL) {
+        return -1;
+    }
+    atomic_store(&rwlock->state, 0);
+    // Writers first; readers are let in by the last queued writer's unlock
+    if (atomic_load(&rwlock->writers_waiting) != 0) {
+        atomic_fetch_add(&rwlock->write_wake, 1);
+        os_futex_wake(&rwlock->write_wake, 1);
+    } else if (atomic_load(&rwlock->readers_waiting) != 0) {
+        atomic_fetch_add(&rwlock->read_wake, 1);
+        os_futex_wake(&rwlock->read_wake, INT_MAX);
+    }
+    return 0;
+}
+
+void iot_rwlock_destroy(struct iot_rwlock* rwlock)
+{
+    free(rwlock);
+}
+
+struct iot_cond* iot_cond_init(void)
+{
+    struct iot_cond* cond = (struct iot_cond*)malloc(sizeof(struct iot_cond));
+    if (cond == NULL) {
+        return NULL;
+    }
+    atomic_init(&cond->sequence, 0);
+    atomic_init(&cond->waiters, 0);
+    return cond;
+}
+
+int iot_cond_wait(struct iot_cond* cond, struct iot_mutex* mutex, uint32_t timeout_ms)
+{
+    if (cond == NULL || mutex == NULL) {
+        return -1;
+    }
+    struct timespec deadline;
+    if (timeout_ms != IOT_WAIT_FOREVER) {
+        os_deadline(timeout_ms, &deadline);
+    }
+    // Read under the mutex: a signal sent after the unlock changes it and ends the sleep
+    atomic_fetch_add(&cond->waiters, 1);
+    unsigned sequence = atomic_load(&cond->sequence);
+    iot_mutex_unlock(mutex);
+    int ret = os_futex_wait(&cond->sequence, sequence, timeout_ms != IOT_WAIT_FOREVER ? &deadline : NULL);
+    atomic_fetch_sub(&cond->waiters, 1);
+    mutex_lock_contended(mutex);
+    return ret != 0 ? IOT_THREAD_TIMEOUT : 0;
+}
+
+int iot_cond_signal(struct iot_cond* cond)
+{
+    if (cond == NULL) {
+        return -1;
+    }
+    atomic_fetch_add(&cond->sequence, 1);
+    if (atomic_load(&cond->waiters) != 0) {
+        os_futex_wake(&cond->sequence, 1);
+    }
+    return 0;
+}
+
+int iot_cond_broadcast(struct iot_cond* cond)
+{
+    if (cond == NULL) {
+        return -1;
+    }
+    atomic_fetch_add(&cond->sequence, 1);
+    if (atomic_load(&cond->waiters) != 0) {
+        os_futex_wake(&cond->sequence, INT_MAX);
+    }
+    return 0;
+}
+
+void iot_cond_destroy(struct iot_cond* cond)
+{
+    free(cond);
+}
+
+struct iot_sem* iot_sem_init(uint32_t initial)
+{
+    struct iot_sem* sem = (struct iot_sem*)malloc(sizeof(struct iot_sem));
+    if (sem == NULL) {
+        return NULL;
+    }
+    atomic_init(&sem->count, initial);
+    atomic_init(&sem->waiters, 0);
+    return sem;
+}
+
+static bool sem_take(struct iot_sem* sem)
+{
+    unsigned count = atomic_load(&sem->count);
+    while (count > 0) {
+        if (atomic_compare_exchange_weak(&sem->count, &count, count - 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int iot_sem_wait(struct iot_sem* sem, uint32_t timeout_ms)
+{
+    if (sem == NULL) {
+        return -1;
+    }
+    if (sem_take(sem)) {
+        return 0;
+    }
+    if (timeout_ms == 0) {
+        return IOT_THREAD_TIMEOUT;
+    }
+    if (spinning_pays()) {
+        for (int round = 0; round < SPIN_MAX; round++) {
+            os_cpu_relax();
+            if (sem_take(sem)) {
+                return 0;
+            }
+        }
+    }
+    struct timespec deadline;
+    if (timeout_ms != IOT_WAIT_FOREVER) {
+        os_deadline(timeout_ms, &deadline);
+    }
+    int ret = 0;
+    atomic_fetch_add(&sem->waiters, 1);
+    while (!sem_take(sem)) {
+        if (os_futex_wait(&sem->count, 0, timeout_ms != IOT_WAIT_FOREVER ? &deadline : NULL) != 0) {
+            ret = sem_take(sem) ? 0 : IOT_THREAD_TIMEOUT;
+            break;
+        }
+    }
+    atomic_fetch_sub(&sem->waiters, 1);
+    return ret;
+}
+
+int iot_sem_post(struct iot_sem* sem)
+{
+    if (sem == NULL) {
+        return -1;
+    }
+    unsigned count = atomic_load(&sem->count);
+    do {
+        if (count == UINT_MAX) {
+            return -1;
+        }
+    } while (!atomic_compare_exchange_weak(&sem->count, &count, count + 1));
+    if (atomic_load(&sem->waiters) != 0) {
+        os_futex_wake(&sem->count, 1);
+    }
+    return 0;
+}
+
+void iot_sem_destroy(struct iot_sem* sem)
+{
+    free(sem);
+}
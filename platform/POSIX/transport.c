@@ -0,0 +1,735 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include "transport_internal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+#include <linux/errqueue.h>
+#define TRANSPORT_ZEROCOPY 1
+#else
+#define TRANSPORT_ZEROCOPY 0
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // SO_NOSIGPIPE is set on the socket instead
+#endif
+
+#define TRANSPORT_MAX_ADDRS 8
+#define TRANSPORT_DNS_CACHE_SIZE 8
+#define TRANSPORT_PINNED_HOSTS 8
+#define TRANSPORT_HOST_SIZE 256
+#define TRANSPORT_PORT_SIZE 32
+#define TRANSPORT_PINNED_SIZE 256
+#define TRANSPORT_MAX_IOV 16 // Vectors handed to one sendmsg call
+
+// One resolved address
+struct transport_addr {
+    struct sockaddr_storage addr;
+    socklen_t length;
+};
+
+// Resolved addresses of a host and port
+struct transport_addrs {
+    struct transport_addr addrs[TRANSPORT_MAX_ADDRS];
+    int count;
+    int preferred_family; // Family of the last winning address, 0 if none
+};
+
+// A cached DNS result
+struct dns_entry {
+    char host[TRANSPORT_HOST_SIZE];
+    char port[TRANSPORT_PORT_SIZE];
+    struct transport_addrs result;
+    uint64_t expires_ms;
+    uint64_t used_ms;
+};
+
+// A host pinned to fixed addresses
+struct pinned_host {
+    char host[TRANSPORT_HOST_SIZE];
+    char addresses[TRANSPORT_PINNED_SIZE];
+    int preferred_family;
+};
+
+static pthread_mutex_t dns_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct dns_entry dns_cache[TRANSPORT_DNS_CACHE_SIZE];
+static struct pinned_host pinned_hosts[TRANSPORT_PINNED_HOSTS];
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+// Fill a config with the defaults used by iot_transport_open
+void iot_transport_config_default(struct iot_transport_config* config)
+{
+    if (config == NULL) {
+        return;
+    }
+    memset(config, 0, sizeof(*config));
+    config->connect_timeout_ms = 10000;
+    config->attempt_delay_ms = 250; // RFC 8305 recommendation
+    config->send_timeout_ms = 10000;
+    config->recv_timeout_ms = 10000;
+    config->tcp_nodelay = true;
+    config->keepalive = true;
+    config->keepalive_idle_s = 60;
+    config->keepalive_interval_s = 10;
+    config->keepalive_count = 3;
+    config->dns_cache_ttl_ms = 60000;
+}
+
+// Append the addresses of one getaddrinfo result
+static void add_addrinfo(struct transport_addrs* out, const struct addrinfo* list)
+{
+    for (const struct addrinfo* ai = list; ai != NULL && out->count < TRANSPORT_MAX_ADDRS; ai = ai->ai_next) {
+        if ((ai->ai_family != AF_INET && ai->ai_family != AF_INET6) || ai->ai_addrlen > sizeof(struct sockaddr_storage)) {
+            continue;
+        }
+        memcpy(&out->addrs[out->count].addr, ai->ai_addr, ai->ai_addrlen);
+        out->addrs[out->count].length = ai->ai_addrlen;
+        out->count++;
+    }
+}
+
+// Resolve a pinned host; return 1 if host is pinned, 0 if not, -1 on error
+static int resolve_pinned(const char* host, const char* port, struct transport_addrs* out)
+{
+    char addresses[TRANSPORT_PINNED_SIZE];
+    int preferred_family = 0;
+    bool found = false;
+
+    pthread_mutex_lock(&dns_lock);
+    for (int i = 0; i < TRANSPORT_PINNED_HOSTS; i++) {
+        if (pinned_hosts[i].host[0] != '\0' && strcmp(pinned_hosts[i].host, host) == 0) {
+            memcpy(addresses, pinned_hosts[i].addresses, sizeof(addresses));
+            preferred_family = pinned_hosts[i].preferred_family;
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&dns_lock);
+    if (!found) {
+        return 0;
+    }
+
+    struct addrinfo hints = { 0 };
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICHOST;
+    char* save = NULL;
+    for (char* token = strtok_r(addresses, " ", &save); token != NULL; token = strtok_r(NULL, " ", &save)) {
+        struct addrinfo* list = NULL;
+        if (getaddrinfo(token, port, &hints, &list) == 0) {
+            add_addrinfo(out, list);
+            freeaddrinfo(list);
+        }
+    }
+    out->preferred_family = preferred_family;
+    return out->count > 0 ? 1 : -1;
+}
+
+// Resolve host and port, going through the pinned hosts and the DNS cache
+static int resolve(const char* host, const char* port, uint32_t ttl_ms, struct transport_addrs* out)
+{
+    memset(out, 0, sizeof(*out));
+    if (strlen(host) >= TRANSPORT_HOST_SIZE || strlen(port) >= TRANSPORT_PORT_SIZE) {
+        return -1;
+    }
+
+    int pinned = resolve_pinned(host, port, out);
+    if (pinned != 0) {
+        return pinned > 0 ? 0 : -1;
+    }
+
+    uint64_t now = now_ms();
+    if (ttl_ms != 0) {
+        pthread_mutex_lock(&dns_lock);
+        for (int i = 0; i < TRANSPORT_DNS_CACHE_SIZE; i++) {
+            struct dns_entry* entry = &dns_cache[i];
+            if (entry->expires_ms > now && strcmp(entry->host, host) == 0 && strcmp(entry->port, port) == 0) {
+                entry->used_ms = now;
+                *out = entry->result;
+                pthread_mutex_unlock(&dns_lock);
+                return 0;
+            }
+        }
+        pthread_mutex_unlock(&dns_lock);
+    }
+
+    struct addrinfo hints = { 0 };
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* list = NULL;
+    if (getaddrinfo(host, port, &hints, &list) != 0) {
+        return -1;
+    }
+    add_addrinfo(out, list);
+    freeaddrinfo(list);
+    if (out->count == 0) {
+        return -1;
+    }
+
+    if (ttl_ms != 0) {
+        // Replace an expired or the least recently used entry
+        pthread_mutex_lock(&dns_lock);
+        struct dns_entry* victim = &dns_cache[0];
+        for (int i = 0; i < TRANSPORT_DNS_CACHE_SIZE; i++) {
+            struct dns_entry* entry = &dns_cache[i];
+            if (entry->expires_ms <= now || (strcmp(entry->host, host) == 0 && strcmp(entry->port, port) == 0)) {
+                victim = entry;
+                break;
+            }
+            if (entry->used_ms < victim->used_ms) {
+                victim = entry;
+            }
+        }
+        strcpy(victim->host, host);
+        strcpy(victim->port, port);
+        victim->result = *out;
+        victim->expires_ms = now + ttl_ms;
+        victim->used_ms = now;
+        pthread_mutex_unlock(&dns_lock);
+    }
+    return 0;
+}
+
+// Remember which family connected so the next connect to host tries it first
+static void remember_family(const char* host, const char* port, int family)
+{
+    pthread_mutex_lock(&dns_lock);
+    for (int i = 0; i < TRANSPORT_PINNED_HOSTS; i++) {
+        if (strcmp(pinned_hosts[i].host, host) == 0) {
+            pinned_hosts[i].preferred_family = family;
+        }
+    }
+    for (int i = 0; i < TRANSPORT_DNS_CACHE_SIZE; i++) {
+        if (strcmp(dns_cache[i].host, host) == 0 && strcmp(dns_cache[i].port, port) == 0) {
+            dns_cache[i].result.preferred_family = family;
+        }
+    }
+    pthread_mutex_unlock(&dns_lock);
+}
+
+// Interleave address families (RFC 8305 section 4), starting with the preferred one
+static void order_addrs(const struct transport_addrs* in, struct transport_addr* out)
+{
+    int first = in->preferred_family != 0 ? in->preferred_family : in->addrs[0].addr.ss_family;
+    int taken[TRANSPORT_MAX_ADDRS] = { 0 };
+    int family = first;
+
+    for (int n = 0; n < in->count; n++) {
+        int pick = -1;
+        for (int i = 0; i < in->count && pick < 0; i++) {
+            if (!taken[i] && in->addrs[i].addr.ss_family == family) {
+                pick = i;
+            }
+        }
+        for (int i = 0; i < in->count && pick < 0; i++) {
+            if (!taken[i]) {
+                pick = i;
+            }
+        }
+        taken[pick] = 1;
+        out[n] = in->addrs[pick];
+        family = in->addrs[pick].addr.ss_family == AF_INET6 ? AF_INET : AF_INET6;
+    }
+}
+
+// Apply the socket options that must be set before connecting
+static void set_options(int fd, const struct iot_transport_config* config)
+{
+    int on = 1;
+
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    if (config->tcp_nodelay) {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    // Buffer sizes go before connect so the window scale is negotiated for them
+    if (config->send_buffer_size > 0) {
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &config->send_buffer_size, sizeof(config->send_buffer_size));
+    }
+    if (config->recv_buffer_size > 0) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &config->recv_buffer_size, sizeof(config->recv_buffer_size));
+    }
+    if (config->keepalive) {
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+        int idle = (int)config->keepalive_idle_s;
+        int interval = (int)config->keepalive_interval_s;
+        int count = (int)config->keepalive_count;
+#ifdef TCP_KEEPIDLE
+        if (idle > 0) {
+            setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+        }
+#elif defined(TCP_KEEPALIVE)
+        if (idle > 0) {
+            setsockopt(fd, IPPROTO_TCP, TCP_KEEPALIVE, &idle, sizeof(idle));
+        }
+#endif
+#ifdef TCP_KEEPINTVL
+        if (interval > 0) {
+            setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+        }
+#endif
+#ifdef TCP_KEEPCNT
+        if (count > 0) {
+            setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+        }
+#endif
+        (void)interval;
+        (void)count;
+    }
+}
+
+// Start a non-blocking connect; return the socket, or -1 if it failed at once
+static int start_connect(const struct transport_addr* addr, const struct iot_transport_config* config, bool* connected)
+{
+    int fd = socket(addr->addr.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    set_options(fd, config);
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    *connected = false;
+    if (connect(fd, (const struct sockaddr*)&addr->addr, addr->length) == 0) {
+        *connected = true;
+    } else if (errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Race connects to the ordered addresses. A new attempt starts when the
+ * previous one has had attempt_delay_ms, or as soon as it fails; the first
+ * to complete wins and the rest are closed. Returns the connected socket,
+ * -1 if every address failed or IOT_TRANSPORT_TIMEOUT.
+ */
+static int connect_race(const struct transport_addr* addrs, int count, const struct iot_transport_config* config,
+    int* family)
+{
+    struct pollfd fds[TRANSPORT_MAX_ADDRS];
+    int families[TRANSPORT_MAX_ADDRS];
+    int pending = 0;
+    int next = 0;
+    int winner = -1;
+    uint64_t start = now_ms();
+    uint64_t next_start = start;
+    uint64_t deadline = config->connect_timeout_ms != 0 ? start + config->connect_timeout_ms : UINT64_MAX;
+
+    while (winner < 0) {
+        uint64_t now = now_ms();
+        if (now >= deadline) {
+            break;
+        }
+
+        if (next < count && (now >= next_start || pending == 0)) {
+            bool connected;
+            int fd = start_connect(&addrs[next], config, &connected);
+            int addr_family = addrs[next].addr.ss_family;
+            next++;
+            if (fd < 0) {
+                continue; // Failed at once: try the next address right away
+            }
+            if (connected) {
+                winner = fd;
+                *family = addr_family;
+                break;
+            }
+            fds[pending].fd = fd;
+            fds[pending].events = POLLOUT;
+            fds[pending].revents = 0;
+            families[pending] = addr_family;
+            pending++;
+            next_start = now + config->attempt_delay_ms;
+            continue;
+        }
+        if (pending == 0) {
+            break; // Every address failed
+        }
+
+        uint64_t wake = deadline;
+        if (next < count && next_start < wake) {
+            wake = next_start;
+        }
+        int timeout = wake == UINT64_MAX ? -1 : (int)(wake - now);
+        int ready = poll(fds, (nfds_t)pending, timeout);
+        if (ready < 0 && errno != EINTR) {
+            break;
+        }
+
+        for (int i = 0; ready > 0 && i < pending; i++) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0) {
+                winner = fds[i].fd;
+                *family = families[i];
+                fds[i] = fds[--pending];
+                families[i] = families[pending];
+                break;
+            }
+            // This attempt failed: drop it and let the next address start now
+            close(fds[i].fd);
+            fds[i] = fds[--pending];
+            families[i] = families[pending];
+            next_start = now;
+            i--;
+            ready--;
+        }
+    }
+
+    for (int i = 0; i < pending; i++) {
+        close(fds[i].fd);
+    }
+    if (winner >= 0) {
+        return winner;
+    }
+    return now_ms() >= deadline ? IOT_TRANSPORT_TIMEOUT : -1;
+}
+
+static void set_timeout(int fd, int option, uint32_t timeout_ms)
+{
+    struct timeval tv;
+    tv.tv_sec = (time_t)(timeout_ms / 1000);
+    tv.tv_usec = (suseconds_t)((timeout_ms % 1000) * 1000);
+    setsockopt(fd, SOL_SOCKET, option, &tv, sizeof(tv));
+}
+
+int iot_transport_open(void** ctx, const char* host, const char* port)
+{
+    return iot_transport_open_with(ctx, host, port, NULL);
+}
+
+int iot_transport_open_with(void** ctx, const char* host, const char* port, const struct iot_transport_config* config)
+{
+    struct iot_transport_config defaults;
+    struct transport_addrs resolved;
+    struct transport_addr ordered[TRANSPORT_MAX_ADDRS];
+
+    if (ctx == NULL || host == NULL || port == NULL) {
+        return -1;
+    }
+    *ctx = NULL;
+    if (config == NULL) {
+        iot_transport_config_default(&defaults);
+        config = &defaults;
+    }
+
+    // Hosts served by an in-memory loopback listener never reach DNS
+    struct loopback_end* end = NULL;
+    int loopback = loopback_connect(host, port, config, &end);
+    if (loopback != 0) {
+        struct iot_transport_socket* sock = loopback > 0 ? (struct iot_transport_socket*)calloc(1, sizeof(struct iot_transport_socket)) : NULL;
+        if (sock == NULL) {
+            if (end != NULL) {
+                loopback_close(end);
+            }
+            return -1;
+        }
+        sock->fd = -1;
+        sock->loopback = end;
+        *ctx = sock;
+        return 0;
+    }
+
+    if (resolve(host, port, config->dns_cache_ttl_ms, &resolved) != 0) {
+        return -1;
+    }
+    order_addrs(&resolved, ordered);
+
+    int family = 0;
+    int fd = connect_race(ordered, resolved.count, config, &family);
+    if (fd < 0) {
+        return fd;
+    }
+    if (family != resolved.preferred_family) {
+        remember_family(host, port, family);
+    }
+
+    // Back to blocking I/O, bounded by the socket timeouts
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    set_timeout(fd, SO_SNDTIMEO, config->send_timeout_ms);
+    set_timeout(fd, SO_RCVTIMEO, config->recv_timeout_ms);
+
+    struct iot_transport_socket* sock = (struct iot_transport_socket*)malloc(sizeof(struct iot_transport_socket));
+    if (sock == NULL) {
+        close(fd);
+        return -1;
+    }
+    sock->fd = fd;
+    sock->loopback = NULL;
+    sock->send_timeout_ms = config->send_timeout_ms;
+    sock->zerocopy_threshold = 0;
+    sock->zerocopy_sent = 0;
+    sock->zerocopy_done = 0;
+#if TRANSPORT_ZEROCOPY
+    int on = 1;
+    if (config->zerocopy_threshold != 0 && setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0) {
+        sock->zerocopy_threshold = config->zerocopy_threshold;
+    }
+#endif
+    *ctx = sock;
+    return 0;
+}
+
+void iot_transport_close(void* ctx)
+{
+    struct iot_transport_socket* sock = (struct iot_transport_socket*)ctx;
+    if (sock != NULL) {
+        if (sock->loopback != NULL) {
+            loopback_close(sock->loopback);
+        } else {
+            close(sock->fd);
+        }
+        free(sock);
+    }
+}
+
+#if TRANSPORT_ZEROCOPY
+/*
+ * Wait until the kernel has released every buffer of the zero-copy sends
+ * issued so far; completions arrive on the socket error queue. If the
+ * kernel reports that it had to copy anyway (loopback, no NIC support),
+ * zero-copy is turned off for this socket.
+ */
+static int zerocopy_wait(struct iot_transport_socket* sock)
+{
+    uint64_t deadline = sock->send_timeout_ms != 0 ? now_ms() + sock->send_timeout_ms : UINT64_MAX;
+
+    while (sock->zerocopy_done != sock->zerocopy_sent) {
+        uint64_t now = now_ms();
+        if (now >= deadline) {
+            return IOT_TRANSPORT_TIMEOUT;
+        }
+        struct pollfd pfd = { sock->fd, 0, 0 }; // POLLERR is always reported
+        int ready = poll(&pfd, 1, deadline == UINT64_MAX ? -1 : (int)(deadline - now));
+        if (ready < 0 && errno != EINTR) {
+            return -1;
+        }
+        if (ready <= 0) {
+            continue;
+        }
+
+        char control[128];
+        struct msghdr msg = { 0 };
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(sock->fd, &msg, MSG_ERRQUEUE) < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (!((cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_RECVERR)
+                    || (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+            struct sock_extended_err err;
+            memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+            if (err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            // Completions cover the range of send calls [ee_info, ee_data]
+            sock->zerocopy_done = err.ee_data + 1;
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                sock->zerocopy_threshold = 0;
+            }
+        }
+    }
+    return 0;
+}
+#endif
+
+int iot_transport_sendv(void* ctx, const struct iot_transport_iovec* iov, size_t count)
+{
+    struct iot_transport_socket* sock = (struct iot_transport_socket*)ctx;
+    struct iovec vec[TRANSPORT_MAX_IOV];
+    size_t total = 0;
+    size_t sent = 0;
+    size_t index = 0;
+    size_t offset = 0; // Bytes of iov[index] already sent
+
+    if (sock == NULL || (iov == NULL && count != 0)) {
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (iov[i].base == NULL && iov[i].length != 0) {
+            return -1;
+        }
+        total += iov[i].length;
+        if (total > INT_MAX) {
+            return -1;
+        }
+    }
+    if (sock->loopback != NULL) {
+        return loopback_sendv(sock->loopback, iov, count, total);
+    }
+
+    int flags = MSG_NOSIGNAL;
+#if TRANSPORT_ZEROCOPY
+    bool zerocopy = sock->zerocopy_threshold != 0 && total >= sock->zerocopy_threshold;
+    if (zerocopy) {
+        flags |= MSG_ZEROCOPY;
+    }
+#endif
+
+    int ret = 0;
+    while (sent < total) {
+        int n = 0;
+        for (size_t i = index; i < count && n < TRANSPORT_MAX_IOV; i++) {
+            size_t skip = i == index ? offset : 0;
+            if (iov[i].length > skip) {
+                vec[n].iov_base = (void*)((const unsigned char*)iov[i].base + skip);
+                vec[n].iov_len = iov[i].length - skip;
+                n++;
+            }
+        }
+
+        struct msghdr msg = { 0 };
+        msg.msg_iov = vec;
+        msg.msg_iovlen = (size_t)n;
+        ssize_t written = sendmsg(sock->fd, &msg, flags);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+#if TRANSPORT_ZEROCOPY
+            if (errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+                flags &= ~MSG_ZEROCOPY; // Out of option memory for pinned pages: copy instead
+                continue;
+            }
+#endif
+            ret = (errno == EAGAIN || errno == EWOULDBLOCK) ? IOT_TRANSPORT_TIMEOUT : -1;
+            break;
+        }
+#if TRANSPORT_ZEROCOPY
+        if (flags & MSG_ZEROCOPY) {
+            sock->zerocopy_sent++;
+        }
+#endif
+
+        // Advance past what the kernel took
+        sent += (size_t)written;
+        size_t advance = (size_t)written;
+        while (index < count && advance >= iov[index].length - offset) {
+            advance -= iov[index].length - offset;
+            index++;
+            offset = 0;
+        }
+        offset += advance;
+    }
+
+#if TRANSPORT_ZEROCOPY
+    if (zerocopy) {
+        int wait = zerocopy_wait(sock);
+        if (wait != 0) {
+            return wait; // The kernel may still read the buffers
+        }
+    }
+#endif
+    return sent > 0 || total == 0 ? (int)sent : ret;
+}
+
+int iot_transport_send(void* ctx, const unsigned char* buf, size_t len)
+{
+    struct iot_transport_iovec iov = { buf, len > INT_MAX ? INT_MAX : len };
+
+    if (buf == NULL && len != 0) {
+        return -1;
+    }
+    return iot_transport_sendv(ctx, &iov, 1);
+}
+
+int iot_transport_recv(void* ctx, unsigned char* buf, size_t len)
+{
+    struct iot_transport_socket* sock = (struct iot_transport_socket*)ctx;
+
+    if (sock == NULL || buf == NULL) {
+        return -1;
+    }
+    if (len > INT_MAX) {
+        len = INT_MAX;
+    }
+    if (sock->loopback != NULL) {
+        return loopback_recv(sock->loopback, buf, len);
+    }
+    for (;;) {
+        ssize_t n = recv(sock->fd, buf, len, 0);
+        if (n >= 0) {
+            return (int)n;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? IOT_TRANSPORT_TIMEOUT : -1;
+    }
+}
+
+int iot_transport_add_host(const char* host, const char* addresses)
+{
+    if (host == NULL || host[0] == '\0' || strlen(host) >= TRANSPORT_HOST_SIZE
+        || (addresses != NULL && strlen(addresses) >= TRANSPORT_PINNED_SIZE)) {
+        return -1;
+    }
+
+    int ret = addresses == NULL ? 0 : -1;
+    pthread_mutex_lock(&dns_lock);
+    struct pinned_host* slot = NULL;
+    for (int i = 0; i < TRANSPORT_PINNED_HOSTS; i++) {
+        if (strcmp(pinned_hosts[i].host, host) == 0) {
+            slot = &pinned_hosts[i];
+            break;
+        }
+        if (slot == NULL && pinned_hosts[i].host[0] == '\0') {
+            slot = &pinned_hosts[i];
+        }
+    }
+    if (addresses == NULL) {
+        if (slot != NULL && strcmp(slot->host, host) == 0) {
+            memset(slot, 0, sizeof(*slot));
+        }
+    } else if (slot != NULL) {
+        strcpy(slot->host, host);
+        strcpy(slot->addresses, addresses);
+        slot->preferred_family = 0;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&dns_lock);
+    return ret;
+}
+
+void iot_transport_flush_dns(void)
+{
+    pthread_mutex_lock(&dns_lock);
+    memset(dns_cache, 0, sizeof(dns_cache));
+    pthread_mutex_unlock(&dns_lock);
+}
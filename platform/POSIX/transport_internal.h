@@ -0,0 +1,28 @@
+#ifndef IOT_POSIX_TRANSPORT_INTERNAL_H
+#define IOT_POSIX_TRANSPORT_INTERNAL_H
+
+#include "interface/transport.h"
+#include <stdint.h>
+
+// One side of an in-memory loopback connection
+struct loopback_end;
+
+// Connection context handed out by iot_transport_open and iot_loopback_accept
+struct iot_transport_socket {
+    int fd; // -1 for loopback connections
+    struct loopback_end* loopback;
+    uint32_t send_timeout_ms;
+    size_t zerocopy_threshold; // 0 when MSG_ZEROCOPY is off or unsupported
+    uint32_t zerocopy_sent; // Zero-copy sendmsg calls issued
+    uint32_t zerocopy_done; // Of those, calls the kernel has released
+};
+
+// Connect to a loopback listener; return 1 if connected, 0 if host:port has none, -1 on error
+int loopback_connect(const char* host, const char* port, const struct iot_transport_config* config, struct loopback_end** end);
+
+// Loopback counterparts of iot_transport_sendv/recv/close
+int loopback_sendv(struct loopback_end* end, const struct iot_transport_iovec* iov, size_t count, size_t total);
+int loopback_recv(struct loopback_end* end, unsigned char* buf, size_t len);
+void loopback_close(struct loopback_end* end);
+
+#endif // IOT_POSIX_TRANSPORT_INTERNAL_H
@@ -0,0 +1,653 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "os_internal.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Each worker owns a Chase-Lev deque (Le et al., "Correct and Efficient
+ * Work-Stealing for Weak Memory Models"): the owner pushes and takes at the
+ * bottom without locking, thieves take from the top with one CAS. Tasks
+ * from threads outside the queue go on a locked injection list that idle
+ * workers drain. A worker that finds nothing spins through a few steal
+ * rounds, then sleeps until the next push. Pushers only touch the sleep
+ * lock when someone is asleep, which they learn from a counter read after
+ * a full fence; sleepers bump that counter and rescan before waiting, so
+ * either side sees the other.
+ */
+
+#define DEQUE_INITIAL_SIZE 256
+#define IDLE_SPINS 64
+
+struct wq_task;
+typedef void (*wq_run_func)(struct wq_task* task);
+
+struct wq_task {
+    wq_run_func run;
+    iot_task_func_t func;
+    void* arg;
+    struct iot_task_group* group;
+    // Parallel for pieces
+    const struct pfor_job* job;
+    size_t begin;
+    size_t end;
+    // Injection list link
+    struct wq_task* next;
+};
+
+struct deque_array {
+    int64_t mask;
+    struct deque_array* retired;
+    _Atomic(struct wq_task*) slots[];
+};
+
+struct wq_deque {
+    _Alignas(64) atomic_int_fast64_t top;
+    _Alignas(64) atomic_int_fast64_t bottom;
+    _Atomic(struct deque_array*) array;
+};
+
+struct wq_worker {
+    struct wq_deque deque;
+    struct iot_workqueue* wq;
+    struct iot_thread* thread;
+    uint32_t index;
+    uint32_t rng;
+};
+
+struct iot_workqueue {
+    struct wq_worker* workers;
+    uint32_t worker_count;
+    atomic_bool stopping;
+
+    pthread_mutex_t inject_lock;
+    struct wq_task* inject_head;
+    struct wq_task* inject_tail;
+    atomic_size_t inject_count;
+
+    _Alignas(64) atomic_uint sleepers;
+    atomic_uint_fast64_t epoch;
+    pthread_mutex_t sleep_lock;
+    pthread_cond_t sleep_cond;
+};
+
+struct iot_task_group {
+    struct iot_workqueue* wq;
+    atomic_size_t pending;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+};
+
+struct pfor_job {
+    iot_range_func_t func;
+    void* arg;
+    size_t grain;
+};
+
+static _Thread_local struct wq_worker* current_worker;
+
+// The calling thread's worker if it belongs to wq
+static struct wq_worker* worker_of(struct iot_workqueue* wq)
+{
+    struct wq_worker* worker = current_worker;
+    return worker != NULL && worker->wq == wq ? worker : NULL;
+}
+
+static struct deque_array* deque_array_new(int64_t size)
+{
+    struct deque_array* array = (struct deque_array*)malloc(sizeof(struct deque_array) + (size_t)size * sizeof(array->slots[0]));
+    if (array == NULL) {
+        return NULL;
+    }
+    array->mask = size - 1;
+    array->retired = NULL;
+    for (int64_t i = 0; i < size; i++) {
+        atomic_init(&array->slots[i], NULL);
+    }
+    return array;
+}
+
+static int deque_init(struct wq_deque* deque)
+{
+    struct deque_array* array = deque_array_new(DEQUE_INITIAL_SIZE);
+    if (array == NULL) {
+        return -1;
+    }
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    atomic_init(&deque->array, array);
+    return 0;
+}
+
+static void deque_free(struct wq_deque* deque)
+{
+    struct deque_array* array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+    while (array != NULL) {
+        struct deque_array* retired = array->retired;
+        free(array);
+        array = retired;
+    }
+}
+
+// Owner only. Thieves may still read the old array, so it is kept until the queue is destroyed
+static int deque_push(struct wq_deque* deque, struct wq_task* task)
+{
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    struct deque_array* array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+    if (bottom - top > array->mask) {
+        struct deque_array* grown = deque_array_new((array->mask + 1) * 2);
+        if (grown == NULL) {
+            return -1;
+        }
+        for (int64_t i = top; i < bottom; i++) {
+            struct wq_task* moved = atomic_load_explicit(&array->slots[i & array->mask], memory_order_relaxed);
+            atomic_store_explicit(&grown->slots[i & grown->mask], moved, memory_order_relaxed);
+        }
+        grown->retired = array;
+        atomic_store_explicit(&deque->array, grown, memory_order_release);
+        array = grown;
+    }
+    atomic_store_explicit(&array->slots[bottom & array->mask], task, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_release);
+    return 0;
+}
+
+// Owner only; takes the most recently pushed task
+static struct wq_task* deque_take(struct wq_deque* deque)
+{
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    struct deque_array* array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+    if (top > bottom) {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+    struct wq_task* task = atomic_load_explicit(&array->slots[bottom & array->mask], memory_order_relaxed);
+    if (top == bottom) {
+        // Last task: race the thieves for it
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed)) {
+            task = NULL;
+        }
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+// Any thread; takes the oldest task, NULL when empty or on a lost race
+static struct wq_task* deque_steal(struct wq_deque* deque)
+{
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (top >= bottom) {
+        return NULL;
+    }
+    struct deque_array* array = atomic_load_explicit(&deque->array, memory_order_acquire);
+    struct wq_task* task = atomic_load_explicit(&array->slots[top & array->mask], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL;
+    }
+    return task;
+}
+
+static bool deque_empty(struct wq_deque* deque)
+{
+    return atomic_load_explicit(&deque->top, memory_order_acquire) >= atomic_load_explicit(&deque->bottom, memory_order_acquire);
+}
+
+static void wake_sleepers(struct iot_workqueue* wq)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&wq->sleepers, memory_order_relaxed) == 0) {
+        return;
+    }
+    pthread_mutex_lock(&wq->sleep_lock);
+    atomic_fetch_add_explicit(&wq->epoch, 1, memory_order_relaxed);
+    pthread_cond_signal(&wq->sleep_cond);
+    pthread_mutex_unlock(&wq->sleep_lock);
+}
+
+static void inject(struct iot_workqueue* wq, struct wq_task* task)
+{
+    task->next = NULL;
+    pthread_mutex_lock(&wq->inject_lock);
+    if (wq->inject_tail != NULL) {
+        wq->inject_tail->next = task;
+    } else {
+        wq->inject_head = task;
+    }
+    wq->inject_tail = task;
+    atomic_fetch_add_explicit(&wq->inject_count, 1, memory_order_release);
+    pthread_mutex_unlock(&wq->inject_lock);
+}
+
+static struct wq_task* take_injected(struct iot_workqueue* wq)
+{
+    if (atomic_load_explicit(&wq->inject_count, memory_order_acquire) == 0) {
+        return NULL;
+    }
+    pthread_mutex_lock(&wq->inject_lock);
+    struct wq_task* task = wq->inject_head;
+    if (task != NULL) {
+        wq->inject_head = task->next;
+        if (wq->inject_head == NULL) {
+            wq->inject_tail = NULL;
+        }
+        atomic_fetch_sub_explicit(&wq->inject_count, 1, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&wq->inject_lock);
+    return task;
+}
+
+// Pushes onto the caller's deque when it is one of wq's workers, else injects
+static int enqueue(struct iot_workqueue* wq, struct wq_task* task)
+{
+    struct wq_worker* worker = worker_of(wq);
+    if (worker != NULL) {
+        if (deque_push(&worker->deque, task) != 0) {
+            return -1;
+        }
+    } else {
+        inject(wq, task);
+    }
+    wake_sleepers(wq);
+    return 0;
+}
+
+static uint32_t next_random(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+// One sweep over the other workers from a random start, then the injection list
+static struct wq_task* steal_any(struct iot_workqueue* wq, struct wq_worker* self, uint32_t* rng)
+{
+    uint32_t count = wq->worker_count;
+    uint32_t start = next_random(rng) % count;
+    for (uint32_t i = 0; i < count; i++) {
+        struct wq_worker* victim = &wq->workers[(start + i) % count];
+        if (victim == self) {
+            continue;
+        }
+        struct wq_task* task = deque_steal(&victim->deque);
+        if (task != NULL) {
+            return task;
+        }
+    }
+    return take_injected(wq);
+}
+
+static struct wq_task* find_task(struct iot_workqueue* wq, struct wq_worker* self, uint32_t* rng)
+{
+    if (self != NULL) {
+        struct wq_task* task = deque_take(&self->deque);
+        if (task != NULL) {
+            return task;
+        }
+    }
+    return steal_any(wq, self, rng);
+}
+
+static bool work_visible(struct iot_workqueue* wq)
+{
+    if (atomic_load_explicit(&wq->inject_count, memory_order_acquire) != 0) {
+        return true;
+    }
+    for (uint32_t i = 0; i < wq->worker_count; i++) {
+        if (!deque_empty(&wq->workers[i].deque)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The last decrement happens under the lock, so once a waiter has taken the
+// lock after seeing pending reach zero, nothing touches the group again
+static void group_finish(struct iot_task_group* group)
+{
+    size_t pending = atomic_load_explicit(&group->pending, memory_order_acquire);
+    for (;;) {
+        if (pending == 1) {
+            pthread_mutex_lock(&group->lock);
+            atomic_fetch_sub_explicit(&group->pending, 1, memory_order_acq_rel);
+            pthread_cond_broadcast(&group->done);
+            pthread_mutex_unlock(&group->lock);
+            return;
+        }
+        if (atomic_compare_exchange_weak_explicit(&group->pending, &pending, pending - 1, memory_order_acq_rel, memory_order_acquire)) {
+            return;
+        }
+    }
+}
+
+static void run_task(struct wq_task* task)
+{
+    struct iot_task_group* group = task->group;
+    task->run(task);
+    free(task);
+    if (group != NULL) {
+        group_finish(group);
+    }
+}
+
+static void run_plain(struct wq_task* task)
+{
+    task->func(task->arg);
+}
+
+static void worker_main(void* arg)
+{
+    struct wq_worker* self = (struct wq_worker*)arg;
+    struct iot_workqueue* wq = self->wq;
+    current_worker = self;
+
+    for (;;) {
+        struct wq_task* task = NULL;
+        for (int spin = 0; spin < IDLE_SPINS && task == NULL; spin++) {
+            task = find_task(wq, self, &self->rng);
+            if (task == NULL) {
+                os_cpu_relax();
+            }
+        }
+        if (task != NULL) {
+            run_task(task);
+            continue;
+        }
+
+        // Announce the sleep, then look once more so a concurrent push is not missed
+        pthread_mutex_lock(&wq->sleep_lock);
+        uint_fast64_t epoch = atomic_load_explicit(&wq->epoch, memory_order_relaxed);
+        atomic_fetch_add_explicit(&wq->sleepers, 1, memory_order_seq_cst);
+        atomic_thread_fence(memory_order_seq_cst);
+        bool stop = false;
+        if (!work_visible(wq)) {
+            stop = atomic_load(&wq->stopping);
+            while (!stop && atomic_load_explicit(&wq->epoch, memory_order_relaxed) == epoch) {
+                pthread_cond_wait(&wq->sleep_cond, &wq->sleep_lock);
+                stop = atomic_load(&wq->stopping);
+            }
+        }
+        atomic_fetch_sub_explicit(&wq->sleepers, 1, memory_order_relaxed);
+        pthread_mutex_unlock(&wq->sleep_lock);
+        if (stop && !work_visible(wq)) {
+            break;
+        }
+    }
+    current_worker = NULL;
+}
+
+struct iot_workqueue* iot_workqueue_create(const char* name, uint32_t workers, uint32_t stack_size)
+{
+    if (workers == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = online > 0 ? (uint32_t)online : 1;
+    }
+    struct iot_workqueue* wq = (struct iot_workqueue*)calloc(1, sizeof(struct iot_workqueue));
+    if (wq == NULL) {
+        return NULL;
+    }
+    wq->workers = (struct wq_worker*)aligned_alloc(64, ((workers * sizeof(struct wq_worker) + 63) / 64) * 64);
+    if (wq->workers == NULL) {
+        free(wq);
+        return NULL;
+    }
+    memset(wq->workers, 0, workers * sizeof(struct wq_worker));
+    pthread_mutex_init(&wq->inject_lock, NULL);
+    pthread_mutex_init(&wq->sleep_lock, NULL);
+    pthread_cond_init(&wq->sleep_cond, NULL);
+
+    for (uint32_t i = 0; i < workers; i++) {
+        struct wq_worker* worker = &wq->workers[i];
+        worker->wq = wq;
+        worker->index = i;
+        worker->rng = 0x9e3779b9u * (i + 1);
+        if (deque_init(&worker->deque) != 0) {
+            wq->worker_count = i;
+            iot_workqueue_destroy(wq);
+            return NULL;
+        }
+    }
+    wq->worker_count = workers;
+    for (uint32_t i = 0; i < workers; i++) {
+        struct wq_worker* worker = &wq->workers[i];
+        worker->thread = iot_thread_create(name != NULL ? name : "iot_workqueue", worker_main, worker, 0, stack_size, 0);
+        if (worker->thread == NULL) {
+            iot_workqueue_destroy(wq);
+            return NULL;
+        }
+    }
+    return wq;
+}
+
+int iot_workqueue_destroy(struct iot_workqueue* wq)
+{
+    if (wq == NULL || worker_of(wq) != NULL) {
+        return -1;
+    }
+    pthread_mutex_lock(&wq->sleep_lock);
+    atomic_store(&wq->stopping, true);
+    pthread_cond_broadcast(&wq->sleep_cond);
+    pthread_mutex_unlock(&wq->sleep_lock);
+
+    for (uint32_t i = 0; i < wq->worker_count; i++) {
+        if (wq->workers[i].thread != NULL) {
+            iot_thread_join(wq->workers[i].thread, NULL);
+        }
+    }
+    // Only left over when a worker failed to start
+    struct wq_task* task;
+    while ((task = take_injected(wq)) != NULL) {
+        run_task(task);
+    }
+    for (uint32_t i = 0; i < wq->worker_count; i++) {
+        deque_free(&wq->workers[i].deque);
+    }
+    pthread_cond_destroy(&wq->sleep_cond);
+    pthread_mutex_destroy(&wq->sleep_lock);
+    pthread_mutex_destroy(&wq->inject_lock);
+    free(wq->workers);
+    free(wq);
+    return 0;
+}
+
+uint32_t iot_workqueue_workers(const struct iot_workqueue* wq)
+{
+    return wq != NULL ? wq->worker_count : 0;
+}
+
+static struct wq_task* task_new(wq_run_func run, iot_task_func_t func, void* arg, struct iot_task_group* group)
+{
+    struct wq_task* task = (struct wq_task*)malloc(sizeof(struct wq_task));
+    if (task == NULL) {
+        return NULL;
+    }
+    task->run = run;
+    task->func = func;
+    task->arg = arg;
+    task->group = group;
+    task->job = NULL;
+    task->begin = 0;
+    task->end = 0;
+    return task;
+}
+
+int iot_workqueue_submit(struct iot_workqueue* wq, iot_task_func_t func, void* arg)
+{
+    if (wq == NULL || func == NULL) {
+        return -1;
+    }
+    struct wq_task* task = task_new(run_plain, func, arg, NULL);
+    if (task == NULL) {
+        return -1;
+    }
+    if (enqueue(wq, task) != 0) {
+        free(task);
+        return -1;
+    }
+    return 0;
+}
+
+struct iot_task_group* iot_task_group_create(struct iot_workqueue* wq)
+{
+    if (wq == NULL) {
+        return NULL;
+    }
+    struct iot_task_group* group = (struct iot_task_group*)calloc(1, sizeof(struct iot_task_group));
+    if (group == NULL) {
+        return NULL;
+    }
+    group->wq = wq;
+    pthread_mutex_init(&group->lock, NULL);
+    pthread_cond_init(&group->done, NULL);
+    return group;
+}
+
+static int group_enqueue(struct iot_task_group* group, struct wq_task* task)
+{
+    atomic_fetch_add_explicit(&group->pending, 1, memory_order_relaxed);
+    if (enqueue(group->wq, task) != 0) {
+        atomic_fetch_sub_explicit(&group->pending, 1, memory_order_relaxed);
+        return -1;
+    }
+    return 0;
+}
+
+int iot_task_group_run(struct iot_task_group* group, iot_task_func_t func, void* arg)
+{
+    if (group == NULL || func == NULL) {
+        return -1;
+    }
+    struct wq_task* task = task_new(run_plain, func, arg, group);
+    if (task == NULL) {
+        return -1;
+    }
+    if (group_enqueue(group, task) != 0) {
+        free(task);
+        return -1;
+    }
+    return 0;
+}
+
+int iot_task_group_wait(struct iot_task_group* group)
+{
+    if (group == NULL) {
+        return -1;
+    }
+    struct iot_workqueue* wq = group->wq;
+    struct wq_worker* self = worker_of(wq);
+    uint32_t local_rng = 0x2545f491u ^ (uint32_t)(uintptr_t)group;
+    uint32_t* rng = self != NULL ? &self->rng : &local_rng;
+
+    while (atomic_load_explicit(&group->pending, memory_order_acquire) != 0) {
+        // Help: any queued task may be one this group is waiting on
+        struct wq_task* task = NULL;
+        for (int spin = 0; spin < IDLE_SPINS && task == NULL; spin++) {
+            if (atomic_load_explicit(&group->pending, memory_order_acquire) == 0) {
+                return 0;
+            }
+            task = find_task(wq, self, rng);
+            if (task == NULL) {
+                os_cpu_relax();
+            }
+        }
+        if (task != NULL) {
+            run_task(task);
+            continue;
+        }
+
+        // The remaining tasks are running elsewhere
+        pthread_mutex_lock(&group->lock);
+        if (atomic_load_explicit(&group->pending, memory_order_acquire) != 0 && !work_visible(wq)) {
+            pthread_cond_wait(&group->done, &group->lock);
+        }
+        pthread_mutex_unlock(&group->lock);
+    }
+    return 0;
+}
+
+void iot_task_group_destroy(struct iot_task_group* group)
+{
+    if (group == NULL) {
+        return;
+    }
+    iot_task_group_wait(group);
+    // The last task to finish may still hold the lock
+    pthread_mutex_lock(&group->lock);
+    pthread_mutex_unlock(&group->lock);
+    pthread_cond_destroy(&group->done);
+    pthread_mutex_destroy(&group->lock);
+    free(group);
+}
+
+// Splits off the upper half until the piece fits the grain, then runs it
+static void pfor_split(struct iot_task_group* group, const struct pfor_job* job, size_t begin, size_t end);
+
+static void run_range(struct wq_task* task)
+{
+    pfor_split(task->group, task->job, task->begin, task->end);
+}
+
+static void pfor_split(struct iot_task_group* group, const struct pfor_job* job, size_t begin, size_t end)
+{
+    while (end - begin > job->grain) {
+        size_t middle = begin + (end - begin) / 2;
+        struct wq_task* task = task_new(run_range, NULL, NULL, group);
+        if (task == NULL) {
+            break;
+        }
+        task->job = job;
+        task->begin = middle;
+        task->end = end;
+        if (group_enqueue(group, task) != 0) {
+            // Out of memory: run the rest here
+            free(task);
+            break;
+        }
+        end = middle;
+    }
+    job->func(job->arg, begin, end);
+}
+
+int iot_workqueue_parallel_for(struct iot_workqueue* wq, size_t begin, size_t end, size_t grain,
+    iot_range_func_t func, void* arg)
+{
+    if (wq == NULL || func == NULL || end < begin) {
+        return -1;
+    }
+    if (begin == end) {
+        return 0;
+    }
+    if (grain == 0) {
+        // About eight pieces per worker leaves room to rebalance
+        grain = (end - begin) / ((size_t)wq->worker_count * 8);
+        grain = grain == 0 ? 1 : grain;
+    }
+    struct pfor_job job = { func, arg, grain };
+    struct iot_task_group group;
+    memset(&group, 0, sizeof(group));
+    group.wq = wq;
+    pthread_mutex_init(&group.lock, NULL);
+    pthread_cond_init(&group.done, NULL);
+
+    pfor_split(&group, &job, begin, end);
+    iot_task_group_wait(&group);
+
+    pthread_mutex_lock(&group.lock);
+    pthread_mutex_unlock(&group.lock);
+    pthread_cond_destroy(&group.done);
+    pthread_mutex_destroy(&group.lock);
+    return 0;
+}
@@ -1,11 +1,14 @@
 #include "connectivity/http_client.h"
 #include "core_http_client.h"
 #include "interface/transport.h"
+#include "system/pool.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define MAX_URL_LENGTH 256
 #define MAX_HEADERS 20
+#define HEADER_BUFFER_LENGTH 1024
 #define DEFAULT_TIMEOUT_MS 5000
 
 // Define the NetworkContext structure
@@ -18,12 +21,16 @@ typedef struct {
     char base_url[MAX_URL_LENGTH];
     char host[128];
     char port[8];
+    char base_path[MAX_URL_LENGTH]; // Path of the base URL, without a trailing '/'
     const char* headers[MAX_HEADERS];
     size_t header_count;
     TransportInterface_t transport_interface;
     HTTPRequestHeaders_t request_headers;
     HTTPResponse_t response;
     struct NetworkContext network_context;
+    bool cork; // Hold back the request headers and send them with the body
+    const void* corked; // Held-back headers, still owned by coreHTTP
+    size_t corked_length;
 } IotHttpContext_t;
 
 static IotHttpContext_t* http_ctx = NULL;
@@ -37,11 +44,36 @@ static int32_t transport_recv(NetworkContext_t* pNetworkContext, void* pBuffer,
     return iot_transport_recv(pNetworkContext->impl, pBuffer, bytesToRecv);
 }
 
+/*
+ * coreHTTP sends the request headers and then the body in two calls. While
+ * corked, the headers are only remembered, and both leave in one vectored
+ * write straight from coreHTTP's header buffer and the caller's payload.
+ */
 static int32_t transport_send(NetworkContext_t* pNetworkContext, const void* pBuffer, size_t bytesToSend)
 {
     if (pNetworkContext == NULL) {
         return -1;
     }
+    if (http_ctx != NULL && http_ctx->cork) {
+        if (http_ctx->corked == NULL) {
+            http_ctx->corked = pBuffer;
+            http_ctx->corked_length = bytesToSend;
+            return (int32_t)bytesToSend;
+        }
+
+        struct iot_transport_iovec iov[2] = {
+            { http_ctx->corked, http_ctx->corked_length },
+            { pBuffer, bytesToSend }
+        };
+        size_t header_length = http_ctx->corked_length;
+        http_ctx->cork = false;
+        http_ctx->corked = NULL;
+        int ret = iot_transport_sendv(pNetworkContext->impl, iov, 2);
+        if (ret < 0 || (size_t)ret < header_length) {
+            return -1; // The headers were already reported as sent
+        }
+        return (int32_t)((size_t)ret - header_length);
+    }
     return iot_transport_send(pNetworkContext->impl, pBuffer, bytesToSend);
 }
 
@@ -99,11 +131,38 @@ int iot_http_set_url(const char* url)
     strncpy(http_ctx->base_url, url, MAX_URL_LENGTH - 1);
     http_ctx->base_url[MAX_URL_LENGTH - 1] = '\0';
 
+    http_ctx->base_path[0] = '\0';
+    if (path_start != NULL) {
+        size_t path_len = strlen(path_start);
+        while (path_len > 0 && path_start[path_len - 1] == '/') {
+            path_len--;
+        }
+        if (path_len >= MAX_URL_LENGTH) {
+            return -1;
+        }
+        memcpy(http_ctx->base_path, path_start, path_len);
+        http_ctx->base_path[path_len] = '\0';
+    }
+
     return iot_transport_open(&http_ctx->network_context.impl,
         http_ctx->host,
         http_ctx->port);
 }
 
+// Add a "Key: Value" header string to a request
+static HTTPStatus_t add_header(HTTPRequestHeaders_t* request_headers, const char* header)
+{
+    const char* colon = strchr(header, ':');
+    if (colon == NULL || colon == header) {
+        return HTTPInvalidParameter;
+    }
+    const char* value = colon + 1;
+    while (*value == ' ') {
+        value++;
+    }
+    return HTTPClient_AddHeader(request_headers, header, (size_t)(colon - header), value, strlen(value));
+}
+
 static int perform_http_request(const char* method,
     const char* path,
     const uint8_t* payload,
@@ -111,41 +170,69 @@ static int perform_http_request(const char* method,
     char* response,
     size_t response_length)
 {
-    if (http_ctx == NULL) {
+    if (http_ctx == NULL || path == NULL) {
+        return -1;
+    }
+
+    // Resolve the path against the base URL
+    char full_path[2 * MAX_URL_LENGTH];
+    int path_length = snprintf(full_path, sizeof(full_path), "%s%s%s",
+        http_ctx->base_path, path[0] == '/' ? "" : "/", path);
+    if (path_length < 0 || (size_t)path_length >= sizeof(full_path)) {
         return -1;
     }
 
     // Prepare request headers buffer
-    uint8_t* header_buffer = (uint8_t*)malloc(1024);
+    uint8_t* header_buffer = (uint8_t*)iot_pool_alloc(HEADER_BUFFER_LENGTH);
     if (header_buffer == NULL) {
         return -1;
     }
 
     HTTPRequestHeaders_t request_headers = {
         .pBuffer = header_buffer,
-        .bufferLen = 1024,
+        .bufferLen = HEADER_BUFFER_LENGTH,
         .headersLen = 0
     };
 
+    // Keep the connection open: it is opened once, in iot_http_set_url
+    HTTPRequestInfo_t request_info = {
+        .pMethod = method,
+        .methodLen = strlen(method),
+        .pPath = full_path,
+        .pathLen = (size_t)path_length,
+        .pHost = http_ctx->host,
+        .hostLen = strlen(http_ctx->host),
+        .reqFlags = HTTP_REQUEST_KEEP_ALIVE_FLAG
+    };
+
+    HTTPStatus_t status = HTTPClient_InitializeRequestHeaders(&request_headers, &request_info);
+    for (size_t i = 0; status == HTTPSuccess && i < http_ctx->header_count; i++) {
+        status = add_header(&request_headers, http_ctx->headers[i]);
+    }
+
     // Prepare response structure
     HTTPResponse_t http_response = {
         .pBuffer = (uint8_t*)response,
-        .bufferLen = response_length,
-        .pHeaders = header_buffer, // Reuse header buffer for response headers
-        .headersLen = 1024
+        .bufferLen = response_length
     };
 
-    // Send the request using CoreHTTP's API
-    HTTPStatus_t status = HTTPClient_Send(
-        &http_ctx->transport_interface,
-        &request_headers,
-        payload,
-        payload_length,
-        &http_response,
-        0 // No special flags
-    );
-
-    free(header_buffer);
+    // Send the request using CoreHTTP's API, with headers and body in one write
+    if (status == HTTPSuccess) {
+        http_ctx->cork = payload_length > 0;
+        http_ctx->corked = NULL;
+        status = HTTPClient_Send(
+            &http_ctx->transport_interface,
+            &request_headers,
+            payload,
+            payload_length,
+            &http_response,
+            0 // No special flags
+        );
+        http_ctx->cork = false;
+        http_ctx->corked = NULL;
+    }
+
+    iot_pool_free(header_buffer);
     return (status == HTTPSuccess) ? 0 : -1;
 }
 
@@ -177,12 +264,18 @@ int iot_http_set_headers(const char* headers[], size_t header_count)
         return -1;
     }
 
+    // Replace any headers set before
+    for (size_t i = 0; i < http_ctx->header_count; i++) {
+        iot_pool_free((void*)http_ctx->headers[i]);
+    }
+    http_ctx->header_count = 0;
+
     for (size_t i = 0; i < header_count; i++) {
-        http_ctx->headers[i] = strdup(headers[i]);
+        http_ctx->headers[i] = iot_pool_strdup(headers[i]);
         if (http_ctx->headers[i] == NULL) {
             // Clean up on failure
             for (size_t j = 0; j < i; j++) {
-                free((void*)http_ctx->headers[j]);
+                iot_pool_free((void*)http_ctx->headers[j]);
             }
             return -1;
         }
@@ -200,7 +293,7 @@ int iot_http_cleanup(void)
 
     // Clean up headers
     for (size_t i = 0; i < http_ctx->header_count; i++) {
-        free((void*)http_ctx->headers[i]);
+        iot_pool_free((void*)http_ctx->headers[i]);
     }
 
     // Close transport
@@ -1,10 +1,13 @@
 #include "connectivity/mqtts_client.h"
 #include "interface/clock.h"
 #include "interface/transport.h"
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 static MQTTClientContext client_context;
+static int debug_level = 4;
 
 static void mbedtls_debug(void* ctx, int level, const char* file, int line, const char* str)
 {
@@ -21,9 +24,77 @@ static int mbedtls_transport_recv(NetworkContext_t* pNetworkContext, void* pBuff
     return mbedtls_ssl_read(&client_context.ssl_context, pBuffer, bytesToRecv);
 }
 
+// Vectors up to this size are gathered into the pending TLS record
+#define MQTT_COALESCE_LIMIT 256
+
+static int32_t mbedtls_write_all(const uint8_t* buffer, size_t length)
+{
+    size_t written = 0;
+    while (written < length) {
+        int ret = mbedtls_ssl_write(&client_context.ssl_context, buffer + written, length - written);
+        if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            continue;
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        written += (size_t)ret;
+    }
+    return (int32_t)written;
+}
+
+/*
+ * coreMQTT hands a publish over as separate vectors (fixed header, topic,
+ * packet id, payload). Written one by one, each becomes its own TLS record
+ * and send call; small vectors are gathered into one record instead, while
+ * large payloads go to mbedtls in place without being staged.
+ */
+static int32_t mbedtls_transport_writev(NetworkContext_t* pNetworkContext, TransportOutVector_t* pIoVec, size_t ioVecCount)
+{
+    uint8_t* staging = client_context.network_buffer;
+    size_t staged = 0;
+    int32_t total = 0;
+
+    for (size_t i = 0; i < ioVecCount; i++) {
+        size_t length = pIoVec[i].iov_len;
+        if (length <= MQTT_COALESCE_LIMIT && length <= sizeof(client_context.network_buffer) - staged) {
+            memcpy(staging + staged, pIoVec[i].iov_base, length);
+            staged += length;
+            continue;
+        }
+        if (staged > 0) {
+            int32_t ret = mbedtls_write_all(staging, staged);
+            if (ret < 0) {
+                return total > 0 ? total : ret;
+            }
+            total += ret;
+            staged = 0;
+        }
+        if (length <= MQTT_COALESCE_LIMIT) {
+            memcpy(staging, pIoVec[i].iov_base, length);
+            staged = length;
+            continue;
+        }
+        int32_t ret = mbedtls_write_all((const uint8_t*)pIoVec[i].iov_base, length);
+        if (ret < 0) {
+            return total > 0 ? total : ret;
+        }
+        total += ret;
+    }
+    if (staged > 0) {
+        int32_t ret = mbedtls_write_all(staging, staged);
+        if (ret < 0) {
+            return total > 0 ? total : ret;
+        }
+        total += ret;
+    }
+    return total;
+}
+
+// Called around every packet; coreMQTT takes differences, so wrapping at 32 bits is harmless
 static uint32_t coreMQTT_GetCurrentTime(void)
 {
-    return (uint32_t)iot_get_time(IOT_TIME_MILLISECONDS);
+    return (uint32_t)(iot_time_coarse_ns() / 1000000u);
 }
 
 static int check_private_key(mbedtls_pk_context* client_key)
@@ -37,6 +108,47 @@ static int check_private_key(mbedtls_pk_context* client_key)
     return ret;
 }
 
+/*
+ * Ring log records published at QoS 1 or 2 are committed only once the
+ * broker acknowledges them. They wait here in publish order, each with the
+ * read position after it; an acknowledgement commits up to the last record
+ * acknowledged along with every record before it. A new connection starts
+ * over from the committed position, so unacknowledged records are resent.
+ */
+#define RING_LOG_INFLIGHT 16
+
+static struct {
+    struct iot_ring_log* log;
+    struct iot_ring_log_cursor next; // Where the next record is read
+    size_t count;
+    struct {
+        uint16_t packet_id;
+        bool acked;
+        struct iot_ring_log_cursor after;
+    } records[RING_LOG_INFLIGHT];
+} ring_log_inflight;
+
+static void ring_log_acked(uint16_t packet_id)
+{
+    size_t acked = 0;
+    for (size_t i = 0; i < ring_log_inflight.count; i++) {
+        if (ring_log_inflight.records[i].packet_id == packet_id) {
+            ring_log_inflight.records[i].acked = true;
+        }
+    }
+    while (acked < ring_log_inflight.count && ring_log_inflight.records[acked].acked) {
+        acked++;
+    }
+    if (acked == 0) {
+        return;
+    }
+    // A failed commit only means the records are sent again
+    iot_ring_log_commit(ring_log_inflight.log, &ring_log_inflight.records[acked - 1].after);
+    ring_log_inflight.count -= acked;
+    memmove(ring_log_inflight.records, ring_log_inflight.records + acked,
+        ring_log_inflight.count * sizeof(ring_log_inflight.records[0]));
+}
+
 static void _mqtts_event_callback(MQTTContext_t* pMqttContext, MQTTPacketInfo_t* pPacketInfo, MQTTDeserializedInfo_t* pDeserializedInfo)
 {
     if (pPacketInfo->type == MQTT_PACKET_TYPE_PUBLISH) {
@@ -47,6 +159,8 @@ static void _mqtts_event_callback(MQTTContext_t* pMqttContext, MQTTPacketInfo_t*
             pPublishInfo->pPayload,
             pPublishInfo->payloadLength,
             NULL);
+    } else if (pPacketInfo->type == MQTT_PACKET_TYPE_PUBACK || pPacketInfo->type == MQTT_PACKET_TYPE_PUBCOMP) {
+        ring_log_acked(pDeserializedInfo->packetIdentifier);
     }
 }
 
@@ -72,6 +186,7 @@ int iot_mqtts_init(void)
     transport.pNetworkContext = NULL;
     transport.send = mbedtls_transport_send;
     transport.recv = mbedtls_transport_recv;
+    transport.writev = mbedtls_transport_writev;
 
     ret = MQTT_Init(&client_context.mqtt_context, &transport, coreMQTT_GetCurrentTime, _mqtts_event_callback, &fixed_buffer);
     if (ret != 0) {
@@ -84,10 +199,18 @@ int iot_mqtts_init(void)
     return ret;
 }
 
+void iot_mqtts_set_debug_level(int level)
+{
+    debug_level = level;
+}
+
 int iot_mqtts_connnect(const char* host, int port, const char* client_id, const char* root_ca, const char* client_cert, const char* private_key)
 {
     int ret;
 
+    // Records the last connection sent and the broker never acknowledged go out again
+    memset(&ring_log_inflight, 0, sizeof(ring_log_inflight));
+
     char port_str[6];
     sprintf(port_str, "%d", port);
 
@@ -112,13 +235,6 @@ int iot_mqtts_connnect(const char* host, int port, const char* client_id, const
         return ret;
     }
 
-    ret = mbedtls_net_connect(&client_context.net_context, host, port_str, MBEDTLS_NET_PROTO_TCP);
-    if (ret != 0) {
-        printf("mbedtls_net_connect returned: %d\n", ret);
-        iot_transport_close(client_context.transport_ctx);
-        return ret;
-    }
-
     ret = mbedtls_ssl_config_defaults(&client_context.ssl_config, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
     if (ret != 0) {
         iot_transport_close(client_context.transport_ctx);
@@ -126,7 +242,7 @@ int iot_mqtts_connnect(const char* host, int port, const char* client_id, const
     }
 
     mbedtls_ssl_conf_dbg(&client_context.ssl_config, mbedtls_debug, NULL);
-    mbedtls_debug_set_threshold(4);
+    mbedtls_debug_set_threshold(debug_level);
 
     mbedtls_ssl_conf_min_version(&client_context.ssl_config, MBEDTLS_SSL_MAJOR_VERSION_3, MBEDTLS_SSL_MINOR_VERSION_3);
     mbedtls_ssl_conf_max_version(&client_context.ssl_config, MBEDTLS_SSL_MAJOR_VERSION_3, MBEDTLS_SSL_MINOR_VERSION_3);
@@ -183,7 +299,8 @@ int iot_mqtts_connnect(const char* host, int port, const char* client_id, const
         return ret;
     }
 
-    mbedtls_ssl_set_bio(&client_context.ssl_context, &client_context.net_context, iot_transport_send, iot_transport_recv, NULL);
+    // TLS records go straight to the connection opened by iot_transport_open
+    mbedtls_ssl_set_bio(&client_context.ssl_context, client_context.transport_ctx, iot_transport_send, iot_transport_recv, NULL);
 
     while ((ret = mbedtls_ssl_handshake(&client_context.ssl_context)) != 0) {
         if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
@@ -251,7 +368,8 @@ int iot_mqtts_disconnect(void)
     return ret;
 }
 
-int iot_mqtts_publish(const char* topic, const uint8_t* payload, size_t payload_length, uint8_t qos)
+// Publishes with a fresh packet id, reported through packet_id if not NULL
+static int publish_message(const char* topic, const uint8_t* payload, size_t payload_length, uint8_t qos, uint16_t* packet_id)
 {
     MQTTPublishInfo_t publish_info = {
         .qos = qos,
@@ -261,8 +379,125 @@ int iot_mqtts_publish(const char* topic, const uint8_t* payload, size_t payload_
         .payloadLength = payload_length
     };
 
-    uint16_t packet_id = MQTT_GetPacketId(&client_context.mqtt_context);
-    return MQTT_Publish(&client_context.mqtt_context, &publish_info, packet_id);
+    uint16_t id = MQTT_GetPacketId(&client_context.mqtt_context);
+    if (packet_id != NULL) {
+        *packet_id = id;
+    }
+    return MQTT_Publish(&client_context.mqtt_context, &publish_info, id);
+}
+
+int iot_mqtts_publish(const char* topic, const uint8_t* payload, size_t payload_length, uint8_t qos)
+{
+    return publish_message(topic, payload, payload_length, qos, NULL);
+}
+
+int iot_mqtts_publish_io(const char* topic, IO* obj, enum io_format format, uint8_t qos)
+{
+    size_t payload_length;
+
+    int ret = io_serialize(obj, format, client_context.payload_buffer, sizeof(client_context.payload_buffer), &payload_length);
+    if (ret != 0) {
+        printf("io_serialize failed, %zu bytes required\n", payload_length);
+        return ret;
+    }
+
+    return iot_mqtts_publish(topic, client_context.payload_buffer, payload_length, qos);
+}
+
+int iot_mqtts_publish_batch(const char* topic, const IOBatch* batch, enum io_batch_format format, uint8_t qos)
+{
+    size_t payload_length;
+
+    int ret = io_batch_serialize(batch, format, client_context.payload_buffer, sizeof(client_context.payload_buffer), &payload_length);
+    if (ret != 0) {
+        printf("io_batch_serialize failed, %zu bytes required\n", payload_length);
+        return ret;
+    }
+
+    return iot_mqtts_publish(topic, client_context.payload_buffer, payload_length, qos);
+}
+
+// Topic and QoS for the records of iot_mqtts_publish_ring_log
+struct ring_log_publish {
+    const char* topic;
+    uint8_t qos;
+};
+
+static int publish_record(void* ctx, const uint8_t* record, size_t length)
+{
+    const struct ring_log_publish* publish = (const struct ring_log_publish*)ctx;
+    return iot_mqtts_publish(publish->topic, record, length, publish->qos) == 0 ? 0 : -1;
+}
+
+// Sends records after the ones awaiting acknowledgement, keeping each until it is acknowledged
+static int publish_ring_log_acked(const char* topic, struct iot_ring_log* log, size_t max_records, uint8_t qos)
+{
+    if (ring_log_inflight.count == 0) {
+        ring_log_inflight.log = log;
+        iot_ring_log_cursor_init(log, &ring_log_inflight.next);
+    } else if (ring_log_inflight.log != log) {
+        return -1; // Another log is still waiting for acknowledgements
+    }
+
+    unsigned char* buf = NULL;
+    size_t size = 0;
+    int published = 0;
+    int ret = 0;
+    while ((size_t)published < max_records && ring_log_inflight.count < RING_LOG_INFLIGHT) {
+        struct iot_ring_log_cursor next = ring_log_inflight.next;
+        size_t length = 0;
+        ret = iot_ring_log_read(log, &next, buf, size, &length);
+        if (ret == IOT_RING_LOG_TOO_SMALL) {
+            unsigned char* grown = (unsigned char*)realloc(buf, length);
+            if (grown == NULL) {
+                ret = -1;
+                break;
+            }
+            buf = grown;
+            size = length;
+            continue;
+        }
+        if (ret == IOT_RING_LOG_END) {
+            ret = 0;
+            break;
+        }
+        uint16_t packet_id;
+        if (ret != 0 || publish_message(topic, buf, length, qos, &packet_id) != MQTTSuccess) {
+            ret = -1;
+            break;
+        }
+        size_t slot = ring_log_inflight.count++;
+        ring_log_inflight.records[slot].packet_id = packet_id;
+        ring_log_inflight.records[slot].acked = false;
+        ring_log_inflight.records[slot].after = next;
+        ring_log_inflight.next = next;
+        published++;
+    }
+    free(buf);
+    return published > 0 ? published : ret;
+}
+
+int iot_mqtts_publish_ring_log(const char* topic, struct iot_ring_log* log, size_t max_records, uint8_t qos)
+{
+    if (topic == NULL || log == NULL) {
+        return -1;
+    }
+    if (qos > 0) {
+        return publish_ring_log_acked(topic, log, max_records, qos);
+    }
+    // Nothing acknowledges QoS 0, so a record is done once sent
+    struct ring_log_publish publish = { topic, qos };
+    return iot_ring_log_drain(log, max_records, publish_record, &publish);
+}
+
+int iot_mqtts_publish_state(void* ctx, IO* message, bool full)
+{
+    const struct iot_mqtts_state_topics* topics = (const struct iot_mqtts_state_topics*)ctx;
+    if (topics == NULL) {
+        return -1;
+    }
+
+    return iot_mqtts_publish_io(full ? topics->full_topic : topics->patch_topic, message, topics->format, topics->qos);
 }
 
 int iot_mqtts_subscribe(const char* topic, uint8_t qos)
@@ -0,0 +1,418 @@
+#include "data/aggregate.h"
+#include "cJSON.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Quantile sketch
+
+#define SKETCH_KEY_SHIFT (52 - IO_SKETCH_SUBBUCKET_BITS)
+
+// Bucket key of a non-zero magnitude: exponent and top mantissa bits
+static int32_t sketch_key(double magnitude)
+{
+    uint64_t bits;
+    memcpy(&bits, &magnitude, sizeof(bits));
+    return (int32_t)(bits >> SKETCH_KEY_SHIFT);
+}
+
+// Midpoint of the magnitudes that map to a key
+static double sketch_value(int32_t key)
+{
+    uint64_t low_bits = (uint64_t)key << SKETCH_KEY_SHIFT;
+    uint64_t high_bits = (uint64_t)(key + 1) << SKETCH_KEY_SHIFT;
+    double low;
+    double high;
+    memcpy(&low, &low_bits, sizeof(low));
+    memcpy(&high, &high_bits, sizeof(high));
+    return isinf(high) ? low : low + (high - low) / 2;
+}
+
+static void store_add(IOSketchStore* store, int32_t key, uint64_t n)
+{
+    if (store->count == 0) {
+        // Center the first key so the window can move either way
+        store->offset = key - IO_SKETCH_BINS / 2;
+    }
+
+    int64_t index = (int64_t)key - store->offset;
+    if (index < 0) {
+        // Slide the window down as far as the empty buckets at the top allow;
+        // magnitudes still below it collapse into the lowest bucket
+        int64_t top = IO_SKETCH_BINS - 1;
+        while (top > 0 && store->bins[top] == 0) {
+            top--;
+        }
+        int64_t shift = -index;
+        if (shift > IO_SKETCH_BINS - 1 - top) {
+            shift = IO_SKETCH_BINS - 1 - top;
+        }
+        if (shift > 0) {
+            memmove(store->bins + shift, store->bins, (size_t)(IO_SKETCH_BINS - shift) * sizeof(store->bins[0]));
+            memset(store->bins, 0, (size_t)shift * sizeof(store->bins[0]));
+            store->offset -= (int32_t)shift;
+        }
+        index = index + shift < 0 ? 0 : index + shift;
+    } else if (index >= IO_SKETCH_BINS) {
+        // Slide the window up, folding the buckets that fall off into bins[0]
+        int64_t shift = index - IO_SKETCH_BINS + 1;
+        uint64_t folded = 0;
+        if (shift >= IO_SKETCH_BINS) {
+            folded = store->count;
+            memset(store->bins, 0, sizeof(store->bins));
+        } else {
+            for (int64_t i = 0; i < shift; i++) {
+                folded += store->bins[i];
+            }
+            memmove(store->bins, store->bins + shift, (size_t)(IO_SKETCH_BINS - shift) * sizeof(store->bins[0]));
+            memset(store->bins + IO_SKETCH_BINS - shift, 0, (size_t)shift * sizeof(store->bins[0]));
+        }
+        store->bins[0] += (uint32_t)folded;
+        store->offset += (int32_t)shift;
+        index = IO_SKETCH_BINS - 1;
+    }
+    store->bins[index] += (uint32_t)n;
+    store->count += n;
+}
+
+// Empty the sketch
+void io_sketch_reset(IOSketch* sketch)
+{
+    memset(sketch, 0, sizeof(*sketch));
+}
+
+// Add a finite value to the sketch
+void io_sketch_add(IOSketch* sketch, double value)
+{
+    if (value > 0) {
+        store_add(&sketch->positive, sketch_key(value), 1);
+    } else if (value < 0) {
+        store_add(&sketch->negative, sketch_key(-value), 1);
+    } else {
+        sketch->zero_count++;
+    }
+}
+
+static void store_merge(IOSketchStore* dst, const IOSketchStore* src)
+{
+    if (src->count == 0) {
+        return;
+    }
+    // Add the highest key first so dst positions its window before the rest arrive
+    for (int i = IO_SKETCH_BINS - 1; i >= 0; i--) {
+        if (src->bins[i] != 0) {
+            store_add(dst, src->offset + i, src->bins[i]);
+        }
+    }
+}
+
+// Add every value counted in src to dst
+void io_sketch_merge(IOSketch* dst, const IOSketch* src)
+{
+    store_merge(&dst->positive, &src->positive);
+    store_merge(&dst->negative, &src->negative);
+    dst->zero_count += src->zero_count;
+}
+
+// Get the number of values in the sketch
+uint64_t io_sketch_count(const IOSketch* sketch)
+{
+    return sketch->positive.count + sketch->negative.count + sketch->zero_count;
+}
+
+// Estimate the q-quantile, walking from the most negative value upwards
+double io_sketch_quantile(const IOSketch* sketch, double q)
+{
+    uint64_t total = io_sketch_count(sketch);
+    if (total == 0) {
+        return 0;
+    }
+    q = q < 0 ? 0 : (q > 1 ? 1 : q);
+    uint64_t rank = (uint64_t)(q * (double)(total - 1));
+    uint64_t seen = 0;
+
+    const IOSketchStore* negative = &sketch->negative;
+    for (int i = IO_SKETCH_BINS - 1; i >= 0 && negative->count > 0; i--) {
+        seen += negative->bins[i];
+        if (seen > rank) {
+            return -sketch_value(negative->offset + i);
+        }
+    }
+    seen += sketch->zero_count;
+    if (seen > rank) {
+        return 0;
+    }
+    const IOSketchStore* positive = &sketch->positive;
+    for (int i = 0; i < IO_SKETCH_BINS; i++) {
+        seen += positive->bins[i];
+        if (seen > rank) {
+            return sketch_value(positive->offset + i);
+        }
+    }
+    return 0; // Not reached: the bins sum to the count
+}
+
+// Windowed aggregation
+
+// Statistics for one step of one metric
+struct pane {
+    int64_t slot;
+    uint64_t count;
+    double sum;
+    double min;
+    double max;
+    IOSketch sketch;
+};
+
+struct metric {
+    char name[IO_AGGREGATE_NAME_SIZE];
+    bool started; // Has samples in windows not yet emitted
+    bool drained; // Was started, and every window with samples was emitted
+    int64_t current; // Newest slot seen
+    int64_t emitted; // End slot of the last window emitted, once drained
+    struct pane* panes; // Ring indexed by slot
+};
+
+struct IOAggregator {
+    struct io_window_config config;
+    int64_t step;
+    int64_t pane_count;
+    io_summary_func_t on_summary;
+    void* ctx;
+    struct metric* metrics;
+    size_t metric_count;
+    size_t metric_capacity;
+    IOSketch scratch; // Merged sketch for sliding windows
+};
+
+static int64_t floor_div(int64_t a, int64_t b)
+{
+    int64_t q = a / b;
+    return (a % b != 0 && a < 0) ? q - 1 : q;
+}
+
+// Create an aggregator
+IOAggregator* io_aggregator_create(const struct io_window_config* config, io_summary_func_t on_summary, void* ctx)
+{
+    if (config == NULL || on_summary == NULL || config->length_ms <= 0
+        || config->quantile_count > IO_AGGREGATE_MAX_QUANTILES) {
+        return NULL; // Error: invalid input
+    }
+
+    int64_t step = config->length_ms;
+    if (config->type == IO_WINDOW_SLIDING) {
+        if (config->step_ms <= 0 || config->length_ms % config->step_ms != 0
+            || config->length_ms / config->step_ms > IO_AGGREGATE_MAX_PANES) {
+            return NULL;
+        }
+        step = config->step_ms;
+    } else if (config->type != IO_WINDOW_TUMBLING) {
+        return NULL;
+    }
+
+    IOAggregator* agg = (IOAggregator*)calloc(1, sizeof(IOAggregator));
+    if (agg == NULL) {
+        return NULL;
+    }
+    agg->config = *config;
+    if (agg->config.quantile_count == 0) {
+        agg->config.quantile_count = 3;
+        agg->config.quantiles[0] = 0.5;
+        agg->config.quantiles[1] = 0.9;
+        agg->config.quantiles[2] = 0.99;
+    }
+    agg->step = step;
+    agg->pane_count = config->length_ms / step;
+    agg->on_summary = on_summary;
+    agg->ctx = ctx;
+    return agg;
+}
+
+// Destroy the aggregator without emitting open windows
+void io_aggregator_destroy(IOAggregator* agg)
+{
+    if (agg == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < agg->metric_count; i++) {
+        free(agg->metrics[i].panes);
+    }
+    free(agg->metrics);
+    free(agg);
+}
+
+// Add a metric and return its index
+int io_aggregator_add_metric(IOAggregator* agg, const char* name)
+{
+    if (agg == NULL || name == NULL || strlen(name) >= IO_AGGREGATE_NAME_SIZE) {
+        return -1; // Error: invalid input
+    }
+
+    if (agg->metric_count == agg->metric_capacity) {
+        size_t capacity = agg->metric_capacity == 0 ? 4 : agg->metric_capacity * 2;
+        struct metric* grown = (struct metric*)realloc(agg->metrics, capacity * sizeof(struct metric));
+        if (grown == NULL) {
+            return -1;
+        }
+        agg->metrics = grown;
+        agg->metric_capacity = capacity;
+    }
+
+    struct metric* m = &agg->metrics[agg->metric_count];
+    memset(m, 0, sizeof(*m));
+    m->panes = (struct pane*)calloc((size_t)agg->pane_count, sizeof(struct pane));
+    if (m->panes == NULL) {
+        return -1;
+    }
+    strcpy(m->name, name);
+    return (int)agg->metric_count++;
+}
+
+static struct pane* pane_for(IOAggregator* agg, struct metric* m, int64_t slot)
+{
+    int64_t index = slot % agg->pane_count;
+    struct pane* p = &m->panes[index < 0 ? index + agg->pane_count : index];
+    if (p->slot != slot || p->count == 0) {
+        // Reused ring entry: start the step afresh
+        p->slot = slot;
+        p->count = 0;
+        p->sum = 0;
+        io_sketch_reset(&p->sketch);
+    }
+    return p;
+}
+
+// Build and deliver the summary of the window that ends with slot 'last'
+static void emit_window(IOAggregator* agg, struct metric* m, int64_t last)
+{
+    uint64_t count = 0;
+    double sum = 0;
+    double min = 0;
+    double max = 0;
+    const IOSketch* sketch = NULL;
+
+    if (agg->pane_count > 1) {
+        io_sketch_reset(&agg->scratch);
+        sketch = &agg->scratch;
+    }
+    for (int64_t i = 0; i < agg->pane_count; i++) {
+        const struct pane* p = &m->panes[i];
+        if (p->count == 0 || p->slot > last || p->slot <= last - agg->pane_count) {
+            continue;
+        }
+        if (count == 0 || p->min < min) {
+            min = p->min;
+        }
+        if (count == 0 || p->max > max) {
+            max = p->max;
+        }
+        count += p->count;
+        sum += p->sum;
+        if (agg->pane_count > 1) {
+            io_sketch_merge(&agg->scratch, &p->sketch);
+        } else {
+            sketch = &p->sketch;
+        }
+    }
+    if (count == 0) {
+        return; // Nothing happened in this window
+    }
+
+    IO* summary = io_create();
+    if (summary == NULL) {
+        return;
+    }
+    cJSON* json = summary->json_obj;
+    cJSON_AddStringToObject(json, "metric", m->name);
+    cJSON_AddNumberToObject(json, "start", (double)((last - agg->pane_count + 1) * agg->step));
+    cJSON_AddNumberToObject(json, "end", (double)((last + 1) * agg->step));
+    cJSON_AddNumberToObject(json, "count", (double)count);
+    cJSON_AddNumberToObject(json, "min", min);
+    cJSON_AddNumberToObject(json, "max", max);
+    cJSON_AddNumberToObject(json, "mean", sum / (double)count);
+    for (size_t i = 0; i < agg->config.quantile_count; i++) {
+        char key[16];
+        double value = io_sketch_quantile(sketch, agg->config.quantiles[i]);
+        // Bucket midpoints can overshoot the real extremes
+        value = value < min ? min : (value > max ? max : value);
+        snprintf(key, sizeof(key), "p%g", agg->config.quantiles[i] * 100);
+        cJSON_AddNumberToObject(json, key, value);
+    }
+    agg->on_summary(agg->ctx, summary);
+    io_destroy(summary);
+}
+
+// Emit every window that closes when the metric moves on to 'slot'
+static void advance(IOAggregator* agg, struct metric* m, int64_t slot)
+{
+    // Windows ending pane_count or more steps after the newest data are empty
+    int64_t last = slot - 1;
+    bool drained = last - m->current >= agg->pane_count;
+    if (drained) {
+        last = m->current + agg->pane_count - 1;
+    }
+    for (int64_t end = m->current; end <= last; end++) {
+        emit_window(agg, m, end);
+    }
+    m->current = slot;
+    if (drained) {
+        // Start over with the next sample, which may be far before slot
+        m->started = false;
+        m->drained = true;
+        m->emitted = last;
+    }
+}
+
+// Record a sample
+int io_aggregator_record(IOAggregator* agg, int metric, int64_t timestamp_ms, double value)
+{
+    if (agg == NULL || metric < 0 || (size_t)metric >= agg->metric_count || !isfinite(value)) {
+        return -1; // Error: invalid input
+    }
+
+    struct metric* m = &agg->metrics[metric];
+    int64_t slot = floor_div(timestamp_ms, agg->step);
+    if (m->started && slot > m->current) {
+        advance(agg, m, slot);
+    }
+    if (!m->started) {
+        if (m->drained && slot <= m->emitted - agg->pane_count + 1) {
+            return -1; // Too late: every window holding it was already emitted
+        }
+        // Windows up to the last one emitted stay closed
+        m->started = true;
+        m->current = m->drained && slot <= m->emitted ? m->emitted + 1 : slot;
+    } else if (slot <= m->current - agg->pane_count) {
+        return -1; // Too late: every window holding it was already emitted
+    }
+
+    struct pane* p = pane_for(agg, m, slot);
+    if (p->count == 0 || value < p->min) {
+        p->min = value;
+    }
+    if (p->count == 0 || value > p->max) {
+        p->max = value;
+    }
+    p->count++;
+    p->sum += value;
+    io_sketch_add(&p->sketch, value);
+    return 0;
+}
+
+// Close and emit every window that ended at or before now_ms
+int io_aggregator_flush(IOAggregator* agg, int64_t now_ms)
+{
+    if (agg == NULL) {
+        return -1; // Error: invalid input
+    }
+    int64_t slot = floor_div(now_ms, agg->step);
+    for (size_t i = 0; i < agg->metric_count; i++) {
+        struct metric* m = &agg->metrics[i];
+        if (m->started && slot > m->current) {
+            advance(agg, m, slot);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include "data/batch.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define IO_SERIES_INITIAL_CAPACITY 64
+
+// Create an empty batch
+IOBatch* io_batch_create(void)
+{
+    return (IOBatch*)calloc(1, sizeof(IOBatch));
+}
+
+// Destroy the batch, freeing all series
+void io_batch_destroy(IOBatch* batch)
+{
+    if (batch == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < batch->series_count; i++) {
+        free(batch->series[i].timestamps);
+        free(batch->series[i].values.ints);
+    }
+    free(batch->series);
+    free(batch);
+}
+
+// Add a series and return its index, or -1 on error
+int io_batch_add_series(IOBatch* batch, const char* name, enum io_series_type type)
+{
+    if (batch == NULL || name == NULL || strlen(name) >= IO_SERIES_NAME_SIZE
+        || (type != IO_SERIES_INT64 && type != IO_SERIES_DOUBLE)) {
+        return -1; // Error: invalid input
+    }
+    if (io_batch_find_series(batch, name) >= 0 || batch->series_count >= 255) {
+        return -1; // Error: duplicate name or too many series
+    }
+
+    if (batch->series_count == batch->series_capacity) {
+        size_t capacity = batch->series_capacity == 0 ? 4 : batch->series_capacity * 2;
+        IOSeries* grown = (IOSeries*)realloc(batch->series, capacity * sizeof(IOSeries));
+        if (grown == NULL) {
+            return -1;
+        }
+        batch->series = grown;
+        batch->series_capacity = capacity;
+    }
+
+    IOSeries* series = &batch->series[batch->series_count];
+    memset(series, 0, sizeof(*series));
+    strcpy(series->name, name);
+    series->type = type;
+    return (int)batch->series_count++;
+}
+
+// Get the index of a series by name, or -1 if not found
+int io_batch_find_series(const IOBatch* batch, const char* name)
+{
+    if (batch == NULL || name == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < batch->series_count; i++) {
+        if (strcmp(batch->series[i].name, name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// Make room for one more sample, doubling both columns together
+static IOSeries* series_reserve(IOBatch* batch, int index, enum io_series_type type)
+{
+    if (batch == NULL || index < 0 || (size_t)index >= batch->series_count) {
+        return NULL;
+    }
+    IOSeries* series = &batch->series[index];
+    if (series->type != type) {
+        return NULL;
+    }
+    if (series->count < series->capacity) {
+        return series;
+    }
+
+    size_t capacity = series->capacity == 0 ? IO_SERIES_INITIAL_CAPACITY : series->capacity * 2;
+    int64_t* timestamps = (int64_t*)realloc(series->timestamps, capacity * sizeof(int64_t));
+    if (timestamps == NULL) {
+        return NULL;
+    }
+    series->timestamps = timestamps;
+    // int64_t and double are both 8 bytes, so one allocation size serves either column
+    int64_t* values = (int64_t*)realloc(series->values.ints, capacity * sizeof(int64_t));
+    if (values == NULL) {
+        return NULL;
+    }
+    series->values.ints = values;
+    series->capacity = capacity;
+    return series;
+}
+
+// Append a sample to an integer series
+int io_batch_append_int(IOBatch* batch, int series, int64_t timestamp, int64_t value)
+{
+    IOSeries* s = series_reserve(batch, series, IO_SERIES_INT64);
+    if (s == NULL) {
+        return -1; // Error: invalid series or out of memory
+    }
+    s->timestamps[s->count] = timestamp;
+    s->values.ints[s->count] = value;
+    s->count++;
+    return 0;
+}
+
+// Append a sample to a double series
+int io_batch_append_double(IOBatch* batch, int series, int64_t timestamp, double value)
+{
+    IOSeries* s = series_reserve(batch, series, IO_SERIES_DOUBLE);
+    if (s == NULL) {
+        return -1; // Error: invalid series or out of memory
+    }
+    s->timestamps[s->count] = timestamp;
+    s->values.doubles[s->count] = value;
+    s->count++;
+    return 0;
+}
+
+// Get the total number of samples over all series
+size_t io_batch_sample_count(const IOBatch* batch)
+{
+    size_t total = 0;
+    if (batch != NULL) {
+        for (size_t i = 0; i < batch->series_count; i++) {
+            total += batch->series[i].count;
+        }
+    }
+    return total;
+}
+
+// Drop all samples but keep the series and their storage
+void io_batch_clear(IOBatch* batch)
+{
+    if (batch != NULL) {
+        for (size_t i = 0; i < batch->series_count; i++) {
+            batch->series[i].count = 0;
+        }
+    }
+}
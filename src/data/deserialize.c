@@ -0,0 +1,781 @@
+#include "cJSON.h"
+#include "data/json_simd.h"
+#include "data/numconv.h"
+#include "data/serialize.h"
+#include "system/pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Wrap a string already allocated with cJSON_malloc in a string item
+static cJSON* string_item(char* str)
+{
+    if (str == NULL) {
+        return NULL;
+    }
+    cJSON* item = cJSON_CreateNull();
+    if (item == NULL) {
+        cJSON_free(str);
+        return NULL;
+    }
+    item->type = cJSON_String;
+    item->valuestring = str;
+    return item;
+}
+
+// JSON
+
+// Cursor over a JSON input buffer
+struct json_parser {
+    const char* data;
+    size_t length;
+    size_t offset;
+    const struct io_json_kernels* kernels;
+};
+
+static void json_skip_whitespace(struct json_parser* p)
+{
+    // Compact input has no whitespace, so only call the kernel when there is some
+    if (p->offset < p->length && (unsigned char)p->data[p->offset] <= ' ') {
+        p->offset += p->kernels->skip_whitespace(p->data + p->offset, p->length - p->offset);
+    }
+}
+
+// Parse the string starting at the opening quote into a cJSON-allocated copy
+static char* json_string(struct json_parser* p)
+{
+    const char* start = p->data + p->offset + 1;
+    size_t available = p->length - p->offset - 1;
+    size_t end = 0;
+    bool escaped = false;
+
+    // Find the closing quote, skipping runs of plain bytes with the kernel
+    for (;;) {
+        end += p->kernels->find_escape(start + end, available - end);
+        if (end == available || (unsigned char)start[end] < 0x20) {
+            return NULL; // Unterminated string or raw control character
+        }
+        if (start[end] == '"') {
+            break;
+        }
+        escaped = true;
+        end += 2; // Skip the backslash and the character it escapes
+        if (end > available) {
+            return NULL;
+        }
+    }
+
+    // Unescaping only ever shrinks the text, so 'end' bytes always suffice
+    char* str = (char*)cJSON_malloc(end + 1);
+    if (str == NULL) {
+        return NULL;
+    }
+
+    if (!escaped) {
+        if (!p->kernels->utf8_valid((const uint8_t*)start, end)) {
+            cJSON_free(str);
+            return NULL;
+        }
+        memcpy(str, start, end);
+        str[end] = '\0';
+        p->offset += end + 2;
+        return str;
+    }
+
+    size_t in = 0;
+    size_t out = 0;
+    while (in < end) {
+        size_t run = p->kernels->find_escape(start + in, end - in);
+        if (!p->kernels->utf8_valid((const uint8_t*)start + in, run)) {
+            cJSON_free(str);
+            return NULL;
+        }
+        memcpy(str + out, start + in, run);
+        in += run;
+        out += run;
+        if (in == end) {
+            break;
+        }
+
+        // start[in] is a backslash here; quotes and control bytes were handled above
+        char c = start[in + 1];
+        size_t consumed = 2;
+        switch (c) {
+        case '"':
+        case '\\':
+        case '/':
+            str[out++] = c;
+            break;
+        case 'b':
+            str[out++] = '\b';
+            break;
+        case 'f':
+            str[out++] = '\f';
+            break;
+        case 'n':
+            str[out++] = '\n';
+            break;
+        case 'r':
+            str[out++] = '\r';
+            break;
+        case 't':
+            str[out++] = '\t';
+            break;
+        case 'u': {
+            uint32_t cp;
+            if (io_parse_unicode_escape(start + in, end - in, &consumed, &cp) != 0) {
+                cJSON_free(str);
+                return NULL;
+            }
+            out += io_format_utf8(str + out, cp);
+            break;
+        }
+        default:
+            cJSON_free(str);
+            return NULL;
+        }
+        in += consumed;
+    }
+    str[out] = '\0';
+    p->offset += end + 2;
+    return str;
+}
+
+static int json_literal(struct json_parser* p, const char* literal, size_t length)
+{
+    if (p->length - p->offset < length || memcmp(p->data + p->offset, literal, length) != 0) {
+        return -1;
+    }
+    p->offset += length;
+    return 0;
+}
+
+static cJSON* json_value(struct json_parser* p, int depth);
+
+static cJSON* json_container(struct json_parser* p, int is_object, int depth)
+{
+    char close = is_object ? '}' : ']';
+    cJSON* container = is_object ? cJSON_CreateObject() : cJSON_CreateArray();
+    if (container == NULL) {
+        return NULL;
+    }
+
+    p->offset++; // Opening bracket
+    json_skip_whitespace(p);
+    if (p->offset < p->length && p->data[p->offset] == close) {
+        p->offset++;
+        return container;
+    }
+
+    for (;;) {
+        char* key = NULL;
+
+        if (is_object) {
+            if (p->offset >= p->length || p->data[p->offset] != '"'
+                || (key = json_string(p)) == NULL) {
+                cJSON_Delete(container);
+                return NULL;
+            }
+            json_skip_whitespace(p);
+            if (p->offset >= p->length || p->data[p->offset] != ':') {
+                cJSON_free(key);
+                cJSON_Delete(container);
+                return NULL;
+            }
+            p->offset++;
+            json_skip_whitespace(p);
+        }
+
+        cJSON* child = json_value(p, depth + 1);
+        if (child == NULL) {
+            cJSON_free(key);
+            cJSON_Delete(container);
+            return NULL;
+        }
+        child->string = key;
+        cJSON_AddItemToArray(container, child);
+
+        json_skip_whitespace(p);
+        if (p->offset >= p->length) {
+            break;
+        }
+        char c = p->data[p->offset++];
+        if (c == close) {
+            return container;
+        }
+        if (c != ',') {
+            break;
+        }
+        json_skip_whitespace(p);
+    }
+
+    cJSON_Delete(container);
+    return NULL;
+}
+
+static cJSON* json_value(struct json_parser* p, int depth)
+{
+    if (depth > IO_MAX_DEPTH || p->offset >= p->length) {
+        return NULL;
+    }
+
+    switch (p->data[p->offset]) {
+    case '{':
+        return json_container(p, 1, depth);
+    case '[':
+        return json_container(p, 0, depth);
+    case '"': {
+        return string_item(json_string(p));
+    }
+    case 't':
+        return json_literal(p, "true", 4) == 0 ? cJSON_CreateTrue() : NULL;
+    case 'f':
+        return json_literal(p, "false", 5) == 0 ? cJSON_CreateFalse() : NULL;
+    case 'n':
+        return json_literal(p, "null", 4) == 0 ? cJSON_CreateNull() : NULL;
+    default: {
+        size_t consumed;
+        bool is_integer;
+        int64_t integer;
+        double number;
+        if (io_parse_number(p->data + p->offset, p->length - p->offset, &consumed,
+                &is_integer, &integer, &number)
+            != 0) {
+            return NULL;
+        }
+        p->offset += consumed;
+        return cJSON_CreateNumber(is_integer ? (double)integer : number);
+    }
+    }
+}
+
+static cJSON* decode_json(const char* data, size_t length)
+{
+    struct json_parser p = { .data = data, .length = length, .kernels = io_json_kernels() };
+
+    json_skip_whitespace(&p);
+    cJSON* root = json_value(&p, 0);
+    if (root == NULL) {
+        return NULL;
+    }
+    json_skip_whitespace(&p);
+    if (p.offset != p.length) {
+        cJSON_Delete(root); // Trailing garbage
+        return NULL;
+    }
+    return root;
+}
+
+// MessagePack
+
+// Cursor over a MessagePack input buffer
+struct io_reader {
+    const uint8_t* data;
+    size_t length;
+    size_t offset;
+};
+
+static int reader_take(struct io_reader* r, size_t count, const uint8_t** out)
+{
+    if (r->length - r->offset < count) {
+        return -1; // Truncated input
+    }
+    *out = r->data + r->offset;
+    r->offset += count;
+    return 0;
+}
+
+// Read a big-endian unsigned integer of 'size' bytes
+static int reader_uint(struct io_reader* r, size_t size, uint64_t* out)
+{
+    const uint8_t* bytes;
+    if (reader_take(r, size, &bytes) != 0) {
+        return -1;
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value = (value << 8) | bytes[i];
+    }
+    *out = value;
+    return 0;
+}
+
+// Copy 'length' bytes into a NUL-terminated string owned by cJSON's allocator
+static char* reader_string(struct io_reader* r, size_t length)
+{
+    const uint8_t* bytes;
+    if (reader_take(r, length, &bytes) != 0 || memchr(bytes, '\0', length) != NULL) {
+        return NULL;
+    }
+    char* str = (char*)cJSON_malloc(length + 1);
+    if (str != NULL) {
+        memcpy(str, bytes, length);
+        str[length] = '\0';
+    }
+    return str;
+}
+
+// Decode the length of a str value whose tag has already been consumed
+static int string_length(struct io_reader* r, uint8_t tag, size_t* length)
+{
+    uint64_t value;
+
+    if ((tag & 0xE0) == 0xA0) {
+        *length = tag & 0x1F;
+        return 0;
+    }
+    switch (tag) {
+    case 0xD9:
+        if (reader_uint(r, 1, &value) != 0) {
+            return -1;
+        }
+        break;
+    case 0xDA:
+        if (reader_uint(r, 2, &value) != 0) {
+            return -1;
+        }
+        break;
+    case 0xDB:
+        if (reader_uint(r, 4, &value) != 0) {
+            return -1;
+        }
+        break;
+    default:
+        return -1;
+    }
+    *length = (size_t)value;
+    return 0;
+}
+
+static cJSON* decode_msgpack(struct io_reader* r, int depth);
+
+static cJSON* decode_container(struct io_reader* r, int is_object, size_t count, int depth)
+{
+    cJSON* container = is_object ? cJSON_CreateObject() : cJSON_CreateArray();
+    if (container == NULL) {
+        return NULL;
+    }
+
+    // Every element needs at least one byte, which bounds hostile counts
+    if (count > r->length - r->offset) {
+        cJSON_Delete(container);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        char* key = NULL;
+
+        if (is_object) {
+            const uint8_t* tag;
+            size_t key_length;
+            if (reader_take(r, 1, &tag) != 0
+                || string_length(r, *tag, &key_length) != 0
+                || (key = reader_string(r, key_length)) == NULL) {
+                cJSON_Delete(container);
+                return NULL;
+            }
+        }
+
+        cJSON* child = decode_msgpack(r, depth + 1);
+        if (child == NULL) {
+            cJSON_free(key);
+            cJSON_Delete(container);
+            return NULL;
+        }
+        child->string = key;
+        cJSON_AddItemToArray(container, child);
+    }
+    return container;
+}
+
+static cJSON* decode_msgpack(struct io_reader* r, int depth)
+{
+    const uint8_t* tag_ptr;
+    uint64_t value;
+    size_t length;
+
+    if (depth > IO_MAX_DEPTH || reader_take(r, 1, &tag_ptr) != 0) {
+        return NULL;
+    }
+    uint8_t tag = *tag_ptr;
+
+    if (tag <= 0x7F) {
+        return cJSON_CreateNumber(tag);
+    }
+    if (tag >= 0xE0) {
+        return cJSON_CreateNumber((int8_t)tag);
+    }
+    if ((tag & 0xF0) == 0x80) {
+        return decode_container(r, 1, tag & 0x0F, depth);
+    }
+    if ((tag & 0xF0) == 0x90) {
+        return decode_container(r, 0, tag & 0x0F, depth);
+    }
+    if ((tag & 0xE0) == 0xA0 || tag == 0xD9 || tag == 0xDA || tag == 0xDB) {
+        if (string_length(r, tag, &length) != 0) {
+            return NULL;
+        }
+        return string_item(reader_string(r, length));
+    }
+
+    switch (tag) {
+    case 0xC0:
+        return cJSON_CreateNull();
+    case 0xC2:
+        return cJSON_CreateFalse();
+    case 0xC3:
+        return cJSON_CreateTrue();
+    case 0xCA: {
+        float single;
+        uint32_t bits;
+        if (reader_uint(r, 4, &value) != 0) {
+            return NULL;
+        }
+        bits = (uint32_t)value;
+        memcpy(&single, &bits, sizeof(single));
+        return cJSON_CreateNumber(single);
+    }
+    case 0xCB: {
+        double number;
+        if (reader_uint(r, 8, &value) != 0) {
+            return NULL;
+        }
+        memcpy(&number, &value, sizeof(number));
+        return cJSON_CreateNumber(number);
+    }
+    case 0xCC:
+    case 0xCD:
+    case 0xCE:
+    case 0xCF:
+        if (reader_uint(r, (size_t)1 << (tag - 0xCC), &value) != 0) {
+            return NULL;
+        }
+        return cJSON_CreateNumber((double)value);
+    case 0xD0:
+        if (reader_uint(r, 1, &value) != 0) {
+            return NULL;
+        }
+        return cJSON_CreateNumber((int8_t)value);
+    case 0xD1:
+        if (reader_uint(r, 2, &value) != 0) {
+            return NULL;
+        }
+        return cJSON_CreateNumber((int16_t)value);
+    case 0xD2:
+        if (reader_uint(r, 4, &value) != 0) {
+            return NULL;
+        }
+        return cJSON_CreateNumber((int32_t)value);
+    case 0xD3:
+        if (reader_uint(r, 8, &value) != 0) {
+            return NULL;
+        }
+        return cJSON_CreateNumber((double)(int64_t)value);
+    case 0xDC:
+    case 0xDE:
+        if (reader_uint(r, 2, &value) != 0) {
+            return NULL;
+        }
+        return decode_container(r, tag == 0xDE, (size_t)value, depth);
+    case 0xDD:
+    case 0xDF:
+        if (reader_uint(r, 4, &value) != 0) {
+            return NULL;
+        }
+        return decode_container(r, tag == 0xDF, (size_t)value, depth);
+    default:
+        return NULL; // bin, ext and reserved tags have no IO representation
+    }
+}
+
+// Decode a buffer in the given format into a new IO
+IO* io_deserialize(const uint8_t* data, size_t length, enum io_format format)
+{
+    cJSON* root = NULL;
+
+    if (data == NULL) {
+        return NULL; // Error: invalid input
+    }
+
+    if (format == IO_FORMAT_JSON) {
+        root = decode_json((const char*)data, length);
+    } else if (format == IO_FORMAT_MSGPACK) {
+        struct io_reader r = { .data = data, .length = length };
+        root = decode_msgpack(&r, 0);
+        if (root != NULL && r.offset != r.length) {
+            cJSON_Delete(root); // Trailing garbage
+            root = NULL;
+        }
+    }
+
+    if (root == NULL) {
+        return NULL;
+    }
+
+    IO* obj = (IO*)iot_pool_alloc(sizeof(IO));
+    if (obj == NULL) {
+        cJSON_Delete(root);
+        return NULL;
+    }
+    obj->json_obj = root;
+    return obj;
+}
+
+// Time-series batches (see the format description in serialize.c)
+
+// Bit-level cursor over a batch bit stream, MSB first
+struct bit_reader {
+    const uint8_t* data;
+    size_t bit;
+    size_t bit_length;
+};
+
+static int bits_get(struct bit_reader* b, unsigned width, uint64_t* out)
+{
+    if (b->bit_length - b->bit < width) {
+        return -1; // Truncated input
+    }
+    uint64_t value = 0;
+    while (width > 0) {
+        size_t byte = b->bit >> 3;
+        unsigned offset = (unsigned)(b->bit & 7);
+        unsigned take = 8 - offset < width ? 8 - offset : width;
+        uint8_t chunk = (uint8_t)((uint8_t)(b->data[byte] << offset) >> (8 - take));
+        value = (value << take) | chunk;
+        b->bit += take;
+        width -= take;
+    }
+    *out = value;
+    return 0;
+}
+
+// Count leading one bits, up to 'limit', consuming them and the terminating zero
+static int bits_prefix(struct bit_reader* b, unsigned limit, unsigned* ones)
+{
+    uint64_t bit;
+    *ones = 0;
+    while (*ones < limit) {
+        if (bits_get(b, 1, &bit) != 0) {
+            return -1;
+        }
+        if (bit == 0) {
+            return 0;
+        }
+        (*ones)++;
+    }
+    return 0;
+}
+
+static uint64_t sign_extend(uint64_t value, unsigned width)
+{
+    uint64_t sign = UINT64_C(1) << (width - 1);
+    return (value ^ sign) - sign;
+}
+
+static int gorilla_dod(struct bit_reader* b, uint64_t* dod)
+{
+    static const unsigned widths[] = { 0, 7, 9, 12, 32, 64 };
+    unsigned ones;
+    uint64_t value = 0;
+
+    if (bits_prefix(b, 5, &ones) != 0) {
+        return -1;
+    }
+    if (ones > 0) {
+        unsigned width = widths[ones];
+        if (bits_get(b, width, &value) != 0) {
+            return -1;
+        }
+        if (width < 64) {
+            value = sign_extend(value, width);
+        }
+    }
+    *dod = value;
+    return 0;
+}
+
+// Decoder state for one delta-of-delta column
+struct dod_state {
+    uint64_t previous;
+    uint64_t delta;
+};
+
+static int gorilla_int(struct bit_reader* b, struct dod_state* s, uint64_t* value)
+{
+    uint64_t dod;
+    if (gorilla_dod(b, &dod) != 0) {
+        return -1;
+    }
+    s->delta += dod;
+    s->previous += s->delta;
+    *value = s->previous;
+    return 0;
+}
+
+// Decoder state for one XOR column
+struct xor_state {
+    uint64_t previous;
+    unsigned leading;
+    unsigned trailing;
+};
+
+static int gorilla_double(struct bit_reader* b, struct xor_state* s, double* value)
+{
+    unsigned ones;
+    uint64_t xor;
+
+    if (bits_prefix(b, 2, &ones) != 0) {
+        return -1;
+    }
+    if (ones == 1) {
+        if (s->leading == 64 || bits_get(b, 64 - s->leading - s->trailing, &xor) != 0) {
+            return -1; // No window yet, or truncated
+        }
+        s->previous ^= xor << s->trailing;
+    } else if (ones == 2) {
+        uint64_t leading;
+        uint64_t length;
+        if (bits_get(b, 5, &leading) != 0 || bits_get(b, 6, &length) != 0) {
+            return -1;
+        }
+        unsigned meaningful = (unsigned)length + 1;
+        if (leading + meaningful > 64 || bits_get(b, meaningful, &xor) != 0) {
+            return -1;
+        }
+        s->leading = (unsigned)leading;
+        s->trailing = 64 - s->leading - meaningful;
+        s->previous ^= xor << s->trailing;
+    }
+    memcpy(value, &s->previous, sizeof(*value));
+    return 0;
+}
+
+static int reader_varint(struct io_reader* r, uint64_t* out)
+{
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        const uint8_t* byte;
+        if (reader_take(r, 1, &byte) != 0) {
+            return -1;
+        }
+        value |= (uint64_t)(*byte & 0x7F) << shift;
+        if ((*byte & 0x80) == 0) {
+            *out = value;
+            return 0;
+        }
+    }
+    return -1; // Over-long varint
+}
+
+static int decode_series(struct io_reader* r, IOBatch* batch)
+{
+    const uint8_t* byte;
+    const uint8_t* name;
+    char name_text[IO_SERIES_NAME_SIZE];
+    uint64_t count;
+
+    if (reader_take(r, 1, &byte) != 0 || *byte >= IO_SERIES_NAME_SIZE) {
+        return -1;
+    }
+    size_t name_length = *byte;
+    if (reader_take(r, name_length, &name) != 0 || memchr(name, '\0', name_length) != NULL) {
+        return -1;
+    }
+    memcpy(name_text, name, name_length);
+    name_text[name_length] = '\0';
+
+    if (reader_take(r, 1, &byte) != 0 || reader_varint(r, &count) != 0) {
+        return -1;
+    }
+    enum io_series_type type = (enum io_series_type)*byte;
+    int index = io_batch_add_series(batch, name_text, type);
+    if (index < 0) {
+        return -1; // Unknown type or duplicate name
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    // Every sample after the first takes at least two bits, which bounds hostile counts
+    size_t bit_length = (r->length - r->offset) * 8;
+    if (bit_length < 128 || (count - 1) > (bit_length - 128) / 2) {
+        return -1;
+    }
+
+    struct bit_reader b = { .data = r->data + r->offset, .bit_length = bit_length };
+    struct dod_state timestamps = { 0 };
+    struct dod_state ints = { 0 };
+    struct xor_state doubles = { .leading = 64 };
+    uint64_t first_value;
+
+    if (bits_get(&b, 64, &timestamps.previous) != 0 || bits_get(&b, 64, &first_value) != 0) {
+        return -1;
+    }
+    if (type == IO_SERIES_INT64) {
+        ints.previous = first_value;
+        io_batch_append_int(batch, index, (int64_t)timestamps.previous, (int64_t)first_value);
+    } else {
+        double value;
+        doubles.previous = first_value;
+        memcpy(&value, &first_value, sizeof(value));
+        io_batch_append_double(batch, index, (int64_t)timestamps.previous, value);
+    }
+
+    for (uint64_t i = 1; i < count; i++) {
+        uint64_t timestamp;
+        int ret;
+        if (gorilla_int(&b, &timestamps, &timestamp) != 0) {
+            return -1;
+        }
+        if (type == IO_SERIES_INT64) {
+            uint64_t value;
+            ret = gorilla_int(&b, &ints, &value);
+            if (ret == 0) {
+                ret = io_batch_append_int(batch, index, (int64_t)timestamp, (int64_t)value);
+            }
+        } else {
+            double value;
+            ret = gorilla_double(&b, &doubles, &value);
+            if (ret == 0) {
+                ret = io_batch_append_double(batch, index, (int64_t)timestamp, value);
+            }
+        }
+        if (ret != 0) {
+            return -1;
+        }
+    }
+
+    r->offset += (b.bit + 7) / 8;
+    return 0;
+}
+
+// Decode a batch encoded with IO_BATCH_FORMAT_GORILLA
+IOBatch* io_batch_deserialize(const uint8_t* data, size_t length)
+{
+    struct io_reader r = { .data = data, .length = length };
+    const uint8_t* version;
+    uint64_t series_count;
+
+    if (data == NULL) {
+        return NULL; // Error: invalid input
+    }
+    if (reader_take(&r, 1, &version) != 0 || *version != IO_BATCH_VERSION || reader_varint(&r, &series_count) != 0
+        || series_count > length) {
+        return NULL;
+    }
+
+    IOBatch* batch = io_batch_create();
+    if (batch == NULL) {
+        return NULL;
+    }
+    for (uint64_t i = 0; i < series_count; i++) {
+        if (decode_series(&r, batch) != 0) {
+            io_batch_destroy(batch);
+            return NULL;
+        }
+    }
+    if (r.offset != r.length) {
+        io_batch_destroy(batch); // Trailing garbage
+        return NULL;
+    }
+    return batch;
+}
@@ -1,13 +1,21 @@
 #include "data/internet_object.h"
 #include "cJSON.h"
+#include "data/serialize.h"
+#include "system/pool.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+void io_init(void)
+{
+    cJSON_Hooks hooks = { iot_pool_alloc, iot_pool_free };
+    cJSON_InitHooks(&hooks);
+}
+
 // Create a new IO and initialize an empty JSON object
 IO* io_create(void)
 {
-    IO* obj = (IO*)malloc(sizeof(IO));
+    IO* obj = (IO*)iot_pool_alloc(sizeof(IO));
     if (obj != NULL) {
         obj->json_obj = cJSON_CreateObject();
     }
@@ -19,7 +27,7 @@ void io_destroy(IO* obj)
 {
     if (obj != NULL) {
         cJSON_Delete(obj->json_obj);
-        free(obj);
+        iot_pool_free(obj);
     }
 }
 
@@ -69,14 +77,50 @@ int io_get_int(IO* obj, const char* key)
     return 0; // Not found or not a number
 }
 
-// Convert the IO to a JSON string (for serialization)
+// Growable output for io_to_string
+struct string_builder {
+    char* data;
+    size_t length;
+    size_t capacity;
+};
+
+static int string_builder_write(void* ctx, const uint8_t* data, size_t length)
+{
+    struct string_builder* sb = (struct string_builder*)ctx;
+
+    if (sb->length + length + 1 > sb->capacity) {
+        size_t capacity = sb->capacity * 2;
+        while (capacity < sb->length + length + 1) {
+            capacity *= 2;
+        }
+        char* grown = (char*)realloc(sb->data, capacity);
+        if (grown == NULL) {
+            return -1;
+        }
+        sb->data = grown;
+        sb->capacity = capacity;
+    }
+    memcpy(sb->data + sb->length, data, length);
+    sb->length += length;
+    return 0;
+}
+
+// Convert the IO to a compact JSON string (for serialization)
 char* io_to_string(IO* obj)
 {
     if (obj == NULL) {
         return NULL; // Error: invalid input
     }
-    char* json_string = cJSON_Print(obj->json_obj);
-    return json_string;
+    struct string_builder sb = { (char*)malloc(256), 0, 256 };
+    if (sb.data == NULL) {
+        return NULL;
+    }
+    if (io_serialize_stream(obj, IO_FORMAT_JSON, string_builder_write, &sb) != 0) {
+        free(sb.data);
+        return NULL;
+    }
+    sb.data[sb.length] = '\0';
+    return sb.data;
 }
 
 // Parse a JSON string into an IO (for deserialization)
@@ -85,13 +129,5 @@ IO* io_from_string(const char* json_string)
     if (json_string == NULL) {
         return NULL; // Error: invalid input
     }
-    IO* obj = (IO*)malloc(sizeof(IO));
-    if (obj != NULL) {
-        obj->json_obj = cJSON_Parse(json_string);
-        if (obj->json_obj == NULL) {
-            free(obj);
-            return NULL; // Error: invalid JSON string
-        }
-    }
-    return obj;
+    return io_deserialize((const uint8_t*)json_string, strlen(json_string), IO_FORMAT_JSON);
 }
@@ -0,0 +1,449 @@
+#include "data/json_simd.h"
+#include <stdatomic.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IO_SIMD_X86 1
+#else
+#define IO_SIMD_X86 0
+#endif
+
+// Scalar kernels, also used for short inputs by the vector kernels
+
+// Byte classes for the scalar scanners
+#define CLASS_ESCAPE 0x01
+#define CLASS_WHITESPACE 0x02
+#define CLASS_STRUCTURAL 0x04
+
+// Class of every byte below 0x80; bytes with the high bit set have none
+static const uint8_t byte_classes[256] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 1, 1, 3, 1, 1, // 0x00: controls, \t \n \r
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x10: controls
+    2, 0, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 0, 0, // 0x20: ' ' '"' ','
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 0, 0, 0, 0, // 0x30: ':'
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x40
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 1, 4, 0, 0, // 0x50: '[' '\\' ']'
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x60
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 4, 0, 0, // 0x70: '{' '}'
+};
+
+static size_t find_escape_scalar(const char* str, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        if (byte_classes[(uint8_t)str[i]] & CLASS_ESCAPE) {
+            return i;
+        }
+    }
+    return length;
+}
+
+static size_t skip_whitespace_scalar(const char* str, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        if (!(byte_classes[(uint8_t)str[i]] & CLASS_WHITESPACE)) {
+            return i;
+        }
+    }
+    return length;
+}
+
+static size_t find_structural_scalar(const char* str, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        if (byte_classes[(uint8_t)str[i]] & CLASS_STRUCTURAL) {
+            return i;
+        }
+    }
+    return length;
+}
+
+// Length of the well-formed UTF-8 sequence at str, or 0 if it is invalid
+static size_t utf8_sequence(const uint8_t* str, size_t length)
+{
+    uint8_t c = str[0];
+    size_t need;
+
+    if (c < 0x80) {
+        return 1;
+    } else if (c < 0xC2) {
+        return 0; // Stray continuation byte or overlong two-byte form
+    } else if (c < 0xE0) {
+        need = 2;
+    } else if (c < 0xF0) {
+        need = 3;
+    } else if (c < 0xF5) {
+        need = 4;
+    } else {
+        return 0;
+    }
+
+    if (length < need) {
+        return 0;
+    }
+    for (size_t i = 1; i < need; i++) {
+        if ((str[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+    if ((c == 0xE0 && str[1] < 0xA0) // Overlong three-byte form
+        || (c == 0xED && str[1] >= 0xA0) // UTF-16 surrogate
+        || (c == 0xF0 && str[1] < 0x90) // Overlong four-byte form
+        || (c == 0xF4 && str[1] >= 0x90)) { // Beyond U+10FFFF
+        return 0;
+    }
+    return need;
+}
+
+static bool utf8_valid_scalar(const uint8_t* str, size_t length)
+{
+    size_t i = 0;
+    while (i < length) {
+        // Eight ASCII bytes at a time
+        uint64_t word;
+        if (length - i >= 8) {
+            memcpy(&word, str + i, sizeof(word));
+            if ((word & 0x8080808080808080ULL) == 0) {
+                i += 8;
+                continue;
+            }
+        }
+        size_t n = utf8_sequence(str + i, length - i);
+        if (n == 0) {
+            return false;
+        }
+        i += n;
+    }
+    return true;
+}
+
+static const struct io_json_kernels scalar_kernels = {
+    IO_SIMD_SCALAR,
+    "scalar",
+    find_escape_scalar,
+    skip_whitespace_scalar,
+    find_structural_scalar,
+    utf8_valid_scalar,
+};
+
+#if IO_SIMD_X86
+
+/*
+ * Vector scanners. Inputs shorter than one vector go to the narrower level
+ * before any wide register is touched, and the final partial block is
+ * handled by re-reading the last full vector and dropping the bits for
+ * bytes that were already checked, so no scan ever calls out for its tail.
+ */
+#define IO_SIMD_SCAN(name, isa, width, load, hits, fallback)                       \
+    __attribute__((target(isa))) static size_t name(const char* str, size_t length) \
+    {                                                                               \
+        if (length < (width)) {                                                     \
+            return fallback(str, length);                                           \
+        }                                                                           \
+        size_t i = 0;                                                               \
+        for (; i + (width) <= length; i += (width)) {                               \
+            uint32_t mask = hits(load(str + i));                                    \
+            if (mask != 0) {                                                        \
+                return i + (size_t)__builtin_ctz(mask);                             \
+            }                                                                       \
+        }                                                                           \
+        if (i == length) {                                                          \
+            return length;                                                          \
+        }                                                                           \
+        uint32_t mask = hits(load(str + length - (width))) >> (i - (length - (width))); \
+        return mask != 0 ? i + (size_t)__builtin_ctz(mask) : length;                \
+    }
+
+// SSE2 kernels (16 bytes per step)
+
+__attribute__((target("sse2"))) static __m128i load_sse2(const char* str)
+{
+    return _mm_loadu_si128((const __m128i*)str);
+}
+
+__attribute__((target("sse2"))) static uint32_t escape_mask_sse2(__m128i v)
+{
+    __m128i quote = _mm_cmpeq_epi8(v, _mm_set1_epi8('"'));
+    __m128i backslash = _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'));
+    __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1F)), v); // v <= 0x1F
+    return (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(quote, backslash), control));
+}
+
+__attribute__((target("sse2"))) static uint32_t non_whitespace_mask_sse2(__m128i v)
+{
+    __m128i space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    __m128i tab = _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'));
+    __m128i newline = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+    __m128i carriage = _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'));
+    __m128i whitespace = _mm_or_si128(_mm_or_si128(space, tab), _mm_or_si128(newline, carriage));
+    return ~(uint32_t)_mm_movemask_epi8(whitespace) & 0xFFFFu;
+}
+
+__attribute__((target("sse2"))) static uint32_t structural_mask_sse2(__m128i v)
+{
+    __m128i braces = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('{')), _mm_cmpeq_epi8(v, _mm_set1_epi8('}')));
+    __m128i brackets = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('[')), _mm_cmpeq_epi8(v, _mm_set1_epi8(']')));
+    __m128i separators = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')), _mm_cmpeq_epi8(v, _mm_set1_epi8(',')));
+    __m128i hits = _mm_or_si128(_mm_or_si128(braces, brackets),
+        _mm_or_si128(separators, _mm_cmpeq_epi8(v, _mm_set1_epi8('"'))));
+    return (uint32_t)_mm_movemask_epi8(hits);
+}
+
+IO_SIMD_SCAN(find_escape_sse2, "sse2", 16, load_sse2, escape_mask_sse2, find_escape_scalar)
+IO_SIMD_SCAN(skip_whitespace_sse2, "sse2", 16, load_sse2, non_whitespace_mask_sse2, skip_whitespace_scalar)
+IO_SIMD_SCAN(find_structural_sse2, "sse2", 16, load_sse2, structural_mask_sse2, find_structural_scalar)
+
+__attribute__((target("sse2"))) static bool utf8_valid_sse2(const uint8_t* str, size_t length)
+{
+    size_t i = 0;
+    while (i + 16 <= length) {
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(str + i)));
+        if (mask == 0) {
+            i += 16;
+            continue;
+        }
+        // Validate the first multi-byte sequence, then resume vector scanning after it
+        i += (size_t)__builtin_ctz(mask);
+        size_t n = utf8_sequence(str + i, length - i);
+        if (n == 0) {
+            return false;
+        }
+        i += n;
+    }
+    return utf8_valid_scalar(str + i, length - i);
+}
+
+static const struct io_json_kernels sse2_kernels = {
+    IO_SIMD_SSE2,
+    "sse2",
+    find_escape_sse2,
+    skip_whitespace_sse2,
+    find_structural_sse2,
+    utf8_valid_sse2,
+};
+
+// AVX2 kernels (32 bytes per step)
+
+__attribute__((target("avx2"))) static __m256i load_avx2(const char* str)
+{
+    return _mm256_loadu_si256((const __m256i*)str);
+}
+
+__attribute__((target("avx2"))) static uint32_t escape_mask_avx2(__m256i v)
+{
+    __m256i quote = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'));
+    __m256i backslash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'));
+    __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1F)), v);
+    return (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(quote, backslash), control));
+}
+
+__attribute__((target("avx2"))) static uint32_t non_whitespace_mask_avx2(__m256i v)
+{
+    __m256i space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+    __m256i tab = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'));
+    __m256i newline = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+    __m256i carriage = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'));
+    __m256i whitespace = _mm256_or_si256(_mm256_or_si256(space, tab), _mm256_or_si256(newline, carriage));
+    return ~(uint32_t)_mm256_movemask_epi8(whitespace);
+}
+
+__attribute__((target("avx2"))) static uint32_t structural_mask_avx2(__m256i v)
+{
+    __m256i braces = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('}')));
+    __m256i brackets = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('[')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(']')));
+    __m256i separators = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(',')));
+    __m256i hits = _mm256_or_si256(_mm256_or_si256(braces, brackets),
+        _mm256_or_si256(separators, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))));
+    return (uint32_t)_mm256_movemask_epi8(hits);
+}
+
+IO_SIMD_SCAN(find_escape_avx2, "avx2", 32, load_avx2, escape_mask_avx2, find_escape_sse2)
+IO_SIMD_SCAN(skip_whitespace_avx2, "avx2", 32, load_avx2, non_whitespace_mask_avx2, skip_whitespace_sse2)
+IO_SIMD_SCAN(find_structural_avx2, "avx2", 32, load_avx2, structural_mask_avx2, find_structural_sse2)
+
+/*
+ * UTF-8 validation after Keiser and Lemire, "Validating UTF-8 In Less Than
+ * One Instruction Per Byte". Each byte is checked against the one or two
+ * bytes before it with three nibble lookups; errors are bit flags that
+ * survive the AND only when all three lookups agree.
+ */
+#define UTF8_TOO_SHORT (1 << 0) // Lead byte not followed by a continuation
+#define UTF8_TOO_LONG (1 << 1) // ASCII followed by a continuation
+#define UTF8_OVERLONG_3 (1 << 2) // 11100000 100_____
+#define UTF8_TOO_LARGE (1 << 3) // 11110100 1001____ and above
+#define UTF8_SURROGATE (1 << 4) // 11101101 101_____
+#define UTF8_OVERLONG_2 (1 << 5) // 1100000_ 10______
+#define UTF8_TOO_LARGE_1000 (1 << 6) // 11110101+ 1000____
+#define UTF8_OVERLONG_4 (1 << 6) // 11110000 1000____
+#define UTF8_TWO_CONTS (1 << 7) // Two continuations in a row (checked below)
+#define UTF8_CARRY (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+#define UTF8_TABLE(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p)                        \
+    _mm256_setr_epi8((char)(a), (char)(b), (char)(c), (char)(d), (char)(e), (char)(f),     \
+        (char)(g), (char)(h), (char)(i), (char)(j), (char)(k), (char)(l), (char)(m),      \
+        (char)(n), (char)(o), (char)(p), (char)(a), (char)(b), (char)(c), (char)(d),      \
+        (char)(e), (char)(f), (char)(g), (char)(h), (char)(i), (char)(j), (char)(k),      \
+        (char)(l), (char)(m), (char)(n), (char)(o), (char)(p))
+
+// The 32 bytes ending 'n' bytes before the start of input
+__attribute__((target("avx2"))) static __m256i utf8_prev_avx2(__m256i input, __m256i prev_input, int n)
+{
+    __m256i straddle = _mm256_permute2x128_si256(prev_input, input, 0x21);
+    switch (n) {
+    case 1:
+        return _mm256_alignr_epi8(input, straddle, 15);
+    case 2:
+        return _mm256_alignr_epi8(input, straddle, 14);
+    default:
+        return _mm256_alignr_epi8(input, straddle, 13);
+    }
+}
+
+__attribute__((target("avx2"))) static __m256i utf8_block_errors_avx2(__m256i input, __m256i prev_input)
+{
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i byte_1_high_table = UTF8_TABLE(
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+        UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+        UTF8_TOO_SHORT,
+        UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+        UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4);
+    const __m256i byte_1_low_table = UTF8_TABLE(
+        UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+        UTF8_CARRY | UTF8_OVERLONG_2,
+        UTF8_CARRY,
+        UTF8_CARRY,
+        UTF8_CARRY | UTF8_TOO_LARGE,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000);
+    const __m256i byte_2_high_table = UTF8_TABLE(
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT);
+
+    __m256i prev1 = utf8_prev_avx2(input, prev_input, 1);
+    __m256i byte_1_high = _mm256_shuffle_epi8(byte_1_high_table, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+    __m256i byte_1_low = _mm256_shuffle_epi8(byte_1_low_table, _mm256_and_si256(prev1, nibble));
+    __m256i byte_2_high = _mm256_shuffle_epi8(byte_2_high_table, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+    __m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    // Third and fourth bytes of a sequence must be continuations; that is
+    // exactly the case where the lookups above flagged TWO_CONTS
+    __m256i third = _mm256_subs_epu8(utf8_prev_avx2(input, prev_input, 2), _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(utf8_prev_avx2(input, prev_input, 3), _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must_continue, special);
+}
+
+// Non-zero where the last bytes of a block start a sequence it cannot finish
+__attribute__((target("avx2"))) static __m256i utf8_incomplete_avx2(__m256i input)
+{
+    const __m256i limits = _mm256_setr_epi8(
+        (char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255,
+        (char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255,
+        (char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255,
+        (char)255, (char)255, (char)255, (char)255, (char)255,
+        (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+    return _mm256_subs_epu8(input, limits);
+}
+
+__attribute__((target("avx2"))) static bool utf8_valid_avx2(const uint8_t* str, size_t length)
+{
+    if (length < 32) {
+        return utf8_valid_sse2(str, length);
+    }
+
+    __m256i error = _mm256_setzero_si256();
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+    size_t i = 0;
+
+    while (i < length) {
+        __m256i input;
+        if (length - i >= 32) {
+            input = _mm256_loadu_si256((const __m256i*)(str + i));
+        } else {
+            // Zero padding is ASCII, so a truncated final sequence is still caught
+            uint8_t tail[32] = { 0 };
+            memcpy(tail, str + i, length - i);
+            input = _mm256_loadu_si256((const __m256i*)tail);
+        }
+        i += 32;
+
+        if (_mm256_movemask_epi8(input) == 0) {
+            // All ASCII: only a sequence left open by the previous block can fail
+            error = _mm256_or_si256(error, prev_incomplete);
+        } else {
+            error = _mm256_or_si256(error, utf8_block_errors_avx2(input, prev_input));
+            prev_incomplete = utf8_incomplete_avx2(input);
+        }
+        prev_input = input;
+    }
+    error = _mm256_or_si256(error, prev_incomplete);
+    return _mm256_testz_si256(error, error) != 0;
+}
+
+static const struct io_json_kernels avx2_kernels = {
+    IO_SIMD_AVX2,
+    "avx2",
+    find_escape_avx2,
+    skip_whitespace_avx2,
+    find_structural_avx2,
+    utf8_valid_avx2,
+};
+
+#endif // IO_SIMD_X86
+
+// Kernels for a specific level, or NULL if unsupported by the build or CPU
+const struct io_json_kernels* io_json_kernels_for(enum io_simd_level level)
+{
+    switch (level) {
+    case IO_SIMD_SCALAR:
+        return &scalar_kernels;
+#if IO_SIMD_X86
+    case IO_SIMD_SSE2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2") ? &sse2_kernels : NULL;
+    case IO_SIMD_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? &avx2_kernels : NULL;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+// Kernels for the best level the running CPU supports (selected once)
+const struct io_json_kernels* io_json_kernels(void)
+{
+    static _Atomic(const struct io_json_kernels*) selected = NULL;
+
+    const struct io_json_kernels* kernels = atomic_load_explicit(&selected, memory_order_relaxed);
+    if (kernels == NULL) {
+        kernels = io_json_kernels_for(IO_SIMD_AVX2);
+        if (kernels == NULL) {
+            kernels = io_json_kernels_for(IO_SIMD_SSE2);
+        }
+        if (kernels == NULL) {
+            kernels = &scalar_kernels;
+        }
+        // Every thread computes the same answer, so a racing store is harmless
+        atomic_store_explicit(&selected, kernels, memory_order_relaxed);
+    }
+    return kernels;
+}
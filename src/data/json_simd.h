@@ -0,0 +1,44 @@
+#ifndef IOT_DATA_JSON_SIMD_H
+#define IOT_DATA_JSON_SIMD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Instruction set levels the JSON kernels are built for
+enum io_simd_level {
+    IO_SIMD_SCALAR,
+    IO_SIMD_SSE2,
+    IO_SIMD_AVX2
+};
+
+// Byte-scanning kernels used by the JSON writer and parser. Every find/skip
+// function returns an index in [0, length]; length means "not found".
+struct io_json_kernels {
+    enum io_simd_level level;
+    const char* name;
+    // First byte that must be escaped inside a JSON string: '"', '\\' or < 0x20
+    size_t (*find_escape)(const char* str, size_t length);
+    // First byte that is not JSON whitespace
+    size_t (*skip_whitespace)(const char* str, size_t length);
+    // First structural byte: { } [ ] : , or '"'
+    size_t (*find_structural)(const char* str, size_t length);
+    // Whether the bytes are well-formed UTF-8 (no overlongs or surrogates)
+    bool (*utf8_valid)(const uint8_t* str, size_t length);
+};
+
+// Kernels for the best level the running CPU supports (selected once)
+const struct io_json_kernels* io_json_kernels(void);
+
+// Kernels for a specific level, or NULL if unsupported by the build or CPU
+const struct io_json_kernels* io_json_kernels_for(enum io_simd_level level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOT_DATA_JSON_SIMD_H
@@ -0,0 +1,282 @@
+#include "data/numconv.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char digit_pairs[] = "00010203040506070809"
+                                  "10111213141516171819"
+                                  "20212223242526272829"
+                                  "30313233343536373839"
+                                  "40414243444546474849"
+                                  "50515253545556575859"
+                                  "60616263646566676869"
+                                  "70717273747576777879"
+                                  "80818283848586878889"
+                                  "90919293949596979899";
+
+// Powers of ten that are exact in a double
+static const double exact_powers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define MAX_EXACT_INTEGER 9007199254740992.0 // 2^53
+
+// Write the digits of u right-aligned so that they end at 'end'
+static char* format_digits(char* end, uint64_t u)
+{
+    while (u >= 100) {
+        end -= 2;
+        memcpy(end, &digit_pairs[(u % 100) * 2], 2);
+        u /= 100;
+    }
+    if (u >= 10) {
+        end -= 2;
+        memcpy(end, &digit_pairs[u * 2], 2);
+    } else {
+        *--end = (char)('0' + u);
+    }
+    return end;
+}
+
+size_t io_format_int64(char* out, int64_t value)
+{
+    char text[IO_INT64_TEXT_SIZE];
+    char* end = text + sizeof(text);
+    uint64_t u = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+
+    char* p = format_digits(end, u);
+    if (value < 0) {
+        *--p = '-';
+    }
+    size_t length = (size_t)(end - p);
+    memcpy(out, p, length);
+    return length;
+}
+
+size_t io_format_double(char* out, double value)
+{
+    if (isnan(value) || isinf(value)) {
+        memcpy(out, "null", 4);
+        return 4;
+    }
+
+    double magnitude = fabs(value);
+    if (magnitude == floor(magnitude) && magnitude < MAX_EXACT_INTEGER) {
+        return io_format_int64(out, (int64_t)value);
+    }
+
+    // Find the fewest fraction digits k such that n / 10^k is exactly value.
+    // n and 10^k are both exact, and IEEE division rounds correctly, so
+    // this is the same test a correct strtod would apply to the text.
+    if (magnitude >= 1e-5 && magnitude < 1e15) {
+        for (int k = 1; k <= 17; k++) {
+            double scaled = magnitude * exact_powers[k];
+            if (scaled >= MAX_EXACT_INTEGER) {
+                break;
+            }
+            double n = nearbyint(scaled);
+            if (n / exact_powers[k] != magnitude) {
+                continue;
+            }
+
+            char text[IO_DOUBLE_TEXT_SIZE + 24];
+            char* end = text + sizeof(text);
+            char* p = format_digits(end, (uint64_t)n);
+            while (end - p <= k) {
+                *--p = '0'; // Leading zeros of a value below one
+            }
+            // Shift the integer part left by one to open a slot for the point
+            size_t int_digits = (size_t)(end - p) - (size_t)k;
+            memmove(p - 1, p, int_digits);
+            p--;
+            p[int_digits] = '.';
+            if (value < 0) {
+                *--p = '-';
+            }
+            size_t length = (size_t)(end - p);
+            memcpy(out, p, length);
+            return length;
+        }
+    }
+
+    // Same shortest-round-trip strategy cJSON uses
+    int length = snprintf(out, IO_DOUBLE_TEXT_SIZE, "%1.15g", value);
+    if (strtod(out, NULL) != value) {
+        length = snprintf(out, IO_DOUBLE_TEXT_SIZE, "%1.17g", value);
+    }
+    return (size_t)length;
+}
+
+int io_parse_number(const char* text, size_t length, size_t* consumed,
+    bool* is_integer, int64_t* integer, double* number)
+{
+    size_t i = 0;
+    bool negative = false;
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool fraction = false;
+
+    if (i < length && text[i] == '-') {
+        negative = true;
+        i++;
+    }
+    size_t int_start = i;
+    while (i < length && text[i] >= '0' && text[i] <= '9') {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (uint64_t)(text[i] - '0');
+            if (mantissa != 0) {
+                digits++;
+            }
+        } else {
+            exponent++;
+        }
+        i++;
+    }
+    if (i == int_start || (text[int_start] == '0' && i - int_start > 1)) {
+        return -1; // No digits, or a leading zero
+    }
+    if (i < length && text[i] == '.') {
+        size_t frac_start = ++i;
+        fraction = true;
+        while (i < length && text[i] >= '0' && text[i] <= '9') {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (uint64_t)(text[i] - '0');
+                if (mantissa != 0) {
+                    digits++;
+                }
+                exponent--;
+            }
+            i++;
+        }
+        if (i == frac_start) {
+            return -1;
+        }
+    }
+    if (i < length && (text[i] == 'e' || text[i] == 'E')) {
+        bool exp_negative = false;
+        int exp_value = 0;
+        fraction = true;
+        i++;
+        if (i < length && (text[i] == '+' || text[i] == '-')) {
+            exp_negative = text[i] == '-';
+            i++;
+        }
+        size_t exp_start = i;
+        while (i < length && text[i] >= '0' && text[i] <= '9') {
+            if (exp_value < 10000) {
+                exp_value = exp_value * 10 + (text[i] - '0');
+            }
+            i++;
+        }
+        if (i == exp_start) {
+            return -1;
+        }
+        exponent += exp_negative ? -exp_value : exp_value;
+    }
+    *consumed = i;
+
+    *is_integer = false;
+    if (!fraction && exponent == 0 && mantissa <= (uint64_t)INT64_MAX + (negative ? 1 : 0)) {
+        *is_integer = true;
+        *integer = negative ? (int64_t)(0 - mantissa) : (int64_t)mantissa;
+        *number = (double)*integer;
+        return 0;
+    }
+
+    // Clinger's fast path: both operands exact, so one rounding gives the right answer
+    if (mantissa <= (uint64_t)MAX_EXACT_INTEGER && exponent >= -22 && exponent <= 22) {
+        double value = (double)mantissa;
+        value = exponent < 0 ? value / exact_powers[-exponent] : value * exact_powers[exponent];
+        *number = negative ? -value : value;
+        return 0;
+    }
+
+    // strtod needs the text terminated; only unusually long numbers go to the heap
+    char buffer[64];
+    char* copy = i < sizeof(buffer) ? buffer : (char*)malloc(i + 1);
+    if (copy == NULL) {
+        return -1;
+    }
+    memcpy(copy, text, i);
+    copy[i] = '\0';
+    *number = strtod(copy, NULL);
+    if (copy != buffer) {
+        free(copy);
+    }
+    return 0;
+}
+
+static int parse_hex4(const char* text, uint32_t* out)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = text[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= (uint32_t)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            value |= (uint32_t)(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            value |= (uint32_t)(c - 'A' + 10);
+        } else {
+            return -1;
+        }
+    }
+    *out = value;
+    return 0;
+}
+
+size_t io_format_utf8(char* out, uint32_t cp)
+{
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+int io_parse_unicode_escape(const char* text, size_t length, size_t* consumed, uint32_t* cp)
+{
+    uint32_t high;
+    uint32_t low;
+
+    if (length < 6 || parse_hex4(text + 2, &high) != 0) {
+        return -1;
+    }
+    if (high >= 0xDC00 && high <= 0xDFFF) {
+        return -1; // Lone low surrogate
+    }
+    if (high >= 0xD800 && high <= 0xDBFF) {
+        if (length < 12 || text[6] != '\\' || text[7] != 'u' || parse_hex4(text + 8, &low) != 0
+            || low < 0xDC00 || low > 0xDFFF) {
+            return -1; // High surrogate without its pair
+        }
+        *cp = 0x10000 + ((high - 0xD800) << 10) + (low - 0xDC00);
+        *consumed = 12;
+        return 0;
+    }
+    if (high == 0) {
+        return -1; // Decoded strings are NUL-terminated
+    }
+    *cp = high;
+    *consumed = 6;
+    return 0;
+}
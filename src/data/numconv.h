@@ -0,0 +1,32 @@
+#ifndef IOT_DATA_NUMCONV_H
+#define IOT_DATA_NUMCONV_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Buffer sizes large enough for any output of the formatters below
+#define IO_INT64_TEXT_SIZE 21
+#define IO_DOUBLE_TEXT_SIZE 32
+
+// Write the decimal form of an integer, returning its length (no NUL)
+size_t io_format_int64(char* out, int64_t value);
+
+// Write the shortest JSON text that parses back to the same double,
+// returning its length (no NUL). NaN and infinities become "null".
+size_t io_format_double(char* out, double value);
+
+// Parse a JSON number at the start of text. On success *consumed is the
+// number of bytes used; integers that fit int64 also set *is_integer.
+int io_parse_number(const char* text, size_t length, size_t* consumed,
+    bool* is_integer, int64_t* integer, double* number);
+
+// Write a code point as UTF-8, returning its length (1 to 4 bytes, no NUL)
+size_t io_format_utf8(char* out, uint32_t cp);
+
+// Decode the \uXXXX escape at text[0] == '\\': exactly four hex digits, and
+// for a high surrogate the \uXXXX low surrogate that must follow. On success
+// *consumed is 6 or 12. Lone surrogates and U+0000 are rejected.
+int io_parse_unicode_escape(const char* text, size_t length, size_t* consumed, uint32_t* cp);
+
+#endif // IOT_DATA_NUMCONV_H
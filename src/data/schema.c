@@ -0,0 +1,739 @@
+#include "data/schema.h"
+#include "data/numconv.h"
+#include <math.h>
+#include <stdlib.h>
+
+// Length of a possibly unterminated string stored in a char[size] field
+static size_t bounded_length(const char* value, size_t size)
+{
+    const char* nul = (const char*)memchr(value, '\0', size);
+    return nul != NULL ? (size_t)(nul - value) : size;
+}
+
+void io_schema_put(struct io_schema_writer* w, const void* data, size_t length)
+{
+    // After the first miss only sizes are accumulated, so output never has holes
+    if (w->overflow != 0 || (size_t)(w->end - w->pos) < length) {
+        w->overflow += length;
+        return;
+    }
+    memcpy(w->pos, data, length);
+    w->pos += length;
+}
+
+void io_schema_json_int64(struct io_schema_writer* w, int64_t value)
+{
+    char text[IO_INT64_TEXT_SIZE];
+    io_schema_put(w, text, io_format_int64(text, value));
+}
+
+void io_schema_json_double(struct io_schema_writer* w, double value)
+{
+    char text[IO_DOUBLE_TEXT_SIZE];
+    io_schema_put(w, text, io_format_double(text, value));
+}
+
+void io_schema_json_bool(struct io_schema_writer* w, bool value)
+{
+    if (value) {
+        io_schema_put(w, "true", 4);
+    } else {
+        io_schema_put(w, "false", 5);
+    }
+}
+
+void io_schema_json_string(struct io_schema_writer* w, const char* value, size_t size)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t length = bounded_length(value, size);
+    size_t run = 0;
+
+    io_schema_put(w, "\"", 1);
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)value[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        io_schema_put(w, value + run, i - run);
+        run = i + 1;
+        if (c == '"' || c == '\\') {
+            char escape[2] = { '\\', (char)c };
+            io_schema_put(w, escape, sizeof(escape));
+        } else {
+            char escape[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+            io_schema_put(w, escape, sizeof(escape));
+        }
+    }
+    io_schema_put(w, value + run, length - run);
+    io_schema_put(w, "\"", 1);
+}
+
+void io_schema_json_end(struct io_schema_writer* w, uint8_t* start)
+{
+    // Every key literal starts with ',', so the first one becomes the opening brace
+    if (w->pos > start) {
+        *start = '{';
+    } else if (w->overflow == 0) {
+        io_schema_put(w, "{", 1);
+    }
+    io_schema_put(w, "}", 1);
+}
+
+// Write a MessagePack tag followed by a big-endian value of 'size' bytes
+static void msgpack_tagged(struct io_schema_writer* w, uint8_t tag, uint64_t value, size_t size)
+{
+    uint8_t out[9];
+    out[0] = tag;
+    for (size_t i = 0; i < size; i++) {
+        out[size - i] = (uint8_t)(value >> (8 * i));
+    }
+    io_schema_put(w, out, size + 1);
+}
+
+void io_schema_msgpack_map(struct io_schema_writer* w, size_t count)
+{
+    if (count < 16) {
+        uint8_t tag = (uint8_t)(0x80 | count);
+        io_schema_put(w, &tag, 1);
+    } else {
+        msgpack_tagged(w, 0xDE, count, 2);
+    }
+}
+
+void io_schema_msgpack_key(struct io_schema_writer* w, const char* key, size_t key_length)
+{
+    uint8_t tag = (uint8_t)(0xA0 | key_length);
+    io_schema_put(w, &tag, 1);
+    io_schema_put(w, key, key_length);
+}
+
+void io_schema_msgpack_int64(struct io_schema_writer* w, int64_t value)
+{
+    if (value >= 0) {
+        uint64_t u = (uint64_t)value;
+        if (u <= 0x7F) {
+            uint8_t tag = (uint8_t)u;
+            io_schema_put(w, &tag, 1);
+        } else if (u <= 0xFF) {
+            msgpack_tagged(w, 0xCC, u, 1);
+        } else if (u <= 0xFFFF) {
+            msgpack_tagged(w, 0xCD, u, 2);
+        } else if (u <= 0xFFFFFFFF) {
+            msgpack_tagged(w, 0xCE, u, 4);
+        } else {
+            msgpack_tagged(w, 0xCF, u, 8);
+        }
+    } else if (value >= -32) {
+        uint8_t tag = (uint8_t)(0xE0 | (value & 0x1F));
+        io_schema_put(w, &tag, 1);
+    } else if (value >= INT8_MIN) {
+        msgpack_tagged(w, 0xD0, (uint64_t)value, 1);
+    } else if (value >= INT16_MIN) {
+        msgpack_tagged(w, 0xD1, (uint64_t)value, 2);
+    } else if (value >= INT32_MIN) {
+        msgpack_tagged(w, 0xD2, (uint64_t)value, 4);
+    } else {
+        msgpack_tagged(w, 0xD3, (uint64_t)value, 8);
+    }
+}
+
+void io_schema_msgpack_double(struct io_schema_writer* w, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    msgpack_tagged(w, 0xCB, bits, 8);
+}
+
+void io_schema_msgpack_bool(struct io_schema_writer* w, bool value)
+{
+    uint8_t tag = value ? 0xC3 : 0xC2;
+    io_schema_put(w, &tag, 1);
+}
+
+void io_schema_msgpack_string(struct io_schema_writer* w, const char* value, size_t size)
+{
+    size_t length = bounded_length(value, size);
+    if (length < 32) {
+        uint8_t tag = (uint8_t)(0xA0 | length);
+        io_schema_put(w, &tag, 1);
+    } else if (length <= 0xFF) {
+        msgpack_tagged(w, 0xD9, length, 1);
+    } else if (length <= 0xFFFF) {
+        msgpack_tagged(w, 0xDA, length, 2);
+    } else {
+        msgpack_tagged(w, 0xDB, length, 4);
+    }
+    io_schema_put(w, value, length);
+}
+
+// Decoding
+
+// Parsed scalar handed from a format-specific reader to store_field
+struct schema_value {
+    enum {
+        VALUE_NULL,
+        VALUE_INT,
+        VALUE_DOUBLE,
+        VALUE_BOOL,
+        VALUE_STRING
+    } type;
+    int64_t integer;
+    double number;
+    const char* str;
+    size_t str_length;
+    bool str_escaped;
+};
+
+struct schema_reader {
+    const uint8_t* pos;
+    const uint8_t* end;
+};
+
+// Find a field by key, starting after the previous match since keys usually arrive in order
+static const struct io_schema_field* find_field(const struct io_schema_field* fields, size_t field_count,
+    size_t* hint, const char* key, size_t key_length)
+{
+    for (size_t n = 0; n < field_count; n++) {
+        size_t i = (*hint + n) % field_count;
+        if (fields[i].name_length == key_length && memcmp(fields[i].name, key, key_length) == 0) {
+            *hint = i + 1;
+            return &fields[i];
+        }
+    }
+    return NULL;
+}
+
+// Copy a JSON string body into dst, resolving escapes; fails if it does not fit
+static int unescape_json(char* dst, size_t size, const char* src, size_t length)
+{
+    size_t out = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)src[i];
+        if (c == '\\') {
+            if (i + 1 >= length) {
+                return -1;
+            }
+            switch (src[i + 1]) {
+            case '"':
+            case '\\':
+            case '/':
+                c = (unsigned char)src[i + 1];
+                break;
+            case 'b':
+                c = '\b';
+                break;
+            case 'f':
+                c = '\f';
+                break;
+            case 'n':
+                c = '\n';
+                break;
+            case 'r':
+                c = '\r';
+                break;
+            case 't':
+                c = '\t';
+                break;
+            case 'u': {
+                char utf8[4];
+                size_t consumed;
+                uint32_t cp;
+                if (io_parse_unicode_escape(src + i, length - i, &consumed, &cp) != 0) {
+                    return -1;
+                }
+                size_t n = io_format_utf8(utf8, cp);
+                if (out + n >= size) {
+                    return -1;
+                }
+                memcpy(dst + out, utf8, n);
+                out += n;
+                i += consumed - 1;
+                continue;
+            }
+            default:
+                return -1;
+            }
+            i++;
+        }
+        if (out + 1 >= size) {
+            return -1;
+        }
+        dst[out++] = (char)c;
+    }
+    dst[out] = '\0';
+    return 0;
+}
+
+static int store_field(const struct io_schema_field* field, void* msg, const struct schema_value* v)
+{
+    uint8_t* dst = (uint8_t*)msg + field->offset;
+    int64_t integer;
+    double number;
+
+    if (v->type == VALUE_NULL) {
+        return 0; // Leave the zeroed default
+    }
+
+    if (field->kind == IO_SCHEMA_KIND_STRING) {
+        if (v->type != VALUE_STRING) {
+            return -1;
+        }
+        if (v->str_escaped) {
+            return unescape_json((char*)dst, field->size, v->str, v->str_length);
+        }
+        if (v->str_length >= field->size || memchr(v->str, '\0', v->str_length) != NULL) {
+            return -1;
+        }
+        memcpy(dst, v->str, v->str_length);
+        dst[v->str_length] = '\0';
+        return 0;
+    }
+
+    if (field->kind == IO_SCHEMA_KIND_BOOL) {
+        if (v->type != VALUE_BOOL) {
+            return -1;
+        }
+        bool flag = v->integer != 0;
+        memcpy(dst, &flag, sizeof(flag));
+        return 0;
+    }
+
+    if (v->type == VALUE_INT) {
+        integer = v->integer;
+        number = (double)v->integer;
+    } else if (v->type == VALUE_DOUBLE) {
+        number = v->number;
+        if (field->kind != IO_SCHEMA_KIND_DOUBLE) {
+            if (number != floor(number) || number < -9223372036854775808.0 || number >= 9223372036854775808.0) {
+                return -1;
+            }
+            integer = (int64_t)number;
+        } else {
+            integer = 0;
+        }
+    } else {
+        return -1;
+    }
+
+    switch (field->kind) {
+    case IO_SCHEMA_KIND_INT32: {
+        if (integer < INT32_MIN || integer > INT32_MAX) {
+            return -1;
+        }
+        int32_t out = (int32_t)integer;
+        memcpy(dst, &out, sizeof(out));
+        return 0;
+    }
+    case IO_SCHEMA_KIND_UINT32: {
+        if (integer < 0 || integer > (int64_t)UINT32_MAX) {
+            return -1;
+        }
+        uint32_t out = (uint32_t)integer;
+        memcpy(dst, &out, sizeof(out));
+        return 0;
+    }
+    case IO_SCHEMA_KIND_INT64:
+        memcpy(dst, &integer, sizeof(integer));
+        return 0;
+    case IO_SCHEMA_KIND_DOUBLE:
+        memcpy(dst, &number, sizeof(number));
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+// JSON
+
+static void json_skip_ws(struct schema_reader* r)
+{
+    while (r->pos < r->end && (*r->pos == ' ' || *r->pos == '\t' || *r->pos == '\n' || *r->pos == '\r')) {
+        r->pos++;
+    }
+}
+
+// Scan a string body, leaving r->pos after the closing quote
+static int json_string(struct schema_reader* r, const char** str, size_t* length, bool* escaped)
+{
+    if (r->pos >= r->end || *r->pos != '"') {
+        return -1;
+    }
+    const uint8_t* start = ++r->pos;
+    *escaped = false;
+    while (r->pos < r->end && *r->pos != '"') {
+        if (*r->pos < 0x20) {
+            return -1;
+        }
+        if (*r->pos == '\\') {
+            *escaped = true;
+            r->pos++;
+        }
+        r->pos++;
+    }
+    if (r->pos >= r->end) {
+        return -1;
+    }
+    *str = (const char*)start;
+    *length = (size_t)(r->pos - start);
+    r->pos++;
+    return 0;
+}
+
+static int json_literal(struct schema_reader* r, const char* literal, size_t length)
+{
+    if ((size_t)(r->end - r->pos) < length || memcmp(r->pos, literal, length) != 0) {
+        return -1;
+    }
+    r->pos += length;
+    return 0;
+}
+
+static int json_number(struct schema_reader* r, struct schema_value* v)
+{
+    size_t consumed;
+    bool is_integer;
+
+    if (io_parse_number((const char*)r->pos, (size_t)(r->end - r->pos), &consumed,
+            &is_integer, &v->integer, &v->number)
+        != 0) {
+        return -1;
+    }
+    v->type = is_integer ? VALUE_INT : VALUE_DOUBLE;
+    r->pos += consumed;
+    return 0;
+}
+
+static int json_skip_value(struct schema_reader* r, int depth);
+
+static int json_value(struct schema_reader* r, struct schema_value* v)
+{
+    json_skip_ws(r);
+    if (r->pos >= r->end) {
+        return -1;
+    }
+    switch (*r->pos) {
+    case '"':
+        v->type = VALUE_STRING;
+        return json_string(r, &v->str, &v->str_length, &v->str_escaped);
+    case 't':
+        v->type = VALUE_BOOL;
+        v->integer = 1;
+        return json_literal(r, "true", 4);
+    case 'f':
+        v->type = VALUE_BOOL;
+        v->integer = 0;
+        return json_literal(r, "false", 5);
+    case 'n':
+        v->type = VALUE_NULL;
+        return json_literal(r, "null", 4);
+    default:
+        return json_number(r, v);
+    }
+}
+
+static int json_skip_value(struct schema_reader* r, int depth)
+{
+    struct schema_value ignored;
+
+    json_skip_ws(r);
+    if (depth > IO_MAX_DEPTH || r->pos >= r->end) {
+        return -1;
+    }
+    if (*r->pos != '{' && *r->pos != '[') {
+        return json_value(r, &ignored);
+    }
+
+    uint8_t close = *r->pos == '{' ? '}' : ']';
+    bool is_object = close == '}';
+    r->pos++;
+    json_skip_ws(r);
+    if (r->pos < r->end && *r->pos == close) {
+        r->pos++;
+        return 0;
+    }
+    for (;;) {
+        if (is_object) {
+            const char* key;
+            size_t key_length;
+            bool escaped;
+            json_skip_ws(r);
+            if (json_string(r, &key, &key_length, &escaped) != 0) {
+                return -1;
+            }
+            json_skip_ws(r);
+            if (json_literal(r, ":", 1) != 0) {
+                return -1;
+            }
+        }
+        if (json_skip_value(r, depth + 1) != 0) {
+            return -1;
+        }
+        json_skip_ws(r);
+        if (r->pos >= r->end) {
+            return -1;
+        }
+        if (*r->pos == close) {
+            r->pos++;
+            return 0;
+        }
+        if (*r->pos++ != ',') {
+            return -1;
+        }
+    }
+}
+
+static int decode_json(const struct io_schema_field* fields, size_t field_count, void* msg, struct schema_reader* r)
+{
+    size_t hint = 0;
+
+    json_skip_ws(r);
+    if (json_literal(r, "{", 1) != 0) {
+        return -1;
+    }
+    json_skip_ws(r);
+    if (r->pos < r->end && *r->pos == '}') {
+        r->pos++;
+        return 0;
+    }
+
+    for (;;) {
+        const char* key;
+        size_t key_length;
+        bool escaped;
+
+        json_skip_ws(r);
+        if (json_string(r, &key, &key_length, &escaped) != 0) {
+            return -1;
+        }
+        json_skip_ws(r);
+        if (json_literal(r, ":", 1) != 0) {
+            return -1;
+        }
+
+        const struct io_schema_field* field = escaped ? NULL : find_field(fields, field_count, &hint, key, key_length);
+        if (field != NULL) {
+            struct schema_value v;
+            if (json_value(r, &v) != 0 || store_field(field, msg, &v) != 0) {
+                return -1;
+            }
+        } else if (json_skip_value(r, 1) != 0) {
+            return -1;
+        }
+
+        json_skip_ws(r);
+        if (r->pos >= r->end) {
+            return -1;
+        }
+        if (*r->pos == '}') {
+            r->pos++;
+            return 0;
+        }
+        if (*r->pos++ != ',') {
+            return -1;
+        }
+    }
+}
+
+// MessagePack
+
+static int msgpack_uint(struct schema_reader* r, size_t size, uint64_t* out)
+{
+    if ((size_t)(r->end - r->pos) < size) {
+        return -1;
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value = (value << 8) | r->pos[i];
+    }
+    r->pos += size;
+    *out = value;
+    return 0;
+}
+
+// Read one scalar; containers are reported through *count so callers can skip them
+static int msgpack_value(struct schema_reader* r, struct schema_value* v, size_t* count)
+{
+    uint64_t value;
+
+    *count = 0;
+    if (r->pos >= r->end) {
+        return -1;
+    }
+    uint8_t tag = *r->pos++;
+
+    if (tag <= 0x7F || tag >= 0xE0) {
+        v->type = VALUE_INT;
+        v->integer = tag <= 0x7F ? tag : (int8_t)tag;
+        return 0;
+    }
+    if ((tag & 0xF0) == 0x80 || (tag & 0xF0) == 0x90) {
+        *count = (size_t)(tag & 0x0F) * ((tag & 0xF0) == 0x80 ? 2 : 1);
+        v->type = VALUE_NULL;
+        return 0;
+    }
+    if ((tag & 0xE0) == 0xA0 || tag == 0xD9 || tag == 0xDA || tag == 0xDB) {
+        if ((tag & 0xE0) == 0xA0) {
+            value = tag & 0x1F;
+        } else if (msgpack_uint(r, (size_t)1 << (tag - 0xD9), &value) != 0) {
+            return -1;
+        }
+        if ((uint64_t)(r->end - r->pos) < value) {
+            return -1;
+        }
+        v->type = VALUE_STRING;
+        v->str = (const char*)r->pos;
+        v->str_length = (size_t)value;
+        v->str_escaped = false;
+        r->pos += value;
+        return 0;
+    }
+
+    switch (tag) {
+    case 0xC0:
+        v->type = VALUE_NULL;
+        return 0;
+    case 0xC2:
+    case 0xC3:
+        v->type = VALUE_BOOL;
+        v->integer = tag == 0xC3;
+        return 0;
+    case 0xCA: {
+        float single;
+        uint32_t bits;
+        if (msgpack_uint(r, 4, &value) != 0) {
+            return -1;
+        }
+        bits = (uint32_t)value;
+        memcpy(&single, &bits, sizeof(single));
+        v->type = VALUE_DOUBLE;
+        v->number = single;
+        return 0;
+    }
+    case 0xCB:
+        if (msgpack_uint(r, 8, &value) != 0) {
+            return -1;
+        }
+        v->type = VALUE_DOUBLE;
+        memcpy(&v->number, &value, sizeof(v->number));
+        return 0;
+    case 0xCC:
+    case 0xCD:
+    case 0xCE:
+    case 0xCF:
+        if (msgpack_uint(r, (size_t)1 << (tag - 0xCC), &value) != 0 || value > INT64_MAX) {
+            return -1;
+        }
+        v->type = VALUE_INT;
+        v->integer = (int64_t)value;
+        return 0;
+    case 0xD0:
+    case 0xD1:
+    case 0xD2:
+    case 0xD3: {
+        size_t size = (size_t)1 << (tag - 0xD0);
+        if (msgpack_uint(r, size, &value) != 0) {
+            return -1;
+        }
+        // Sign-extend from the encoded width
+        uint64_t sign = (uint64_t)1 << (size * 8 - 1);
+        v->type = VALUE_INT;
+        v->integer = size == 8 ? (int64_t)value : (int64_t)((value ^ sign) - sign);
+        return 0;
+    }
+    case 0xDC:
+    case 0xDD:
+    case 0xDE:
+    case 0xDF:
+        if (msgpack_uint(r, (tag == 0xDC || tag == 0xDE) ? 2 : 4, &value) != 0) {
+            return -1;
+        }
+        *count = (size_t)value * (tag >= 0xDE ? 2 : 1);
+        v->type = VALUE_NULL;
+        return 0;
+    default:
+        return -1; // bin and ext are not used by schemas
+    }
+}
+
+static int msgpack_skip(struct schema_reader* r, int depth)
+{
+    struct schema_value v;
+    size_t count;
+
+    if (depth > IO_MAX_DEPTH || msgpack_value(r, &v, &count) != 0) {
+        return -1;
+    }
+    if (count > (size_t)(r->end - r->pos)) {
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (msgpack_skip(r, depth + 1) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int decode_msgpack(const struct io_schema_field* fields, size_t field_count, void* msg, struct schema_reader* r)
+{
+    uint64_t entries;
+    size_t hint = 0;
+
+    if (r->pos >= r->end) {
+        return -1;
+    }
+    uint8_t tag = *r->pos++;
+    if ((tag & 0xF0) == 0x80) {
+        entries = tag & 0x0F;
+    } else if (tag == 0xDE || tag == 0xDF) {
+        if (msgpack_uint(r, tag == 0xDE ? 2 : 4, &entries) != 0) {
+            return -1;
+        }
+    } else {
+        return -1;
+    }
+
+    for (uint64_t i = 0; i < entries; i++) {
+        struct schema_value key;
+        struct schema_value v;
+        size_t count;
+
+        if (msgpack_value(r, &key, &count) != 0 || key.type != VALUE_STRING) {
+            return -1;
+        }
+
+        const struct io_schema_field* field = find_field(fields, field_count, &hint, key.str, key.str_length);
+        if (field == NULL) {
+            if (msgpack_skip(r, 1) != 0) {
+                return -1;
+            }
+            continue;
+        }
+        if (msgpack_value(r, &v, &count) != 0 || count != 0 || store_field(field, msg, &v) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int io_schema_decode(const struct io_schema_field* fields, size_t field_count, void* msg,
+    enum io_format format, const uint8_t* data, size_t length)
+{
+    if (fields == NULL || msg == NULL || data == NULL) {
+        return -1; // Error: invalid input
+    }
+
+    struct schema_reader r = { data, data + length };
+    int ret;
+    if (format == IO_FORMAT_JSON) {
+        ret = decode_json(fields, field_count, msg, &r);
+        json_skip_ws(&r);
+    } else if (format == IO_FORMAT_MSGPACK) {
+        ret = decode_msgpack(fields, field_count, msg, &r);
+    } else {
+        return -1;
+    }
+
+    return (ret == 0 && r.pos == r.end) ? 0 : -1;
+}
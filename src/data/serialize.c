@@ -0,0 +1,664 @@
+#include "data/serialize.h"
+#include "cJSON.h"
+#include "data/json_simd.h"
+#include "data/numconv.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define IO_STREAM_BUFFER_SIZE 256
+
+// Output state shared by the buffer, stream and size-only encoders
+struct io_writer {
+    uint8_t* buffer;
+    size_t capacity;
+    size_t length;
+    size_t total;
+    io_write_func_t write;
+    void* ctx;
+    int error;
+};
+
+static void writer_flush(struct io_writer* w)
+{
+    if (w->write != NULL && w->length > 0 && w->error == 0) {
+        if (w->write(w->ctx, w->buffer, w->length) != 0) {
+            w->error = -1;
+        }
+    }
+    if (w->write != NULL) {
+        w->length = 0;
+    }
+}
+
+static void writer_put(struct io_writer* w, const void* data, size_t length)
+{
+    const uint8_t* src = (const uint8_t*)data;
+
+    w->total += length;
+    if (w->error != 0) {
+        return;
+    }
+
+    if (w->write == NULL) {
+        // Fixed buffer: keep counting past the end so callers learn the required size
+        if (w->buffer == NULL || w->length + length > w->capacity) {
+            w->length = w->capacity;
+            if (w->buffer != NULL) {
+                w->error = -1;
+            }
+            return;
+        }
+        memcpy(w->buffer + w->length, src, length);
+        w->length += length;
+        return;
+    }
+
+    while (length > 0 && w->error == 0) {
+        size_t room = w->capacity - w->length;
+        size_t chunk = length < room ? length : room;
+        memcpy(w->buffer + w->length, src, chunk);
+        w->length += chunk;
+        src += chunk;
+        length -= chunk;
+        if (w->length == w->capacity) {
+            writer_flush(w);
+        }
+    }
+}
+
+static void writer_byte(struct io_writer* w, uint8_t value)
+{
+    writer_put(w, &value, 1);
+}
+
+// Write a big-endian unsigned integer of 'size' bytes after a MessagePack tag
+static void writer_tagged(struct io_writer* w, uint8_t tag, uint64_t value, size_t size)
+{
+    uint8_t out[9];
+    out[0] = tag;
+    for (size_t i = 0; i < size; i++) {
+        out[size - i] = (uint8_t)(value >> (8 * i));
+    }
+    writer_put(w, out, size + 1);
+}
+
+// Check whether a double holds an integer that survives an int64 round trip
+static int number_is_integer(double value, int64_t* out)
+{
+    if (value != value || value < -9223372036854775808.0 || value >= 9223372036854775808.0) {
+        return 0;
+    }
+    int64_t integer = (int64_t)value;
+    if ((double)integer != value) {
+        return 0;
+    }
+    *out = integer;
+    return 1;
+}
+
+// JSON
+
+static void json_string(struct io_writer* w, const char* str)
+{
+    static const char hex[] = "0123456789abcdef";
+    const struct io_json_kernels* kernels = io_json_kernels();
+    size_t length = strlen(str);
+
+    writer_byte(w, '"');
+    while (length > 0) {
+        // Copy the longest run that needs no escaping in one go
+        size_t run = kernels->find_escape(str, length);
+        writer_put(w, str, run);
+        if (run == length) {
+            break;
+        }
+
+        unsigned char c = (unsigned char)str[run];
+        char escape[6] = { '\\', 0 };
+        size_t escape_length = 2;
+        switch (c) {
+        case '"':
+        case '\\':
+            escape[1] = (char)c;
+            break;
+        case '\b':
+            escape[1] = 'b';
+            break;
+        case '\f':
+            escape[1] = 'f';
+            break;
+        case '\n':
+            escape[1] = 'n';
+            break;
+        case '\r':
+            escape[1] = 'r';
+            break;
+        case '\t':
+            escape[1] = 't';
+            break;
+        default:
+            escape[1] = 'u';
+            escape[2] = '0';
+            escape[3] = '0';
+            escape[4] = hex[c >> 4];
+            escape[5] = hex[c & 0xF];
+            escape_length = 6;
+            break;
+        }
+        writer_put(w, escape, escape_length);
+        str += run + 1;
+        length -= run + 1;
+    }
+    writer_byte(w, '"');
+}
+
+static void json_number(struct io_writer* w, double value)
+{
+    char text[IO_DOUBLE_TEXT_SIZE];
+    writer_put(w, text, io_format_double(text, value));
+}
+
+static int encode_json(struct io_writer* w, const cJSON* item, int depth)
+{
+    if (depth > IO_MAX_DEPTH) {
+        return -1;
+    }
+
+    switch (item->type & 0xFF) {
+    case cJSON_NULL:
+        writer_put(w, "null", 4);
+        return 0;
+    case cJSON_False:
+        writer_put(w, "false", 5);
+        return 0;
+    case cJSON_True:
+        writer_put(w, "true", 4);
+        return 0;
+    case cJSON_Number:
+        json_number(w, item->valuedouble);
+        return 0;
+    case cJSON_String:
+        json_string(w, item->valuestring != NULL ? item->valuestring : "");
+        return 0;
+    case cJSON_Array:
+    case cJSON_Object: {
+        int is_object = (item->type & 0xFF) == cJSON_Object;
+        writer_byte(w, is_object ? '{' : '[');
+        for (const cJSON* child = item->child; child != NULL; child = child->next) {
+            if (child != item->child) {
+                writer_byte(w, ',');
+            }
+            if (is_object) {
+                if (child->string == NULL) {
+                    return -1;
+                }
+                json_string(w, child->string);
+                writer_byte(w, ':');
+            }
+            if (encode_json(w, child, depth + 1) != 0) {
+                return -1;
+            }
+        }
+        writer_byte(w, is_object ? '}' : ']');
+        return 0;
+    }
+    default:
+        return -1; // Raw and invalid items have no portable encoding
+    }
+}
+
+// MessagePack
+
+static void msgpack_integer(struct io_writer* w, int64_t value)
+{
+    if (value >= 0) {
+        uint64_t u = (uint64_t)value;
+        if (u <= 0x7F) {
+            writer_byte(w, (uint8_t)u);
+        } else if (u <= 0xFF) {
+            writer_tagged(w, 0xCC, u, 1);
+        } else if (u <= 0xFFFF) {
+            writer_tagged(w, 0xCD, u, 2);
+        } else if (u <= 0xFFFFFFFF) {
+            writer_tagged(w, 0xCE, u, 4);
+        } else {
+            writer_tagged(w, 0xCF, u, 8);
+        }
+    } else if (value >= -32) {
+        writer_byte(w, (uint8_t)(0xE0 | (value & 0x1F)));
+    } else if (value >= INT8_MIN) {
+        writer_tagged(w, 0xD0, (uint64_t)value, 1);
+    } else if (value >= INT16_MIN) {
+        writer_tagged(w, 0xD1, (uint64_t)value, 2);
+    } else if (value >= INT32_MIN) {
+        writer_tagged(w, 0xD2, (uint64_t)value, 4);
+    } else {
+        writer_tagged(w, 0xD3, (uint64_t)value, 8);
+    }
+}
+
+static void msgpack_number(struct io_writer* w, double value)
+{
+    int64_t integer;
+
+    if (number_is_integer(value, &integer)) {
+        msgpack_integer(w, integer);
+    } else if ((double)(float)value == value || value != value) {
+        float single = (float)value;
+        uint32_t bits;
+        memcpy(&bits, &single, sizeof(bits));
+        writer_tagged(w, 0xCA, bits, 4);
+    } else {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        writer_tagged(w, 0xCB, bits, 8);
+    }
+}
+
+static void msgpack_string(struct io_writer* w, const char* str)
+{
+    size_t length = strlen(str);
+
+    if (length < 32) {
+        writer_byte(w, (uint8_t)(0xA0 | length));
+    } else if (length <= 0xFF) {
+        writer_tagged(w, 0xD9, length, 1);
+    } else if (length <= 0xFFFF) {
+        writer_tagged(w, 0xDA, length, 2);
+    } else {
+        writer_tagged(w, 0xDB, length, 4);
+    }
+    writer_put(w, str, length);
+}
+
+static void msgpack_container(struct io_writer* w, int is_object, size_t count)
+{
+    if (count < 16) {
+        writer_byte(w, (uint8_t)((is_object ? 0x80 : 0x90) | count));
+    } else if (count <= 0xFFFF) {
+        writer_tagged(w, is_object ? 0xDE : 0xDC, count, 2);
+    } else {
+        writer_tagged(w, is_object ? 0xDF : 0xDD, count, 4);
+    }
+}
+
+static int encode_msgpack(struct io_writer* w, const cJSON* item, int depth)
+{
+    if (depth > IO_MAX_DEPTH) {
+        return -1;
+    }
+
+    switch (item->type & 0xFF) {
+    case cJSON_NULL:
+        writer_byte(w, 0xC0);
+        return 0;
+    case cJSON_False:
+        writer_byte(w, 0xC2);
+        return 0;
+    case cJSON_True:
+        writer_byte(w, 0xC3);
+        return 0;
+    case cJSON_Number:
+        msgpack_number(w, item->valuedouble);
+        return 0;
+    case cJSON_String:
+        msgpack_string(w, item->valuestring != NULL ? item->valuestring : "");
+        return 0;
+    case cJSON_Array:
+    case cJSON_Object: {
+        int is_object = (item->type & 0xFF) == cJSON_Object;
+        size_t count = 0;
+        for (const cJSON* child = item->child; child != NULL; child = child->next) {
+            count++;
+        }
+        msgpack_container(w, is_object, count);
+        for (const cJSON* child = item->child; child != NULL; child = child->next) {
+            if (is_object) {
+                if (child->string == NULL) {
+                    return -1;
+                }
+                msgpack_string(w, child->string);
+            }
+            if (encode_msgpack(w, child, depth + 1) != 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+    default:
+        return -1;
+    }
+}
+
+static int encode(struct io_writer* w, IO* obj, enum io_format format)
+{
+    if (obj == NULL || obj->json_obj == NULL) {
+        return -1;
+    }
+
+    switch (format) {
+    case IO_FORMAT_JSON:
+        return encode_json(w, obj->json_obj, 0);
+    case IO_FORMAT_MSGPACK:
+        return encode_msgpack(w, obj->json_obj, 0);
+    default:
+        return -1;
+    }
+}
+
+// Encode an IO into a caller-provided buffer without allocating
+int io_serialize(IO* obj, enum io_format format, uint8_t* buffer, size_t buffer_length, size_t* out_length)
+{
+    if (buffer == NULL || out_length == NULL) {
+        return -1; // Error: invalid input
+    }
+
+    struct io_writer w = { .buffer = buffer, .capacity = buffer_length };
+    if (encode(&w, obj, format) != 0) {
+        *out_length = 0;
+        return -1;
+    }
+
+    *out_length = w.total;
+    return w.error;
+}
+
+// Encode an IO through a write callback, staging output in a small stack buffer
+int io_serialize_stream(IO* obj, enum io_format format, io_write_func_t write, void* ctx)
+{
+    if (write == NULL) {
+        return -1; // Error: invalid input
+    }
+
+    uint8_t staging[IO_STREAM_BUFFER_SIZE];
+    struct io_writer w = {
+        .buffer = staging,
+        .capacity = sizeof(staging),
+        .write = write,
+        .ctx = ctx
+    };
+
+    if (encode(&w, obj, format) != 0) {
+        return -1;
+    }
+    writer_flush(&w);
+    return w.error;
+}
+
+// Get the number of bytes io_serialize would produce
+size_t io_serialized_size(IO* obj, enum io_format format)
+{
+    struct io_writer w = { 0 };
+    if (encode(&w, obj, format) != 0) {
+        return 0;
+    }
+    return w.total;
+}
+
+/*
+ * Time-series batches (IO_BATCH_FORMAT_GORILLA), after Pelkonen et al.,
+ * "Gorilla: A Fast, Scalable, In-Memory Time Series Database":
+ *
+ *   u8 version (1), varint series count, then per series:
+ *   u8 name length, name, u8 type, varint sample count, and if any samples
+ *   a bit stream (MSB first, zero-padded to a byte) holding the first
+ *   timestamp and value as 64 raw bits each, then for every later sample
+ *   the timestamp delta-of-delta and the value: delta-of-delta again for
+ *   integers, XOR against the previous value for doubles.
+ *
+ * Delta-of-delta buckets: '0' (zero), '10' + 7 bits, '110' + 9 bits,
+ * '1110' + 12 bits, '11110' + 32 bits, '11111' + 64 bits, all signed.
+ * XOR values: '0' (same value), '10' + meaningful bits within the previous
+ * window, '11' + 5 bits leading zeros + 6 bits (length - 1) + bits.
+ */
+
+// Bit-level output on top of an io_writer
+struct bit_writer {
+    struct io_writer* w;
+    uint64_t pending;
+    unsigned count;
+};
+
+static void bits_put(struct bit_writer* b, uint64_t value, unsigned width)
+{
+    // Split wide fields so the pending bits never exceed 64
+    if (width > 32) {
+        bits_put(b, value >> 32, width - 32);
+        width = 32;
+    }
+    b->pending = (b->pending << width) | (value & ((UINT64_C(1) << width) - 1));
+    b->count += width;
+    while (b->count >= 8) {
+        b->count -= 8;
+        writer_byte(b->w, (uint8_t)(b->pending >> b->count));
+    }
+}
+
+static void bits_flush(struct bit_writer* b)
+{
+    if (b->count > 0) {
+        writer_byte(b->w, (uint8_t)(b->pending << (8 - b->count)));
+        b->count = 0;
+    }
+}
+
+static void writer_varint(struct io_writer* w, uint64_t value)
+{
+    uint8_t out[10];
+    size_t length = 0;
+    do {
+        out[length] = (uint8_t)(value & 0x7F);
+        value >>= 7;
+        if (value != 0) {
+            out[length] |= 0x80;
+        }
+        length++;
+    } while (value != 0);
+    writer_put(w, out, length);
+}
+
+// Deltas use wrapping arithmetic so any int64 sequence round-trips exactly
+static void gorilla_dod(struct bit_writer* b, uint64_t dod)
+{
+    int64_t value = (int64_t)dod;
+
+    if (value == 0) {
+        bits_put(b, 0x0, 1);
+    } else if (value >= -64 && value <= 63) {
+        bits_put(b, 0x2, 2);
+        bits_put(b, dod, 7);
+    } else if (value >= -256 && value <= 255) {
+        bits_put(b, 0x6, 3);
+        bits_put(b, dod, 9);
+    } else if (value >= -2048 && value <= 2047) {
+        bits_put(b, 0xE, 4);
+        bits_put(b, dod, 12);
+    } else if (value >= INT32_MIN && value <= INT32_MAX) {
+        bits_put(b, 0x1E, 5);
+        bits_put(b, dod, 32);
+    } else {
+        bits_put(b, 0x1F, 5);
+        bits_put(b, dod, 64);
+    }
+}
+
+// Encoder state for one delta-of-delta column
+struct dod_state {
+    uint64_t previous;
+    uint64_t delta;
+};
+
+static void gorilla_int(struct bit_writer* b, struct dod_state* s, uint64_t value)
+{
+    uint64_t delta = value - s->previous;
+    gorilla_dod(b, delta - s->delta);
+    s->previous = value;
+    s->delta = delta;
+}
+
+// Encoder state for one XOR column
+struct xor_state {
+    uint64_t previous;
+    unsigned leading; // 64 until the first window is written
+    unsigned trailing;
+};
+
+static void gorilla_double(struct bit_writer* b, struct xor_state* s, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint64_t xor = bits ^ s->previous;
+    s->previous = bits;
+
+    if (xor == 0) {
+        bits_put(b, 0x0, 1);
+        return;
+    }
+
+    unsigned leading = (unsigned)__builtin_clzll(xor);
+    unsigned trailing = (unsigned)__builtin_ctzll(xor);
+    if (leading > 31) {
+        leading = 31; // Only five bits to store it in
+    }
+
+    if (s->leading != 64 && leading >= s->leading && trailing >= s->trailing) {
+        // Fits inside the previous window: reuse its position
+        bits_put(b, 0x2, 2);
+        bits_put(b, xor >> s->trailing, 64 - s->leading - s->trailing);
+        return;
+    }
+
+    unsigned meaningful = 64 - leading - trailing;
+    bits_put(b, 0x3, 2);
+    bits_put(b, leading, 5);
+    bits_put(b, meaningful - 1, 6);
+    bits_put(b, xor >> trailing, meaningful);
+    s->leading = leading;
+    s->trailing = trailing;
+}
+
+static void encode_series_gorilla(struct io_writer* w, const IOSeries* series)
+{
+    size_t name_length = strlen(series->name);
+
+    writer_byte(w, (uint8_t)name_length);
+    writer_put(w, series->name, name_length);
+    writer_byte(w, (uint8_t)series->type);
+    writer_varint(w, series->count);
+    if (series->count == 0) {
+        return;
+    }
+
+    struct bit_writer b = { .w = w };
+    struct dod_state timestamps = { .previous = (uint64_t)series->timestamps[0] };
+    struct dod_state ints = { 0 };
+    struct xor_state doubles = { .leading = 64 };
+
+    bits_put(&b, (uint64_t)series->timestamps[0], 64);
+    if (series->type == IO_SERIES_INT64) {
+        ints.previous = (uint64_t)series->values.ints[0];
+        bits_put(&b, ints.previous, 64);
+    } else {
+        memcpy(&doubles.previous, &series->values.doubles[0], sizeof(doubles.previous));
+        bits_put(&b, doubles.previous, 64);
+    }
+
+    for (size_t i = 1; i < series->count; i++) {
+        gorilla_int(&b, &timestamps, (uint64_t)series->timestamps[i]);
+        if (series->type == IO_SERIES_INT64) {
+            gorilla_int(&b, &ints, (uint64_t)series->values.ints[i]);
+        } else {
+            gorilla_double(&b, &doubles, series->values.doubles[i]);
+        }
+    }
+    bits_flush(&b);
+}
+
+static void json_int64(struct io_writer* w, int64_t value)
+{
+    char text[IO_INT64_TEXT_SIZE];
+    writer_put(w, text, io_format_int64(text, value));
+}
+
+static void encode_series_json(struct io_writer* w, const IOSeries* series)
+{
+    json_string(w, series->name);
+    writer_put(w, ":{\"t0\":", 7);
+    json_int64(w, series->count > 0 ? series->timestamps[0] : 0);
+    writer_put(w, ",\"dt\":[", 7);
+    for (size_t i = 1; i < series->count; i++) {
+        if (i > 1) {
+            writer_byte(w, ',');
+        }
+        json_int64(w, (int64_t)((uint64_t)series->timestamps[i] - (uint64_t)series->timestamps[i - 1]));
+    }
+    writer_put(w, "],\"v\":[", 7);
+    for (size_t i = 0; i < series->count; i++) {
+        if (i > 0) {
+            writer_byte(w, ',');
+        }
+        if (series->type == IO_SERIES_INT64) {
+            json_int64(w, series->values.ints[i]);
+        } else {
+            json_number(w, series->values.doubles[i]);
+        }
+    }
+    writer_put(w, "]}", 2);
+}
+
+static int encode_batch(struct io_writer* w, const IOBatch* batch, enum io_batch_format format)
+{
+    if (batch == NULL) {
+        return -1;
+    }
+
+    switch (format) {
+    case IO_BATCH_FORMAT_GORILLA:
+        writer_byte(w, IO_BATCH_VERSION);
+        writer_varint(w, batch->series_count);
+        for (size_t i = 0; i < batch->series_count; i++) {
+            encode_series_gorilla(w, &batch->series[i]);
+        }
+        return 0;
+    case IO_BATCH_FORMAT_JSON:
+        writer_byte(w, '{');
+        for (size_t i = 0; i < batch->series_count; i++) {
+            if (i > 0) {
+                writer_byte(w, ',');
+            }
+            encode_series_json(w, &batch->series[i]);
+        }
+        writer_byte(w, '}');
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+// Encode a batch into a caller-provided buffer without allocating
+int io_batch_serialize(const IOBatch* batch, enum io_batch_format format, uint8_t* buffer,
+    size_t buffer_length, size_t* out_length)
+{
+    if (buffer == NULL || out_length == NULL) {
+        return -1; // Error: invalid input
+    }
+
+    struct io_writer w = { .buffer = buffer, .capacity = buffer_length };
+    if (encode_batch(&w, batch, format) != 0) {
+        *out_length = 0;
+        return -1;
+    }
+
+    *out_length = w.total;
+    return w.error;
+}
+
+// Get the number of bytes io_batch_serialize would produce
+size_t io_batch_serialized_size(const IOBatch* batch, enum io_batch_format format)
+{
+    struct io_writer w = { 0 };
+    if (encode_batch(&w, batch, format) != 0) {
+        return 0;
+    }
+    return w.total;
+}
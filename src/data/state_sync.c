@@ -0,0 +1,345 @@
+#include "data/state_sync.h"
+#include "cJSON.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Merge patches
+
+/*
+ * Add to patch the members that turn a receiver object into v, where the
+ * receiver holds 'a' (the acknowledged object, or NULL if it may not be an
+ * object at all) modified by patches whose keys are recorded in 't'. When
+ * 'complete' is set the receiver may not have this object, so every member
+ * of v is written out in full. Records in 'flags' what a merge patch
+ * cannot express safely.
+ */
+struct diff_flags {
+    bool null_value; // A null member must be written, which reads as a delete
+    bool replaced_object; // An object in 'a' is deleted or overwritten by a non-object
+};
+
+static int diff_member(cJSON* patch, const char* key, const cJSON* a, const cJSON* t, const cJSON* v,
+    bool complete, struct diff_flags* flags);
+
+// Look up a member, trying *hint first: snapshots of the same state usually
+// list their members in the same order, which keeps the walk linear.
+static const cJSON* member(const cJSON* object, const char* key, const cJSON** hint)
+{
+    const cJSON* item = *hint;
+    if (item == NULL || strcmp(item->string, key) != 0) {
+        item = cJSON_GetObjectItemCaseSensitive(object, key);
+    }
+    *hint = item != NULL ? item->next : NULL;
+    return item;
+}
+
+static int diff_object(cJSON* patch, const cJSON* a, const cJSON* t, const cJSON* v, bool complete, struct diff_flags* flags)
+{
+    const cJSON* item;
+    const cJSON* a_hint = a != NULL ? a->child : NULL;
+    const cJSON* v_hint = v->child;
+
+    cJSON_ArrayForEach(item, v)
+    {
+        if (diff_member(patch, item->string, member(a, item->string, &a_hint),
+                cJSON_GetObjectItemCaseSensitive(t, item->string), item, complete, flags)
+            != 0) {
+            return -1;
+        }
+    }
+    // Members that v no longer has
+    cJSON_ArrayForEach(item, a)
+    {
+        if (member(v, item->string, &v_hint) == NULL
+            && diff_member(patch, item->string, item, cJSON_GetObjectItemCaseSensitive(t, item->string), NULL,
+                   complete, flags)
+                != 0) {
+            return -1;
+        }
+    }
+    cJSON_ArrayForEach(item, t)
+    {
+        if (cJSON_GetObjectItemCaseSensitive(v, item->string) == NULL
+            && cJSON_GetObjectItemCaseSensitive(a, item->string) == NULL
+            && diff_member(patch, item->string, NULL, item, NULL, complete, flags) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int diff_member(cJSON* patch, const char* key, const cJSON* a, const cJSON* t, const cJSON* v,
+    bool complete, struct diff_flags* flags)
+{
+    cJSON* value = NULL;
+
+    if (v == NULL) {
+        if (a == NULL && t == NULL) {
+            return 0;
+        }
+        flags->replaced_object |= cJSON_IsObject(a);
+        value = cJSON_CreateNull();
+    } else if (!cJSON_IsObject(v)) {
+        if (!complete && t == NULL && a != NULL && cJSON_Compare(a, v, true)) {
+            return 0; // Unchanged, and no unacknowledged report touched it
+        }
+        flags->replaced_object |= cJSON_IsObject(a);
+        flags->null_value |= cJSON_IsNull(v);
+        value = cJSON_Duplicate(v, true);
+    } else {
+        // A receiver that may not hold an object here needs all of v
+        bool sub_complete = complete || !cJSON_IsObject(a);
+        value = cJSON_CreateObject();
+        if (value == NULL
+            || diff_object(value, cJSON_IsObject(a) ? a : NULL, cJSON_IsObject(t) ? t : NULL, v, sub_complete,
+                   flags)
+                != 0) {
+            cJSON_Delete(value);
+            return -1;
+        }
+        if (value->child == NULL && !sub_complete) {
+            cJSON_Delete(value);
+            return 0; // No change below this member
+        }
+    }
+
+    if (value == NULL) {
+        return -1;
+    }
+    cJSON_AddItemToObject(patch, key, value);
+    return 0;
+}
+
+// Build the JSON merge patch that turns 'from' into 'to'
+IO* io_merge_patch_create(const IO* from, const IO* to)
+{
+    struct diff_flags flags = { false, false };
+
+    if (from == NULL || to == NULL || !cJSON_IsObject(from->json_obj) || !cJSON_IsObject(to->json_obj)) {
+        return NULL; // Error: invalid input
+    }
+    IO* patch = io_create();
+    if (patch == NULL || patch->json_obj == NULL
+        || diff_object(patch->json_obj, from->json_obj, NULL, to->json_obj, false, &flags) != 0
+        || flags.null_value) {
+        io_destroy(patch);
+        return NULL;
+    }
+    return patch;
+}
+
+static int apply_object(cJSON* target, const cJSON* patch)
+{
+    const cJSON* item;
+
+    cJSON_ArrayForEach(item, patch)
+    {
+        if (cJSON_IsNull(item)) {
+            cJSON_DeleteItemFromObjectCaseSensitive(target, item->string);
+            continue;
+        }
+
+        cJSON* current = cJSON_GetObjectItemCaseSensitive(target, item->string);
+        cJSON* value;
+        if (cJSON_IsObject(item)) {
+            if (cJSON_IsObject(current)) {
+                if (apply_object(current, item) != 0) {
+                    return -1;
+                }
+                continue;
+            }
+            // Anything that is not an object is replaced by one, then patched
+            value = cJSON_CreateObject();
+            if (value == NULL || apply_object(value, item) != 0) {
+                cJSON_Delete(value);
+                return -1;
+            }
+        } else {
+            value = cJSON_Duplicate(item, true);
+            if (value == NULL) {
+                return -1;
+            }
+        }
+
+        if (current != NULL) {
+            cJSON_ReplaceItemInObjectCaseSensitive(target, item->string, value);
+        } else {
+            cJSON_AddItemToObject(target, item->string, value);
+        }
+    }
+    return 0;
+}
+
+// Apply a JSON merge patch to target in place
+int io_merge_patch_apply(IO* target, const IO* patch)
+{
+    if (target == NULL || patch == NULL || !cJSON_IsObject(target->json_obj) || !cJSON_IsObject(patch->json_obj)) {
+        return -1; // Error: invalid input
+    }
+    return apply_object(target->json_obj, patch->json_obj);
+}
+
+// Delta state reporting
+
+struct IOStateSync {
+    uint32_t full_interval;
+    uint32_t since_full; // Patches sent since the last full snapshot
+    io_state_publish_func_t publish;
+    void* ctx;
+    cJSON* acked; // Last acknowledged state, NULL before the first ack
+    cJSON* sent; // Most recently reported state
+    cJSON* touched; // Keys of every patch sent since the last ack
+    bool full_requested;
+    bool full_pending; // A full snapshot is not acknowledged yet
+};
+
+// Record the keys of a sent patch, keeping the structure of nested objects
+static int touch(cJSON* touched, const cJSON* patch)
+{
+    const cJSON* item;
+
+    cJSON_ArrayForEach(item, patch)
+    {
+        cJSON* entry = cJSON_GetObjectItemCaseSensitive(touched, item->string);
+        if (cJSON_IsObject(item)) {
+            if (!cJSON_IsObject(entry)) {
+                cJSON* object = cJSON_CreateObject();
+                if (object == NULL) {
+                    return -1;
+                }
+                if (entry != NULL) {
+                    cJSON_ReplaceItemInObjectCaseSensitive(touched, item->string, object);
+                } else {
+                    cJSON_AddItemToObject(touched, item->string, object);
+                }
+                entry = object;
+            }
+            if (touch(entry, item) != 0) {
+                return -1;
+            }
+        } else if (entry == NULL) {
+            // Leaves only record presence; an object recorded earlier keeps its keys
+            cJSON* leaf = cJSON_CreateTrue();
+            if (leaf == NULL) {
+                return -1;
+            }
+            cJSON_AddItemToObject(touched, item->string, leaf);
+        }
+    }
+    return 0;
+}
+
+// Create a state reporter
+IOStateSync* io_state_sync_create(uint32_t full_interval, io_state_publish_func_t publish, void* ctx)
+{
+    if (publish == NULL) {
+        return NULL; // Error: invalid input
+    }
+    IOStateSync* sync = (IOStateSync*)calloc(1, sizeof(IOStateSync));
+    if (sync == NULL) {
+        return NULL;
+    }
+    sync->touched = cJSON_CreateObject();
+    if (sync->touched == NULL) {
+        free(sync);
+        return NULL;
+    }
+    sync->full_interval = full_interval;
+    sync->publish = publish;
+    sync->ctx = ctx;
+    return sync;
+}
+
+// Destroy the reporter and its snapshots
+void io_state_sync_destroy(IOStateSync* sync)
+{
+    if (sync != NULL) {
+        cJSON_Delete(sync->acked);
+        cJSON_Delete(sync->sent);
+        cJSON_Delete(sync->touched);
+        free(sync);
+    }
+}
+
+// Publish what changed in state
+int io_state_sync_report(IOStateSync* sync, const IO* state)
+{
+    if (sync == NULL || state == NULL || !cJSON_IsObject(state->json_obj)) {
+        return -1; // Error: invalid input
+    }
+
+    bool full = sync->acked == NULL || sync->full_requested || sync->full_pending
+        || (sync->full_interval != 0 && sync->since_full >= sync->full_interval);
+    cJSON* message;
+
+    if (full) {
+        message = cJSON_Duplicate(state->json_obj, true);
+    } else {
+        struct diff_flags flags = { false, false };
+        message = cJSON_CreateObject();
+        if (message != NULL && diff_object(message, sync->acked, sync->touched, state->json_obj, false, &flags) != 0) {
+            cJSON_Delete(message);
+            return -1;
+        }
+        if (message != NULL && (flags.null_value || flags.replaced_object)) {
+            cJSON_Delete(message);
+            full = true;
+            message = cJSON_Duplicate(state->json_obj, true);
+        } else if (message != NULL && message->child == NULL) {
+            cJSON_Delete(message);
+            return 0; // Nothing changed
+        }
+    }
+
+    cJSON* sent = cJSON_Duplicate(state->json_obj, true);
+    if (message == NULL || sent == NULL) {
+        cJSON_Delete(message);
+        cJSON_Delete(sent);
+        return -1;
+    }
+
+    IO io = { message };
+    int ret = sync->publish(sync->ctx, &io, full);
+    if (ret == 0) {
+        cJSON_Delete(sync->sent);
+        sync->sent = sent;
+        sent = NULL;
+        if (full) {
+            sync->since_full = 0;
+            sync->full_requested = false;
+            sync->full_pending = true;
+        } else {
+            sync->since_full++;
+            ret = touch(sync->touched, message);
+        }
+    }
+    cJSON_Delete(sent);
+    cJSON_Delete(message);
+    return ret;
+}
+
+// Mark the most recent report as received
+void io_state_sync_ack(IOStateSync* sync)
+{
+    if (sync == NULL || sync->sent == NULL) {
+        return;
+    }
+    cJSON* touched = cJSON_CreateObject();
+    if (touched == NULL) {
+        return; // Keep the old baseline; patches stay correct, just larger
+    }
+    cJSON_Delete(sync->acked);
+    sync->acked = sync->sent;
+    sync->sent = NULL;
+    cJSON_Delete(sync->touched);
+    sync->touched = touched;
+    sync->full_pending = false;
+}
+
+// Make the next report a full snapshot
+void io_state_sync_request_full(IOStateSync* sync)
+{
+    if (sync != NULL) {
+        sync->full_requested = true;
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef IOT_STORAGE_CRC32_H
+#define IOT_STORAGE_CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// CRC-32 (IEEE 802.3, as zlib). Start with crc 0 and feed the previous
+// result back in to checksum data in pieces.
+uint32_t iot_crc32(uint32_t crc, const void* data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOT_STORAGE_CRC32_H
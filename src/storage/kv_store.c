@@ -0,0 +1,898 @@
+#include "storage/kv_store.h"
+#include "interface/filesystem.h"
+#include "interface/os.h"
+#include "storage/crc32.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Log layout, little-endian:
+ *
+ *   file header  "IOKV" u32 version
+ *   record       u32 payload length, u32 CRC-32 of the payload, payload
+ *   payload      one or more ops: u8 op, u16 key length, u32 value length,
+ *                key, value (no value for deletes)
+ *
+ * The index stores, per key, the file offset and length of its latest
+ * value. live_bytes is what the live keys would take as one record each,
+ * the form compaction writes them in, so log_bytes - live_bytes is the
+ * space compaction would reclaim.
+ */
+
+#define KV_MAGIC "IOKV"
+#define KV_VERSION 1
+#define KV_FILE_HEADER 8
+#define KV_RECORD_HEADER 8
+#define KV_OP_HEADER 7
+#define KV_OP_PUT 1
+#define KV_OP_DELETE 2
+#define KV_DEFAULT_COMPACT_PERCENT 50
+#define KV_DEFAULT_COMPACT_MIN_BYTES (64 * 1024)
+#define KV_INITIAL_SLOTS 64
+#define KV_COPY_CHUNK (64 * 1024)
+
+struct kv_slot {
+    char* key; // NULL when empty, kv_tombstone when deleted
+    uint64_t hash;
+    uint64_t offset; // Of the value in the log
+    uint32_t length;
+    uint16_t key_length;
+    bool moved; // Already given its post-compaction offset
+};
+
+static char kv_tombstone[1];
+
+struct iot_kv {
+    struct iot_mutex* lock;
+    struct iot_file* file;
+    char* path;
+    char* compact_path;
+    struct iot_kv_config config;
+    struct kv_slot* slots;
+    size_t capacity; // Power of two
+    size_t count; // Live keys
+    size_t used; // Live keys and tombstones
+    uint64_t log_bytes;
+    uint64_t live_bytes;
+    uint64_t recovered_bytes;
+    uint64_t discarded_bytes;
+    uint32_t compactions;
+    struct iot_thread* compactor; // Last background compaction, joined before the next
+    bool compacting;
+};
+
+struct iot_kv_batch {
+    unsigned char* data; // Encoded ops, the payload of the record
+    size_t length;
+    size_t capacity;
+};
+
+// A live key as it was when compaction started
+struct kv_snapshot_entry {
+    char* key;
+    uint16_t key_length;
+    uint32_t length;
+    uint64_t old_offset;
+    uint64_t new_offset;
+};
+
+static void put_u16(unsigned char* p, uint16_t v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_u32(unsigned char* p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static uint16_t get_u16(const unsigned char* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const unsigned char* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// FNV-1a
+static uint64_t hash_key(const char* key, size_t length)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)key[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static uint64_t entry_cost(size_t key_length, uint32_t length)
+{
+    return KV_RECORD_HEADER + KV_OP_HEADER + key_length + length;
+}
+
+// Linear probe for key; NULL if it is not stored
+static struct kv_slot* find_slot(const struct iot_kv* kv, const char* key, size_t key_length, uint64_t hash)
+{
+    size_t mask = kv->capacity - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        struct kv_slot* slot = &kv->slots[i];
+        if (slot->key == NULL) {
+            return NULL;
+        }
+        if (slot->key != kv_tombstone && slot->hash == hash && slot->key_length == key_length
+            && memcmp(slot->key, key, key_length) == 0) {
+            return slot;
+        }
+    }
+}
+
+// Rebuild the table at new_capacity, dropping tombstones
+static int resize(struct iot_kv* kv, size_t new_capacity)
+{
+    struct kv_slot* slots = (struct kv_slot*)calloc(new_capacity, sizeof(struct kv_slot));
+    if (slots == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < kv->capacity; i++) {
+        struct kv_slot* old = &kv->slots[i];
+        if (old->key == NULL || old->key == kv_tombstone) {
+            continue;
+        }
+        size_t j = old->hash & (new_capacity - 1);
+        while (slots[j].key != NULL) {
+            j = (j + 1) & (new_capacity - 1);
+        }
+        slots[j] = *old;
+    }
+    free(kv->slots);
+    kv->slots = slots;
+    kv->capacity = new_capacity;
+    kv->used = kv->count;
+    return 0;
+}
+
+// A new key takes copy, if not NULL, as its copy of key; the caller frees copy otherwise
+static int index_put(struct iot_kv* kv, const char* key, size_t key_length, uint64_t offset, uint32_t length, char** copy)
+{
+    uint64_t hash = hash_key(key, key_length);
+    struct kv_slot* slot = find_slot(kv, key, key_length, hash);
+    if (slot != NULL) {
+        kv->live_bytes -= entry_cost(key_length, slot->length);
+        kv->live_bytes += entry_cost(key_length, length);
+        slot->offset = offset;
+        slot->length = length;
+        return 0;
+    }
+
+    // Keep the load under 3/4; grow only if live keys, not tombstones, fill the table
+    if ((kv->used + 1) * 4 > kv->capacity * 3) {
+        size_t capacity = (kv->count + 1) * 2 > kv->capacity ? kv->capacity * 2 : kv->capacity;
+        if (resize(kv, capacity) != 0) {
+            return -1;
+        }
+    }
+    char* key_copy = copy != NULL ? *copy : NULL;
+    if (key_copy != NULL) {
+        *copy = NULL;
+    } else {
+        key_copy = (char*)malloc(key_length + 1);
+        if (key_copy == NULL) {
+            return -1;
+        }
+        memcpy(key_copy, key, key_length);
+        key_copy[key_length] = '\0';
+    }
+
+    size_t mask = kv->capacity - 1;
+    size_t i = hash & mask;
+    while (kv->slots[i].key != NULL && kv->slots[i].key != kv_tombstone) {
+        i = (i + 1) & mask;
+    }
+    if (kv->slots[i].key == NULL) {
+        kv->used++;
+    }
+    slot = &kv->slots[i];
+    slot->key = key_copy;
+    slot->hash = hash;
+    slot->offset = offset;
+    slot->length = length;
+    slot->key_length = (uint16_t)key_length;
+    slot->moved = false;
+    kv->count++;
+    kv->live_bytes += entry_cost(key_length, length);
+    return 0;
+}
+
+static bool index_delete(struct iot_kv* kv, const char* key, size_t key_length)
+{
+    struct kv_slot* slot = find_slot(kv, key, key_length, hash_key(key, key_length));
+    if (slot == NULL) {
+        return false;
+    }
+    kv->live_bytes -= entry_cost(key_length, slot->length);
+    free(slot->key);
+    slot->key = kv_tombstone;
+    kv->count--;
+    return true;
+}
+
+// Check that a payload is a sequence of well-formed ops
+static bool payload_valid(const unsigned char* payload, size_t length)
+{
+    size_t pos = 0;
+    while (pos < length) {
+        if (length - pos < KV_OP_HEADER) {
+            return false;
+        }
+        unsigned op = payload[pos];
+        size_t key_length = get_u16(payload + pos + 1);
+        size_t value_length = get_u32(payload + pos + 3);
+        if ((op != KV_OP_PUT && op != KV_OP_DELETE) || key_length == 0 || key_length > IOT_KV_MAX_KEY
+            || (op == KV_OP_DELETE && value_length != 0)) {
+            return false;
+        }
+        pos += KV_OP_HEADER;
+        if (length - pos < key_length || length - pos - key_length < value_length) {
+            return false;
+        }
+        pos += key_length + value_length;
+    }
+    return length > 0;
+}
+
+// Apply a valid payload that starts at file offset base. keys, if not NULL,
+// holds a key copy per put op from payload_reserve, and it cannot fail
+static int payload_apply(struct iot_kv* kv, const unsigned char* payload, size_t length, uint64_t base, char** keys)
+{
+    size_t pos = 0;
+    size_t put = 0;
+    while (pos < length) {
+        unsigned op = payload[pos];
+        size_t key_length = get_u16(payload + pos + 1);
+        uint32_t value_length = get_u32(payload + pos + 3);
+        const char* key = (const char*)payload + pos + KV_OP_HEADER;
+        pos += KV_OP_HEADER + key_length;
+        if (op == KV_OP_PUT) {
+            if (index_put(kv, key, key_length, base + pos, value_length, keys != NULL ? &keys[put++] : NULL) != 0) {
+                return -1;
+            }
+        } else {
+            index_delete(kv, key, key_length);
+        }
+        pos += value_length;
+    }
+    return 0;
+}
+
+// Count the put ops of a valid payload
+static size_t payload_puts(const unsigned char* payload, size_t length)
+{
+    size_t puts = 0;
+    size_t pos = 0;
+    while (pos < length) {
+        puts += payload[pos] == KV_OP_PUT;
+        pos += KV_OP_HEADER + get_u16(payload + pos + 1) + get_u32(payload + pos + 3);
+    }
+    return puts;
+}
+
+// Allocate up front what applying payload could need, so that once its
+// record is in the log the index takes it whole: a key copy for each put of
+// a key that is not stored or may have been deleted by an earlier op, and
+// room in the table for all of them. keys has one NULL entry per put op
+static int payload_reserve(struct iot_kv* kv, const unsigned char* payload, size_t length, char** keys)
+{
+    size_t put = 0;
+    size_t added = 0;
+    bool deleted = false;
+    size_t pos = 0;
+    while (pos < length) {
+        unsigned op = payload[pos];
+        size_t key_length = get_u16(payload + pos + 1);
+        const char* key = (const char*)payload + pos + KV_OP_HEADER;
+        pos += KV_OP_HEADER + key_length + get_u32(payload + pos + 3);
+        if (op != KV_OP_PUT) {
+            deleted = true;
+            continue;
+        }
+        if (deleted || find_slot(kv, key, key_length, hash_key(key, key_length)) == NULL) {
+            keys[put] = (char*)malloc(key_length + 1);
+            if (keys[put] == NULL) {
+                return -1;
+            }
+            memcpy(keys[put], key, key_length);
+            keys[put][key_length] = '\0';
+            added++;
+        }
+        put++;
+    }
+    // The same rule as index_put, applied once for every key to be added
+    if ((kv->used + added) * 4 > kv->capacity * 3) {
+        size_t capacity = kv->capacity;
+        while ((kv->count + added) * 4 > capacity * 3) {
+            capacity *= 2;
+        }
+        if (resize(kv, capacity) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Rebuild the index from the log and cut off anything after the last intact record
+static int recover(struct iot_kv* kv)
+{
+    struct iot_fmap* map = iot_fmap(kv->file, 0, 0, IOT_FMAP_SEQUENTIAL);
+    if (map == NULL) {
+        return -1;
+    }
+    const unsigned char* data = (const unsigned char*)iot_fmap_data(map);
+    size_t size = iot_fmap_size(map);
+
+    if (size < KV_FILE_HEADER) {
+        // New, or torn while the header was being written
+        iot_funmap(map);
+        unsigned char header[KV_FILE_HEADER];
+        memcpy(header, KV_MAGIC, 4);
+        put_u32(header + 4, KV_VERSION);
+        if (iot_ftruncate(kv->file, 0) != 0 || iot_fwrite(header, 1, sizeof(header), kv->file) != sizeof(header)
+            || iot_fsync(kv->file) != 0) {
+            return -1;
+        }
+        kv->log_bytes = KV_FILE_HEADER;
+        return 0;
+    }
+    if (memcmp(data, KV_MAGIC, 4) != 0 || get_u32(data + 4) != KV_VERSION) {
+        iot_funmap(map);
+        return -1;
+    }
+
+    size_t pos = KV_FILE_HEADER;
+    while (size - pos >= KV_RECORD_HEADER) {
+        size_t length = get_u32(data + pos);
+        uint32_t crc = get_u32(data + pos + 4);
+        const unsigned char* payload = data + pos + KV_RECORD_HEADER;
+        if (length > size - pos - KV_RECORD_HEADER || iot_crc32(0, payload, length) != crc || !payload_valid(payload, length)) {
+            break;
+        }
+        if (payload_apply(kv, payload, length, pos + KV_RECORD_HEADER, NULL) != 0) {
+            iot_funmap(map);
+            return -1;
+        }
+        pos += KV_RECORD_HEADER + length;
+    }
+    iot_funmap(map);
+
+    kv->recovered_bytes = pos;
+    kv->discarded_bytes = size - pos;
+    kv->log_bytes = pos;
+    if (pos < size && iot_ftruncate(kv->file, pos) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static char* concat(const char* a, const char* b)
+{
+    size_t la = strlen(a);
+    size_t lb = strlen(b);
+    char* s = (char*)malloc(la + lb + 1);
+    if (s != NULL) {
+        memcpy(s, a, la);
+        memcpy(s + la, b, lb + 1);
+    }
+    return s;
+}
+
+struct iot_kv* iot_kv_open(const char* path, const struct iot_kv_config* config)
+{
+    if (path == NULL) {
+        return NULL;
+    }
+    struct iot_kv* kv = (struct iot_kv*)calloc(1, sizeof(struct iot_kv));
+    if (kv == NULL) {
+        return NULL;
+    }
+    if (config != NULL) {
+        kv->config = *config;
+    }
+    if (kv->config.compact_percent == 0) {
+        kv->config.compact_percent = KV_DEFAULT_COMPACT_PERCENT;
+    }
+    if (kv->config.compact_min_bytes == 0) {
+        kv->config.compact_min_bytes = KV_DEFAULT_COMPACT_MIN_BYTES;
+    }
+    kv->path = concat(path, "");
+    kv->compact_path = concat(path, ".compact");
+    kv->capacity = KV_INITIAL_SLOTS;
+    kv->slots = (struct kv_slot*)calloc(kv->capacity, sizeof(struct kv_slot));
+    kv->lock = iot_mutex_init();
+    if (kv->path == NULL || kv->compact_path == NULL || kv->slots == NULL || kv->lock == NULL) {
+        iot_kv_close(kv);
+        return NULL;
+    }
+
+    iot_remove(kv->compact_path); // Left by a compaction that did not finish
+    kv->file = iot_fopen(path, "a+");
+    if (kv->file == NULL || recover(kv) != 0) {
+        iot_kv_close(kv);
+        return NULL;
+    }
+    return kv;
+}
+
+// Join the last background compaction; called without the lock
+static void join_compactor(struct iot_kv* kv)
+{
+    for (;;) {
+        iot_mutex_lock(kv->lock);
+        struct iot_thread* compactor = kv->compactor;
+        bool compacting = kv->compacting;
+        kv->compactor = NULL;
+        iot_mutex_unlock(kv->lock);
+        if (compactor != NULL) {
+            iot_thread_join(compactor, NULL);
+        } else if (compacting) {
+            iot_thread_delay(1); // A synchronous iot_kv_compact on another thread
+        } else {
+            return;
+        }
+    }
+}
+
+int iot_kv_close(struct iot_kv* kv)
+{
+    if (kv == NULL) {
+        return -1;
+    }
+    int ret = 0;
+    if (kv->lock != NULL) {
+        join_compactor(kv);
+        iot_mutex_destroy(kv->lock);
+    }
+    if (kv->file != NULL) {
+        if (iot_fsync(kv->file) != 0) {
+            ret = -1;
+        }
+        if (iot_fclose(kv->file) != 0) {
+            ret = -1;
+        }
+    }
+    for (size_t i = 0; kv->slots != NULL && i < kv->capacity; i++) {
+        if (kv->slots[i].key != kv_tombstone) {
+            free(kv->slots[i].key);
+        }
+    }
+    free(kv->slots);
+    free(kv->path);
+    free(kv->compact_path);
+    free(kv);
+    return ret;
+}
+
+static int read_at(struct iot_file* file, uint64_t offset, void* buf, size_t length)
+{
+    if (iot_fseek(file, (long)offset) != 0) {
+        return -1;
+    }
+    return iot_fread(buf, 1, length, file) == length ? 0 : -1;
+}
+
+// Write the live keys as of now, then the records appended meanwhile, to
+// compact_path and rename it over the log. The caller has set compacting.
+static int compact_run(struct iot_kv* kv)
+{
+    struct kv_snapshot_entry* snapshot = NULL;
+    size_t snapshot_count = 0;
+    unsigned char* buf = NULL;
+    size_t buf_size = 0;
+    struct iot_file* reader = NULL;
+    struct iot_file* out = NULL;
+    int ret = -1;
+
+    iot_mutex_lock(kv->lock);
+    uint64_t start = kv->log_bytes;
+    snapshot = (struct kv_snapshot_entry*)calloc(kv->count + 1, sizeof(struct kv_snapshot_entry));
+    for (size_t i = 0; snapshot != NULL && i < kv->capacity; i++) {
+        struct kv_slot* slot = &kv->slots[i];
+        if (slot->key == NULL || slot->key == kv_tombstone) {
+            continue;
+        }
+        struct kv_snapshot_entry* entry = &snapshot[snapshot_count++];
+        entry->key = concat(slot->key, "");
+        entry->key_length = slot->key_length;
+        entry->length = slot->length;
+        entry->old_offset = slot->offset;
+        if (entry->key == NULL) {
+            break;
+        }
+    }
+    iot_mutex_unlock(kv->lock);
+    if (snapshot == NULL || (snapshot_count > 0 && snapshot[snapshot_count - 1].key == NULL)) {
+        goto done;
+    }
+
+    // The log below start never changes, so it is copied without the lock
+    struct iot_fbuffer_config out_config = { 256 * 1024, 60000 };
+    reader = iot_fopen(kv->path, "r");
+    out = iot_fopen_buffered(kv->compact_path, "w", &out_config);
+    if (reader == NULL || out == NULL) {
+        goto done;
+    }
+    unsigned char header[KV_FILE_HEADER];
+    memcpy(header, KV_MAGIC, 4);
+    put_u32(header + 4, KV_VERSION);
+    if (iot_fwrite(header, 1, sizeof(header), out) != sizeof(header)) {
+        goto done;
+    }
+    uint64_t size = KV_FILE_HEADER;
+    for (size_t i = 0; i < snapshot_count; i++) {
+        struct kv_snapshot_entry* entry = &snapshot[i];
+        size_t payload = KV_OP_HEADER + entry->key_length + entry->length;
+        if (buf_size < KV_RECORD_HEADER + payload) {
+            free(buf);
+            buf_size = KV_RECORD_HEADER + payload;
+            buf = (unsigned char*)malloc(buf_size);
+            if (buf == NULL) {
+                goto done;
+            }
+        }
+        unsigned char* op = buf + KV_RECORD_HEADER;
+        op[0] = KV_OP_PUT;
+        put_u16(op + 1, entry->key_length);
+        put_u32(op + 3, entry->length);
+        memcpy(op + KV_OP_HEADER, entry->key, entry->key_length);
+        if (read_at(reader, entry->old_offset, op + KV_OP_HEADER + entry->key_length, entry->length) != 0) {
+            goto done;
+        }
+        put_u32(buf, (uint32_t)payload);
+        put_u32(buf + 4, iot_crc32(0, op, payload));
+        if (iot_fwrite(buf, 1, KV_RECORD_HEADER + payload, out) != KV_RECORD_HEADER + payload) {
+            goto done;
+        }
+        entry->new_offset = size + KV_RECORD_HEADER + KV_OP_HEADER + entry->key_length;
+        size += KV_RECORD_HEADER + payload;
+    }
+    if (iot_fsync(out) != 0) {
+        goto done;
+    }
+
+    iot_mutex_lock(kv->lock);
+    // Records appended since the snapshot are copied as they are, shifted by delta
+    uint64_t tail = kv->log_bytes - start;
+    int64_t delta = (int64_t)size - (int64_t)start;
+    if (buf_size < KV_COPY_CHUNK) {
+        free(buf);
+        buf_size = KV_COPY_CHUNK;
+        buf = (unsigned char*)malloc(buf_size);
+    }
+    bool copied = buf != NULL;
+    for (uint64_t done = 0; copied && done < tail;) {
+        size_t chunk = tail - done < KV_COPY_CHUNK ? (size_t)(tail - done) : KV_COPY_CHUNK;
+        copied = read_at(reader, start + done, buf, chunk) == 0 && iot_fwrite(buf, 1, chunk, out) == chunk;
+        done += chunk;
+    }
+    // Opened before the rename, so a failure leaves the old log in place
+    struct iot_file* file = NULL;
+    if (copied && iot_fsync(out) == 0 && iot_fclose(out) == 0) {
+        out = NULL;
+        file = iot_fopen(kv->compact_path, "a+");
+        if (file != NULL && iot_rename(kv->compact_path, kv->path) != 0) {
+            iot_fclose(file);
+            file = NULL;
+        }
+    }
+    if (file == NULL) {
+        iot_mutex_unlock(kv->lock);
+        goto done;
+    }
+
+    // Point the index at the new file: keys unchanged since the snapshot
+    // move to where they were copied, later writes move with the tail
+    for (size_t i = 0; i < snapshot_count; i++) {
+        struct kv_snapshot_entry* entry = &snapshot[i];
+        struct kv_slot* slot = find_slot(kv, entry->key, entry->key_length, hash_key(entry->key, entry->key_length));
+        if (slot != NULL && slot->offset == entry->old_offset) {
+            slot->offset = entry->new_offset;
+            slot->moved = true;
+        }
+    }
+    for (size_t i = 0; i < kv->capacity; i++) {
+        struct kv_slot* slot = &kv->slots[i];
+        if (slot->key == NULL || slot->key == kv_tombstone) {
+            continue;
+        }
+        if (!slot->moved) {
+            slot->offset = (uint64_t)((int64_t)slot->offset + delta);
+        }
+        slot->moved = false;
+    }
+    iot_fclose(kv->file);
+    kv->file = file;
+    kv->log_bytes = size + tail;
+    kv->compactions++;
+    iot_mutex_unlock(kv->lock);
+    ret = 0;
+
+done:
+    if (out != NULL) {
+        iot_fclose(out);
+    }
+    if (ret != 0) {
+        iot_remove(kv->compact_path);
+    }
+    if (reader != NULL) {
+        iot_fclose(reader);
+    }
+    for (size_t i = 0; i < snapshot_count; i++) {
+        free(snapshot[i].key);
+    }
+    free(snapshot);
+    free(buf);
+
+    iot_mutex_lock(kv->lock);
+    kv->compacting = false;
+    iot_mutex_unlock(kv->lock);
+    return ret;
+}
+
+static void compact_thread(void* arg)
+{
+    compact_run((struct iot_kv*)arg);
+}
+
+// Start a background compaction if enough of the log is dead; called with the lock held
+static void maybe_compact(struct iot_kv* kv)
+{
+    if (kv->compacting || kv->log_bytes < kv->config.compact_min_bytes) {
+        return;
+    }
+    uint64_t dead = kv->log_bytes - KV_FILE_HEADER > kv->live_bytes ? kv->log_bytes - KV_FILE_HEADER - kv->live_bytes : 0;
+    if (dead * 100 < (uint64_t)kv->config.compact_percent * kv->log_bytes) {
+        return;
+    }
+    if (kv->compactor != NULL) {
+        iot_thread_join(kv->compactor, NULL); // Finished: it cleared compacting
+        kv->compactor = NULL;
+    }
+    kv->compacting = true;
+    kv->compactor = iot_thread_create("kv_compact", compact_thread, kv, 0, 0, 0);
+    if (kv->compactor == NULL) {
+        kv->compacting = false;
+    }
+}
+
+// Append one record holding payload and apply it to the index
+static int append(struct iot_kv* kv, const unsigned char* payload, size_t length)
+{
+    unsigned char* record = (unsigned char*)malloc(KV_RECORD_HEADER + length);
+    if (record == NULL) {
+        return -1;
+    }
+    put_u32(record, (uint32_t)length);
+    put_u32(record + 4, iot_crc32(0, payload, length));
+    memcpy(record + KV_RECORD_HEADER, payload, length);
+
+    char* stack_keys[8];
+    size_t puts = payload_puts(payload, length);
+    char** keys = puts <= 8 ? stack_keys : (char**)malloc(puts * sizeof(char*));
+    if (keys == NULL) {
+        free(record);
+        return -1;
+    }
+    for (size_t i = 0; i < puts; i++) {
+        keys[i] = NULL;
+    }
+
+    iot_mutex_lock(kv->lock);
+    uint64_t offset = kv->log_bytes;
+    int ret = 0;
+    if (payload_reserve(kv, payload, length, keys) != 0) {
+        ret = -1;
+    } else if (iot_fwrite(record, 1, KV_RECORD_HEADER + length, kv->file) != KV_RECORD_HEADER + length
+        || (kv->config.sync_writes && iot_fsync(kv->file) != 0)) {
+        iot_ftruncate(kv->file, offset); // Leave no half record behind
+        ret = -1;
+    } else {
+        kv->log_bytes += KV_RECORD_HEADER + length;
+        ret = payload_apply(kv, payload, length, offset + KV_RECORD_HEADER, keys);
+        maybe_compact(kv);
+    }
+    iot_mutex_unlock(kv->lock);
+    // Copies the index did not take: keys already stored, or a failed write
+    for (size_t i = 0; i < puts; i++) {
+        free(keys[i]);
+    }
+    if (keys != stack_keys) {
+        free(keys);
+    }
+    free(record);
+    return ret;
+}
+
+// Encode one op into out, which has room for it
+static size_t encode_op(unsigned char* out, unsigned op, const char* key, size_t key_length, const void* value, size_t length)
+{
+    out[0] = (unsigned char)op;
+    put_u16(out + 1, (uint16_t)key_length);
+    put_u32(out + 3, (uint32_t)length);
+    memcpy(out + KV_OP_HEADER, key, key_length);
+    if (length > 0) {
+        memcpy(out + KV_OP_HEADER + key_length, value, length);
+    }
+    return KV_OP_HEADER + key_length + length;
+}
+
+static bool key_valid(const char* key, size_t* key_length)
+{
+    if (key == NULL) {
+        return false;
+    }
+    *key_length = strlen(key);
+    return *key_length > 0 && *key_length <= IOT_KV_MAX_KEY;
+}
+
+int iot_kv_put(struct iot_kv* kv, const char* key, const void* value, size_t length)
+{
+    size_t key_length;
+    if (kv == NULL || !key_valid(key, &key_length) || (value == NULL && length > 0) || length > UINT32_MAX - KV_OP_HEADER - IOT_KV_MAX_KEY) {
+        return -1;
+    }
+    unsigned char stack_payload[256];
+    size_t payload_length = KV_OP_HEADER + key_length + length;
+    unsigned char* payload = payload_length <= sizeof(stack_payload) ? stack_payload : (unsigned char*)malloc(payload_length);
+    if (payload == NULL) {
+        return -1;
+    }
+    encode_op(payload, KV_OP_PUT, key, key_length, value, length);
+    int ret = append(kv, payload, payload_length);
+    if (payload != stack_payload) {
+        free(payload);
+    }
+    return ret;
+}
+
+int iot_kv_get(struct iot_kv* kv, const char* key, void* buf, size_t size, size_t* length)
+{
+    size_t key_length;
+    if (kv == NULL || !key_valid(key, &key_length) || (buf == NULL && size > 0)) {
+        return -1;
+    }
+    iot_mutex_lock(kv->lock);
+    struct kv_slot* slot = find_slot(kv, key, key_length, hash_key(key, key_length));
+    int ret = 0;
+    if (slot == NULL) {
+        ret = IOT_KV_NOT_FOUND;
+    } else {
+        size_t n = slot->length < size ? slot->length : size;
+        if (length != NULL) {
+            *length = slot->length;
+        }
+        if (n > 0) {
+            ret = read_at(kv->file, slot->offset, buf, n);
+        }
+    }
+    iot_mutex_unlock(kv->lock);
+    return ret;
+}
+
+int iot_kv_delete(struct iot_kv* kv, const char* key)
+{
+    size_t key_length;
+    if (kv == NULL || !key_valid(key, &key_length)) {
+        return -1;
+    }
+    iot_mutex_lock(kv->lock);
+    bool found = find_slot(kv, key, key_length, hash_key(key, key_length)) != NULL;
+    iot_mutex_unlock(kv->lock);
+    if (!found) {
+        return IOT_KV_NOT_FOUND;
+    }
+    unsigned char payload[KV_OP_HEADER + IOT_KV_MAX_KEY];
+    return append(kv, payload, encode_op(payload, KV_OP_DELETE, key, key_length, NULL, 0));
+}
+
+int iot_kv_compact(struct iot_kv* kv)
+{
+    if (kv == NULL) {
+        return -1;
+    }
+    for (;;) {
+        join_compactor(kv);
+        iot_mutex_lock(kv->lock);
+        bool idle = !kv->compacting;
+        kv->compacting = true;
+        iot_mutex_unlock(kv->lock);
+        if (idle) {
+            return compact_run(kv);
+        }
+    }
+}
+
+void iot_kv_get_stats(struct iot_kv* kv, struct iot_kv_stats* stats)
+{
+    if (kv == NULL || stats == NULL) {
+        return;
+    }
+    iot_mutex_lock(kv->lock);
+    stats->keys = kv->count;
+    stats->log_bytes = kv->log_bytes;
+    stats->live_bytes = kv->live_bytes;
+    stats->recovered_bytes = kv->recovered_bytes;
+    stats->discarded_bytes = kv->discarded_bytes;
+    stats->compactions = kv->compactions;
+    iot_mutex_unlock(kv->lock);
+}
+
+struct iot_kv_batch* iot_kv_batch_create(void)
+{
+    return (struct iot_kv_batch*)calloc(1, sizeof(struct iot_kv_batch));
+}
+
+static int batch_add(struct iot_kv_batch* batch, unsigned op, const char* key, const void* value, size_t length)
+{
+    size_t key_length;
+    if (batch == NULL || !key_valid(key, &key_length) || (value == NULL && length > 0)) {
+        return -1;
+    }
+    size_t needed = KV_OP_HEADER + key_length + length;
+    if (needed > UINT32_MAX - batch->length) {
+        return -1;
+    }
+    if (batch->length + needed > batch->capacity) {
+        size_t capacity = batch->capacity != 0 ? batch->capacity : 256;
+        while (capacity < batch->length + needed) {
+            capacity *= 2;
+        }
+        unsigned char* data = (unsigned char*)realloc(batch->data, capacity);
+        if (data == NULL) {
+            return -1;
+        }
+        batch->data = data;
+        batch->capacity = capacity;
+    }
+    batch->length += encode_op(batch->data + batch->length, op, key, key_length, value, length);
+    return 0;
+}
+
+int iot_kv_batch_put(struct iot_kv_batch* batch, const char* key, const void* value, size_t length)
+{
+    return batch_add(batch, KV_OP_PUT, key, value, length);
+}
+
+int iot_kv_batch_delete(struct iot_kv_batch* batch, const char* key)
+{
+    return batch_add(batch, KV_OP_DELETE, key, NULL, 0);
+}
+
+void iot_kv_batch_clear(struct iot_kv_batch* batch)
+{
+    if (batch != NULL) {
+        batch->length = 0;
+    }
+}
+
+void iot_kv_batch_destroy(struct iot_kv_batch* batch)
+{
+    if (batch != NULL) {
+        free(batch->data);
+        free(batch);
+    }
+}
+
+int iot_kv_write(struct iot_kv* kv, const struct iot_kv_batch* batch)
+{
+    if (kv == NULL || batch == NULL) {
+        return -1;
+    }
+    if (batch->length == 0) {
+        return 0;
+    }
+    return append(kv, batch->data, batch->length);
+}
@@ -0,0 +1,631 @@
+#include "storage/ring_log.h"
+#include "interface/filesystem.h"
+#include "interface/os.h"
+#include "storage/crc32.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * File layout, little-endian:
+ *
+ *   checkpoint slots  two 64-byte slots at 0 and 512, written alternately
+ *                     so a torn checkpoint leaves the other one intact
+ *   record space      capacity bytes from 1024
+ *
+ * A slot holds "IORL", u32 version, u32 capacity, u32 head, u64 next_seq,
+ * u32 tail, u32 read offset, u64 tail_seq, u64 read seq, u64 generation,
+ * u32 CRC-32 of the preceding bytes. A record is u32 length, u32 CRC-32
+ * of seq and data, u64 seq, data. Offsets are relative to the record space.
+ *
+ * A record that does not fit before the end goes to offset 0; if there is
+ * room for a header at the old head, a wrap marker with the record's seq
+ * is left there, so every seq is found at the end of the previous record
+ * or, failing that, at offset 0.
+ *
+ * Records are overwritten only after a checkpoint has moved the tail past
+ * them. Evicting therefore writes a checkpoint, and frees some slack
+ * beyond the record so that the appends after it need none. Recovery
+ * replays the records past the checkpointed head while they fit in the
+ * space the checkpoint left free and stops at the first that does not,
+ * or whose seq or CRC is wrong.
+ */
+
+#define RING_MAGIC "IORL"
+#define RING_VERSION 1
+#define RING_SLOT_SIZE 64
+#define RING_SLOT_STRIDE 512
+#define RING_DATA_START 1024
+#define RING_RECORD_HEADER 16
+#define RING_WRAP 0xffffffffu
+#define RING_MIN_CAPACITY 256
+#define RING_DEFAULT_CAPACITY (64 * 1024)
+#define RING_DEFAULT_CHECKPOINT_INTERVAL 64
+#define RING_UNKNOWN_POSITION UINT64_MAX
+#define RING_WINDOW_SIZE 4096
+
+struct ring_header {
+    uint32_t length;
+    uint32_t crc;
+    uint64_t seq;
+};
+
+struct iot_ring_log {
+    struct iot_mutex* lock;
+    struct iot_file* file;
+    struct iot_ring_log_config config;
+    uint32_t capacity;
+    uint32_t slack; // Extra space freed when evicting
+    uint64_t position; // Of the file, to skip redundant seeks
+    uint32_t head; // End of the newest record
+    uint64_t next_seq;
+    uint32_t tail; // Oldest record; meaningless when empty
+    uint64_t tail_seq; // Equal to next_seq when empty
+    struct iot_ring_log_cursor committed;
+    uint64_t generation; // Of the newest checkpoint
+    uint32_t since_checkpoint; // Appends
+    uint64_t lost;
+    uint64_t recovered;
+    unsigned char* scratch;
+    size_t scratch_size;
+    // Record space read ahead for header lookups, which walk it in order
+    unsigned char window[RING_WINDOW_SIZE];
+    uint32_t window_offset;
+    uint32_t window_length;
+};
+
+static void put_u32(unsigned char* p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static void put_u64(unsigned char* p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static uint32_t get_u32(const unsigned char* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_u64(const unsigned char* p)
+{
+    return (uint64_t)get_u32(p) | ((uint64_t)get_u32(p + 4) << 32);
+}
+
+static bool is_empty(const struct iot_ring_log* log)
+{
+    return log->tail_seq == log->next_seq;
+}
+
+static int seek_to(struct iot_ring_log* log, uint64_t position)
+{
+    if (log->position == position) {
+        return 0;
+    }
+    if (iot_fseek(log->file, (long)position) != 0) {
+        log->position = RING_UNKNOWN_POSITION;
+        return -1;
+    }
+    log->position = position;
+    return 0;
+}
+
+static int read_at(struct iot_ring_log* log, uint64_t position, void* buf, size_t length)
+{
+    if (seek_to(log, position) != 0) {
+        return -1;
+    }
+    if (iot_fread(buf, 1, length, log->file) != length) {
+        log->position = RING_UNKNOWN_POSITION;
+        return -1;
+    }
+    log->position += length;
+    return 0;
+}
+
+static int write_at(struct iot_ring_log* log, uint64_t position, const void* buf, size_t length)
+{
+    uint64_t window_start = RING_DATA_START + (uint64_t)log->window_offset;
+    if (position < window_start + log->window_length && position + length > window_start) {
+        log->window_length = 0;
+    }
+    if (seek_to(log, position) != 0) {
+        return -1;
+    }
+    if (iot_fwrite(buf, 1, length, log->file) != length) {
+        log->position = RING_UNKNOWN_POSITION;
+        return -1;
+    }
+    log->position += length;
+    return 0;
+}
+
+static uint32_t record_crc(uint64_t seq, const void* data, size_t length)
+{
+    unsigned char seq_bytes[8];
+    put_u64(seq_bytes, seq);
+    return iot_crc32(iot_crc32(0, seq_bytes, sizeof(seq_bytes)), data, length);
+}
+
+static void encode_header(unsigned char* p, uint32_t length, uint32_t crc, uint64_t seq)
+{
+    put_u32(p, length);
+    put_u32(p + 4, crc);
+    put_u64(p + 8, seq);
+}
+
+// Read the header at offset if it is the record seq
+static bool header_at(struct iot_ring_log* log, uint32_t offset, uint64_t seq, struct ring_header* header)
+{
+    if (offset < log->window_offset || offset + RING_RECORD_HEADER > log->window_offset + log->window_length) {
+        uint32_t length = log->capacity - offset < RING_WINDOW_SIZE ? log->capacity - offset : RING_WINDOW_SIZE;
+        log->window_length = 0;
+        if (read_at(log, RING_DATA_START + (uint64_t)offset, log->window, length) != 0) {
+            return false;
+        }
+        log->window_offset = offset;
+        log->window_length = length;
+    }
+    const unsigned char* buf = log->window + (offset - log->window_offset);
+    if (get_u64(buf + 8) != seq) {
+        return false;
+    }
+    header->length = get_u32(buf);
+    header->crc = get_u32(buf + 4);
+    header->seq = seq;
+    return true;
+}
+
+// Find record seq, expected at offset or at 0 if it wrapped; returns its
+// offset, or -1 if it is not there
+static int64_t locate(struct iot_ring_log* log, uint32_t offset, uint64_t seq, struct ring_header* header)
+{
+    if ((uint64_t)offset + RING_RECORD_HEADER <= log->capacity) {
+        if (!header_at(log, offset, seq, header)) {
+            return -1;
+        }
+        if (header->length != RING_WRAP) {
+            return (uint64_t)offset + RING_RECORD_HEADER + header->length <= log->capacity ? (int64_t)offset : -1;
+        }
+    }
+    if (!header_at(log, 0, seq, header) || header->length == RING_WRAP
+        || (uint64_t)RING_RECORD_HEADER + header->length > log->capacity) {
+        return -1;
+    }
+    return 0;
+}
+
+// Drop the oldest record
+static void evict(struct iot_ring_log* log)
+{
+    struct ring_header header;
+    if (log->tail_seq >= log->committed.seq) {
+        log->lost++;
+    }
+    int64_t next = -1;
+    if (locate(log, log->tail, log->tail_seq, &header) == (int64_t)log->tail && log->tail_seq + 1 != log->next_seq) {
+        next = locate(log, log->tail + RING_RECORD_HEADER + header.length, log->tail_seq + 1, &header);
+    }
+    log->tail_seq++;
+    if (next >= 0) {
+        log->tail = (uint32_t)next;
+    } else if (!is_empty(log)) {
+        // Unreadable: the records after it cannot be found either
+        log->lost += log->next_seq - (log->tail_seq > log->committed.seq ? log->tail_seq : log->committed.seq);
+        log->tail_seq = log->next_seq;
+    }
+}
+
+// Whether a record of need bytes at start overwrites no stored record
+static bool fits(const struct iot_ring_log* log, uint32_t start, uint32_t need)
+{
+    if (is_empty(log)) {
+        return true;
+    }
+    // Wrapping passes the records between the head and the end, which are the oldest
+    if (start != log->head && log->tail >= log->head) {
+        return false;
+    }
+    return log->tail < start || (uint64_t)log->tail >= (uint64_t)start + need;
+}
+
+// Where a record of need bytes goes
+static uint32_t record_start(const struct iot_ring_log* log, uint32_t need)
+{
+    return (uint64_t)log->head + need > log->capacity ? 0 : log->head;
+}
+
+// Evict the records in the way of a record of need bytes at start, and the
+// slack after it; returns whether any were evicted
+static bool make_room(struct iot_ring_log* log, uint32_t start, uint32_t need)
+{
+    if (fits(log, start, need)) {
+        return false;
+    }
+    if (start != log->head) {
+        while (!is_empty(log) && log->tail >= log->head) {
+            evict(log);
+        }
+    }
+    uint64_t end = (uint64_t)start + need + log->slack;
+    while (!is_empty(log) && log->tail >= start && log->tail < end) {
+        evict(log);
+    }
+    return true;
+}
+
+static int write_checkpoint(struct iot_ring_log* log)
+{
+    unsigned char slot[RING_SLOT_SIZE] = { 0 };
+    uint64_t generation = log->generation + 1;
+    memcpy(slot, RING_MAGIC, 4);
+    put_u32(slot + 4, RING_VERSION);
+    put_u32(slot + 8, log->capacity);
+    put_u32(slot + 12, log->head);
+    put_u64(slot + 16, log->next_seq);
+    put_u32(slot + 24, is_empty(log) ? log->head : log->tail);
+    put_u32(slot + 28, log->committed.offset);
+    put_u64(slot + 32, log->tail_seq);
+    put_u64(slot + 40, log->committed.seq);
+    put_u64(slot + 48, generation);
+    put_u32(slot + 56, iot_crc32(0, slot, 56));
+
+    if (write_at(log, (generation & 1) * RING_SLOT_STRIDE, slot, sizeof(slot)) != 0
+        || (log->config.sync_writes && iot_fsync(log->file) != 0)) {
+        return -1;
+    }
+    log->generation = generation;
+    log->since_checkpoint = 0;
+    return 0;
+}
+
+// Parse a checkpoint slot; false if it is not a valid one
+static bool read_slot(const unsigned char* slot, struct iot_ring_log* log)
+{
+    if (memcmp(slot, RING_MAGIC, 4) != 0 || get_u32(slot + 4) != RING_VERSION || get_u32(slot + 56) != iot_crc32(0, slot, 56)) {
+        return false;
+    }
+    uint32_t capacity = get_u32(slot + 8);
+    uint32_t head = get_u32(slot + 12);
+    uint64_t next_seq = get_u64(slot + 16);
+    uint32_t tail = get_u32(slot + 24);
+    uint64_t tail_seq = get_u64(slot + 32);
+    uint32_t read_offset = get_u32(slot + 28);
+    uint64_t read_seq = get_u64(slot + 40);
+    if (capacity < RING_MIN_CAPACITY || head > capacity || tail > capacity || read_offset > capacity || tail_seq > next_seq
+        || read_seq > next_seq) {
+        return false;
+    }
+    log->capacity = capacity;
+    log->head = head;
+    log->next_seq = next_seq;
+    log->tail = tail;
+    log->tail_seq = tail_seq;
+    log->committed.offset = read_offset;
+    log->committed.seq = read_seq;
+    log->generation = get_u64(slot + 48);
+    return true;
+}
+
+static int reserve_scratch(struct iot_ring_log* log, size_t size)
+{
+    if (log->scratch_size >= size) {
+        return 0;
+    }
+    unsigned char* scratch = (unsigned char*)realloc(log->scratch, size);
+    if (scratch == NULL) {
+        return -1;
+    }
+    log->scratch = scratch;
+    log->scratch_size = size;
+    return 0;
+}
+
+// Load the newest checkpoint, then replay the records appended after it
+static int recover(struct iot_ring_log* log, size_t file_size)
+{
+    unsigned char slots[2][RING_SLOT_SIZE];
+    if (read_at(log, 0, slots[0], RING_SLOT_SIZE) != 0 || read_at(log, RING_SLOT_STRIDE, slots[1], RING_SLOT_SIZE) != 0) {
+        return -1;
+    }
+    struct iot_ring_log candidates[2];
+    bool valid[2];
+    for (int i = 0; i < 2; i++) {
+        memset(&candidates[i], 0, sizeof(candidates[i]));
+        valid[i] = read_slot(slots[i], &candidates[i]);
+    }
+    int best = valid[0] && (!valid[1] || candidates[0].generation > candidates[1].generation) ? 0 : 1;
+    if (!valid[best] || file_size != RING_DATA_START + (size_t)candidates[best].capacity) {
+        return -1;
+    }
+    log->capacity = candidates[best].capacity;
+    log->head = candidates[best].head;
+    log->next_seq = candidates[best].next_seq;
+    log->tail = candidates[best].tail;
+    log->tail_seq = candidates[best].tail_seq;
+    log->committed = candidates[best].committed;
+    log->generation = candidates[best].generation;
+
+    for (;;) {
+        struct ring_header header;
+        int64_t start = locate(log, log->head, log->next_seq, &header);
+        if (start < 0) {
+            break;
+        }
+        uint32_t need = RING_RECORD_HEADER + header.length;
+        if (!fits(log, (uint32_t)start, need) || reserve_scratch(log, header.length + 1) != 0
+            || read_at(log, RING_DATA_START + (uint64_t)start + RING_RECORD_HEADER, log->scratch, header.length) != 0
+            || record_crc(header.seq, log->scratch, header.length) != header.crc) {
+            break;
+        }
+        if (is_empty(log)) {
+            log->tail = (uint32_t)start;
+        }
+        log->head = (uint32_t)start + need;
+        log->next_seq++;
+        log->recovered++;
+    }
+    return log->recovered > 0 ? write_checkpoint(log) : 0;
+}
+
+// Size the file and write the first checkpoint
+static int initialize(struct iot_ring_log* log)
+{
+    log->next_seq = 1;
+    log->tail_seq = 1;
+    log->committed.seq = 1;
+    if (iot_ftruncate(log->file, 0) != 0 || iot_ftruncate(log->file, RING_DATA_START + (size_t)log->capacity) != 0) {
+        return -1;
+    }
+    // Forced so a crash never leaves a sized file without a checkpoint
+    bool sync_writes = log->config.sync_writes;
+    log->config.sync_writes = true;
+    int ret = write_checkpoint(log);
+    log->config.sync_writes = sync_writes;
+    return ret;
+}
+
+struct iot_ring_log* iot_ring_log_open(const char* path, const struct iot_ring_log_config* config)
+{
+    if (path == NULL) {
+        return NULL;
+    }
+    struct iot_ring_log* log = (struct iot_ring_log*)calloc(1, sizeof(struct iot_ring_log));
+    if (log == NULL) {
+        return NULL;
+    }
+    if (config != NULL) {
+        log->config = *config;
+    }
+    if (log->config.capacity == 0) {
+        log->config.capacity = RING_DEFAULT_CAPACITY;
+    }
+    if (log->config.checkpoint_interval == 0) {
+        log->config.checkpoint_interval = RING_DEFAULT_CHECKPOINT_INTERVAL;
+    }
+    log->capacity = log->config.capacity;
+    log->position = RING_UNKNOWN_POSITION;
+    log->lock = iot_mutex_init();
+    if (log->lock == NULL || log->capacity < RING_MIN_CAPACITY || log->capacity > UINT32_MAX - RING_DATA_START) {
+        iot_ring_log_close(log);
+        return NULL;
+    }
+
+    // An empty file is one whose creation was cut short
+    struct iot_stat st;
+    bool exists = iot_stat(path, &st) == 0 && st.st_size > 0;
+    log->file = iot_fopen(path, exists ? "r+" : "w+");
+    if (log->file == NULL || (exists ? recover(log, st.st_size) : initialize(log)) != 0) {
+        iot_ring_log_close(log);
+        return NULL;
+    }
+    log->slack = log->capacity / 16;
+    return log;
+}
+
+int iot_ring_log_close(struct iot_ring_log* log)
+{
+    if (log == NULL) {
+        return -1;
+    }
+    int ret = 0;
+    if (log->file != NULL) {
+        if (log->generation > 0 && write_checkpoint(log) != 0) {
+            ret = -1;
+        }
+        if (iot_fsync(log->file) != 0) {
+            ret = -1;
+        }
+        if (iot_fclose(log->file) != 0) {
+            ret = -1;
+        }
+    }
+    iot_mutex_destroy(log->lock);
+    free(log->scratch);
+    free(log);
+    return ret;
+}
+
+int iot_ring_log_append(struct iot_ring_log* log, const void* data, size_t length)
+{
+    if (log == NULL || (data == NULL && length > 0) || length > log->capacity - RING_RECORD_HEADER) {
+        return -1;
+    }
+    uint32_t need = RING_RECORD_HEADER + (uint32_t)length;
+
+    iot_mutex_lock(log->lock);
+    int ret = reserve_scratch(log, need);
+    if (ret == 0) {
+        uint64_t seq = log->next_seq;
+        encode_header(log->scratch, (uint32_t)length, record_crc(seq, data, length), seq);
+        if (length > 0) {
+            memcpy(log->scratch + RING_RECORD_HEADER, data, length);
+        }
+        uint32_t start = record_start(log, need);
+        if (make_room(log, start, need)) {
+            // The evicted records must be gone on disk before any is overwritten
+            ret = write_checkpoint(log);
+        }
+        if (ret == 0 && start != log->head && (uint64_t)log->head + RING_RECORD_HEADER <= log->capacity) {
+            unsigned char marker[RING_RECORD_HEADER];
+            encode_header(marker, RING_WRAP, record_crc(seq, NULL, 0), seq);
+            ret = write_at(log, RING_DATA_START + (uint64_t)log->head, marker, sizeof(marker));
+        }
+        if (ret == 0) {
+            ret = write_at(log, RING_DATA_START + (uint64_t)start, log->scratch, need);
+        }
+        if (ret == 0 && log->config.sync_writes) {
+            ret = iot_fsync(log->file);
+        }
+        if (ret == 0) {
+            if (is_empty(log)) {
+                log->tail = start;
+            }
+            log->head = start + need;
+            log->next_seq++;
+            if (++log->since_checkpoint >= log->config.checkpoint_interval) {
+                ret = write_checkpoint(log);
+            }
+        }
+    }
+    iot_mutex_unlock(log->lock);
+    return ret;
+}
+
+// The oldest stored record, or the next one written if there is none
+static void oldest(const struct iot_ring_log* log, struct iot_ring_log_cursor* cursor)
+{
+    cursor->seq = log->tail_seq;
+    cursor->offset = is_empty(log) ? log->head : log->tail;
+}
+
+void iot_ring_log_cursor_init(struct iot_ring_log* log, struct iot_ring_log_cursor* cursor)
+{
+    if (log == NULL || cursor == NULL) {
+        return;
+    }
+    iot_mutex_lock(log->lock);
+    if (log->committed.seq < log->tail_seq) {
+        oldest(log, cursor);
+    } else {
+        *cursor = log->committed;
+    }
+    iot_mutex_unlock(log->lock);
+}
+
+int iot_ring_log_read(struct iot_ring_log* log, struct iot_ring_log_cursor* cursor, void* buf, size_t size, size_t* length)
+{
+    if (log == NULL || cursor == NULL || length == NULL) {
+        return -1;
+    }
+    iot_mutex_lock(log->lock);
+    if (cursor->seq < log->tail_seq || cursor->seq > log->next_seq) {
+        oldest(log, cursor);
+    }
+    int ret = 0;
+    struct ring_header header;
+    int64_t offset = -1;
+    if (cursor->seq == log->next_seq) {
+        ret = IOT_RING_LOG_END;
+    } else if ((offset = locate(log, cursor->offset, cursor->seq, &header)) < 0) {
+        ret = -1;
+    } else {
+        *length = header.length;
+        if (header.length > size || (buf == NULL && header.length > 0)) {
+            ret = IOT_RING_LOG_TOO_SMALL;
+        } else if (read_at(log, RING_DATA_START + (uint64_t)offset + RING_RECORD_HEADER, buf, header.length) != 0
+            || record_crc(header.seq, buf, header.length) != header.crc) {
+            ret = -1;
+        } else {
+            cursor->offset = (uint32_t)offset + RING_RECORD_HEADER + header.length;
+            cursor->seq++;
+        }
+    }
+    iot_mutex_unlock(log->lock);
+    return ret;
+}
+
+int iot_ring_log_commit(struct iot_ring_log* log, const struct iot_ring_log_cursor* cursor)
+{
+    if (log == NULL || cursor == NULL) {
+        return -1;
+    }
+    iot_mutex_lock(log->lock);
+    int ret = 0;
+    if (cursor->seq > log->committed.seq && cursor->seq <= log->next_seq) {
+        log->committed = *cursor;
+        ret = write_checkpoint(log);
+    }
+    iot_mutex_unlock(log->lock);
+    return ret;
+}
+
+int iot_ring_log_drain(struct iot_ring_log* log, size_t max_records, iot_ring_log_sink sink, void* ctx)
+{
+    if (log == NULL || sink == NULL) {
+        return -1;
+    }
+    struct iot_ring_log_cursor cursor;
+    iot_ring_log_cursor_init(log, &cursor);
+    unsigned char* buf = NULL;
+    size_t size = 0;
+    int delivered = 0;
+    int ret = 0;
+    while ((size_t)delivered < max_records) {
+        struct iot_ring_log_cursor next = cursor;
+        size_t length = 0;
+        ret = iot_ring_log_read(log, &next, buf, size, &length);
+        if (ret == IOT_RING_LOG_TOO_SMALL) {
+            unsigned char* grown = (unsigned char*)realloc(buf, length);
+            if (grown == NULL) {
+                ret = -1;
+                break;
+            }
+            buf = grown;
+            size = length;
+            continue;
+        }
+        if (ret == IOT_RING_LOG_END) {
+            ret = 0;
+            break;
+        }
+        if (ret != 0) {
+            break;
+        }
+        if (sink(ctx, buf, length) != 0) {
+            ret = -1;
+            break;
+        }
+        cursor = next;
+        delivered++;
+    }
+    if (delivered > 0 && iot_ring_log_commit(log, &cursor) != 0) {
+        ret = -1;
+    }
+    free(buf);
+    return ret < 0 ? ret : delivered;
+}
+
+void iot_ring_log_get_stats(struct iot_ring_log* log, struct iot_ring_log_stats* stats)
+{
+    if (log == NULL || stats == NULL) {
+        return;
+    }
+    iot_mutex_lock(log->lock);
+    memset(stats, 0, sizeof(*stats));
+    stats->capacity = log->capacity;
+    if (!is_empty(log)) {
+        stats->used_bytes = log->head > log->tail ? log->head - log->tail : log->capacity - log->tail + log->head;
+    }
+    stats->records = log->next_seq - log->tail_seq;
+    stats->unread = log->next_seq - (log->committed.seq > log->tail_seq ? log->committed.seq : log->tail_seq);
+    stats->next_seq = log->next_seq;
+    stats->lost = log->lost;
+    stats->recovered = log->recovered;
+    iot_mutex_unlock(log->lock);
+}
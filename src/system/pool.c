@@ -0,0 +1,325 @@
+#include "system/pool.h"
+#include "interface/os.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SANITIZE_ADDRESS__)
+#define POOL_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define POOL_ASAN 1
+#endif
+#endif
+
+#if defined(POOL_ASAN)
+#include <sanitizer/asan_interface.h>
+#define POISON(addr, size) ASAN_POISON_MEMORY_REGION(addr, size)
+#define UNPOISON(addr, size) ASAN_UNPOISON_MEMORY_REGION(addr, size)
+#else
+#define POISON(addr, size) ((void)(addr), (void)(size))
+#define UNPOISON(addr, size) ((void)(addr), (void)(size))
+#endif
+
+/*
+ * Every block starts with a 16-byte header naming its size class, so
+ * iot_pool_free finds the class without a lookup and the memory after it
+ * keeps malloc's alignment. Classes step by 16 bytes up to 64 and then by
+ * halves of a power of two (96, 128, 192, ...), which wastes at most a
+ * third of a block. Each class carves its chunks lazily, a block at a
+ * time, and keeps the freed blocks on a list linked through their first
+ * bytes.
+ *
+ * A thread keeps up to CACHE_BLOCKS free blocks per class. An empty cache
+ * takes TRANSFER_BLOCKS from the class under its lock, and a full one gives
+ * back as many, so a thread that allocates and frees in a steady pattern
+ * stops taking the lock at all. The first time a thread puts a block in
+ * its cache it sets a thread-specific key whose destructor hands the cache
+ * back, so blocks cached by any thread return when it exits. Under
+ * AddressSanitizer, free blocks are poisoned, and so is the tail of a
+ * block beyond the size asked for.
+ */
+
+#define CLASSES 14
+#define LARGE_CLASS 0xffu
+#define HEADER_SIZE 16
+#define CHUNK_SIZE (16 * 1024)
+#define CACHE_BLOCKS 16
+#define TRANSFER_BLOCKS (CACHE_BLOCKS / 2)
+
+static const uint32_t class_sizes[CLASSES] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048
+};
+
+// Chunks of a class, linked so they stay reachable for leak checkers
+struct chunk {
+    struct chunk* next;
+};
+
+struct size_class {
+    _Atomic(struct iot_mutex*) lock;
+    void* free_list;
+    size_t free_blocks;
+    size_t total_blocks;
+    struct chunk* chunks;
+    char* carve; // Next uncarved block of the newest chunk
+    char* carve_end;
+};
+
+struct thread_cache {
+    void* blocks[CLASSES][CACHE_BLOCKS];
+    uint32_t count[CLASSES];
+    bool exit_key_set; // Flushed by the key's destructor when the thread exits
+};
+
+static struct size_class classes[CLASSES];
+static atomic_size_t reserved_bytes;
+static atomic_size_t large_in_use;
+static _Thread_local struct thread_cache cache;
+static pthread_once_t exit_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t exit_key;
+static bool exit_key_created;
+
+static unsigned class_of(size_t size)
+{
+    if (size <= 64) {
+        return size == 0 ? 0 : (unsigned)((size - 1) >> 4);
+    }
+    // size - 1 has its top bit at 6..10; the bit below picks the half
+    unsigned top = 63u - (unsigned)__builtin_clzll((unsigned long long)(size - 1));
+    unsigned half = (unsigned)((size - 1) >> (top - 1)) & 1u;
+    return 4 + (top - 6) * 2 + half;
+}
+
+static size_t block_size(unsigned index)
+{
+    return HEADER_SIZE + class_sizes[index];
+}
+
+static void flush_at_exit(void* arg)
+{
+    (void)arg;
+    iot_pool_thread_flush();
+    cache.exit_key_set = false; // Blocks freed by later destructors set it again
+}
+
+static void create_exit_key(void)
+{
+    exit_key_created = pthread_key_create(&exit_key, flush_at_exit) == 0;
+}
+
+// Arranges for the calling thread's cache to be flushed when it exits
+static __attribute__((noinline)) void set_exit_key(void)
+{
+    pthread_once(&exit_key_once, create_exit_key);
+    if (exit_key_created) {
+        pthread_setspecific(exit_key, &cache);
+    }
+    cache.exit_key_set = true;
+}
+
+// The class lock, created on first use
+static struct iot_mutex* class_lock(struct size_class* sc)
+{
+    struct iot_mutex* lock = atomic_load_explicit(&sc->lock, memory_order_acquire);
+    if (lock != NULL) {
+        return lock;
+    }
+    struct iot_mutex* created = iot_mutex_init();
+    if (created == NULL) {
+        return NULL;
+    }
+    if (!atomic_compare_exchange_strong_explicit(&sc->lock, &lock, created, memory_order_acq_rel, memory_order_acquire)) {
+        iot_mutex_destroy(created); // Another thread got there first
+        return lock;
+    }
+    return created;
+}
+
+static void* link_of(void* block)
+{
+    void* next;
+    memcpy(&next, (char*)block + HEADER_SIZE, sizeof(next));
+    return next;
+}
+
+static void set_link(void* block, void* next)
+{
+    UNPOISON((char*)block + HEADER_SIZE, sizeof(next));
+    memcpy((char*)block + HEADER_SIZE, &next, sizeof(next));
+}
+
+// Takes one block off the free list or the chunk; called under the lock
+static void* take_block(struct size_class* sc, unsigned index)
+{
+    void* block = sc->free_list;
+    if (block != NULL) {
+        sc->free_list = link_of(block);
+        sc->free_blocks--;
+        return block;
+    }
+    size_t size = block_size(index);
+    if (sc->carve == NULL || (size_t)(sc->carve_end - sc->carve) < size) {
+        struct chunk* chunk = (struct chunk*)malloc(CHUNK_SIZE);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->next = sc->chunks;
+        sc->chunks = chunk;
+        sc->carve = (char*)chunk + HEADER_SIZE;
+        sc->carve_end = (char*)chunk + CHUNK_SIZE;
+        atomic_fetch_add_explicit(&reserved_bytes, CHUNK_SIZE, memory_order_relaxed);
+    }
+    block = sc->carve;
+    sc->carve += size;
+    sc->total_blocks++;
+    *(uint32_t*)block = index;
+    return block;
+}
+
+// Fills an empty cache with up to TRANSFER_BLOCKS blocks
+static int refill(unsigned index)
+{
+    struct size_class* sc = &classes[index];
+    struct iot_mutex* lock = class_lock(sc);
+    if (lock == NULL) {
+        return -1;
+    }
+    if (!cache.exit_key_set) {
+        set_exit_key();
+    }
+    iot_mutex_lock(lock);
+    uint32_t count = 0;
+    while (count < TRANSFER_BLOCKS) {
+        void* block = take_block(sc, index);
+        if (block == NULL) {
+            break;
+        }
+        cache.blocks[index][count++] = block;
+    }
+    iot_mutex_unlock(lock);
+    cache.count[index] = count;
+    return count > 0 ? 0 : -1;
+}
+
+// Hands the newest count blocks of a cache back to the class
+static __attribute__((noinline)) void drain(unsigned index, uint32_t count)
+{
+    struct size_class* sc = &classes[index];
+    // A cache holds blocks only once the lock exists
+    struct iot_mutex* lock = atomic_load_explicit(&sc->lock, memory_order_acquire);
+    iot_mutex_lock(lock);
+    while (count-- > 0) {
+        void* block = cache.blocks[index][--cache.count[index]];
+        set_link(block, sc->free_list);
+        sc->free_list = block;
+        sc->free_blocks++;
+    }
+    iot_mutex_unlock(lock);
+}
+
+// Hands out a block from the cache, which must hold one
+static void* from_cache(unsigned index, size_t size)
+{
+    char* block = (char*)cache.blocks[index][--cache.count[index]];
+    POISON(block + HEADER_SIZE, class_sizes[index]);
+    UNPOISON(block + HEADER_SIZE, size);
+    return block + HEADER_SIZE;
+}
+
+// Large requests and empty caches; kept out of line so the fast path saves no registers
+static __attribute__((noinline)) void* alloc_slow(size_t size)
+{
+    if (size > IOT_POOL_MAX_BLOCK) {
+        if (size > SIZE_MAX - HEADER_SIZE) {
+            return NULL;
+        }
+        char* block = (char*)malloc(HEADER_SIZE + size);
+        if (block == NULL) {
+            return NULL;
+        }
+        *(uint32_t*)block = LARGE_CLASS;
+        atomic_fetch_add_explicit(&large_in_use, 1, memory_order_relaxed);
+        return block + HEADER_SIZE;
+    }
+    unsigned index = class_of(size);
+    if (refill(index) != 0) {
+        return NULL;
+    }
+    return from_cache(index, size);
+}
+
+void* iot_pool_alloc(size_t size)
+{
+    if (size <= IOT_POOL_MAX_BLOCK) {
+        unsigned index = class_of(size);
+        if (cache.count[index] > 0) {
+            return from_cache(index, size);
+        }
+    }
+    return alloc_slow(size);
+}
+
+char* iot_pool_strdup(const char* str)
+{
+    if (str == NULL) {
+        return NULL;
+    }
+    size_t length = strlen(str) + 1;
+    char* copy = (char*)iot_pool_alloc(length);
+    if (copy != NULL) {
+        memcpy(copy, str, length);
+    }
+    return copy;
+}
+
+void iot_pool_free(void* ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    char* block = (char*)ptr - HEADER_SIZE;
+    uint32_t index = *(uint32_t*)block;
+    if (index == LARGE_CLASS) {
+        atomic_fetch_sub_explicit(&large_in_use, 1, memory_order_relaxed);
+        free(block);
+        return;
+    }
+    POISON(ptr, class_sizes[index]);
+    if (cache.count[index] == CACHE_BLOCKS) {
+        drain(index, TRANSFER_BLOCKS);
+    } else if (!cache.exit_key_set) {
+        set_exit_key();
+    }
+    cache.blocks[index][cache.count[index]++] = block;
+}
+
+void iot_pool_thread_flush(void)
+{
+    for (unsigned index = 0; index < CLASSES; index++) {
+        if (cache.count[index] > 0) {
+            drain(index, cache.count[index]);
+        }
+    }
+}
+
+void iot_pool_get_stats(struct iot_pool_stats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    for (unsigned index = 0; index < CLASSES; index++) {
+        struct size_class* sc = &classes[index];
+        struct iot_mutex* lock = atomic_load_explicit(&sc->lock, memory_order_acquire);
+        if (lock == NULL) {
+            continue; // Never used
+        }
+        iot_mutex_lock(lock);
+        stats->total_blocks += sc->total_blocks;
+        stats->free_blocks += sc->free_blocks;
+        iot_mutex_unlock(lock);
+    }
+    stats->reserved_bytes = atomic_load_explicit(&reserved_bytes, memory_order_relaxed);
+    stats->large_in_use = atomic_load_explicit(&large_in_use, memory_order_relaxed);
+}
@@ -0,0 +1,286 @@
+#include "system/timer_wheel.h"
+#include <stdlib.h>
+
+/*
+ * Level l holds the timers due between 64^l and 64^(l+1) ticks after the
+ * next tick to process, in the slot picked by bits 6l..6l+5 of their
+ * expiry; timers further out than the top level spans wait in its last
+ * slot. When the tick count enters a new block of 64^l ticks, the level-l
+ * slot for that block is cascaded: its timers are filed again and drop to
+ * lower levels. Level 0 slots are fired as the tick count reaches them.
+ *
+ * Each level keeps a bitmap of its occupied slots, from which the next
+ * tick where anything fires or cascades is found with one rotate and
+ * count-trailing-zeros per level. Advancing jumps straight between those
+ * ticks, and reports them as the next expiry.
+ */
+
+#define LEVEL_BITS 6
+#define LEVEL_SLOTS (1u << LEVEL_BITS)
+#define SLOT_MASK (LEVEL_SLOTS - 1)
+#define LEVELS 6
+#define MAX_DELTA ((uint64_t)1 << (LEVEL_BITS * LEVELS))
+
+struct iot_timer_wheel {
+    uint32_t tick_ms;
+    uint64_t now_ms; // Of the last advance
+    uint64_t tick; // Next tick to process; every earlier one is done
+    size_t pending;
+    uint64_t occupied[LEVELS]; // Bit per slot, set while its list is non-empty
+    struct iot_timer* slots[LEVELS * LEVEL_SLOTS];
+};
+
+static unsigned lowest_bit(uint64_t bits)
+{
+    return (unsigned)__builtin_ctzll(bits);
+}
+
+static void link_timer(struct iot_timer_wheel* wheel, struct iot_timer* timer)
+{
+    uint64_t expires = timer->expires;
+    uint64_t delta = expires - wheel->tick;
+    if (delta >= MAX_DELTA) {
+        expires = wheel->tick + MAX_DELTA - 1;
+        delta = MAX_DELTA - 1;
+    }
+    unsigned level = 0;
+    while (delta >= (uint64_t)1 << (LEVEL_BITS * (level + 1))) {
+        level++;
+    }
+    unsigned slot = level * LEVEL_SLOTS + (unsigned)((expires >> (LEVEL_BITS * level)) & SLOT_MASK);
+    struct iot_timer** head = &wheel->slots[slot];
+    timer->next = *head;
+    if (timer->next != NULL) {
+        timer->next->pprev = &timer->next;
+    }
+    *head = timer;
+    timer->pprev = head;
+    timer->slot = (uint16_t)slot;
+    wheel->occupied[level] |= (uint64_t)1 << (slot & SLOT_MASK);
+}
+
+// Also works on timers in the expired list of process_tick
+static void unlink_timer(struct iot_timer_wheel* wheel, struct iot_timer* timer)
+{
+    *timer->pprev = timer->next;
+    if (timer->next != NULL) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+    if (wheel->slots[timer->slot] == NULL) {
+        wheel->occupied[timer->slot / LEVEL_SLOTS] &= ~((uint64_t)1 << (timer->slot & SLOT_MASK));
+    }
+}
+
+// Takes a slot's list out of the wheel
+static struct iot_timer* detach_slot(struct iot_timer_wheel* wheel, unsigned level, unsigned index)
+{
+    unsigned slot = level * LEVEL_SLOTS + index;
+    struct iot_timer* list = wheel->slots[slot];
+    wheel->slots[slot] = NULL;
+    wheel->occupied[level] &= ~((uint64_t)1 << index);
+    return list;
+}
+
+// The first tick from wheel->tick on at which a slot of level fires or cascades
+static uint64_t level_next_tick(const struct iot_timer_wheel* wheel, unsigned level)
+{
+    uint64_t bits = wheel->occupied[level];
+    if (bits == 0) {
+        return UINT64_MAX;
+    }
+    unsigned shift = LEVEL_BITS * level;
+    uint64_t block = wheel->tick >> shift;
+    unsigned position = (unsigned)(block & SLOT_MASK);
+    // Above level 0, the current block's slot was cascaded on entering it,
+    // unless that is happening at this very tick; a timer there is a lap ahead
+    unsigned start = position;
+    if (level > 0 && (wheel->tick & (((uint64_t)1 << shift) - 1)) != 0) {
+        start++;
+    }
+    unsigned first = start & SLOT_MASK;
+    uint64_t rotated = first != 0 ? (bits >> first) | (bits << (LEVEL_SLOTS - first)) : bits;
+    return (block + (start - position) + lowest_bit(rotated)) << shift;
+}
+
+static uint64_t next_tick(const struct iot_timer_wheel* wheel)
+{
+    uint64_t next = UINT64_MAX;
+    for (unsigned level = 0; level < LEVELS; level++) {
+        uint64_t tick = level_next_tick(wheel, level);
+        if (tick < next) {
+            next = tick;
+        }
+    }
+    return next;
+}
+
+static void cascade(struct iot_timer_wheel* wheel, unsigned level)
+{
+    unsigned index = (unsigned)((wheel->tick >> (LEVEL_BITS * level)) & SLOT_MASK);
+    struct iot_timer* timer = detach_slot(wheel, level, index);
+    while (timer != NULL) {
+        struct iot_timer* next = timer->next;
+        link_timer(wheel, timer);
+        timer = next;
+    }
+}
+
+// Processes wheel->tick: cascades the levels whose block starts there, then fires its level 0 slot
+static int process_tick(struct iot_timer_wheel* wheel)
+{
+    for (unsigned level = LEVELS - 1; level > 0; level--) {
+        if ((wheel->tick & (((uint64_t)1 << (LEVEL_BITS * level)) - 1)) == 0) {
+            cascade(wheel, level);
+        }
+    }
+    struct iot_timer* expired = detach_slot(wheel, 0, (unsigned)(wheel->tick & SLOT_MASK));
+    if (expired == NULL) {
+        wheel->tick++;
+        return 0;
+    }
+    // Callbacks may cancel the timers still in expired and start new ones, which go to later ticks
+    expired->pprev = &expired;
+    wheel->tick++;
+    int fired = 0;
+    while (expired != NULL) {
+        struct iot_timer* timer = expired;
+        unlink_timer(wheel, timer);
+        wheel->pending--;
+        if (timer->period != 0) {
+            timer->expires += timer->period;
+            if (timer->expires < wheel->tick) {
+                timer->expires = wheel->tick;
+            }
+            link_timer(wheel, timer);
+            wheel->pending++;
+        }
+        timer->func(timer, timer->arg);
+        fired++;
+    }
+    return fired;
+}
+
+struct iot_timer_wheel* iot_timer_wheel_create(uint32_t tick_ms, uint64_t now_ms)
+{
+    struct iot_timer_wheel* wheel = (struct iot_timer_wheel*)calloc(1, sizeof(struct iot_timer_wheel));
+    if (wheel == NULL) {
+        return NULL;
+    }
+    wheel->tick_ms = tick_ms != 0 ? tick_ms : 1;
+    wheel->now_ms = now_ms;
+    wheel->tick = now_ms / wheel->tick_ms;
+    return wheel;
+}
+
+void iot_timer_wheel_destroy(struct iot_timer_wheel* wheel)
+{
+    if (wheel == NULL) {
+        return;
+    }
+    for (unsigned slot = 0; slot < LEVELS * LEVEL_SLOTS; slot++) {
+        while (wheel->slots[slot] != NULL) {
+            unlink_timer(wheel, wheel->slots[slot]);
+        }
+    }
+    free(wheel);
+}
+
+void iot_timer_init(struct iot_timer* timer, iot_timer_func_t func, void* arg)
+{
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires = 0;
+    timer->period = 0;
+    timer->slot = 0;
+    timer->func = func;
+    timer->arg = arg;
+}
+
+int iot_timer_start(struct iot_timer_wheel* wheel, struct iot_timer* timer, uint64_t delay_ms, uint32_t period_ms)
+{
+    if (wheel == NULL || timer == NULL || timer->func == NULL) {
+        return -1;
+    }
+    if (timer->pprev != NULL) {
+        unlink_timer(wheel, timer);
+        wheel->pending--;
+    }
+    // Rounded up, so a timer never fires before its time
+    uint64_t expires_ms = delay_ms > UINT64_MAX - wheel->now_ms ? UINT64_MAX : wheel->now_ms + delay_ms;
+    uint64_t expires = expires_ms / wheel->tick_ms + (expires_ms % wheel->tick_ms != 0);
+    timer->expires = expires > wheel->tick ? expires : wheel->tick;
+    // Summed in 64 bits: periods near UINT32_MAX would wrap to 0 and leave a one-shot timer
+    timer->period = (uint32_t)(((uint64_t)period_ms + wheel->tick_ms - 1) / wheel->tick_ms);
+    link_timer(wheel, timer);
+    wheel->pending++;
+    return 0;
+}
+
+int iot_timer_cancel(struct iot_timer_wheel* wheel, struct iot_timer* timer)
+{
+    if (wheel == NULL || timer == NULL) {
+        return -1;
+    }
+    if (timer->pprev == NULL) {
+        return 0;
+    }
+    unlink_timer(wheel, timer);
+    wheel->pending--;
+    return 1;
+}
+
+bool iot_timer_pending(const struct iot_timer* timer)
+{
+    return timer != NULL && timer->pprev != NULL;
+}
+
+int iot_timer_wheel_advance(struct iot_timer_wheel* wheel, uint64_t now_ms)
+{
+    if (wheel == NULL) {
+        return -1;
+    }
+    if (now_ms < wheel->now_ms) {
+        return 0;
+    }
+    wheel->now_ms = now_ms;
+    uint64_t target = now_ms / wheel->tick_ms;
+    int fired = 0;
+    while (wheel->tick <= target) {
+        uint64_t next = next_tick(wheel);
+        if (next > target) {
+            wheel->tick = target + 1;
+            break;
+        }
+        wheel->tick = next;
+        fired += process_tick(wheel);
+    }
+    return fired;
+}
+
+uint64_t iot_timer_wheel_next_expiry(const struct iot_timer_wheel* wheel)
+{
+    if (wheel == NULL || wheel->pending == 0) {
+        return IOT_TIMER_WHEEL_IDLE;
+    }
+    uint64_t tick = next_tick(wheel);
+    return tick > UINT64_MAX / wheel->tick_ms ? IOT_TIMER_WHEEL_IDLE - 1 : tick * wheel->tick_ms;
+}
+
+uint32_t iot_timer_wheel_timeout(const struct iot_timer_wheel* wheel, uint64_t now_ms)
+{
+    uint64_t next = iot_timer_wheel_next_expiry(wheel);
+    if (next == IOT_TIMER_WHEEL_IDLE) {
+        return UINT32_MAX;
+    }
+    if (next <= now_ms) {
+        return 0;
+    }
+    return next - now_ms < UINT32_MAX ? (uint32_t)(next - now_ms) : UINT32_MAX - 1;
+}
+
+size_t iot_timer_wheel_pending(const struct iot_timer_wheel* wheel)
+{
+    return wheel != NULL ? wheel->pending : 0;
+}
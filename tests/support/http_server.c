@@ -0,0 +1,761 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "http_server.h"
+#include "interface/transport.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+/*
+ * One thread per connection. It reads a request head, consumes the body
+ * as it arrives without keeping it, and writes the response through an
+ * output buffer that is flushed whenever it fills, so large bodies stream
+ * in fixed-size pieces. Input left over after a request is the start of
+ * the next pipelined one.
+ */
+
+#define HTTP_POLL_MS 50 // How often blocked threads look for a stop request
+#define HTTP_SEND_TIMEOUT_MS 1000 // A client that stops reading this long is dropped
+#define HTTP_IO_SIZE 16384
+#define HTTP_MAX_HEAD 8192 // Request line and headers
+#define HTTP_MAX_LINE 1024 // Chunk size lines and trailers
+
+#define HEAD_TOO_LARGE (-2)
+
+struct http_buffer {
+    unsigned char* data;
+    size_t length;
+    size_t capacity;
+};
+
+struct http_connection {
+    struct http_connection* next;
+    struct iot_http_server* server;
+    void* ctx;
+    struct http_buffer in; // Received and not yet consumed
+    struct http_buffer out; // Response bytes not yet sent
+};
+
+// What serving a request needs from its head
+struct http_request {
+    const char* method;
+    const char* target;
+    bool keep_alive;
+    bool http10;
+    bool chunked;
+    bool has_length;
+    uint64_t content_length;
+    const char* range;
+};
+
+struct iot_http_server {
+    struct iot_loopback_listener* listener;
+    pthread_t acceptor;
+    struct iot_http_server_config config;
+    unsigned char pattern[HTTP_IO_SIZE + 26]; // Body bytes for any offset, starting at offset % 26
+
+    pthread_mutex_t lock;
+    pthread_cond_t idle; // A connection ended
+    bool stopping;
+    struct http_connection* connections;
+    struct iot_http_server_stats stats;
+};
+
+static bool server_stopping(struct iot_http_server* server)
+{
+    pthread_mutex_lock(&server->lock);
+    bool stopping = server->stopping;
+    pthread_mutex_unlock(&server->lock);
+    return stopping;
+}
+
+static int buffer_reserve(struct http_buffer* buffer, size_t length)
+{
+    if (buffer->capacity - buffer->length >= length) {
+        return 0;
+    }
+    size_t capacity = buffer->capacity != 0 ? buffer->capacity : HTTP_IO_SIZE;
+    while (capacity - buffer->length < length) {
+        capacity *= 2;
+    }
+    unsigned char* grown = (unsigned char*)realloc(buffer->data, capacity);
+    if (grown == NULL) {
+        return -1;
+    }
+    buffer->data = grown;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+static int buffer_append(struct http_buffer* buffer, const void* data, size_t length)
+{
+    if (buffer_reserve(buffer, length) != 0) {
+        return -1;
+    }
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+    return 0;
+}
+
+static void buffer_consume(struct http_buffer* buffer, size_t length)
+{
+    memmove(buffer->data, buffer->data + length, buffer->length - length);
+    buffer->length -= length;
+}
+
+// Read whatever arrives next; 1 when input was added, 0 at end of stream, -1 on error or stop
+static int receive(struct http_connection* conn)
+{
+    if (buffer_reserve(&conn->in, HTTP_IO_SIZE) != 0) {
+        return -1;
+    }
+    for (;;) {
+        if (server_stopping(conn->server)) {
+            return -1;
+        }
+        int n = iot_transport_recv(conn->ctx, conn->in.data + conn->in.length, HTTP_IO_SIZE);
+        if (n == IOT_TRANSPORT_TIMEOUT) {
+            continue;
+        }
+        if (n <= 0) {
+            return n == 0 ? 0 : -1;
+        }
+        conn->in.length += (size_t)n;
+        pthread_mutex_lock(&conn->server->lock);
+        conn->server->stats.bytes_received += (uint64_t)n;
+        pthread_mutex_unlock(&conn->server->lock);
+        return 1;
+    }
+}
+
+static int flush(struct http_connection* conn)
+{
+    size_t sent = 0;
+
+    // Counted first, so the counters are current once the client has the response
+    pthread_mutex_lock(&conn->server->lock);
+    conn->server->stats.bytes_sent += conn->out.length;
+    pthread_mutex_unlock(&conn->server->lock);
+    while (sent < conn->out.length) {
+        int n = iot_transport_send(conn->ctx, conn->out.data + sent, conn->out.length - sent);
+        if (n <= 0) {
+            return -1;
+        }
+        sent += (size_t)n;
+    }
+    conn->out.length = 0;
+    return 0;
+}
+
+// Wait for the next request head; its length including the blank line, 0 at end of stream,
+// HEAD_TOO_LARGE, or -1 on error
+static long read_head(struct http_connection* conn)
+{
+    size_t scanned = 0;
+
+    for (;;) {
+        // Empty lines before a request line are ignored
+        while (conn->in.length >= 2 && conn->in.data[0] == '\r' && conn->in.data[1] == '\n') {
+            buffer_consume(&conn->in, 2);
+        }
+        for (size_t i = scanned > 3 ? scanned - 3 : 0; i + 4 <= conn->in.length; i++) {
+            if (memcmp(conn->in.data + i, "\r\n\r\n", 4) == 0) {
+                return (long)(i + 4);
+            }
+        }
+        scanned = conn->in.length;
+        if (scanned > HTTP_MAX_HEAD) {
+            return HEAD_TOO_LARGE;
+        }
+        int ret = receive(conn);
+        if (ret <= 0) {
+            return ret == 0 && conn->in.length == 0 ? 0 : -1;
+        }
+    }
+}
+
+// Wait for a CRLF-terminated line at the start of the input; its length without the CRLF, or -1
+static long read_line(struct http_connection* conn)
+{
+    size_t scanned = 0;
+
+    for (;;) {
+        for (size_t i = scanned > 0 ? scanned - 1 : 0; i + 2 <= conn->in.length; i++) {
+            if (conn->in.data[i] == '\r' && conn->in.data[i + 1] == '\n') {
+                return (long)i;
+            }
+        }
+        scanned = conn->in.length;
+        if (scanned > HTTP_MAX_LINE || receive(conn) <= 0) {
+            return -1;
+        }
+    }
+}
+
+// Consume count bytes of input as they arrive
+static int skip(struct http_connection* conn, uint64_t count)
+{
+    while (count > 0) {
+        if (conn->in.length == 0 && receive(conn) <= 0) {
+            return -1;
+        }
+        size_t n = conn->in.length < count ? conn->in.length : (size_t)count;
+        buffer_consume(&conn->in, n);
+        count -= n;
+    }
+    return 0;
+}
+
+static int parse_u64(const char* s, size_t length, int base, uint64_t* value)
+{
+    uint64_t v = 0;
+
+    if (length == 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < length; i++) {
+        int digit;
+        if (s[i] >= '0' && s[i] <= '9') {
+            digit = s[i] - '0';
+        } else if (base == 16 && s[i] >= 'a' && s[i] <= 'f') {
+            digit = s[i] - 'a' + 10;
+        } else if (base == 16 && s[i] >= 'A' && s[i] <= 'F') {
+            digit = s[i] - 'A' + 10;
+        } else {
+            return -1;
+        }
+        if (v > (UINT64_MAX - (uint64_t)digit) / (uint64_t)base) {
+            return -1;
+        }
+        v = v * (uint64_t)base + (uint64_t)digit;
+    }
+    *value = v;
+    return 0;
+}
+
+// Consume a chunked request body, trailers included; its decoded length, or -1
+static int64_t read_chunked(struct http_connection* conn)
+{
+    uint64_t total = 0;
+
+    for (;;) {
+        long line = read_line(conn);
+        if (line < 0) {
+            return -1;
+        }
+        const char* text = (const char*)conn->in.data;
+        size_t digits = 0;
+        while (digits < (size_t)line && text[digits] != ';') {
+            digits++; // Chunk extensions are ignored
+        }
+        uint64_t size;
+        if (parse_u64(text, digits, 16, &size) != 0 || size > INT64_MAX - total) {
+            return -1;
+        }
+        buffer_consume(&conn->in, (size_t)line + 2);
+        if (size == 0) {
+            break;
+        }
+        if (skip(conn, size) != 0 || read_line(conn) != 0) {
+            return -1; // The chunk data must be followed by CRLF
+        }
+        buffer_consume(&conn->in, 2);
+        total += size;
+    }
+    for (;;) {
+        long line = read_line(conn);
+        if (line < 0) {
+            return -1;
+        }
+        buffer_consume(&conn->in, (size_t)line + 2);
+        if (line == 0) {
+            return (int64_t)total;
+        }
+    }
+}
+
+// Whether a comma-separated header value lists token
+static bool has_token(const char* value, const char* token)
+{
+    size_t token_length = strlen(token);
+
+    while (*value != '\0') {
+        while (*value == ' ' || *value == '\t' || *value == ',') {
+            value++;
+        }
+        const char* end = value;
+        while (*end != '\0' && *end != ',') {
+            end++;
+        }
+        const char* last = end;
+        while (last > value && (last[-1] == ' ' || last[-1] == '\t')) {
+            last--;
+        }
+        if ((size_t)(last - value) == token_length && strncasecmp(value, token, token_length) == 0) {
+            return true;
+        }
+        value = end;
+    }
+    return false;
+}
+
+// Split a NUL-terminated head in place; return 0, or the status code to reject it with
+static int parse_head(char* head, struct http_request* request)
+{
+    const char* connection = NULL;
+    const char* encoding = NULL;
+    const char* length = NULL;
+
+    memset(request, 0, sizeof(*request));
+    char* line_end = strstr(head, "\r\n");
+    *line_end = '\0';
+    char* target = strchr(head, ' ');
+    char* version = target != NULL ? strchr(target + 1, ' ') : NULL;
+    if (version == NULL || target == head || version == target + 1 || strchr(version + 1, ' ') != NULL) {
+        return 400;
+    }
+    *target++ = '\0';
+    *version++ = '\0';
+    if (strncmp(version, "HTTP/1.", 7) != 0 || (version[7] != '0' && version[7] != '1') || version[8] != '\0') {
+        return strncmp(version, "HTTP/", 5) == 0 ? 505 : 400;
+    }
+    request->method = head;
+    request->target = target;
+    request->http10 = version[7] == '0';
+
+    for (char* line = line_end + 2; *line != '\0' && strncmp(line, "\r\n", 2) != 0; line = line_end + 2) {
+        line_end = strstr(line, "\r\n");
+        *line_end = '\0';
+        char* colon = strchr(line, ':');
+        char* space = strpbrk(line, " \t");
+        if (colon == NULL || colon == line || (space != NULL && space < colon)) {
+            return 400; // Also rejects obsolete line folding
+        }
+        *colon = '\0';
+        char* value = colon + 1;
+        while (*value == ' ' || *value == '\t') {
+            value++;
+        }
+        for (char* end = line_end; end > value && (end[-1] == ' ' || end[-1] == '\t'); end--) {
+            end[-1] = '\0';
+        }
+
+        if (strcasecmp(line, "Connection") == 0) {
+            connection = value;
+        } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+            encoding = value;
+        } else if (strcasecmp(line, "Content-Length") == 0) {
+            if (length != NULL && strcmp(length, value) != 0) {
+                return 400;
+            }
+            length = value;
+        } else if (strcasecmp(line, "Range") == 0) {
+            request->range = value;
+        }
+    }
+
+    if (encoding != NULL) {
+        if (strcasecmp(encoding, "chunked") != 0) {
+            return 501;
+        }
+        if (length != NULL) {
+            return 400;
+        }
+        request->chunked = true;
+    }
+    if (length != NULL) {
+        if (parse_u64(length, strlen(length), 10, &request->content_length) != 0) {
+            return 400;
+        }
+        request->has_length = true;
+    }
+    if (request->http10) {
+        request->keep_alive = connection != NULL && has_token(connection, "keep-alive");
+    } else {
+        request->keep_alive = connection == NULL || !has_token(connection, "close");
+    }
+    return 0;
+}
+
+// Apply size, delay_ms and chunk from the query string; return 0, or -1 if one is malformed
+static int parse_query(const char* target, uint64_t* size, uint64_t* delay_ms, uint64_t* chunk)
+{
+    const char* query = strchr(target, '?');
+
+    while (query != NULL) {
+        const char* name = query + 1;
+        query = strchr(name, '&');
+        const char* end = query != NULL ? query : name + strlen(name);
+        const char* equals = memchr(name, '=', (size_t)(end - name));
+        if (equals == NULL) {
+            continue;
+        }
+        size_t name_length = (size_t)(equals - name);
+        uint64_t* value = NULL;
+        if (name_length == 4 && strncmp(name, "size", 4) == 0) {
+            value = size;
+        } else if (name_length == 8 && strncmp(name, "delay_ms", 8) == 0) {
+            value = delay_ms;
+        } else if (name_length == 5 && strncmp(name, "chunk", 5) == 0) {
+            value = chunk;
+        }
+        if (value != NULL && parse_u64(equals + 1, (size_t)(end - equals - 1), 10, value) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Resolve a "bytes=" range against size: 1 with the range, 0 to ignore it, -1 if unsatisfiable
+static int parse_range(const char* value, uint64_t size, uint64_t* first, uint64_t* last)
+{
+    if (strncasecmp(value, "bytes=", 6) != 0 || strchr(value, ',') != NULL) {
+        return 0; // Other units and multiple ranges are served in full
+    }
+    value += 6;
+    const char* dash = strchr(value, '-');
+    if (dash == NULL) {
+        return 0;
+    }
+    uint64_t a;
+    uint64_t b;
+    if (dash == value) {
+        // Suffix range: the last b bytes
+        if (parse_u64(dash + 1, strlen(dash + 1), 10, &b) != 0) {
+            return 0;
+        }
+        if (b == 0 || size == 0) {
+            return -1;
+        }
+        *first = b < size ? size - b : 0;
+        *last = size - 1;
+        return 1;
+    }
+    if (parse_u64(value, (size_t)(dash - value), 10, &a) != 0) {
+        return 0;
+    }
+    if (dash[1] == '\0') {
+        b = UINT64_MAX;
+    } else if (parse_u64(dash + 1, strlen(dash + 1), 10, &b) != 0 || b < a) {
+        return 0;
+    }
+    if (a >= size) {
+        return -1;
+    }
+    *first = a;
+    *last = b < size ? b : size - 1;
+    return 1;
+}
+
+// Sleep for ms in short slices; false if the server is stopping
+static bool pause_ms(struct iot_http_server* server, uint64_t ms)
+{
+    while (ms > 0) {
+        if (server_stopping(server)) {
+            return false;
+        }
+        uint64_t slice = ms < HTTP_POLL_MS ? ms : HTTP_POLL_MS;
+        struct timespec ts = { (time_t)(slice / 1000), (long)(slice % 1000) * 1000000L };
+        nanosleep(&ts, NULL);
+        ms -= slice;
+    }
+    return true;
+}
+
+static const char* reason(int status)
+{
+    switch (status) {
+    case 200:
+        return "OK";
+    case 206:
+        return "Partial Content";
+    case 400:
+        return "Bad Request";
+    case 416:
+        return "Range Not Satisfiable";
+    case 431:
+        return "Request Header Fields Too Large";
+    case 501:
+        return "Not Implemented";
+    default:
+        return "HTTP Version Not Supported";
+    }
+}
+
+// Queue an error response without a body; the connection is closed afterwards
+static int reject(struct http_connection* conn, int status)
+{
+    char head[128];
+    int n = snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", status, reason(status));
+    if (buffer_append(&conn->out, head, (size_t)n) != 0 || flush(conn) != 0) {
+        return -1;
+    }
+    return 1;
+}
+
+// Write the generated body bytes [first, first + length), chunked in pieces of chunk when nonzero
+static int write_body(struct http_connection* conn, uint64_t first, uint64_t length, uint64_t chunk)
+{
+    const unsigned char* pattern = conn->server->pattern;
+    uint64_t offset = first;
+    uint64_t end = first + length;
+
+    while (offset < end) {
+        uint64_t piece_end = chunk != 0 && end - offset > chunk ? offset + chunk : end;
+        if (chunk != 0) {
+            char size[24];
+            int n = snprintf(size, sizeof(size), "%llx\r\n", (unsigned long long)(piece_end - offset));
+            if (buffer_append(&conn->out, size, (size_t)n) != 0) {
+                return -1;
+            }
+        }
+        while (offset < piece_end) {
+            size_t n = piece_end - offset < HTTP_IO_SIZE ? (size_t)(piece_end - offset) : HTTP_IO_SIZE;
+            if (buffer_append(&conn->out, pattern + offset % 26, n) != 0) {
+                return -1;
+            }
+            offset += n;
+            if (conn->out.length >= HTTP_IO_SIZE && flush(conn) != 0) {
+                return -1;
+            }
+        }
+        if (chunk != 0 && buffer_append(&conn->out, "\r\n", 2) != 0) {
+            return -1;
+        }
+    }
+    if (chunk != 0 && buffer_append(&conn->out, "0\r\n\r\n", 5) != 0) {
+        return -1;
+    }
+    return flush(conn);
+}
+
+// Read and answer one request; 0 to keep the connection, 1 to close it, -1 on error
+static int serve_request(struct http_connection* conn)
+{
+    struct iot_http_server* server = conn->server;
+    struct http_request request;
+    char head[HTTP_MAX_HEAD + 1];
+
+    long head_length = read_head(conn);
+    if (head_length == HEAD_TOO_LARGE || head_length > HTTP_MAX_HEAD) {
+        return reject(conn, 431);
+    }
+    if (head_length <= 0) {
+        return head_length == 0 ? 1 : -1;
+    }
+    memcpy(head, conn->in.data, (size_t)head_length);
+    head[head_length] = '\0';
+    buffer_consume(&conn->in, (size_t)head_length);
+
+    int status = parse_head(head, &request);
+    if (status != 0) {
+        return reject(conn, status);
+    }
+
+    bool has_body = strcmp(request.method, "HEAD") != 0;
+    if (has_body && strcmp(request.method, "GET") != 0) {
+        if (strcmp(request.method, "POST") != 0 && strcmp(request.method, "PUT") != 0 && strcmp(request.method, "DELETE") != 0) {
+            return reject(conn, 501);
+        }
+        request.range = NULL; // Ranges only apply to GET and HEAD
+    }
+
+    uint64_t size = server->config.response_size;
+    uint64_t delay_ms = server->config.delay_ms;
+    uint64_t chunk = server->config.chunk_size;
+    if (parse_query(request.target, &size, &delay_ms, &chunk) != 0) {
+        return reject(conn, 400);
+    }
+
+    int64_t received = 0;
+    if (request.chunked) {
+        received = read_chunked(conn);
+    } else if (request.has_length) {
+        received = skip(conn, request.content_length) == 0 ? (int64_t)request.content_length : -1;
+    }
+    if (received < 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&server->lock);
+    server->stats.requests++;
+    pthread_mutex_unlock(&server->lock);
+    if (!pause_ms(server, delay_ms)) {
+        return -1;
+    }
+
+    status = 200;
+    uint64_t first = 0;
+    uint64_t length = size;
+    char range[80] = "";
+    if (request.range != NULL) {
+        uint64_t last;
+        int ret = parse_range(request.range, size, &first, &last);
+        if (ret > 0) {
+            status = 206;
+            length = last - first + 1;
+            snprintf(range, sizeof(range), "Content-Range: bytes %llu-%llu/%llu\r\n",
+                (unsigned long long)first, (unsigned long long)last, (unsigned long long)size);
+        } else if (ret < 0) {
+            status = 416;
+            length = 0;
+            snprintf(range, sizeof(range), "Content-Range: bytes */%llu\r\n", (unsigned long long)size);
+        }
+    }
+    if (status == 416) {
+        chunk = 0;
+    }
+
+    char framing[48];
+    if (chunk != 0) {
+        snprintf(framing, sizeof(framing), "Transfer-Encoding: chunked\r\n");
+    } else {
+        snprintf(framing, sizeof(framing), "Content-Length: %llu\r\n", (unsigned long long)length);
+    }
+    const char* connection = !request.keep_alive ? "Connection: close\r\n" : request.http10 ? "Connection: keep-alive\r\n" : "";
+    char response[384];
+    int n = snprintf(response, sizeof(response),
+        "HTTP/1.1 %d %s\r\nContent-Type: application/octet-stream\r\nAccept-Ranges: bytes\r\n%s%sX-Received-Length: %lld\r\n%s\r\n",
+        status, reason(status), framing, range, (long long)received, connection);
+    if (buffer_append(&conn->out, response, (size_t)n) != 0) {
+        return -1;
+    }
+    if (write_body(conn, first, has_body ? length : 0, has_body ? chunk : 0) != 0) {
+        return -1;
+    }
+    return request.keep_alive ? 0 : 1;
+}
+
+static void* connection_main(void* arg)
+{
+    struct http_connection* conn = (struct http_connection*)arg;
+    struct iot_http_server* server = conn->server;
+
+    while (serve_request(conn) == 0) {
+    }
+    iot_transport_close(conn->ctx);
+
+    pthread_mutex_lock(&server->lock);
+    for (struct http_connection** link = &server->connections; *link != NULL; link = &(*link)->next) {
+        if (*link == conn) {
+            *link = conn->next;
+            break;
+        }
+    }
+    pthread_cond_broadcast(&server->idle);
+    pthread_mutex_unlock(&server->lock);
+
+    free(conn->in.data);
+    free(conn->out.data);
+    free(conn);
+    return NULL;
+}
+
+static void connection_start(struct iot_http_server* server, void* ctx)
+{
+    struct http_connection* conn = (struct http_connection*)calloc(1, sizeof(struct http_connection));
+    if (conn == NULL) {
+        iot_transport_close(ctx);
+        return;
+    }
+    conn->server = server;
+    conn->ctx = ctx;
+
+    pthread_t thread;
+    pthread_mutex_lock(&server->lock);
+    if (pthread_create(&thread, NULL, connection_main, conn) != 0) {
+        pthread_mutex_unlock(&server->lock);
+        iot_transport_close(ctx);
+        free(conn);
+        return;
+    }
+    // The thread unlinks itself under the lock, so it cannot run ahead of this
+    conn->next = server->connections;
+    server->connections = conn;
+    server->stats.connections++;
+    pthread_mutex_unlock(&server->lock);
+    pthread_detach(thread);
+}
+
+static void* server_acceptor(void* arg)
+{
+    struct iot_http_server* server = (struct iot_http_server*)arg;
+    struct iot_transport_config config;
+
+    iot_transport_config_default(&config);
+    config.send_timeout_ms = HTTP_SEND_TIMEOUT_MS;
+    config.recv_timeout_ms = HTTP_POLL_MS;
+    while (!server_stopping(server)) {
+        void* ctx = NULL;
+        if (iot_loopback_accept_with(server->listener, &ctx, HTTP_POLL_MS, &config) == 0) {
+            connection_start(server, ctx);
+        }
+    }
+    return NULL;
+}
+
+struct iot_http_server* iot_http_server_start(const struct iot_http_server_config* config)
+{
+    if (config == NULL || config->host == NULL || config->port == NULL) {
+        return NULL;
+    }
+
+    struct iot_http_server* server = (struct iot_http_server*)calloc(1, sizeof(struct iot_http_server));
+    if (server == NULL) {
+        return NULL;
+    }
+    server->config = *config;
+    for (size_t i = 0; i < sizeof(server->pattern); i++) {
+        server->pattern[i] = (unsigned char)('a' + i % 26);
+    }
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->idle, NULL);
+    server->listener = iot_loopback_listen(config->host, config->port, config->link);
+    if (server->listener == NULL || pthread_create(&server->acceptor, NULL, server_acceptor, server) != 0) {
+        iot_loopback_destroy(server->listener);
+        server->listener = NULL;
+        iot_http_server_stop(server);
+        return NULL;
+    }
+    return server;
+}
+
+void iot_http_server_stop(struct iot_http_server* server)
+{
+    if (server == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&server->lock);
+    server->stopping = true;
+    pthread_mutex_unlock(&server->lock);
+    if (server->listener != NULL) {
+        pthread_join(server->acceptor, NULL);
+        iot_loopback_destroy(server->listener);
+    }
+
+    // Connection threads see the flag within a poll interval and unlink themselves
+    pthread_mutex_lock(&server->lock);
+    while (server->connections != NULL) {
+        pthread_cond_wait(&server->idle, &server->lock);
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    pthread_cond_destroy(&server->idle);
+    pthread_mutex_destroy(&server->lock);
+    free(server);
+}
+
+void iot_http_server_get_stats(struct iot_http_server* server, struct iot_http_server_stats* stats)
+{
+    if (server == NULL || stats == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&server->lock);
+    *stats = server->stats;
+    pthread_mutex_unlock(&server->lock);
+}
@@ -0,0 +1,78 @@
+#ifndef IOT_TEST_HTTP_SERVER_H
+#define IOT_TEST_HTTP_SERVER_H
+
+#include "interface/loopback.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A minimal HTTP/1.1 server for tests and benchmarks. It listens on an
+ * in-memory loopback listener, so iot_http_set_url with its host and port
+ * reaches it without a network. Connections are kept alive unless the
+ * client asks otherwise, and pipelined requests are answered in order.
+ *
+ * Every GET, HEAD, POST, PUT and DELETE is answered with a generated body
+ * whose byte at offset i is 'a' + i % 26. Query parameters override the
+ * server defaults for one request:
+ *
+ *   size=N      Body length in bytes
+ *   delay_ms=N  Wait this long before responding
+ *   chunk=N     Send the body with chunked encoding, N bytes per chunk
+ *
+ * GET and HEAD honour a single "Range: bytes=" range with 206 or 416.
+ * Request bodies, sized by Content-Length or chunked, are read and
+ * discarded; their length is echoed in an X-Received-Length header.
+ */
+
+struct iot_http_server_config {
+    const char* host; // Host name clients connect to
+    const char* port; // Port clients connect to
+    const struct iot_link_profile* link; // Emulated link, NULL for an ideal one
+    size_t response_size; // Default body length
+    uint32_t delay_ms; // Default wait before each response
+    size_t chunk_size; // Default chunk length, 0 for a Content-Length body
+};
+
+// Counters since the server started
+struct iot_http_server_stats {
+    uint64_t connections;
+    uint64_t requests;
+    uint64_t bytes_received; // Request bytes, headers included
+    uint64_t bytes_sent; // Response bytes, headers included
+};
+
+// Opaque server type
+struct iot_http_server;
+
+/**
+ * @brief Start serving on config->host and config->port
+ *
+ * @param config Server settings
+ * @return struct iot_http_server* Running server, NULL on failure
+ */
+struct iot_http_server* iot_http_server_start(const struct iot_http_server_config* config);
+
+/**
+ * @brief Close every connection and stop the server
+ *
+ * @param server Server handle
+ */
+void iot_http_server_stop(struct iot_http_server* server);
+
+/**
+ * @brief Read the server counters
+ *
+ * @param server Server handle
+ * @param stats Filled with the current counters
+ */
+void iot_http_server_get_stats(struct iot_http_server* server, struct iot_http_server_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOT_TEST_HTTP_SERVER_H
@@ -0,0 +1,884 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "mqtt_broker.h"
+#include "core_mqtt_serializer.h"
+#include "interface/transport.h"
+#include "tls_server.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Every client gets two threads. The reader blocks on the connection and
+ * appends raw bytes to the session inbox; the worker decodes packets from
+ * the inbox (through TLS when enabled) and writes everything the client
+ * receives, so a TLS context is only ever used by one thread. Publishes
+ * routed from other clients are encoded by the publishing worker and
+ * queued on the subscriber's outbox.
+ *
+ * PUBLISH and PUBACK go through the coreMQTT serializer. coreMQTT only
+ * implements the client side of the other packets, so CONNECT, SUBSCRIBE
+ * and UNSUBSCRIBE are parsed here and their acks built by hand.
+ */
+
+#define BROKER_POLL_MS 50 // How often blocked threads look for a stop request
+#define BROKER_SEND_TIMEOUT_MS 1000 // A client that stops reading this long is dropped
+#define BROKER_READ_SIZE 4096
+#define BROKER_MAX_PACKET (1024 * 1024)
+
+// MQTT 3.1.1 packet types and fixed header flags
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH 0x30
+#define MQTT_PUBACK 0x40
+#define MQTT_SUBSCRIBE 0x82
+#define MQTT_SUBACK 0x90
+#define MQTT_UNSUBSCRIBE 0xA2
+#define MQTT_UNSUBACK 0xB0
+#define MQTT_PINGREQ 0xC0
+#define MQTT_PINGRESP 0xD0
+#define MQTT_DISCONNECT 0xE0
+
+#define CONNECT_FLAG_WILL 0x04
+#define CONNECT_FLAG_WILL_QOS 0x18
+#define CONNECT_FLAG_PASSWORD 0x40
+#define CONNECT_FLAG_USERNAME 0x80
+
+// An encoded packet waiting in an outbox
+struct broker_packet {
+    struct broker_packet* next;
+    size_t length;
+    unsigned char data[];
+};
+
+struct broker_subscription {
+    struct broker_subscription* next;
+    uint8_t qos;
+    char filter[];
+};
+
+struct broker_retained {
+    struct broker_retained* next;
+    uint8_t qos;
+    uint16_t topic_length;
+    size_t payload_length;
+    unsigned char data[]; // Topic, then payload
+};
+
+// A byte buffer that grows as needed
+struct broker_buffer {
+    unsigned char* data;
+    size_t length;
+    size_t capacity;
+};
+
+struct broker_session {
+    struct broker_session* next;
+    struct iot_mqtt_broker* broker;
+    void* ctx;
+    struct tls_session* tls;
+    pthread_t reader;
+
+    // Protected by lock
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    struct broker_buffer inbox; // Raw bytes from the connection
+    bool reader_done;
+    bool closing;
+    struct broker_packet* outbox;
+    struct broker_packet* outbox_tail;
+
+    // Protected by the broker lock
+    bool connected;
+    uint16_t next_packet_id;
+    struct broker_subscription* subscriptions;
+
+    // Owned by the worker
+    struct broker_buffer packets; // Decoded stream, split into packets
+};
+
+struct iot_mqtt_broker {
+    struct iot_loopback_listener* listener;
+    struct tls_server* tls;
+    pthread_t acceptor;
+
+    pthread_mutex_t lock;
+    pthread_cond_t idle; // A session ended
+    bool stopping;
+    struct broker_session* sessions;
+    struct broker_retained* retained;
+    struct iot_mqtt_broker_stats stats;
+};
+
+static int buffer_append(struct broker_buffer* buffer, const unsigned char* data, size_t length)
+{
+    if (buffer->capacity - buffer->length < length) {
+        size_t capacity = buffer->capacity != 0 ? buffer->capacity : BROKER_READ_SIZE;
+        while (capacity - buffer->length < length) {
+            capacity *= 2;
+        }
+        unsigned char* grown = (unsigned char*)realloc(buffer->data, capacity);
+        if (grown == NULL) {
+            return -1;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+    return 0;
+}
+
+static void buffer_consume(struct broker_buffer* buffer, size_t length)
+{
+    memmove(buffer->data, buffer->data + length, buffer->length - length);
+    buffer->length -= length;
+}
+
+static uint16_t read_u16(const unsigned char* p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+// Write a fixed header; return its length
+static size_t encode_header(unsigned char* out, uint8_t type, size_t remaining)
+{
+    size_t n = 0;
+    out[n++] = type;
+    do {
+        unsigned char byte = (unsigned char)(remaining % 128);
+        remaining /= 128;
+        out[n++] = remaining > 0 ? (unsigned char)(byte | 0x80) : byte;
+    } while (remaining > 0);
+    return n;
+}
+
+// Read a length-prefixed string at *offset; return 0 and advance, or -1 if it overruns
+static int read_string(const unsigned char* body, size_t length, size_t* offset, const unsigned char** str, uint16_t* str_length)
+{
+    if (length - *offset < 2) {
+        return -1;
+    }
+    uint16_t n = read_u16(body + *offset);
+    if (length - *offset - 2 < n) {
+        return -1;
+    }
+    *str = body + *offset + 2;
+    *str_length = n;
+    *offset += 2 + (size_t)n;
+    return 0;
+}
+
+bool iot_mqtt_topic_matches(const char* filter, const char* topic, size_t topic_length)
+{
+    const char* end = topic + topic_length;
+
+    // Wildcards never match topics reserved for the server
+    if (topic_length > 0 && topic[0] == '$' && (filter[0] == '+' || filter[0] == '#')) {
+        return false;
+    }
+    for (;;) {
+        if (filter[0] == '#') {
+            return true; // Also matches the parent level
+        }
+        const char* level_end = memchr(topic, '/', (size_t)(end - topic));
+        if (level_end == NULL) {
+            level_end = end;
+        }
+        if (filter[0] == '+') {
+            filter++;
+        } else {
+            size_t level = (size_t)(level_end - topic);
+            if (strncmp(filter, topic, level) != 0 || (filter[level] != '/' && filter[level] != '\0')) {
+                return false;
+            }
+            filter += level;
+        }
+        if (level_end == end) {
+            return filter[0] == '\0' || strcmp(filter, "/#") == 0;
+        }
+        if (filter[0] != '/') {
+            return false;
+        }
+        filter++;
+        topic = level_end + 1;
+    }
+}
+
+static bool filter_valid(const unsigned char* filter, size_t length)
+{
+    if (length == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        bool level_start = i == 0 || filter[i - 1] == '/';
+        bool level_end = i + 1 == length || filter[i + 1] == '/';
+        if (filter[i] == '+' && !(level_start && level_end)) {
+            return false;
+        }
+        if (filter[i] == '#' && !(level_start && i + 1 == length)) {
+            return false;
+        }
+        if (filter[i] == '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Raw bytes for the worker, or for mbedtls through tls_session_read
+static int take_input(void* ctx, unsigned char* buf, size_t len)
+{
+    struct broker_session* session = (struct broker_session*)ctx;
+    int ret;
+
+    pthread_mutex_lock(&session->lock);
+    if (session->inbox.length > 0) {
+        size_t n = session->inbox.length < len ? session->inbox.length : len;
+        memcpy(buf, session->inbox.data, n);
+        buffer_consume(&session->inbox, n);
+        ret = (int)n;
+    } else {
+        ret = session->reader_done ? 0 : IOT_TRANSPORT_TIMEOUT;
+    }
+    pthread_mutex_unlock(&session->lock);
+    return ret;
+}
+
+static int send_raw(void* ctx, const unsigned char* buf, size_t len)
+{
+    struct broker_session* session = (struct broker_session*)ctx;
+    size_t sent = 0;
+
+    while (sent < len) {
+        int ret = iot_transport_send(session->ctx, buf + sent, len - sent);
+        if (ret <= 0) {
+            return -1;
+        }
+        sent += (size_t)ret;
+    }
+    return (int)len;
+}
+
+static int session_write(struct broker_session* session, const unsigned char* buf, size_t len)
+{
+    int ret = session->tls != NULL ? tls_session_write(session->tls, buf, len) : send_raw(session, buf, len);
+    return ret == (int)len ? 0 : -1;
+}
+
+static int session_read(struct broker_session* session, unsigned char* buf, size_t len)
+{
+    return session->tls != NULL ? tls_session_read(session->tls, buf, len) : take_input(session, buf, len);
+}
+
+// Encode a publish for a session and queue it; called with the broker lock held
+static void enqueue_publish(struct broker_session* target, const MQTTPublishInfo_t* publish)
+{
+    uint16_t packet_id = 0;
+    size_t remaining;
+    size_t size;
+
+    if (publish->qos != MQTTQoS0) {
+        if (++target->next_packet_id == 0) {
+            target->next_packet_id = 1;
+        }
+        packet_id = target->next_packet_id;
+    }
+    if (MQTT_GetPublishPacketSize(publish, &remaining, &size) != MQTTSuccess) {
+        return;
+    }
+    struct broker_packet* packet = (struct broker_packet*)malloc(sizeof(struct broker_packet) + size);
+    if (packet == NULL) {
+        return;
+    }
+    MQTTFixedBuffer_t buffer = { packet->data, size };
+    if (MQTT_SerializePublish(publish, packet_id, remaining, &buffer) != MQTTSuccess) {
+        free(packet);
+        return;
+    }
+    packet->next = NULL;
+    packet->length = size;
+
+    pthread_mutex_lock(&target->lock);
+    if (target->outbox_tail != NULL) {
+        target->outbox_tail->next = packet;
+    } else {
+        target->outbox = packet;
+    }
+    target->outbox_tail = packet;
+    pthread_cond_signal(&target->wake);
+    pthread_mutex_unlock(&target->lock);
+    target->broker->stats.publishes_delivered++;
+}
+
+// Store or clear the retained message of a topic; called with the broker lock held
+static void retain(struct iot_mqtt_broker* broker, const MQTTPublishInfo_t* publish)
+{
+    for (struct broker_retained** link = &broker->retained; *link != NULL; link = &(*link)->next) {
+        struct broker_retained* r = *link;
+        if (r->topic_length == publish->topicNameLength && memcmp(r->data, publish->pTopicName, r->topic_length) == 0) {
+            *link = r->next;
+            free(r);
+            broker->stats.retained--;
+            break;
+        }
+    }
+    if (publish->payloadLength == 0) {
+        return; // An empty retained publish clears the topic
+    }
+    struct broker_retained* r = (struct broker_retained*)malloc(sizeof(struct broker_retained) + publish->topicNameLength + publish->payloadLength);
+    if (r == NULL) {
+        return;
+    }
+    r->qos = (uint8_t)publish->qos;
+    r->topic_length = publish->topicNameLength;
+    r->payload_length = publish->payloadLength;
+    memcpy(r->data, publish->pTopicName, publish->topicNameLength);
+    memcpy(r->data + publish->topicNameLength, publish->pPayload, publish->payloadLength);
+    r->next = broker->retained;
+    broker->retained = r;
+    broker->stats.retained++;
+}
+
+// Deliver a publish to every matching subscription, the publisher's own included
+static void route(struct iot_mqtt_broker* broker, const MQTTPublishInfo_t* publish)
+{
+    pthread_mutex_lock(&broker->lock);
+    broker->stats.publishes_received++;
+    if (publish->retain) {
+        retain(broker, publish);
+    }
+    for (struct broker_session* s = broker->sessions; s != NULL; s = s->next) {
+        int granted = -1;
+        for (struct broker_subscription* sub = s->subscriptions; sub != NULL; sub = sub->next) {
+            if (sub->qos > granted && iot_mqtt_topic_matches(sub->filter, publish->pTopicName, publish->topicNameLength)) {
+                granted = sub->qos;
+            }
+        }
+        if (s->connected && granted >= 0) {
+            MQTTPublishInfo_t out = *publish;
+            out.retain = false; // Set only on messages sent because of a new subscription
+            out.dup = false;
+            if ((int)out.qos > granted) {
+                out.qos = (MQTTQoS_t)granted;
+            }
+            enqueue_publish(s, &out);
+        }
+    }
+    pthread_mutex_unlock(&broker->lock);
+}
+
+static int handle_connect(struct broker_session* session, const unsigned char* body, size_t length)
+{
+    size_t offset = 0;
+    const unsigned char* str;
+    uint16_t str_length;
+
+    if (read_string(body, length, &offset, &str, &str_length) != 0 || str_length != 4 || memcmp(str, "MQTT", 4) != 0
+        || length - offset < 4) {
+        return -1;
+    }
+    uint8_t level = body[offset];
+    uint8_t flags = body[offset + 1];
+    offset += 4; // Level, flags and keep alive
+    if (level != 4) {
+        const unsigned char refused[] = { MQTT_CONNACK, 2, 0, 1 }; // Unacceptable protocol version
+        session_write(session, refused, sizeof(refused));
+        return -1;
+    }
+    if ((flags & 0x01) || (!(flags & CONNECT_FLAG_WILL) && (flags & (CONNECT_FLAG_WILL_QOS | 0x20)))) {
+        return -1; // Reserved bit, or will options without a will
+    }
+
+    // Client identifier, will topic and message, user name and password are accepted and ignored
+    int fields = 1 + ((flags & CONNECT_FLAG_WILL) ? 2 : 0) + ((flags & CONNECT_FLAG_USERNAME) ? 1 : 0) + ((flags & CONNECT_FLAG_PASSWORD) ? 1 : 0);
+    for (int i = 0; i < fields; i++) {
+        if (read_string(body, length, &offset, &str, &str_length) != 0) {
+            return -1;
+        }
+    }
+    if (offset != length) {
+        return -1;
+    }
+
+    const unsigned char accepted[] = { MQTT_CONNACK, 2, 0, 0 };
+    if (session_write(session, accepted, sizeof(accepted)) != 0) {
+        return -1;
+    }
+    pthread_mutex_lock(&session->broker->lock);
+    session->connected = true;
+    session->broker->stats.connections++;
+    pthread_mutex_unlock(&session->broker->lock);
+    return 0;
+}
+
+static int handle_publish(struct broker_session* session, uint8_t type, unsigned char* body, size_t length, size_t header_length)
+{
+    MQTTPacketInfo_t info = { .type = type, .pRemainingData = body, .remainingLength = length, .headerLength = header_length };
+    MQTTPublishInfo_t publish;
+    uint16_t packet_id = 0;
+
+    memset(&publish, 0, sizeof(publish));
+    if (MQTT_DeserializePublish(&info, &packet_id, &publish) != MQTTSuccess || publish.qos == MQTTQoS2) {
+        return -1; // QoS 2 is not supported
+    }
+    if (memchr(publish.pTopicName, '+', publish.topicNameLength) != NULL || memchr(publish.pTopicName, '#', publish.topicNameLength) != NULL) {
+        return -1;
+    }
+
+    route(session->broker, &publish);
+
+    if (publish.qos == MQTTQoS1) {
+        unsigned char ack[MQTT_PUBLISH_ACK_PACKET_SIZE];
+        MQTTFixedBuffer_t buffer = { ack, sizeof(ack) };
+        if (MQTT_SerializeAck(&buffer, MQTT_PACKET_TYPE_PUBACK, packet_id) != MQTTSuccess || session_write(session, ack, sizeof(ack)) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int handle_subscribe(struct broker_session* session, const unsigned char* body, size_t length)
+{
+    struct iot_mqtt_broker* broker = session->broker;
+    unsigned char* ack = (unsigned char*)malloc(8 + length); // Header, packet identifier and fewer return codes than body bytes
+    size_t offset = 2;
+    size_t count = 0;
+
+    if (ack == NULL || length < 2) {
+        free(ack);
+        return -1;
+    }
+    unsigned char* codes = ack + 8;
+
+    pthread_mutex_lock(&broker->lock);
+    while (offset < length) {
+        const unsigned char* filter;
+        uint16_t filter_length;
+        if (read_string(body, length, &offset, &filter, &filter_length) != 0 || offset >= length || body[offset] > 2) {
+            pthread_mutex_unlock(&broker->lock);
+            free(ack);
+            return -1;
+        }
+        uint8_t requested = body[offset++];
+        uint8_t qos = requested > 1 ? 1 : requested;
+        if (!filter_valid(filter, filter_length)) {
+            codes[count++] = 0x80;
+            continue;
+        }
+
+        // A repeated filter replaces the existing subscription
+        struct broker_subscription* sub = session->subscriptions;
+        while (sub != NULL && !(strlen(sub->filter) == filter_length && memcmp(sub->filter, filter, filter_length) == 0)) {
+            sub = sub->next;
+        }
+        if (sub == NULL) {
+            sub = (struct broker_subscription*)malloc(sizeof(struct broker_subscription) + filter_length + 1);
+            if (sub == NULL) {
+                codes[count++] = 0x80;
+                continue;
+            }
+            memcpy(sub->filter, filter, filter_length);
+            sub->filter[filter_length] = '\0';
+            sub->next = session->subscriptions;
+            session->subscriptions = sub;
+        }
+        sub->qos = qos;
+        codes[count++] = qos;
+
+        // Retained messages go out after the SUBACK, which is written below
+        for (struct broker_retained* r = broker->retained; r != NULL; r = r->next) {
+            if (iot_mqtt_topic_matches(sub->filter, (const char*)r->data, r->topic_length)) {
+                MQTTPublishInfo_t publish;
+                memset(&publish, 0, sizeof(publish));
+                publish.qos = (MQTTQoS_t)(r->qos < qos ? r->qos : qos);
+                publish.retain = true;
+                publish.pTopicName = (const char*)r->data;
+                publish.topicNameLength = r->topic_length;
+                publish.pPayload = r->data + r->topic_length;
+                publish.payloadLength = r->payload_length;
+                enqueue_publish(session, &publish);
+            }
+        }
+    }
+    pthread_mutex_unlock(&broker->lock);
+
+    if (count == 0) {
+        free(ack);
+        return -1; // A SUBSCRIBE must carry at least one filter
+    }
+    unsigned char header[5];
+    size_t header_length = encode_header(header, MQTT_SUBACK, 2 + count);
+    unsigned char* start = codes - 2 - header_length;
+    memcpy(start, header, header_length);
+    memcpy(codes - 2, body, 2); // Packet identifier
+    int ret = session_write(session, start, header_length + 2 + count);
+    free(ack);
+    return ret;
+}
+
+static int handle_unsubscribe(struct broker_session* session, const unsigned char* body, size_t length)
+{
+    size_t offset = 2;
+
+    if (length < 5) {
+        return -1;
+    }
+    pthread_mutex_lock(&session->broker->lock);
+    while (offset < length) {
+        const unsigned char* filter;
+        uint16_t filter_length;
+        if (read_string(body, length, &offset, &filter, &filter_length) != 0) {
+            pthread_mutex_unlock(&session->broker->lock);
+            return -1;
+        }
+        for (struct broker_subscription** link = &session->subscriptions; *link != NULL; link = &(*link)->next) {
+            struct broker_subscription* sub = *link;
+            if (strlen(sub->filter) == filter_length && memcmp(sub->filter, filter, filter_length) == 0) {
+                *link = sub->next;
+                free(sub);
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&session->broker->lock);
+
+    const unsigned char ack[] = { MQTT_UNSUBACK, 2, body[0], body[1] };
+    return session_write(session, ack, sizeof(ack));
+}
+
+// Handle one packet; return 0 to go on, 1 on DISCONNECT, -1 to drop the client
+static int handle_packet(struct broker_session* session, uint8_t type, unsigned char* body, size_t length, size_t header_length)
+{
+    if (!session->connected) {
+        return type == MQTT_CONNECT ? handle_connect(session, body, length) : -1;
+    }
+    if ((type & 0xF0) == MQTT_PUBLISH) {
+        return handle_publish(session, type, body, length, header_length);
+    }
+    switch (type) {
+    case MQTT_PUBACK: {
+        // Outgoing QoS 1 messages are not retried: the loopback link never drops data
+        MQTTPacketInfo_t info = { .type = type, .pRemainingData = body, .remainingLength = length, .headerLength = header_length };
+        uint16_t packet_id;
+        bool session_present;
+        return MQTT_DeserializeAck(&info, &packet_id, &session_present) == MQTTSuccess ? 0 : -1;
+    }
+    case MQTT_SUBSCRIBE:
+        return handle_subscribe(session, body, length);
+    case MQTT_UNSUBSCRIBE:
+        return handle_unsubscribe(session, body, length);
+    case MQTT_PINGREQ: {
+        const unsigned char pong[] = { MQTT_PINGRESP, 0 };
+        return length == 0 ? session_write(session, pong, sizeof(pong)) : -1;
+    }
+    case MQTT_DISCONNECT:
+        return 1;
+    default:
+        return -1; // A second CONNECT, QoS 2 flow or unknown type
+    }
+}
+
+// Decode what has arrived and handle every complete packet
+static int process_input(struct broker_session* session)
+{
+    unsigned char buf[BROKER_READ_SIZE];
+
+    for (;;) {
+        int n = session_read(session, buf, sizeof(buf));
+        if (n == IOT_TRANSPORT_TIMEOUT || n == 0) {
+            return 0; // Nothing more for now; end of stream is seen by the worker
+        }
+        if (n < 0 || buffer_append(&session->packets, buf, (size_t)n) != 0) {
+            return -1;
+        }
+
+        struct broker_buffer* packets = &session->packets;
+        while (packets->length >= 2) {
+            size_t remaining = 0;
+            size_t header_length = 1;
+            bool complete = false;
+            while (!complete && header_length < packets->length && header_length < 5) {
+                unsigned char byte = packets->data[header_length++];
+                remaining |= (size_t)(byte & 0x7F) << (7 * (header_length - 2));
+                complete = !(byte & 0x80);
+            }
+            if (!complete && header_length == 5) {
+                return -1; // Remaining length longer than four bytes
+            }
+            if (remaining > BROKER_MAX_PACKET) {
+                return -1;
+            }
+            if (!complete || packets->length - header_length < remaining) {
+                break; // Wait for the rest of the packet
+            }
+            int ret = handle_packet(session, packets->data[0], packets->data + header_length, remaining, header_length);
+            if (ret != 0) {
+                return ret;
+            }
+            buffer_consume(packets, header_length + remaining);
+        }
+        if (packets->length > BROKER_MAX_PACKET + 5) {
+            return -1;
+        }
+    }
+}
+
+static void* session_reader(void* arg)
+{
+    struct broker_session* session = (struct broker_session*)arg;
+    unsigned char buf[BROKER_READ_SIZE];
+
+    for (;;) {
+        pthread_mutex_lock(&session->lock);
+        bool closing = session->closing;
+        pthread_mutex_unlock(&session->lock);
+        if (closing) {
+            break;
+        }
+
+        int n = iot_transport_recv(session->ctx, buf, sizeof(buf));
+        if (n == IOT_TRANSPORT_TIMEOUT) {
+            continue;
+        }
+        pthread_mutex_lock(&session->lock);
+        if (n <= 0 || buffer_append(&session->inbox, buf, (size_t)n) != 0) {
+            session->reader_done = true;
+        }
+        pthread_cond_signal(&session->wake);
+        bool done = session->reader_done;
+        pthread_mutex_unlock(&session->lock);
+        if (done) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void session_free(struct broker_session* session)
+{
+    while (session->outbox != NULL) {
+        struct broker_packet* next = session->outbox->next;
+        free(session->outbox);
+        session->outbox = next;
+    }
+    while (session->subscriptions != NULL) {
+        struct broker_subscription* next = session->subscriptions->next;
+        free(session->subscriptions);
+        session->subscriptions = next;
+    }
+    free(session->inbox.data);
+    free(session->packets.data);
+    pthread_cond_destroy(&session->wake);
+    pthread_mutex_destroy(&session->lock);
+    free(session);
+}
+
+static void* session_worker(void* arg)
+{
+    struct broker_session* session = (struct broker_session*)arg;
+    struct iot_mqtt_broker* broker = session->broker;
+
+    for (;;) {
+        pthread_mutex_lock(&session->lock);
+        while (!session->closing && !session->reader_done && session->inbox.length == 0 && session->outbox == NULL) {
+            pthread_cond_wait(&session->wake, &session->lock);
+        }
+        struct broker_packet* outbox = session->outbox;
+        session->outbox = NULL;
+        session->outbox_tail = NULL;
+        bool done = session->closing || (session->reader_done && session->inbox.length == 0);
+        pthread_mutex_unlock(&session->lock);
+
+        int ret = 0;
+        while (outbox != NULL) {
+            struct broker_packet* next = outbox->next;
+            if (ret == 0) {
+                ret = session_write(session, outbox->data, outbox->length);
+            }
+            free(outbox);
+            outbox = next;
+        }
+        if (ret == 0) {
+            ret = process_input(session);
+        }
+        if (ret != 0 || done) {
+            break;
+        }
+    }
+
+    // Stop the reader, then leave the broker so nothing is routed here any more
+    pthread_mutex_lock(&session->lock);
+    session->closing = true;
+    pthread_mutex_unlock(&session->lock);
+    pthread_join(session->reader, NULL);
+    tls_session_destroy(session->tls);
+    iot_transport_close(session->ctx);
+
+    pthread_mutex_lock(&broker->lock);
+    for (struct broker_session** link = &broker->sessions; *link != NULL; link = &(*link)->next) {
+        if (*link == session) {
+            *link = session->next;
+            break;
+        }
+    }
+    pthread_cond_broadcast(&broker->idle);
+    pthread_mutex_unlock(&broker->lock);
+
+    session_free(session);
+    return NULL;
+}
+
+static void session_start(struct iot_mqtt_broker* broker, void* ctx)
+{
+    struct broker_session* session = (struct broker_session*)calloc(1, sizeof(struct broker_session));
+    if (session == NULL) {
+        iot_transport_close(ctx);
+        return;
+    }
+    session->broker = broker;
+    session->ctx = ctx;
+    pthread_mutex_init(&session->lock, NULL);
+    pthread_cond_init(&session->wake, NULL);
+    if (broker->tls != NULL) {
+        session->tls = tls_session_create(broker->tls, session, send_raw, take_input);
+        if (session->tls == NULL) {
+            iot_transport_close(ctx);
+            session_free(session);
+            return;
+        }
+    }
+
+    pthread_t worker;
+    if (pthread_create(&session->reader, NULL, session_reader, session) != 0) {
+        tls_session_destroy(session->tls);
+        iot_transport_close(ctx);
+        session_free(session);
+        return;
+    }
+    pthread_mutex_lock(&broker->lock);
+    session->next = broker->sessions;
+    broker->sessions = session;
+    pthread_mutex_unlock(&broker->lock);
+    if (pthread_create(&worker, NULL, session_worker, session) != 0) {
+        // Without a worker, unwind what it would have done on exit
+        pthread_mutex_lock(&session->lock);
+        session->closing = true;
+        pthread_mutex_unlock(&session->lock);
+        pthread_join(session->reader, NULL);
+        pthread_mutex_lock(&broker->lock);
+        for (struct broker_session** link = &broker->sessions; *link != NULL; link = &(*link)->next) {
+            if (*link == session) {
+                *link = session->next;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&broker->lock);
+        tls_session_destroy(session->tls);
+        iot_transport_close(ctx);
+        session_free(session);
+        return;
+    }
+    pthread_detach(worker);
+}
+
+static void* broker_acceptor(void* arg)
+{
+    struct iot_mqtt_broker* broker = (struct iot_mqtt_broker*)arg;
+    struct iot_transport_config config;
+
+    iot_transport_config_default(&config);
+    config.send_timeout_ms = BROKER_SEND_TIMEOUT_MS;
+    config.recv_timeout_ms = BROKER_POLL_MS;
+    for (;;) {
+        pthread_mutex_lock(&broker->lock);
+        bool stopping = broker->stopping;
+        pthread_mutex_unlock(&broker->lock);
+        if (stopping) {
+            break;
+        }
+
+        void* ctx = NULL;
+        if (iot_loopback_accept_with(broker->listener, &ctx, BROKER_POLL_MS, &config) == 0) {
+            session_start(broker, ctx);
+        }
+    }
+    return NULL;
+}
+
+struct iot_mqtt_broker* iot_mqtt_broker_start(const struct iot_mqtt_broker_config* config)
+{
+    if (config == NULL || config->host == NULL || config->port == NULL) {
+        return NULL;
+    }
+
+    struct iot_mqtt_broker* broker = (struct iot_mqtt_broker*)calloc(1, sizeof(struct iot_mqtt_broker));
+    if (broker == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&broker->lock, NULL);
+    pthread_cond_init(&broker->idle, NULL);
+    if (config->tls) {
+        broker->tls = tls_server_create(config->ca_cert, config->server_cert, config->server_key, config->require_client_cert);
+        if (broker->tls == NULL) {
+            iot_mqtt_broker_stop(broker);
+            return NULL;
+        }
+    }
+    broker->listener = iot_loopback_listen(config->host, config->port, config->link);
+    if (broker->listener == NULL || pthread_create(&broker->acceptor, NULL, broker_acceptor, broker) != 0) {
+        iot_loopback_destroy(broker->listener);
+        broker->listener = NULL;
+        iot_mqtt_broker_stop(broker);
+        return NULL;
+    }
+    return broker;
+}
+
+void iot_mqtt_broker_stop(struct iot_mqtt_broker* broker)
+{
+    if (broker == NULL) {
+        return;
+    }
+
+    if (broker->listener != NULL) {
+        pthread_mutex_lock(&broker->lock);
+        broker->stopping = true;
+        pthread_mutex_unlock(&broker->lock);
+        pthread_join(broker->acceptor, NULL);
+        iot_loopback_destroy(broker->listener);
+    }
+
+    // Workers unlink themselves; wait until the last one is gone
+    pthread_mutex_lock(&broker->lock);
+    for (struct broker_session* s = broker->sessions; s != NULL; s = s->next) {
+        pthread_mutex_lock(&s->lock);
+        s->closing = true;
+        pthread_cond_signal(&s->wake);
+        pthread_mutex_unlock(&s->lock);
+    }
+    while (broker->sessions != NULL) {
+        pthread_cond_wait(&broker->idle, &broker->lock);
+    }
+    pthread_mutex_unlock(&broker->lock);
+
+    while (broker->retained != NULL) {
+        struct broker_retained* next = broker->retained->next;
+        free(broker->retained);
+        broker->retained = next;
+    }
+    tls_server_destroy(broker->tls);
+    pthread_cond_destroy(&broker->idle);
+    pthread_mutex_destroy(&broker->lock);
+    free(broker);
+}
+
+void iot_mqtt_broker_get_stats(struct iot_mqtt_broker* broker, struct iot_mqtt_broker_stats* stats)
+{
+    if (broker == NULL || stats == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&broker->lock);
+    *stats = broker->stats;
+    pthread_mutex_unlock(&broker->lock);
+}
@@ -0,0 +1,80 @@
+#ifndef IOT_TEST_MQTT_BROKER_H
+#define IOT_TEST_MQTT_BROKER_H
+
+#include "interface/loopback.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A minimal MQTT 3.1.1 broker for tests and benchmarks. It serves clean
+ * sessions over an in-memory loopback listener, so iot_mqtts_connnect to
+ * its host and port reaches it without a network. Supported: QoS 0 and 1,
+ * retained messages, + and # wildcards, and delivery back to the
+ * publisher when it is subscribed. Not supported: QoS 2, persistent
+ * sessions, wills and authentication.
+ */
+
+struct iot_mqtt_broker_config {
+    const char* host; // Host name clients connect to
+    const char* port; // Port clients connect to
+    const struct iot_link_profile* link; // Emulated link, NULL for an ideal one
+    bool tls; // Serve MQTT over TLS
+    bool require_client_cert; // Reject TLS clients without a certificate signed by ca_cert
+    const char* ca_cert; // PEM; NULL selects the built-in test certificates
+    const char* server_cert;
+    const char* server_key;
+};
+
+// Counters since the broker started
+struct iot_mqtt_broker_stats {
+    uint64_t connections;
+    uint64_t publishes_received;
+    uint64_t publishes_delivered;
+    uint64_t retained;
+};
+
+// Opaque broker type
+struct iot_mqtt_broker;
+
+/**
+ * @brief Start serving on config->host and config->port
+ *
+ * @param config Broker settings
+ * @return struct iot_mqtt_broker* Running broker, NULL on failure
+ */
+struct iot_mqtt_broker* iot_mqtt_broker_start(const struct iot_mqtt_broker_config* config);
+
+/**
+ * @brief Disconnect every client and stop the broker
+ *
+ * @param broker Broker handle
+ */
+void iot_mqtt_broker_stop(struct iot_mqtt_broker* broker);
+
+/**
+ * @brief Read the broker counters
+ *
+ * @param broker Broker handle
+ * @param stats Filled with the current counters
+ */
+void iot_mqtt_broker_get_stats(struct iot_mqtt_broker* broker, struct iot_mqtt_broker_stats* stats);
+
+/**
+ * @brief Whether a topic name matches a subscription filter
+ *
+ * @param filter Topic filter, possibly with + and # wildcards
+ * @param topic Topic name of a publish
+ * @param topic_length Length of topic
+ * @return bool true if a subscription to filter receives the publish
+ */
+bool iot_mqtt_topic_matches(const char* filter, const char* topic, size_t topic_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOT_TEST_MQTT_BROKER_H
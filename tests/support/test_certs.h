@@ -0,0 +1,19 @@
+#ifndef IOT_TEST_CERTS_H
+#define IOT_TEST_CERTS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// PEM test certificates and keys shared by the local test servers and their clients
+extern const char iot_test_ca_cert[];
+extern const char iot_test_server_cert[];
+extern const char iot_test_server_key[];
+extern const char iot_test_client_cert[];
+extern const char iot_test_client_key[];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOT_TEST_CERTS_H
@@ -0,0 +1,205 @@
+#include "tls_server.h"
+#include "interface/transport.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/x509_crt.h"
+#include "test_certs.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(MBEDTLS_USE_PSA_CRYPTO) || defined(MBEDTLS_SSL_PROTO_TLS1_3)
+#include "psa/crypto.h"
+#define TLS_SERVER_PSA 1
+#else
+#define TLS_SERVER_PSA 0
+#endif
+
+struct tls_server {
+    mbedtls_ssl_config config;
+    mbedtls_x509_crt ca_cert;
+    mbedtls_x509_crt cert;
+    mbedtls_pk_context key;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    // mbedtls contexts are not thread-safe: sessions share the DRBG and the
+    // private key, so random draws and handshake steps are serialized
+    pthread_mutex_t rng_lock;
+    pthread_mutex_t handshake_lock;
+};
+
+struct tls_session {
+    mbedtls_ssl_context ssl;
+    struct tls_server* server;
+    void* io_ctx;
+    tls_send_func_t send;
+    tls_recv_func_t recv;
+    bool handshake_done;
+};
+
+static int locked_random(void* ctx, unsigned char* out, size_t len)
+{
+    struct tls_server* server = (struct tls_server*)ctx;
+    pthread_mutex_lock(&server->rng_lock);
+    int ret = mbedtls_ctr_drbg_random(&server->ctr_drbg, out, len);
+    pthread_mutex_unlock(&server->rng_lock);
+    return ret;
+}
+
+static int bio_send(void* ctx, const unsigned char* buf, size_t len)
+{
+    struct tls_session* session = (struct tls_session*)ctx;
+    int ret = session->send(session->io_ctx, buf, len);
+    return ret < 0 ? MBEDTLS_ERR_NET_SEND_FAILED : ret;
+}
+
+static int bio_recv(void* ctx, unsigned char* buf, size_t len)
+{
+    struct tls_session* session = (struct tls_session*)ctx;
+    int ret = session->recv(session->io_ctx, buf, len);
+    if (ret == IOT_TRANSPORT_TIMEOUT) {
+        return MBEDTLS_ERR_SSL_WANT_READ;
+    }
+    return ret < 0 ? MBEDTLS_ERR_NET_RECV_FAILED : ret;
+}
+
+struct tls_server* tls_server_create(const char* ca_cert, const char* server_cert, const char* server_key, bool require_client_cert)
+{
+    struct tls_server* server = (struct tls_server*)calloc(1, sizeof(struct tls_server));
+    if (server == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&server->rng_lock, NULL);
+    pthread_mutex_init(&server->handshake_lock, NULL);
+    mbedtls_ssl_config_init(&server->config);
+    mbedtls_x509_crt_init(&server->ca_cert);
+    mbedtls_x509_crt_init(&server->cert);
+    mbedtls_pk_init(&server->key);
+    mbedtls_entropy_init(&server->entropy);
+    mbedtls_ctr_drbg_init(&server->ctr_drbg);
+
+    if (ca_cert == NULL) {
+        ca_cert = iot_test_ca_cert;
+    }
+    if (server_cert == NULL) {
+        server_cert = iot_test_server_cert;
+    }
+    if (server_key == NULL) {
+        server_key = iot_test_server_key;
+    }
+
+#if TLS_SERVER_PSA
+    if (psa_crypto_init() != PSA_SUCCESS) {
+        tls_server_destroy(server);
+        return NULL;
+    }
+#endif
+    if (mbedtls_ctr_drbg_seed(&server->ctr_drbg, mbedtls_entropy_func, &server->entropy, NULL, 0) != 0
+        || mbedtls_x509_crt_parse(&server->ca_cert, (const unsigned char*)ca_cert, strlen(ca_cert) + 1) != 0
+        || mbedtls_x509_crt_parse(&server->cert, (const unsigned char*)server_cert, strlen(server_cert) + 1) != 0
+        || mbedtls_pk_parse_key(&server->key, (const unsigned char*)server_key, strlen(server_key) + 1, NULL, 0, mbedtls_ctr_drbg_random, &server->ctr_drbg) != 0
+        || mbedtls_ssl_config_defaults(&server->config, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT) != 0
+        || mbedtls_ssl_conf_own_cert(&server->config, &server->cert, &server->key) != 0) {
+        tls_server_destroy(server);
+        return NULL;
+    }
+    mbedtls_ssl_conf_rng(&server->config, locked_random, server);
+    mbedtls_ssl_conf_ca_chain(&server->config, &server->ca_cert, NULL);
+    mbedtls_ssl_conf_authmode(&server->config, require_client_cert ? MBEDTLS_SSL_VERIFY_REQUIRED : MBEDTLS_SSL_VERIFY_NONE);
+    return server;
+}
+
+void tls_server_destroy(struct tls_server* server)
+{
+    if (server == NULL) {
+        return;
+    }
+    mbedtls_ssl_config_free(&server->config);
+    mbedtls_x509_crt_free(&server->ca_cert);
+    mbedtls_x509_crt_free(&server->cert);
+    mbedtls_pk_free(&server->key);
+    mbedtls_ctr_drbg_free(&server->ctr_drbg);
+    mbedtls_entropy_free(&server->entropy);
+    pthread_mutex_destroy(&server->rng_lock);
+    pthread_mutex_destroy(&server->handshake_lock);
+    free(server);
+}
+
+struct tls_session* tls_session_create(struct tls_server* server, void* io_ctx, tls_send_func_t send, tls_recv_func_t recv)
+{
+    struct tls_session* session = (struct tls_session*)calloc(1, sizeof(struct tls_session));
+    if (session == NULL) {
+        return NULL;
+    }
+    mbedtls_ssl_init(&session->ssl);
+    if (mbedtls_ssl_setup(&session->ssl, &server->config) != 0) {
+        mbedtls_ssl_free(&session->ssl);
+        free(session);
+        return NULL;
+    }
+    session->server = server;
+    session->io_ctx = io_ctx;
+    session->send = send;
+    session->recv = recv;
+    mbedtls_ssl_set_bio(&session->ssl, session, bio_send, bio_recv, NULL);
+    return session;
+}
+
+int tls_session_read(struct tls_session* session, unsigned char* buf, size_t len)
+{
+    int ret;
+
+    if (!session->handshake_done) {
+        pthread_mutex_lock(&session->server->handshake_lock);
+        ret = mbedtls_ssl_handshake(&session->ssl);
+        pthread_mutex_unlock(&session->server->handshake_lock);
+        if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            return IOT_TRANSPORT_TIMEOUT;
+        }
+        if (ret != 0) {
+            return -1;
+        }
+        session->handshake_done = true;
+    }
+
+    ret = mbedtls_ssl_read(&session->ssl, buf, len);
+    if (ret > 0) {
+        return ret;
+    }
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        return IOT_TRANSPORT_TIMEOUT;
+    }
+    return -1; // close_notify, end of stream or a fatal alert
+}
+
+int tls_session_write(struct tls_session* session, const unsigned char* buf, size_t len)
+{
+    size_t written = 0;
+
+    while (written < len) {
+        int ret = mbedtls_ssl_write(&session->ssl, buf + written, len - written);
+        if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            continue;
+        }
+        if (ret < 0) {
+            return -1;
+        }
+        written += (size_t)ret;
+    }
+    return (int)len;
+}
+
+void tls_session_destroy(struct tls_session* session)
+{
+    if (session == NULL) {
+        return;
+    }
+    if (session->handshake_done) {
+        mbedtls_ssl_close_notify(&session->ssl);
+    }
+    mbedtls_ssl_free(&session->ssl);
+    free(session);
+}
@@ -0,0 +1,48 @@
+#ifndef IOT_TEST_TLS_SERVER_H
+#define IOT_TEST_TLS_SERVER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Server-side TLS for the local test servers, on top of mbedtls
+
+// Certificates and settings shared by every connection of a server
+struct tls_server;
+
+// One TLS connection
+struct tls_session;
+
+/*
+ * Raw record I/O of a session. recv returns the bytes read, 0 at end of
+ * stream, IOT_TRANSPORT_TIMEOUT if nothing is available yet, or another
+ * negative value on error; send returns the bytes written or a negative
+ * value on error.
+ */
+typedef int (*tls_send_func_t)(void* ctx, const unsigned char* buf, size_t len);
+typedef int (*tls_recv_func_t)(void* ctx, unsigned char* buf, size_t len);
+
+// Load the server identity; NULL PEM arguments select the built-in test certificates
+struct tls_server* tls_server_create(const char* ca_cert, const char* server_cert, const char* server_key, bool require_client_cert);
+void tls_server_destroy(struct tls_server* server);
+
+// Start a session whose handshake runs on the first reads
+struct tls_session* tls_session_create(struct tls_server* server, void* io_ctx, tls_send_func_t send, tls_recv_func_t recv);
+
+// Read plaintext; return the bytes read, IOT_TRANSPORT_TIMEOUT if more records are needed, -1 once closed or failed
+int tls_session_read(struct tls_session* session, unsigned char* buf, size_t len);
+
+// Write all of buf; return len or -1
+int tls_session_write(struct tls_session* session, const unsigned char* buf, size_t len);
+
+// Send close_notify and free the session
+void tls_session_destroy(struct tls_session* session);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOT_TEST_TLS_SERVER_H
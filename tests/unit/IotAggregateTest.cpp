@@ -0,0 +1,310 @@
+#include "data/aggregate.h"
+#include <algorithm>
+#include <cmath>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+// A window summary captured from the aggregator callback
+struct Summary {
+    std::string metric;
+    double start;
+    double end;
+    double count;
+    double min;
+    double max;
+    double mean;
+    double p50;
+    double p99;
+    double p2;
+};
+
+// Test fixture collecting emitted summaries
+class IotAggregateTest : public ::testing::Test {
+protected:
+    std::vector<Summary> summaries;
+
+    static void on_summary(void* ctx, IO* summary)
+    {
+        auto* out = static_cast<std::vector<Summary>*>(ctx);
+        cJSON* json = summary->json_obj;
+        auto number = [json](const char* key) {
+            cJSON* item = cJSON_GetObjectItemCaseSensitive(json, key);
+            return cJSON_IsNumber(item) ? item->valuedouble : NAN;
+        };
+        out->push_back({ io_get_string(summary, "metric"), number("start"), number("end"), number("count"),
+            number("min"), number("max"), number("mean"), number("p50"), number("p99"), number("p2") });
+    }
+
+    IOAggregator* create(enum io_window_type type, int64_t length_ms, int64_t step_ms)
+    {
+        struct io_window_config config = {};
+        config.type = type;
+        config.length_ms = length_ms;
+        config.step_ms = step_ms;
+        return io_aggregator_create(&config, on_summary, &summaries);
+    }
+
+    static double exact_quantile(std::vector<double> values, double q)
+    {
+        std::sort(values.begin(), values.end());
+        return values[(size_t)(q * (double)(values.size() - 1))];
+    }
+};
+
+// Sketch estimates stay within the advertised relative error
+TEST_F(IotAggregateTest, SketchAccuracy)
+{
+    std::mt19937 rng(42);
+    std::lognormal_distribution<double> latency(3.0, 0.8);
+    std::normal_distribution<double> temperature(2.0, 6.0); // Crosses zero
+    const double tolerance = 1.0 / (1 << (IO_SKETCH_SUBBUCKET_BITS + 1));
+
+    for (int dist = 0; dist < 2; dist++) {
+        IOSketch sketch;
+        io_sketch_reset(&sketch);
+        std::vector<double> values;
+        for (int i = 0; i < 20000; i++) {
+            double v = dist == 0 ? latency(rng) : temperature(rng);
+            values.push_back(v);
+            io_sketch_add(&sketch, v);
+        }
+        EXPECT_EQ(io_sketch_count(&sketch), values.size());
+        for (double q : { 0.01, 0.1, 0.5, 0.9, 0.99 }) {
+            double exact = exact_quantile(values, q);
+            double estimate = io_sketch_quantile(&sketch, q);
+            EXPECT_LE(std::fabs(estimate - exact), std::fabs(exact) * tolerance + 1e-12)
+                << "dist " << dist << " q " << q;
+        }
+    }
+}
+
+// Merging two sketches gives the same answers as one sketch over both inputs
+TEST_F(IotAggregateTest, SketchMerge)
+{
+    IOSketch a;
+    IOSketch b;
+    IOSketch all;
+    io_sketch_reset(&a);
+    io_sketch_reset(&b);
+    io_sketch_reset(&all);
+    for (int i = -500; i < 1500; i++) {
+        double v = i * 0.75;
+        io_sketch_add(i % 2 == 0 ? &a : &b, v);
+        io_sketch_add(&all, v);
+    }
+    io_sketch_merge(&a, &b);
+    EXPECT_EQ(io_sketch_count(&a), io_sketch_count(&all));
+    for (double q : { 0.0, 0.25, 0.5, 0.75, 1.0 }) {
+        EXPECT_DOUBLE_EQ(io_sketch_quantile(&a, q), io_sketch_quantile(&all, q));
+    }
+}
+
+// Values far beyond the bucket range collapse instead of failing
+TEST_F(IotAggregateTest, SketchWideRange)
+{
+    IOSketch sketch;
+    io_sketch_reset(&sketch);
+    for (int i = 0; i < 100; i++) {
+        io_sketch_add(&sketch, 1e-6);
+    }
+    io_sketch_add(&sketch, 1e9);
+    EXPECT_EQ(io_sketch_count(&sketch), 101u);
+    EXPECT_NEAR(io_sketch_quantile(&sketch, 1.0), 1e9, 1e9 / 32);
+}
+
+// Magnitudes arriving from the top down move the window down with them
+TEST_F(IotAggregateTest, SketchDescendingInserts)
+{
+    const double tolerance = 1.0 / (1 << (IO_SKETCH_SUBBUCKET_BITS + 1));
+    IOSketch sketch;
+    IOSketch low;
+    IOSketch high;
+    io_sketch_reset(&sketch);
+    io_sketch_reset(&low);
+    io_sketch_reset(&high);
+    std::vector<double> values;
+    // 1..200 spans 7.6 octaves, inside the 8 the buckets cover
+    for (int i = 200; i >= 1; i--) {
+        values.push_back(i);
+        io_sketch_add(&sketch, i);
+        io_sketch_add(i > 100 ? &high : &low, i);
+    }
+    IOSketch merged;
+    io_sketch_reset(&merged);
+    io_sketch_merge(&merged, &high);
+    io_sketch_merge(&merged, &low);
+    for (double q : { 0.0, 0.02, 0.1, 0.5, 0.99, 1.0 }) {
+        double exact = exact_quantile(values, q);
+        EXPECT_LE(std::fabs(io_sketch_quantile(&sketch, q) - exact), exact * tolerance) << "q " << q;
+        EXPECT_LE(std::fabs(io_sketch_quantile(&merged, q) - exact), exact * tolerance) << "merged q " << q;
+    }
+}
+
+TEST_F(IotAggregateTest, TumblingWindows)
+{
+    IOAggregator* agg = create(IO_WINDOW_TUMBLING, 60000, 0);
+    ASSERT_NE(agg, nullptr);
+    int temperature = io_aggregator_add_metric(agg, "temperature");
+    ASSERT_EQ(temperature, 0);
+
+    // Three minutes at 1 Hz, with the value equal to the second within the minute
+    const int64_t base = 1700000040000; // Aligned to a minute
+    for (int64_t s = 0; s < 180; s++) {
+        EXPECT_EQ(io_aggregator_record(agg, temperature, base + s * 1000, (double)(s % 60)), 0);
+    }
+    ASSERT_EQ(summaries.size(), 2u); // The third minute is still open
+    io_aggregator_flush(agg, base + 180000);
+    ASSERT_EQ(summaries.size(), 3u);
+
+    for (size_t i = 0; i < summaries.size(); i++) {
+        const Summary& s = summaries[i];
+        EXPECT_EQ(s.metric, "temperature");
+        EXPECT_EQ(s.start, (double)(base + (int64_t)i * 60000));
+        EXPECT_EQ(s.end, s.start + 60000);
+        EXPECT_EQ(s.count, 60);
+        EXPECT_EQ(s.min, 0);
+        EXPECT_EQ(s.max, 59);
+        EXPECT_DOUBLE_EQ(s.mean, 29.5);
+        EXPECT_NEAR(s.p50, 29, 29.0 / 32);
+        EXPECT_NEAR(s.p99, 58, 58.0 / 32);
+    }
+
+    // Samples for windows already emitted are refused
+    EXPECT_EQ(io_aggregator_record(agg, temperature, base, 1.0), -1);
+    io_aggregator_destroy(agg);
+}
+
+TEST_F(IotAggregateTest, SlidingWindows)
+{
+    // One-minute windows every 10 seconds
+    IOAggregator* agg = create(IO_WINDOW_SLIDING, 60000, 10000);
+    ASSERT_NE(agg, nullptr);
+    int m = io_aggregator_add_metric(agg, "load");
+    const int64_t base = 1700000040000;
+    for (int64_t s = 0; s < 120; s++) {
+        io_aggregator_record(agg, m, base + s * 1000, (double)s);
+    }
+    io_aggregator_flush(agg, INT64_MAX);
+
+    // 12 steps with data, each closing a window, plus 5 partial windows while draining
+    ASSERT_EQ(summaries.size(), 17u);
+    for (size_t i = 0; i < summaries.size(); i++) {
+        const Summary& s = summaries[i];
+        EXPECT_EQ(s.end - s.start, 60000);
+        EXPECT_EQ(s.end, (double)(base + (int64_t)(i + 1) * 10000));
+        // Window covers seconds [end - 60, end) clipped to [0, 120)
+        double first = std::max(0.0, (s.end - base) / 1000 - 60);
+        double last = std::min(119.0, (s.end - base) / 1000 - 1);
+        EXPECT_EQ(s.min, first);
+        EXPECT_EQ(s.max, last);
+        EXPECT_EQ(s.count, last - first + 1);
+        EXPECT_DOUBLE_EQ(s.mean, (first + last) / 2);
+    }
+    io_aggregator_destroy(agg);
+}
+
+// Windows are merged from their panes' sketches, which keeps the full range
+TEST_F(IotAggregateTest, SlidingWindowSpansSevenOctaves)
+{
+    struct io_window_config config = {};
+    config.type = IO_WINDOW_SLIDING;
+    config.length_ms = 60000;
+    config.step_ms = 10000;
+    config.quantile_count = 2;
+    config.quantiles[0] = 0.02;
+    config.quantiles[1] = 0.5;
+    IOAggregator* agg = io_aggregator_create(&config, on_summary, &summaries);
+    ASSERT_NE(agg, nullptr);
+    int m = io_aggregator_add_metric(agg, "latency");
+
+    // 1..200 in shuffled order over the first 50 seconds of one window
+    std::vector<double> values;
+    for (int i = 1; i <= 200; i++) {
+        values.push_back(i);
+    }
+    std::shuffle(values.begin(), values.end(), std::mt19937(7));
+    const int64_t base = 1700000040000;
+    for (size_t i = 0; i < values.size(); i++) {
+        ASSERT_EQ(io_aggregator_record(agg, m, base + (int64_t)i * 250, values[i]), 0);
+    }
+    io_aggregator_flush(agg, base + 60000);
+    ASSERT_FALSE(summaries.empty());
+    const Summary& full = summaries.back();
+    ASSERT_EQ(full.count, 200);
+    const double tolerance = 1.0 / (1 << (IO_SKETCH_SUBBUCKET_BITS + 1));
+    double p2 = exact_quantile(values, 0.02);
+    EXPECT_LE(std::fabs(full.p2 - p2), p2 * tolerance);
+    EXPECT_LE(std::fabs(full.p50 - 100), 100 * tolerance);
+    io_aggregator_destroy(agg);
+}
+
+// Closing every window leaves the aggregator ready for later samples
+TEST_F(IotAggregateTest, FlushAllThenRecordAgain)
+{
+    IOAggregator* agg = create(IO_WINDOW_SLIDING, 60000, 10000);
+    int m = io_aggregator_add_metric(agg, "x");
+    EXPECT_EQ(io_aggregator_record(agg, m, 100000, 1.0), 0);
+    io_aggregator_flush(agg, INT64_MAX);
+    ASSERT_EQ(summaries.size(), 6u); // Every window holding step 10
+    EXPECT_EQ(summaries.back().end, 160000);
+
+    // Every window holding step 10 was emitted
+    EXPECT_EQ(io_aggregator_record(agg, m, 105000, 2.0), -1);
+    // Step 12 is still in windows ending after step 15
+    summaries.clear();
+    EXPECT_EQ(io_aggregator_record(agg, m, 125000, 3.0), 0);
+    EXPECT_EQ(io_aggregator_record(agg, m, 200000, 4.0), 0);
+    ASSERT_EQ(summaries.size(), 2u); // Ending at steps 16 and 17
+    EXPECT_EQ(summaries[0].end, 170000);
+    EXPECT_EQ(summaries[0].count, 1);
+    EXPECT_EQ(summaries[0].min, 3.0);
+    io_aggregator_flush(agg, INT64_MAX);
+    EXPECT_EQ(summaries.back().max, 4.0);
+    io_aggregator_destroy(agg);
+}
+
+// Sliding windows accept samples for steps that are still part of an open window
+TEST_F(IotAggregateTest, LateSamples)
+{
+    IOAggregator* agg = create(IO_WINDOW_SLIDING, 60000, 10000);
+    int m = io_aggregator_add_metric(agg, "x");
+    EXPECT_EQ(io_aggregator_record(agg, m, 100000, 1.0), 0);
+    EXPECT_EQ(io_aggregator_record(agg, m, 55000, 2.0), 0); // Step 5 is in the window ending at step 10
+    EXPECT_EQ(io_aggregator_record(agg, m, 45000, 3.0), -1); // Step 4 is not
+    summaries.clear();
+    io_aggregator_flush(agg, 110000);
+    ASSERT_EQ(summaries.size(), 1u);
+    EXPECT_EQ(summaries[0].count, 2);
+    EXPECT_EQ(summaries[0].min, 1.0);
+    EXPECT_EQ(summaries[0].max, 2.0);
+    io_aggregator_destroy(agg);
+}
+
+TEST_F(IotAggregateTest, GapsSkipEmptyWindows)
+{
+    IOAggregator* agg = create(IO_WINDOW_TUMBLING, 1000, 0);
+    int m = io_aggregator_add_metric(agg, "x");
+    io_aggregator_record(agg, m, 500, 1.0);
+    io_aggregator_record(agg, m, 1000000, 2.0); // Long silence
+    ASSERT_EQ(summaries.size(), 1u);
+    EXPECT_EQ(summaries[0].start, 0);
+    EXPECT_EQ(summaries[0].count, 1);
+    io_aggregator_destroy(agg);
+}
+
+TEST_F(IotAggregateTest, InvalidInput)
+{
+    EXPECT_EQ(create(IO_WINDOW_TUMBLING, 0, 0), nullptr);
+    EXPECT_EQ(create(IO_WINDOW_SLIDING, 60000, 7000), nullptr); // Step must divide length
+    EXPECT_EQ(create(IO_WINDOW_SLIDING, 60000, 100), nullptr); // Too many panes
+
+    IOAggregator* agg = create(IO_WINDOW_TUMBLING, 1000, 0);
+    EXPECT_EQ(io_aggregator_add_metric(agg, std::string(IO_AGGREGATE_NAME_SIZE, 'x').c_str()), -1);
+    int m = io_aggregator_add_metric(agg, "x");
+    EXPECT_EQ(io_aggregator_record(agg, m + 1, 0, 1.0), -1);
+    EXPECT_EQ(io_aggregator_record(agg, m, 0, NAN), -1);
+    EXPECT_EQ(io_aggregator_record(agg, m, 0, INFINITY), -1);
+    io_aggregator_destroy(agg);
+}
@@ -0,0 +1,195 @@
+#include "data/serialize.h"
+#include <cmath>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <limits>
+#include <string>
+#include <vector>
+
+// Test fixture for time-series batches
+class IotBatchTest : public ::testing::Test {
+protected:
+    IOBatch* batch = nullptr;
+
+    void SetUp() override
+    {
+        batch = io_batch_create();
+        ASSERT_NE(batch, nullptr);
+    }
+
+    void TearDown() override
+    {
+        io_batch_destroy(batch);
+    }
+
+    std::vector<uint8_t> encode(enum io_batch_format format)
+    {
+        std::vector<uint8_t> buffer(io_batch_serialized_size(batch, format));
+        size_t length = 0;
+        EXPECT_EQ(io_batch_serialize(batch, format, buffer.data(), buffer.size(), &length), 0);
+        EXPECT_EQ(length, buffer.size());
+        return buffer;
+    }
+
+    // Decode the Gorilla encoding and check every sample matches bit for bit
+    void expect_round_trip()
+    {
+        std::vector<uint8_t> encoded = encode(IO_BATCH_FORMAT_GORILLA);
+        IOBatch* decoded = io_batch_deserialize(encoded.data(), encoded.size());
+        ASSERT_NE(decoded, nullptr);
+        ASSERT_EQ(decoded->series_count, batch->series_count);
+        for (size_t i = 0; i < batch->series_count; i++) {
+            const IOSeries& a = batch->series[i];
+            const IOSeries& b = decoded->series[i];
+            EXPECT_STREQ(a.name, b.name);
+            EXPECT_EQ(a.type, b.type);
+            ASSERT_EQ(a.count, b.count);
+            for (size_t j = 0; j < a.count; j++) {
+                EXPECT_EQ(a.timestamps[j], b.timestamps[j]) << a.name << "[" << j << "]";
+                EXPECT_EQ(std::memcmp(&a.values.ints[j], &b.values.ints[j], sizeof(int64_t)), 0)
+                    << a.name << "[" << j << "]";
+            }
+        }
+        io_batch_destroy(decoded);
+    }
+};
+
+TEST_F(IotBatchTest, AddSeries)
+{
+    EXPECT_EQ(io_batch_add_series(batch, "temperature", IO_SERIES_DOUBLE), 0);
+    EXPECT_EQ(io_batch_add_series(batch, "rssi", IO_SERIES_INT64), 1);
+    EXPECT_EQ(io_batch_add_series(batch, "rssi", IO_SERIES_INT64), -1);
+    EXPECT_EQ(io_batch_add_series(batch, std::string(IO_SERIES_NAME_SIZE, 'x').c_str(), IO_SERIES_INT64), -1);
+    EXPECT_EQ(io_batch_find_series(batch, "rssi"), 1);
+    EXPECT_EQ(io_batch_find_series(batch, "missing"), -1);
+
+    // Appending the wrong type or to an unknown series fails
+    EXPECT_EQ(io_batch_append_int(batch, 0, 1000, 5), -1);
+    EXPECT_EQ(io_batch_append_double(batch, 7, 1000, 5.0), -1);
+    EXPECT_EQ(io_batch_append_double(batch, 0, 1000, 5.0), 0);
+    EXPECT_EQ(io_batch_sample_count(batch), 1u);
+
+    io_batch_clear(batch);
+    EXPECT_EQ(io_batch_sample_count(batch), 0u);
+    EXPECT_EQ(batch->series_count, 2u);
+}
+
+// A minute of 1 Hz samples with realistic jitter and sensor noise
+TEST_F(IotBatchTest, RoundTripTelemetry)
+{
+    int temperature = io_batch_add_series(batch, "temperature", IO_SERIES_DOUBLE);
+    int humidity = io_batch_add_series(batch, "humidity", IO_SERIES_DOUBLE);
+    int rssi = io_batch_add_series(batch, "rssi", IO_SERIES_INT64);
+    int64_t ts = 1700000000000;
+    for (int i = 0; i < 60; i++) {
+        int64_t jitter = (i % 7 == 3) ? 2 : 0;
+        io_batch_append_double(batch, temperature, ts + jitter, 23.5 + (i % 5) * 0.1);
+        io_batch_append_double(batch, humidity, ts + jitter, 41.25);
+        io_batch_append_int(batch, rssi, ts + jitter, -67 - (i % 3));
+        ts += 1000;
+    }
+    expect_round_trip();
+}
+
+// Extreme values exercise the widest buckets and the wrapping delta arithmetic
+TEST_F(IotBatchTest, RoundTripEdgeValues)
+{
+    int ints = io_batch_add_series(batch, "ints", IO_SERIES_INT64);
+    int doubles = io_batch_add_series(batch, "doubles", IO_SERIES_DOUBLE);
+    const int64_t int_values[] = { 0, std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min(), -1, 1,
+        1 << 20, -(1LL << 40), 63, -64, 255, -256, 2047, -2048 };
+    const double double_values[] = { 0.0, -0.0, 1.0, std::nan(""), std::numeric_limits<double>::infinity(),
+        -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::denorm_min(),
+        std::numeric_limits<double>::max(), 1e-300, 3.14159, 3.14159, 2.0, 1.5 };
+    const int64_t timestamps[] = { std::numeric_limits<int64_t>::min(), 0, 5, 5, 4, 100000, 100001,
+        std::numeric_limits<int64_t>::max(), -7, 1LL << 33, (1LL << 33) + 64, (1LL << 33) + 64 + 300, 0 };
+    for (size_t i = 0; i < sizeof(int_values) / sizeof(int_values[0]); i++) {
+        io_batch_append_int(batch, ints, timestamps[i], int_values[i]);
+        io_batch_append_double(batch, doubles, timestamps[i], double_values[i]);
+    }
+    io_batch_add_series(batch, "empty", IO_SERIES_DOUBLE);
+    expect_round_trip();
+}
+
+// Batching a minute of samples beats one JSON object per sample by far
+TEST_F(IotBatchTest, CompressesVersusPerSampleJson)
+{
+    int temperature = io_batch_add_series(batch, "temperature", IO_SERIES_DOUBLE);
+    size_t per_sample_bytes = 0;
+    for (int i = 0; i < 60; i++) {
+        int64_t ts = 1700000000000 + i * 1000;
+        double value = 21.0 + (i / 10) * 0.5;
+        io_batch_append_double(batch, temperature, ts, value);
+
+        IO* obj = io_create();
+        cJSON_AddNumberToObject(obj->json_obj, "ts", (double)ts);
+        cJSON_AddNumberToObject(obj->json_obj, "temperature", value);
+        per_sample_bytes += io_serialized_size(obj, IO_FORMAT_JSON);
+        io_destroy(obj);
+    }
+
+    size_t gorilla_bytes = encode(IO_BATCH_FORMAT_GORILLA).size();
+    size_t json_bytes = encode(IO_BATCH_FORMAT_JSON).size();
+    EXPECT_LT(gorilla_bytes * 20, per_sample_bytes);
+    EXPECT_LT(json_bytes, per_sample_bytes);
+    EXPECT_LT(gorilla_bytes, json_bytes);
+}
+
+TEST_F(IotBatchTest, JsonFallback)
+{
+    int temperature = io_batch_add_series(batch, "temperature", IO_SERIES_DOUBLE);
+    int rssi = io_batch_add_series(batch, "rssi", IO_SERIES_INT64);
+    io_batch_append_double(batch, temperature, 1000, 23.5);
+    io_batch_append_double(batch, temperature, 2000, 23.75);
+    io_batch_append_int(batch, rssi, 1000, -67);
+    io_batch_append_int(batch, rssi, 2000, -68);
+    io_batch_append_int(batch, rssi, 3005, -70);
+
+    std::vector<uint8_t> encoded = encode(IO_BATCH_FORMAT_JSON);
+    EXPECT_EQ(std::string(encoded.begin(), encoded.end()),
+        "{\"temperature\":{\"t0\":1000,\"dt\":[1000],\"v\":[23.5,23.75]},"
+        "\"rssi\":{\"t0\":1000,\"dt\":[1000,1005],\"v\":[-67,-68,-70]}}");
+
+    // The fallback is plain JSON that io_deserialize accepts
+    IO* obj = io_deserialize(encoded.data(), encoded.size(), IO_FORMAT_JSON);
+    EXPECT_NE(obj, nullptr);
+    io_destroy(obj);
+}
+
+TEST_F(IotBatchTest, BufferTooSmall)
+{
+    int series = io_batch_add_series(batch, "x", IO_SERIES_INT64);
+    for (int i = 0; i < 10; i++) {
+        io_batch_append_int(batch, series, i * 1000, i * i);
+    }
+    uint8_t buffer[4];
+    size_t length = 0;
+    EXPECT_EQ(io_batch_serialize(batch, IO_BATCH_FORMAT_GORILLA, buffer, sizeof(buffer), &length), -1);
+    EXPECT_EQ(length, io_batch_serialized_size(batch, IO_BATCH_FORMAT_GORILLA));
+}
+
+TEST_F(IotBatchTest, RejectsMalformedInput)
+{
+    int series = io_batch_add_series(batch, "temperature", IO_SERIES_DOUBLE);
+    for (int i = 0; i < 20; i++) {
+        io_batch_append_double(batch, series, i * 1000, 20.0 + i * 0.37);
+    }
+    std::vector<uint8_t> encoded = encode(IO_BATCH_FORMAT_GORILLA);
+
+    // Every truncation fails cleanly
+    for (size_t length = 0; length < encoded.size(); length++) {
+        IOBatch* decoded = io_batch_deserialize(encoded.data(), length);
+        EXPECT_EQ(decoded, nullptr) << length;
+        io_batch_destroy(decoded);
+    }
+
+    // Wrong version, trailing bytes and a hostile sample count
+    std::vector<uint8_t> bad = encoded;
+    bad[0] = 2;
+    EXPECT_EQ(io_batch_deserialize(bad.data(), bad.size()), nullptr);
+    bad = encoded;
+    bad.push_back(0);
+    EXPECT_EQ(io_batch_deserialize(bad.data(), bad.size()), nullptr);
+    const uint8_t huge[] = { IO_BATCH_VERSION, 1, 1, 'x', IO_SERIES_INT64, 0xFF, 0xFF, 0xFF, 0xFF, 0x0F };
+    EXPECT_EQ(io_batch_deserialize(huge, sizeof(huge)), nullptr);
+}
@@ -0,0 +1,97 @@
+#include "connectivity/http_client.h"
+#include "http_server.h"
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+class IotHttpClientTest : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        iot_http_server_config config {};
+        config.host = "server.test";
+        config.port = "8080";
+        config.response_size = 64;
+        server_ = iot_http_server_start(&config);
+        ASSERT_NE(server_, nullptr);
+        ASSERT_EQ(iot_http_init(), 0);
+    }
+
+    void TearDown() override
+    {
+        iot_http_cleanup();
+        iot_http_server_stop(server_);
+    }
+
+    iot_http_server_stats stats()
+    {
+        iot_http_server_stats s;
+        iot_http_server_get_stats(server_, &s);
+        return s;
+    }
+
+    // The response buffer, cleared so no earlier response shows through
+    char* buffer()
+    {
+        std::fill(response_.begin(), response_.end(), '\0');
+        return response_.data();
+    }
+
+    iot_http_server* server_ = nullptr;
+    std::vector<char> response_ = std::vector<char>(4096);
+};
+
+} // namespace
+
+TEST_F(IotHttpClientTest, EveryMethodReusesOneConnection)
+{
+    const uint8_t payload[] = "reading=42";
+    ASSERT_EQ(iot_http_set_url("http://server.test:8080"), 0);
+
+    ASSERT_EQ(iot_http_get("/a", buffer(), response_.size()), 0);
+    EXPECT_NE(std::string(response_.data()).find("HTTP/1.1 200"), std::string::npos);
+    ASSERT_EQ(iot_http_post("/a", payload, sizeof(payload) - 1, buffer(), response_.size()), 0);
+    EXPECT_NE(std::string(response_.data()).find("X-Received-Length: 10"), std::string::npos);
+    ASSERT_EQ(iot_http_put("/a", payload, sizeof(payload) - 1, buffer(), response_.size()), 0);
+    EXPECT_NE(std::string(response_.data()).find("X-Received-Length: 10"), std::string::npos);
+    ASSERT_EQ(iot_http_delete("/a", buffer(), response_.size()), 0);
+
+    EXPECT_EQ(stats().requests, 4u);
+    EXPECT_EQ(stats().connections, 1u);
+}
+
+TEST_F(IotHttpClientTest, SendsCustomHeaders)
+{
+    const char* headers[] = { "Range: bytes=0-9" };
+    ASSERT_EQ(iot_http_set_url("http://server.test:8080"), 0);
+    ASSERT_EQ(iot_http_set_headers(headers, 1), 0);
+
+    ASSERT_EQ(iot_http_get("/a", buffer(), response_.size()), 0);
+    std::string response(response_.data());
+    EXPECT_NE(response.find("HTTP/1.1 206"), std::string::npos);
+    EXPECT_NE(response.find("Content-Range: bytes 0-9/64"), std::string::npos);
+
+    // Setting headers again replaces the earlier ones
+    ASSERT_EQ(iot_http_set_headers(nullptr, 0), 0);
+    ASSERT_EQ(iot_http_get("/a", buffer(), response_.size()), 0);
+    EXPECT_NE(std::string(response_.data()).find("HTTP/1.1 200"), std::string::npos);
+}
+
+TEST_F(IotHttpClientTest, ReceivesLargeAndChunkedBodies)
+{
+    std::vector<char> response(70000);
+    ASSERT_EQ(iot_http_set_url("http://server.test:8080/base/"), 0);
+    ASSERT_EQ(iot_http_get("/data?size=60000", response.data(), response.size()), 0);
+    ASSERT_EQ(iot_http_get("data?size=3000&chunk=500", response.data(), response.size()), 0);
+
+    // The response must fit the buffer
+    EXPECT_NE(iot_http_get("/data?size=5000", buffer(), response_.size()), 0);
+}
+
+TEST_F(IotHttpClientTest, FailsWithoutAServer)
+{
+    EXPECT_NE(iot_http_set_url("http://server.test:8081"), 0);
+}
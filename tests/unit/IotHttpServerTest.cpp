@@ -0,0 +1,439 @@
+#include "http_server.h"
+#include "interface/transport.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <map>
+#include <string>
+
+namespace {
+
+const char* const kHost = "server.test";
+const char* const kPort = "8080";
+
+struct Response {
+    int status = 0;
+    std::map<std::string, std::string> headers; // Names in lower case
+    std::string body;
+    size_t chunks = 0; // Data chunks of a chunked body
+};
+
+std::string expected_body(size_t first, size_t length)
+{
+    std::string body;
+    for (size_t i = first; i < first + length; i++) {
+        body.push_back(static_cast<char>('a' + i % 26));
+    }
+    return body;
+}
+
+// Sends hand-written requests and parses responses
+class RawClient {
+public:
+    ~RawClient() { iot_transport_close(ctx_); }
+
+    bool open()
+    {
+        iot_transport_config config;
+        iot_transport_config_default(&config);
+        config.recv_timeout_ms = 2000;
+        return iot_transport_open_with(&ctx_, kHost, kPort, &config) == 0;
+    }
+
+    bool send(const std::string& data)
+    {
+        for (size_t sent = 0; sent < data.size();) {
+            int n = iot_transport_send(ctx_, reinterpret_cast<const unsigned char*>(data.data()) + sent, data.size() - sent);
+            if (n <= 0) {
+                return false;
+            }
+            sent += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    // Read one response; head_only for the answer to a HEAD request
+    bool read(Response& response, bool head_only = false)
+    {
+        std::string line;
+        if (!read_line(line) || line.compare(0, 9, "HTTP/1.1 ") != 0) {
+            return false;
+        }
+        response = Response();
+        response.status = std::atoi(line.c_str() + 9);
+        while (read_line(line) && !line.empty()) {
+            size_t colon = line.find(':');
+            std::string name = line.substr(0, colon);
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            response.headers[name] = line.substr(line.find_first_not_of(' ', colon + 1));
+        }
+        if (head_only) {
+            return true;
+        }
+        if (response.headers["transfer-encoding"] == "chunked") {
+            for (;;) {
+                if (!read_line(line)) {
+                    return false;
+                }
+                size_t size = std::strtoul(line.c_str(), nullptr, 16);
+                if (size == 0) {
+                    return read_line(line) && line.empty();
+                }
+                std::string chunk;
+                if (!read_exact(chunk, size) || !read_line(line) || !line.empty()) {
+                    return false;
+                }
+                response.body += chunk;
+                response.chunks++;
+            }
+        }
+        return read_exact(response.body, std::strtoul(response.headers["content-length"].c_str(), nullptr, 10));
+    }
+
+    bool request(const std::string& data, Response& response, bool head_only = false)
+    {
+        return send(data) && read(response, head_only);
+    }
+
+    // Whether the server has closed the connection
+    bool closed()
+    {
+        if (!pending_.empty()) {
+            return false;
+        }
+        unsigned char byte;
+        return iot_transport_recv(ctx_, &byte, 1) == 0;
+    }
+
+private:
+    bool fill()
+    {
+        unsigned char buf[4096];
+        int n = iot_transport_recv(ctx_, buf, sizeof(buf));
+        if (n <= 0) {
+            return false;
+        }
+        pending_.append(reinterpret_cast<const char*>(buf), static_cast<size_t>(n));
+        return true;
+    }
+
+    bool read_line(std::string& line)
+    {
+        size_t end;
+        while ((end = pending_.find("\r\n")) == std::string::npos) {
+            if (!fill()) {
+                return false;
+            }
+        }
+        line = pending_.substr(0, end);
+        pending_.erase(0, end + 2);
+        return true;
+    }
+
+    bool read_exact(std::string& out, size_t length)
+    {
+        while (pending_.size() < length) {
+            if (!fill()) {
+                return false;
+            }
+        }
+        out = pending_.substr(0, length);
+        pending_.erase(0, length);
+        return true;
+    }
+
+    void* ctx_ = nullptr;
+    std::string pending_;
+};
+
+class IotHttpServerTest : public ::testing::Test {
+protected:
+    void SetUp() override { start(); }
+
+    void TearDown() override { iot_http_server_stop(server_); }
+
+    void start(size_t response_size = 100, size_t chunk_size = 0, const iot_link_profile* link = nullptr)
+    {
+        iot_http_server_stop(server_);
+        iot_http_server_config config {};
+        config.host = kHost;
+        config.port = kPort;
+        config.link = link;
+        config.response_size = response_size;
+        config.chunk_size = chunk_size;
+        server_ = iot_http_server_start(&config);
+        ASSERT_NE(server_, nullptr);
+    }
+
+    iot_http_server_stats stats()
+    {
+        iot_http_server_stats s;
+        iot_http_server_get_stats(server_, &s);
+        return s;
+    }
+
+    iot_http_server* server_ = nullptr;
+};
+
+} // namespace
+
+TEST_F(IotHttpServerTest, ServesTheDefaultBody)
+{
+    RawClient client;
+    Response response;
+    ASSERT_TRUE(client.open());
+    ASSERT_TRUE(client.request("GET /data HTTP/1.1\r\nHost: server.test\r\n\r\n", response));
+
+    EXPECT_EQ(response.status, 200);
+    EXPECT_EQ(response.headers["content-length"], "100");
+    EXPECT_EQ(response.headers["accept-ranges"], "bytes");
+    EXPECT_EQ(response.headers.count("connection"), 0u);
+    EXPECT_EQ(response.body, expected_body(0, 100));
+}
+
+TEST_F(IotHttpServerTest, QueryOverridesSize)
+{
+    RawClient client;
+    Response response;
+    ASSERT_TRUE(client.open());
+
+    ASSERT_TRUE(client.request("GET /data?size=100000 HTTP/1.1\r\n\r\n", response));
+    EXPECT_EQ(response.body, expected_body(0, 100000));
+
+    ASSERT_TRUE(client.request("GET /empty?size=0 HTTP/1.1\r\n\r\n", response));
+    EXPECT_EQ(response.status, 200);
+    EXPECT_TRUE(response.body.empty());
+
+    ASSERT_TRUE(client.request("GET /data?size=12abc HTTP/1.1\r\n\r\n", response));
+    EXPECT_EQ(response.status, 400);
+    EXPECT_TRUE(client.closed());
+}
+
+TEST_F(IotHttpServerTest, KeepsConnectionsAlive)
+{
+    RawClient client;
+    Response response;
+    ASSERT_TRUE(client.open());
+    for (int i = 0; i < 5; i++) {
+        ASSERT_TRUE(client.request("GET / HTTP/1.1\r\n\r\n", response));
+        EXPECT_EQ(response.status, 200);
+    }
+    EXPECT_EQ(stats().connections, 1u);
+    EXPECT_EQ(stats().requests, 5u);
+}
+
+TEST_F(IotHttpServerTest, ConnectionCloseEndsTheConnection)
+{
+    RawClient client;
+    Response response;
+    ASSERT_TRUE(client.open());
+    ASSERT_TRUE(client.request("GET / HTTP/1.1\r\nConnection: Close\r\n\r\n", response));
+    EXPECT_EQ(response.headers["connection"], "close");
+    EXPECT_EQ(response.body.size(), 100u);
+    EXPECT_TRUE(client.closed());
+}
+
+TEST_F(IotHttpServerTest, Http10ClosesUnlessAskedToKeepAlive)
+{
+    RawClient client;
+    Response response;
+    ASSERT_TRUE(client.open());
+    ASSERT_TRUE(client.request("GET / HTTP/1.0\r\nConnection: keep-alive\r\n\r\n", response));
+    EXPECT_EQ(response.headers["connection"], "keep-alive");
+    ASSERT_TRUE(client.request("GET / HTTP/1.0\r\n\r\n", response));
+    EXPECT_EQ(response.headers["connection"], "close");
+    EXPECT_TRUE(client.closed());
+}
+
+TEST_F(IotHttpServerTest, AnswersPipelinedRequestsInOrder)
+{
+    RawClient client;
+    Response response;
+    ASSERT_TRUE(client.open());
+    ASSERT_TRUE(client.send("GET /a?size=1 HTTP/1.1\r\n\r\n"
+                            "POST /b?size=2 HTTP/1.1\r\nContent-Length: 3\r\n\r\nxyz"
+                            "GET /c?size=3 HTTP/1.1\r\n\r\n"));
+    for (size_t size = 1; size <= 3; size++) {
+        ASSERT_TRUE(client.read(response));
+        EXPECT_EQ(response.body, expected_body(0, size));
+    }
+}
+
+TEST_F(IotHttpServerTest, SendsChunkedBodies)
+{
+    RawClient client;
+    Response response;
+    ASSERT_TRUE(client.open());
+
+    ASSERT_TRUE(client.request("GET /data?size=1000&chunk=300 HTTP/1.1\r\n\r\n", response));
+    EXPECT_EQ(response.headers["transfer-encoding"], "chunked");
+    EXPECT_EQ(response.headers.count("content-length"), 0u);
+    EXPECT_EQ(response.chunks, 4u);
+    EXPECT_EQ(response.body, expected_body(0, 1000));
+
+    // An empty chunked body is just the last chunk
+    ASSERT_TRUE(client.request("GET /data?size=0&chunk=300 HTTP/1.1\r\n\r\n", response));
+    EXPECT_EQ(response.chunks, 0u);
+    EXPECT_TRUE(response.body.empty());
+
+    // The server default applies unless the query turns it off
+    start(100, 64);
+    RawClient second;
+    ASSERT_TRUE(second.open());
+    ASSERT_TRUE(second.request("GET / HTTP/1.1\r\n\r\n", response));
+    EXPECT_EQ(response.chunks, 2u);
+    ASSERT_TRUE(second.request("GET /?chunk=0 HTTP/1.1\r\n\r\n", response));
+    EXPECT_EQ(response.headers["content-length"], "100");
+}
+
+TEST_F(IotHttpServerTest, ReadsRequestBodies)
+{
+    RawClient client;
+    Response response;
+    ASSERT_TRUE(client.open());
+
+    std::string payload(50000, 'p');
+    ASSERT_TRUE(client.request("PUT /up HTTP/1.1\r\nContent-Length: 50000\r\n\r\n" + payload, response));
+    EXPECT_EQ(response.status, 200);
+    EXPECT_EQ(response.headers["x-received-length"], "50000");
+
+    // Chunk extensions and trailers are accepted and ignored
+    ASSERT_TRUE(client.request("POST /up HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                               "5;name=value\r\nhello\r\nA\r\n0123456789\r\n0\r\nX-Trailer: yes\r\n\r\n",
+        response));
+    EXPECT_EQ(response.status, 200);
+    EXPECT_EQ(response.headers["x-received-length"], "15");
+
+    ASSERT_TRUE(client.request("DELETE /up?size=0 HTTP/1.1\r\n\r\n", response));
+    EXPECT_EQ(response.status, 200);
+    EXPECT_EQ(response.headers["x-received-length"], "0");
+}
+
+TEST_F(IotHttpServerTest, ServesRanges)
+{
+    RawClient client;
+    Response response;
+    ASSERT_TRUE(client.open());
+
+    ASSERT_TRUE(client.request("GET / HTTP/1.1\r\nRange: bytes=10-19\r\n\r\n", response));
+    EXPECT_EQ(response.status, 206);
+    EXPECT_EQ(response.headers["content-range"], "bytes 10-19/100");
+    EXPECT_EQ(response.body, expected_body(10, 10));
+
+    ASSERT_TRUE(client.request("GET / HTTP/1.1\r\nRange: bytes=90-\r\n\r\n", response));
+    EXPECT_EQ(response.headers["content-range"], "bytes 90-99/100");
+    EXPECT_EQ(response.body, expected_body(90, 10));
+
+    ASSERT_TRUE(client.request("GET / HTTP/1.1\r\nRange: bytes=-5\r\n\r\n", response));
+    EXPECT_EQ(response.body, expected_body(95, 5));
+
+    ASSERT_TRUE(client.request("GET / HTTP/1.1\r\nRange: bytes=95-1000\r\n\r\n", response));
+    EXPECT_EQ(response.headers["content-range"], "bytes 95-99/100");
+
+    ASSERT_TRUE(client.request("GET /?chunk=4 HTTP/1.1\r\nRange: bytes=3-12\r\n\r\n", response));
+    EXPECT_EQ(response.status, 206);
+    EXPECT_EQ(response.chunks, 3u);
+    EXPECT_EQ(response.body, expected_body(3, 10));
+
+    ASSERT_TRUE(client.request("GET / HTTP/1.1\r\nRange: bytes=100-\r\n\r\n", response));
+    EXPECT_EQ(response.status, 416);
+    EXPECT_EQ(response.headers["content-range"], "bytes */100");
+    EXPECT_TRUE(response.body.empty());
+
+    // Malformed and multiple ranges are ignored
+    ASSERT_TRUE(client.request("GET / HTTP/1.1\r\nRange: bytes=20-10\r\n\r\n", response));
+    EXPECT_EQ(response.status, 200);
+    ASSERT_TRUE(client.request("GET / HTTP/1.1\r\nRange: bytes=0-1,5-6\r\n\r\n", response));
+    EXPECT_EQ(response.status, 200);
+
+    // Ranges only apply to GET and HEAD
+    ASSERT_TRUE(client.request("POST / HTTP/1.1\r\nRange: bytes=0-9\r\nContent-Length: 0\r\n\r\n", response));
+    EXPECT_EQ(response.status, 200);
+    EXPECT_EQ(response.body.size(), 100u);
+}
+
+TEST_F(IotHttpServerTest, HeadSendsHeadersOnly)
+{
+    RawClient client;
+    Response response;
+    ASSERT_TRUE(client.open());
+    ASSERT_TRUE(client.request("HEAD /?size=5000 HTTP/1.1\r\n\r\n", response, true));
+    EXPECT_EQ(response.headers["content-length"], "5000");
+
+    // Nothing but the next response follows
+    ASSERT_TRUE(client.request("GET /?size=3 HTTP/1.1\r\n\r\n", response));
+    EXPECT_EQ(response.body, "abc");
+}
+
+TEST_F(IotHttpServerTest, HonoursDelays)
+{
+    RawClient client;
+    Response response;
+    ASSERT_TRUE(client.open());
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(client.request("GET /?delay_ms=120 HTTP/1.1\r\n\r\n", response));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(120));
+    EXPECT_EQ(response.status, 200);
+}
+
+TEST_F(IotHttpServerTest, RejectsBadRequests)
+{
+    const struct {
+        const char* request;
+        int status;
+    } cases[] = {
+        { "GARBAGE\r\n\r\n", 400 },
+        { "GET / HTTP/2.0\r\n\r\n", 505 },
+        { "BREW / HTTP/1.1\r\n\r\n", 501 },
+        { "GET / HTTP/1.1\r\nNo colon here\r\n\r\n", 400 },
+        { "GET / HTTP/1.1\r\nBad Name: x\r\n\r\n", 400 },
+        { "POST / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n", 400 },
+        { "POST / HTTP/1.1\r\nContent-Length: 1\r\nTransfer-Encoding: chunked\r\n\r\n", 400 },
+        { "POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n", 501 },
+    };
+    for (const auto& c : cases) {
+        RawClient client;
+        Response response;
+        ASSERT_TRUE(client.open());
+        ASSERT_TRUE(client.request(c.request, response)) << c.request;
+        EXPECT_EQ(response.status, c.status) << c.request;
+        EXPECT_TRUE(client.closed()) << c.request;
+    }
+
+    RawClient client;
+    Response response;
+    ASSERT_TRUE(client.open());
+    ASSERT_TRUE(client.request("GET / HTTP/1.1\r\nX-Big: " + std::string(10000, 'x') + "\r\n\r\n", response));
+    EXPECT_EQ(response.status, 431);
+}
+
+TEST_F(IotHttpServerTest, CountsWireBytes)
+{
+    RawClient client;
+    Response response;
+    ASSERT_TRUE(client.open());
+    std::string request = "PUT / HTTP/1.1\r\nContent-Length: 10\r\n\r\n0123456789";
+    ASSERT_TRUE(client.request(request, response));
+
+    iot_http_server_stats s = stats();
+    EXPECT_EQ(s.requests, 1u);
+    EXPECT_EQ(s.bytes_received, request.size());
+    EXPECT_GT(s.bytes_sent, 100u);
+}
+
+TEST_F(IotHttpServerTest, WorksOverAShapedLink)
+{
+    iot_link_profile link {};
+    link.rtt_us = 2000;
+    link.max_read = 7;
+    link.max_write = 13;
+    start(20000, 1000, &link);
+
+    RawClient client;
+    Response response;
+    ASSERT_TRUE(client.open());
+    ASSERT_TRUE(client.request("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n0\r\n\r\n", response));
+    EXPECT_EQ(response.headers["x-received-length"], "3");
+    EXPECT_EQ(response.body, expected_body(0, 20000));
+}
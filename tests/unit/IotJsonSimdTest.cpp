@@ -0,0 +1,254 @@
+#include "data/internet_object.h"
+#include "data/json_simd.h"
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+// Test fixture comparing every supported kernel level against the scalar one
+class IotJsonSimdTest : public ::testing::Test {
+protected:
+    const struct io_json_kernels* scalar = nullptr;
+    std::vector<const struct io_json_kernels*> levels;
+
+    void SetUp() override
+    {
+        scalar = io_json_kernels_for(IO_SIMD_SCALAR);
+        ASSERT_NE(scalar, nullptr);
+        for (io_simd_level level : { IO_SIMD_SCALAR, IO_SIMD_SSE2, IO_SIMD_AVX2 }) {
+            const struct io_json_kernels* kernels = io_json_kernels_for(level);
+            if (kernels != nullptr) {
+                levels.push_back(kernels);
+            }
+        }
+    }
+
+    // Random printable text with a few special bytes sprinkled in
+    static std::string random_text(std::mt19937& rng, size_t length)
+    {
+        static const char special[] = { '"', '\\', '\n', '\t', ' ', '{', '}', '[', ']', ':', ',', '\r', 0x01, 0x1F };
+        std::string text(length, 'a');
+        std::uniform_int_distribution<int> printable('#', '~');
+        std::uniform_int_distribution<int> pick(0, 63);
+        for (size_t i = 0; i < length; i++) {
+            int roll = pick(rng);
+            if (roll < (int)sizeof(special)) {
+                text[i] = special[roll];
+            } else {
+                text[i] = (char)printable(rng);
+            }
+        }
+        return text;
+    }
+
+    static std::string round_trip(const char* json)
+    {
+        IO* obj = io_from_string(json);
+        if (obj == nullptr) {
+            return "<invalid>";
+        }
+        char* text = io_to_string(obj);
+        std::string result = text != nullptr ? text : "<error>";
+        free(text);
+        io_destroy(obj);
+        return result;
+    }
+};
+
+// Best kernels are always one of the supported levels
+TEST_F(IotJsonSimdTest, DispatchSelectsSupportedLevel)
+{
+    const struct io_json_kernels* best = io_json_kernels();
+    ASSERT_NE(best, nullptr);
+    EXPECT_EQ(best, levels.back());
+}
+
+// Every level agrees with the scalar kernels at every offset and length
+TEST_F(IotJsonSimdTest, KernelsMatchScalar)
+{
+    std::mt19937 rng(1234);
+    for (size_t length : { 0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 200, 1000 }) {
+        for (int round = 0; round < 20; round++) {
+            std::string text = random_text(rng, length);
+            for (size_t start = 0; start <= std::min<size_t>(length, 40); start++) {
+                const char* s = text.data() + start;
+                size_t n = length - start;
+                for (const struct io_json_kernels* k : levels) {
+                    SCOPED_TRACE(k->name);
+                    EXPECT_EQ(k->find_escape(s, n), scalar->find_escape(s, n));
+                    EXPECT_EQ(k->skip_whitespace(s, n), scalar->skip_whitespace(s, n));
+                    EXPECT_EQ(k->find_structural(s, n), scalar->find_structural(s, n));
+                }
+            }
+        }
+    }
+}
+
+// A single special byte is found at every position of a longer plain run
+TEST_F(IotJsonSimdTest, FindsByteAtEveryPosition)
+{
+    for (size_t pos = 0; pos < 100; pos++) {
+        std::string text(100, 'a');
+        text[pos] = '"';
+        std::string spaces(100, ' ');
+        spaces[pos] = 'x';
+        for (const struct io_json_kernels* k : levels) {
+            SCOPED_TRACE(k->name);
+            EXPECT_EQ(k->find_escape(text.data(), text.size()), pos);
+            EXPECT_EQ(k->find_structural(text.data(), text.size()), pos);
+            EXPECT_EQ(k->skip_whitespace(spaces.data(), spaces.size()), pos);
+        }
+    }
+}
+
+// High-bit bytes are neither escapes nor structural characters
+TEST_F(IotJsonSimdTest, HighBytesArePlain)
+{
+    std::string text(64, '\xC3');
+    for (const struct io_json_kernels* k : levels) {
+        EXPECT_EQ(k->find_escape(text.data(), text.size()), text.size());
+        EXPECT_EQ(k->find_structural(text.data(), text.size()), text.size());
+        EXPECT_EQ(k->skip_whitespace(text.data(), text.size()), 0u);
+    }
+}
+
+TEST_F(IotJsonSimdTest, Utf8Validation)
+{
+    const std::vector<std::string> valid = {
+        "",
+        "plain ascii text that is longer than one vector register......",
+        "caf\xC3\xA9",
+        "\xE2\x82\xAC euro",
+        "\xF0\x9F\x98\x80 emoji",
+        "\xEF\xBF\xBF",
+        "\xF4\x8F\xBF\xBF",
+    };
+    const std::vector<std::string> invalid = {
+        "\x80",
+        "\xC0\xAF", // Overlong '/'
+        "\xC3",
+        "\xE0\x80\xAF", // Overlong three-byte
+        "\xED\xA0\x80", // Surrogate
+        "\xF0\x80\x80\xAF", // Overlong four-byte
+        "\xF4\x90\x80\x80", // Beyond U+10FFFF
+        "\xF5\x80\x80\x80",
+        "\xE2\x82",
+    };
+
+    for (const struct io_json_kernels* k : levels) {
+        SCOPED_TRACE(k->name);
+        for (const std::string& s : valid) {
+            // Also check the sequence placed after a long ASCII prefix
+            std::string shifted = std::string(45, 'a') + s + std::string(20, 'b');
+            EXPECT_TRUE(k->utf8_valid((const uint8_t*)s.data(), s.size())) << s;
+            EXPECT_TRUE(k->utf8_valid((const uint8_t*)shifted.data(), shifted.size())) << s;
+        }
+        for (const std::string& s : invalid) {
+            std::string shifted = std::string(45, 'a') + s + std::string(20, 'b');
+            EXPECT_FALSE(k->utf8_valid((const uint8_t*)s.data(), s.size()));
+            EXPECT_FALSE(k->utf8_valid((const uint8_t*)shifted.data(), shifted.size()));
+        }
+    }
+}
+
+// Randomly corrupted UTF-8 gets the same verdict from every level
+TEST_F(IotJsonSimdTest, Utf8MatchesScalar)
+{
+    const std::string sample = "ascii \xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80\xED\x9F\xBF\xF4\x8F\xBF\xBF text";
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> byte(0, 255);
+    for (int round = 0; round < 20000; round++) {
+        std::string text;
+        size_t copies = 1 + (size_t)(round % 6);
+        for (size_t i = 0; i < copies; i++) {
+            text += sample;
+        }
+        // Corrupt up to two bytes, sometimes none
+        for (int flips = round % 3; flips > 0; flips--) {
+            text[(size_t)byte(rng) % text.size()] = (char)byte(rng);
+        }
+        text.resize(text.size() - (size_t)(round % 4));
+        bool expected = scalar->utf8_valid((const uint8_t*)text.data(), text.size());
+        for (const struct io_json_kernels* k : levels) {
+            ASSERT_EQ(k->utf8_valid((const uint8_t*)text.data(), text.size()), expected) << k->name << " round " << round;
+        }
+    }
+}
+
+// io_to_string produces compact JSON that io_from_string reads back
+TEST_F(IotJsonSimdTest, StringRoundTrip)
+{
+    EXPECT_EQ(round_trip("{ \"a\" : 1 , \"b\" : [ true, false, null ] }"), "{\"a\":1,\"b\":[true,false,null]}");
+    EXPECT_EQ(round_trip("{\"s\":\"tab\\tquote\\\"slash\\\\ctl\\u0001\"}"),
+        "{\"s\":\"tab\\tquote\\\"slash\\\\ctl\\u0001\"}");
+    EXPECT_EQ(round_trip("{\"n\":[0,-5,3.25,1e3,-0.001,9007199254740993]}"),
+        "{\"n\":[0,-5,3.25,1000,-0.001,9007199254740992]}");
+    EXPECT_EQ(round_trip("[\"\\u00e9\\u20AC\\ud83d\\ude00\\/\"]"), "[\"\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80/\"]");
+    EXPECT_EQ(round_trip("{\"k\":\"caf\xC3\xA9\"}"), "{\"k\":\"caf\xC3\xA9\"}");
+}
+
+TEST_F(IotJsonSimdTest, FromStringRejectsInvalid)
+{
+    const char* invalid[] = {
+        "",
+        "{",
+        "{\"a\":}",
+        "{\"a\" 1}",
+        "[1,]",
+        "[1 2]",
+        "{\"a\":1}x",
+        "\"unterminated",
+        "\"raw\ncontrol\"",
+        "\"bad \\x escape\"",
+        "\"\\u0000\"",
+        "\"\\ud83d\"",
+        "\"\\ude00\"",
+        "\"\xC3\x28\"",
+        "[01]",
+        "tru",
+    };
+    for (const char* json : invalid) {
+        IO* obj = io_from_string(json);
+        EXPECT_EQ(obj, nullptr) << json;
+        io_destroy(obj);
+    }
+
+    // Nesting beyond IO_MAX_DEPTH is refused rather than recursing without bound
+    std::string deep = std::string(100, '[') + std::string(100, ']');
+    EXPECT_EQ(io_from_string(deep.c_str()), nullptr);
+}
+
+// Long strings cross many vector blocks on both the write and read paths
+TEST_F(IotJsonSimdTest, LongStringRoundTrip)
+{
+    std::mt19937 rng(99);
+    std::string value = random_text(rng, 5000);
+    IO* obj = io_create();
+    io_add_string(obj, "log", value.c_str());
+    char* text = io_to_string(obj);
+    ASSERT_NE(text, nullptr);
+    IO* parsed = io_from_string(text);
+    ASSERT_NE(parsed, nullptr);
+    EXPECT_STREQ(io_get_string(parsed, "log"), io_get_string(obj, "log"));
+    free(text);
+    io_destroy(parsed);
+    io_destroy(obj);
+}
+
+// Numbers with more digits than a double holds parse as strtod reads them, whatever their length
+TEST_F(IotJsonSimdTest, FromStringAcceptsLongNumbers)
+{
+    std::string ones = "1." + std::string(64, '0') + "1";
+    std::string big = std::string(80, '9') + "e-70";
+    std::string tiny = "0." + std::string(100, '0') + "123456789012345678901234567";
+    for (const std::string& number : { ones, big, tiny }) {
+        std::string json = "{\"v\":" + number + "}";
+        IO* obj = io_from_string(json.c_str());
+        ASSERT_NE(obj, nullptr) << number;
+        cJSON* item = cJSON_GetObjectItemCaseSensitive(obj->json_obj, "v");
+        ASSERT_TRUE(cJSON_IsNumber(item)) << number;
+        EXPECT_EQ(item->valuedouble, strtod(number.c_str(), nullptr)) << number;
+        io_destroy(obj);
+    }
+}
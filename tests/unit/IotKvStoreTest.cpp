@@ -0,0 +1,365 @@
+#include "interface/filesystem.h"
+#include "storage/crc32.h"
+#include "storage/kv_store.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+class IotKvStoreTest : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        char tmpl[] = "/tmp/iot_kv_test_XXXXXX";
+        ASSERT_NE(mkdtemp(tmpl), nullptr);
+        dir = tmpl;
+        path = dir + "/store.log";
+    }
+
+    void TearDown() override
+    {
+        if (kv != nullptr) {
+            iot_kv_close(kv);
+        }
+        iot_rmdir_recursive(dir.c_str());
+    }
+
+    void open(const struct iot_kv_config* config = nullptr)
+    {
+        kv = iot_kv_open(path.c_str(), config);
+        ASSERT_NE(kv, nullptr);
+    }
+
+    void reopen(const struct iot_kv_config* config = nullptr)
+    {
+        ASSERT_EQ(iot_kv_close(kv), 0);
+        kv = nullptr;
+        open(config);
+    }
+
+    std::string get(const char* key)
+    {
+        char buf[512];
+        size_t length = 0;
+        int ret = iot_kv_get(kv, key, buf, sizeof(buf), &length);
+        if (ret == IOT_KV_NOT_FOUND) {
+            return "<missing>";
+        }
+        EXPECT_EQ(ret, 0);
+        return std::string(buf, length < sizeof(buf) ? length : sizeof(buf));
+    }
+
+    int put(const char* key, const std::string& value) { return iot_kv_put(kv, key, value.data(), value.size()); }
+
+    size_t file_size() const
+    {
+        struct iot_stat st = {};
+        iot_stat(path.c_str(), &st);
+        return st.st_size;
+    }
+
+    // Overwrite part of the log in place
+    void patch_file(size_t offset, const void* data, size_t length)
+    {
+        struct iot_file* file = iot_fopen(path.c_str(), "r+");
+        ASSERT_NE(file, nullptr);
+        ASSERT_EQ(iot_fseek(file, static_cast<long>(offset)), 0);
+        ASSERT_EQ(iot_fwrite(data, 1, length, file), length);
+        ASSERT_EQ(iot_fclose(file), 0);
+    }
+
+    void truncate_file(size_t size)
+    {
+        struct iot_file* file = iot_fopen(path.c_str(), "r+");
+        ASSERT_NE(file, nullptr);
+        ASSERT_EQ(iot_ftruncate(file, size), 0);
+        ASSERT_EQ(iot_fclose(file), 0);
+    }
+
+    std::string dir;
+    std::string path;
+    struct iot_kv* kv = nullptr;
+};
+
+} // namespace
+
+TEST(IotCrc32Test, MatchesZlib)
+{
+    EXPECT_EQ(iot_crc32(0, "123456789", 9), 0xcbf43926u);
+    EXPECT_EQ(iot_crc32(iot_crc32(0, "1234", 4), "56789", 5), 0xcbf43926u);
+    EXPECT_EQ(iot_crc32(0, "", 0), 0u);
+}
+
+TEST_F(IotKvStoreTest, PutGetDelete)
+{
+    open();
+    EXPECT_EQ(get("mode"), "<missing>");
+    ASSERT_EQ(put("mode", "eco"), 0);
+    ASSERT_EQ(put("interval", "30"), 0);
+    EXPECT_EQ(get("mode"), "eco");
+    ASSERT_EQ(put("mode", "boost"), 0);
+    EXPECT_EQ(get("mode"), "boost");
+    EXPECT_EQ(get("interval"), "30");
+
+    EXPECT_EQ(iot_kv_delete(kv, "mode"), 0);
+    EXPECT_EQ(get("mode"), "<missing>");
+    EXPECT_EQ(iot_kv_delete(kv, "mode"), IOT_KV_NOT_FOUND);
+
+    // Empty values are values
+    ASSERT_EQ(iot_kv_put(kv, "empty", nullptr, 0), 0);
+    size_t length = 99;
+    EXPECT_EQ(iot_kv_get(kv, "empty", nullptr, 0, &length), 0);
+    EXPECT_EQ(length, 0u);
+
+    // A short buffer gets a prefix and the full length
+    ASSERT_EQ(put("long", std::string(100, 'x')), 0);
+    char buf[10];
+    ASSERT_EQ(iot_kv_get(kv, "long", buf, sizeof(buf), &length), 0);
+    EXPECT_EQ(length, 100u);
+    EXPECT_EQ(std::string(buf, sizeof(buf)), std::string(10, 'x'));
+
+    EXPECT_LT(put("", "v"), 0);
+    EXPECT_LT(put(std::string(IOT_KV_MAX_KEY + 1, 'k').c_str(), "v"), 0);
+
+    struct iot_kv_stats stats;
+    iot_kv_get_stats(kv, &stats);
+    EXPECT_EQ(stats.keys, 3u);
+    EXPECT_EQ(stats.log_bytes, file_size());
+}
+
+TEST_F(IotKvStoreTest, ReopenRebuildsIndex)
+{
+    open();
+    for (int i = 0; i < 1000; i++) {
+        ASSERT_EQ(put(("key" + std::to_string(i)).c_str(), "value" + std::to_string(i)), 0);
+    }
+    for (int i = 0; i < 1000; i += 3) {
+        ASSERT_EQ(iot_kv_delete(kv, ("key" + std::to_string(i)).c_str()), 0);
+    }
+    ASSERT_EQ(put("key1", "changed"), 0);
+    reopen();
+
+    struct iot_kv_stats stats;
+    iot_kv_get_stats(kv, &stats);
+    EXPECT_EQ(stats.keys, 1000u - 334u);
+    EXPECT_EQ(stats.recovered_bytes, file_size());
+    EXPECT_EQ(stats.discarded_bytes, 0u);
+    EXPECT_EQ(get("key0"), "<missing>");
+    EXPECT_EQ(get("key1"), "changed");
+    EXPECT_EQ(get("key2"), "value2");
+    EXPECT_EQ(get("key999"), "<missing>");
+    EXPECT_EQ(get("key998"), "value998");
+}
+
+TEST_F(IotKvStoreTest, TornTailIsCutOff)
+{
+    open();
+    ASSERT_EQ(put("a", "first"), 0);
+    ASSERT_EQ(put("b", "second"), 0);
+    size_t intact = file_size();
+    ASSERT_EQ(put("c", "third"), 0);
+    ASSERT_EQ(iot_kv_close(kv), 0);
+    kv = nullptr;
+
+    // Power lost halfway through the last record
+    truncate_file(intact + 9);
+    open();
+    struct iot_kv_stats stats;
+    iot_kv_get_stats(kv, &stats);
+    EXPECT_EQ(stats.recovered_bytes, intact);
+    EXPECT_EQ(stats.discarded_bytes, 9u);
+    EXPECT_EQ(file_size(), intact);
+    EXPECT_EQ(get("b"), "second");
+    EXPECT_EQ(get("c"), "<missing>");
+
+    // Writes continue after the cut
+    ASSERT_EQ(put("c", "again"), 0);
+    reopen();
+    EXPECT_EQ(get("c"), "again");
+}
+
+TEST_F(IotKvStoreTest, CorruptRecordEndsReplay)
+{
+    open();
+    ASSERT_EQ(put("a", "first"), 0);
+    size_t second = file_size();
+    ASSERT_EQ(put("b", "second"), 0);
+    ASSERT_EQ(put("c", "third"), 0);
+    ASSERT_EQ(iot_kv_close(kv), 0);
+    kv = nullptr;
+
+    // Flip a byte of b's value: the CRC no longer matches
+    patch_file(second + 8 + 7 + 1 + 2, "X", 1);
+    open();
+    EXPECT_EQ(get("a"), "first");
+    EXPECT_EQ(get("b"), "<missing>");
+    EXPECT_EQ(get("c"), "<missing>");
+}
+
+TEST_F(IotKvStoreTest, BatchesApplyWholeOrNotAtAll)
+{
+    open();
+    ASSERT_EQ(put("old", "1"), 0);
+    struct iot_kv_batch* batch = iot_kv_batch_create();
+    ASSERT_NE(batch, nullptr);
+    ASSERT_EQ(iot_kv_batch_put(batch, "x", "10", 2), 0);
+    ASSERT_EQ(iot_kv_batch_put(batch, "y", "20", 2), 0);
+    ASSERT_EQ(iot_kv_batch_delete(batch, "old"), 0);
+    ASSERT_EQ(iot_kv_batch_put(batch, "x", "11", 2), 0);
+    size_t before = file_size();
+    ASSERT_EQ(iot_kv_write(kv, batch), 0);
+    EXPECT_EQ(get("x"), "11");
+    EXPECT_EQ(get("y"), "20");
+    EXPECT_EQ(get("old"), "<missing>");
+
+    // The same batch again, torn one byte short: none of it survives
+    iot_kv_batch_clear(batch);
+    ASSERT_EQ(iot_kv_batch_put(batch, "x", "12", 2), 0);
+    ASSERT_EQ(iot_kv_batch_put(batch, "z", "30", 2), 0);
+    size_t intact = file_size();
+    ASSERT_EQ(iot_kv_write(kv, batch), 0);
+    size_t end = file_size();
+    iot_kv_batch_destroy(batch);
+    ASSERT_EQ(iot_kv_close(kv), 0);
+    kv = nullptr;
+    EXPECT_GT(intact, before);
+
+    truncate_file(end - 1);
+    open();
+    EXPECT_EQ(get("x"), "11");
+    EXPECT_EQ(get("y"), "20");
+    EXPECT_EQ(get("z"), "<missing>");
+}
+
+// A batch large enough to grow the index, with keys put twice and put again
+// after a delete, leaves the same index as replaying it on open
+TEST_F(IotKvStoreTest, LargeBatchIndexMatchesReplay)
+{
+    open();
+    ASSERT_EQ(put("kept", "1"), 0);
+    ASSERT_EQ(put("gone", "2"), 0);
+    struct iot_kv_batch* batch = iot_kv_batch_create();
+    ASSERT_NE(batch, nullptr);
+    ASSERT_EQ(iot_kv_batch_delete(batch, "kept"), 0);
+    ASSERT_EQ(iot_kv_batch_put(batch, "kept", "3", 1), 0);
+    ASSERT_EQ(iot_kv_batch_delete(batch, "gone"), 0);
+    for (int i = 0; i < 200; i++) {
+        std::string key = "key" + std::to_string(i % 150);
+        std::string value = std::to_string(i);
+        ASSERT_EQ(iot_kv_batch_put(batch, key.c_str(), value.data(), value.size()), 0);
+    }
+    ASSERT_EQ(iot_kv_write(kv, batch), 0);
+    iot_kv_batch_destroy(batch);
+
+    struct iot_kv_stats written;
+    iot_kv_get_stats(kv, &written);
+    EXPECT_EQ(written.keys, 151u);
+    EXPECT_EQ(get("kept"), "3");
+    EXPECT_EQ(get("gone"), "<missing>");
+    EXPECT_EQ(get("key10"), "160");
+    EXPECT_EQ(get("key149"), "149");
+
+    reopen();
+    struct iot_kv_stats replayed;
+    iot_kv_get_stats(kv, &replayed);
+    EXPECT_EQ(replayed.keys, written.keys);
+    EXPECT_EQ(replayed.live_bytes, written.live_bytes);
+    EXPECT_EQ(get("kept"), "3");
+    EXPECT_EQ(get("key10"), "160");
+}
+
+TEST_F(IotKvStoreTest, CompactReclaimsSpace)
+{
+    // Only the explicit compaction runs
+    struct iot_kv_config config = {};
+    config.compact_percent = 100;
+    open(&config);
+    std::string value(200, 'v');
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 50; i++) {
+            value[0] = static_cast<char>('a' + round);
+            ASSERT_EQ(put(("k" + std::to_string(i)).c_str(), value), 0);
+        }
+    }
+    ASSERT_EQ(iot_kv_delete(kv, "k0"), 0);
+    size_t before = file_size();
+    ASSERT_EQ(iot_kv_compact(kv), 0);
+
+    struct iot_kv_stats stats;
+    iot_kv_get_stats(kv, &stats);
+    EXPECT_EQ(stats.compactions, 1u);
+    EXPECT_EQ(stats.log_bytes, file_size());
+    EXPECT_EQ(stats.log_bytes, stats.live_bytes + 8);
+    EXPECT_LT(file_size(), before / 10);
+    value[0] = 't';
+    EXPECT_EQ(get("k1"), value);
+    EXPECT_EQ(get("k0"), "<missing>");
+
+    ASSERT_EQ(put("k1", "after"), 0);
+    reopen(&config);
+    EXPECT_EQ(get("k1"), "after");
+    EXPECT_EQ(get("k49"), value);
+    EXPECT_EQ(get("k0"), "<missing>");
+}
+
+TEST_F(IotKvStoreTest, BackgroundCompactionUnderLoad)
+{
+    struct iot_kv_config config = {};
+    config.compact_percent = 50;
+    config.compact_min_bytes = 16 * 1024;
+    open(&config);
+
+    const int kThreads = 3;
+    const int kKeys = 40;
+    const int kRounds = 300;
+    std::atomic<bool> failed { false };
+    std::vector<std::thread> writers;
+    for (int t = 0; t < kThreads; t++) {
+        writers.emplace_back([&, t] {
+            for (int round = 0; round < kRounds; round++) {
+                for (int i = 0; i < kKeys; i++) {
+                    std::string key = "t" + std::to_string(t) + "k" + std::to_string(i);
+                    std::string value = key + "=" + std::to_string(round) + std::string(32, '.');
+                    if (iot_kv_put(kv, key.c_str(), value.data(), value.size()) != 0) {
+                        failed = true;
+                    }
+                    char buf[128];
+                    size_t length = 0;
+                    if (iot_kv_get(kv, key.c_str(), buf, sizeof(buf), &length) != 0 || std::string(buf, length) != value) {
+                        failed = true;
+                    }
+                }
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    EXPECT_FALSE(failed);
+
+    struct iot_kv_stats stats;
+    iot_kv_get_stats(kv, &stats);
+    EXPECT_GT(stats.compactions, 0u);
+    reopen(&config);
+    for (int t = 0; t < kThreads; t++) {
+        for (int i = 0; i < kKeys; i++) {
+            std::string key = "t" + std::to_string(t) + "k" + std::to_string(i);
+            EXPECT_EQ(get(key.c_str()), key + "=" + std::to_string(kRounds - 1) + std::string(32, '.'));
+        }
+    }
+}
+
+TEST_F(IotKvStoreTest, RejectsForeignFiles)
+{
+    struct iot_file* file = iot_fopen(path.c_str(), "w");
+    ASSERT_NE(file, nullptr);
+    ASSERT_EQ(iot_fwrite("not a store log", 1, 15, file), 15u);
+    ASSERT_EQ(iot_fclose(file), 0);
+    EXPECT_EQ(iot_kv_open(path.c_str(), nullptr), nullptr);
+}
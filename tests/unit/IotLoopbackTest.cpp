@@ -0,0 +1,296 @@
+#include "interface/loopback.h"
+#include "interface/transport.h"
+#include <algorithm>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Receive exactly len bytes, or fewer if the peer closes or times out
+size_t recv_all(void* ctx, unsigned char* buf, size_t len)
+{
+    size_t got = 0;
+    while (got < len) {
+        int n = iot_transport_recv(ctx, buf + got, len - got);
+        if (n <= 0) {
+            break;
+        }
+        got += static_cast<size_t>(n);
+    }
+    return got;
+}
+
+// Send all of buf, looping over short writes
+bool send_all(void* ctx, const unsigned char* buf, size_t len)
+{
+    size_t sent = 0;
+    while (sent < len) {
+        int n = iot_transport_send(ctx, buf + sent, len - sent);
+        if (n <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// A listener plus one accepted connection
+struct Link {
+    iot_loopback_listener* listener = nullptr;
+    void* client = nullptr;
+    void* server = nullptr;
+
+    explicit Link(const iot_link_profile* profile, const char* port = "1883")
+    {
+        listener = iot_loopback_listen("broker.test", port, profile);
+        if (listener != nullptr && iot_transport_open(&client, "broker.test", port) == 0) {
+            iot_loopback_accept(listener, &server, 1000);
+        }
+    }
+
+    ~Link()
+    {
+        iot_transport_close(client);
+        iot_transport_close(server);
+        iot_loopback_destroy(listener);
+    }
+};
+
+std::vector<unsigned char> pattern(size_t length)
+{
+    std::vector<unsigned char> data(length);
+    for (size_t i = 0; i < length; i++) {
+        data[i] = static_cast<unsigned char>(i * 31 + 7);
+    }
+    return data;
+}
+
+} // namespace
+
+TEST(IotLoopbackTest, EchoBothWays)
+{
+    Link link(nullptr);
+    ASSERT_NE(link.server, nullptr);
+
+    const unsigned char ping[] = "ping";
+    EXPECT_EQ(iot_transport_send(link.client, ping, 4), 4);
+    unsigned char buf[16];
+    ASSERT_EQ(recv_all(link.server, buf, 4), 4u);
+    EXPECT_EQ(std::string(reinterpret_cast<char*>(buf), 4), "ping");
+
+    iot_transport_iovec iov[2] = { { "po", 2 }, { "ng", 2 } };
+    EXPECT_EQ(iot_transport_sendv(link.server, iov, 2), 4);
+    ASSERT_EQ(recv_all(link.client, buf, 4), 4u);
+    EXPECT_EQ(std::string(reinterpret_cast<char*>(buf), 4), "pong");
+}
+
+TEST(IotLoopbackTest, ListenerOwnsItsAddress)
+{
+    iot_loopback_listener* listener = iot_loopback_listen("broker.test", "8883", nullptr);
+    ASSERT_NE(listener, nullptr);
+    EXPECT_EQ(iot_loopback_listen("broker.test", "8883", nullptr), nullptr);
+
+    void* ctx = nullptr;
+    EXPECT_EQ(iot_loopback_accept(listener, &ctx, 10), IOT_TRANSPORT_TIMEOUT);
+    EXPECT_EQ(ctx, nullptr);
+
+    // A client that is never accepted sees the connection close with the listener
+    void* client = nullptr;
+    ASSERT_EQ(iot_transport_open(&client, "broker.test", "8883"), 0);
+    iot_loopback_destroy(listener);
+    unsigned char buf[4];
+    EXPECT_EQ(iot_transport_recv(client, buf, sizeof(buf)), 0);
+    iot_transport_close(client);
+
+    // Once destroyed the name no longer resolves to it
+    EXPECT_NE(iot_transport_open(&client, "broker.test", "8883"), 0);
+}
+
+TEST(IotLoopbackTest, RoundTripTakesOneRtt)
+{
+    iot_link_profile profile {};
+    profile.rtt_us = 40000;
+    Link link(&profile);
+    ASSERT_NE(link.server, nullptr);
+
+    std::thread echo([&] {
+        unsigned char buf[8];
+        if (recv_all(link.server, buf, 8) == 8) {
+            send_all(link.server, buf, 8);
+        }
+    });
+    auto start = std::chrono::steady_clock::now();
+    const unsigned char message[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    ASSERT_TRUE(send_all(link.client, message, 8));
+    unsigned char reply[8];
+    ASSERT_EQ(recv_all(link.client, reply, 8), 8u);
+    double ms = elapsed_ms(start);
+    echo.join();
+
+    EXPECT_GE(ms, 39.0);
+    EXPECT_LT(ms, 80.0);
+}
+
+TEST(IotLoopbackTest, BandwidthLimitsThroughput)
+{
+    iot_link_profile profile {};
+    profile.bandwidth_bps = 8000000; // 1 MB/s
+    Link link(&profile);
+    ASSERT_NE(link.server, nullptr);
+
+    std::vector<unsigned char> data = pattern(100000);
+    std::vector<unsigned char> received(data.size());
+    auto start = std::chrono::steady_clock::now();
+    std::thread reader([&] { recv_all(link.server, received.data(), received.size()); });
+    ASSERT_TRUE(send_all(link.client, data.data(), data.size()));
+    reader.join();
+    double ms = elapsed_ms(start);
+
+    EXPECT_EQ(received, data);
+    EXPECT_GE(ms, 95.0);
+    EXPECT_LT(ms, 200.0);
+}
+
+TEST(IotLoopbackTest, LossDelaysButKeepsOrder)
+{
+    iot_link_profile profile {};
+    profile.rtt_us = 2000;
+    profile.jitter_us = 1000;
+    profile.loss_ppm = 100000; // 10%
+    profile.rto_us = 5000;
+    profile.mss = 100;
+    profile.seed = 7;
+    Link link(&profile);
+    ASSERT_NE(link.server, nullptr);
+
+    // A bulk transfer is delivered intact and in order
+    std::vector<unsigned char> data = pattern(20000);
+    std::vector<unsigned char> received(data.size());
+    std::thread reader([&] { recv_all(link.server, received.data(), received.size()); });
+    ASSERT_TRUE(send_all(link.client, data.data(), data.size()));
+    reader.join();
+    EXPECT_EQ(received, data);
+
+    // Ping-pong exchanges pay an RTO for each lost segment
+    const int rounds = 50;
+    std::thread echo([&] {
+        unsigned char buf[8];
+        for (int i = 0; i < rounds && recv_all(link.server, buf, 8) == 8; i++) {
+            send_all(link.server, buf, 8);
+        }
+    });
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        unsigned char buf[8] = { static_cast<unsigned char>(i) };
+        ASSERT_TRUE(send_all(link.client, buf, 8));
+        ASSERT_EQ(recv_all(link.client, buf, 8), 8u);
+        EXPECT_EQ(buf[0], i);
+    }
+    double ms = elapsed_ms(start);
+    echo.join();
+    EXPECT_GE(ms, rounds * 2.0 + 5.0);
+}
+
+TEST(IotLoopbackTest, ShortReadsAndWrites)
+{
+    iot_link_profile profile {};
+    profile.max_write = 7;
+    profile.max_read = 5;
+    profile.seed = 3;
+    Link link(&profile);
+    ASSERT_NE(link.server, nullptr);
+
+    std::vector<unsigned char> data = pattern(1000);
+    int largest_write = 0;
+    for (size_t sent = 0; sent < data.size();) {
+        int n = iot_transport_send(link.client, data.data() + sent, data.size() - sent);
+        ASSERT_GT(n, 0);
+        largest_write = std::max(largest_write, n);
+        sent += static_cast<size_t>(n);
+    }
+    EXPECT_LE(largest_write, 7);
+
+    std::vector<unsigned char> received;
+    int largest_read = 0;
+    unsigned char buf[64];
+    while (received.size() < data.size()) {
+        int n = iot_transport_recv(link.server, buf, sizeof(buf));
+        ASSERT_GT(n, 0);
+        largest_read = std::max(largest_read, n);
+        received.insert(received.end(), buf, buf + n);
+    }
+    EXPECT_LE(largest_read, 5);
+    EXPECT_EQ(received, data);
+}
+
+TEST(IotLoopbackTest, SameSeedSameFragmentation)
+{
+    iot_link_profile profile {};
+    profile.max_write = 50;
+    profile.seed = 42;
+    std::vector<unsigned char> data = pattern(2000);
+
+    auto write_sizes = [&](const char* port) {
+        Link link(&profile, port);
+        std::vector<int> sizes;
+        for (size_t sent = 0; sent < data.size();) {
+            int n = iot_transport_send(link.client, data.data() + sent, data.size() - sent);
+            if (n <= 0) {
+                break;
+            }
+            sizes.push_back(n);
+            sent += static_cast<size_t>(n);
+        }
+        return sizes;
+    };
+    std::vector<int> first = write_sizes("1001");
+    EXPECT_GT(first.size(), 40u);
+    EXPECT_EQ(write_sizes("1002"), first);
+}
+
+TEST(IotLoopbackTest, CloseSemantics)
+{
+    Link link(nullptr);
+    ASSERT_NE(link.server, nullptr);
+
+    const unsigned char bye[] = "bye";
+    ASSERT_EQ(iot_transport_send(link.server, bye, 3), 3);
+    iot_transport_close(link.server);
+    link.server = nullptr;
+
+    // Data sent before the close is still delivered, then end of stream
+    unsigned char buf[8];
+    EXPECT_EQ(recv_all(link.client, buf, 3), 3u);
+    EXPECT_EQ(iot_transport_recv(link.client, buf, sizeof(buf)), 0);
+    EXPECT_EQ(iot_transport_send(link.client, bye, 3), -1);
+}
+
+TEST(IotLoopbackTest, WindowBlocksSenderUntilTimeout)
+{
+    iot_link_profile profile {};
+    profile.window = 1000;
+    iot_loopback_listener* listener = iot_loopback_listen("broker.test", "9000", &profile);
+    ASSERT_NE(listener, nullptr);
+    iot_transport_config config;
+    iot_transport_config_default(&config);
+    config.send_timeout_ms = 50;
+    void* client = nullptr;
+    ASSERT_EQ(iot_transport_open_with(&client, "broker.test", "9000", &config), 0);
+
+    std::vector<unsigned char> data = pattern(1500);
+    EXPECT_EQ(iot_transport_send(client, data.data(), data.size()), 1000);
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(iot_transport_send(client, data.data() + 1000, 500), IOT_TRANSPORT_TIMEOUT);
+    EXPECT_GE(elapsed_ms(start), 45.0);
+
+    iot_transport_close(client);
+    iot_loopback_destroy(listener);
+}
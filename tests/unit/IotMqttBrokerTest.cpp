@@ -0,0 +1,575 @@
+#include "interface/transport.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/x509_crt.h"
+#include "mqtt_broker.h"
+#include "test_certs.h"
+#include <cstring>
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+const char* const kHost = "broker.test";
+const char* const kPort = "1883";
+
+struct Packet {
+    uint8_t type = 0;
+    std::vector<uint8_t> body;
+};
+
+// Client side of a TLS connection that trusts the built-in test CA
+struct TlsClient {
+    mbedtls_ssl_context ssl;
+    mbedtls_ssl_config config;
+    mbedtls_x509_crt ca_cert;
+    mbedtls_x509_crt cert;
+    mbedtls_pk_context key;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctr_drbg;
+
+    TlsClient()
+    {
+        mbedtls_ssl_init(&ssl);
+        mbedtls_ssl_config_init(&config);
+        mbedtls_x509_crt_init(&ca_cert);
+        mbedtls_x509_crt_init(&cert);
+        mbedtls_pk_init(&key);
+        mbedtls_entropy_init(&entropy);
+        mbedtls_ctr_drbg_init(&ctr_drbg);
+    }
+
+    ~TlsClient()
+    {
+        mbedtls_ssl_free(&ssl);
+        mbedtls_ssl_config_free(&config);
+        mbedtls_x509_crt_free(&ca_cert);
+        mbedtls_x509_crt_free(&cert);
+        mbedtls_pk_free(&key);
+        mbedtls_ctr_drbg_free(&ctr_drbg);
+        mbedtls_entropy_free(&entropy);
+    }
+};
+
+const unsigned char* pem(const char* text)
+{
+    return reinterpret_cast<const unsigned char*>(text);
+}
+
+// A bare MQTT 3.1.1 client that builds packets by hand, in the clear or over TLS
+class RawClient {
+public:
+    ~RawClient()
+    {
+        tls_.reset();
+        iot_transport_close(ctx_);
+    }
+
+    bool open()
+    {
+        iot_transport_config config;
+        iot_transport_config_default(&config);
+        config.recv_timeout_ms = 1000;
+        return iot_transport_open_with(&ctx_, kHost, kPort, &config) == 0;
+    }
+
+    // Open and complete a TLS 1.2 handshake, presenting the test client certificate if with_cert
+    bool open_tls(bool with_cert)
+    {
+        if (!open()) {
+            return false;
+        }
+        tls_.reset(new TlsClient);
+        TlsClient& tls = *tls_;
+        if (mbedtls_ctr_drbg_seed(&tls.ctr_drbg, mbedtls_entropy_func, &tls.entropy, nullptr, 0) != 0
+            || mbedtls_x509_crt_parse(&tls.ca_cert, pem(iot_test_ca_cert), std::strlen(iot_test_ca_cert) + 1) != 0
+            || mbedtls_ssl_config_defaults(&tls.config, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT) != 0) {
+            return false;
+        }
+        // As iot_mqtts_connnect does; TLS 1.2 also reports a refused certificate from the handshake itself
+        mbedtls_ssl_conf_min_version(&tls.config, MBEDTLS_SSL_MAJOR_VERSION_3, MBEDTLS_SSL_MINOR_VERSION_3);
+        mbedtls_ssl_conf_max_version(&tls.config, MBEDTLS_SSL_MAJOR_VERSION_3, MBEDTLS_SSL_MINOR_VERSION_3);
+        mbedtls_ssl_conf_authmode(&tls.config, MBEDTLS_SSL_VERIFY_REQUIRED);
+        mbedtls_ssl_conf_ca_chain(&tls.config, &tls.ca_cert, nullptr);
+        mbedtls_ssl_conf_rng(&tls.config, mbedtls_ctr_drbg_random, &tls.ctr_drbg);
+        if (with_cert
+            && (mbedtls_x509_crt_parse(&tls.cert, pem(iot_test_client_cert), std::strlen(iot_test_client_cert) + 1) != 0
+                || mbedtls_pk_parse_key(&tls.key, pem(iot_test_client_key), std::strlen(iot_test_client_key) + 1, nullptr, 0, mbedtls_ctr_drbg_random, &tls.ctr_drbg) != 0
+                || mbedtls_ssl_conf_own_cert(&tls.config, &tls.cert, &tls.key) != 0)) {
+            return false;
+        }
+        if (mbedtls_ssl_setup(&tls.ssl, &tls.config) != 0 || mbedtls_ssl_set_hostname(&tls.ssl, kHost) != 0) {
+            return false;
+        }
+        mbedtls_ssl_set_bio(&tls.ssl, ctx_, iot_transport_send, iot_transport_recv, nullptr);
+
+        int ret;
+        while ((ret = mbedtls_ssl_handshake(&tls.ssl)) != 0) {
+            if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool connect(uint8_t level = 4)
+    {
+        std::vector<uint8_t> body = { 0, 4, 'M', 'Q', 'T', 'T', level, 0x02, 0, 60 };
+        append_string(body, "raw-client");
+        return send(0x10, body);
+    }
+
+    bool subscribe(uint16_t packet_id, const std::vector<std::pair<std::string, uint8_t>>& filters)
+    {
+        std::vector<uint8_t> body = { static_cast<uint8_t>(packet_id >> 8), static_cast<uint8_t>(packet_id) };
+        for (const auto& f : filters) {
+            append_string(body, f.first);
+            body.push_back(f.second);
+        }
+        return send(0x82, body);
+    }
+
+    bool unsubscribe(uint16_t packet_id, const std::string& filter)
+    {
+        std::vector<uint8_t> body = { static_cast<uint8_t>(packet_id >> 8), static_cast<uint8_t>(packet_id) };
+        append_string(body, filter);
+        return send(0xA2, body);
+    }
+
+    bool publish(const std::string& topic, const std::string& payload, uint8_t qos = 0, bool retain = false, uint16_t packet_id = 0)
+    {
+        std::vector<uint8_t> body;
+        append_string(body, topic);
+        if (qos > 0) {
+            body.push_back(static_cast<uint8_t>(packet_id >> 8));
+            body.push_back(static_cast<uint8_t>(packet_id));
+        }
+        body.insert(body.end(), payload.begin(), payload.end());
+        return send(static_cast<uint8_t>(0x30 | (qos << 1) | (retain ? 1 : 0)), body);
+    }
+
+    bool send(uint8_t type, const std::vector<uint8_t>& body)
+    {
+        std::vector<uint8_t> packet = { type };
+        size_t remaining = body.size();
+        do {
+            uint8_t byte = remaining % 128;
+            remaining /= 128;
+            packet.push_back(remaining > 0 ? byte | 0x80 : byte);
+        } while (remaining > 0);
+        packet.insert(packet.end(), body.begin(), body.end());
+        for (size_t sent = 0; sent < packet.size();) {
+            int n = write_some(packet.data() + sent, packet.size() - sent);
+            if (n <= 0) {
+                return false;
+            }
+            sent += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    // Read one packet; false on timeout or when the broker closes the connection
+    bool read(Packet& packet)
+    {
+        uint8_t byte;
+        if (!read_exact(&packet.type, 1)) {
+            return false;
+        }
+        size_t remaining = 0;
+        int shift = 0;
+        do {
+            if (!read_exact(&byte, 1)) {
+                return false;
+            }
+            remaining |= static_cast<size_t>(byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        packet.body.resize(remaining);
+        return read_exact(packet.body.data(), remaining);
+    }
+
+    // Whether the broker has closed the connection
+    bool closed()
+    {
+        uint8_t byte;
+        return read_some(&byte, 1) == 0;
+    }
+
+private:
+    static void append_string(std::vector<uint8_t>& out, const std::string& s)
+    {
+        out.push_back(static_cast<uint8_t>(s.size() >> 8));
+        out.push_back(static_cast<uint8_t>(s.size()));
+        out.insert(out.end(), s.begin(), s.end());
+    }
+
+    bool read_exact(uint8_t* buf, size_t len)
+    {
+        size_t got = 0;
+        while (got < len) {
+            int n = read_some(buf + got, len - got);
+            if (n <= 0) {
+                return false;
+            }
+            got += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    int write_some(const uint8_t* buf, size_t len)
+    {
+        return tls_ ? mbedtls_ssl_write(&tls_->ssl, buf, len) : iot_transport_send(ctx_, buf, len);
+    }
+
+    // Like iot_transport_recv: 0 once the broker has closed the connection
+    int read_some(uint8_t* buf, size_t len)
+    {
+        if (!tls_) {
+            return iot_transport_recv(ctx_, buf, len);
+        }
+        int n = mbedtls_ssl_read(&tls_->ssl, buf, len);
+        return n == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY ? 0 : n;
+    }
+
+    void* ctx_ = nullptr;
+    std::unique_ptr<TlsClient> tls_;
+};
+
+// Topic, payload and flags of a received PUBLISH
+struct Message {
+    std::string topic;
+    std::string payload;
+    uint8_t qos = 0;
+    bool retain = false;
+    uint16_t packet_id = 0;
+};
+
+Message parse_publish(const Packet& packet)
+{
+    Message m;
+    m.qos = (packet.type >> 1) & 3;
+    m.retain = packet.type & 1;
+    size_t topic_length = (packet.body[0] << 8) | packet.body[1];
+    m.topic.assign(packet.body.begin() + 2, packet.body.begin() + 2 + topic_length);
+    size_t offset = 2 + topic_length;
+    if (m.qos > 0) {
+        m.packet_id = static_cast<uint16_t>((packet.body[offset] << 8) | packet.body[offset + 1]);
+        offset += 2;
+    }
+    m.payload.assign(packet.body.begin() + offset, packet.body.end());
+    return m;
+}
+
+class IotMqttBrokerTest : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        iot_mqtt_broker_config config {};
+        config.host = kHost;
+        config.port = kPort;
+        broker_ = iot_mqtt_broker_start(&config);
+        ASSERT_NE(broker_, nullptr);
+    }
+
+    void TearDown() override { iot_mqtt_broker_stop(broker_); }
+
+    // Replace the broker with one that serves TLS with the built-in test certificates
+    void restart_with_tls(bool require_client_cert)
+    {
+        iot_mqtt_broker_stop(broker_);
+        iot_mqtt_broker_config config {};
+        config.host = kHost;
+        config.port = kPort;
+        config.tls = true;
+        config.require_client_cert = require_client_cert;
+        broker_ = iot_mqtt_broker_start(&config);
+        ASSERT_NE(broker_, nullptr);
+    }
+
+    // Open and CONNECT a client, expecting an accepting CONNACK
+    void connect(RawClient& client, bool tls = false)
+    {
+        ASSERT_TRUE(tls ? client.open_tls(true) : client.open());
+        ASSERT_TRUE(client.connect());
+        Packet connack;
+        ASSERT_TRUE(client.read(connack));
+        EXPECT_EQ(connack.type, 0x20);
+        EXPECT_EQ(connack.body, (std::vector<uint8_t> { 0, 0 }));
+    }
+
+    void subscribe(RawClient& client, const std::string& filter, uint8_t qos, uint8_t expected_code)
+    {
+        ASSERT_TRUE(client.subscribe(7, { { filter, qos } }));
+        Packet suback;
+        ASSERT_TRUE(client.read(suback));
+        EXPECT_EQ(suback.type, 0x90);
+        EXPECT_EQ(suback.body, (std::vector<uint8_t> { 0, 7, expected_code }));
+    }
+
+    iot_mqtt_broker* broker_ = nullptr;
+};
+
+} // namespace
+
+TEST(IotMqttTopicTest, FilterMatching)
+{
+    auto matches = [](const char* filter, const std::string& topic) {
+        return iot_mqtt_topic_matches(filter, topic.data(), topic.size());
+    };
+    EXPECT_TRUE(matches("a/b", "a/b"));
+    EXPECT_FALSE(matches("a/b", "a/bc"));
+    EXPECT_FALSE(matches("a/b", "a"));
+    EXPECT_FALSE(matches("a", "a/b"));
+    EXPECT_TRUE(matches("a/+", "a/b"));
+    EXPECT_TRUE(matches("a/+", "a/"));
+    EXPECT_FALSE(matches("a/+", "a/b/c"));
+    EXPECT_TRUE(matches("+/+/temp", "home/kitchen/temp"));
+    EXPECT_TRUE(matches("a/#", "a"));
+    EXPECT_TRUE(matches("a/#", "a/b/c"));
+    EXPECT_TRUE(matches("#", "anything/at/all"));
+    EXPECT_FALSE(matches("#", "$SYS/uptime"));
+    EXPECT_FALSE(matches("+/uptime", "$SYS/uptime"));
+    EXPECT_TRUE(matches("$SYS/#", "$SYS/uptime"));
+}
+
+TEST_F(IotMqttBrokerTest, ConnectAndPing)
+{
+    RawClient client;
+    connect(client);
+    ASSERT_TRUE(client.send(0xC0, {}));
+    Packet pong;
+    ASSERT_TRUE(client.read(pong));
+    EXPECT_EQ(pong.type, 0xD0);
+    EXPECT_TRUE(pong.body.empty());
+
+    ASSERT_TRUE(client.send(0xE0, {}));
+    EXPECT_TRUE(client.closed());
+
+    iot_mqtt_broker_stats stats;
+    iot_mqtt_broker_get_stats(broker_, &stats);
+    EXPECT_EQ(stats.connections, 1u);
+}
+
+TEST_F(IotMqttBrokerTest, RejectsOtherProtocolLevels)
+{
+    RawClient client;
+    ASSERT_TRUE(client.open());
+    ASSERT_TRUE(client.connect(5));
+    Packet connack;
+    ASSERT_TRUE(client.read(connack));
+    EXPECT_EQ(connack.body, (std::vector<uint8_t> { 0, 1 }));
+    EXPECT_TRUE(client.closed());
+}
+
+TEST_F(IotMqttBrokerTest, PacketsBeforeConnectDropTheClient)
+{
+    RawClient client;
+    ASSERT_TRUE(client.open());
+    ASSERT_TRUE(client.send(0xC0, {}));
+    EXPECT_TRUE(client.closed());
+}
+
+TEST_F(IotMqttBrokerTest, PublisherReceivesItsOwnMessages)
+{
+    RawClient client;
+    connect(client);
+    subscribe(client, "sensors/+/temp", 0, 0);
+
+    ASSERT_TRUE(client.publish("sensors/kitchen/temp", "21.5"));
+    ASSERT_TRUE(client.publish("sensors/kitchen/humidity", "40"));
+    ASSERT_TRUE(client.publish("sensors/hall/temp", "19.0"));
+
+    Packet packet;
+    ASSERT_TRUE(client.read(packet));
+    Message first = parse_publish(packet);
+    EXPECT_EQ(first.topic, "sensors/kitchen/temp");
+    EXPECT_EQ(first.payload, "21.5");
+    EXPECT_EQ(first.qos, 0);
+    EXPECT_FALSE(first.retain);
+    ASSERT_TRUE(client.read(packet));
+    EXPECT_EQ(parse_publish(packet).topic, "sensors/hall/temp");
+}
+
+TEST_F(IotMqttBrokerTest, QoS1IsAcknowledgedAndDowngraded)
+{
+    RawClient publisher;
+    RawClient qos1;
+    RawClient qos0;
+    connect(publisher);
+    connect(qos1);
+    connect(qos0);
+    subscribe(qos1, "cmd/#", 2, 1); // QoS 2 is granted as QoS 1
+    subscribe(qos0, "cmd/#", 0, 0);
+
+    ASSERT_TRUE(publisher.publish("cmd/reboot", "now", 1, false, 42));
+    Packet puback;
+    ASSERT_TRUE(publisher.read(puback));
+    EXPECT_EQ(puback.type, 0x40);
+    EXPECT_EQ(puback.body, (std::vector<uint8_t> { 0, 42 }));
+
+    Packet packet;
+    ASSERT_TRUE(qos1.read(packet));
+    Message m1 = parse_publish(packet);
+    EXPECT_EQ(m1.qos, 1);
+    EXPECT_NE(m1.packet_id, 0);
+    EXPECT_EQ(m1.payload, "now");
+    ASSERT_TRUE(qos1.send(0x40, { static_cast<uint8_t>(m1.packet_id >> 8), static_cast<uint8_t>(m1.packet_id) }));
+
+    ASSERT_TRUE(qos0.read(packet));
+    EXPECT_EQ(parse_publish(packet).qos, 0);
+
+    iot_mqtt_broker_stats stats;
+    iot_mqtt_broker_get_stats(broker_, &stats);
+    EXPECT_EQ(stats.publishes_received, 1u);
+    EXPECT_EQ(stats.publishes_delivered, 2u);
+}
+
+TEST_F(IotMqttBrokerTest, RetainedMessagesReachNewSubscribers)
+{
+    {
+        RawClient publisher;
+        connect(publisher);
+        ASSERT_TRUE(publisher.publish("state/door", "open", 0, true));
+        ASSERT_TRUE(publisher.publish("state/door", "closed", 1, true, 1));
+        ASSERT_TRUE(publisher.publish("state/light", "on", 0, true));
+        Packet puback;
+        ASSERT_TRUE(publisher.read(puback));
+    }
+
+    RawClient late;
+    connect(late);
+    subscribe(late, "state/door", 1, 1);
+    Packet packet;
+    ASSERT_TRUE(late.read(packet));
+    Message m = parse_publish(packet);
+    EXPECT_EQ(m.topic, "state/door");
+    EXPECT_EQ(m.payload, "closed");
+    EXPECT_TRUE(m.retain);
+    EXPECT_EQ(m.qos, 1);
+
+    // An empty retained publish clears the topic
+    ASSERT_TRUE(late.publish("state/door", "", 0, true));
+    ASSERT_TRUE(late.read(packet));
+    EXPECT_FALSE(parse_publish(packet).retain);
+    iot_mqtt_broker_stats stats;
+    iot_mqtt_broker_get_stats(broker_, &stats);
+    EXPECT_EQ(stats.retained, 1u);
+}
+
+TEST_F(IotMqttBrokerTest, UnsubscribeStopsDelivery)
+{
+    RawClient client;
+    connect(client);
+    subscribe(client, "a/b", 0, 0);
+    ASSERT_TRUE(client.unsubscribe(9, "a/b"));
+    Packet unsuback;
+    ASSERT_TRUE(client.read(unsuback));
+    EXPECT_EQ(unsuback.type, 0xB0);
+    EXPECT_EQ(unsuback.body, (std::vector<uint8_t> { 0, 9 }));
+
+    ASSERT_TRUE(client.publish("a/b", "dropped"));
+    subscribe(client, "c", 0, 0);
+    ASSERT_TRUE(client.publish("c", "kept"));
+    Packet packet;
+    ASSERT_TRUE(client.read(packet));
+    EXPECT_EQ(parse_publish(packet).payload, "kept");
+}
+
+TEST_F(IotMqttBrokerTest, InvalidFiltersAreRefused)
+{
+    RawClient client;
+    connect(client);
+    ASSERT_TRUE(client.subscribe(3, { { "a/#/b", 0 }, { "a+", 0 }, { "ok/+", 1 } }));
+    Packet suback;
+    ASSERT_TRUE(client.read(suback));
+    EXPECT_EQ(suback.body, (std::vector<uint8_t> { 0, 3, 0x80, 0x80, 1 }));
+}
+
+TEST_F(IotMqttBrokerTest, QoS2DropsTheClient)
+{
+    RawClient client;
+    connect(client);
+    ASSERT_TRUE(client.publish("a", "b", 2, false, 5));
+    EXPECT_TRUE(client.closed());
+}
+
+TEST_F(IotMqttBrokerTest, LargePayloadsSurviveShortReads)
+{
+    iot_mqtt_broker_stop(broker_);
+    iot_link_profile link {};
+    link.max_read = 13;
+    link.max_write = 29;
+    link.seed = 5;
+    iot_mqtt_broker_config config {};
+    config.host = kHost;
+    config.port = kPort;
+    config.link = &link;
+    broker_ = iot_mqtt_broker_start(&config);
+    ASSERT_NE(broker_, nullptr);
+
+    RawClient client;
+    connect(client);
+    subscribe(client, "blob", 1, 1);
+    std::string payload(20000, 'x');
+    for (size_t i = 0; i < payload.size(); i++) {
+        payload[i] = static_cast<char>('a' + i % 26);
+    }
+    ASSERT_TRUE(client.publish("blob", payload, 1, false, 1));
+
+    // The PUBACK and the routed message may arrive in either order
+    Message received;
+    bool acked = false;
+    for (int i = 0; i < 2; i++) {
+        Packet packet;
+        ASSERT_TRUE(client.read(packet));
+        if (packet.type == 0x40) {
+            acked = true;
+        } else {
+            received = parse_publish(packet);
+        }
+    }
+    EXPECT_TRUE(acked);
+    EXPECT_EQ(received.payload, payload);
+}
+
+TEST_F(IotMqttBrokerTest, PublishRoundTripOverTls)
+{
+    ASSERT_NO_FATAL_FAILURE(restart_with_tls(false));
+    RawClient client;
+    connect(client, true);
+    subscribe(client, "sensors/+/temp", 0, 0);
+
+    ASSERT_TRUE(client.publish("sensors/kitchen/temp", "21.5"));
+    Packet packet;
+    ASSERT_TRUE(client.read(packet));
+    Message message = parse_publish(packet);
+    EXPECT_EQ(message.topic, "sensors/kitchen/temp");
+    EXPECT_EQ(message.payload, "21.5");
+
+    ASSERT_TRUE(client.send(0xE0, {}));
+    EXPECT_TRUE(client.closed());
+
+    iot_mqtt_broker_stats stats;
+    iot_mqtt_broker_get_stats(broker_, &stats);
+    EXPECT_EQ(stats.connections, 1u);
+    EXPECT_EQ(stats.publishes_received, 1u);
+}
+
+TEST_F(IotMqttBrokerTest, RequiredClientCertificateRejectsAnonymousClients)
+{
+    ASSERT_NO_FATAL_FAILURE(restart_with_tls(true));
+    RawClient anonymous;
+    EXPECT_FALSE(anonymous.open_tls(false));
+
+    // The refusal is per connection: a client with the test certificate still gets in
+    RawClient client;
+    connect(client, true);
+
+    iot_mqtt_broker_stats stats;
+    iot_mqtt_broker_get_stats(broker_, &stats);
+    EXPECT_EQ(stats.connections, 1u);
+}
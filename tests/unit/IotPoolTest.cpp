@@ -0,0 +1,259 @@
+#include "data/internet_object.h"
+#include "system/pool.h"
+#include <cstdint>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Live {
+    unsigned char* ptr;
+    size_t size;
+    unsigned char fill;
+};
+
+// Checks a block still holds the pattern it was given
+bool intact(const Live& live)
+{
+    for (size_t i = 0; i < live.size; i++) {
+        if (live.ptr[i] != live.fill) {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct iot_pool_stats stats()
+{
+    struct iot_pool_stats current;
+    iot_pool_get_stats(&current);
+    return current;
+}
+
+// Blocks handed out and not back in the shared lists
+size_t outstanding()
+{
+    struct iot_pool_stats current = stats();
+    return current.total_blocks - current.free_blocks;
+}
+
+// Every IO of the test binary comes from the pool, as on a device that
+// calls io_init at startup
+class PooledIoEnvironment : public ::testing::Environment {
+public:
+    void SetUp() override { io_init(); }
+};
+
+const ::testing::Environment* const pooled_io = ::testing::AddGlobalTestEnvironment(new PooledIoEnvironment);
+
+// A telemetry message of a few fields, built up or parsed from text
+IO* random_io(std::mt19937& rng)
+{
+    if (rng() % 4 == 0) {
+        std::string text = "{\"id\":\"dev-" + std::to_string(rng() % 1000) + "\",\"seq\":" + std::to_string(rng() % 100000)
+            + ",\"tags\":[\"a\",\"bb\",\"ccc\"]}";
+        return io_from_string(text.c_str());
+    }
+    IO* obj = io_create();
+    if (obj == nullptr) {
+        return nullptr;
+    }
+    size_t fields = 1 + rng() % 12;
+    for (size_t i = 0; i < fields; i++) {
+        std::string key = "k" + std::to_string(i);
+        if (rng() % 2 == 0) {
+            io_add_int(obj, key.c_str(), static_cast<int>(rng()));
+        } else {
+            io_add_string(obj, key.c_str(), std::string(1 + rng() % 200, 'v').c_str());
+        }
+    }
+    return obj;
+}
+
+} // namespace
+
+TEST(IotPoolTest, EverySizeIsAlignedAndWritable)
+{
+    std::vector<Live> blocks;
+    for (size_t size = 0; size <= IOT_POOL_MAX_BLOCK + 64; size++) {
+        auto* ptr = static_cast<unsigned char*>(iot_pool_alloc(size));
+        ASSERT_NE(ptr, nullptr) << size;
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(ptr) % alignof(std::max_align_t), 0u) << size;
+        std::memset(ptr, static_cast<int>(size & 0xff), size);
+        blocks.push_back({ ptr, size, static_cast<unsigned char>(size & 0xff) });
+    }
+    for (const Live& live : blocks) {
+        ASSERT_TRUE(intact(live)) << live.size;
+        iot_pool_free(live.ptr);
+    }
+    iot_pool_free(nullptr);
+}
+
+TEST(IotPoolTest, FreedBlocksServeTheirClassAgain)
+{
+    void* first = iot_pool_alloc(100);
+    ASSERT_NE(first, nullptr);
+    iot_pool_free(first);
+    // 100 and 120 round up to the same class
+    void* second = iot_pool_alloc(120);
+    EXPECT_EQ(second, first);
+    // 20 does not
+    void* third = iot_pool_alloc(20);
+    EXPECT_NE(third, first);
+    iot_pool_free(second);
+    iot_pool_free(third);
+}
+
+TEST(IotPoolTest, StrdupCopies)
+{
+    const char* text = "Authorization: Bearer token";
+    char* copy = iot_pool_strdup(text);
+    ASSERT_NE(copy, nullptr);
+    EXPECT_NE(copy, text);
+    EXPECT_STREQ(copy, text);
+    iot_pool_free(copy);
+    EXPECT_EQ(iot_pool_strdup(nullptr), nullptr);
+}
+
+TEST(IotPoolTest, LargeRequestsGoToMalloc)
+{
+    size_t before = stats().large_in_use;
+    void* large = iot_pool_alloc(IOT_POOL_MAX_BLOCK + 1);
+    ASSERT_NE(large, nullptr);
+    std::memset(large, 0x5a, IOT_POOL_MAX_BLOCK + 1);
+    EXPECT_EQ(stats().large_in_use, before + 1);
+    iot_pool_free(large);
+    EXPECT_EQ(stats().large_in_use, before);
+    EXPECT_EQ(iot_pool_alloc(SIZE_MAX), nullptr);
+}
+
+TEST(IotPoolTest, BlocksFreedOnAnotherThreadReturnOnFlush)
+{
+    iot_pool_thread_flush();
+    size_t before = outstanding();
+    const size_t count = 5000;
+    std::vector<void*> blocks(count);
+    std::thread producer([&] {
+        for (size_t i = 0; i < count; i++) {
+            blocks[i] = iot_pool_alloc(16 + i % 1000);
+        }
+        iot_pool_thread_flush();
+    });
+    producer.join();
+    std::thread consumer([&] {
+        for (void* block : blocks) {
+            ASSERT_NE(block, nullptr);
+            iot_pool_free(block);
+        }
+        iot_pool_thread_flush();
+    });
+    consumer.join();
+    EXPECT_EQ(outstanding(), before);
+}
+
+TEST(IotPoolTest, PlainThreadsReturnTheirCacheOnExit)
+{
+    iot_pool_thread_flush();
+    size_t before = outstanding();
+    // Allocated here, freed into the cache of a thread that never flushes
+    std::vector<void*> blocks;
+    for (size_t size = 16; size <= IOT_POOL_MAX_BLOCK; size += 16) {
+        blocks.push_back(iot_pool_alloc(size));
+    }
+    iot_pool_thread_flush();
+    std::thread consumer([&] {
+        for (void* block : blocks) {
+            iot_pool_free(block);
+        }
+        void* own = iot_pool_alloc(300);
+        iot_pool_free(own);
+    });
+    consumer.join();
+    EXPECT_EQ(outstanding(), before);
+}
+
+// Hours of a gateway's churn in miniature: a fixed number of live blocks of
+// random sizes, each replaced over and over. The memory held must level
+// off once every class has seen its peak, and all of it must come back
+TEST(IotPoolTest, RandomChurnDoesNotGrowTheFootprint)
+{
+    iot_pool_thread_flush();
+    size_t before = outstanding();
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> size_of(1, IOT_POOL_MAX_BLOCK);
+    const size_t live_count = 2000;
+    const int rounds = 20;
+    std::vector<Live> live(live_count);
+    for (Live& slot : live) {
+        slot.size = size_of(rng);
+        slot.ptr = static_cast<unsigned char*>(iot_pool_alloc(slot.size));
+        ASSERT_NE(slot.ptr, nullptr);
+        slot.fill = static_cast<unsigned char>(rng());
+        std::memset(slot.ptr, slot.fill, slot.size);
+    }
+    size_t warmed_up = 0;
+    for (int round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < 50 * live_count; i++) {
+            Live& slot = live[rng() % live_count];
+            ASSERT_TRUE(intact(slot));
+            iot_pool_free(slot.ptr);
+            slot.size = size_of(rng);
+            slot.ptr = static_cast<unsigned char*>(iot_pool_alloc(slot.size));
+            ASSERT_NE(slot.ptr, nullptr);
+            slot.fill = static_cast<unsigned char>(rng());
+            std::memset(slot.ptr, slot.fill, slot.size);
+        }
+        if (round == 1) {
+            warmed_up = stats().reserved_bytes;
+        }
+    }
+    // Random peaks of single classes may still add a chunk here and there
+    EXPECT_LE(stats().reserved_bytes, warmed_up + warmed_up / 20);
+
+    for (const Live& slot : live) {
+        ASSERT_TRUE(intact(slot));
+        iot_pool_free(slot.ptr);
+    }
+    iot_pool_thread_flush();
+    EXPECT_EQ(outstanding(), before);
+}
+
+// The same churn through real IO objects: with io_init, their cJSON nodes
+// and strings come from the pool, and the footprint levels off in the same way
+TEST(IotPoolTest, IoChurnDoesNotGrowTheFootprint)
+{
+    iot_pool_thread_flush();
+    size_t before = outstanding();
+    std::mt19937 rng(7);
+    const size_t live_count = 500;
+    const int rounds = 20;
+    std::vector<IO*> live(live_count);
+    for (IO*& obj : live) {
+        obj = random_io(rng);
+        ASSERT_NE(obj, nullptr);
+    }
+    EXPECT_GT(outstanding(), before + live_count);
+
+    size_t warmed_up = 0;
+    for (int round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < 10 * live_count; i++) {
+            IO*& obj = live[rng() % live_count];
+            io_destroy(obj);
+            obj = random_io(rng);
+            ASSERT_NE(obj, nullptr);
+        }
+        if (round == 1) {
+            warmed_up = stats().reserved_bytes;
+        }
+    }
+    EXPECT_LE(stats().reserved_bytes, warmed_up + warmed_up / 20);
+
+    for (IO* obj : live) {
+        io_destroy(obj);
+    }
+    iot_pool_thread_flush();
+    EXPECT_EQ(outstanding(), before);
+}
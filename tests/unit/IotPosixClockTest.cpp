@@ -0,0 +1,78 @@
+#include "interface/clock.h"
+#include <chrono>
+#include <ctime>
+#include <gtest/gtest.h>
+#include <thread>
+
+namespace {
+
+const uint64_t kMs = 1000000;
+
+} // namespace
+
+TEST(IotPosixClockTest, MonotonicClockAdvances)
+{
+    uint64_t previous = iot_time_monotonic_ns();
+    for (int i = 0; i < 1000; i++) {
+        uint64_t now = iot_time_monotonic_ns();
+        ASSERT_GE(now, previous);
+        previous = now;
+    }
+    uint64_t start = iot_time_monotonic_ns();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    uint64_t elapsed = iot_time_monotonic_ns() - start;
+    EXPECT_GE(elapsed, 20 * kMs);
+    EXPECT_LT(elapsed, 2000 * kMs);
+}
+
+TEST(IotPosixClockTest, WallClockIsUnixTime)
+{
+    uint64_t seconds = iot_time_realtime_ns() / 1000000000u;
+    uint64_t reference = static_cast<uint64_t>(std::time(nullptr));
+    EXPECT_LE(seconds > reference ? seconds - reference : reference - seconds, 1u);
+    uint64_t legacy = iot_get_time(IOT_TIME_SECONDS);
+    EXPECT_LE(legacy > reference ? legacy - reference : reference - legacy, 1u);
+}
+
+TEST(IotPosixClockTest, GetTimeUnitsShareTheMonotonicClock)
+{
+    uint64_t ns = iot_time_monotonic_ns();
+    uint64_t us = iot_get_time(IOT_TIME_MICROSECONDS);
+    uint64_t ms = iot_get_time(IOT_TIME_MILLISECONDS);
+    EXPECT_GE(us, ns / 1000);
+    EXPECT_LT(us, ns / 1000 + 1000000);
+    EXPECT_GE(ms, ns / kMs);
+    EXPECT_LT(ms, ns / kMs + 1000);
+}
+
+TEST(IotPosixClockTest, CoarseClockLagsByAtMostItsResolution)
+{
+    uint64_t resolution = iot_time_coarse_resolution_ns();
+    EXPECT_GT(resolution, 0u);
+    EXPECT_LE(resolution, 100 * kMs);
+    for (int i = 0; i < 1000; i++) {
+        uint64_t coarse = iot_time_coarse_ns();
+        uint64_t fine = iot_time_monotonic_ns();
+        ASSERT_LE(coarse, fine);
+        // Slack for the time between the two reads on a busy machine
+        ASSERT_LE(fine - coarse, resolution + 50 * kMs);
+    }
+}
+
+TEST(IotPosixClockTest, CyclesConvertToElapsedTime)
+{
+    EXPECT_GT(iot_cycles_per_second(), 0u);
+    uint64_t start_ns = iot_time_monotonic_ns();
+    uint64_t start = iot_cycles();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    uint64_t cycles = iot_cycles() - start;
+    uint64_t elapsed_ns = iot_time_monotonic_ns() - start_ns;
+    uint64_t converted = iot_cycles_to_ns(cycles);
+    // Within 10% of the monotonic clock over the same interval
+    EXPECT_GT(converted, elapsed_ns - elapsed_ns / 10);
+    EXPECT_LT(converted, elapsed_ns + elapsed_ns / 10);
+
+    // Long intervals convert without overflowing
+    uint64_t hour = iot_cycles_per_second() * 3600;
+    EXPECT_EQ(iot_cycles_to_ns(hour), 3600 * 1000000000ull);
+}
@@ -0,0 +1,265 @@
+#include "interface/filesystem.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <poll.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct Completion {
+    int calls = 0;
+    int64_t result = 0;
+};
+
+void record(void* user_data, int64_t result)
+{
+    Completion* completion = static_cast<Completion*>(user_data);
+    completion->calls++;
+    completion->result = result;
+}
+
+// Run callbacks until nothing is pending, failing rather than hanging
+void drain(struct iot_aio* aio)
+{
+    for (int i = 0; i < 1000 && iot_aio_pending(aio) > 0; i++) {
+        ASSERT_GE(iot_aio_complete(aio, 100), 0);
+    }
+    ASSERT_EQ(iot_aio_pending(aio), 0u);
+}
+
+// Every test runs against both backends; io_uring is skipped where the kernel refuses it
+class IotPosixFilesystemAioTest : public ::testing::TestWithParam<enum iot_aio_backend> {
+protected:
+    void SetUp() override
+    {
+        char tmpl[] = "/tmp/iot_aio_test_XXXXXX";
+        int fd = mkstemp(tmpl);
+        ASSERT_GE(fd, 0);
+        close(fd);
+        path = tmpl;
+
+        struct iot_aio_config config = { 8, 2, GetParam() };
+        aio = iot_aio_create(&config);
+        if (aio == nullptr && GetParam() == IOT_AIO_URING) {
+            GTEST_SKIP() << "io_uring is not available";
+        }
+        ASSERT_NE(aio, nullptr);
+        EXPECT_EQ(iot_aio_get_backend(aio), GetParam());
+    }
+
+    void TearDown() override
+    {
+        iot_aio_destroy(aio);
+        unlink(path.c_str());
+    }
+
+    std::string path;
+    struct iot_aio* aio = nullptr;
+};
+
+} // namespace
+
+TEST_P(IotPosixFilesystemAioTest, WriteReadAndFsync)
+{
+    const size_t kBlock = 4096;
+    const int kBlocks = 8;
+    struct iot_file* file = iot_fopen(path.c_str(), "w+");
+    ASSERT_NE(file, nullptr);
+
+    std::vector<unsigned char> data(kBlock * kBlocks);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<unsigned char>(i * 13 + i / kBlock);
+    }
+    // Written back to front, as positional writes need no order
+    Completion writes[kBlocks];
+    for (int i = kBlocks - 1; i >= 0; i--) {
+        ASSERT_EQ(iot_aio_write(aio, file, data.data() + i * kBlock, kBlock, i * kBlock, record, &writes[i]), 0);
+    }
+    EXPECT_EQ(iot_aio_pending(aio), static_cast<uint32_t>(kBlocks));
+    EXPECT_EQ(iot_aio_submit(aio), kBlocks);
+    drain(aio);
+    for (const Completion& write : writes) {
+        EXPECT_EQ(write.calls, 1);
+        EXPECT_EQ(write.result, static_cast<int64_t>(kBlock));
+    }
+
+    Completion sync;
+    ASSERT_EQ(iot_aio_fsync(aio, file, record, &sync), 0);
+    drain(aio);
+    EXPECT_EQ(sync.calls, 1);
+    EXPECT_EQ(sync.result, 0);
+
+    std::vector<unsigned char> back(data.size());
+    Completion reads[kBlocks];
+    for (int i = 0; i < kBlocks; i++) {
+        ASSERT_EQ(iot_aio_read(aio, file, back.data() + i * kBlock, kBlock, i * kBlock, record, &reads[i]), 0);
+    }
+    drain(aio);
+    for (const Completion& read : reads) {
+        EXPECT_EQ(read.result, static_cast<int64_t>(kBlock));
+    }
+    EXPECT_EQ(back, data);
+
+    // Reading past the end returns what is there
+    Completion tail;
+    ASSERT_EQ(iot_aio_read(aio, file, back.data(), kBlock, data.size() - 100, record, &tail), 0);
+    drain(aio);
+    EXPECT_EQ(tail.result, 100);
+    EXPECT_EQ(iot_fclose(file), 0);
+}
+
+TEST_P(IotPosixFilesystemAioTest, QueueDepthIsEnforced)
+{
+    struct iot_file* file = iot_fopen(path.c_str(), "w+");
+    ASSERT_NE(file, nullptr);
+    char byte = 'x';
+    Completion completions[9];
+    for (int i = 0; i < 8; i++) {
+        ASSERT_EQ(iot_aio_write(aio, file, &byte, 1, i, record, &completions[i]), 0);
+    }
+    EXPECT_LT(iot_aio_write(aio, file, &byte, 1, 8, record, &completions[8]), 0);
+
+    drain(aio);
+    EXPECT_EQ(iot_aio_write(aio, file, &byte, 1, 8, record, &completions[8]), 0);
+    drain(aio);
+    for (const Completion& completion : completions) {
+        EXPECT_EQ(completion.result, 1);
+    }
+    EXPECT_EQ(iot_fclose(file), 0);
+}
+
+namespace {
+
+// Reads a file block by block, queueing each read from the previous one's callback
+struct Chain {
+    struct iot_aio* aio;
+    struct iot_file* file;
+    std::vector<unsigned char>* out;
+    size_t block;
+    size_t next_offset = 0;
+    int64_t total = 0;
+    bool failed = false;
+};
+
+void chain_next(void* user_data, int64_t result)
+{
+    Chain* chain = static_cast<Chain*>(user_data);
+    if (result < 0) {
+        chain->failed = true;
+        return;
+    }
+    chain->total += result;
+    if (chain->next_offset < chain->out->size()) {
+        size_t offset = chain->next_offset;
+        chain->next_offset += chain->block;
+        if (iot_aio_read(chain->aio, chain->file, chain->out->data() + offset, chain->block, offset, chain_next, chain) != 0) {
+            chain->failed = true;
+        }
+    }
+}
+
+} // namespace
+
+TEST_P(IotPosixFilesystemAioTest, CallbacksQueueFollowUpRequests)
+{
+    std::vector<unsigned char> data(64 * 1024);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<unsigned char>(i ^ (i >> 8));
+    }
+    struct iot_file* file = iot_fopen(path.c_str(), "w+");
+    ASSERT_NE(file, nullptr);
+    ASSERT_EQ(iot_fwrite(data.data(), 1, data.size(), file), data.size());
+
+    std::vector<unsigned char> back(data.size());
+    Chain chain = { aio, file, &back, 1024 };
+    chain_next(&chain, 0);
+    drain(aio);
+    EXPECT_FALSE(chain.failed);
+    EXPECT_EQ(chain.total, static_cast<int64_t>(data.size()));
+    EXPECT_EQ(back, data);
+    EXPECT_EQ(iot_fclose(file), 0);
+}
+
+TEST_P(IotPosixFilesystemAioTest, ErrorsAreNegatedErrno)
+{
+    struct iot_file* file = iot_fopen(path.c_str(), "w");
+    ASSERT_NE(file, nullptr);
+    char buf[16];
+    Completion completion;
+    ASSERT_EQ(iot_aio_read(aio, file, buf, sizeof(buf), 0, record, &completion), 0);
+    drain(aio);
+    EXPECT_EQ(completion.calls, 1);
+    EXPECT_EQ(completion.result, -EBADF);
+
+    EXPECT_LT(iot_aio_read(aio, nullptr, buf, sizeof(buf), 0, record, &completion), 0);
+    EXPECT_LT(iot_aio_read(aio, file, nullptr, sizeof(buf), 0, record, &completion), 0);
+    EXPECT_EQ(iot_fclose(file), 0);
+}
+
+TEST_P(IotPosixFilesystemAioTest, PollableDescriptor)
+{
+    struct iot_file* file = iot_fopen(path.c_str(), "w+");
+    ASSERT_NE(file, nullptr);
+
+    // Nothing pending: completing returns at once
+    EXPECT_EQ(iot_aio_complete(aio, -1), 0);
+
+    Completion completion;
+    ASSERT_EQ(iot_aio_write(aio, file, "event", 5, 0, record, &completion), 0);
+    ASSERT_EQ(iot_aio_submit(aio), 1);
+
+    struct pollfd pfd = { iot_aio_fd(aio), POLLIN, 0 };
+    ASSERT_EQ(poll(&pfd, 1, 2000), 1);
+    EXPECT_EQ(iot_aio_complete(aio, 0), 1);
+    EXPECT_EQ(completion.result, 5);
+
+    // Once drained, the descriptor is quiet again
+    EXPECT_EQ(poll(&pfd, 1, 0), 0);
+    EXPECT_EQ(iot_fclose(file), 0);
+}
+
+TEST_P(IotPosixFilesystemAioTest, BufferedWritesAreVisible)
+{
+    struct iot_file* file = iot_fopen_buffered(path.c_str(), "w+", nullptr);
+    ASSERT_NE(file, nullptr);
+    ASSERT_EQ(iot_fwrite("buffered", 1, 8, file), 8u);
+
+    char buf[16] = {};
+    Completion completion;
+    ASSERT_EQ(iot_aio_read(aio, file, buf, sizeof(buf) - 1, 0, record, &completion), 0);
+    drain(aio);
+    EXPECT_EQ(completion.result, 8);
+    EXPECT_STREQ(buf, "buffered");
+    EXPECT_EQ(iot_fclose(file), 0);
+}
+
+TEST_P(IotPosixFilesystemAioTest, DestroyWaitsForSubmittedRequests)
+{
+    struct iot_file* file = iot_fopen(path.c_str(), "w+");
+    ASSERT_NE(file, nullptr);
+    std::vector<unsigned char> data(8 * 4096, 0x5a);
+    Completion completions[8];
+    for (int i = 0; i < 8; i++) {
+        ASSERT_EQ(iot_aio_write(aio, file, data.data() + i * 4096, 4096, i * 4096, record, &completions[i]), 0);
+    }
+    ASSERT_EQ(iot_aio_submit(aio), 8);
+    iot_aio_destroy(aio);
+    aio = nullptr;
+    for (const Completion& completion : completions) {
+        EXPECT_EQ(completion.calls, 0);
+    }
+
+    struct iot_stat st;
+    ASSERT_EQ(iot_stat(path.c_str(), &st), 0);
+    EXPECT_EQ(st.st_size, data.size());
+    EXPECT_EQ(iot_fclose(file), 0);
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, IotPosixFilesystemAioTest, ::testing::Values(IOT_AIO_URING, IOT_AIO_THREADS),
+    [](const ::testing::TestParamInfo<enum iot_aio_backend>& info) {
+        return std::string(info.param == IOT_AIO_URING ? "Uring" : "Threads");
+    });
@@ -0,0 +1,218 @@
+#include "interface/filesystem.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct Entry {
+    std::string name;
+    enum iot_dirscan_type type;
+    uint64_t size;
+    int64_t mtime_ms;
+};
+
+class IotPosixFilesystemScanTest : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        char tmpl[] = "/tmp/iot_scan_test_XXXXXX";
+        ASSERT_NE(mkdtemp(tmpl), nullptr);
+        root = tmpl;
+    }
+
+    void TearDown() override { iot_rmdir_recursive(root.c_str()); }
+
+    std::string path(const std::string& name) const { return root + "/" + name; }
+
+    void write_file(const std::string& name, size_t size, int64_t mtime_s = 0)
+    {
+        struct iot_file* file = iot_fopen(path(name).c_str(), "w");
+        ASSERT_NE(file, nullptr);
+        std::string data(size, 'x');
+        ASSERT_EQ(iot_fwrite(data.data(), 1, data.size(), file), data.size());
+        ASSERT_EQ(iot_fclose(file), 0);
+        if (mtime_s != 0) {
+            struct timeval times[2] = { { mtime_s, 0 }, { mtime_s, 0 } };
+            ASSERT_EQ(utimes(path(name).c_str(), times), 0);
+        }
+    }
+
+    std::vector<Entry> scan(const struct iot_dirscan_options* options, size_t buffer_size = 64 * 1024, int* calls = nullptr)
+    {
+        std::vector<Entry> entries;
+        struct iot_dirscan* scan = iot_dirscan_open(root.c_str(), options);
+        EXPECT_NE(scan, nullptr);
+        if (scan == nullptr) {
+            return entries;
+        }
+        std::vector<char> buf(buffer_size);
+        const struct iot_dirscan_entry* batch;
+        int n;
+        while ((n = iot_dirscan_read(scan, buf.data(), buf.size(), &batch)) > 0) {
+            for (int i = 0; i < n; i++) {
+                entries.push_back({ batch[i].name, batch[i].type, batch[i].size, batch[i].mtime_ms });
+            }
+            if (calls != nullptr) {
+                (*calls)++;
+            }
+        }
+        EXPECT_EQ(n, 0);
+        EXPECT_EQ(iot_dirscan_close(scan), 0);
+        return entries;
+    }
+
+    static std::vector<std::string> names(const std::vector<Entry>& entries)
+    {
+        std::vector<std::string> out;
+        for (const Entry& entry : entries) {
+            out.push_back(entry.name);
+        }
+        return out;
+    }
+
+    std::string root;
+};
+
+} // namespace
+
+TEST_F(IotPosixFilesystemScanTest, ReportsTypesSizesAndTimes)
+{
+    write_file("a.seg", 10, 1700000000);
+    write_file("b.seg", 2000, 1700000100);
+    ASSERT_EQ(iot_mkdir(path("sub").c_str()), 0);
+    ASSERT_EQ(symlink("a.seg", path("link").c_str()), 0);
+
+    struct iot_dirscan_options options = { nullptr, IOT_DIRSCAN_BY_NAME, 0 };
+    std::vector<Entry> entries = scan(&options);
+    ASSERT_EQ(entries.size(), 4u);
+    EXPECT_EQ(entries[0].name, "a.seg");
+    EXPECT_EQ(entries[0].type, IOT_DIRSCAN_FILE);
+    EXPECT_EQ(entries[0].size, 10u);
+    EXPECT_EQ(entries[0].mtime_ms, 1700000000000);
+    EXPECT_EQ(entries[1].name, "b.seg");
+    EXPECT_EQ(entries[1].size, 2000u);
+    EXPECT_EQ(entries[2].name, "link");
+    EXPECT_EQ(entries[2].type, IOT_DIRSCAN_SYMLINK);
+    EXPECT_EQ(entries[3].name, "sub");
+    EXPECT_EQ(entries[3].type, IOT_DIRSCAN_DIR);
+
+    // Without stat, types are still right
+    options.flags = IOT_DIRSCAN_NO_STAT;
+    entries = scan(&options);
+    ASSERT_EQ(entries.size(), 4u);
+    EXPECT_EQ(entries[1].type, IOT_DIRSCAN_FILE);
+    EXPECT_EQ(entries[1].size, 0u);
+    EXPECT_EQ(entries[3].type, IOT_DIRSCAN_DIR);
+}
+
+TEST_F(IotPosixFilesystemScanTest, FiltersAndSorts)
+{
+    write_file("seg-003.dat", 30, 1700000300);
+    write_file("seg-001.dat", 50, 1700000200);
+    write_file("seg-002.dat", 10, 1700000100);
+    write_file("index.json", 5, 1700000000);
+
+    struct iot_dirscan_options options = { "seg-*.dat", IOT_DIRSCAN_BY_NAME, 0 };
+    EXPECT_EQ(names(scan(&options)), (std::vector<std::string> { "seg-001.dat", "seg-002.dat", "seg-003.dat" }));
+    options.sort = IOT_DIRSCAN_BY_MTIME;
+    EXPECT_EQ(names(scan(&options)), (std::vector<std::string> { "seg-002.dat", "seg-001.dat", "seg-003.dat" }));
+    options.sort = IOT_DIRSCAN_BY_SIZE;
+    EXPECT_EQ(names(scan(&options)), (std::vector<std::string> { "seg-002.dat", "seg-003.dat", "seg-001.dat" }));
+
+    options.pattern = "*.json";
+    options.sort = IOT_DIRSCAN_UNSORTED;
+    EXPECT_EQ(names(scan(&options)), (std::vector<std::string> { "index.json" }));
+    options.pattern = "*.none";
+    EXPECT_TRUE(scan(&options).empty());
+}
+
+TEST_F(IotPosixFilesystemScanTest, SmallBuffersTakeSeveralCalls)
+{
+    const int kFiles = 2000;
+    for (int i = 0; i < kFiles; i++) {
+        write_file("segment-" + std::to_string(i), 0);
+    }
+    for (enum iot_dirscan_sort sort : { IOT_DIRSCAN_UNSORTED, IOT_DIRSCAN_BY_NAME }) {
+        struct iot_dirscan_options options = { nullptr, sort, IOT_DIRSCAN_NO_STAT };
+        int calls = 0;
+        std::vector<std::string> found = names(scan(&options, IOT_DIRSCAN_MIN_BUFFER, &calls));
+        ASSERT_EQ(found.size(), static_cast<size_t>(kFiles));
+        EXPECT_GT(calls, 10);
+        std::vector<std::string> sorted = found;
+        std::sort(sorted.begin(), sorted.end());
+        EXPECT_EQ(std::unique(sorted.begin(), sorted.end()), sorted.end());
+        if (sort == IOT_DIRSCAN_BY_NAME) {
+            EXPECT_EQ(found, sorted);
+        }
+    }
+
+    struct iot_dirscan* scan = iot_dirscan_open(root.c_str(), nullptr);
+    ASSERT_NE(scan, nullptr);
+    char small[64];
+    const struct iot_dirscan_entry* entries;
+    EXPECT_LT(iot_dirscan_read(scan, small, sizeof(small), &entries), 0);
+    EXPECT_EQ(iot_dirscan_close(scan), 0);
+}
+
+TEST_F(IotPosixFilesystemScanTest, RecursiveOrder)
+{
+    ASSERT_EQ(iot_mkdirp(path("a/b").c_str()), 0);
+    ASSERT_EQ(iot_mkdir(path("c").c_str()), 0);
+    write_file("top.log", 1);
+    write_file("a/one.log", 2);
+    write_file("a/b/two.log", 3);
+    write_file("a/b/skip.tmp", 4);
+    ASSERT_EQ(symlink(path("a").c_str(), path("c/loop").c_str()), 0);
+
+    struct iot_dirscan_options options = { nullptr, IOT_DIRSCAN_BY_NAME, IOT_DIRSCAN_RECURSIVE };
+    EXPECT_EQ(names(scan(&options)), (std::vector<std::string> { "a", "a/b", "a/b/skip.tmp", "a/b/two.log", "a/one.log", "c", "c/loop", "top.log" }));
+
+    // The pattern selects entries anywhere but does not stop the descent
+    options.pattern = "*.log";
+    std::vector<Entry> logs = scan(&options);
+    EXPECT_EQ(names(logs), (std::vector<std::string> { "a/b/two.log", "a/one.log", "top.log" }));
+    EXPECT_EQ(logs[0].size, 3u);
+
+    // Unsorted: every directory before its contents, or after with DIRS_LAST
+    for (uint32_t flags : { IOT_DIRSCAN_RECURSIVE, IOT_DIRSCAN_RECURSIVE | IOT_DIRSCAN_DIRS_LAST }) {
+        struct iot_dirscan_options unsorted = { nullptr, IOT_DIRSCAN_UNSORTED, flags };
+        std::vector<std::string> found = names(scan(&unsorted));
+        ASSERT_EQ(found.size(), 8u);
+        for (size_t i = 0; i < found.size(); i++) {
+            for (size_t j = 0; j < found.size(); j++) {
+                if (found[j].compare(0, found[i].size() + 1, found[i] + "/") == 0) {
+                    EXPECT_EQ(i < j, !(flags & IOT_DIRSCAN_DIRS_LAST)) << found[i] << " and " << found[j];
+                }
+            }
+        }
+    }
+}
+
+TEST_F(IotPosixFilesystemScanTest, RemoveRecursiveUsesTheScan)
+{
+    ASSERT_EQ(iot_mkdirp(path("spool/2024/01").c_str()), 0);
+    for (int i = 0; i < 300; i++) {
+        write_file("spool/2024/01/seg-" + std::to_string(i), 1);
+    }
+    write_file("spool/top", 1);
+    write_file("keep", 1);
+    ASSERT_EQ(symlink(path("keep").c_str(), path("spool/link").c_str()), 0);
+
+    EXPECT_EQ(iot_rmdir_recursive(path("spool").c_str()), 0);
+    struct stat st;
+    EXPECT_NE(lstat(path("spool").c_str(), &st), 0);
+    EXPECT_EQ(lstat(path("keep").c_str(), &st), 0);
+
+    // Files and symlinks are removed themselves
+    EXPECT_EQ(iot_rmdir_recursive(path("keep").c_str()), 0);
+    EXPECT_NE(lstat(path("keep").c_str(), &st), 0);
+    EXPECT_LT(iot_rmdir_recursive(path("missing").c_str()), 0);
+    EXPECT_EQ(iot_dirscan_open(path("missing").c_str(), nullptr), nullptr);
+}
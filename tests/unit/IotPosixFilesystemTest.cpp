@@ -0,0 +1,369 @@
+#include "interface/filesystem.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Each test runs in a fresh directory under /tmp, removed afterwards
+class IotPosixFilesystemTest : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        char tmpl[] = "/tmp/iot_fs_test_XXXXXX";
+        ASSERT_NE(mkdtemp(tmpl), nullptr);
+        root = tmpl;
+    }
+
+    void TearDown() override
+    {
+        if (!root.empty()) {
+            EXPECT_EQ(iot_rmdir_recursive(root.c_str()), 0);
+        }
+    }
+
+    std::string path(const std::string& name) const { return root + "/" + name; }
+
+    void write_file(const std::string& name, const std::vector<unsigned char>& data)
+    {
+        struct iot_file* file = iot_fopen(path(name).c_str(), "wb");
+        ASSERT_NE(file, nullptr);
+        ASSERT_EQ(iot_fwrite(data.data(), 1, data.size(), file), data.size());
+        ASSERT_EQ(iot_fclose(file), 0);
+    }
+
+    size_t size_on_disk(const std::string& name) const
+    {
+        struct iot_stat st = {};
+        return iot_stat(path(name).c_str(), &st) == 0 ? st.st_size : 0;
+    }
+
+    std::string root;
+};
+
+std::vector<unsigned char> pattern(size_t size)
+{
+    std::vector<unsigned char> data(size);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = static_cast<unsigned char>(i * 7 + i / 251);
+    }
+    return data;
+}
+
+} // namespace
+
+TEST_F(IotPosixFilesystemTest, WriteSeekRead)
+{
+    std::vector<unsigned char> data = pattern(10000);
+    write_file("data.bin", data);
+
+    struct iot_file* file = iot_fopen(path("data.bin").c_str(), "rb");
+    ASSERT_NE(file, nullptr);
+    std::vector<unsigned char> back(data.size());
+    EXPECT_EQ(iot_fread(back.data(), 100, 100, file), 100u);
+    EXPECT_EQ(back, data);
+
+    // Short reads at end of file count whole elements only
+    ASSERT_EQ(iot_fseek(file, 9950), 0);
+    EXPECT_EQ(iot_fread(back.data(), 100, 1, file), 0u);
+    ASSERT_EQ(iot_fseek(file, 9900), 0);
+    EXPECT_EQ(iot_fread(back.data(), 100, 2, file), 1u);
+    EXPECT_EQ(0, std::memcmp(back.data(), data.data() + 9900, 100));
+    EXPECT_EQ(iot_fclose(file), 0);
+
+    struct iot_stat st;
+    ASSERT_EQ(iot_stat(path("data.bin").c_str(), &st), 0);
+    EXPECT_EQ(st.st_size, data.size());
+}
+
+TEST_F(IotPosixFilesystemTest, OpenModes)
+{
+    EXPECT_EQ(iot_fopen(path("missing").c_str(), "r"), nullptr);
+    EXPECT_EQ(iot_fopen(path("bad").c_str(), "q"), nullptr);
+
+    write_file("log", { 'a', 'b' });
+    struct iot_file* file = iot_fopen(path("log").c_str(), "a");
+    ASSERT_NE(file, nullptr);
+    EXPECT_EQ(iot_fwrite("cd", 1, 2, file), 2u);
+    EXPECT_EQ(iot_fclose(file), 0);
+
+    file = iot_fopen(path("log").c_str(), "r+");
+    ASSERT_NE(file, nullptr);
+    char buf[8] = {};
+    EXPECT_EQ(iot_fread(buf, 1, sizeof(buf), file), 4u);
+    EXPECT_STREQ(buf, "abcd");
+    EXPECT_EQ(iot_ftruncate(file, 1), 0);
+    EXPECT_EQ(iot_fclose(file), 0);
+
+    struct iot_stat st;
+    ASSERT_EQ(iot_stat(path("log").c_str(), &st), 0);
+    EXPECT_EQ(st.st_size, 1u);
+
+    // "x" refuses to replace an existing file
+    EXPECT_EQ(iot_fopen(path("log").c_str(), "wx"), nullptr);
+}
+
+TEST_F(IotPosixFilesystemTest, DirectoriesAndRecursiveRemove)
+{
+    ASSERT_EQ(iot_mkdirp(path("a/b/c").c_str()), 0);
+    EXPECT_EQ(iot_mkdirp(path("a/b").c_str()), 0);
+    EXPECT_NE(iot_mkdir(path("a").c_str()), 0);
+    write_file("a/one", { 1 });
+    write_file("a/b/two", { 2 });
+    ASSERT_EQ(symlink(root.c_str(), path("a/link").c_str()), 0);
+
+    struct iot_dir* dir = iot_opendir(path("a").c_str());
+    ASSERT_NE(dir, nullptr);
+    std::vector<std::string> files;
+    std::vector<std::string> others;
+    while (struct iot_dirent* entry = iot_readdir(dir)) {
+        (iot_is_file(entry) ? files : others).push_back(iot_dirent_name(entry));
+    }
+    EXPECT_EQ(iot_closedir(dir), 0);
+    std::sort(others.begin(), others.end());
+    EXPECT_EQ(files, std::vector<std::string> { "one" });
+    EXPECT_EQ(others, (std::vector<std::string> { "b", "link" }));
+
+    // The link is removed, not followed: root itself survives
+    ASSERT_EQ(iot_rmdir_recursive(path("a").c_str()), 0);
+    struct iot_stat st;
+    EXPECT_NE(iot_stat(path("a").c_str(), &st), 0);
+    EXPECT_EQ(iot_stat(root.c_str(), &st), 0);
+}
+
+TEST_F(IotPosixFilesystemTest, MapWholeFile)
+{
+    std::vector<unsigned char> data = pattern(3 * 4096 + 123);
+    write_file("image.bin", data);
+
+    struct iot_file* file = iot_fopen(path("image.bin").c_str(), "rb");
+    ASSERT_NE(file, nullptr);
+    struct iot_fmap* map = iot_fmap(file, 0, 0, IOT_FMAP_SEQUENTIAL);
+    ASSERT_NE(map, nullptr);
+    ASSERT_EQ(iot_fmap_size(map), data.size());
+    EXPECT_EQ(0, std::memcmp(iot_fmap_data(map), data.data(), data.size()));
+
+    // The mapping stays valid after the file is closed
+    EXPECT_EQ(iot_fclose(file), 0);
+    EXPECT_EQ(static_cast<const unsigned char*>(iot_fmap_data(map))[data.size() - 1], data.back());
+    EXPECT_EQ(iot_funmap(map), 0);
+}
+
+TEST_F(IotPosixFilesystemTest, MapUnalignedRange)
+{
+    std::vector<unsigned char> data = pattern(5 * 4096);
+    write_file("image.bin", data);
+
+    struct iot_file* file = iot_fopen(path("image.bin").c_str(), "rb");
+    ASSERT_NE(file, nullptr);
+    struct iot_fmap* map = iot_fmap(file, 4097, 8000, IOT_FMAP_RANDOM);
+    ASSERT_NE(map, nullptr);
+    ASSERT_EQ(iot_fmap_size(map), 8000u);
+    EXPECT_EQ(0, std::memcmp(iot_fmap_data(map), data.data() + 4097, 8000));
+
+    EXPECT_EQ(iot_fmap_advise(map, 10, 5000, IOT_FMAP_WILLNEED), 0);
+    EXPECT_EQ(iot_fmap_advise(map, 0, 0, IOT_FMAP_NORMAL), 0);
+    EXPECT_NE(iot_fmap_advise(map, 7000, 1001, IOT_FMAP_NORMAL), 0);
+    EXPECT_EQ(iot_funmap(map), 0);
+
+    // Offset 0 to EOF from the middle of the file
+    map = iot_fmap(file, 12345, 0, IOT_FMAP_NORMAL);
+    ASSERT_NE(map, nullptr);
+    EXPECT_EQ(iot_fmap_size(map), data.size() - 12345);
+    EXPECT_EQ(0, std::memcmp(iot_fmap_data(map), data.data() + 12345, data.size() - 12345));
+    EXPECT_EQ(iot_funmap(map), 0);
+    EXPECT_EQ(iot_fclose(file), 0);
+}
+
+TEST_F(IotPosixFilesystemTest, MapRejectsRangesPastEnd)
+{
+    write_file("small.bin", pattern(100));
+    struct iot_file* file = iot_fopen(path("small.bin").c_str(), "rb");
+    ASSERT_NE(file, nullptr);
+
+    EXPECT_EQ(iot_fmap(file, 101, 0, IOT_FMAP_NORMAL), nullptr);
+    EXPECT_EQ(iot_fmap(file, 50, 51, IOT_FMAP_NORMAL), nullptr);
+
+    // A mapping at EOF is empty but usable
+    struct iot_fmap* map = iot_fmap(file, 100, 0, IOT_FMAP_NORMAL);
+    ASSERT_NE(map, nullptr);
+    EXPECT_EQ(iot_fmap_size(map), 0u);
+    EXPECT_NE(iot_fmap_data(map), nullptr);
+    EXPECT_EQ(iot_funmap(map), 0);
+
+    EXPECT_EQ(iot_fmap(nullptr, 0, 0, IOT_FMAP_NORMAL), nullptr);
+    EXPECT_NE(iot_funmap(nullptr), 0);
+    EXPECT_EQ(iot_fclose(file), 0);
+}
+
+TEST_F(IotPosixFilesystemTest, MapEmptyFile)
+{
+    write_file("empty.bin", {});
+    struct iot_file* file = iot_fopen(path("empty.bin").c_str(), "rb");
+    ASSERT_NE(file, nullptr);
+    struct iot_fmap* map = iot_fmap(file, 0, 0, IOT_FMAP_SEQUENTIAL);
+    ASSERT_NE(map, nullptr);
+    EXPECT_EQ(iot_fmap_size(map), 0u);
+    EXPECT_EQ(iot_funmap(map), 0);
+    EXPECT_EQ(iot_fclose(file), 0);
+}
+
+TEST_F(IotPosixFilesystemTest, BufferedWritesWaitForFlush)
+{
+    struct iot_fbuffer_config config = { 4096, 60000 };
+    struct iot_file* file = iot_fopen_buffered(path("spool").c_str(), "w", &config);
+    ASSERT_NE(file, nullptr);
+    for (int i = 0; i < 100; i++) {
+        ASSERT_EQ(iot_fwrite("0123456789", 1, 10, file), 10u);
+    }
+    EXPECT_EQ(size_on_disk("spool"), 0u);
+    EXPECT_EQ(iot_fflush(file), 0);
+    EXPECT_EQ(size_on_disk("spool"), 1000u);
+
+    // Filling the buffer writes it out; the remainder stays buffered
+    std::vector<unsigned char> data = pattern(1000);
+    for (int i = 0; i < 5; i++) {
+        ASSERT_EQ(iot_fwrite(data.data(), 1, data.size(), file), data.size());
+    }
+    EXPECT_EQ(size_on_disk("spool"), 5000u);
+    EXPECT_EQ(iot_fsync(file), 0);
+    EXPECT_EQ(size_on_disk("spool"), 6000u);
+
+    // Writes as large as the buffer go straight through
+    std::vector<unsigned char> large = pattern(4096);
+    ASSERT_EQ(iot_fwrite(large.data(), 1, large.size(), file), large.size());
+    EXPECT_EQ(size_on_disk("spool"), 6000u + large.size());
+
+    ASSERT_EQ(iot_fwrite("tail", 1, 4, file), 4u);
+    EXPECT_EQ(iot_fclose(file), 0);
+    EXPECT_EQ(size_on_disk("spool"), 6000u + large.size() + 4);
+}
+
+TEST_F(IotPosixFilesystemTest, BufferedReadSeekAndTruncateSeeWrites)
+{
+    struct iot_file* file = iot_fopen_buffered(path("state").c_str(), "w+", nullptr);
+    ASSERT_NE(file, nullptr);
+    ASSERT_EQ(iot_fwrite("hello world", 1, 11, file), 11u);
+
+    ASSERT_EQ(iot_fseek(file, 6), 0);
+    ASSERT_EQ(iot_fwrite("there", 1, 5, file), 5u);
+    ASSERT_EQ(iot_fseek(file, 0), 0);
+    char buf[16] = {};
+    EXPECT_EQ(iot_fread(buf, 1, sizeof(buf) - 1, file), 11u);
+    EXPECT_STREQ(buf, "hello there");
+
+    ASSERT_EQ(iot_fwrite("!", 1, 1, file), 1u);
+    ASSERT_EQ(iot_ftruncate(file, 5), 0);
+    EXPECT_EQ(size_on_disk("state"), 5u);
+
+    ASSERT_EQ(iot_fwrite("abc", 1, 3, file), 3u);
+    struct iot_fmap* map = iot_fmap(file, 0, 0, IOT_FMAP_NORMAL);
+    ASSERT_NE(map, nullptr);
+    EXPECT_EQ(iot_fmap_size(map), 15u); // Past the truncated end, so the gap reads as zeros
+    EXPECT_EQ(iot_funmap(map), 0);
+    EXPECT_EQ(iot_fclose(file), 0);
+}
+
+TEST_F(IotPosixFilesystemTest, BackgroundFlushBoundsDataAge)
+{
+    struct iot_fbuffer_config config = { 64 * 1024, 40 };
+    struct iot_file* file = iot_fopen_buffered(path("log").c_str(), "a", &config);
+    ASSERT_NE(file, nullptr);
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(iot_fwrite("line\n", 1, 5, file), 5u);
+    while (size_on_disk("log") == 0 && std::chrono::steady_clock::now() - start < std::chrono::seconds(2)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    auto age = std::chrono::steady_clock::now() - start;
+    EXPECT_EQ(size_on_disk("log"), 5u);
+    EXPECT_LT(age, std::chrono::milliseconds(500));
+    EXPECT_EQ(iot_fclose(file), 0);
+}
+
+TEST_F(IotPosixFilesystemTest, BufferedMemoryIsBounded)
+{
+    // Large buffers on several files: the process-wide limit flushes them before they fill
+    struct iot_fbuffer_config config = { 8 * 1024 * 1024, 60000 };
+    const int kFiles = 4;
+    std::vector<struct iot_file*> files;
+    for (int i = 0; i < kFiles; i++) {
+        files.push_back(iot_fopen_buffered(path("f" + std::to_string(i)).c_str(), "w", &config));
+        ASSERT_NE(files.back(), nullptr);
+    }
+    std::vector<unsigned char> record = pattern(256);
+    const size_t kPerFile = 2 * 1024 * 1024;
+    for (size_t written = 0; written < kPerFile; written += record.size()) {
+        for (auto* file : files) {
+            ASSERT_EQ(iot_fwrite(record.data(), 1, record.size(), file), record.size());
+        }
+    }
+    size_t on_disk = 0;
+    for (int i = 0; i < kFiles; i++) {
+        on_disk += size_on_disk("f" + std::to_string(i));
+    }
+    EXPECT_GE(on_disk, kFiles * kPerFile - 2 * 1024 * 1024);
+    for (auto* file : files) {
+        EXPECT_EQ(iot_fclose(file), 0);
+    }
+}
+
+TEST_F(IotPosixFilesystemTest, ConcurrentBufferedWriters)
+{
+    const int kThreads = 4;
+    const int kRecords = 5000;
+    struct iot_fbuffer_config config = { 1024, 5 };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&, t] {
+            struct iot_file* file = iot_fopen_buffered(path("t" + std::to_string(t)).c_str(), "w", &config);
+            ASSERT_NE(file, nullptr);
+            for (int i = 0; i < kRecords; i++) {
+                ASSERT_EQ(iot_fwrite("record\n", 1, 7, file), 7u);
+            }
+            EXPECT_EQ(iot_fclose(file), 0);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (int t = 0; t < kThreads; t++) {
+        EXPECT_EQ(size_on_disk("t" + std::to_string(t)), 7u * kRecords);
+    }
+}
+
+TEST_F(IotPosixFilesystemTest, FilesCloseWhileTheFlusherWrites)
+{
+    // Short intervals keep the flusher writing while other files open and close
+    const int kThreads = 4;
+    const int kRounds = 200;
+    struct iot_fbuffer_config config = { 4096, 2 };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&, t] {
+            std::string name = path("c" + std::to_string(t));
+            for (int round = 0; round < kRounds; round++) {
+                struct iot_file* file = iot_fopen_buffered(name.c_str(), "a", &config);
+                ASSERT_NE(file, nullptr);
+                for (int i = 0; i < 10; i++) {
+                    ASSERT_EQ(iot_fwrite("record\n", 1, 7, file), 7u);
+                }
+                if (round % 2 == 0) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                EXPECT_EQ(iot_fclose(file), 0);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (int t = 0; t < kThreads; t++) {
+        EXPECT_EQ(size_on_disk("c" + std::to_string(t)), 70u * kRounds);
+    }
+}
@@ -0,0 +1,286 @@
+#include "interface/os.h"
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+namespace {
+
+long elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+} // namespace
+
+TEST(IotPosixOsSyncTest, MutexExcludesThreads)
+{
+    struct iot_mutex* mutex = iot_mutex_init();
+    ASSERT_NE(mutex, nullptr);
+    // A plain counter: lost updates show up as a short total
+    uint64_t counter = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 20000; i++) {
+                iot_mutex_lock(mutex);
+                counter++;
+                iot_mutex_unlock(mutex);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(counter, 80000u);
+    iot_mutex_destroy(mutex);
+}
+
+TEST(IotPosixOsSyncTest, MutexTrylock)
+{
+    struct iot_mutex* mutex = iot_mutex_init();
+    ASSERT_NE(mutex, nullptr);
+    EXPECT_EQ(iot_mutex_trylock(mutex), 0);
+    int other = 0;
+    std::thread([&] { other = iot_mutex_trylock(mutex); }).join();
+    EXPECT_LT(other, 0);
+    EXPECT_EQ(iot_mutex_unlock(mutex), 0);
+    EXPECT_EQ(iot_mutex_trylock(mutex), 0);
+    EXPECT_EQ(iot_mutex_unlock(mutex), 0);
+    EXPECT_LT(iot_mutex_lock(nullptr), 0);
+    EXPECT_LT(iot_mutex_trylock(nullptr), 0);
+    EXPECT_LT(iot_mutex_unlock(nullptr), 0);
+    iot_mutex_destroy(mutex);
+}
+
+TEST(IotPosixOsSyncTest, RwlockAdmitsReadersTogether)
+{
+    struct iot_rwlock* rwlock = iot_rwlock_init();
+    ASSERT_NE(rwlock, nullptr);
+    std::atomic<int> inside { 0 };
+    std::atomic<int> most { 0 };
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; t++) {
+        readers.emplace_back([&] {
+            iot_rwlock_read_lock(rwlock);
+            int now = inside.fetch_add(1) + 1;
+            int seen = most.load();
+            while (now > seen && !most.compare_exchange_weak(seen, now)) {
+            }
+            // Stay until every reader is in, which a shared hold allows
+            auto start = std::chrono::steady_clock::now();
+            while (most.load() < 3 && elapsed_ms(start) < 2000) {
+                iot_thread_delay(1);
+            }
+            inside.fetch_sub(1);
+            iot_rwlock_read_unlock(rwlock);
+        });
+    }
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    EXPECT_EQ(most.load(), 3);
+    iot_rwlock_destroy(rwlock);
+}
+
+TEST(IotPosixOsSyncTest, RwlockWritersExcludeEveryone)
+{
+    struct iot_rwlock* rwlock = iot_rwlock_init();
+    ASSERT_NE(rwlock, nullptr);
+    // Writers keep both halves equal; a reader seeing them differ raced a writer
+    uint64_t first = 0;
+    uint64_t second = 0;
+    std::atomic<int> torn { 0 };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 2; t++) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 5000; i++) {
+                iot_rwlock_write_lock(rwlock);
+                first++;
+                second++;
+                iot_rwlock_write_unlock(rwlock);
+            }
+        });
+        threads.emplace_back([&] {
+            for (int i = 0; i < 5000; i++) {
+                iot_rwlock_read_lock(rwlock);
+                if (first != second) {
+                    torn.fetch_add(1);
+                }
+                iot_rwlock_read_unlock(rwlock);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(torn.load(), 0);
+    EXPECT_EQ(first, 10000u);
+    EXPECT_EQ(second, 10000u);
+    iot_rwlock_destroy(rwlock);
+}
+
+TEST(IotPosixOsSyncTest, RwlockWriterIsNotStarved)
+{
+    struct iot_rwlock* rwlock = iot_rwlock_init();
+    ASSERT_NE(rwlock, nullptr);
+    std::atomic<bool> written { false };
+    std::atomic<bool> stop { false };
+    // Overlapping readers keep the lock shared for as long as they run
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 2; t++) {
+        readers.emplace_back([&] {
+            while (!stop.load()) {
+                iot_rwlock_read_lock(rwlock);
+                iot_thread_delay(1);
+                iot_rwlock_read_unlock(rwlock);
+            }
+        });
+    }
+    iot_thread_delay(10);
+    auto start = std::chrono::steady_clock::now();
+    std::thread writer([&] {
+        iot_rwlock_write_lock(rwlock);
+        written.store(true);
+        iot_rwlock_write_unlock(rwlock);
+    });
+    writer.join();
+    long waited = elapsed_ms(start);
+    stop.store(true);
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    EXPECT_TRUE(written.load());
+    EXPECT_LT(waited, 1000);
+    iot_rwlock_destroy(rwlock);
+}
+
+TEST(IotPosixOsSyncTest, CondSignalWakesWaiter)
+{
+    struct iot_mutex* mutex = iot_mutex_init();
+    struct iot_cond* cond = iot_cond_init();
+    ASSERT_NE(mutex, nullptr);
+    ASSERT_NE(cond, nullptr);
+    bool ready = false;
+    int result = -1;
+    std::thread waiter([&] {
+        iot_mutex_lock(mutex);
+        while (!ready) {
+            result = iot_cond_wait(cond, mutex, IOT_WAIT_FOREVER);
+        }
+        iot_mutex_unlock(mutex);
+    });
+    iot_thread_delay(10);
+    iot_mutex_lock(mutex);
+    ready = true;
+    EXPECT_EQ(iot_cond_signal(cond), 0);
+    iot_mutex_unlock(mutex);
+    waiter.join();
+    EXPECT_EQ(result, 0);
+    iot_cond_destroy(cond);
+    iot_mutex_destroy(mutex);
+}
+
+TEST(IotPosixOsSyncTest, CondBroadcastWakesAll)
+{
+    struct iot_mutex* mutex = iot_mutex_init();
+    struct iot_cond* cond = iot_cond_init();
+    ASSERT_NE(mutex, nullptr);
+    ASSERT_NE(cond, nullptr);
+    bool ready = false;
+    int woken = 0;
+    std::vector<std::thread> waiters;
+    for (int t = 0; t < 4; t++) {
+        waiters.emplace_back([&] {
+            iot_mutex_lock(mutex);
+            while (!ready) {
+                iot_cond_wait(cond, mutex, IOT_WAIT_FOREVER);
+            }
+            woken++;
+            iot_mutex_unlock(mutex);
+        });
+    }
+    iot_thread_delay(10);
+    iot_mutex_lock(mutex);
+    ready = true;
+    EXPECT_EQ(iot_cond_broadcast(cond), 0);
+    iot_mutex_unlock(mutex);
+    for (auto& waiter : waiters) {
+        waiter.join();
+    }
+    EXPECT_EQ(woken, 4);
+    iot_cond_destroy(cond);
+    iot_mutex_destroy(mutex);
+}
+
+TEST(IotPosixOsSyncTest, CondWaitTimesOut)
+{
+    struct iot_mutex* mutex = iot_mutex_init();
+    struct iot_cond* cond = iot_cond_init();
+    ASSERT_NE(mutex, nullptr);
+    ASSERT_NE(cond, nullptr);
+    iot_mutex_lock(mutex);
+    auto start = std::chrono::steady_clock::now();
+    int result = iot_cond_wait(cond, mutex, 30);
+    long waited = elapsed_ms(start);
+    // The mutex is held again on return
+    EXPECT_LT(iot_mutex_trylock(mutex), 0);
+    iot_mutex_unlock(mutex);
+    EXPECT_EQ(result, IOT_THREAD_TIMEOUT);
+    EXPECT_GE(waited, 25);
+    EXPECT_LT(iot_cond_wait(nullptr, mutex, 0), 0);
+    EXPECT_LT(iot_cond_signal(nullptr), 0);
+    iot_cond_destroy(cond);
+    iot_mutex_destroy(mutex);
+}
+
+TEST(IotPosixOsSyncTest, SemaphoreCounts)
+{
+    struct iot_sem* sem = iot_sem_init(2);
+    ASSERT_NE(sem, nullptr);
+    EXPECT_EQ(iot_sem_wait(sem, 0), 0);
+    EXPECT_EQ(iot_sem_wait(sem, 0), 0);
+    EXPECT_EQ(iot_sem_wait(sem, 0), IOT_THREAD_TIMEOUT);
+
+    // Every post is taken exactly once across the consumers
+    std::atomic<int> taken { 0 };
+    std::vector<std::thread> consumers;
+    for (int t = 0; t < 3; t++) {
+        consumers.emplace_back([&] {
+            for (int i = 0; i < 1000; i++) {
+                ASSERT_EQ(iot_sem_wait(sem, IOT_WAIT_FOREVER), 0);
+                taken.fetch_add(1);
+            }
+        });
+    }
+    for (int i = 0; i < 3000; i++) {
+        ASSERT_EQ(iot_sem_post(sem), 0);
+    }
+    for (auto& consumer : consumers) {
+        consumer.join();
+    }
+    EXPECT_EQ(taken.load(), 3000);
+    EXPECT_EQ(iot_sem_wait(sem, 0), IOT_THREAD_TIMEOUT);
+    iot_sem_destroy(sem);
+}
+
+TEST(IotPosixOsSyncTest, SemaphoreTimesOutAndRefusesOverflow)
+{
+    struct iot_sem* sem = iot_sem_init(0);
+    ASSERT_NE(sem, nullptr);
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(iot_sem_wait(sem, 30), IOT_THREAD_TIMEOUT);
+    EXPECT_GE(elapsed_ms(start), 25);
+    iot_sem_destroy(sem);
+
+    sem = iot_sem_init(UINT_MAX);
+    ASSERT_NE(sem, nullptr);
+    EXPECT_LT(iot_sem_post(sem), 0);
+    EXPECT_EQ(iot_sem_wait(sem, 0), 0);
+    EXPECT_EQ(iot_sem_post(sem), 0);
+    EXPECT_LT(iot_sem_wait(nullptr, 0), 0);
+    EXPECT_LT(iot_sem_post(nullptr), 0);
+    iot_sem_destroy(sem);
+}
@@ -0,0 +1,598 @@
+#include "interface/os.h"
+#include "system/pool.h"
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <pthread.h>
+#include <sched.h>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Counter {
+    std::atomic<bool> stop { false };
+    std::atomic<uint64_t> ticks { 0 };
+};
+
+// The zero-length sleep is a syscall, where sanitizers deliver the suspend signal
+void count_until_stopped(void* arg)
+{
+    Counter* counter = static_cast<Counter*>(arg);
+    while (!counter->stop.load()) {
+        counter->ticks.fetch_add(1);
+        iot_thread_delay(0);
+    }
+}
+
+// Blocks in a cancellation point until deleted
+void sleep_forever(void* arg)
+{
+    static_cast<std::atomic<bool>*>(arg)->store(true);
+    for (;;) {
+        iot_thread_delay(1000);
+    }
+}
+
+struct SelfDelete {
+    struct iot_thread* thread = nullptr;
+    std::atomic<bool> ready { false };
+    std::atomic<bool> done { false };
+};
+
+void delete_self(void* arg)
+{
+    SelfDelete* self = static_cast<SelfDelete*>(arg);
+    while (!self->ready.load()) {
+    }
+    // self lives on the test's stack, so nothing may touch it after done
+    struct iot_thread* thread = self->thread;
+    self->done.store(true);
+    iot_thread_delete(thread);
+}
+
+const uint32_t kGo = 0x80000000u;
+
+struct Receiver {
+    std::vector<uint32_t> events;
+    size_t expected = 0;
+    std::atomic<bool> waiting { false };
+};
+
+// Waits for kGo, then receives expected events
+void receive(void* arg)
+{
+    Receiver* receiver = static_cast<Receiver*>(arg);
+    receiver->waiting.store(true);
+    ASSERT_EQ(iot_thread_wait_flags(kGo, 0, nullptr, IOT_WAIT_FOREVER), 0);
+    uint32_t event;
+    while (receiver->events.size() < receiver->expected && iot_thread_wait_event(&event, IOT_WAIT_FOREVER) == 0) {
+        receiver->events.push_back(event);
+    }
+}
+
+struct Timeouts {
+    int event_poll = 0;
+    int event_timed = 0;
+    int flags_timed = 0;
+    long elapsed_ms = 0;
+};
+
+void time_out(void* arg)
+{
+    Timeouts* timeouts = static_cast<Timeouts*>(arg);
+    uint32_t event;
+    timeouts->event_poll = iot_thread_wait_event(&event, 0);
+    auto start = std::chrono::steady_clock::now();
+    timeouts->event_timed = iot_thread_wait_event(&event, 30);
+    timeouts->flags_timed = iot_thread_wait_flags(0x1, 0, nullptr, 30);
+    timeouts->elapsed_ms = static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+struct FlagSteps {
+    uint32_t seen[4] = {};
+    int results[4] = {};
+    std::atomic<int> step { 0 };
+};
+
+void wait_flag_steps(void* arg)
+{
+    FlagSteps* steps = static_cast<FlagSteps*>(arg);
+    // Any bit, cleared
+    steps->results[0] = iot_thread_wait_flags(0x3, 0, &steps->seen[0], IOT_WAIT_FOREVER);
+    steps->step.store(1);
+    // All bits, one of which arrives later
+    steps->results[1] = iot_thread_wait_flags(0x6, IOT_FLAGS_WAIT_ALL, &steps->seen[1], IOT_WAIT_FOREVER);
+    steps->step.store(2);
+    // Left set, so the next wait sees it again
+    steps->results[2] = iot_thread_wait_flags(0x8, IOT_FLAGS_NO_CLEAR, &steps->seen[2], IOT_WAIT_FOREVER);
+    steps->results[3] = iot_thread_wait_flags(0x8, 0, &steps->seen[3], 0);
+    steps->step.store(3);
+}
+
+struct Sum {
+    uint64_t expected = 0;
+    uint64_t total = 0;
+    uint64_t count = 0;
+};
+
+void sum_events(void* arg)
+{
+    Sum* sum = static_cast<Sum*>(arg);
+    uint32_t event;
+    while (sum->count < sum->expected && iot_thread_wait_event(&event, IOT_WAIT_FOREVER) == 0) {
+        sum->total += event;
+        sum->count++;
+    }
+}
+
+struct Waiter {
+    std::atomic<bool> started { false };
+    uint32_t event = 0;
+};
+
+// The event lives off the stack: cancellation skips the frame's epilogue, which ASan relies on
+void wait_forever(void* arg)
+{
+    Waiter* waiter = static_cast<Waiter*>(arg);
+    waiter->started.store(true);
+    iot_thread_wait_event(&waiter->event, IOT_WAIT_FOREVER);
+}
+
+std::atomic<struct iot_thread*> signal_target { nullptr };
+
+void post_from_signal(int)
+{
+    iot_thread_post(signal_target.load(), 42);
+    iot_thread_set_flags(signal_target.load(), kGo);
+}
+
+} // namespace
+
+TEST(IotPosixOsTest, SuspendStopsTheThreadUntilResumed)
+{
+    Counter counter;
+    struct iot_thread* thread = iot_thread_create("counter", count_until_stopped, &counter, 0, 0, 0);
+    ASSERT_NE(thread, nullptr);
+    while (counter.ticks.load() == 0) {
+    }
+
+    for (int round = 0; round < 3; round++) {
+        ASSERT_EQ(iot_thread_suspend(thread), 0);
+        EXPECT_EQ(iot_thread_suspend(thread), 0);
+        uint64_t parked = counter.ticks.load();
+        iot_thread_delay(20);
+        EXPECT_EQ(counter.ticks.load(), parked);
+
+        ASSERT_EQ(iot_thread_resume(thread), 0);
+        EXPECT_EQ(iot_thread_resume(thread), 0);
+        while (counter.ticks.load() == parked) {
+        }
+    }
+
+    counter.stop.store(true);
+    EXPECT_EQ(iot_thread_join(thread, nullptr), 0);
+}
+
+TEST(IotPosixOsTest, DeleteCancelsRunningAndSuspendedThreads)
+{
+    std::atomic<bool> started { false };
+    struct iot_thread* thread = iot_thread_create("sleeper", sleep_forever, &started, 0, 0, 0);
+    ASSERT_NE(thread, nullptr);
+    while (!started.load()) {
+    }
+    EXPECT_EQ(iot_thread_delete(thread), 0);
+
+    started.store(false);
+    thread = iot_thread_create("sleeper", sleep_forever, &started, 0, 0, 0);
+    ASSERT_NE(thread, nullptr);
+    while (!started.load()) {
+    }
+    ASSERT_EQ(iot_thread_suspend(thread), 0);
+    EXPECT_EQ(iot_thread_delete(thread), 0);
+    EXPECT_LT(iot_thread_delete(nullptr), 0);
+}
+
+TEST(IotPosixOsTest, ThreadsCanDeleteThemselves)
+{
+    SelfDelete self;
+    self.thread = iot_thread_create("self", delete_self, &self, 0, 0, 0);
+    ASSERT_NE(self.thread, nullptr);
+    self.ready.store(true);
+    while (!self.done.load()) {
+    }
+    // Leave the thread time to exit before the test ends
+    iot_thread_delay(10);
+}
+
+TEST(IotPosixOsTest, PriorityIsKept)
+{
+    Counter counter;
+    struct iot_thread* thread = iot_thread_create("prio", count_until_stopped, &counter, 5, 0, 0);
+    ASSERT_NE(thread, nullptr);
+    uint32_t priority = 0;
+    ASSERT_EQ(iot_thread_get_priority(thread, &priority), 0);
+    EXPECT_EQ(priority, 5u);
+    ASSERT_EQ(iot_thread_set_priority(thread, 9), 0);
+    ASSERT_EQ(iot_thread_get_priority(thread, &priority), 0);
+    EXPECT_EQ(priority, 9u);
+    EXPECT_LT(iot_thread_get_priority(thread, nullptr), 0);
+    EXPECT_LT(iot_thread_set_priority(nullptr, 1), 0);
+    EXPECT_LT(iot_thread_suspend(nullptr), 0);
+    EXPECT_LT(iot_thread_resume(nullptr), 0);
+
+    counter.stop.store(true);
+    EXPECT_EQ(iot_thread_join(thread, nullptr), 0);
+}
+
+TEST(IotPosixOsTest, MailboxKeepsOrderAndRejectsWhenFull)
+{
+    Receiver receiver;
+    receiver.expected = 8;
+    // 5 rounds up to 8 slots
+    struct iot_thread* thread = iot_thread_create("receiver", receive, &receiver, 0, 0, 5);
+    ASSERT_NE(thread, nullptr);
+    while (!receiver.waiting.load()) {
+    }
+    for (uint32_t i = 1; i <= 8; i++) {
+        ASSERT_EQ(iot_thread_post(thread, i), 0);
+    }
+    EXPECT_LT(iot_thread_post(thread, 9), 0);
+    ASSERT_EQ(iot_thread_set_flags(thread, kGo), 0);
+    ASSERT_EQ(iot_thread_join(thread, nullptr), 0);
+    EXPECT_EQ(receiver.events, (std::vector<uint32_t> { 1, 2, 3, 4, 5, 6, 7, 8 }));
+}
+
+TEST(IotPosixOsTest, WaitsTimeOut)
+{
+    Timeouts timeouts;
+    struct iot_thread* thread = iot_thread_create("timeouts", time_out, &timeouts, 0, 0, 4);
+    ASSERT_NE(thread, nullptr);
+    ASSERT_EQ(iot_thread_join(thread, nullptr), 0);
+    EXPECT_EQ(timeouts.event_poll, IOT_THREAD_TIMEOUT);
+    EXPECT_EQ(timeouts.event_timed, IOT_THREAD_TIMEOUT);
+    EXPECT_EQ(timeouts.flags_timed, IOT_THREAD_TIMEOUT);
+    EXPECT_GE(timeouts.elapsed_ms, 60);
+}
+
+TEST(IotPosixOsTest, FlagsWaitForAnyOrAll)
+{
+    FlagSteps steps;
+    struct iot_thread* thread = iot_thread_create("flags", wait_flag_steps, &steps, 0, 0, 0);
+    ASSERT_NE(thread, nullptr);
+    ASSERT_EQ(iot_thread_set_flags(thread, 0x1 | 0x10), 0);
+    while (steps.step.load() < 1) {
+    }
+    ASSERT_EQ(iot_thread_set_flags(thread, 0x2), 0);
+    iot_thread_delay(10);
+    EXPECT_EQ(steps.step.load(), 1);
+    ASSERT_EQ(iot_thread_set_flags(thread, 0x4 | 0x8), 0);
+    ASSERT_EQ(iot_thread_join(thread, nullptr), 0);
+
+    for (int result : steps.results) {
+        EXPECT_EQ(result, 0);
+    }
+    EXPECT_EQ(steps.seen[0], 0x11u);
+    EXPECT_EQ(steps.seen[1], 0x1eu);
+    EXPECT_EQ(steps.seen[2], 0x18u);
+    EXPECT_EQ(steps.seen[3], 0x18u);
+}
+
+TEST(IotPosixOsTest, ConcurrentPostersLoseNothing)
+{
+    const int kPosters = 4;
+    const uint32_t kEach = 20000;
+    Sum sum;
+    sum.expected = kPosters * kEach;
+    struct iot_thread* thread = iot_thread_create("sum", sum_events, &sum, 0, 0, 64);
+    ASSERT_NE(thread, nullptr);
+    std::vector<std::thread> posters;
+    for (int p = 0; p < kPosters; p++) {
+        posters.emplace_back([thread, kEach] {
+            for (uint32_t i = 1; i <= kEach; i++) {
+                while (iot_thread_post(thread, i) != 0) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& poster : posters) {
+        poster.join();
+    }
+    ASSERT_EQ(iot_thread_join(thread, nullptr), 0);
+    EXPECT_EQ(sum.count, sum.expected);
+    EXPECT_EQ(sum.total, static_cast<uint64_t>(kPosters) * kEach * (kEach + 1) / 2);
+}
+
+TEST(IotPosixOsTest, SignalHandlersCanPost)
+{
+    Receiver receiver;
+    receiver.expected = 1;
+    struct iot_thread* thread = iot_thread_create("receiver", receive, &receiver, 0, 0, 4);
+    ASSERT_NE(thread, nullptr);
+    signal_target.store(thread);
+    auto previous = std::signal(SIGUSR1, post_from_signal);
+    std::raise(SIGUSR1);
+    std::signal(SIGUSR1, previous);
+    ASSERT_EQ(iot_thread_join(thread, nullptr), 0);
+    EXPECT_EQ(receiver.events, (std::vector<uint32_t> { 42 }));
+}
+
+TEST(IotPosixOsTest, EventsNeedAMailbox)
+{
+    uint32_t event;
+    EXPECT_EQ(iot_thread_self(), nullptr);
+    EXPECT_LT(iot_thread_wait_event(&event, 0), 0);
+    EXPECT_LT(iot_thread_wait_flags(0x1, 0, nullptr, 0), 0);
+    EXPECT_LT(iot_thread_post(nullptr, 1), 0);
+    EXPECT_LT(iot_thread_set_flags(nullptr, 1), 0);
+
+    Waiter waiter;
+    struct iot_thread* thread = iot_thread_create("no_events", wait_forever, &waiter, 0, 0, 0);
+    ASSERT_NE(thread, nullptr);
+    EXPECT_LT(iot_thread_post(thread, 1), 0);
+    // Its wait fails at once instead of blocking
+    EXPECT_EQ(iot_thread_join(thread, nullptr), 0);
+    EXPECT_TRUE(waiter.started.load());
+}
+
+namespace {
+
+// Blocks handed out and not back in the pool's shared lists
+size_t pool_outstanding()
+{
+    struct iot_pool_stats stats;
+    iot_pool_get_stats(&stats);
+    return stats.total_blocks - stats.free_blocks;
+}
+
+// Leaves freed blocks of every class in the calling thread's pool cache
+void fill_pool_cache()
+{
+    std::vector<void*> blocks;
+    for (size_t size = 16; size <= IOT_POOL_MAX_BLOCK; size += 16) {
+        blocks.push_back(iot_pool_alloc(size));
+    }
+    for (void* block : blocks) {
+        iot_pool_free(block);
+    }
+}
+
+// Fills its pool cache, then sleeps or deletes itself. Nothing with a
+// destructor lives in this frame, which the thread is cancelled through
+void cache_blocks(void* arg)
+{
+    SelfDelete* self = static_cast<SelfDelete*>(arg);
+    fill_pool_cache();
+    while (!self->ready.load()) {
+        iot_thread_delay(1);
+    }
+    struct iot_thread* thread = self->thread;
+    self->done.store(true);
+    if (thread != nullptr) {
+        iot_thread_delete(thread);
+    }
+    for (;;) {
+        iot_thread_delay(1000);
+    }
+}
+
+} // namespace
+
+TEST(IotPosixOsTest, DeletedThreadsReturnTheirPoolBlocks)
+{
+    iot_pool_thread_flush();
+    size_t before = pool_outstanding();
+
+    // Cancelled by another thread
+    SelfDelete cancelled;
+    struct iot_thread* thread = iot_thread_create("cache", cache_blocks, &cancelled, 0, 0, 0);
+    ASSERT_NE(thread, nullptr);
+    cancelled.ready.store(true);
+    while (!cancelled.done.load()) {
+    }
+    EXPECT_EQ(iot_thread_delete(thread), 0);
+    EXPECT_EQ(pool_outstanding(), before);
+
+    // Deleting itself; the detached thread flushes before it is gone
+    SelfDelete self;
+    self.thread = iot_thread_create("cache", cache_blocks, &self, 0, 0, 0);
+    ASSERT_NE(self.thread, nullptr);
+    self.ready.store(true);
+    while (!self.done.load()) {
+    }
+    for (int i = 0; i < 1000 && pool_outstanding() != before; i++) {
+        iot_thread_delay(1);
+    }
+    EXPECT_EQ(pool_outstanding(), before);
+}
+
+TEST(IotPosixOsTest, DeleteWakesAWaitingThread)
+{
+    Waiter waiter;
+    struct iot_thread* thread = iot_thread_create("waiter", wait_forever, &waiter, 0, 0, 4);
+    ASSERT_NE(thread, nullptr);
+    while (!waiter.started.load()) {
+    }
+    iot_thread_delay(10);
+    EXPECT_EQ(iot_thread_delete(thread), 0);
+}
+
+namespace {
+
+struct Placement {
+    int cpu = -1;
+    uint64_t mask = 0;
+    char name[16] = {};
+    int policy = -1;
+    uintptr_t local = 0;
+};
+
+void record_placement(void* arg)
+{
+    Placement* placement = static_cast<Placement*>(arg);
+    int local = 0;
+    placement->local = reinterpret_cast<uintptr_t>(&local);
+    placement->cpu = iot_cpu_current();
+    iot_thread_get_affinity(nullptr, &placement->mask);
+#if defined(__linux__) || defined(__APPLE__)
+    pthread_getname_np(pthread_self(), placement->name, sizeof(placement->name));
+#endif
+    struct sched_param param;
+    pthread_getschedparam(pthread_self(), &placement->policy, &param);
+}
+
+// The lowest CPU the test itself may run on
+uint64_t first_usable_cpu()
+{
+    uint64_t mask = 0;
+    EXPECT_EQ(iot_thread_get_affinity(nullptr, &mask), 0);
+    return mask & (~mask + 1);
+}
+
+// Systems without affinity accept only the empty mask
+bool affinity_supported()
+{
+    uint64_t mask = 0;
+    return iot_thread_get_affinity(nullptr, &mask) == 0 && iot_thread_set_affinity(nullptr, mask) == 0;
+}
+
+} // namespace
+
+TEST(IotPosixOsTest, PinnedThreadRunsOnItsCpu)
+{
+    if (!affinity_supported()) {
+        GTEST_SKIP();
+    }
+    uint64_t cpu_bit = first_usable_cpu();
+    ASSERT_NE(cpu_bit, 0u);
+    Placement placement;
+    struct iot_thread_attr attr;
+    iot_thread_attr_init(&attr);
+    attr.name = "a-rather-long-thread-name";
+    attr.cpu_mask = cpu_bit;
+    struct iot_thread* thread = iot_thread_create_ex(record_placement, &placement, &attr);
+    ASSERT_NE(thread, nullptr);
+    ASSERT_EQ(iot_thread_join(thread, nullptr), 0);
+    EXPECT_EQ(placement.mask, cpu_bit);
+    EXPECT_EQ(uint64_t { 1 } << placement.cpu, cpu_bit);
+#if defined(__linux__) || defined(__APPLE__)
+    EXPECT_STREQ(placement.name, "a-rather-long-t");
+#endif
+    EXPECT_EQ(placement.policy, SCHED_OTHER);
+}
+
+TEST(IotPosixOsTest, AffinityChangesWhileRunning)
+{
+    if (!affinity_supported()) {
+        GTEST_SKIP();
+    }
+    Counter counter;
+    struct iot_thread* thread = iot_thread_create("pin", count_until_stopped, &counter, 0, 0, 0);
+    ASSERT_NE(thread, nullptr);
+    uint64_t all = 0;
+    ASSERT_EQ(iot_thread_get_affinity(thread, &all), 0);
+    uint64_t cpu_bit = first_usable_cpu();
+    uint64_t mask = 0;
+    ASSERT_EQ(iot_thread_set_affinity(thread, cpu_bit), 0);
+    ASSERT_EQ(iot_thread_get_affinity(thread, &mask), 0);
+    EXPECT_EQ(mask, cpu_bit);
+    ASSERT_EQ(iot_thread_set_affinity(thread, 0), 0);
+    ASSERT_EQ(iot_thread_get_affinity(thread, &mask), 0);
+    EXPECT_EQ(mask, all);
+    if (iot_cpu_count() < 64) {
+        // No such CPU
+        EXPECT_LT(iot_thread_set_affinity(thread, uint64_t { 1 } << 63), 0);
+    }
+    EXPECT_LT(iot_thread_get_affinity(thread, nullptr), 0);
+
+    counter.stop.store(true);
+    EXPECT_EQ(iot_thread_join(thread, nullptr), 0);
+}
+
+TEST(IotPosixOsTest, ThreadRunsOnTheCallersStack)
+{
+    // Roomy enough for the sanitizers' per-thread state
+    const size_t size = 2 * 1024 * 1024;
+    std::vector<unsigned char> stack(size + 4096);
+    // Stacks are page-aligned on some systems
+    uintptr_t base = (reinterpret_cast<uintptr_t>(stack.data()) + 4095) & ~uintptr_t { 4095 };
+    Placement placement;
+    struct iot_thread_attr attr;
+    iot_thread_attr_init(&attr);
+    attr.stack = reinterpret_cast<void*>(base);
+    attr.stack_size = size;
+    struct iot_thread* thread = iot_thread_create_ex(record_placement, &placement, &attr);
+    ASSERT_NE(thread, nullptr);
+    ASSERT_EQ(iot_thread_join(thread, nullptr), 0);
+    EXPECT_GE(placement.local, base);
+    EXPECT_LT(placement.local, base + size);
+}
+
+TEST(IotPosixOsTest, BadAttributesAreRefused)
+{
+    Placement placement;
+    struct iot_thread_attr attr;
+    iot_thread_attr_init(&attr);
+    attr.sched = static_cast<enum iot_thread_sched>(7);
+    EXPECT_EQ(iot_thread_create_ex(record_placement, &placement, &attr), nullptr);
+
+    unsigned char small[64];
+    iot_thread_attr_init(&attr);
+    attr.stack = small;
+    attr.stack_size = sizeof(small);
+    EXPECT_EQ(iot_thread_create_ex(record_placement, &placement, &attr), nullptr);
+
+    iot_thread_attr_init(&attr);
+    EXPECT_EQ(iot_thread_create_ex(nullptr, &placement, &attr), nullptr);
+
+    // NULL attributes are the defaults
+    struct iot_thread* thread = iot_thread_create_ex(record_placement, &placement, nullptr);
+    ASSERT_NE(thread, nullptr);
+    EXPECT_EQ(iot_thread_join(thread, nullptr), 0);
+}
+
+TEST(IotPosixOsTest, RealTimeClassIsAppliedOrRefused)
+{
+    for (enum iot_thread_sched sched : { IOT_THREAD_SCHED_FIFO, IOT_THREAD_SCHED_RR }) {
+        Placement placement;
+        struct iot_thread_attr attr;
+        iot_thread_attr_init(&attr);
+        attr.sched = sched;
+        attr.priority = 10;
+        struct iot_thread* thread = iot_thread_create_ex(record_placement, &placement, &attr);
+        if (thread == nullptr) {
+            // Without CAP_SYS_NICE or an RLIMIT_RTPRIO allowance
+            continue;
+        }
+        uint32_t priority = 0;
+        EXPECT_EQ(iot_thread_get_priority(thread, &priority), 0);
+        EXPECT_EQ(priority, 10u);
+        ASSERT_EQ(iot_thread_join(thread, nullptr), 0);
+        EXPECT_EQ(placement.policy, sched == IOT_THREAD_SCHED_FIFO ? SCHED_FIFO : SCHED_RR);
+    }
+}
+
+TEST(IotPosixOsTest, TopologyListsTheOnlineCpus)
+{
+    int count = iot_cpu_count();
+    ASSERT_GE(count, 1);
+    EXPECT_EQ(iot_cpu_topology(nullptr, 0), count);
+    EXPECT_LT(iot_cpu_topology(nullptr, 1), 0);
+    std::vector<struct iot_cpu_info> cpus(static_cast<size_t>(count));
+    ASSERT_EQ(iot_cpu_topology(cpus.data(), cpus.size()), count);
+    for (size_t i = 1; i < cpus.size(); i++) {
+        EXPECT_GT(cpus[i].cpu, cpus[i - 1].cpu);
+    }
+    int current = iot_cpu_current();
+    if (current < 0) {
+        // Not every system says
+        return;
+    }
+    bool listed = false;
+    for (const auto& info : cpus) {
+        listed = listed || info.cpu == static_cast<uint32_t>(current);
+    }
+    EXPECT_TRUE(listed);
+}
@@ -0,0 +1,369 @@
+#include "interface/transport.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// A loopback TCP listener used as the remote end of the transport
+struct Listener {
+    int fd = -1;
+    int port = 0;
+
+    int queued[4] = { -1, -1, -1, -1 };
+
+    ~Listener()
+    {
+        for (int c : queued) {
+            if (c >= 0) {
+                close(c);
+            }
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    // Listen on the loopback address of a family; port 0 picks a free one
+    bool open(int family, int wanted_port, int backlog)
+    {
+        fd = socket(family, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return false;
+        }
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        sockaddr_storage addr {};
+        socklen_t length;
+        if (family == AF_INET6) {
+            setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on));
+            auto* a6 = reinterpret_cast<sockaddr_in6*>(&addr);
+            a6->sin6_family = AF_INET6;
+            a6->sin6_addr = in6addr_loopback;
+            a6->sin6_port = htons(static_cast<uint16_t>(wanted_port));
+            length = sizeof(sockaddr_in6);
+        } else {
+            auto* a4 = reinterpret_cast<sockaddr_in*>(&addr);
+            a4->sin_family = AF_INET;
+            a4->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            a4->sin_port = htons(static_cast<uint16_t>(wanted_port));
+            length = sizeof(sockaddr_in);
+        }
+        if (bind(fd, reinterpret_cast<sockaddr*>(&addr), length) != 0 || listen(fd, backlog) != 0) {
+            return false;
+        }
+        getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &length);
+        port = ntohs(family == AF_INET6 ? reinterpret_cast<sockaddr_in6*>(&addr)->sin6_port
+                                        : reinterpret_cast<sockaddr_in*>(&addr)->sin_port);
+        return true;
+    }
+
+    // Fill the accept queue so further SYNs are dropped, like an unreachable host
+    void blackhole(int family)
+    {
+        for (int i = 0; i < 4; i++) {
+            int c = socket(family, SOCK_STREAM, 0);
+            fcntl(c, F_SETFL, O_NONBLOCK);
+            sockaddr_storage addr {};
+            socklen_t length = sizeof(addr);
+            getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &length);
+            connect(c, reinterpret_cast<sockaddr*>(&addr), length);
+            queued[i] = c;
+        }
+        usleep(20000);
+    }
+
+    int accept_one()
+    {
+        return accept(fd, nullptr, nullptr);
+    }
+
+    std::string port_string() const { return std::to_string(port); }
+};
+
+double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+iot_transport_config fast_config()
+{
+    iot_transport_config config;
+    iot_transport_config_default(&config);
+    config.connect_timeout_ms = 2000;
+    config.attempt_delay_ms = 100;
+    return config;
+}
+
+// Listen on the same port on ::1 and 127.0.0.1
+bool open_dual_stack(Listener& v6, Listener& v4, int v6_backlog)
+{
+    for (int attempt = 0; attempt < 20; attempt++) {
+        Listener six;
+        if (!six.open(AF_INET6, 0, v6_backlog)) {
+            return false;
+        }
+        Listener four;
+        if (four.open(AF_INET, six.port, 16)) {
+            std::swap(v6.fd, six.fd);
+            v6.port = six.port;
+            std::swap(v4.fd, four.fd);
+            v4.port = four.port;
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+// Test a connection carrying data both ways
+TEST(IotPosixTransportTest, SendReceiveLoopback)
+{
+    Listener server;
+    ASSERT_TRUE(server.open(AF_INET, 0, 16));
+
+    void* ctx = nullptr;
+    ASSERT_EQ(iot_transport_open(&ctx, "127.0.0.1", server.port_string().c_str()), 0);
+    int peer = server.accept_one();
+    ASSERT_GE(peer, 0);
+
+    const unsigned char hello[] = "hello";
+    EXPECT_EQ(iot_transport_send(ctx, hello, sizeof(hello)), (int)sizeof(hello));
+    char buffer[16] = { 0 };
+    EXPECT_EQ(recv(peer, buffer, sizeof(buffer), 0), (ssize_t)sizeof(hello));
+    EXPECT_STREQ(buffer, "hello");
+
+    ASSERT_EQ(send(peer, "pong", 4, 0), 4);
+    unsigned char reply[16];
+    EXPECT_EQ(iot_transport_recv(ctx, reply, sizeof(reply)), 4);
+
+    close(peer);
+    EXPECT_EQ(iot_transport_recv(ctx, reply, sizeof(reply)), 0); // Peer closed
+    iot_transport_close(ctx);
+}
+
+// Read from a socket until it closes
+static std::string drain(int fd)
+{
+    std::string out;
+    char buffer[65536];
+    ssize_t n;
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        out.append(buffer, (size_t)n);
+    }
+    return out;
+}
+
+// Test that vectored sends deliver the buffers back to back
+TEST(IotPosixTransportTest, SendVectors)
+{
+    Listener server;
+    ASSERT_TRUE(server.open(AF_INET, 0, 16));
+    void* ctx = nullptr;
+    ASSERT_EQ(iot_transport_open(&ctx, "127.0.0.1", server.port_string().c_str()), 0);
+    int peer = server.accept_one();
+    ASSERT_GE(peer, 0);
+
+    // More vectors than one sendmsg call takes, including empty ones
+    std::vector<std::string> parts;
+    std::vector<iot_transport_iovec> iov;
+    std::string expected;
+    for (int i = 0; i < 40; i++) {
+        parts.push_back(i % 7 == 3 ? "" : "part" + std::to_string(i) + ";");
+    }
+    for (const std::string& part : parts) {
+        iov.push_back({ part.data(), part.size() });
+        expected += part;
+    }
+    EXPECT_EQ(iot_transport_sendv(ctx, iov.data(), iov.size()), (int)expected.size());
+    EXPECT_EQ(iot_transport_sendv(ctx, nullptr, 0), 0);
+    iot_transport_iovec bad = { nullptr, 4 };
+    EXPECT_EQ(iot_transport_sendv(ctx, &bad, 1), -1);
+    EXPECT_EQ(iot_transport_sendv(nullptr, iov.data(), 1), -1);
+    iot_transport_close(ctx);
+    EXPECT_EQ(drain(peer), expected);
+    close(peer);
+}
+
+// Test that large sends arrive intact with zero-copy enabled (or its fallback)
+TEST(IotPosixTransportTest, ZeroCopySend)
+{
+    Listener server;
+    ASSERT_TRUE(server.open(AF_INET, 0, 16));
+    iot_transport_config config;
+    iot_transport_config_default(&config);
+    config.zerocopy_threshold = 16384;
+    void* ctx = nullptr;
+    ASSERT_EQ(iot_transport_open_with(&ctx, "127.0.0.1", server.port_string().c_str(), &config), 0);
+    int peer = server.accept_one();
+    ASSERT_GE(peer, 0);
+
+    std::string received;
+    std::thread reader([&] { received = drain(peer); });
+    std::string header = "HDR:";
+    std::vector<unsigned char> payload(1 << 20);
+    for (size_t i = 0; i < payload.size(); i++) {
+        payload[i] = (unsigned char)(i * 131 + (i >> 12));
+    }
+    iot_transport_iovec iov[2] = { { header.data(), header.size() }, { payload.data(), payload.size() } };
+    for (int round = 0; round < 3; round++) {
+        EXPECT_EQ(iot_transport_sendv(ctx, iov, 2), (int)(header.size() + payload.size()));
+        payload[round] ^= 0xFF; // Safe to modify once sendv has returned
+    }
+    iot_transport_close(ctx);
+    reader.join();
+    close(peer);
+
+    ASSERT_EQ(received.size(), 3 * (header.size() + payload.size()));
+    for (int round = 0; round < 3; round++) {
+        size_t at = round * (header.size() + payload.size());
+        EXPECT_EQ(received.compare(at, header.size(), header), 0);
+        EXPECT_EQ((unsigned char)received[at + header.size() + round], (unsigned char)(payload[round] ^ 0xFF));
+        EXPECT_EQ(received.compare(at + header.size() + 100, 1000,
+                      std::string(payload.begin() + 100, payload.begin() + 1100)),
+            0);
+    }
+}
+
+// Test that a silent peer makes recv time out instead of blocking
+TEST(IotPosixTransportTest, ReceiveTimeout)
+{
+    Listener server;
+    ASSERT_TRUE(server.open(AF_INET, 0, 16));
+    iot_transport_config config = fast_config();
+    config.recv_timeout_ms = 50;
+
+    void* ctx = nullptr;
+    ASSERT_EQ(iot_transport_open_with(&ctx, "127.0.0.1", server.port_string().c_str(), &config), 0);
+    unsigned char buffer[4];
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(iot_transport_recv(ctx, buffer, sizeof(buffer)), IOT_TRANSPORT_TIMEOUT);
+    EXPECT_GE(elapsed_ms(start), 40.0);
+    EXPECT_LT(elapsed_ms(start), 1000.0);
+    iot_transport_close(ctx);
+}
+
+// Test that a refused connection fails fast and an unreachable one times out
+TEST(IotPosixTransportTest, ConnectFailures)
+{
+    int port;
+    {
+        Listener closed;
+        ASSERT_TRUE(closed.open(AF_INET, 0, 16));
+        port = closed.port;
+    }
+    iot_transport_config config = fast_config();
+    void* ctx = nullptr;
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(iot_transport_open_with(&ctx, "127.0.0.1", std::to_string(port).c_str(), &config), -1);
+    EXPECT_LT(elapsed_ms(start), 500.0);
+    EXPECT_EQ(ctx, nullptr);
+
+    Listener silent;
+    if (!silent.open(AF_INET6, 0, 0)) {
+        GTEST_SKIP() << "IPv6 loopback unavailable";
+    }
+    silent.blackhole(AF_INET6);
+    config.connect_timeout_ms = 200;
+    start = std::chrono::steady_clock::now();
+    EXPECT_EQ(iot_transport_open_with(&ctx, "::1", silent.port_string().c_str(), &config), IOT_TRANSPORT_TIMEOUT);
+    EXPECT_GE(elapsed_ms(start), 190.0);
+    EXPECT_LT(elapsed_ms(start), 1000.0);
+}
+
+// Test that a dead IPv6 path costs one attempt delay, not a connect timeout
+TEST(IotPosixTransportTest, HappyEyeballsFallsBackToIPv4)
+{
+    Listener v6, v4;
+    if (!open_dual_stack(v6, v4, 0)) {
+        GTEST_SKIP() << "IPv6 loopback unavailable";
+    }
+    v6.blackhole(AF_INET6);
+    ASSERT_EQ(iot_transport_add_host("dual.test", "::1 127.0.0.1"), 0);
+
+    iot_transport_config config = fast_config();
+    void* ctx = nullptr;
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(iot_transport_open_with(&ctx, "dual.test", v4.port_string().c_str(), &config), 0);
+    double took = elapsed_ms(start);
+    EXPECT_GE(took, 90.0); // IPv6 got its head start
+    EXPECT_LT(took, 600.0);
+    int peer = v4.accept_one();
+    EXPECT_GE(peer, 0);
+    close(peer);
+    iot_transport_close(ctx);
+
+    // IPv4 won, so the next connect starts with it
+    start = std::chrono::steady_clock::now();
+    ASSERT_EQ(iot_transport_open_with(&ctx, "dual.test", v4.port_string().c_str(), &config), 0);
+    EXPECT_LT(elapsed_ms(start), 90.0);
+    peer = v4.accept_one();
+    EXPECT_GE(peer, 0);
+    close(peer);
+    iot_transport_close(ctx);
+    iot_transport_add_host("dual.test", nullptr);
+}
+
+// Test that a healthy IPv6 path wins without waiting
+TEST(IotPosixTransportTest, HappyEyeballsPrefersIPv6)
+{
+    Listener v6, v4;
+    if (!open_dual_stack(v6, v4, 16)) {
+        GTEST_SKIP() << "IPv6 loopback unavailable";
+    }
+    ASSERT_EQ(iot_transport_add_host("dual.test", "::1 127.0.0.1"), 0);
+
+    iot_transport_config config = fast_config();
+    void* ctx = nullptr;
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(iot_transport_open_with(&ctx, "dual.test", v6.port_string().c_str(), &config), 0);
+    EXPECT_LT(elapsed_ms(start), 90.0);
+    int peer = v6.accept_one();
+    EXPECT_GE(peer, 0);
+    close(peer);
+    iot_transport_close(ctx);
+    iot_transport_add_host("dual.test", nullptr);
+}
+
+// Test that pinned hosts bypass DNS and can be removed again
+TEST(IotPosixTransportTest, PinnedHosts)
+{
+    Listener server;
+    ASSERT_TRUE(server.open(AF_INET, 0, 16));
+    iot_transport_config config = fast_config();
+    void* ctx = nullptr;
+
+    ASSERT_EQ(iot_transport_add_host("broker.invalid", "127.0.0.1"), 0);
+    ASSERT_EQ(iot_transport_open_with(&ctx, "broker.invalid", server.port_string().c_str(), &config), 0);
+    iot_transport_close(ctx);
+
+    ASSERT_EQ(iot_transport_add_host("broker.invalid", nullptr), 0);
+    iot_transport_flush_dns();
+    EXPECT_NE(iot_transport_open_with(&ctx, "broker.invalid", server.port_string().c_str(), &config), 0);
+
+    EXPECT_EQ(iot_transport_add_host("bad.invalid", "not-an-address"), 0);
+    EXPECT_EQ(iot_transport_open_with(&ctx, "bad.invalid", "1", &config), -1);
+    iot_transport_add_host("bad.invalid", nullptr);
+    EXPECT_EQ(iot_transport_add_host(nullptr, "127.0.0.1"), -1);
+}
+
+// Test invalid arguments
+TEST(IotPosixTransportTest, InvalidInput)
+{
+    void* ctx = nullptr;
+    unsigned char buffer[4];
+    EXPECT_EQ(iot_transport_open(nullptr, "127.0.0.1", "1"), -1);
+    EXPECT_EQ(iot_transport_open(&ctx, nullptr, "1"), -1);
+    EXPECT_EQ(iot_transport_send(nullptr, buffer, sizeof(buffer)), -1);
+    EXPECT_EQ(iot_transport_recv(nullptr, buffer, sizeof(buffer)), -1);
+    iot_transport_close(nullptr);
+}
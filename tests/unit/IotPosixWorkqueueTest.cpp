@@ -0,0 +1,200 @@
+#include "interface/os.h"
+#include <atomic>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+namespace {
+
+void count_task(void* arg)
+{
+    static_cast<std::atomic<int>*>(arg)->fetch_add(1);
+}
+
+struct Fib {
+    struct iot_workqueue* wq;
+    int n;
+    long result;
+};
+
+// Naive recursive Fibonacci, each call joining a group of its two halves
+void fib_task(void* arg)
+{
+    Fib* fib = static_cast<Fib*>(arg);
+    if (fib->n < 2) {
+        fib->result = fib->n;
+        return;
+    }
+    Fib left = { fib->wq, fib->n - 1, 0 };
+    Fib right = { fib->wq, fib->n - 2, 0 };
+    struct iot_task_group* group = iot_task_group_create(fib->wq);
+    iot_task_group_run(group, fib_task, &left);
+    iot_task_group_run(group, fib_task, &right);
+    iot_task_group_destroy(group);
+    fib->result = left.result + right.result;
+}
+
+struct Spawner {
+    struct iot_task_group* group;
+    std::atomic<int>* count;
+    int depth;
+};
+
+// Adds tasks to its own group from inside a task
+void spawn_task(void* arg)
+{
+    Spawner* spawner = static_cast<Spawner*>(arg);
+    spawner->count->fetch_add(1);
+    if (spawner->depth == 0) {
+        delete spawner;
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        iot_task_group_run(spawner->group, spawn_task, new Spawner { spawner->group, spawner->count, spawner->depth - 1 });
+    }
+    delete spawner;
+}
+
+class IotPosixWorkqueueTest : public ::testing::TestWithParam<uint32_t> {
+protected:
+    void SetUp() override
+    {
+        wq = iot_workqueue_create("test_wq", GetParam(), 0);
+        ASSERT_NE(wq, nullptr);
+    }
+
+    void TearDown() override { EXPECT_EQ(iot_workqueue_destroy(wq), 0); }
+
+    struct iot_workqueue* wq = nullptr;
+};
+
+} // namespace
+
+TEST_P(IotPosixWorkqueueTest, SubmittedTasksRunBeforeDestroyReturns)
+{
+    EXPECT_EQ(iot_workqueue_workers(wq), GetParam());
+    std::atomic<int> count { 0 };
+    for (int i = 0; i < 10000; i++) {
+        ASSERT_EQ(iot_workqueue_submit(wq, count_task, &count), 0);
+    }
+    EXPECT_EQ(iot_workqueue_destroy(wq), 0);
+    EXPECT_EQ(count.load(), 10000);
+    wq = iot_workqueue_create("test_wq", GetParam(), 0);
+    ASSERT_NE(wq, nullptr);
+}
+
+TEST_P(IotPosixWorkqueueTest, GroupsWaitForNestedTasks)
+{
+    std::atomic<int> count { 0 };
+    struct iot_task_group* group = iot_task_group_create(wq);
+    ASSERT_NE(group, nullptr);
+    ASSERT_EQ(iot_task_group_run(group, spawn_task, new Spawner { group, &count, 10 }), 0);
+    EXPECT_EQ(iot_task_group_wait(group), 0);
+    EXPECT_EQ(count.load(), (1 << 11) - 1);
+
+    // Reusable after a wait
+    ASSERT_EQ(iot_task_group_run(group, count_task, &count), 0);
+    iot_task_group_destroy(group);
+    EXPECT_EQ(count.load(), 1 << 11);
+}
+
+TEST_P(IotPosixWorkqueueTest, TasksJoinTheirOwnGroups)
+{
+    Fib fib = { wq, 20, 0 };
+    struct iot_task_group* group = iot_task_group_create(wq);
+    ASSERT_EQ(iot_task_group_run(group, fib_task, &fib), 0);
+    iot_task_group_destroy(group);
+    EXPECT_EQ(fib.result, 6765);
+}
+
+TEST_P(IotPosixWorkqueueTest, ParallelForCoversTheRangeOnce)
+{
+    const size_t kCount = 100003;
+    std::vector<std::atomic<int>> hits(kCount);
+    auto body = [](void* arg, size_t begin, size_t end) {
+        auto* cells = static_cast<std::vector<std::atomic<int>>*>(arg);
+        for (size_t i = begin; i < end; i++) {
+            (*cells)[i].fetch_add(1);
+        }
+    };
+    for (size_t grain : { static_cast<size_t>(0), static_cast<size_t>(1), static_cast<size_t>(1000), kCount * 2 }) {
+        for (auto& hit : hits) {
+            hit.store(0);
+        }
+        ASSERT_EQ(iot_workqueue_parallel_for(wq, 0, kCount, grain, body, &hits), 0);
+        for (size_t i = 0; i < kCount; i++) {
+            ASSERT_EQ(hits[i].load(), 1) << "index " << i << " grain " << grain;
+        }
+    }
+
+    // Offset and empty ranges
+    std::atomic<int> calls { 0 };
+    auto check = [](void* arg, size_t begin, size_t end) {
+        EXPECT_GE(begin, 10u);
+        EXPECT_LE(end, 20u);
+        static_cast<std::atomic<int>*>(arg)->fetch_add(static_cast<int>(end - begin));
+    };
+    EXPECT_EQ(iot_workqueue_parallel_for(wq, 10, 20, 3, check, &calls), 0);
+    EXPECT_EQ(calls.load(), 10);
+    EXPECT_EQ(iot_workqueue_parallel_for(wq, 5, 5, 1, check, &calls), 0);
+    EXPECT_LT(iot_workqueue_parallel_for(wq, 6, 5, 1, check, &calls), 0);
+    EXPECT_EQ(calls.load(), 10);
+}
+
+TEST_P(IotPosixWorkqueueTest, NestedParallelFor)
+{
+    struct Ctx {
+        struct iot_workqueue* wq;
+        std::atomic<long> sum;
+    } ctx = { wq, { 0 } };
+    auto outer = [](void* arg, size_t begin, size_t end) {
+        Ctx* c = static_cast<Ctx*>(arg);
+        for (size_t i = begin; i < end; i++) {
+            auto inner = [](void* inner_arg, size_t b, size_t e) {
+                static_cast<Ctx*>(inner_arg)->sum.fetch_add(static_cast<long>(e - b));
+            };
+            iot_workqueue_parallel_for(c->wq, 0, 1000, 10, inner, c);
+        }
+    };
+    ASSERT_EQ(iot_workqueue_parallel_for(wq, 0, 64, 1, outer, &ctx), 0);
+    EXPECT_EQ(ctx.sum.load(), 64 * 1000);
+}
+
+TEST_P(IotPosixWorkqueueTest, SeveralSubmittingThreads)
+{
+    std::atomic<int> count { 0 };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&] {
+            struct iot_task_group* group = iot_task_group_create(wq);
+            for (int i = 0; i < 2000; i++) {
+                iot_task_group_run(group, count_task, &count);
+            }
+            iot_task_group_destroy(group);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(count.load(), 8000);
+}
+
+INSTANTIATE_TEST_SUITE_P(Workers, IotPosixWorkqueueTest, ::testing::Values(1u, 2u, 4u));
+
+TEST(IotPosixWorkqueueApiTest, RejectsBadArguments)
+{
+    EXPECT_LT(iot_workqueue_destroy(nullptr), 0);
+    EXPECT_EQ(iot_workqueue_workers(nullptr), 0u);
+    EXPECT_LT(iot_workqueue_submit(nullptr, count_task, nullptr), 0);
+    EXPECT_EQ(iot_task_group_create(nullptr), nullptr);
+    EXPECT_LT(iot_task_group_run(nullptr, count_task, nullptr), 0);
+    EXPECT_LT(iot_task_group_wait(nullptr), 0);
+
+    // 0 workers means one per CPU
+    struct iot_workqueue* wq = iot_workqueue_create(nullptr, 0, 0);
+    ASSERT_NE(wq, nullptr);
+    EXPECT_GE(iot_workqueue_workers(wq), 1u);
+    EXPECT_LT(iot_workqueue_submit(wq, nullptr, nullptr), 0);
+    EXPECT_LT(iot_workqueue_parallel_for(wq, 0, 1, 1, nullptr, nullptr), 0);
+    EXPECT_EQ(iot_workqueue_destroy(wq), 0);
+}
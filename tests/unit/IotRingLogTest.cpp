@@ -0,0 +1,431 @@
+#include "interface/filesystem.h"
+#include "storage/ring_log.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Record i: its number, padded to a length that varies with i
+std::string record(int i)
+{
+    std::string data = "rec-" + std::to_string(i) + "-";
+    data.append(static_cast<size_t>(i * 7 % 61), static_cast<char>('a' + i % 26));
+    return data;
+}
+
+class IotRingLogTest : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        char tmpl[] = "/tmp/iot_ring_test_XXXXXX";
+        ASSERT_NE(mkdtemp(tmpl), nullptr);
+        dir = tmpl;
+        path = dir + "/telemetry.ring";
+    }
+
+    void TearDown() override
+    {
+        if (log != nullptr) {
+            iot_ring_log_close(log);
+        }
+        iot_rmdir_recursive(dir.c_str());
+    }
+
+    void open(const struct iot_ring_log_config* config, const std::string& file = "")
+    {
+        log = iot_ring_log_open(file.empty() ? path.c_str() : file.c_str(), config);
+        ASSERT_NE(log, nullptr);
+    }
+
+    void close()
+    {
+        ASSERT_EQ(iot_ring_log_close(log), 0);
+        log = nullptr;
+    }
+
+    void append(int i)
+    {
+        std::string data = record(i);
+        ASSERT_EQ(iot_ring_log_append(log, data.data(), data.size()), 0);
+    }
+
+    // Every record from the cursor on
+    std::vector<std::string> read_all(struct iot_ring_log_cursor* cursor)
+    {
+        std::vector<std::string> records;
+        char buf[256];
+        size_t length = 0;
+        int ret;
+        while ((ret = iot_ring_log_read(log, cursor, buf, sizeof(buf), &length)) == 0) {
+            records.emplace_back(buf, length);
+        }
+        EXPECT_EQ(ret, IOT_RING_LOG_END);
+        return records;
+    }
+
+    std::vector<std::string> read_unread()
+    {
+        struct iot_ring_log_cursor cursor;
+        iot_ring_log_cursor_init(log, &cursor);
+        return read_all(&cursor);
+    }
+
+    // What a power cut would leave: the file as it is now, under another name
+    std::string snapshot()
+    {
+        std::string copy = dir + "/crash" + std::to_string(snapshots++) + ".ring";
+        struct iot_file* in = iot_fopen(path.c_str(), "r");
+        struct iot_file* out = iot_fopen(copy.c_str(), "w");
+        EXPECT_NE(in, nullptr);
+        EXPECT_NE(out, nullptr);
+        char buf[4096];
+        size_t n;
+        while ((n = iot_fread(buf, 1, sizeof(buf), in)) > 0) {
+            EXPECT_EQ(iot_fwrite(buf, 1, n, out), n);
+        }
+        iot_fclose(in);
+        iot_fclose(out);
+        return copy;
+    }
+
+    void patch(const std::string& file, size_t offset, char byte)
+    {
+        struct iot_file* f = iot_fopen(file.c_str(), "r+");
+        ASSERT_NE(f, nullptr);
+        ASSERT_EQ(iot_fseek(f, static_cast<long>(offset)), 0);
+        ASSERT_EQ(iot_fwrite(&byte, 1, 1, f), 1u);
+        ASSERT_EQ(iot_fclose(f), 0);
+    }
+
+    size_t file_size(const std::string& file) const
+    {
+        struct iot_stat st = {};
+        iot_stat(file.c_str(), &st);
+        return st.st_size;
+    }
+
+    std::string dir;
+    std::string path;
+    int snapshots = 0;
+    struct iot_ring_log* log = nullptr;
+};
+
+} // namespace
+
+TEST_F(IotRingLogTest, AppendAndReadInOrder)
+{
+    struct iot_ring_log_config config = {};
+    config.capacity = 4096;
+    open(&config);
+    EXPECT_EQ(file_size(path), 1024u + 4096u);
+
+    struct iot_ring_log_cursor cursor;
+    iot_ring_log_cursor_init(log, &cursor);
+    EXPECT_TRUE(read_all(&cursor).empty());
+    for (int i = 0; i < 10; i++) {
+        append(i);
+    }
+    std::vector<std::string> records = read_all(&cursor);
+    ASSERT_EQ(records.size(), 10u);
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ(records[i], record(i));
+    }
+
+    // The cursor picks up where it stopped
+    append(10);
+    ASSERT_EQ(iot_ring_log_append(log, nullptr, 0), 0);
+    records = read_all(&cursor);
+    ASSERT_EQ(records.size(), 2u);
+    EXPECT_EQ(records[0], record(10));
+    EXPECT_EQ(records[1], "");
+
+    // Too small a buffer leaves the cursor in place
+    iot_ring_log_cursor_init(log, &cursor);
+    char small[4];
+    size_t length = 0;
+    EXPECT_EQ(iot_ring_log_read(log, &cursor, small, sizeof(small), &length), IOT_RING_LOG_TOO_SMALL);
+    EXPECT_EQ(length, record(0).size());
+    EXPECT_EQ(read_all(&cursor).size(), 12u);
+
+    std::string huge(4096, 'x');
+    EXPECT_LT(iot_ring_log_append(log, huge.data(), huge.size()), 0);
+
+    struct iot_ring_log_stats stats;
+    iot_ring_log_get_stats(log, &stats);
+    EXPECT_EQ(stats.capacity, 4096u);
+    EXPECT_EQ(stats.records, 12u);
+    EXPECT_EQ(stats.unread, 12u);
+    EXPECT_EQ(stats.next_seq, 13u);
+    EXPECT_EQ(stats.lost, 0u);
+}
+
+TEST_F(IotRingLogTest, FullLogOverwritesOldest)
+{
+    struct iot_ring_log_config config = {};
+    config.capacity = 1024;
+    open(&config);
+    const int kRecords = 500;
+    for (int i = 0; i < kRecords; i++) {
+        append(i);
+    }
+    EXPECT_EQ(file_size(path), 1024u + 1024u);
+
+    // What is left is the newest records, contiguous and intact
+    std::vector<std::string> records = read_unread();
+    ASSERT_GT(records.size(), 5u);
+    size_t first = kRecords - records.size();
+    for (size_t i = 0; i < records.size(); i++) {
+        EXPECT_EQ(records[i], record(static_cast<int>(first + i)));
+    }
+    struct iot_ring_log_stats stats;
+    iot_ring_log_get_stats(log, &stats);
+    EXPECT_EQ(stats.records, records.size());
+    EXPECT_EQ(stats.lost, first);
+    EXPECT_LE(stats.used_bytes, 1024u);
+}
+
+TEST_F(IotRingLogTest, CommittedPositionSurvivesReopen)
+{
+    struct iot_ring_log_config config = {};
+    config.capacity = 4096;
+    open(&config);
+    for (int i = 0; i < 20; i++) {
+        append(i);
+    }
+    struct iot_ring_log_cursor cursor;
+    iot_ring_log_cursor_init(log, &cursor);
+    char buf[256];
+    size_t length;
+    for (int i = 0; i < 8; i++) {
+        ASSERT_EQ(iot_ring_log_read(log, &cursor, buf, sizeof(buf), &length), 0);
+    }
+    ASSERT_EQ(iot_ring_log_commit(log, &cursor), 0);
+    close();
+
+    // Capacity comes from the file, not the config
+    config.capacity = 8192;
+    open(&config);
+    std::vector<std::string> records = read_unread();
+    ASSERT_EQ(records.size(), 12u);
+    EXPECT_EQ(records[0], record(8));
+    append(20);
+    EXPECT_EQ(read_unread().back(), record(20));
+
+    struct iot_ring_log_stats stats;
+    iot_ring_log_get_stats(log, &stats);
+    EXPECT_EQ(stats.capacity, 4096u);
+    EXPECT_EQ(stats.records, 21u);
+    EXPECT_EQ(stats.unread, 13u);
+}
+
+TEST_F(IotRingLogTest, RecoveryScansPastCheckpoint)
+{
+    struct iot_ring_log_config config = {};
+    config.capacity = 8192;
+    config.checkpoint_interval = 1000;
+    open(&config);
+    for (int i = 0; i < 50; i++) {
+        append(i);
+    }
+    std::string crashed = snapshot();
+    ASSERT_EQ(iot_ring_log_close(log), 0);
+
+    log = iot_ring_log_open(crashed.c_str(), &config);
+    ASSERT_NE(log, nullptr);
+    struct iot_ring_log_stats stats;
+    iot_ring_log_get_stats(log, &stats);
+    EXPECT_EQ(stats.recovered, 50u);
+    EXPECT_EQ(stats.next_seq, 51u);
+    EXPECT_EQ(read_unread().size(), 50u);
+}
+
+TEST_F(IotRingLogTest, TornRecordEndsRecovery)
+{
+    struct iot_ring_log_config config = {};
+    config.capacity = 8192;
+    config.checkpoint_interval = 1000;
+    open(&config);
+    size_t offset = 1024;
+    for (int i = 0; i < 9; i++) {
+        offset += 16 + record(i).size();
+        append(i);
+    }
+    append(9);
+    std::string crashed = snapshot();
+    close();
+
+    // Half-written last record: its data does not match its CRC
+    patch(crashed, offset + 16 + 2, '#');
+    open(&config, crashed);
+    struct iot_ring_log_stats stats;
+    iot_ring_log_get_stats(log, &stats);
+    EXPECT_EQ(stats.recovered, 9u);
+    EXPECT_EQ(stats.next_seq, 10u);
+
+    // The next append takes its place
+    append(100);
+    std::vector<std::string> records = read_unread();
+    ASSERT_EQ(records.size(), 10u);
+    EXPECT_EQ(records[8], record(8));
+    EXPECT_EQ(records[9], record(100));
+}
+
+TEST_F(IotRingLogTest, RecoveryMatchesLiveLogAcrossWraps)
+{
+    struct iot_ring_log_config config = {};
+    config.capacity = 2048;
+    config.checkpoint_interval = 1000;
+    open(&config);
+    std::vector<std::string> crashes;
+    for (int i = 0; i < 600; i++) {
+        append(i);
+        if (i % 37 == 0) {
+            crashes.push_back(snapshot());
+            // Reading and committing moves the checkpoint too
+            if (i % 3 == 0) {
+                struct iot_ring_log_cursor cursor;
+                iot_ring_log_cursor_init(log, &cursor);
+                char buf[256];
+                size_t length;
+                ASSERT_EQ(iot_ring_log_read(log, &cursor, buf, sizeof(buf), &length), 0);
+                ASSERT_EQ(iot_ring_log_commit(log, &cursor), 0);
+            }
+        }
+    }
+    close();
+
+    // Each crash image recovers exactly the records stored when it was taken
+    int last = -1;
+    for (const std::string& crashed : crashes) {
+        last += last < 0 ? 1 : 37;
+        open(&config, crashed);
+        struct iot_ring_log_stats stats;
+        iot_ring_log_get_stats(log, &stats);
+        EXPECT_EQ(stats.next_seq, static_cast<uint64_t>(last) + 2) << crashed;
+        struct iot_ring_log_cursor cursor = { 0, 0 };
+        std::vector<std::string> records = read_all(&cursor);
+        ASSERT_EQ(records.size(), stats.records) << crashed;
+        ASSERT_FALSE(records.empty());
+        for (size_t i = 0; i < records.size(); i++) {
+            EXPECT_EQ(records[i], record(last - static_cast<int>(records.size() - 1 - i))) << crashed;
+        }
+        close();
+    }
+}
+
+TEST_F(IotRingLogTest, ReaderSkipsOverwrittenRecords)
+{
+    struct iot_ring_log_config config = {};
+    config.capacity = 1024;
+    open(&config);
+    append(0);
+    struct iot_ring_log_cursor cursor;
+    iot_ring_log_cursor_init(log, &cursor);
+    for (int i = 1; i < 200; i++) {
+        append(i);
+    }
+    std::vector<std::string> records = read_all(&cursor);
+    ASSERT_FALSE(records.empty());
+    EXPECT_EQ(records.back(), record(199));
+    EXPECT_EQ(records.front(), record(200 - static_cast<int>(records.size())));
+}
+
+namespace {
+
+struct Collector {
+    std::vector<std::string> records;
+    size_t fail_at = SIZE_MAX;
+};
+
+int collect(void* ctx, const uint8_t* data, size_t length)
+{
+    Collector* collector = static_cast<Collector*>(ctx);
+    if (collector->records.size() == collector->fail_at) {
+        return -1;
+    }
+    collector->records.emplace_back(reinterpret_cast<const char*>(data), length);
+    return 0;
+}
+
+} // namespace
+
+TEST_F(IotRingLogTest, DrainDeliversBatchesAndCommits)
+{
+    struct iot_ring_log_config config = {};
+    config.capacity = 8192;
+    open(&config);
+    for (int i = 0; i < 25; i++) {
+        append(i);
+    }
+    Collector collector;
+    EXPECT_EQ(iot_ring_log_drain(log, 10, collect, &collector), 10);
+    EXPECT_EQ(iot_ring_log_drain(log, 10, collect, &collector), 10);
+
+    // A failed send commits what went before and retries the rest
+    collector.fail_at = 22;
+    EXPECT_LT(iot_ring_log_drain(log, 10, collect, &collector), 0);
+    collector.fail_at = SIZE_MAX;
+    close();
+    open(&config);
+    EXPECT_EQ(iot_ring_log_drain(log, 10, collect, &collector), 3);
+    EXPECT_EQ(iot_ring_log_drain(log, 10, collect, &collector), 0);
+    ASSERT_EQ(collector.records.size(), 25u);
+    for (int i = 0; i < 25; i++) {
+        EXPECT_EQ(collector.records[i], record(i));
+    }
+}
+
+TEST_F(IotRingLogTest, ConcurrentWriterAndDrain)
+{
+    struct iot_ring_log_config config = {};
+    config.capacity = 16 * 1024;
+    open(&config);
+    const int kRecords = 20000;
+    std::atomic<bool> done { false };
+    std::thread writer([&] {
+        for (int i = 0; i < kRecords; i++) {
+            std::string data = record(i);
+            iot_ring_log_append(log, data.data(), data.size());
+        }
+        done = true;
+    });
+
+    Collector collector;
+    while (!done) {
+        ASSERT_GE(iot_ring_log_drain(log, 64, collect, &collector), 0);
+    }
+    writer.join();
+    ASSERT_GE(iot_ring_log_drain(log, SIZE_MAX, collect, &collector), 0);
+
+    // In order, never duplicated, ending with the last; gaps are overwrites
+    ASSERT_FALSE(collector.records.empty());
+    int previous = -1;
+    for (const std::string& data : collector.records) {
+        int i = std::atoi(data.c_str() + 4);
+        ASSERT_GT(i, previous);
+        ASSERT_EQ(data, record(i));
+        previous = i;
+    }
+    EXPECT_EQ(previous, kRecords - 1);
+    struct iot_ring_log_stats stats;
+    iot_ring_log_get_stats(log, &stats);
+    EXPECT_GE(stats.lost + collector.records.size(), static_cast<uint64_t>(kRecords));
+}
+
+TEST_F(IotRingLogTest, RejectsForeignFiles)
+{
+    struct iot_file* file = iot_fopen(path.c_str(), "w");
+    ASSERT_NE(file, nullptr);
+    ASSERT_EQ(iot_fwrite("not a ring log", 1, 14, file), 14u);
+    ASSERT_EQ(iot_fclose(file), 0);
+    EXPECT_EQ(iot_ring_log_open(path.c_str(), nullptr), nullptr);
+
+    struct iot_ring_log_config config = {};
+    config.capacity = 16;
+    EXPECT_EQ(iot_ring_log_open((dir + "/small.ring").c_str(), &config), nullptr);
+}
@@ -0,0 +1,179 @@
+#include "data/schema.h"
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define TEST_TELEMETRY_FIELDS(X) \
+    X(STRING, device_id, 16)     \
+    X(INT64, ts, 0)              \
+    X(DOUBLE, temperature, 0)    \
+    X(INT32, rssi, 0)            \
+    X(UINT32, uptime, 0)         \
+    X(BOOL, charging, 0)
+
+IO_SCHEMA_DECLARE(test_telemetry, TEST_TELEMETRY_FIELDS)
+IO_SCHEMA_DEFINE(test_telemetry, TEST_TELEMETRY_FIELDS)
+
+// A string past the 16-bit MessagePack length, between two other fields
+#define TEST_BLOB_FIELDS(X) \
+    X(INT32, before, 0)     \
+    X(STRING, blob, 70001)  \
+    X(INT32, after, 0)
+
+IO_SCHEMA_DECLARE(test_blob, TEST_BLOB_FIELDS)
+IO_SCHEMA_DEFINE(test_blob, TEST_BLOB_FIELDS)
+
+// Test fixture for schema-driven codecs
+class IotSchemaTest : public ::testing::Test {
+protected:
+    test_telemetry msg = {};
+
+    void SetUp() override
+    {
+        strcpy(msg.device_id, "sensor-\"01\"");
+        msg.ts = 1700000000123;
+        msg.temperature = 23.57;
+        msg.rssi = -67;
+        msg.uptime = 864023;
+        msg.charging = true;
+    }
+
+    static void expect_equal(const test_telemetry& a, const test_telemetry& b)
+    {
+        EXPECT_STREQ(a.device_id, b.device_id);
+        EXPECT_EQ(a.ts, b.ts);
+        EXPECT_DOUBLE_EQ(a.temperature, b.temperature);
+        EXPECT_EQ(a.rssi, b.rssi);
+        EXPECT_EQ(a.uptime, b.uptime);
+        EXPECT_EQ(a.charging, b.charging);
+    }
+};
+
+// Test: JSON output uses the pre-built keys and escapes string values
+TEST_F(IotSchemaTest, EncodeJson)
+{
+    uint8_t buffer[256];
+    size_t length = 0;
+    ASSERT_EQ(test_telemetry_encode(&msg, IO_FORMAT_JSON, buffer, sizeof(buffer), &length), 0);
+    EXPECT_EQ(std::string((const char*)buffer, length),
+        "{\"device_id\":\"sensor-\\\"01\\\"\",\"ts\":1700000000123,\"temperature\":23.57,"
+        "\"rssi\":-67,\"uptime\":864023,\"charging\":true}");
+}
+
+// Test: Both formats round-trip through the generated decoder
+TEST_F(IotSchemaTest, RoundTrip)
+{
+    for (enum io_format format : { IO_FORMAT_JSON, IO_FORMAT_MSGPACK }) {
+        uint8_t buffer[256];
+        size_t length = 0;
+        ASSERT_EQ(test_telemetry_encode(&msg, format, buffer, sizeof(buffer), &length), 0);
+
+        test_telemetry decoded;
+        ASSERT_EQ(test_telemetry_decode(&decoded, format, buffer, length), 0);
+        expect_equal(msg, decoded);
+    }
+}
+
+// Test: Strings of 64 KiB and more get a 32-bit MessagePack length
+TEST_F(IotSchemaTest, MsgpackLongStringRoundTrip)
+{
+    for (size_t size : { 0xFFFFu, 0x10000u, 70000u }) {
+        std::unique_ptr<test_blob> blob(new test_blob());
+        blob->before = 7;
+        memset(blob->blob, 'a', size);
+        blob->blob[size - 1] = 'z';
+        blob->after = -9;
+
+        std::vector<uint8_t> buffer(size + 64);
+        size_t length = 0;
+        ASSERT_EQ(test_blob_encode(blob.get(), IO_FORMAT_MSGPACK, buffer.data(), buffer.size(), &length), 0) << size;
+        std::unique_ptr<test_blob> decoded(new test_blob());
+        ASSERT_EQ(test_blob_decode(decoded.get(), IO_FORMAT_MSGPACK, buffer.data(), length), 0) << size;
+        EXPECT_EQ(decoded->before, 7);
+        EXPECT_EQ(strlen(decoded->blob), size);
+        EXPECT_EQ(memcmp(decoded->blob, blob->blob, size + 1), 0);
+        EXPECT_EQ(decoded->after, -9);
+    }
+}
+
+// Test: Schema output decodes as a regular IO
+TEST_F(IotSchemaTest, CompatibleWithIo)
+{
+    uint8_t buffer[256];
+    size_t length = 0;
+    ASSERT_EQ(test_telemetry_encode(&msg, IO_FORMAT_MSGPACK, buffer, sizeof(buffer), &length), 0);
+
+    IO* obj = io_deserialize(buffer, length, IO_FORMAT_MSGPACK);
+    ASSERT_NE(obj, nullptr);
+    EXPECT_STREQ(io_get_string(obj, "device_id"), "sensor-\"01\"");
+    EXPECT_EQ(io_get_int(obj, "rssi"), -67);
+    io_destroy(obj);
+}
+
+// Test: Unknown keys are skipped, missing keys stay zero and order does not matter
+TEST_F(IotSchemaTest, DecodeJsonLoose)
+{
+    const char json[] = " { \"extra\" : {\"a\":[1,2,{\"b\":null}]}, \"rssi\": -3,\n"
+                        "\"device_id\":\"x\\u00e9\\n\", \"temperature\": 1e2 } ";
+    test_telemetry decoded;
+    ASSERT_EQ(test_telemetry_decode(&decoded, IO_FORMAT_JSON, (const uint8_t*)json, sizeof(json) - 1), 0);
+    EXPECT_EQ(decoded.rssi, -3);
+    EXPECT_STREQ(decoded.device_id, "x\xC3\xA9\n");
+    EXPECT_DOUBLE_EQ(decoded.temperature, 100.0);
+    EXPECT_EQ(decoded.ts, 0);
+    EXPECT_FALSE(decoded.charging);
+}
+
+// Test: Type mismatches, overflow and truncation are rejected
+TEST_F(IotSchemaTest, DecodeRejectsInvalid)
+{
+    const char* inputs[] = {
+        "{\"rssi\":\"loud\"}",
+        "{\"rssi\":3000000000}",
+        "{\"uptime\":-1}",
+        "{\"device_id\":\"this id is far too long\"}",
+        "{\"rssi\":1",
+        "[1,2]",
+    };
+    for (const char* json : inputs) {
+        test_telemetry decoded;
+        EXPECT_EQ(test_telemetry_decode(&decoded, IO_FORMAT_JSON, (const uint8_t*)json, strlen(json)), -1) << json;
+    }
+}
+
+// Test: \u escapes take exactly four hex digits, and surrogates only in pairs
+TEST_F(IotSchemaTest, DecodeJsonUnicodeEscapes)
+{
+    const char json[] = "{\"device_id\":\"\\uD83D\\ude00\\u20AC\\/\"}";
+    test_telemetry decoded;
+    ASSERT_EQ(test_telemetry_decode(&decoded, IO_FORMAT_JSON, (const uint8_t*)json, sizeof(json) - 1), 0);
+    EXPECT_STREQ(decoded.device_id, "\xF0\x9F\x98\x80\xE2\x82\xAC/");
+
+    const char* inputs[] = {
+        "{\"device_id\":\"\\u12\"}",
+        "{\"device_id\":\"\\u-123\"}",
+        "{\"device_id\":\"\\u 123\"}",
+        "{\"device_id\":\"\\u0x12\"}",
+        "{\"device_id\":\"\\u0000\"}",
+        "{\"device_id\":\"\\uD83D\"}",
+        "{\"device_id\":\"\\uD83Dx\"}",
+        "{\"device_id\":\"\\uD83D\\u0041\"}",
+        "{\"device_id\":\"\\uDE00\"}",
+        "{\"device_id\":\"\\q\"}",
+    };
+    for (const char* input : inputs) {
+        EXPECT_EQ(test_telemetry_decode(&decoded, IO_FORMAT_JSON, (const uint8_t*)input, strlen(input)), -1) << input;
+    }
+}
+
+// Test: A short buffer fails and reports the required size
+TEST_F(IotSchemaTest, BufferTooSmall)
+{
+    uint8_t buffer[256];
+    size_t needed = 0;
+    size_t length = 0;
+    ASSERT_EQ(test_telemetry_encode(&msg, IO_FORMAT_JSON, buffer, sizeof(buffer), &needed), 0);
+    EXPECT_EQ(test_telemetry_encode(&msg, IO_FORMAT_JSON, buffer, needed - 1, &length), -1);
+    EXPECT_EQ(length, needed);
+}
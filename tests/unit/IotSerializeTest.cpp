@@ -0,0 +1,126 @@
+#include "data/serialize.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+// Test fixture for IO serialization
+class IotSerializeTest : public ::testing::Test {
+protected:
+    IO* obj = nullptr;
+
+    void SetUp() override
+    {
+        obj = io_create();
+        io_add_string(obj, "device_id", "sensor-01");
+        io_add_int(obj, "battery", 87);
+        io_add_int(obj, "rssi", -67);
+        io_add_int(obj, "uptime", 70000);
+        cJSON_AddNumberToObject(obj->json_obj, "temperature", 23.57);
+        cJSON_AddBoolToObject(obj->json_obj, "charging", true);
+        cJSON_AddNullToObject(obj->json_obj, "error");
+        cJSON* samples = cJSON_AddArrayToObject(obj->json_obj, "samples");
+        cJSON_AddItemToArray(samples, cJSON_CreateNumber(1.5));
+        cJSON_AddItemToArray(samples, cJSON_CreateNumber(-40000));
+        cJSON_AddItemToArray(samples, cJSON_CreateString("a \"quoted\"\n line"));
+    }
+
+    void TearDown() override
+    {
+        io_destroy(obj);
+    }
+
+    std::vector<uint8_t> encode(enum io_format format)
+    {
+        std::vector<uint8_t> buffer(io_serialized_size(obj, format));
+        size_t length = 0;
+        EXPECT_EQ(io_serialize(obj, format, buffer.data(), buffer.size(), &length), 0);
+        EXPECT_EQ(length, buffer.size());
+        return buffer;
+    }
+};
+
+// Collects streamed output for comparison with the buffer encoder
+static int append_to_vector(void* ctx, const uint8_t* data, size_t length)
+{
+    auto* out = static_cast<std::vector<uint8_t>*>(ctx);
+    out->insert(out->end(), data, data + length);
+    return 0;
+}
+
+// Test: MessagePack output round-trips to an identical IO
+TEST_F(IotSerializeTest, MsgpackRoundTrip)
+{
+    std::vector<uint8_t> encoded = encode(IO_FORMAT_MSGPACK);
+
+    IO* decoded = io_deserialize(encoded.data(), encoded.size(), IO_FORMAT_MSGPACK);
+    ASSERT_NE(decoded, nullptr);
+    EXPECT_TRUE(cJSON_Compare(obj->json_obj, decoded->json_obj, true));
+    EXPECT_STREQ(io_get_string(decoded, "device_id"), "sensor-01");
+    EXPECT_EQ(io_get_int(decoded, "rssi"), -67);
+    io_destroy(decoded);
+}
+
+// Test: JSON output round-trips to an identical IO
+TEST_F(IotSerializeTest, JsonRoundTrip)
+{
+    std::vector<uint8_t> encoded = encode(IO_FORMAT_JSON);
+
+    IO* decoded = io_deserialize(encoded.data(), encoded.size(), IO_FORMAT_JSON);
+    ASSERT_NE(decoded, nullptr);
+    EXPECT_TRUE(cJSON_Compare(obj->json_obj, decoded->json_obj, true));
+    io_destroy(decoded);
+}
+
+// Test: MessagePack is smaller than JSON for the same object
+TEST_F(IotSerializeTest, MsgpackIsSmallerThanJson)
+{
+    EXPECT_LT(io_serialized_size(obj, IO_FORMAT_MSGPACK), io_serialized_size(obj, IO_FORMAT_JSON));
+}
+
+// Test: Integers use the smallest MessagePack representation
+TEST_F(IotSerializeTest, MsgpackCompactIntegers)
+{
+    IO* small = io_create();
+    io_add_int(small, "a", 5);
+    uint8_t buffer[16];
+    size_t length = 0;
+    ASSERT_EQ(io_serialize(small, IO_FORMAT_MSGPACK, buffer, sizeof(buffer), &length), 0);
+    const uint8_t expected[] = { 0x81, 0xA1, 'a', 0x05 };
+    ASSERT_EQ(length, sizeof(expected));
+    EXPECT_EQ(memcmp(buffer, expected, sizeof(expected)), 0);
+    io_destroy(small);
+}
+
+// Test: Streaming output matches the buffer encoder byte for byte
+TEST_F(IotSerializeTest, StreamMatchesBuffer)
+{
+    for (enum io_format format : { IO_FORMAT_JSON, IO_FORMAT_MSGPACK }) {
+        std::vector<uint8_t> streamed;
+        EXPECT_EQ(io_serialize_stream(obj, format, append_to_vector, &streamed), 0);
+        EXPECT_EQ(streamed, encode(format));
+    }
+}
+
+// Test: A short buffer fails and reports the required size
+TEST_F(IotSerializeTest, BufferTooSmall)
+{
+    uint8_t buffer[8];
+    size_t length = 0;
+    EXPECT_EQ(io_serialize(obj, IO_FORMAT_MSGPACK, buffer, sizeof(buffer), &length), -1);
+    EXPECT_EQ(length, io_serialized_size(obj, IO_FORMAT_MSGPACK));
+}
+
+// Test: Truncated and malformed MessagePack input is rejected
+TEST_F(IotSerializeTest, MsgpackRejectsMalformedInput)
+{
+    std::vector<uint8_t> encoded = encode(IO_FORMAT_MSGPACK);
+    for (size_t length = 0; length < encoded.size(); length++) {
+        EXPECT_EQ(io_deserialize(encoded.data(), length, IO_FORMAT_MSGPACK), nullptr);
+    }
+
+    const uint8_t huge_map[] = { 0xDF, 0xFF, 0xFF, 0xFF, 0xFF };
+    EXPECT_EQ(io_deserialize(huge_map, sizeof(huge_map), IO_FORMAT_MSGPACK), nullptr);
+
+    const uint8_t trailing[] = { 0x80, 0x00 };
+    EXPECT_EQ(io_deserialize(trailing, sizeof(trailing), IO_FORMAT_MSGPACK), nullptr);
+}
@@ -0,0 +1,278 @@
+#include "data/state_sync.h"
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+static IO* parse(const char* json)
+{
+    IO* io = io_from_string(json);
+    EXPECT_NE(io, nullptr) << json;
+    return io;
+}
+
+// Set a number member, replacing any existing value
+static void io_set_int(IO* io, const char* key, int value)
+{
+    cJSON_DeleteItemFromObjectCaseSensitive(io->json_obj, key);
+    cJSON_AddNumberToObject(io->json_obj, key, value);
+}
+
+static std::string compact(const IO* io)
+{
+    char* str = cJSON_PrintUnformatted(io->json_obj);
+    std::string out(str);
+    cJSON_free(str);
+    return out;
+}
+
+// A subscriber holding the state rebuilt from the published messages
+struct Receiver {
+    IO* state = nullptr;
+    std::vector<std::string> messages;
+    std::vector<bool> full;
+    bool drop = false;
+
+    ~Receiver() { io_destroy(state); }
+
+    static int publish(void* ctx, IO* message, bool full)
+    {
+        auto* self = static_cast<Receiver*>(ctx);
+        self->messages.push_back(compact(message));
+        self->full.push_back(full);
+        if (self->drop) {
+            return 0;
+        }
+        if (full || self->state == nullptr) {
+            io_destroy(self->state);
+            self->state = io_create();
+            cJSON_Delete(self->state->json_obj);
+            self->state->json_obj = cJSON_Duplicate(message->json_obj, true);
+            return 0;
+        }
+        return io_merge_patch_apply(self->state, message);
+    }
+};
+
+// Check that the patch from one document to another rebuilds the target exactly
+static void expect_round_trip(const char* from_json, const char* to_json)
+{
+    IO* from = parse(from_json);
+    IO* to = parse(to_json);
+    IO* patch = io_merge_patch_create(from, to);
+    ASSERT_NE(patch, nullptr);
+    ASSERT_EQ(io_merge_patch_apply(from, patch), 0);
+    EXPECT_TRUE(cJSON_Compare(from->json_obj, to->json_obj, true))
+        << compact(from) << " != " << compact(to) << " via " << compact(patch);
+    io_destroy(patch);
+    io_destroy(from);
+    io_destroy(to);
+}
+
+// Test applying the examples from RFC 7386, appendix A
+TEST(IotStateSyncTest, ApplyRfcExamples)
+{
+    const char* cases[][3] = {
+        { "{\"a\":\"b\"}", "{\"a\":\"c\"}", "{\"a\":\"c\"}" },
+        { "{\"a\":\"b\"}", "{\"b\":\"c\"}", "{\"a\":\"b\",\"b\":\"c\"}" },
+        { "{\"a\":\"b\"}", "{\"a\":null}", "{}" },
+        { "{\"a\":\"b\",\"b\":\"c\"}", "{\"a\":null}", "{\"b\":\"c\"}" },
+        { "{\"a\":[\"b\"]}", "{\"a\":\"c\"}", "{\"a\":\"c\"}" },
+        { "{\"a\":\"c\"}", "{\"a\":[\"b\"]}", "{\"a\":[\"b\"]}" },
+        { "{\"a\":{\"b\":\"c\"}}", "{\"a\":{\"b\":\"d\",\"c\":null}}", "{\"a\":{\"b\":\"d\"}}" },
+        { "{\"a\":[{\"b\":\"c\"}]}", "{\"a\":[1]}", "{\"a\":[1]}" },
+        { "{\"e\":null}", "{\"a\":1}", "{\"e\":null,\"a\":1}" },
+        { "{}", "{\"a\":{\"bb\":{\"ccc\":null}}}", "{\"a\":{\"bb\":{}}}" },
+    };
+    for (const auto& c : cases) {
+        IO* target = parse(c[0]);
+        IO* patch = parse(c[1]);
+        IO* expected = parse(c[2]);
+        ASSERT_EQ(io_merge_patch_apply(target, patch), 0);
+        EXPECT_TRUE(cJSON_Compare(target->json_obj, expected->json_obj, true)) << compact(target);
+        io_destroy(target);
+        io_destroy(patch);
+        io_destroy(expected);
+    }
+}
+
+// Test that patches contain only what changed and rebuild the target
+TEST(IotStateSyncTest, CreateMinimalPatch)
+{
+    IO* from = parse("{\"fw\":\"1.0\",\"temp\":21.5,\"net\":{\"rssi\":-70,\"ip\":\"10.0.0.2\"},\"tags\":[1,2]}");
+    IO* to = parse("{\"fw\":\"1.0\",\"temp\":22,\"net\":{\"rssi\":-71,\"ip\":\"10.0.0.2\"},\"tags\":[1,2],\"up\":true}");
+    IO* patch = io_merge_patch_create(from, to);
+    ASSERT_NE(patch, nullptr);
+    EXPECT_EQ(compact(patch), "{\"temp\":22,\"net\":{\"rssi\":-71},\"up\":true}");
+    io_destroy(patch);
+
+    patch = io_merge_patch_create(from, from);
+    ASSERT_NE(patch, nullptr);
+    EXPECT_EQ(compact(patch), "{}");
+    io_destroy(patch);
+    io_destroy(from);
+    io_destroy(to);
+
+    expect_round_trip("{\"a\":{\"b\":1,\"c\":2}}", "{\"a\":5}");
+    expect_round_trip("{\"a\":5}", "{\"a\":{\"b\":{}}}");
+    expect_round_trip("{\"a\":{\"b\":1}}", "{}");
+    expect_round_trip("{\"a\":[1,2,3]}", "{\"a\":[1,2]}");
+    expect_round_trip("{}", "{\"a\":{}}");
+
+    // Null members cannot be written by a merge patch
+    from = parse("{\"a\":1}");
+    to = parse("{\"a\":null}");
+    EXPECT_EQ(io_merge_patch_create(from, to), nullptr);
+    io_destroy(from);
+    io_destroy(to);
+}
+
+// Test that reports start full, then carry only changed fields once acknowledged
+TEST(IotStateSyncTest, ReportsPatchesAfterAck)
+{
+    Receiver receiver;
+    IOStateSync* sync = io_state_sync_create(0, Receiver::publish, &receiver);
+    ASSERT_NE(sync, nullptr);
+
+    IO* state = io_create();
+    for (int i = 0; i < 80; i++) {
+        io_set_int(state, ("field_" + std::to_string(i)).c_str(), i);
+    }
+    ASSERT_EQ(io_state_sync_report(sync, state), 0);
+    ASSERT_EQ(receiver.full.size(), 1u);
+    EXPECT_TRUE(receiver.full[0]);
+    size_t full_size = receiver.messages[0].size();
+
+    // Unacknowledged: the next report is still a full snapshot
+    io_set_int(state, "field_3", 300);
+    ASSERT_EQ(io_state_sync_report(sync, state), 0);
+    EXPECT_TRUE(receiver.full[1]);
+    io_state_sync_ack(sync);
+
+    io_set_int(state, "field_7", 700);
+    ASSERT_EQ(io_state_sync_report(sync, state), 0);
+    ASSERT_EQ(receiver.full.size(), 3u);
+    EXPECT_FALSE(receiver.full[2]);
+    EXPECT_EQ(receiver.messages[2], "{\"field_7\":700}");
+    EXPECT_LT(receiver.messages[2].size() * 40, full_size);
+    EXPECT_TRUE(cJSON_Compare(receiver.state->json_obj, state->json_obj, true));
+
+    // Nothing changed since the last ack: nothing is published
+    io_state_sync_ack(sync);
+    ASSERT_EQ(io_state_sync_report(sync, state), 0);
+    EXPECT_EQ(receiver.full.size(), 3u);
+
+    io_destroy(state);
+    io_state_sync_destroy(sync);
+}
+
+// Test periodic and requested full snapshots
+TEST(IotStateSyncTest, FullSnapshots)
+{
+    Receiver receiver;
+    IOStateSync* sync = io_state_sync_create(3, Receiver::publish, &receiver);
+    IO* state = parse("{\"n\":0}");
+
+    for (int i = 0; i < 9; i++) {
+        io_set_int(state, "n", i);
+        ASSERT_EQ(io_state_sync_report(sync, state), 0);
+        io_state_sync_ack(sync);
+    }
+    std::vector<bool> expected = { true, false, false, false, true, false, false, false, true };
+    EXPECT_EQ(receiver.full, expected);
+
+    io_state_sync_request_full(sync);
+    io_set_int(state, "n", 100);
+    ASSERT_EQ(io_state_sync_report(sync, state), 0);
+    EXPECT_TRUE(receiver.full.back());
+
+    // Deleting an object cannot be patched safely: fall back to a full snapshot
+    io_state_sync_ack(sync);
+    IO* nested = parse("{\"n\":100,\"cfg\":{\"a\":1}}");
+    ASSERT_EQ(io_state_sync_report(sync, nested), 0);
+    EXPECT_FALSE(receiver.full.back());
+    io_state_sync_ack(sync);
+    ASSERT_EQ(io_state_sync_report(sync, state), 0);
+    EXPECT_TRUE(receiver.full.back());
+    EXPECT_TRUE(cJSON_Compare(receiver.state->json_obj, state->json_obj, true));
+
+    io_destroy(nested);
+    io_destroy(state);
+    io_state_sync_destroy(sync);
+}
+
+// Mutate a random path of a small nested document
+static void mutate(std::mt19937& rng, cJSON* object, int depth)
+{
+    static const char* keys[] = { "a", "b", "c", "d" };
+    const char* key = keys[rng() % 4];
+    cJSON* item = cJSON_GetObjectItemCaseSensitive(object, key);
+    switch (rng() % 8) {
+    case 0:
+        cJSON_DeleteItemFromObjectCaseSensitive(object, key);
+        break;
+    case 2:
+        cJSON_DeleteItemFromObjectCaseSensitive(object, key);
+        cJSON_AddNullToObject(object, key);
+        break;
+    case 1:
+        if (depth < 3) {
+            if (!cJSON_IsObject(item)) {
+                cJSON_DeleteItemFromObjectCaseSensitive(object, key);
+                item = cJSON_AddObjectToObject(object, key);
+            }
+            mutate(rng, item, depth + 1);
+            break;
+        }
+        // fall through
+    default:
+        cJSON_DeleteItemFromObjectCaseSensitive(object, key);
+        cJSON_AddNumberToObject(object, key, (double)(rng() % 5));
+        break;
+    }
+}
+
+// Test that the latest patch rebuilds the state whatever earlier reports were lost
+TEST(IotStateSyncTest, PatchesSurviveLostReports)
+{
+    std::mt19937 rng(42);
+    for (int round = 0; round < 50; round++) {
+        Receiver receiver;
+        IOStateSync* sync = io_state_sync_create(0, Receiver::publish, &receiver);
+        IO* state = parse("{\"a\":{\"b\":1},\"c\":2}");
+
+        for (int step = 0; step < 40; step++) {
+            for (int n = rng() % 3 + 1; n > 0; n--) {
+                mutate(rng, state->json_obj, 0);
+            }
+            bool before_first = receiver.state == nullptr;
+            receiver.drop = !before_first && rng() % 3 == 0;
+            size_t published = receiver.messages.size();
+            ASSERT_EQ(io_state_sync_report(sync, state), 0);
+            if (receiver.messages.size() == published || receiver.drop) {
+                continue;
+            }
+            ASSERT_TRUE(cJSON_Compare(receiver.state->json_obj, state->json_obj, true))
+                << "round " << round << " step " << step << ": " << compact(receiver.state) << " != "
+                << compact(state) << " via " << receiver.messages.back();
+            if (rng() % 2 == 0) {
+                io_state_sync_ack(sync);
+            }
+        }
+        io_destroy(state);
+        io_state_sync_destroy(sync);
+    }
+}
+
+// Test invalid input handling
+TEST(IotStateSyncTest, InvalidInput)
+{
+    Receiver receiver;
+    EXPECT_EQ(io_state_sync_create(0, nullptr, nullptr), nullptr);
+    IOStateSync* sync = io_state_sync_create(0, Receiver::publish, &receiver);
+    EXPECT_EQ(io_state_sync_report(sync, nullptr), -1);
+    EXPECT_EQ(io_merge_patch_create(nullptr, nullptr), nullptr);
+    EXPECT_EQ(io_merge_patch_apply(nullptr, nullptr), -1);
+    io_state_sync_destroy(sync);
+}
@@ -0,0 +1,301 @@
+#include "system/timer_wheel.h"
+#include <algorithm>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+namespace {
+
+const uint64_t kStart = 1700000000123ull;
+
+// A timer that records when it fired, by the time of the advance that fired it
+struct Probe {
+    struct iot_timer timer;
+    uint64_t* clock = nullptr;
+    std::vector<uint64_t> fired;
+};
+
+void record_fire(struct iot_timer* timer, void* arg)
+{
+    (void)timer;
+    Probe* probe = static_cast<Probe*>(arg);
+    probe->fired.push_back(*probe->clock);
+}
+
+class IotTimerWheelTest : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        now = kStart;
+        wheel = iot_timer_wheel_create(1, now);
+        ASSERT_NE(wheel, nullptr);
+    }
+
+    void TearDown() override { iot_timer_wheel_destroy(wheel); }
+
+    void init(Probe& probe)
+    {
+        probe.clock = &now;
+        iot_timer_init(&probe.timer, record_fire, &probe);
+    }
+
+    int advance_to(uint64_t time)
+    {
+        now = time;
+        return iot_timer_wheel_advance(wheel, now);
+    }
+
+    struct iot_timer_wheel* wheel = nullptr;
+    uint64_t now = 0;
+};
+
+} // namespace
+
+TEST_F(IotTimerWheelTest, FiresAtExpiryNotBefore)
+{
+    Probe probe;
+    init(probe);
+    ASSERT_EQ(iot_timer_start(wheel, &probe.timer, 10, 0), 0);
+    EXPECT_TRUE(iot_timer_pending(&probe.timer));
+    EXPECT_EQ(iot_timer_wheel_pending(wheel), 1u);
+    EXPECT_EQ(advance_to(kStart + 9), 0);
+    EXPECT_TRUE(probe.fired.empty());
+    EXPECT_EQ(advance_to(kStart + 10), 1);
+    EXPECT_EQ(probe.fired, (std::vector<uint64_t> { kStart + 10 }));
+    EXPECT_FALSE(iot_timer_pending(&probe.timer));
+    EXPECT_EQ(iot_timer_wheel_pending(wheel), 0u);
+    EXPECT_EQ(advance_to(kStart + 1000), 0);
+}
+
+TEST_F(IotTimerWheelTest, RoundsExpiryUpToTheTick)
+{
+    iot_timer_wheel_destroy(wheel);
+    wheel = iot_timer_wheel_create(10, kStart);
+    ASSERT_NE(wheel, nullptr);
+    Probe probe;
+    init(probe);
+    // kStart + 15 lies inside the tick that ends at kStart + 17
+    ASSERT_EQ(iot_timer_start(wheel, &probe.timer, 15, 0), 0);
+    EXPECT_EQ(advance_to(kStart + 16), 0);
+    EXPECT_EQ(advance_to(kStart + 17), 1);
+}
+
+TEST_F(IotTimerWheelTest, CancelAndRestart)
+{
+    Probe probe;
+    init(probe);
+    EXPECT_EQ(iot_timer_cancel(wheel, &probe.timer), 0);
+    ASSERT_EQ(iot_timer_start(wheel, &probe.timer, 100, 0), 0);
+    EXPECT_EQ(iot_timer_cancel(wheel, &probe.timer), 1);
+    EXPECT_FALSE(iot_timer_pending(&probe.timer));
+    EXPECT_EQ(advance_to(kStart + 200), 0);
+
+    // Restarting a pending timer moves it rather than adding it twice
+    ASSERT_EQ(iot_timer_start(wheel, &probe.timer, 100, 0), 0);
+    ASSERT_EQ(iot_timer_start(wheel, &probe.timer, 5000, 0), 0);
+    EXPECT_EQ(iot_timer_wheel_pending(wheel), 1u);
+    EXPECT_EQ(advance_to(kStart + 5199), 0);
+    EXPECT_EQ(advance_to(kStart + 5200), 1);
+    EXPECT_EQ(probe.fired.size(), 1u);
+}
+
+TEST_F(IotTimerWheelTest, PeriodicTimerDoesNotDrift)
+{
+    Probe probe;
+    init(probe);
+    ASSERT_EQ(iot_timer_start(wheel, &probe.timer, 100, 100), 0);
+    // Late and uneven advances still see one fire per elapsed period
+    for (uint64_t step : { 130, 50, 420, 1, 99, 300 }) {
+        advance_to(now + step);
+    }
+    EXPECT_EQ(probe.fired.size(), (now - kStart) / 100);
+    EXPECT_TRUE(iot_timer_pending(&probe.timer));
+    // Due in 99 ticks, a level up: reported no later than its expiry
+    EXPECT_GT(iot_timer_wheel_next_expiry(wheel), now);
+    EXPECT_LE(iot_timer_wheel_next_expiry(wheel), kStart + 1100);
+}
+
+TEST_F(IotTimerWheelTest, LongestPeriodStaysPeriodic)
+{
+    iot_timer_wheel_destroy(wheel);
+    wheel = iot_timer_wheel_create(10, kStart);
+    ASSERT_NE(wheel, nullptr);
+    Probe probe;
+    init(probe);
+    const uint32_t period = UINT32_MAX - 5;
+    ASSERT_EQ(iot_timer_start(wheel, &probe.timer, 10, period), 0);
+    EXPECT_EQ(advance_to(kStart + 20), 1);
+    EXPECT_TRUE(iot_timer_pending(&probe.timer));
+    EXPECT_EQ(advance_to(kStart + 10 + period), 0);
+    EXPECT_EQ(advance_to(kStart + 20 + period), 1);
+    EXPECT_EQ(probe.fired.size(), 2u);
+}
+
+TEST_F(IotTimerWheelTest, RandomTimersFireOnTheFirstAdvancePastExpiry)
+{
+    std::mt19937_64 random(7);
+    const size_t count = 5000;
+    std::vector<Probe> probes(count);
+    std::vector<uint64_t> expiry(count);
+    for (size_t i = 0; i < count; i++) {
+        init(probes[i]);
+        // From a few ticks to past the top level's span, to cover every level and the overflow slot
+        uint64_t delay = random() % (uint64_t { 1 } << (4 + (i % 34)));
+        expiry[i] = kStart + delay;
+        ASSERT_EQ(iot_timer_start(wheel, &probes[i].timer, delay, 0), 0);
+    }
+    // Advance by small steps, onto the nearest expiry exactly, or by steps
+    // of any size, as an event loop woken at odd times would
+    std::vector<uint64_t> sorted = expiry;
+    std::sort(sorted.begin(), sorted.end());
+    // Time of the previous advance; none has happened before kStart
+    uint64_t previous = kStart - 1;
+    while (iot_timer_wheel_pending(wheel) > 0) {
+        auto nearest = std::upper_bound(sorted.begin(), sorted.end(), now);
+        switch (random() % 3) {
+        case 0:
+            advance_to(now + 1 + random() % 64);
+            break;
+        case 1:
+            advance_to(nearest != sorted.end() ? *nearest : now + 1);
+            break;
+        default:
+            advance_to(now + 1 + random() % (uint64_t { 1 } << (random() % 36)));
+            break;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (!probes[i].fired.empty() && probes[i].fired.back() == now) {
+                ASSERT_GE(now, expiry[i]) << "timer " << i;
+                ASSERT_LT(previous, expiry[i]) << "timer " << i;
+            }
+        }
+        previous = now;
+    }
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(probes[i].fired.size(), 1u) << "timer " << i;
+    }
+}
+
+TEST_F(IotTimerWheelTest, TimersALapAheadWaitForTheirLap)
+{
+    // Just short of 64 and 64^2 level spans, these land in the slot their
+    // level has already cascaded for the current block, to go a lap later
+    std::vector<uint64_t> delays;
+    for (uint64_t span : { uint64_t { 1 } << 12, uint64_t { 1 } << 18 }) {
+        for (uint64_t back = 1; back <= 70; back += 3) {
+            delays.push_back(span - back);
+        }
+    }
+    advance_to(kStart + 1);
+    std::vector<Probe> probes(delays.size());
+    for (size_t i = 0; i < delays.size(); i++) {
+        init(probes[i]);
+        ASSERT_EQ(iot_timer_start(wheel, &probes[i].timer, delays[i], 0), 0);
+    }
+    uint64_t start = now;
+    while (iot_timer_wheel_pending(wheel) > 0) {
+        // Never in the past, which would keep an event loop spinning
+        ASSERT_GT(iot_timer_wheel_next_expiry(wheel), now);
+        advance_to(now + 1);
+        ASSERT_LE(now - start, uint64_t { 1 } << 18);
+    }
+    for (size_t i = 0; i < delays.size(); i++) {
+        EXPECT_EQ(probes[i].fired, (std::vector<uint64_t> { start + delays[i] })) << "delay " << delays[i];
+    }
+}
+
+TEST_F(IotTimerWheelTest, NextExpiryGuidesTicklessSleep)
+{
+    EXPECT_EQ(iot_timer_wheel_next_expiry(wheel), IOT_TIMER_WHEEL_IDLE);
+    EXPECT_EQ(iot_timer_wheel_timeout(wheel, now), UINT32_MAX);
+
+    Probe near;
+    Probe far;
+    init(near);
+    init(far);
+    ASSERT_EQ(iot_timer_start(wheel, &near.timer, 50, 0), 0);
+    ASSERT_EQ(iot_timer_start(wheel, &far.timer, 3600000, 0), 0);
+    EXPECT_EQ(iot_timer_wheel_next_expiry(wheel), kStart + 50);
+    EXPECT_EQ(iot_timer_wheel_timeout(wheel, kStart + 20), 30u);
+    EXPECT_EQ(iot_timer_wheel_timeout(wheel, kStart + 80), 0u);
+
+    // Sleeping for each reported timeout reaches the far expiry in a few wake-ups
+    int wakeups = 0;
+    while (far.fired.empty()) {
+        uint32_t timeout = iot_timer_wheel_timeout(wheel, now);
+        ASSERT_NE(timeout, UINT32_MAX);
+        advance_to(now + timeout);
+        ASSERT_LT(++wakeups, 20);
+    }
+    EXPECT_EQ(near.fired, (std::vector<uint64_t> { kStart + 50 }));
+    EXPECT_EQ(far.fired, (std::vector<uint64_t> { kStart + 3600000 }));
+}
+
+namespace {
+
+struct Chain {
+    struct iot_timer_wheel* wheel;
+    struct iot_timer self;
+    struct iot_timer victim;
+    int self_fires = 0;
+    int victim_fires = 0;
+};
+
+// Cancels the victim, due in the same tick, and restarts itself at once twice
+void chain_fire(struct iot_timer* timer, void* arg)
+{
+    Chain* chain = static_cast<Chain*>(arg);
+    chain->self_fires++;
+    iot_timer_cancel(chain->wheel, &chain->victim);
+    if (chain->self_fires < 3) {
+        iot_timer_start(chain->wheel, timer, 0, 0);
+    }
+}
+
+void victim_fire(struct iot_timer* timer, void* arg)
+{
+    (void)timer;
+    static_cast<Chain*>(arg)->victim_fires++;
+}
+
+} // namespace
+
+TEST_F(IotTimerWheelTest, CallbacksMayStartAndCancelTimers)
+{
+    Chain chain;
+    chain.wheel = wheel;
+    iot_timer_init(&chain.self, chain_fire, &chain);
+    iot_timer_init(&chain.victim, victim_fire, &chain);
+    // Started last, the victim sits ahead of self in the slot's list and fires first
+    ASSERT_EQ(iot_timer_start(wheel, &chain.self, 10, 0), 0);
+    ASSERT_EQ(iot_timer_start(wheel, &chain.victim, 10, 0), 0);
+    EXPECT_EQ(advance_to(kStart + 10), 2);
+    EXPECT_EQ(chain.victim_fires, 1);
+
+    // Now self fires first and cancels the victim before its turn; restarted
+    // from its own callback with no delay, self waits for the next tick
+    ASSERT_EQ(iot_timer_start(wheel, &chain.victim, 10, 0), 0);
+    ASSERT_EQ(iot_timer_start(wheel, &chain.self, 10, 0), 0);
+    EXPECT_EQ(advance_to(kStart + 20), 1);
+    EXPECT_EQ(chain.victim_fires, 1);
+    EXPECT_EQ(advance_to(kStart + 21), 1);
+    EXPECT_EQ(advance_to(kStart + 30), 0);
+    EXPECT_EQ(chain.self_fires, 3);
+    EXPECT_EQ(iot_timer_wheel_pending(wheel), 0u);
+}
+
+TEST_F(IotTimerWheelTest, DestroyStopsPendingTimers)
+{
+    Probe probe;
+    init(probe);
+    ASSERT_EQ(iot_timer_start(wheel, &probe.timer, 1000, 0), 0);
+    iot_timer_wheel_destroy(wheel);
+    wheel = nullptr;
+    EXPECT_FALSE(iot_timer_pending(&probe.timer));
+
+    EXPECT_LT(iot_timer_start(nullptr, &probe.timer, 1, 0), 0);
+    EXPECT_LT(iot_timer_cancel(nullptr, &probe.timer), 0);
+    EXPECT_LT(iot_timer_wheel_advance(nullptr, 0), 0);
+    EXPECT_EQ(iot_timer_wheel_next_expiry(nullptr), IOT_TIMER_WHEEL_IDLE);
+}